@@ -61,6 +61,9 @@ STEAMNETWORKINGSOCKETS_INTERFACE bool SteamAPI_IGameNetworkingSockets_ReceivedP2
 STEAMNETWORKINGSOCKETS_INTERFACE bool SteamAPI_IGameNetworkingSockets_GetCertificateRequest( IGameNetworkingSockets* self, int * pcbBlob, void * pBlob, GameNetworkingErrMsg & errMsg );
 STEAMNETWORKINGSOCKETS_INTERFACE bool SteamAPI_IGameNetworkingSockets_SetCertificate( IGameNetworkingSockets* self, const void * pCertificate, int cbCertificate, GameNetworkingErrMsg & errMsg );
 STEAMNETWORKINGSOCKETS_INTERFACE void SteamAPI_IGameNetworkingSockets_RunCallbacks( IGameNetworkingSockets* self );
+STEAMNETWORKINGSOCKETS_INTERFACE void SteamAPI_IGameNetworkingSockets_BroadcastMessage( IGameNetworkingSockets* self, GameNetworkingMessage_t * pMessage, int nConnections, const HGameNetConnection * pConnections, int64 * pOutMessageNumberOrResult );
+STEAMNETWORKINGSOCKETS_INTERFACE int SteamAPI_IGameNetworkingSockets_BroadcastMessageToPollGroup( IGameNetworkingSockets* self, GameNetworkingMessage_t * pMessage, HGameNetPollGroup hPollGroup );
+STEAMNETWORKINGSOCKETS_INTERFACE EResult SteamAPI_IGameNetworkingSockets_ConfigureConnectionLanes( IGameNetworkingSockets* self, HGameNetConnection hConn, int nNumLanes, const int * pLanePriorities, const uint16 * pLaneWeights );
 
 // IGameNetworkingUtils
 STEAMNETWORKINGSOCKETS_INTERFACE IGameNetworkingUtils *SteamAPI_GameNetworkingUtils_v003();
@@ -858,6 +858,12 @@ struct GameNetworkingMessage_t
 	/// Not used for received messages.
 	int64 m_nUserData;
 
+	/// For outbound messages, which lane to use?  See
+	/// IGameNetworkingSockets::ConfigureConnectionLanes.
+	/// For inbound messages, what lane was the message received on?
+	uint16 m_idxLane;
+	uint16 _pad1__;
+
 	/// You MUST call this when you're done with the object,
 	/// to free up memory, etc.
 	inline void Release();
@@ -871,6 +877,7 @@ struct GameNetworkingMessage_t
 	inline int64 GetConnectionUserData() const { return m_nConnUserData; }
 	inline GameNetworkingMicroseconds GetTimeReceived() const { return m_usecTimeReceived; }
 	inline int64 GetMessageNumber() const { return m_nMessageNumber; }
+	inline int GetLane() const { return m_idxLane; }
 #endif
 protected:
 	// Declare destructor protected.  You should never need to declare a message
@@ -1130,6 +1137,20 @@ enum EGameNetworkingConfigValue
 	k_EGameNetworkingConfig_SendRateMin = 10,
 	k_EGameNetworkingConfig_SendRateMax = 11,
 
+	/// [connection int32] Congestion control algorithm used to adjust the
+	/// send rate (within the limits set by SendRateMin/SendRateMax).
+	/// See k_nGameNetworkingConfig_CongestionControl_xxx.
+	///
+	/// - Fixed (default): the send rate is set from the initial ping and
+	///   then only clamped to the min/max values.
+	/// - BBR: estimate bottleneck bandwidth and minimum RTT from the
+	///   delivery rate measured from acks, and pace to that model,
+	///   periodically probing for more bandwidth.  (Loosely based on
+	///   draft-cardwell-iccrg-bbr-congestion-control.)
+	///
+	/// The setting may be changed on a live connection.
+	k_EGameNetworkingConfig_CongestionControl = 48,
+
 	/// [connection int32] Nagle time, in microseconds.  When SendMessage is called, if
 	/// the outgoing message is less than the size of the MTU, it will be
 	/// queued for a delay equal to the Nagle timer value.  This is to ensure
@@ -1139,6 +1160,20 @@ enum EGameNetworkingConfigValue
 	/// Default is 5000us (5ms).
 	k_EGameNetworkingConfig_NagleTime = 12,
 
+	/// [connection int32] Forward error correction for unreliable messages
+	/// that are too large to fit in a single packet.  Ordinarily, if any
+	/// packet carrying a piece of such a message is lost, the whole message
+	/// is lost.  When this is nonzero, the message is divided into
+	/// packet-sized chunks, and for every N chunks we also send one XOR parity
+	/// block, which allows the receiver to rebuild any one lost chunk in that
+	/// group.  Smaller values recover more loss, at the cost of more bandwidth:
+	/// the overhead is about 1/N of the message size.  (N is increased if
+	/// needed for very large messages, to stay within the receiver's
+	/// reassembly limits.)  Messages that fit in one packet are not affected.
+	/// Only used if the peer supports it.
+	/// 0=off (default), max 10
+	k_EGameNetworkingConfig_UnreliableFECGroupSize = 53,
+
 	/// [connection int32] Don't automatically fail IP connections that don't have
 	/// strong auth.  On clients, this means we will attempt the connection even if
 	/// we don't know our identity or can't get a cert.  On the server, it means that
@@ -1322,6 +1357,92 @@ enum EGameNetworkingConfigValue
 	k_EGameNetworkingConfig_FakeRateLimit_Recv_Rate = 44,
 	k_EGameNetworkingConfig_FakeRateLimit_Recv_Burst = 45,
 
+//
+// Low level UDP
+//
+
+	/// [global int32] Use UDP segmentation offload, where supported by the
+	/// OS (currently Linux only).  Bursts of full-sized packets to the same
+	/// host are handed to the kernel as a single buffer (GSO), and on
+	/// receive the kernel may coalesce packets from the same host (GRO).
+	/// We probe for support when a socket is opened, and fall back to
+	/// ordinary sends and receives if it is not available.  Receive
+	/// offload only applies to sockets opened after this is set.
+	/// 0=disabled (default), 1=enabled
+	k_EGameNetworkingConfig_UDP_SegmentationOffload = 46,
+
+	/// [global int32] Number of receive worker threads (currently Linux
+	/// only).  When nonzero, reading datagrams off of sockets, decrypting
+	/// data packets, and processing them for established UDP connections
+	/// is done by these threads, in parallel, holding only the lock of the
+	/// connection, not the global lock.  Anything else (handshakes, inline
+	/// stats, state changes, simulated network conditions) is handed to the
+	/// service thread.  Sockets are divided among the workers, and listen
+	/// sockets are split into SO_REUSEPORT shards, one per worker, with
+	/// packets steered to a shard by connection ID.  This value is read when
+	/// the library is initialized.
+	/// 0=disabled (default), max 16
+	k_EGameNetworkingConfig_RecvWorkerThreads = 47,
+
+	/// [global int32] Check the signatures in incoming connection requests
+	/// in batches.  Connect requests on a listen socket that pass the cheap
+	/// checks are queued, and once per service pass (or when enough have
+	/// piled up) the signatures they contain are verified all at once, which
+	/// is several times cheaper than checking them one by one.  This matters
+	/// when many clients connect at the same time, such as when a server
+	/// restarts.  The extra latency is negligible.
+	/// 0=check each request as it arrives, 1=batch (default)
+	k_EGameNetworkingConfig_HandshakeBatchVerify = 49,
+
+	/// [global int32] Number of threads used to do the public key crypto
+	/// for incoming connection requests.  When nonzero, checking the
+	/// signatures and doing the key exchange for connect requests on a listen
+	/// socket happens on these threads, without holding the global lock.
+	/// While that's in progress, the request just waits in a queue.  When it
+	/// is done, the request is picked up again by the service thread, a few
+	/// at a time, so that a flood of connection attempts doesn't delay
+	/// processing of packets for connections that are already established.
+	/// If the workers fall too far behind, new requests are dropped, and the
+	/// client will retry.  Only used when k_EGameNetworkingConfig_HandshakeBatchVerify
+	/// is on.  This value is read when the library is initialized.
+	/// 0=do the work inline (default), max 16
+	k_EGameNetworkingConfig_HandshakeCryptoThreads = 50,
+
+	/// [global int32] Max rate of connect requests per second that a listen
+	/// socket will process from any one source address prefix (/24 for IPv4,
+	/// /48 for IPv6).  Short bursts of up to twice this many are allowed.
+	/// Only requests that carry a valid challenge count against the limit,
+	/// so spoofed floods cannot use up the allowance of a legitimate
+	/// network.  Requests over the limit are dropped before we parse them,
+	/// and the client will retry.  Prefixes are hashed into a fixed number of
+	/// buckets, so unrelated networks may occasionally share a limit.
+	/// 0=no limit.  Default is 32
+	k_EGameNetworkingConfig_ConnectRequestRateLimit = 51,
+
+	/// [global int32] Pace outgoing packets.  This is the most send time,
+	/// in microseconds, that a connection may "catch up" on at once, if it
+	/// was not able to send when it wanted to, for example because the
+	/// service thread woke up late.  Without a limit, those packets are
+	/// sent back to back, and those microbursts can overflow the shallow
+	/// buffers in consumer routers.  When pacing, the service thread also
+	/// wakes up with microsecond precision where the OS supports it
+	/// (currently Linux), rather than millisecond precision, so that it
+	/// can send each packet close to when it is due.
+	/// 0=no pacing.  Default is 250
+	k_EGameNetworkingConfig_SendPacingMaxBurst = 52,
+
+	/// [global int32] Ask the kernel to timestamp incoming datagrams, where
+	/// supported by the OS (currently Linux only).  Ping and jitter are then
+	/// measured from the time the packet arrived at the host, rather than
+	/// the time we got around to processing it, so they are not inflated by
+	/// delays in waking up the service thread, lock contention, etc.  The
+	/// difference is reported separately in the connection's detailed status
+	/// as receive processing latency.  The kernel does a bit of extra work
+	/// for each packet, which is negligible unless you are receiving a very
+	/// high packet rate.  Only applies to sockets opened after this is set.
+	/// 0=disabled, 1=enabled (default)
+	k_EGameNetworkingConfig_RecvKernelTimestamps = 54,
+
 //
 // Callbacks
 //
@@ -1514,6 +1635,10 @@ const int k_nGameNetworkingConfig_P2P_Transport_ICE_Enable_Private = 2; // host
 const int k_nGameNetworkingConfig_P2P_Transport_ICE_Enable_Public = 4; // STUN reflexive addresses, or host address that isn't a "private" address
 const int k_nGameNetworkingConfig_P2P_Transport_ICE_Enable_All = 0x7fffffff;
 
+// Values for k_EGameNetworkingConfig_CongestionControl
+const int k_nGameNetworkingConfig_CongestionControl_Fixed = 0; // Rate is only clamped to SendRateMin/SendRateMax
+const int k_nGameNetworkingConfig_CongestionControl_BBR = 1; // Delivery rate based bandwidth estimation
+
 /// In a few places we need to set configuration options on listen sockets and connections, and
 /// have them take effect *before* the listen socket or connection really starts doing anything.
 /// Creating the object and then setting the options "immediately" after creation doesn't work
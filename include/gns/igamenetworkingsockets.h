@@ -703,6 +703,60 @@ public:
 	/// You don't need to call this if you are using Steam's callback dispatch
 	/// mechanism (SteamAPI_RunCallbacks and SteamGameserver_RunCallbacks).
 	virtual void RunCallbacks() = 0;
+
+	//
+	// Methods below were added after this interface version was published.
+	// They are at the end, so that the vtable layout is compatible with
+	// code built against the earlier headers.
+	//
+
+	/// Send the same message to many connections, without copying the payload
+	/// for each connection.  This is useful for sending a snapshot or event
+	/// to all of the players on a server.
+	///
+	/// Allocate and fill in the message as described for SendMessages.  You
+	/// must fill in m_nFlags.  m_conn is ignored.  The library takes ownership
+	/// of the message, and the payload is freed (using m_pfnFreeData, if you
+	/// supplied your own buffer) once every connection is done with it.  For
+	/// reliable messages, that means when it has been acknowledged, so your
+	/// buffer may need to remain valid for a while.
+	///
+	/// pOutMessageNumberOrResult is an optional array with one entry per
+	/// connection, filled in the same way as for SendMessages.
+	virtual void BroadcastMessage( GameNetworkingMessage_t *pMessage, int nConnections, const HGameNetConnection *pConnections, int64 *pOutMessageNumberOrResult ) = 0;
+
+	/// Same as BroadcastMessage, but sends to all of the connections in a poll group.
+	/// Returns the number of connections the message was queued on, or -1 if the
+	/// poll group handle is invalid.  (In which case the message is released.)
+	virtual int BroadcastMessageToPollGroup( GameNetworkingMessage_t *pMessage, HGameNetPollGroup hPollGroup ) = 0;
+
+	/// Configure multiple outbound message streams ("lanes") on a connection, and
+	/// control head-of-line blocking between them.  Messages within a given lane
+	/// are always sent in the order they are queued, but messages from different
+	/// lanes may be sent out of order.  Each lane has its own reliable stream, so
+	/// if a packet carrying reliable data for one lane is lost, reliable messages
+	/// in the other lanes are still delivered while we retransmit it.  Use the
+	/// m_idxLane field of GameNetworkingMessage_t to select the lane when you send
+	/// with SendMessages.  SendMessageToConnection always uses lane 0.  Received
+	/// messages have m_idxLane set to the lane they were sent on.  Message numbers
+	/// are shared by all the lanes on a connection.
+	///
+	/// pLanePriorities controls strict priority: lanes with a lower value are
+	/// always sent first.  Among lanes with the same priority, pLaneWeights
+	/// controls how the bandwidth is shared.  (A lane with weight 2 gets twice
+	/// the bandwidth of a lane with weight 1, when both have data to send.)
+	/// Either may be NULL, in which case all lanes have priority 0 and weight 1.
+	///
+	/// nNumLanes must be at least the current number of lanes (you cannot remove
+	/// lanes) and no more than 255.  Both peers must be running a version that
+	/// supports lanes.  You can call this before the connection is established,
+	/// but if it turns out the peer doesn't support lanes, the connection will fail.
+	///
+	/// Returns:
+	/// k_EResultInvalidParam: invalid connection handle, or the lane configuration is invalid
+	/// k_EResultInvalidState: connection is in an invalid state, or the peer doesn't support lanes
+	/// k_EResultNoConnection: connection has ended
+	virtual EResult ConfigureConnectionLanes( HGameNetConnection hConn, int nNumLanes, const int *pLanePriorities, const uint16 *pLaneWeights ) = 0;
 protected:
 	~IGameNetworkingSockets(); // Silence some warnings
 };
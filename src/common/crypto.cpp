@@ -2,6 +2,17 @@
 
 #include "crypto.h"
 
+#if defined(__i386__) || defined(__x86_64__)
+	#include <cpuid.h>
+#elif defined(_MSC_VER) && ( defined(_M_IX86) || defined(_M_X64) )
+	#include <intrin.h>
+#elif defined(__aarch64__) && defined(__linux__)
+	#include <sys/auxv.h>
+	#include <asm/hwcap.h>
+#elif defined(_M_ARM64)
+	#include "winlite.h"
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // SipHash, used for challenge generation
@@ -98,6 +109,38 @@ uint64_t CCrypto::SipHash( const void *data, size_t inlen, const CCrypto::SipHas
   return b;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Check for hardware AES support
+//-----------------------------------------------------------------------------
+static bool DetectHardwareAES()
+{
+#if defined(__i386__) || defined(__x86_64__)
+	unsigned a, b, c, d;
+	if ( !__get_cpuid( 1, &a, &b, &c, &d ) )
+		return false;
+	return ( c & bit_AES ) && ( c & bit_PCLMUL );
+#elif defined(_MSC_VER) && ( defined(_M_IX86) || defined(_M_X64) )
+	int regs[4];
+	__cpuid( regs, 1 );
+	return ( regs[2] & (1<<25) ) && ( regs[2] & (1<<1) );
+#elif defined(__aarch64__) && defined(__linux__)
+	const unsigned long hwcap = getauxval( AT_HWCAP );
+	return ( hwcap & HWCAP_AES ) && ( hwcap & HWCAP_PMULL );
+#elif defined(__aarch64__) && defined(__APPLE__)
+	return true; // All Apple ARM64 chips have the crypto extensions
+#elif defined(_M_ARM64)
+	return IsProcessorFeaturePresent( PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE ) != FALSE;
+#else
+	return false;
+#endif
+}
+
+bool CCrypto::BHasHardwareAES()
+{
+	static const bool s_bHasHardwareAES = DetectHardwareAES();
+	return s_bHasHardwareAES;
+}
+
 #ifdef DBGFLAG_VALIDATE
 //-----------------------------------------------------------------------------
 // Purpose: validates memory structures
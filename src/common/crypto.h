@@ -21,22 +21,57 @@ class SymmetricCryptContextBase
 {
 public:
 	SymmetricCryptContextBase();
-	~SymmetricCryptContextBase() { Wipe(); }
-	void Wipe();
+	~SymmetricCryptContextBase() { WipeContext(); }
 
 protected:
+
+	// Free the crypto library context.  Derived classes expose this
+	// through their own Wipe(), along with any state of their own.
+	void WipeContext();
+
 	void *m_ctx;
 
 	uint32 m_cbIV, m_cbTag;
 };
 
+// One packet in a call to AES_GCM_EncryptContext::EncryptBatch or
+// AES_GCM_DecryptContext::DecryptBatch.  Every packet has its own IV
+// (and optional AAD); the key, IV size and tag size come from the context.
+struct AES_GCM_BatchPacket_t
+{
+	const void *m_pIn; // Plaintext when encrypting, ciphertext+tag when decrypting
+	uint32 m_cbIn;
+	const void *m_pIV;
+	const void *m_pAAD; // Optional additional authentication data
+	uint32 m_cbAAD;
+	void *m_pOut; // May be the same as m_pIn
+	uint32 m_cbOut; // In: size of the output buffer.  Out: number of bytes written, 0 on failure
+	bool m_bOK; // Out: true if the packet was encrypted, or decrypted and authenticated
+};
+
+// Expanded key and GHASH powers used by the multi-buffer batch path
+struct AES_GCM_MultiBufferKey;
+
 // Base class for AES-GCM encryption and ddecryption
 class AES_GCM_CipherContext : public SymmetricCryptContextBase
 {
 public:
+	AES_GCM_CipherContext() : m_pMultiBufferKey( nullptr ) {}
+	~AES_GCM_CipherContext() { WipeMultiBufferKey(); }
+	void Wipe() { WipeMultiBufferKey(); WipeContext(); }
 
 	// Initialize context with the specified private key, IV size, and tag size
 	bool InitCipher( const void *pKey, size_t cbKey, size_t cbIV, size_t cbTag, bool bEncrypt );
+
+protected:
+
+	// If the CPU can run the multi-buffer path (VAES + VPCLMULQDQ) and the
+	// parameters are ones it handles, set it up.  Otherwise, batches are just
+	// processed one packet at a time using the normal implementation.
+	void InitMultiBufferKey( const void *pKey, size_t cbKey, size_t cbIV, size_t cbTag );
+	void WipeMultiBufferKey();
+
+	AES_GCM_MultiBufferKey *m_pMultiBufferKey;
 };
 
 class AES_GCM_EncryptContext : public AES_GCM_CipherContext
@@ -46,7 +81,10 @@ public:
 	// Initialize context with the specified private key, IV size, and tag size
 	inline bool Init( const void *pKey, size_t cbKey, size_t cbIV, size_t cbTag )
 	{
-		return InitCipher( pKey, cbKey, cbIV, cbTag, true );
+		if ( !InitCipher( pKey, cbKey, cbIV, cbTag, true ) )
+			return false;
+		InitMultiBufferKey( pKey, cbKey, cbIV, cbTag );
+		return true;
 	}
 
 	// Encrypt data and append auth tag
@@ -56,10 +94,80 @@ public:
 		void *pEncryptedDataAndTag, uint32 *pcbEncryptedDataAndTag,
 		const void *pAdditionalAuthenticationData, size_t cbAuthenticationData // Optional additional authentication data.  Not encrypted, but will be included in the tag, so it can be authenticated.
 	);
+
+	// Encrypt a batch of packets, each with its own IV, and append the auth
+	// tags.  This is much cheaper per packet than calling Encrypt() in a loop
+	// when the packets are small.  Returns the number of packets encrypted.
+	int EncryptBatch( AES_GCM_BatchPacket_t *pPackets, int nPackets );
 };
 
 class AES_GCM_DecryptContext : public AES_GCM_CipherContext
 {
+public:
+
+	// Initialize context with the specified private key, IV size, and tag size
+	inline bool Init( const void *pKey, size_t cbKey, size_t cbIV, size_t cbTag )
+	{
+		if ( !InitCipher( pKey, cbKey, cbIV, cbTag, false ) )
+			return false;
+		InitMultiBufferKey( pKey, cbKey, cbIV, cbTag );
+		return true;
+	}
+
+	// Decrypt data and check auth tag, which is assumed to be at the end
+	bool Decrypt(
+		const void *pEncryptedDataAndTag, size_t cbEncryptedDataAndTag,
+		const void *pIV,
+		void *pPlaintextData, uint32 *pcbPlaintextData,
+		const void *pAdditionalAuthenticationData, size_t cbAuthenticationData // Optional additional authentication data.  Not encrypted, but will be included in the tag, so it can be authenticated.
+	);
+
+	// Decrypt a batch of packets, each with its own IV, and check their auth
+	// tags.  Packets that fail are flagged individually, and the contents of
+	// their output buffer are undefined.  Returns the number of packets
+	// decrypted OK.
+	int DecryptBatch( AES_GCM_BatchPacket_t *pPackets, int nPackets );
+};
+
+// Base class for ChaCha20-Poly1305 (RFC 8439) encryption and decryption.
+// Works just like the AES-GCM contexts, but the only parameters supported
+// are a 256-bit key, 96-bit IV, and 128-bit tag.  This is used on CPUs that
+// do not have hardware AES support, where it is several times faster.
+class ChaCha20Poly1305_CipherContext
+{
+public:
+	ChaCha20Poly1305_CipherContext();
+	~ChaCha20Poly1305_CipherContext() { Wipe(); }
+	void Wipe();
+
+	// Initialize context with the specified private key, IV size, and tag size
+	bool InitCipher( const void *pKey, size_t cbKey, size_t cbIV, size_t cbTag, bool bEncrypt );
+
+protected:
+	void *m_ctx;
+};
+
+class ChaCha20Poly1305_EncryptContext : public ChaCha20Poly1305_CipherContext
+{
+public:
+
+	// Initialize context with the specified private key, IV size, and tag size
+	inline bool Init( const void *pKey, size_t cbKey, size_t cbIV, size_t cbTag )
+	{
+		return InitCipher( pKey, cbKey, cbIV, cbTag, true );
+	}
+
+	// Encrypt data and append auth tag
+	bool Encrypt(
+		const void *pPlaintextData, size_t cbPlaintextData,
+		const void *pIV,
+		void *pEncryptedDataAndTag, uint32 *pcbEncryptedDataAndTag,
+		const void *pAdditionalAuthenticationData, size_t cbAuthenticationData // Optional additional authentication data.  Not encrypted, but will be included in the tag, so it can be authenticated.
+	);
+};
+
+class ChaCha20Poly1305_DecryptContext : public ChaCha20Poly1305_CipherContext
+{
 public:
 
 	// Initialize context with the specified private key, IV size, and tag size
@@ -80,6 +188,15 @@ public:
 namespace CCrypto
 {
 	void Init();
+
+	// Does this CPU have instructions that make AES-GCM fast?  (AES-NI and
+	// PCLMULQDQ on x86, the crypto extensions on ARM.)  If not, then
+	// ChaCha20-Poly1305 is the better choice.
+	bool BHasHardwareAES();
+
+	// Can AES-GCM be used at all?  Some backends only implement
+	// it using the hardware instructions.
+	bool BCanUseAESGCM();
 	
 	// Symmetric encryption and authentication using AES-GCM.
 	bool SymmetricAuthEncryptWithIV(
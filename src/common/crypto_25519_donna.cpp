@@ -4,7 +4,7 @@
 #include "crypto_25519.h"
 #include <tier0/dbg.h>
 
-#ifdef VALVE_CRYPTO_25519_DONNA
+#if defined( VALVE_CRYPTO_25519_DONNA ) || defined( VALVE_CRYPTO_25519_DONNA_BATCH )
 
 #ifdef _WIN64
 #include "intrin.h"
@@ -27,6 +27,7 @@ void curved25519_scalarmult_basepoint_sse2( curved25519_key pk, const curved2551
 void ed25519_publickey_sse2( const ed25519_secret_key sk, ed25519_public_key pk );
 int ed25519_sign_open_sse2( const unsigned char *m, size_t mlen, const ed25519_public_key pk, const ed25519_signature RS );
 void ed25519_sign_sse2( const unsigned char *m, size_t mlen, const ed25519_secret_key sk, const ed25519_public_key pk, ed25519_signature RS );
+int ed25519_sign_open_batch_sse2( const unsigned char **m, size_t *mlen, const unsigned char **pk, const unsigned char **RS, size_t num, int *valid );
 
 #ifdef OSX // We can assume SSE2 for all Intel macs running 32-bit code
 #define CHOOSE_25519_IMPL( func ) func##_sse2
@@ -127,6 +128,52 @@ static bool CheckSSE2Technology()
 #endif
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Source of the random scalars used by ed25519_sign_open_batch.  We
+//          build with ED25519_CUSTOMRNG, so it's up to us to provide this.
+//-----------------------------------------------------------------------------
+extern "C" void ed25519_randombytes_unsafe( void *p, size_t len )
+{
+	CCrypto::GenerateRandomBlock( p, (int)len );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Verify a batch of ed25519 signatures
+//-----------------------------------------------------------------------------
+bool CCrypto::VerifySignatureBatch( int nSignatures, const uint8 *const *ppPublicKey, const void *const *ppData, const size_t *pcbData, const uint8 *const *ppSignature, bool *pbValid )
+{
+	if ( nSignatures <= 0 )
+		return true;
+
+	// ed25519_sign_open_batch works in batches of up to 64
+	// internally.  We just need to convert the arguments.
+	// It won't modify any of the inputs, it just isn't
+	// const-correct.
+	int nResult = 0;
+	const int k_nChunk = 64;
+	int valid[ k_nChunk ];
+	size_t cbData[ k_nChunk ];
+	for ( int idxStart = 0 ; idxStart < nSignatures ; idxStart += k_nChunk )
+	{
+		const int n = ( nSignatures - idxStart < k_nChunk ) ? nSignatures - idxStart : k_nChunk;
+		for ( int i = 0 ; i < n ; ++i )
+			cbData[i] = pcbData[ idxStart+i ];
+		nResult |= CHOOSE_25519_IMPL( ed25519_sign_open_batch )(
+			(const unsigned char **)( ppData + idxStart ), cbData,
+			(const unsigned char **)( ppPublicKey + idxStart ),
+			(const unsigned char **)( ppSignature + idxStart ),
+			n, valid );
+		for ( int i = 0 ; i < n ; ++i )
+			pbValid[ idxStart+i ] = ( valid[i] != 0 );
+	}
+
+	return nResult == 0;
+}
+
+#endif // #if defined( VALVE_CRYPTO_25519_DONNA ) || defined( VALVE_CRYPTO_25519_DONNA_BATCH )
+
+#ifdef VALVE_CRYPTO_25519_DONNA
+
 //-----------------------------------------------------------------------------
 // Purpose: Generate a shared secret from two exchanged curve25519 keys
 //-----------------------------------------------------------------------------
@@ -106,6 +106,18 @@ bool CECSigningPublicKey::VerifySignature( const void *pData, size_t cbData, con
 	return crypto_sign_ed25519_verify_detached( signature, static_cast<const unsigned char*>( pData ), cbData, CCryptoKeyBase_RawBuffer::GetRawDataPtr() ) == 0;
 }
 
+bool CCrypto::VerifySignatureBatch( int nSignatures, const uint8 *const *ppPublicKey, const void *const *ppData, const size_t *pcbData, const uint8 *const *ppSignature, bool *pbValid )
+{
+	// libsodium has no batch verification, just check them one at a time
+	bool bAllValid = true;
+	for ( int i = 0 ; i < nSignatures ; ++i )
+	{
+		pbValid[i] = crypto_sign_ed25519_verify_detached( ppSignature[i], static_cast<const unsigned char*>( ppData[i] ), pcbData[i], ppPublicKey[i] ) == 0;
+		bAllValid = bAllValid && pbValid[i];
+	}
+	return bAllValid;
+}
+
 bool CEC25519PrivateKeyBase::CachePublicKey()
 {
 	// Need to convert the private key into a public key here
@@ -0,0 +1,638 @@
+//========= Copyright Valve LLC, All rights reserved. ========================
+//
+// Batch AES-GCM encryption and decryption.
+//
+// When packets are small, the cost of AES-GCM through the crypto library
+// is mostly fixed per-packet overhead: setting the IV, the generic
+// update / finalize machinery, and a short chain of dependent AES rounds
+// that can't fill the pipeline.  If the CPU has VAES and VPCLMULQDQ, we
+// process a batch of packets together instead.  The counter blocks for
+// all of the packets are laid out in one array and encrypted 16 at a time
+// (four independent 512-bit lanes of four blocks each), and then GHASH is
+// computed for each packet four blocks at a time, using precomputed powers
+// of H and a single reduction per four blocks.
+//
+// Anything else (older CPUs, other key or IV sizes, very large packets)
+// just uses the normal per-packet Encrypt() / Decrypt().
+//
+//=============================================================================
+
+#include "crypto.h"
+#include <tier0/dbg.h>
+#include <string.h>
+
+#if ( defined(__GNUC__) || defined(__clang__) ) && defined(__x86_64__)
+	#define AES_GCM_MULTIBUFFER
+	#include <cpuid.h>
+	#include <immintrin.h>
+	#define AES_GCM_MULTIBUFFER_TARGET __attribute__((target("aes,pclmul,ssse3,sse4.1,avx2,avx512f,avx512bw,vaes,vpclmulqdq")))
+#elif defined(_MSC_VER) && defined(_M_X64)
+	#define AES_GCM_MULTIBUFFER
+	#include <intrin.h>
+	#include <immintrin.h>
+	#define AES_GCM_MULTIBUFFER_TARGET
+#endif
+
+#ifdef AES_GCM_MULTIBUFFER
+
+/// Max number of AES blocks (including the block used to mask the
+/// tag) that we will encrypt for one pass over a batch.  A packet
+/// bigger than this is just handled individually.
+constexpr int k_nMaxMultiBufferBlocks = 256;
+constexpr uint32 k_cbMaxMultiBufferPacket = ( k_nMaxMultiBufferBlocks - 1 ) * 16;
+
+struct AES_GCM_MultiBufferKey
+{
+	/// AES-256 round keys
+	__m128i m_roundKeys[15];
+
+	/// H^4, H^3, H^2, H^1, and then zeros, byte-reflected.  Loading 4
+	/// entries starting at [4-n] gives the multipliers for n blocks.
+	__m128i m_arHPow[7];
+
+	uint32 m_cbTag;
+};
+
+static bool BDetectMultiBufferCPUSupport()
+{
+	uint32 nECX1, nEBX7, nECX7;
+	#ifdef _MSC_VER
+		int regs[4];
+		__cpuid( regs, 0 );
+		if ( regs[0] < 7 )
+			return false;
+		__cpuid( regs, 1 );
+		nECX1 = (uint32)regs[2];
+		__cpuidex( regs, 7, 0 );
+		nEBX7 = (uint32)regs[1];
+		nECX7 = (uint32)regs[2];
+	#else
+		unsigned a, b, c, d;
+		if ( !__get_cpuid( 1, &a, &b, &c, &d ) )
+			return false;
+		nECX1 = c;
+		if ( !__get_cpuid_count( 7, 0, &a, &b, &c, &d ) )
+			return false;
+		nEBX7 = b;
+		nECX7 = c;
+	#endif
+
+	// AES-NI, PCLMULQDQ, SSSE3, SSE4.1, OSXSAVE
+	const uint32 nNeedECX1 = (1u<<25) | (1u<<1) | (1u<<9) | (1u<<19) | (1u<<27);
+	if ( ( nECX1 & nNeedECX1 ) != nNeedECX1 )
+		return false;
+
+	// AVX2, AVX512F, AVX512BW
+	const uint32 nNeedEBX7 = (1u<<5) | (1u<<16) | (1u<<30);
+	if ( ( nEBX7 & nNeedEBX7 ) != nNeedEBX7 )
+		return false;
+
+	// VAES, VPCLMULQDQ
+	const uint32 nNeedECX7 = (1u<<9) | (1u<<10);
+	if ( ( nECX7 & nNeedECX7 ) != nNeedECX7 )
+		return false;
+
+	// And the OS must save the AVX-512 register state
+	#ifdef _MSC_VER
+		const uint64 nXCR0 = _xgetbv( 0 );
+	#else
+		uint32 nXCR0Lo, nXCR0Hi;
+		__asm__ ( "xgetbv" : "=a"( nXCR0Lo ), "=d"( nXCR0Hi ) : "c"( 0 ) );
+		const uint64 nXCR0 = nXCR0Lo | ( (uint64)nXCR0Hi << 32 );
+	#endif
+	return ( nXCR0 & 0xe6 ) == 0xe6;
+}
+
+static bool BCPUSupportsMultiBuffer()
+{
+	static const bool s_bSupported = BDetectMultiBufferCPUSupport();
+	return s_bSupported;
+}
+
+//
+// GHASH.  Values are kept byte-reflected, and multiplied using the method
+// from Intel's "Carry-Less Multiplication and Its Usage for Computing the
+// GCM Mode" white paper.
+//
+
+/// Shift the 256-bit carryless product lo:hi left by one bit and reduce
+/// it modulo x^128 + x^7 + x^2 + x + 1.
+static inline AES_GCM_MULTIBUFFER_TARGET __m128i GHASHReduce( __m128i lo, __m128i hi )
+{
+	__m128i t7 = _mm_srli_epi32( lo, 31 );
+	__m128i t8 = _mm_srli_epi32( hi, 31 );
+	lo = _mm_slli_epi32( lo, 1 );
+	hi = _mm_slli_epi32( hi, 1 );
+	__m128i t9 = _mm_srli_si128( t7, 12 );
+	t8 = _mm_slli_si128( t8, 4 );
+	t7 = _mm_slli_si128( t7, 4 );
+	lo = _mm_or_si128( lo, t7 );
+	hi = _mm_or_si128( hi, t8 );
+	hi = _mm_or_si128( hi, t9 );
+
+	t7 = _mm_slli_epi32( lo, 31 );
+	t8 = _mm_slli_epi32( lo, 30 );
+	t9 = _mm_slli_epi32( lo, 25 );
+	t7 = _mm_xor_si128( t7, t8 );
+	t7 = _mm_xor_si128( t7, t9 );
+	t8 = _mm_srli_si128( t7, 4 );
+	t7 = _mm_slli_si128( t7, 12 );
+	lo = _mm_xor_si128( lo, t7 );
+
+	__m128i t2 = _mm_srli_epi32( lo, 1 );
+	__m128i t4 = _mm_srli_epi32( lo, 2 );
+	__m128i t5 = _mm_srli_epi32( lo, 7 );
+	t2 = _mm_xor_si128( t2, t4 );
+	t2 = _mm_xor_si128( t2, t5 );
+	t2 = _mm_xor_si128( t2, t8 );
+	lo = _mm_xor_si128( lo, t2 );
+	return _mm_xor_si128( hi, lo );
+}
+
+static inline AES_GCM_MULTIBUFFER_TARGET __m128i GHASHMul( __m128i a, __m128i b )
+{
+	__m128i lo = _mm_clmulepi64_si128( a, b, 0x00 );
+	__m128i hi = _mm_clmulepi64_si128( a, b, 0x11 );
+	__m128i mid = _mm_xor_si128( _mm_clmulepi64_si128( a, b, 0x10 ), _mm_clmulepi64_si128( a, b, 0x01 ) );
+	lo = _mm_xor_si128( lo, _mm_slli_si128( mid, 8 ) );
+	hi = _mm_xor_si128( hi, _mm_srli_si128( mid, 8 ) );
+	return GHASHReduce( lo, hi );
+}
+
+/// XOR the four 128-bit lanes together.  (The zero-masked forms of the
+/// extract and broadcast intrinsics are used throughout.  GCC implements the
+/// unmasked ones with _mm512_undefined_epi32(), which trips -Wmaybe-uninitialized.)
+static inline AES_GCM_MULTIBUFFER_TARGET __m128i Fold512( __m512i x )
+{
+	__m256i t = _mm256_xor_si256( _mm512_maskz_extracti64x4_epi64( 0xf, x, 0 ), _mm512_maskz_extracti64x4_epi64( 0xf, x, 1 ) );
+	return _mm_xor_si128( _mm256_castsi256_si128( t ), _mm256_extracti128_si256( t, 1 ) );
+}
+
+/// y = (y^x0)*H^4 + x1*H^3 + x2*H^2 + x3*H, where x is four byte-reflected
+/// blocks and hpow the matching powers of H.  (Or fewer blocks, with zeros
+/// in the unused lanes of both.)
+static inline AES_GCM_MULTIBUFFER_TARGET __m128i GHASHUpdate4( __m128i y, __m512i x, __m512i hpow )
+{
+	x = _mm512_xor_si512( x, _mm512_inserti32x4( _mm512_setzero_si512(), y, 0 ) );
+	__m512i lo = _mm512_clmulepi64_epi128( x, hpow, 0x00 );
+	__m512i hi = _mm512_clmulepi64_epi128( x, hpow, 0x11 );
+	__m512i mid = _mm512_xor_si512( _mm512_clmulepi64_epi128( x, hpow, 0x10 ), _mm512_clmulepi64_epi128( x, hpow, 0x01 ) );
+	__m128i lo128 = Fold512( lo );
+	__m128i hi128 = Fold512( hi );
+	__m128i mid128 = Fold512( mid );
+	lo128 = _mm_xor_si128( lo128, _mm_slli_si128( mid128, 8 ) );
+	hi128 = _mm_xor_si128( hi128, _mm_srli_si128( mid128, 8 ) );
+	return GHASHReduce( lo128, hi128 );
+}
+
+static inline AES_GCM_MULTIBUFFER_TARGET __m512i ByteReflect512( __m512i x )
+{
+	const __m512i kReflect = _mm512_maskz_broadcast_i32x4( 0xffff, _mm_set_epi8( 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 ) );
+	return _mm512_shuffle_epi8( x, kReflect );
+}
+
+static inline __mmask64 TailMask( uint32 cb )
+{
+	Assert( cb > 0 && cb < 64 );
+	return ( (uint64)1 << cb ) - 1;
+}
+
+/// Hash data, padded with zeros to a multiple of 16 bytes
+static inline AES_GCM_MULTIBUFFER_TARGET __m128i GHASHData( const AES_GCM_MultiBufferKey &key, __m128i y, const uint8 *p, uint32 cb )
+{
+	const __m512i hpow4 = _mm512_loadu_si512( &key.m_arHPow[0] );
+	while ( cb >= 64 )
+	{
+		y = GHASHUpdate4( y, ByteReflect512( _mm512_loadu_si512( p ) ), hpow4 );
+		p += 64;
+		cb -= 64;
+	}
+	if ( cb > 0 )
+	{
+		const int nBlocks = ( cb + 15 ) / 16;
+		__m512i x = _mm512_maskz_loadu_epi8( TailMask( cb ), p );
+		y = GHASHUpdate4( y, ByteReflect512( x ), _mm512_loadu_si512( &key.m_arHPow[4-nBlocks] ) );
+	}
+	return y;
+}
+
+/// Hash the length block, and produce the (full size) tag
+static inline AES_GCM_MULTIBUFFER_TARGET __m128i GHASHFinish( const AES_GCM_MultiBufferKey &key, __m128i y, uint32 cbAAD, uint32 cbData, __m128i tagMask )
+{
+	__m128i len = _mm_set_epi64x( (long long)cbAAD*8, (long long)cbData*8 );
+	y = GHASHMul( _mm_xor_si128( y, len ), key.m_arHPow[3] );
+	const __m128i kReflect = _mm_set_epi8( 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 );
+	return _mm_xor_si128( _mm_shuffle_epi8( y, kReflect ), tagMask );
+}
+
+//
+// AES
+//
+
+static inline AES_GCM_MULTIBUFFER_TARGET __m128i AES256KeyAssist1( __m128i t1, __m128i t2 )
+{
+	t2 = _mm_shuffle_epi32( t2, 0xff );
+	__m128i t4 = _mm_slli_si128( t1, 4 );
+	t1 = _mm_xor_si128( t1, t4 );
+	t4 = _mm_slli_si128( t4, 4 );
+	t1 = _mm_xor_si128( t1, t4 );
+	t4 = _mm_slli_si128( t4, 4 );
+	t1 = _mm_xor_si128( t1, t4 );
+	return _mm_xor_si128( t1, t2 );
+}
+
+static inline AES_GCM_MULTIBUFFER_TARGET __m128i AES256KeyAssist2( __m128i t1, __m128i t3 )
+{
+	__m128i t2 = _mm_shuffle_epi32( _mm_aeskeygenassist_si128( t1, 0 ), 0xaa );
+	__m128i t4 = _mm_slli_si128( t3, 4 );
+	t3 = _mm_xor_si128( t3, t4 );
+	t4 = _mm_slli_si128( t4, 4 );
+	t3 = _mm_xor_si128( t3, t4 );
+	t4 = _mm_slli_si128( t4, 4 );
+	t3 = _mm_xor_si128( t3, t4 );
+	return _mm_xor_si128( t3, t2 );
+}
+
+static AES_GCM_MULTIBUFFER_TARGET void InitMultiBufferKeyInternal( AES_GCM_MultiBufferKey &key, const uint8 *pKey )
+{
+	__m128i *rk = key.m_roundKeys;
+	__m128i t1 = _mm_loadu_si128( (const __m128i *)pKey );
+	__m128i t3 = _mm_loadu_si128( (const __m128i *)( pKey + 16 ) );
+	rk[0] = t1;
+	rk[1] = t3;
+	#define AES256_KEY_EXPAND_ROUND( i, rcon ) \
+		t1 = AES256KeyAssist1( t1, _mm_aeskeygenassist_si128( t3, rcon ) ); \
+		rk[i] = t1; \
+		t3 = AES256KeyAssist2( t1, t3 ); \
+		rk[i+1] = t3;
+	AES256_KEY_EXPAND_ROUND( 2, 0x01 )
+	AES256_KEY_EXPAND_ROUND( 4, 0x02 )
+	AES256_KEY_EXPAND_ROUND( 6, 0x04 )
+	AES256_KEY_EXPAND_ROUND( 8, 0x08 )
+	AES256_KEY_EXPAND_ROUND( 10, 0x10 )
+	AES256_KEY_EXPAND_ROUND( 12, 0x20 )
+	#undef AES256_KEY_EXPAND_ROUND
+	rk[14] = AES256KeyAssist1( t1, _mm_aeskeygenassist_si128( t3, 0x40 ) );
+
+	// H = E(K, 0^128)
+	__m128i h = _mm_xor_si128( _mm_setzero_si128(), rk[0] );
+	for ( int r = 1 ; r < 14 ; ++r )
+		h = _mm_aesenc_si128( h, rk[r] );
+	h = _mm_aesenclast_si128( h, rk[14] );
+	h = _mm_shuffle_epi8( h, _mm_set_epi8( 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 ) );
+
+	__m128i h2 = GHASHMul( h, h );
+	__m128i h3 = GHASHMul( h2, h );
+	__m128i h4 = GHASHMul( h3, h );
+	key.m_arHPow[0] = h4;
+	key.m_arHPow[1] = h3;
+	key.m_arHPow[2] = h2;
+	key.m_arHPow[3] = h;
+	key.m_arHPow[4] = _mm_setzero_si128();
+	key.m_arHPow[5] = _mm_setzero_si128();
+	key.m_arHPow[6] = _mm_setzero_si128();
+}
+
+/// Encrypt nBlocks blocks in place.  The buffer must have room for the
+/// count to be rounded up to a multiple of 4.
+static AES_GCM_MULTIBUFFER_TARGET void AESEncryptBlocks( const AES_GCM_MultiBufferKey &key, __m128i *pBlocks, int nBlocks )
+{
+	__m512i rk[15];
+	for ( int r = 0 ; r < 15 ; ++r )
+		rk[r] = _mm512_maskz_broadcast_i32x4( 0xffff, key.m_roundKeys[r] );
+
+	int i = 0;
+	for ( ; i + 16 <= nBlocks ; i += 16 )
+	{
+		__m512i b0 = _mm512_xor_si512( _mm512_loadu_si512( pBlocks + i + 0 ), rk[0] );
+		__m512i b1 = _mm512_xor_si512( _mm512_loadu_si512( pBlocks + i + 4 ), rk[0] );
+		__m512i b2 = _mm512_xor_si512( _mm512_loadu_si512( pBlocks + i + 8 ), rk[0] );
+		__m512i b3 = _mm512_xor_si512( _mm512_loadu_si512( pBlocks + i + 12 ), rk[0] );
+		for ( int r = 1 ; r < 14 ; ++r )
+		{
+			b0 = _mm512_aesenc_epi128( b0, rk[r] );
+			b1 = _mm512_aesenc_epi128( b1, rk[r] );
+			b2 = _mm512_aesenc_epi128( b2, rk[r] );
+			b3 = _mm512_aesenc_epi128( b3, rk[r] );
+		}
+		_mm512_storeu_si512( pBlocks + i + 0, _mm512_aesenclast_epi128( b0, rk[14] ) );
+		_mm512_storeu_si512( pBlocks + i + 4, _mm512_aesenclast_epi128( b1, rk[14] ) );
+		_mm512_storeu_si512( pBlocks + i + 8, _mm512_aesenclast_epi128( b2, rk[14] ) );
+		_mm512_storeu_si512( pBlocks + i + 12, _mm512_aesenclast_epi128( b3, rk[14] ) );
+	}
+	for ( ; i < nBlocks ; i += 4 )
+	{
+		__m512i b = _mm512_xor_si512( _mm512_loadu_si512( pBlocks + i ), rk[0] );
+		for ( int r = 1 ; r < 14 ; ++r )
+			b = _mm512_aesenc_epi128( b, rk[r] );
+		_mm512_storeu_si512( pBlocks + i, _mm512_aesenclast_epi128( b, rk[14] ) );
+	}
+}
+
+/// Fill in the counter blocks for one packet: J0 (used to mask the tag),
+/// followed by one block for each 16 bytes of data
+static AES_GCM_MULTIBUFFER_TARGET void FillCounterBlocks( __m128i *pBlocks, int nBlocks, const void *pIV )
+{
+	alignas(16) uint8 base[16];
+	memcpy( base, pIV, 12 );
+	memset( base+12, 0, 4 );
+	const __m128i j = _mm_load_si128( (const __m128i *)base );
+	for ( int i = 0 ; i < nBlocks ; ++i )
+		pBlocks[i] = _mm_insert_epi32( j, (int)BigDWord( (uint32)( i+1 ) ), 3 );
+}
+
+/// XOR data with keystream.  The keystream can be read in 64 byte chunks
+/// without running off the end of the buffer.
+static inline AES_GCM_MULTIBUFFER_TARGET void XORKeyStream( const __m128i *pKeyStream, const uint8 *pIn, uint8 *pOut, uint32 cb )
+{
+	while ( cb >= 64 )
+	{
+		_mm512_storeu_si512( pOut, _mm512_xor_si512( _mm512_loadu_si512( pIn ), _mm512_loadu_si512( pKeyStream ) ) );
+		pIn += 64;
+		pOut += 64;
+		pKeyStream += 4;
+		cb -= 64;
+	}
+	if ( cb > 0 )
+	{
+		const __mmask64 m = TailMask( cb );
+		__m512i x = _mm512_xor_si512( _mm512_maskz_loadu_epi8( m, pIn ), _mm512_loadu_si512( pKeyStream ) );
+		_mm512_mask_storeu_epi8( pOut, m, x );
+	}
+}
+
+static AES_GCM_MULTIBUFFER_TARGET void EncryptOnePacket( const AES_GCM_MultiBufferKey &key, const __m128i *pBlocks, AES_GCM_BatchPacket_t &pkt )
+{
+	const uint8 *pIn = (const uint8 *)pkt.m_pIn;
+	uint8 *pOut = (uint8 *)pkt.m_pOut;
+	const uint32 cbData = pkt.m_cbIn;
+
+	__m128i y = _mm_setzero_si128();
+	if ( pkt.m_cbAAD > 0 )
+		y = GHASHData( key, y, (const uint8 *)pkt.m_pAAD, pkt.m_cbAAD );
+
+	// Encrypt and hash the ciphertext in the same pass
+	const __m512i hpow4 = _mm512_loadu_si512( &key.m_arHPow[0] );
+	const __m128i *pKeyStream = pBlocks + 1;
+	uint32 cb = cbData;
+	while ( cb >= 64 )
+	{
+		__m512i x = _mm512_xor_si512( _mm512_loadu_si512( pIn ), _mm512_loadu_si512( pKeyStream ) );
+		_mm512_storeu_si512( pOut, x );
+		y = GHASHUpdate4( y, ByteReflect512( x ), hpow4 );
+		pIn += 64;
+		pOut += 64;
+		pKeyStream += 4;
+		cb -= 64;
+	}
+	if ( cb > 0 )
+	{
+		const __mmask64 m = TailMask( cb );
+		const int nBlocks = ( cb + 15 ) / 16;
+		__m512i x = _mm512_xor_si512( _mm512_maskz_loadu_epi8( m, pIn ), _mm512_loadu_si512( pKeyStream ) );
+		x = _mm512_maskz_mov_epi8( m, x );
+		_mm512_mask_storeu_epi8( pOut, m, x );
+		y = GHASHUpdate4( y, ByteReflect512( x ), _mm512_loadu_si512( &key.m_arHPow[4-nBlocks] ) );
+		pOut += cb;
+	}
+
+	alignas(16) uint8 tag[16];
+	_mm_store_si128( (__m128i *)tag, GHASHFinish( key, y, pkt.m_cbAAD, cbData, pBlocks[0] ) );
+	memcpy( pOut, tag, key.m_cbTag );
+
+	pkt.m_cbOut = cbData + key.m_cbTag;
+	pkt.m_bOK = true;
+}
+
+static AES_GCM_MULTIBUFFER_TARGET void DecryptOnePacket( const AES_GCM_MultiBufferKey &key, const __m128i *pBlocks, AES_GCM_BatchPacket_t &pkt )
+{
+	const uint8 *pIn = (const uint8 *)pkt.m_pIn;
+	const uint32 cbData = pkt.m_cbIn - key.m_cbTag;
+
+	// Check the tag before we write any plaintext
+	__m128i y = _mm_setzero_si128();
+	if ( pkt.m_cbAAD > 0 )
+		y = GHASHData( key, y, (const uint8 *)pkt.m_pAAD, pkt.m_cbAAD );
+	y = GHASHData( key, y, pIn, cbData );
+
+	alignas(16) uint8 tag[16];
+	_mm_store_si128( (__m128i *)tag, GHASHFinish( key, y, pkt.m_cbAAD, cbData, pBlocks[0] ) );
+	uint8 diff = 0;
+	for ( uint32 i = 0 ; i < key.m_cbTag ; ++i )
+		diff |= tag[i] ^ pIn[ cbData + i ];
+	if ( diff != 0 )
+	{
+		pkt.m_cbOut = 0;
+		pkt.m_bOK = false;
+		return;
+	}
+
+	XORKeyStream( pBlocks + 1, pIn, (uint8 *)pkt.m_pOut, cbData );
+	pkt.m_cbOut = cbData;
+	pkt.m_bOK = true;
+}
+
+/// Process a batch of packets using the multi-buffer path.  Packets bigger
+/// than k_cbMaxMultiBufferPacket are skipped, and *pbNeedFallback is set;
+/// the caller must handle them individually.
+static AES_GCM_MULTIBUFFER_TARGET int ProcessBatchMultiBuffer( const AES_GCM_MultiBufferKey &key, AES_GCM_BatchPacket_t *pPackets, int nPackets, bool bEncrypt, bool *pbNeedFallback )
+{
+	// Extra blocks at the end, so that we can always process a multiple of 4,
+	// and read keystream in 64-byte chunks
+	__m128i arBlocks[ k_nMaxMultiBufferBlocks + 4 ];
+
+	int nOK = 0;
+	int idxFirst = 0;
+	while ( idxFirst < nPackets )
+	{
+
+		// Gather up as many packets as will fit
+		int nBlocksUsed = 0;
+		int idxEnd = idxFirst;
+		int arBlockOffset[ k_nMaxMultiBufferBlocks ];
+		while ( idxEnd < nPackets && idxEnd - idxFirst < k_nMaxMultiBufferBlocks )
+		{
+			AES_GCM_BatchPacket_t &pkt = pPackets[ idxEnd ];
+			if ( pkt.m_cbIn > k_cbMaxMultiBufferPacket )
+			{
+				*pbNeedFallback = true;
+				arBlockOffset[ idxEnd - idxFirst ] = -1;
+				++idxEnd;
+				continue;
+			}
+			pkt.m_bOK = false;
+
+			// Validate sizes
+			uint32 cbData;
+			if ( bEncrypt )
+			{
+				cbData = pkt.m_cbIn;
+				if ( (uint64)cbData + key.m_cbTag > pkt.m_cbOut )
+				{
+					AssertMsg( false, "Buffer isn't big enough to hold encrypted data and tag" );
+					pkt.m_cbOut = 0;
+					arBlockOffset[ idxEnd - idxFirst ] = -1;
+					++idxEnd;
+					continue;
+				}
+			}
+			else
+			{
+				if ( pkt.m_cbIn < key.m_cbTag )
+				{
+					pkt.m_cbOut = 0;
+					arBlockOffset[ idxEnd - idxFirst ] = -1;
+					++idxEnd;
+					continue;
+				}
+				cbData = pkt.m_cbIn - key.m_cbTag;
+				if ( cbData > pkt.m_cbOut )
+				{
+					AssertMsg( false, "Buffer might not be big enough to hold decrypted data" );
+					pkt.m_cbOut = 0;
+					arBlockOffset[ idxEnd - idxFirst ] = -1;
+					++idxEnd;
+					continue;
+				}
+			}
+
+			const int nBlocks = 1 + int( ( cbData + 15 ) / 16 );
+			if ( nBlocksUsed + nBlocks > k_nMaxMultiBufferBlocks )
+				break;
+
+			FillCounterBlocks( arBlocks + nBlocksUsed, nBlocks, pkt.m_pIV );
+			arBlockOffset[ idxEnd - idxFirst ] = nBlocksUsed;
+			nBlocksUsed += nBlocks;
+			++idxEnd;
+		}
+
+		// Encrypt all of the counter blocks at once
+		const int nBlocksPadded = ( nBlocksUsed + 3 ) & ~3;
+		for ( int i = nBlocksUsed ; i < nBlocksPadded + 4 ; ++i )
+			arBlocks[i] = _mm_setzero_si128();
+		AESEncryptBlocks( key, arBlocks, nBlocksPadded );
+
+		// Now finish each packet
+		for ( int idx = idxFirst ; idx < idxEnd ; ++idx )
+		{
+			const int iOffset = arBlockOffset[ idx - idxFirst ];
+			if ( iOffset < 0 )
+				continue;
+			if ( bEncrypt )
+				EncryptOnePacket( key, arBlocks + iOffset, pPackets[idx] );
+			else
+				DecryptOnePacket( key, arBlocks + iOffset, pPackets[idx] );
+			if ( pPackets[idx].m_bOK )
+				++nOK;
+		}
+
+		SecureZeroMemory( arBlocks, nBlocksPadded * sizeof(arBlocks[0]) );
+		idxFirst = idxEnd;
+	}
+
+	return nOK;
+}
+
+#else
+
+struct AES_GCM_MultiBufferKey
+{
+	int m_nUnused;
+};
+
+#endif // #ifdef AES_GCM_MULTIBUFFER
+
+void AES_GCM_CipherContext::InitMultiBufferKey( const void *pKey, size_t cbKey, size_t cbIV, size_t cbTag )
+{
+	#ifdef AES_GCM_MULTIBUFFER
+		if ( cbKey == 32 && cbIV == 12 && cbTag > 0 && cbTag <= 16 && BCPUSupportsMultiBuffer() )
+		{
+			if ( !m_pMultiBufferKey )
+				m_pMultiBufferKey = new AES_GCM_MultiBufferKey;
+			InitMultiBufferKeyInternal( *m_pMultiBufferKey, (const uint8 *)pKey );
+			m_pMultiBufferKey->m_cbTag = (uint32)cbTag;
+			return;
+		}
+	#else
+		(void)pKey; (void)cbKey; (void)cbIV; (void)cbTag;
+	#endif
+	WipeMultiBufferKey();
+}
+
+void AES_GCM_CipherContext::WipeMultiBufferKey()
+{
+	if ( m_pMultiBufferKey )
+	{
+		SecureZeroMemory( m_pMultiBufferKey, sizeof(*m_pMultiBufferKey) );
+		delete m_pMultiBufferKey;
+		m_pMultiBufferKey = nullptr;
+	}
+}
+
+int AES_GCM_EncryptContext::EncryptBatch( AES_GCM_BatchPacket_t *pPackets, int nPackets )
+{
+	#ifdef AES_GCM_MULTIBUFFER
+		if ( m_pMultiBufferKey )
+		{
+			bool bNeedFallback = false;
+			int nOK = ProcessBatchMultiBuffer( *m_pMultiBufferKey, pPackets, nPackets, true, &bNeedFallback );
+			if ( !bNeedFallback )
+				return nOK;
+			for ( int i = 0 ; i < nPackets ; ++i )
+			{
+				AES_GCM_BatchPacket_t &pkt = pPackets[i];
+				if ( pkt.m_cbIn > k_cbMaxMultiBufferPacket )
+				{
+					pkt.m_bOK = Encrypt( pkt.m_pIn, pkt.m_cbIn, pkt.m_pIV, pkt.m_pOut, &pkt.m_cbOut, pkt.m_pAAD, pkt.m_cbAAD );
+					if ( pkt.m_bOK )
+						++nOK;
+				}
+			}
+			return nOK;
+		}
+	#endif
+
+	int nOK = 0;
+	for ( int i = 0 ; i < nPackets ; ++i )
+	{
+		AES_GCM_BatchPacket_t &pkt = pPackets[i];
+		pkt.m_bOK = Encrypt( pkt.m_pIn, pkt.m_cbIn, pkt.m_pIV, pkt.m_pOut, &pkt.m_cbOut, pkt.m_pAAD, pkt.m_cbAAD );
+		if ( pkt.m_bOK )
+			++nOK;
+	}
+	return nOK;
+}
+
+int AES_GCM_DecryptContext::DecryptBatch( AES_GCM_BatchPacket_t *pPackets, int nPackets )
+{
+	#ifdef AES_GCM_MULTIBUFFER
+		if ( m_pMultiBufferKey )
+		{
+			bool bNeedFallback = false;
+			int nOK = ProcessBatchMultiBuffer( *m_pMultiBufferKey, pPackets, nPackets, false, &bNeedFallback );
+			if ( !bNeedFallback )
+				return nOK;
+			for ( int i = 0 ; i < nPackets ; ++i )
+			{
+				AES_GCM_BatchPacket_t &pkt = pPackets[i];
+				if ( pkt.m_cbIn > k_cbMaxMultiBufferPacket )
+				{
+					pkt.m_bOK = Decrypt( pkt.m_pIn, pkt.m_cbIn, pkt.m_pIV, pkt.m_pOut, &pkt.m_cbOut, pkt.m_pAAD, pkt.m_cbAAD );
+					if ( pkt.m_bOK )
+						++nOK;
+				}
+			}
+			return nOK;
+		}
+	#endif
+
+	int nOK = 0;
+	for ( int i = 0 ; i < nPackets ; ++i )
+	{
+		AES_GCM_BatchPacket_t &pkt = pPackets[i];
+		pkt.m_bOK = Decrypt( pkt.m_pIn, pkt.m_cbIn, pkt.m_pIV, pkt.m_pOut, &pkt.m_cbOut, pkt.m_pAAD, pkt.m_cbAAD );
+		if ( pkt.m_bOK )
+			++nOK;
+	}
+	return nOK;
+}
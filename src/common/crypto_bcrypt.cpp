@@ -79,7 +79,7 @@ SymmetricCryptContextBase::SymmetricCryptContextBase()
 	m_cbTag = 0;
 }
 
-void SymmetricCryptContextBase::Wipe()
+void SymmetricCryptContextBase::WipeContext()
 {
 	delete (BCryptContext *)m_ctx;
 	m_ctx = NULL;
@@ -189,6 +189,11 @@ bool AES_GCM_DecryptContext::Decrypt(
 	return NT_SUCCESS(status);
 }
 
+bool CCrypto::BCanUseAESGCM()
+{
+	return true;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Generate a SHA256 hash
 // Input:	pchInput -			Plaintext string of item to hash (null terminated)
@@ -0,0 +1,443 @@
+//========= Copyright Valve LLC, All rights reserved. ========================
+//
+// Portable reference implementation of ChaCha20-Poly1305 (RFC 8439), for
+// crypto backends that don't provide it.  The Poly1305 code is based on
+// poly1305-donna (public domain), using 26-bit limbs.
+//
+//=============================================================================
+
+#include "crypto.h"
+#include <tier0/dbg.h>
+#include <string.h>
+
+#ifdef STEAMNETWORKINGSOCKETS_CRYPTO_VALVEOPENSSL
+	#include "tier0/memdbgoff.h"
+	#include <openssl/opensslv.h>
+	#include "tier0/memdbgon.h"
+	#if OPENSSL_VERSION_NUMBER < 0x10100000
+		// EVP_chacha20_poly1305 requires OpenSSL 1.1.0
+		#define VALVE_CRYPTO_CHACHA20POLY1305_REF
+	#endif
+#endif
+
+#if defined( STEAMNETWORKINGSOCKETS_CRYPTO_BCRYPT )
+	#define VALVE_CRYPTO_CHACHA20POLY1305_REF
+#endif
+
+#ifdef VALVE_CRYPTO_CHACHA20POLY1305_REF
+
+static inline uint32 U8TO32( const uint8 *p )
+{
+	return (uint32)p[0] | ( (uint32)p[1] << 8 ) | ( (uint32)p[2] << 16 ) | ( (uint32)p[3] << 24 );
+}
+
+static inline void U32TO8( uint8 *p, uint32 v )
+{
+	p[0] = (uint8)( v );
+	p[1] = (uint8)( v >> 8 );
+	p[2] = (uint8)( v >> 16 );
+	p[3] = (uint8)( v >> 24 );
+}
+
+struct ChaCha20Poly1305Key_t
+{
+	uint32 m_key[8];
+};
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// ChaCha20
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#define CHACHA_ROTL32( v, n ) ( ( (v) << (n) ) | ( (v) >> ( 32 - (n) ) ) )
+#define CHACHA_QUARTERROUND( a, b, c, d ) \
+	a += b; d ^= a; d = CHACHA_ROTL32( d, 16 ); \
+	c += d; b ^= c; b = CHACHA_ROTL32( b, 12 ); \
+	a += b; d ^= a; d = CHACHA_ROTL32( d, 8 ); \
+	c += d; b ^= c; b = CHACHA_ROTL32( b, 7 );
+
+static void ChaCha20Block( const ChaCha20Poly1305Key_t &key, uint32 nCounter, const uint32 nonce[3], uint8 out[64] )
+{
+	uint32 state[16] = {
+		0x61707865, 0x3320646e, 0x79622d32, 0x6b206574, // "expand 32-byte k"
+		key.m_key[0], key.m_key[1], key.m_key[2], key.m_key[3],
+		key.m_key[4], key.m_key[5], key.m_key[6], key.m_key[7],
+		nCounter, nonce[0], nonce[1], nonce[2]
+	};
+	uint32 x[16];
+	memcpy( x, state, sizeof(x) );
+	for ( int i = 0 ; i < 10 ; ++i )
+	{
+		CHACHA_QUARTERROUND( x[0], x[4], x[ 8], x[12] )
+		CHACHA_QUARTERROUND( x[1], x[5], x[ 9], x[13] )
+		CHACHA_QUARTERROUND( x[2], x[6], x[10], x[14] )
+		CHACHA_QUARTERROUND( x[3], x[7], x[11], x[15] )
+		CHACHA_QUARTERROUND( x[0], x[5], x[10], x[15] )
+		CHACHA_QUARTERROUND( x[1], x[6], x[11], x[12] )
+		CHACHA_QUARTERROUND( x[2], x[7], x[ 8], x[13] )
+		CHACHA_QUARTERROUND( x[3], x[4], x[ 9], x[14] )
+	}
+	for ( int i = 0 ; i < 16 ; ++i )
+		U32TO8( out + i*4, x[i] + state[i] );
+	SecureZeroMemory( x, sizeof(x) );
+	SecureZeroMemory( state, sizeof(state) );
+}
+
+/// XOR data with the key stream, starting at block 1.  (Block 0 is used
+/// to make the Poly1305 key.)  In-place is OK.
+static void ChaCha20XOR( const ChaCha20Poly1305Key_t &key, const uint32 nonce[3], const uint8 *pIn, uint8 *pOut, size_t cb )
+{
+	uint8 block[64];
+	uint32 nCounter = 1;
+	while ( cb > 0 )
+	{
+		ChaCha20Block( key, nCounter++, nonce, block );
+		const size_t n = cb < sizeof(block) ? cb : sizeof(block);
+		for ( size_t i = 0 ; i < n ; ++i )
+			pOut[i] = pIn[i] ^ block[i];
+		pIn += n;
+		pOut += n;
+		cb -= n;
+	}
+	SecureZeroMemory( block, sizeof(block) );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Poly1305
+//
+/////////////////////////////////////////////////////////////////////////////
+
+struct Poly1305State_t
+{
+	uint32 r[5];
+	uint32 h[5];
+	uint32 pad[4];
+	uint8 buffer[16];
+	size_t leftover;
+};
+
+static void Poly1305Init( Poly1305State_t &st, const uint8 key[32] )
+{
+	// r &= 0xffffffc0ffffffc0ffffffc0fffffff
+	st.r[0] = ( U8TO32( &key[ 0] )      ) & 0x3ffffff;
+	st.r[1] = ( U8TO32( &key[ 3] ) >> 2 ) & 0x3ffff03;
+	st.r[2] = ( U8TO32( &key[ 6] ) >> 4 ) & 0x3ffc0ff;
+	st.r[3] = ( U8TO32( &key[ 9] ) >> 6 ) & 0x3f03fff;
+	st.r[4] = ( U8TO32( &key[12] ) >> 8 ) & 0x00fffff;
+
+	memset( st.h, 0, sizeof(st.h) );
+
+	st.pad[0] = U8TO32( &key[16] );
+	st.pad[1] = U8TO32( &key[20] );
+	st.pad[2] = U8TO32( &key[24] );
+	st.pad[3] = U8TO32( &key[28] );
+
+	st.leftover = 0;
+}
+
+static void Poly1305Blocks( Poly1305State_t &st, const uint8 *m, size_t cb, uint32 hibit )
+{
+	const uint32 r0 = st.r[0], r1 = st.r[1], r2 = st.r[2], r3 = st.r[3], r4 = st.r[4];
+	const uint32 s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+	uint32 h0 = st.h[0], h1 = st.h[1], h2 = st.h[2], h3 = st.h[3], h4 = st.h[4];
+
+	while ( cb >= 16 )
+	{
+		// h += m[i]
+		h0 += ( U8TO32( m+ 0 )      ) & 0x3ffffff;
+		h1 += ( U8TO32( m+ 3 ) >> 2 ) & 0x3ffffff;
+		h2 += ( U8TO32( m+ 6 ) >> 4 ) & 0x3ffffff;
+		h3 += ( U8TO32( m+ 9 ) >> 6 ) & 0x3ffffff;
+		h4 += ( U8TO32( m+12 ) >> 8 ) | hibit;
+
+		// h *= r
+		uint64 d0 = (uint64)h0*r0 + (uint64)h1*s4 + (uint64)h2*s3 + (uint64)h3*s2 + (uint64)h4*s1;
+		uint64 d1 = (uint64)h0*r1 + (uint64)h1*r0 + (uint64)h2*s4 + (uint64)h3*s3 + (uint64)h4*s2;
+		uint64 d2 = (uint64)h0*r2 + (uint64)h1*r1 + (uint64)h2*r0 + (uint64)h3*s4 + (uint64)h4*s3;
+		uint64 d3 = (uint64)h0*r3 + (uint64)h1*r2 + (uint64)h2*r1 + (uint64)h3*r0 + (uint64)h4*s4;
+		uint64 d4 = (uint64)h0*r4 + (uint64)h1*r3 + (uint64)h2*r2 + (uint64)h3*r1 + (uint64)h4*r0;
+
+		// (partial) h %= p
+		uint32 c;
+		            c = (uint32)( d0 >> 26 ); h0 = (uint32)d0 & 0x3ffffff;
+		d1 += c;    c = (uint32)( d1 >> 26 ); h1 = (uint32)d1 & 0x3ffffff;
+		d2 += c;    c = (uint32)( d2 >> 26 ); h2 = (uint32)d2 & 0x3ffffff;
+		d3 += c;    c = (uint32)( d3 >> 26 ); h3 = (uint32)d3 & 0x3ffffff;
+		d4 += c;    c = (uint32)( d4 >> 26 ); h4 = (uint32)d4 & 0x3ffffff;
+		h0 += c*5;  c = h0 >> 26;             h0 = h0 & 0x3ffffff;
+		h1 += c;
+
+		m += 16;
+		cb -= 16;
+	}
+
+	st.h[0] = h0;
+	st.h[1] = h1;
+	st.h[2] = h2;
+	st.h[3] = h3;
+	st.h[4] = h4;
+}
+
+static void Poly1305Update( Poly1305State_t &st, const uint8 *m, size_t cb )
+{
+	// Finish off any partial block from last time
+	if ( st.leftover )
+	{
+		size_t want = 16 - st.leftover;
+		if ( want > cb )
+			want = cb;
+		memcpy( st.buffer + st.leftover, m, want );
+		cb -= want;
+		m += want;
+		st.leftover += want;
+		if ( st.leftover < 16 )
+			return;
+		Poly1305Blocks( st, st.buffer, 16, 1<<24 );
+		st.leftover = 0;
+	}
+
+	// Full blocks
+	if ( cb >= 16 )
+	{
+		const size_t want = cb & ~(size_t)15;
+		Poly1305Blocks( st, m, want, 1<<24 );
+		m += want;
+		cb -= want;
+	}
+
+	// Save the rest
+	if ( cb )
+	{
+		memcpy( st.buffer, m, cb );
+		st.leftover = cb;
+	}
+}
+
+/// Pad with zeros to a multiple of 16 bytes, as the AEAD construction requires
+static void Poly1305PadTo16( Poly1305State_t &st )
+{
+	static const uint8 zeros[16] = {};
+	if ( st.leftover )
+		Poly1305Update( st, zeros, 16 - st.leftover );
+}
+
+static void Poly1305Finish( Poly1305State_t &st, uint8 mac[16] )
+{
+	// Process the remaining block.  (The AEAD never leaves one, but be general.)
+	if ( st.leftover )
+	{
+		size_t i = st.leftover;
+		st.buffer[i++] = 1;
+		for ( ; i < 16 ; ++i )
+			st.buffer[i] = 0;
+		Poly1305Blocks( st, st.buffer, 16, 0 );
+	}
+
+	// Fully carry h
+	uint32 h0 = st.h[0], h1 = st.h[1], h2 = st.h[2], h3 = st.h[3], h4 = st.h[4];
+	uint32 c;
+	             c = h1 >> 26; h1 = h1 & 0x3ffffff;
+	h2 +=     c; c = h2 >> 26; h2 = h2 & 0x3ffffff;
+	h3 +=     c; c = h3 >> 26; h3 = h3 & 0x3ffffff;
+	h4 +=     c; c = h4 >> 26; h4 = h4 & 0x3ffffff;
+	h0 +=   c*5; c = h0 >> 26; h0 = h0 & 0x3ffffff;
+	h1 +=     c;
+
+	// Compute h + -p
+	uint32 g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+	uint32 g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+	uint32 g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+	uint32 g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+	uint32 g4 = h4 + c - ( 1u << 26 );
+
+	// Select h if h < p, or h + -p if h >= p
+	uint32 mask = ( g4 >> 31 ) - 1;
+	g0 &= mask;
+	g1 &= mask;
+	g2 &= mask;
+	g3 &= mask;
+	g4 &= mask;
+	mask = ~mask;
+	h0 = ( h0 & mask ) | g0;
+	h1 = ( h1 & mask ) | g1;
+	h2 = ( h2 & mask ) | g2;
+	h3 = ( h3 & mask ) | g3;
+	h4 = ( h4 & mask ) | g4;
+
+	// h = h % (2^128)
+	h0 = ( ( h0       ) | ( h1 << 26 ) ) & 0xffffffff;
+	h1 = ( ( h1 >>  6 ) | ( h2 << 20 ) ) & 0xffffffff;
+	h2 = ( ( h2 >> 12 ) | ( h3 << 14 ) ) & 0xffffffff;
+	h3 = ( ( h3 >> 18 ) | ( h4 <<  8 ) ) & 0xffffffff;
+
+	// mac = ( h + pad ) % (2^128)
+	uint64 f;
+	f = (uint64)h0 + st.pad[0]            ; h0 = (uint32)f;
+	f = (uint64)h1 + st.pad[1] + ( f >> 32 ); h1 = (uint32)f;
+	f = (uint64)h2 + st.pad[2] + ( f >> 32 ); h2 = (uint32)f;
+	f = (uint64)h3 + st.pad[3] + ( f >> 32 ); h3 = (uint32)f;
+
+	U32TO8( mac +  0, h0 );
+	U32TO8( mac +  4, h1 );
+	U32TO8( mac +  8, h2 );
+	U32TO8( mac + 12, h3 );
+
+	SecureZeroMemory( &st, sizeof(st) );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// AEAD construction
+//
+/////////////////////////////////////////////////////////////////////////////
+
+/// Compute the tag over the AAD and ciphertext
+static void ChaCha20Poly1305Tag( const ChaCha20Poly1305Key_t &key, const uint32 nonce[3], const uint8 *pAAD, size_t cbAAD, const uint8 *pCiphertext, size_t cbCiphertext, uint8 tag[16] )
+{
+	// One-time Poly1305 key is the first 32 bytes of block 0
+	uint8 block0[64];
+	ChaCha20Block( key, 0, nonce, block0 );
+	Poly1305State_t st;
+	Poly1305Init( st, block0 );
+	SecureZeroMemory( block0, sizeof(block0) );
+
+	if ( cbAAD > 0 )
+	{
+		Poly1305Update( st, pAAD, cbAAD );
+		Poly1305PadTo16( st );
+	}
+	Poly1305Update( st, pCiphertext, cbCiphertext );
+	Poly1305PadTo16( st );
+
+	uint8 lengths[16];
+	U32TO8( lengths +  0, (uint32)cbAAD );
+	U32TO8( lengths +  4, (uint32)( (uint64)cbAAD >> 32 ) );
+	U32TO8( lengths +  8, (uint32)cbCiphertext );
+	U32TO8( lengths + 12, (uint32)( (uint64)cbCiphertext >> 32 ) );
+	Poly1305Update( st, lengths, sizeof(lengths) );
+
+	Poly1305Finish( st, tag );
+}
+
+ChaCha20Poly1305_CipherContext::ChaCha20Poly1305_CipherContext()
+: m_ctx( nullptr )
+{
+}
+
+void ChaCha20Poly1305_CipherContext::Wipe()
+{
+	if ( m_ctx )
+	{
+		ChaCha20Poly1305Key_t *pKey = (ChaCha20Poly1305Key_t *)m_ctx;
+		SecureZeroMemory( pKey, sizeof(*pKey) );
+		delete pKey;
+		m_ctx = nullptr;
+	}
+}
+
+bool ChaCha20Poly1305_CipherContext::InitCipher( const void *pKey, size_t cbKey, size_t cbIV, size_t cbTag, bool bEncrypt )
+{
+	if ( cbKey != 32 || cbIV != 12 || cbTag != 16 )
+	{
+		AssertMsg( false, "Only 256-bit key, 96-bit IV, and 128-bit tag are supported for ChaCha20-Poly1305" );
+		Wipe();
+		return false;
+	}
+
+	ChaCha20Poly1305Key_t *pCtxKey = (ChaCha20Poly1305Key_t *)m_ctx;
+	if ( !pCtxKey )
+	{
+		pCtxKey = new ChaCha20Poly1305Key_t;
+		m_ctx = pCtxKey;
+	}
+	for ( int i = 0 ; i < 8 ; ++i )
+		pCtxKey->m_key[i] = U8TO32( (const uint8 *)pKey + i*4 );
+	return true;
+}
+
+bool ChaCha20Poly1305_EncryptContext::Encrypt(
+	const void *pPlaintextData, size_t cbPlaintextData,
+	const void *pIV,
+	void *pEncryptedDataAndTag, uint32 *pcbEncryptedDataAndTag,
+	const void *pAdditionalAuthenticationData, size_t cbAuthenticationData
+) {
+	const ChaCha20Poly1305Key_t *pKey = (const ChaCha20Poly1305Key_t *)m_ctx;
+	if ( !pKey )
+	{
+		AssertMsg( false, "Not initialized!" );
+		*pcbEncryptedDataAndTag = 0;
+		return false;
+	}
+
+	// Make sure their buffer is big enough
+	const size_t cbEncryptedTotal = cbPlaintextData + 16;
+	if ( cbEncryptedTotal > *pcbEncryptedDataAndTag )
+	{
+		AssertMsg( false, "Buffer isn't big enough to hold encrypted data and tag" );
+		*pcbEncryptedDataAndTag = 0;
+		return false;
+	}
+
+	uint32 nonce[3];
+	for ( int i = 0 ; i < 3 ; ++i )
+		nonce[i] = U8TO32( (const uint8 *)pIV + i*4 );
+
+	uint8 *pOut = (uint8 *)pEncryptedDataAndTag;
+	ChaCha20XOR( *pKey, nonce, (const uint8 *)pPlaintextData, pOut, cbPlaintextData );
+	ChaCha20Poly1305Tag( *pKey, nonce, (const uint8 *)pAdditionalAuthenticationData, cbAuthenticationData, pOut, cbPlaintextData, pOut + cbPlaintextData );
+
+	*pcbEncryptedDataAndTag = (uint32)cbEncryptedTotal;
+	return true;
+}
+
+bool ChaCha20Poly1305_DecryptContext::Decrypt(
+	const void *pEncryptedDataAndTag, size_t cbEncryptedDataAndTag,
+	const void *pIV,
+	void *pPlaintextData, uint32 *pcbPlaintextData,
+	const void *pAdditionalAuthenticationData, size_t cbAuthenticationData
+) {
+	const ChaCha20Poly1305Key_t *pKey = (const ChaCha20Poly1305Key_t *)m_ctx;
+	if ( !pKey )
+	{
+		AssertMsg( false, "Not initialized!" );
+		*pcbPlaintextData = 0;
+		return false;
+	}
+
+	// Make sure buffer and tag sizes aren't totally bogus
+	if ( cbEncryptedDataAndTag < 16 )
+	{
+		*pcbPlaintextData = 0;
+		return false;
+	}
+	const size_t cbCiphertext = cbEncryptedDataAndTag - 16;
+	if ( cbCiphertext > *pcbPlaintextData )
+	{
+		AssertMsg( false, "Buffer might not be big enough to hold decrypted data" );
+		*pcbPlaintextData = 0;
+		return false;
+	}
+	*pcbPlaintextData = 0;
+
+	uint32 nonce[3];
+	for ( int i = 0 ; i < 3 ; ++i )
+		nonce[i] = U8TO32( (const uint8 *)pIV + i*4 );
+
+	// Check the tag first, in constant time
+	const uint8 *pIn = (const uint8 *)pEncryptedDataAndTag;
+	uint8 tag[16];
+	ChaCha20Poly1305Tag( *pKey, nonce, (const uint8 *)pAdditionalAuthenticationData, cbAuthenticationData, pIn, cbCiphertext, tag );
+	uint8 diff = 0;
+	for ( int i = 0 ; i < 16 ; ++i )
+		diff |= tag[i] ^ pIn[ cbCiphertext + i ];
+	if ( diff != 0 )
+		return false;
+
+	ChaCha20XOR( *pKey, nonce, pIn, (uint8 *)pPlaintextData, cbCiphertext );
+	*pcbPlaintextData = (uint32)cbCiphertext;
+	return true;
+}
+
+#endif // #ifdef VALVE_CRYPTO_CHACHA20POLY1305_REF
@@ -14,7 +14,7 @@ SymmetricCryptContextBase::SymmetricCryptContextBase()
 {
 }
 
-void SymmetricCryptContextBase::Wipe()
+void SymmetricCryptContextBase::WipeContext()
 {
 	sodium_free(m_ctx);
 
@@ -102,6 +102,102 @@ bool AES_GCM_DecryptContext::Decrypt(
 	return nDecryptResult == 0;
 }
 
+ChaCha20Poly1305_CipherContext::ChaCha20Poly1305_CipherContext()
+	: m_ctx(nullptr)
+{
+}
+
+void ChaCha20Poly1305_CipherContext::Wipe()
+{
+	// sodium_free zeros the memory
+	sodium_free(m_ctx);
+	m_ctx = nullptr;
+}
+
+bool ChaCha20Poly1305_CipherContext::InitCipher( const void *pKey, size_t cbKey, size_t cbIV, size_t cbTag, bool bEncrypt )
+{
+	if ( cbKey != crypto_aead_chacha20poly1305_ietf_KEYBYTES || cbIV != crypto_aead_chacha20poly1305_ietf_NPUBBYTES || cbTag != crypto_aead_chacha20poly1305_ietf_ABYTES )
+	{
+		AssertMsg( false, "Only 256-bit key, 96-bit IV, and 128-bit tag are supported for ChaCha20-Poly1305" );
+		Wipe();
+		return false;
+	}
+
+	if(m_ctx == nullptr)
+	{
+		m_ctx = sodium_malloc( crypto_aead_chacha20poly1305_ietf_KEYBYTES );
+		if ( m_ctx == nullptr )
+			return false;
+	}
+
+	memcpy( m_ctx, pKey, crypto_aead_chacha20poly1305_ietf_KEYBYTES );
+
+	return true;
+}
+
+bool ChaCha20Poly1305_EncryptContext::Encrypt(
+		const void *pPlaintextData, size_t cbPlaintextData,
+		const void *pIV,
+		void *pEncryptedDataAndTag, uint32 *pcbEncryptedDataAndTag,
+		const void *pAdditionalAuthenticationData, size_t cbAuthenticationData
+		)
+{
+	// Make sure caller's buffer is big enough to hold the result.
+	if ( !m_ctx || cbPlaintextData + crypto_aead_chacha20poly1305_ietf_ABYTES > *pcbEncryptedDataAndTag )
+	{
+		*pcbEncryptedDataAndTag = 0;
+		return false;
+	}
+
+	unsigned long long cbEncryptedDataAndTag_longlong;
+	crypto_aead_chacha20poly1305_ietf_encrypt(
+			static_cast<unsigned char*>( pEncryptedDataAndTag ), &cbEncryptedDataAndTag_longlong,
+			static_cast<const unsigned char*>( pPlaintextData ), cbPlaintextData,
+			static_cast<const unsigned char*>(pAdditionalAuthenticationData), cbAuthenticationData,
+			nullptr,
+			static_cast<const unsigned char*>( pIV ),
+			static_cast<const unsigned char*>( m_ctx )
+			);
+
+	*pcbEncryptedDataAndTag = cbEncryptedDataAndTag_longlong;
+
+	return true;
+}
+
+bool ChaCha20Poly1305_DecryptContext::Decrypt(
+		const void *pEncryptedDataAndTag, size_t cbEncryptedDataAndTag,
+		const void *pIV,
+		void *pPlaintextData, uint32 *pcbPlaintextData,
+		const void *pAdditionalAuthenticationData, size_t cbAuthenticationData
+		)
+{
+	// Make sure caller's buffer is big enough to hold the result
+	if ( !m_ctx || cbEncryptedDataAndTag > *pcbPlaintextData + crypto_aead_chacha20poly1305_ietf_ABYTES )
+	{
+		*pcbPlaintextData = 0;
+		return false;
+	}
+
+	unsigned long long cbPlaintextData_longlong;
+	const int nDecryptResult = crypto_aead_chacha20poly1305_ietf_decrypt(
+			static_cast<unsigned char*>( pPlaintextData ), &cbPlaintextData_longlong,
+			nullptr,
+			static_cast<const unsigned char*>( pEncryptedDataAndTag ), cbEncryptedDataAndTag,
+			static_cast<const unsigned char*>( pAdditionalAuthenticationData ), cbAuthenticationData,
+			static_cast<const unsigned char*>( pIV ), static_cast<const unsigned char*>( m_ctx )
+			);
+
+	*pcbPlaintextData = cbPlaintextData_longlong;
+
+	return nDecryptResult == 0;
+}
+
+bool CCrypto::BCanUseAESGCM()
+{
+	// Libsodium only implements AES-GCM using the hardware instructions
+	return crypto_aead_aes256gcm_is_available() == 1;
+}
+
 void CCrypto::Init()
 {
 	// sodium_init is safe to call multiple times from multiple threads
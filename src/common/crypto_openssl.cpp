@@ -69,7 +69,7 @@ SymmetricCryptContextBase::SymmetricCryptContextBase()
 	m_cbTag = 0;
 }
 
-void SymmetricCryptContextBase::Wipe()
+void SymmetricCryptContextBase::WipeContext()
 {
 	if ( m_ctx )
 	{
@@ -149,14 +149,16 @@ bool AES_GCM_CipherContext::InitCipher( const void *pKey, size_t cbKey, size_t c
 	return true;
 }
 
-bool AES_GCM_EncryptContext::Encrypt(
+// Encrypt using an AEAD cipher.  Shared by AES-GCM and ChaCha20-Poly1305,
+// which use the same EVP interface.
+static bool EVP_AEADEncrypt(
+		EVP_CIPHER_CTX *ctx, uint32 cbTag,
 		const void *pPlaintextData, size_t cbPlaintextData,
 		const void *pIV,
 		void *pEncryptedDataAndTag, uint32 *pcbEncryptedDataAndTag,
-		const void *pAdditionalAuthenticationData, size_t cbAuthenticationData // Optional additional authentication data.  Not encrypted, but will be included in the tag, so it can be authenticated.
+		const void *pAdditionalAuthenticationData, size_t cbAuthenticationData
 		)
 {
-	EVP_CIPHER_CTX *ctx = (EVP_CIPHER_CTX*)m_ctx;
 	if ( !ctx )
 	{
 		AssertMsg( false, "Not initialized!" );
@@ -166,7 +168,7 @@ bool AES_GCM_EncryptContext::Encrypt(
 
 	// Calculate size of encrypted data.  Note that GCM does not use padding.
 	uint32 cbEncryptedWithoutTag = (uint32)cbPlaintextData;
-	uint32 cbEncryptedTotal = cbEncryptedWithoutTag + m_cbTag;
+	uint32 cbEncryptedTotal = cbEncryptedWithoutTag + cbTag;
 
 	// Make sure their buffer is big enough
 	if ( cbEncryptedTotal > *pcbEncryptedDataAndTag )
@@ -208,7 +210,7 @@ bool AES_GCM_EncryptContext::Encrypt(
 	VerifyFatal( (uint8 *)pEncryptedDataAndTag + cbEncryptedWithoutTag == pOut );
 
 	// Append the tag
-	if ( EVP_CIPHER_CTX_ctrl( ctx, EVP_CTRL_GCM_GET_TAG, (int)m_cbTag, pOut ) != 1 )
+	if ( EVP_CIPHER_CTX_ctrl( ctx, EVP_CTRL_GCM_GET_TAG, (int)cbTag, pOut ) != 1 )
 	{
 		AssertMsg( false, "Bad tag size" );
 		return false;
@@ -221,15 +223,15 @@ bool AES_GCM_EncryptContext::Encrypt(
 	return true;
 }
 
-bool AES_GCM_DecryptContext::Decrypt(
+// Decrypt using an AEAD cipher, and check the tag
+static bool EVP_AEADDecrypt(
+		EVP_CIPHER_CTX *ctx, uint32 cbTag,
 		const void *pEncryptedDataAndTag, size_t cbEncryptedDataAndTag,
 		const void *pIV,
 		void *pPlaintextData, uint32 *pcbPlaintextData,
 		const void *pAdditionalAuthenticationData, size_t cbAuthenticationData
 		)
 {
-
-	EVP_CIPHER_CTX *ctx = (EVP_CIPHER_CTX*)m_ctx;
 	if ( !ctx )
 	{
 		AssertMsg( false, "Not initialized!" );
@@ -238,13 +240,13 @@ bool AES_GCM_DecryptContext::Decrypt(
 	}
 
 	// Make sure buffer and tag sizes aren't totally bogus
-	if ( m_cbTag > cbEncryptedDataAndTag )
+	if ( cbTag > cbEncryptedDataAndTag )
 	{
 		AssertMsg( false, "Encrypted size doesn't make sense for tag size" );
 		*pcbPlaintextData = 0;
 		return false;
 	}
-	uint32 cbEncryptedDataWithoutTag = uint32( cbEncryptedDataAndTag - m_cbTag );
+	uint32 cbEncryptedDataWithoutTag = uint32( cbEncryptedDataAndTag - cbTag );
 
 	// Make sure their buffer is big enough.  Remember that in GCM mode,
 	// there is no padding, so if this fails, we indeed would have overflowed
@@ -291,7 +293,7 @@ bool AES_GCM_DecryptContext::Decrypt(
 	pIn += cbEncryptedDataWithoutTag;
 
 	// Set expected tag value
-	if( EVP_CIPHER_CTX_ctrl( ctx, EVP_CTRL_GCM_SET_TAG, (int)m_cbTag, const_cast<uint8*>( pIn ) ) != 1)
+	if( EVP_CIPHER_CTX_ctrl( ctx, EVP_CTRL_GCM_SET_TAG, (int)cbTag, const_cast<uint8*>( pIn ) ) != 1)
 	{
 		AssertMsg( false, "Bad tag size" );
 		return false;
@@ -310,6 +312,100 @@ bool AES_GCM_DecryptContext::Decrypt(
 	return true;
 }
 
+bool AES_GCM_EncryptContext::Encrypt(
+		const void *pPlaintextData, size_t cbPlaintextData,
+		const void *pIV,
+		void *pEncryptedDataAndTag, uint32 *pcbEncryptedDataAndTag,
+		const void *pAdditionalAuthenticationData, size_t cbAuthenticationData // Optional additional authentication data.  Not encrypted, but will be included in the tag, so it can be authenticated.
+		)
+{
+	return EVP_AEADEncrypt( (EVP_CIPHER_CTX*)m_ctx, m_cbTag, pPlaintextData, cbPlaintextData, pIV, pEncryptedDataAndTag, pcbEncryptedDataAndTag, pAdditionalAuthenticationData, cbAuthenticationData );
+}
+
+bool AES_GCM_DecryptContext::Decrypt(
+		const void *pEncryptedDataAndTag, size_t cbEncryptedDataAndTag,
+		const void *pIV,
+		void *pPlaintextData, uint32 *pcbPlaintextData,
+		const void *pAdditionalAuthenticationData, size_t cbAuthenticationData
+		)
+{
+	return EVP_AEADDecrypt( (EVP_CIPHER_CTX*)m_ctx, m_cbTag, pEncryptedDataAndTag, cbEncryptedDataAndTag, pIV, pPlaintextData, pcbPlaintextData, pAdditionalAuthenticationData, cbAuthenticationData );
+}
+
+// EVP_chacha20_poly1305 requires OpenSSL 1.1.0.  Otherwise, we use the reference implementation
+#if OPENSSL_VERSION_NUMBER >= 0x10100000 && !defined( VALVE_CRYPTO_CHACHA20POLY1305_REF )
+
+ChaCha20Poly1305_CipherContext::ChaCha20Poly1305_CipherContext()
+{
+	m_ctx = nullptr;
+}
+
+void ChaCha20Poly1305_CipherContext::Wipe()
+{
+	if ( m_ctx )
+	{
+		EVP_CIPHER_CTX_free( (EVP_CIPHER_CTX*)m_ctx );
+		m_ctx = nullptr;
+	}
+}
+
+bool ChaCha20Poly1305_CipherContext::InitCipher( const void *pKey, size_t cbKey, size_t cbIV, size_t cbTag, bool bEncrypt )
+{
+	if ( cbKey != 32 || cbIV != 12 || cbTag != 16 )
+	{
+		AssertMsg( false, "Only 256-bit key, 96-bit IV, and 128-bit tag are supported for ChaCha20-Poly1305" );
+		Wipe();
+		return false;
+	}
+
+	EVP_CIPHER_CTX *ctx = (EVP_CIPHER_CTX*)m_ctx;
+	if ( ctx )
+	{
+		EVP_CIPHER_CTX_reset( ctx );
+	}
+	else
+	{
+		ctx = EVP_CIPHER_CTX_new();
+		if ( !ctx )
+			return false;
+		m_ctx = ctx;
+	}
+
+	if ( EVP_CipherInit_ex( ctx, EVP_chacha20_poly1305(), nullptr, (const uint8*)pKey, nullptr, bEncrypt ? 1 : 0 ) != 1 )
+	{
+		Wipe();
+		return false;
+	}
+	return true;
+}
+
+bool ChaCha20Poly1305_EncryptContext::Encrypt(
+		const void *pPlaintextData, size_t cbPlaintextData,
+		const void *pIV,
+		void *pEncryptedDataAndTag, uint32 *pcbEncryptedDataAndTag,
+		const void *pAdditionalAuthenticationData, size_t cbAuthenticationData
+		)
+{
+	return EVP_AEADEncrypt( (EVP_CIPHER_CTX*)m_ctx, 16, pPlaintextData, cbPlaintextData, pIV, pEncryptedDataAndTag, pcbEncryptedDataAndTag, pAdditionalAuthenticationData, cbAuthenticationData );
+}
+
+bool ChaCha20Poly1305_DecryptContext::Decrypt(
+		const void *pEncryptedDataAndTag, size_t cbEncryptedDataAndTag,
+		const void *pIV,
+		void *pPlaintextData, uint32 *pcbPlaintextData,
+		const void *pAdditionalAuthenticationData, size_t cbAuthenticationData
+		)
+{
+	return EVP_AEADDecrypt( (EVP_CIPHER_CTX*)m_ctx, 16, pEncryptedDataAndTag, cbEncryptedDataAndTag, pIV, pPlaintextData, pcbPlaintextData, pAdditionalAuthenticationData, cbAuthenticationData );
+}
+
+#endif
+
+bool CCrypto::BCanUseAESGCM()
+{
+	return true;
+}
+
 //-----------------------------------------------------------------------------
 bool CCrypto::SymmetricAuthEncryptWithIV(
 		const void *pPlaintextData, size_t cbPlaintextData,
@@ -41,6 +41,10 @@ ed25519_hram(hash_512bits hram, const ed25519_signature RS, const ed25519_public
 	ed25519_hash_final(&ctx, hram);
 }
 
+/* define ED25519_BATCH_VERIFY_ONLY to compile just the verification functions,
+   for when signing and key generation come from somewhere else */
+#if !defined(ED25519_BATCH_VERIFY_ONLY)
+
 void
 ED25519_FN(ed25519_publickey) (const ed25519_secret_key sk, ed25519_public_key pk) {
 	bignum256modm a;
@@ -90,6 +94,8 @@ ED25519_FN(ed25519_sign) (const unsigned char *m, size_t mlen, const ed25519_sec
 	contract256_modm(RS + 32, S);
 }
 
+#endif /* !ED25519_BATCH_VERIFY_ONLY */
+
 int
 ED25519_FN(ed25519_sign_open) (const unsigned char *m, size_t mlen, const ed25519_public_key pk, const ed25519_signature RS) {
 	ge25519 ALIGN(16) R, A;
@@ -117,6 +123,8 @@ ED25519_FN(ed25519_sign_open) (const unsigned char *m, size_t mlen, const ed2551
 
 #include "ed25519-donna-batchverify.h"
 
+#if !defined(ED25519_BATCH_VERIFY_ONLY)
+
 /*
 	Fast Curve25519 basepoint scalar multiplication
 */
@@ -148,3 +156,4 @@ ED25519_FN(curved25519_scalarmult_basepoint) (curved25519_key pk, const curved25
 	curve25519_contract(pk, yplusz);
 }
 
+#endif /* !ED25519_BATCH_VERIFY_ONLY */
@@ -342,32 +342,40 @@ int CGameNetworkingMessages::ReceiveMessagesOnChannel( int nLocalChannel, GameNe
 
 	Channel *pChan = FindOrCreateChannel( nLocalChannel );
 
-	ShortDurationScopeLock lockMessageQueues( g_lockAllRecvMessageQueues );
-
-	// Pull out all messages from the poll group into per-channel queues
+	// Pull out all messages from the poll group into per-channel queues.
+	// The poll group queue and the session queues are protected by different
+	// short duration locks, and we can't hold both at once, so move them
+	// across in batches.
 	if ( m_pPollGroup )
 	{
+		GameNetworkingMessage_t *arBatch[ 64 ];
 		for (;;)
 		{
-			CGameNetworkingMessage *pMsg = m_pPollGroup->m_queueRecvMessages.m_pFirst;
-			if ( !pMsg )
+			int nBatch = m_pPollGroup->ReceiveMessages( arBatch, V_ARRAYSIZE( arBatch ) );
+			if ( nBatch <= 0 )
 				break;
-			pMsg->Unlink();
 
-			int idxSession = g_mapSessionsByConnection.Find( pMsg->m_conn );
-			if ( idxSession == g_mapSessionsByConnection.InvalidIndex() )
+			ShortDurationScopeLock lockMessageQueues( g_lockAllRecvMessageQueues );
+			for ( int i = 0 ; i < nBatch ; ++i )
 			{
-				pMsg->Release();
-				continue;
+				CGameNetworkingMessage *pMsg = static_cast<CGameNetworkingMessage *>( arBatch[i] );
+
+				int idxSession = g_mapSessionsByConnection.Find( pMsg->m_conn );
+				if ( idxSession == g_mapSessionsByConnection.InvalidIndex() )
+				{
+					pMsg->Release();
+					continue;
+				}
+
+				GameNetworkingMessagesSession *pSess = g_mapSessionsByConnection[ idxSession ];
+				Assert( pSess->m_pConnection );
+				Assert( this == &pSess->m_gameNetworkingMessagesOwner );
+				pSess->ReceivedMessage( pMsg );
 			}
-
-			GameNetworkingMessagesSession *pSess = g_mapSessionsByConnection[ idxSession ];
-			Assert( pSess->m_pConnection );
-			Assert( this == &pSess->m_gameNetworkingMessagesOwner );
-			pSess->ReceivedMessage( pMsg );
 		}
 	}
 
+	ShortDurationScopeLock lockMessageQueues( g_lockAllRecvMessageQueues );
 	return pChan->m_queueRecvMessages.RemoveMessages( ppOutMessages, nMaxMessages );
 }
 
@@ -739,14 +747,18 @@ void GameNetworkingMessagesSession::ReceivedMessage( CGameNetworkingMessage *pMs
 		pMsg->Release();
 		return;
 	}
-	Assert( pMsg->m_pfnFreeData == CGameNetworkingMessage::DefaultFreeData );
+	Assert( pMsg->m_pfnFreeData == CGameNetworkingMessage::DefaultFreeData || pMsg->m_pfnFreeData == CGameNetworkingMessage::InlineFreeData );
 
 	// Process the header
 	P2PMessageHeader *hdr = static_cast<P2PMessageHeader *>( pMsg->m_pData );
 	pMsg->m_nChannel = LittleDWord( hdr->m_nToChannel );
 	pMsg->m_cbSize -= sizeof(P2PMessageHeader);
 	pMsg->m_pData = hdr+1;
-	pMsg->m_pfnFreeData = FreeMessageDataWithP2PMessageHeader;
+
+	// If the payload was malloc'd, we need to free the original pointer.
+	// (If it's inline in the message block, there's nothing to do.)
+	if ( pMsg->m_pfnFreeData == CGameNetworkingMessage::DefaultFreeData )
+		pMsg->m_pfnFreeData = FreeMessageDataWithP2PMessageHeader;
 
 	// Add to the session
 	pMsg->LinkToQueueTail( &CGameNetworkingMessage::m_links, &m_queueRecvMessages );
@@ -51,6 +51,13 @@ DEFINE_GLOBAL_CONFIGVAL( int32, FakeRateLimit_Send_Rate, 0, 0, 1024*1024*1024 );
 DEFINE_GLOBAL_CONFIGVAL( int32, FakeRateLimit_Send_Burst, 16*1024, 0, 1024*1024 );
 DEFINE_GLOBAL_CONFIGVAL( int32, FakeRateLimit_Recv_Rate, 0, 0, 1024*1024*1024 );
 DEFINE_GLOBAL_CONFIGVAL( int32, FakeRateLimit_Recv_Burst, 16*1024, 0, 1024*1024 );
+DEFINE_GLOBAL_CONFIGVAL( int32, UDP_SegmentationOffload, 0, 0, 1 );
+DEFINE_GLOBAL_CONFIGVAL( int32, RecvWorkerThreads, 0, 0, k_nSteamDatagramMaxRecvWorkerThreads );
+DEFINE_GLOBAL_CONFIGVAL( int32, HandshakeBatchVerify, 1, 0, 1 );
+DEFINE_GLOBAL_CONFIGVAL( int32, HandshakeCryptoThreads, 0, 0, k_nSteamDatagramMaxCryptoWorkerThreads );
+DEFINE_GLOBAL_CONFIGVAL( int32, ConnectRequestRateLimit, 32, 0, 0x10000 );
+DEFINE_GLOBAL_CONFIGVAL( int32, SendPacingMaxBurst, 250, 0, 1000000 );
+DEFINE_GLOBAL_CONFIGVAL( int32, RecvKernelTimestamps, 1, 0, 1 );
 
 DEFINE_GLOBAL_CONFIGVAL( int32, EnumerateDevVars, 0, 0, 1 );
 
@@ -67,7 +74,9 @@ DEFINE_CONNECTON_DEFAULT_CONFIGVAL( int32, SendBufferSize, 512*1024, 0, 0x100000
 DEFINE_CONNECTON_DEFAULT_CONFIGVAL( int64, ConnectionUserData, -1 ); // no limits here
 DEFINE_CONNECTON_DEFAULT_CONFIGVAL( int32, SendRateMin, 128*1024, 1024, 0x10000000 );
 DEFINE_CONNECTON_DEFAULT_CONFIGVAL( int32, SendRateMax, 1024*1024, 1024, 0x10000000 );
+DEFINE_CONNECTON_DEFAULT_CONFIGVAL( int32, CongestionControl, k_nGameNetworkingConfig_CongestionControl_Fixed, k_nGameNetworkingConfig_CongestionControl_Fixed, k_nGameNetworkingConfig_CongestionControl_BBR );
 DEFINE_CONNECTON_DEFAULT_CONFIGVAL( int32, NagleTime, 5000, 0, 20000 );
+DEFINE_CONNECTON_DEFAULT_CONFIGVAL( int32, UnreliableFECGroupSize, 0, 0, k_nMaxBufferedUnreliableSegments/2 );
 DEFINE_CONNECTON_DEFAULT_CONFIGVAL( int32, MTU_PacketSize, 1300, k_cbGameNetworkingSocketsMinMTUPacketSize, k_cbGameNetworkingSocketsMaxUDPMsgLen );
 #ifdef STEAMNETWORKINGSOCKETS_OPENSOURCE
 	// We don't have a trusted third party, so allow this by default,
@@ -189,6 +198,8 @@ static GlobalConfigValueEntry *FindConfigValueEntry( EGameNetworkingConfigValue
 	return nullptr;
 }
 
+std::atomic<uint32> g_nConfigValueVersion{1};
+
 void ConnectionConfig::Init( ConnectionConfig *pInherit )
 {
 	EnsureConfigValueTableInitted();
@@ -207,6 +218,30 @@ void ConnectionConfig::Init( ConnectionConfig *pInherit )
 			pVal->m_pInherit = &( static_cast< GlobalConfigValueBase<int32> * >( pEntry ) )->m_value;
 		}
 	}
+
+	// Rewiring the inheritance chain changes effective values
+	BumpConfigValueVersion();
+}
+
+void ConnectionConfigSnapshot::Refresh( const ConnectionConfig &config )
+{
+	// Grab the version first, so that if it changes while we are
+	// reading the values, we'll just refresh again next time
+	m_nVersion = g_nConfigValueVersion.load( std::memory_order_acquire );
+
+	m_SendBufferSize = config.m_SendBufferSize.Get();
+
+	// Clamp the rate limits themselves to be safe and make sure they are sane
+	m_nSendRateMin = Clamp( config.m_SendRateMin.Get(), 1024, 100*1024*1024 );
+	m_nSendRateMax = Clamp( config.m_SendRateMax.Get(), m_nSendRateMin, 100*1024*1024 );
+
+	m_CongestionControl = config.m_CongestionControl.Get();
+	m_NagleTime = config.m_NagleTime.Get();
+	m_UnreliableFECGroupSize = config.m_UnreliableFECGroupSize.Get();
+	m_LogLevel_AckRTT = config.m_LogLevel_AckRTT.Get();
+	m_LogLevel_PacketDecode = config.m_LogLevel_PacketDecode.Get();
+	m_LogLevel_Message = config.m_LogLevel_Message.Get();
+	m_LogLevel_PacketGaps = config.m_LogLevel_PacketGaps.Get();
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -215,10 +250,102 @@ void ConnectionConfig::Init( ConnectionConfig *pInherit )
 //
 /////////////////////////////////////////////////////////////////////////////
 
-CUtlHashMap<uint16, CGameNetworkConnectionBase *, std::equal_to<uint16>, Identity<uint16> > g_mapConnections;
+CConnectionTable g_mapConnections;
 CUtlHashMap<int, CGameNetworkPollGroup *, std::equal_to<int>, Identity<int> > g_mapPollGroups;
 TableLock g_tables_lock;
 
+uint32 CConnectionTable::Add( CGameNetworkConnectionBase *pConn )
+{
+	g_tables_lock.AssertHeldByCurrentThread();
+
+	// First time?  Choose the key for the ID permutation.  This must
+	// not change once we've handed out any IDs.
+	if ( m_vecSlots.empty() && m_nFreeSlots == 0 )
+	{
+		do {
+			CCrypto::GenerateRandomBlock( m_keySalt, sizeof(m_keySalt) );
+		} while ( m_keySalt[0] == 0 && m_keySalt[1] == 0 );
+	}
+
+	// Reuse the oldest free slot, if we have enough of them.  Otherwise,
+	// allocate a new one
+	uint32 idxSlot;
+	if ( m_nFreeSlots > 0 && ( m_nFreeSlots >= k_nMinFreeSlotsBeforeReuse || m_vecSlots.size() >= k_nMaxSlots ) )
+	{
+		idxSlot = m_idxFreeHead;
+		Slot &slot = m_vecSlots[ idxSlot ];
+		m_idxFreeHead = slot.m_idxNextFree;
+		if ( m_idxFreeHead == ~0u )
+			m_idxFreeTail = ~0u;
+		--m_nFreeSlots;
+	}
+	else if ( m_vecSlots.size() < k_nMaxSlots )
+	{
+		idxSlot = (uint32)m_vecSlots.size();
+		m_vecSlots.push_back( Slot{ nullptr, 0, 0, 0, ~0u } );
+	}
+	else
+	{
+		return 0;
+	}
+	Slot &slot = m_vecSlots[ idxSlot ];
+
+	// Assign the ID.  Make sure neither half is zero.  (The next
+	// generation is always OK, we don't need to try very many.)
+	uint32 nConnectionID;
+	for (;;)
+	{
+		nConnectionID = SaltConnectionID( ( slot.m_nGeneration << k_nSlotBits ) | idxSlot );
+		slot.m_nGeneration = ( slot.m_nGeneration + 1 ) & ( ( 1u << ( 32 - k_nSlotBits ) ) - 1 );
+		if ( ( nConnectionID & 0xffff ) != 0 && ( nConnectionID & 0xffff0000 ) != 0 )
+			break;
+	}
+	Assert( ( UnsaltConnectionID( nConnectionID ) & ( k_nMaxSlots-1 ) ) == idxSlot );
+
+	slot.m_pConn = pConn;
+	slot.m_nConnectionID = nConnectionID;
+	slot.m_idxDense = (uint32)m_vecConnections.size();
+	slot.m_idxNextFree = ~0u;
+	m_vecConnections.push_back( pConn );
+	return nConnectionID;
+}
+
+bool CConnectionTable::Remove( uint32 nConnectionID, CGameNetworkConnectionBase *pConn )
+{
+	g_tables_lock.AssertHeldByCurrentThread();
+
+	const uint32 idxSlot = UnsaltConnectionID( nConnectionID ) & ( k_nMaxSlots-1 );
+	if ( idxSlot >= m_vecSlots.size() )
+		return false;
+	Slot &slot = m_vecSlots[ idxSlot ];
+	if ( slot.m_nConnectionID != nConnectionID || slot.m_pConn != pConn )
+		return false;
+
+	// Move the last connection into our spot in the dense list
+	Assert( m_vecConnections[ slot.m_idxDense ] == pConn );
+	CGameNetworkConnectionBase *pLast = m_vecConnections.back();
+	if ( pLast != pConn )
+	{
+		m_vecConnections[ slot.m_idxDense ] = pLast;
+		Slot &slotLast = m_vecSlots[ UnsaltConnectionID( pLast->m_hConnectionSelf ) & ( k_nMaxSlots-1 ) ];
+		Assert( slotLast.m_pConn == pLast );
+		slotLast.m_idxDense = slot.m_idxDense;
+	}
+	m_vecConnections.pop_back();
+
+	// Put slot at the end of the free list
+	slot.m_pConn = nullptr;
+	slot.m_nConnectionID = 0;
+	slot.m_idxNextFree = ~0u;
+	if ( m_idxFreeTail == ~0u )
+		m_idxFreeHead = idxSlot;
+	else
+		m_vecSlots[ m_idxFreeTail ].m_idxNextFree = idxSlot;
+	m_idxFreeTail = idxSlot;
+	++m_nFreeSlots;
+	return true;
+}
+
 // Table of active listen sockets.  Listen sockets and this table are protected
 // by the global lock.
 CUtlHashMap<int, CGameNetworkListenSocketBase *, std::equal_to<int>, Identity<int> > g_mapListenSockets; 
@@ -251,16 +378,10 @@ static CGameNetworkConnectionBase *InternalGetConnectionByHandle( HGameNetConnec
 	if ( sock == 0 )
 		return nullptr;
 	TableScopeLock tableScopeLock( g_tables_lock );
-	int idx = g_mapConnections.Find( uint16( sock ) );
-	if ( idx == g_mapConnections.InvalidIndex() )
-		return nullptr;
-	CGameNetworkConnectionBase *pResult = g_mapConnections[ idx ];
+	CGameNetworkConnectionBase *pResult = g_mapConnections.Find( sock );
 	if ( !pResult )
-	{
-		AssertMsg( false, "g_mapConnections corruption!" );
 		return nullptr;
-	}
-	if ( uint16( pResult->m_hConnectionSelf ) != uint16( sock ) )
+	if ( pResult->m_hConnectionSelf != sock )
 	{
 		AssertMsg( false, "Connection map corruption!" );
 		return nullptr;
@@ -311,6 +432,32 @@ CGameNetworkConnectionBase *GetConnectionByHandle( HGameNetConnection sock, Conn
 	return InternalGetConnectionByHandle( sock, scopeLock, nullptr, false );
 }
 
+CGameNetworkConnectionBase *TryLockConnectionByLocalID( uint32 nLocalConnectionID, ConnectionScopeLock &scopeLock, const char *pszLockTag )
+{
+	// NOTE: We might not hold the global lock, and so we must not wait on
+	// any locks.  Fail immediately if anybody else has them.
+	if ( nLocalConnectionID == 0 || !g_tables_lock.try_lock( pszLockTag ) )
+		return nullptr;
+
+	CGameNetworkConnectionBase *pResult = nullptr;
+	CGameNetworkConnectionBase *pConn = g_mapConnections.Find( nLocalConnectionID );
+	if ( pConn )
+	{
+		if ( pConn->GetState() != k_EGameNetworkingConnectionState_Dead && scopeLock.TryLock( *pConn->m_pLock, 0, pszLockTag ) )
+		{
+			// Check again now that we have the connection locked
+			if ( pConn->GetState() != k_EGameNetworkingConnectionState_Dead && pConn->m_unConnectionIDLocal == nLocalConnectionID )
+				pResult = pConn;
+			else
+				scopeLock.Unlock();
+		}
+	}
+
+	// NOTE: We unlock the table lock here, OUT OF ORDER!
+	g_tables_lock.unlock();
+	return pResult;
+}
+
 inline CGameNetworkConnectionBase *GetConnectionByHandleForAPI( HGameNetConnection sock, ConnectionScopeLock &scopeLock, const char *pszLockTag )
 {
 	return InternalGetConnectionByHandle( sock, scopeLock, pszLockTag, true );
@@ -453,9 +600,8 @@ void CGameNetworkingSockets::KillConnections()
 
 	// Destroy all of my connections
 	CGameNetworkConnectionBase::ProcessDeletionList();
-	FOR_EACH_HASHMAP( g_mapConnections, idx )
+	for ( CGameNetworkConnectionBase *pConn: g_mapConnections.IterValues() )
 	{
-		CGameNetworkConnectionBase *pConn = g_mapConnections[idx];
 		if ( pConn->m_pGameNetworkingSocketsInterface == this )
 		{
 			ConnectionScopeLock connectionLock( *pConn );
@@ -1198,6 +1344,94 @@ void CGameNetworkingSockets::SendMessages( int nMessages, GameNetworkingMessage_
 		pConn->CheckConnectionStateOrScheduleWakeUp( usecNow );
 }
 
+void CGameNetworkingSockets::BroadcastMessage( GameNetworkingMessage_t *pMessage, int nConnections, const HGameNetConnection *pConnections, int64 *pOutMessageNumberOrResult )
+{
+	CGameNetworkingMessage *pOwner = static_cast<CGameNetworkingMessage*>( pMessage );
+	if ( !pOwner )
+	{
+		if ( pOutMessageNumberOrResult )
+		{
+			for ( int i = 0 ; i < nConnections ; ++i )
+				pOutMessageNumberOrResult[i] = -k_EResultInvalidParam;
+		}
+		return;
+	}
+
+	// The message we were given owns the payload.  Each connection gets its
+	// own (small) message object that points at it, since the reliability
+	// layer keeps per-connection state in the message.  Our reference keeps
+	// the payload alive while we are queuing.
+	pOwner->InitSharedPayload();
+
+	// GameNetworkingGlobalLock scopeLock( "BroadcastMessage" ); // NO, not necessary!
+	GameNetworkingMicroseconds usecNow = GameNetworkingSockets_GetLocalTimestamp();
+	for ( int i = 0 ; i < nConnections ; ++i )
+	{
+		int64 result;
+		ConnectionScopeLock connectionLock;
+		CGameNetworkConnectionBase *pConn = GetConnectionByHandleForAPI( pConnections[i], connectionLock, "BroadcastMessage" );
+		if ( !pConn )
+		{
+			result = -k_EResultInvalidParam;
+		}
+		else
+		{
+			CGameNetworkingMessage *pMsg = CGameNetworkingMessage::NewSharingPayload( pOwner );
+			if ( !pMsg )
+			{
+				result = -k_EResultFail;
+			}
+			else
+			{
+				bool bThinkImmediately = false;
+				result = pConn->APISendMessageToConnection( pMsg, usecNow, &bThinkImmediately );
+				if ( bThinkImmediately )
+					pConn->CheckConnectionStateOrScheduleWakeUp( usecNow );
+			}
+		}
+
+		if ( pOutMessageNumberOrResult )
+			pOutMessageNumberOrResult[i] = result;
+	}
+
+	// Release our reference.  If nobody else took one, this frees the payload now.
+	pOwner->ReleaseSharedPayload();
+}
+
+int CGameNetworkingSockets::BroadcastMessageToPollGroup( GameNetworkingMessage_t *pMessage, HGameNetPollGroup hPollGroup )
+{
+	// Grab the list of connections.  We can't hold the poll group lock while
+	// we lock the connections, that's the wrong order.  (Unless we also took
+	// the global lock, which we'd rather not.)  Any connections that leave
+	// the group in the meantime still get the message.
+	CUtlVector<HGameNetConnection> vecConnections;
+	{
+		PollGroupScopeLock pollGroupLock;
+		CGameNetworkPollGroup *pPollGroup = GetPollGroupByHandle( hPollGroup, pollGroupLock, "BroadcastMessageToPollGroup" );
+		if ( !pPollGroup )
+		{
+			if ( pMessage )
+				pMessage->Release();
+			return -1;
+		}
+		vecConnections.EnsureCapacity( pPollGroup->m_vecConnections.Count() );
+		for ( CGameNetworkConnectionBase *pConn: pPollGroup->m_vecConnections )
+			vecConnections.AddToTail( pConn->m_hConnectionSelf );
+	}
+
+	CUtlVector<int64> vecResults;
+	vecResults.SetCount( vecConnections.Count() );
+	BroadcastMessage( pMessage, vecConnections.Count(), vecConnections.Base(), vecResults.Base() );
+
+	int nSent = 0;
+	for ( int64 result: vecResults )
+	{
+		if ( result > 0 )
+			++nSent;
+	}
+	return nSent;
+}
+
 EResult CGameNetworkingSockets::FlushMessagesOnConnection( HGameNetConnection hConn )
 {
 	//GameNetworkingGlobalLock scopeLock( "FlushMessagesOnConnection" ); // NO, not necessary!
@@ -1208,6 +1442,16 @@ EResult CGameNetworkingSockets::FlushMessagesOnConnection( HGameNetConnection hC
 	return pConn->APIFlushMessageOnConnection();
 }
 
+EResult CGameNetworkingSockets::ConfigureConnectionLanes( HGameNetConnection hConn, int nNumLanes, const int *pLanePriorities, const uint16 *pLaneWeights )
+{
+	//GameNetworkingGlobalLock scopeLock( "ConfigureConnectionLanes" ); // NO, not necessary!
+	ConnectionScopeLock connectionLock;
+	CGameNetworkConnectionBase *pConn = GetConnectionByHandleForAPI( hConn, connectionLock, "ConfigureConnectionLanes" );
+	if ( !pConn )
+		return k_EResultInvalidParam;
+	return pConn->APIConfigureConnectionLanes( nNumLanes, pLanePriorities, pLaneWeights );
+}
+
 int CGameNetworkingSockets::ReceiveMessagesOnConnection( HGameNetConnection hConn, GameNetworkingMessage_t **ppOutMessages, int nMaxMessages )
 {
 	//GameNetworkingGlobalLock scopeLock( "ReceiveMessagesOnConnection" ); // NO, not necessary!
@@ -1285,10 +1529,7 @@ int CGameNetworkingSockets::ReceiveMessagesOnPollGroup( HGameNetPollGroup hPollG
 	CGameNetworkPollGroup *pPollGroup = GetPollGroupByHandle( hPollGroup, pollGroupLock, "ReceiveMessagesOnPollGroup" );
 	if ( !pPollGroup )
 		return -1;
-	g_lockAllRecvMessageQueues.lock();
-	int nMessagesReceived = pPollGroup->m_queueRecvMessages.RemoveMessages( ppOutMessages, nMaxMessages );
-	g_lockAllRecvMessageQueues.unlock();
-	return nMessagesReceived;
+	return pPollGroup->ReceiveMessages( ppOutMessages, nMaxMessages );
 }
 
 #ifdef STEAMNETWORKINGSOCKETS_STEAMCLIENT
@@ -1298,10 +1539,7 @@ int CGameNetworkingSockets::ReceiveMessagesOnListenSocketLegacyPollGroup( HSteam
 	CGameNetworkListenSocketBase *pSock = GetListenSocketByHandle( hSocket );
 	if ( !pSock )
 		return -1;
-	g_lockAllRecvMessageQueues.lock();
-	int nMessagesReceived = pSock->m_legacyPollGroup.m_queueRecvMessages.RemoveMessages( ppOutMessages, nMaxMessages );
-	g_lockAllRecvMessageQueues.unlock();
-	return nMessagesReceived;
+	return pSock->m_legacyPollGroup.ReceiveMessages( ppOutMessages, nMaxMessages );
 }
 #endif
 
@@ -1965,17 +2203,25 @@ bool CGameNetworkingUtils::SetConfigValue( EGameNetworkingConfigValue eValue,
 
 	GameNetworkingGlobalLock scopeLock( "SetConfigValue" );
 
+	bool bResult;
 	switch ( pEntry->m_eDataType )
 	{
-		case k_EGameNetworkingConfig_Int32: return SetConfigValueTyped<int32>( pEntry, eScopeType, scopeObj, eDataType, pValue );
-		case k_EGameNetworkingConfig_Int64: return SetConfigValueTyped<int64>( pEntry, eScopeType, scopeObj, eDataType, pValue );
-		case k_EGameNetworkingConfig_Float: return SetConfigValueTyped<float>( pEntry, eScopeType, scopeObj, eDataType, pValue );
-		case k_EGameNetworkingConfig_String: return SetConfigValueTyped<std::string>( pEntry, eScopeType, scopeObj, eDataType, pValue );
-		case k_EGameNetworkingConfig_Ptr: return SetConfigValueTyped<void *>( pEntry, eScopeType, scopeObj, eDataType, pValue );
+		case k_EGameNetworkingConfig_Int32: bResult = SetConfigValueTyped<int32>( pEntry, eScopeType, scopeObj, eDataType, pValue ); break;
+		case k_EGameNetworkingConfig_Int64: bResult = SetConfigValueTyped<int64>( pEntry, eScopeType, scopeObj, eDataType, pValue ); break;
+		case k_EGameNetworkingConfig_Float: bResult = SetConfigValueTyped<float>( pEntry, eScopeType, scopeObj, eDataType, pValue ); break;
+		case k_EGameNetworkingConfig_String: bResult = SetConfigValueTyped<std::string>( pEntry, eScopeType, scopeObj, eDataType, pValue ); break;
+		case k_EGameNetworkingConfig_Ptr: bResult = SetConfigValueTyped<void *>( pEntry, eScopeType, scopeObj, eDataType, pValue ); break;
+		default:
+			Assert( false );
+			return false;
 	}
 
-	Assert( false );
-	return false;
+	// Whatever scope this was, anybody holding a snapshot of
+	// effective values might be affected.  Bump the version
+	// after the value is in place, not before.
+	if ( bResult )
+		BumpConfigValueVersion();
+	return bResult;
 }
 
 EGameNetworkingGetConfigValueResult CGameNetworkingUtils::GetConfigValue(
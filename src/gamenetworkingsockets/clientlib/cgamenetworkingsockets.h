@@ -116,6 +116,10 @@ public:
 
 	virtual void RunCallbacks() override;
 
+	virtual void BroadcastMessage( GameNetworkingMessage_t *pMessage, int nConnections, const HGameNetConnection *pConnections, int64 *pOutMessageNumberOrResult ) override;
+	virtual int BroadcastMessageToPollGroup( GameNetworkingMessage_t *pMessage, HGameNetPollGroup hPollGroup ) override;
+	virtual EResult ConfigureConnectionLanes( HGameNetConnection hConn, int nNumLanes, const int *pLanePriorities, const uint16 *pLaneWeights ) override;
+
 	/// Configuration options that will apply to all connections on this interface
 	ConnectionConfig m_connectionConfig;
 
@@ -1,6 +1,7 @@
 //====== Copyright Valve Corporation, All rights reserved. ====================
 
 #include <time.h>
+#include <new>
 
 #include <gns/igamenetworkingsockets.h>
 #include "gamenetworkingsockets_connections.h"
@@ -21,9 +22,6 @@
 // Put everything in a namespace, so we don't violate the one definition rule
 namespace GameNetworkingSocketsLib {
 
-const int k_nMaxRecentLocalConnectionIDs = 256;
-static CUtlVectorFixed<uint16,k_nMaxRecentLocalConnectionIDs> s_vecRecentLocalConnectionIDs;
-
 /// Check if we've sent a "spam reply", meaning a reply to an incoming
 /// message that could be random spoofed garbage.  Returns false if we've
 /// recently sent one and cannot send any more right now without risking
@@ -61,18 +59,468 @@ bool BCheckGlobalSpamReplyRateLimit( GameNetworkingMicroseconds usecNow )
 //
 /////////////////////////////////////////////////////////////////////////////
 
+// Messages are allocated as a single block: the CGameNetworkingMessage,
+// followed by the payload.  Blocks come from a handful of size classes that
+// cover payloads up to the max plaintext size of a single packet, which is
+// nearly all of the traffic.  Larger payloads get a header-only block, and
+// the data is malloc'd separately.
+//
+// Each thread has a small cache of free blocks per size class, so allocating
+// and releasing messages is normally just a push or pop, with no locks.  The
+// cache is refilled from (or spills into) a shared pool in batches.  The
+// shared pool uses a raw mutex, not one of our debug-tracked locks, because
+// messages are allocated and freed while holding all sorts of other locks,
+// including ShortDurationLock's such as g_lockAllRecvMessageQueues.  It is a
+// leaf lock, and nothing is done while holding it other than list surgery.
+//
+// Blocks are carved out of aligned slabs, so we can find a block's slab
+// just by masking the pointer.  The shared pool tracks free blocks per slab.
+// When a slab is entirely free and the pool is holding more than
+// k_cbMessagePoolSharedFreeMax of idle blocks for that size class, the slab is
+// returned to the system.  Empty slabs are also freed at shutdown.  (Blocks
+// sitting in a thread cache are not free as far as their slab is concerned,
+// so a slab that any thread has cached blocks from is never freed.)
+
+#if defined( __SANITIZE_ADDRESS__ ) || defined( __SANITIZE_THREAD__ )
+	// Let the sanitizer see every block individually, so it can catch use after free
+	#define MESSAGE_POOL_PASSTHROUGH
+#elif defined( __has_feature )
+	// Clang doesn't define the GCC macros
+	#if __has_feature( address_sanitizer ) || __has_feature( thread_sanitizer )
+		#define MESSAGE_POOL_PASSTHROUGH
+	#endif
+#endif
+
+const int k_cbMessageBlockHeader = ( sizeof(CGameNetworkingMessage) + 15 ) & ~15;
+const int k_arMessagePoolPayloadSize[] = { 0, 64, 256, 512, k_cbGameNetworkingSocketsMaxPlaintextPayloadRecv };
+const int k_nMessagePoolSizeClasses = V_ARRAYSIZE( k_arMessagePoolPayloadSize );
+const int k_nMessagePoolThreadCacheMax = 64; // Max blocks each thread will cache, per size class
+const int k_nMessagePoolBatch = 32; // Blocks moved between thread and shared pool at a time
+const int k_cbMessagePoolSlab = 64*1024; // Size and alignment of a slab
+const int k_cbMessagePoolSharedFreeMax = 1024*1024; // Idle memory per size class in the shared pool, above which we free empty slabs
+
+struct MessagePoolFreeBlock
+{
+	MessagePoolFreeBlock *m_pNext;
+};
+
+struct MessagePoolSlab
+{
+	MessagePoolSlab *m_pPrev; // Links in the shared list of slabs that have free blocks
+	MessagePoolSlab *m_pNext;
+	MessagePoolFreeBlock *m_pFirstFree;
+	int m_nFree; // Number of blocks in m_pFirstFree
+	int m_nBlocks;
+};
+const int k_cbMessagePoolSlabHeader = ( sizeof(MessagePoolSlab) + 15 ) & ~15;
+COMPILE_TIME_ASSERT( k_cbMessagePoolSlabHeader + ( k_cbMessageBlockHeader + k_cbGameNetworkingSocketsMaxPlaintextPayloadRecv ) * k_nMessagePoolBatch <= k_cbMessagePoolSlab );
+
+struct MessagePoolSharedList
+{
+	ShortDurationMutexImpl m_mutex;
+	MessagePoolSlab *m_pFirstSlab = nullptr; // Slabs with at least one free block.  We allocate from the front.
+	MessagePoolSlab *m_pLastSlab = nullptr;
+	int m_nFree = 0; // Total free blocks in all slabs
+};
+static MessagePoolSharedList s_arMessagePoolShared[ k_nMessagePoolSizeClasses ];
+
+static std::atomic<int64> s_nMessagePoolHits( 0 );
+static std::atomic<int64> s_nMessagePoolMisses( 0 );
+static std::atomic<int64> s_nMessagePoolSlabs( 0 );
+static std::atomic<int64> s_cbMessagePoolSlabs( 0 );
+static std::atomic<int64> s_nMessagePoolOversizedPayloads( 0 );
+
+// Plain old data, so it is zero-initialized and access doesn't need
+// a guard check.  MessagePoolThreadCacheFlusher returns the blocks
+// to the shared pool when the thread exits.
+struct MessagePoolThreadCache
+{
+	void *m_arBlocks[ k_nMessagePoolSizeClasses ][ k_nMessagePoolThreadCacheMax ];
+	int m_arCount[ k_nMessagePoolSizeClasses ];
+	int m_nHits; // Not yet published
+	int m_nMisses;
+	bool m_bFlusherRegistered;
+	bool m_bThreadExiting; // Thread is shutting down; don't use the cache anymore
+};
+static thread_local MessagePoolThreadCache tls_messagePoolCache;
+
+inline int MessagePool_BlockSize( int nSizeClass )
+{
+	return k_cbMessageBlockHeader + k_arMessagePoolPayloadSize[ nSizeClass ];
+}
+
+inline MessagePoolSlab *MessagePool_SlabFromBlock( void *pBlock )
+{
+	return reinterpret_cast<MessagePoolSlab *>( reinterpret_cast<uintptr_t>( pBlock ) & ~(uintptr_t)( k_cbMessagePoolSlab-1 ) );
+}
+
+static void MessagePool_PublishCounters( MessagePoolThreadCache &cache )
+{
+	if ( cache.m_nHits )
+	{
+		s_nMessagePoolHits.fetch_add( cache.m_nHits, std::memory_order_relaxed );
+		cache.m_nHits = 0;
+	}
+	if ( cache.m_nMisses )
+	{
+		s_nMessagePoolMisses.fetch_add( cache.m_nMisses, std::memory_order_relaxed );
+		cache.m_nMisses = 0;
+	}
+}
+
+/// Add a slab to the end of the list of slabs with free blocks.  Shared lock must be held
+static void MessagePool_LinkSlab( MessagePoolSharedList &shared, MessagePoolSlab *pSlab )
+{
+	pSlab->m_pPrev = shared.m_pLastSlab;
+	pSlab->m_pNext = nullptr;
+	if ( shared.m_pLastSlab )
+		shared.m_pLastSlab->m_pNext = pSlab;
+	else
+		shared.m_pFirstSlab = pSlab;
+	shared.m_pLastSlab = pSlab;
+}
+
+/// Remove a slab from the list of slabs with free blocks.  Shared lock must be held
+static void MessagePool_UnlinkSlab( MessagePoolSharedList &shared, MessagePoolSlab *pSlab )
+{
+	if ( pSlab->m_pPrev )
+		pSlab->m_pPrev->m_pNext = pSlab->m_pNext;
+	else
+		shared.m_pFirstSlab = pSlab->m_pNext;
+	if ( pSlab->m_pNext )
+		pSlab->m_pNext->m_pPrev = pSlab->m_pPrev;
+	else
+		shared.m_pLastSlab = pSlab->m_pPrev;
+	pSlab->m_pPrev = pSlab->m_pNext = nullptr;
+}
+
+/// Return a chain of slabs (linked by m_pNext) to the system
+static void MessagePool_FreeSlabs( MessagePoolSlab *pSlab )
+{
+	while ( pSlab )
+	{
+		MessagePoolSlab *pNext = pSlab->m_pNext;
+		s_nMessagePoolSlabs.fetch_sub( 1, std::memory_order_relaxed );
+		s_cbMessagePoolSlabs.fetch_sub( k_cbMessagePoolSlab, std::memory_order_relaxed );
+		#ifdef _WIN32
+			_aligned_free( pSlab );
+		#else
+			free( pSlab );
+		#endif
+		pSlab = pNext;
+	}
+}
+
+/// Return blocks to the shared pool.  If that leaves a slab entirely free,
+/// and we have more than cbKeepFree of idle blocks, free the slab
+static void MessagePool_PushShared( int nSizeClass, void **ppBlocks, int nBlocks, int cbKeepFree = k_cbMessagePoolSharedFreeMax )
+{
+	if ( nBlocks <= 0 )
+		return;
+
+	const int nKeepFree = cbKeepFree / MessagePool_BlockSize( nSizeClass );
+	MessagePoolSlab *pSlabsToFree = nullptr;
+	MessagePoolSharedList &shared = s_arMessagePoolShared[ nSizeClass ];
+	{
+		std::lock_guard<ShortDurationMutexImpl> lock( shared.m_mutex );
+		for ( int i = 0 ; i < nBlocks ; ++i )
+		{
+			MessagePoolFreeBlock *p = static_cast<MessagePoolFreeBlock *>( ppBlocks[i] );
+			MessagePoolSlab *pSlab = MessagePool_SlabFromBlock( p );
+			Assert( pSlab->m_nFree < pSlab->m_nBlocks );
+			p->m_pNext = pSlab->m_pFirstFree;
+			pSlab->m_pFirstFree = p;
+			if ( pSlab->m_nFree++ == 0 )
+				MessagePool_LinkSlab( shared, pSlab );
+			++shared.m_nFree;
+
+			if ( pSlab->m_nFree == pSlab->m_nBlocks && shared.m_nFree > nKeepFree )
+			{
+				MessagePool_UnlinkSlab( shared, pSlab );
+				shared.m_nFree -= pSlab->m_nBlocks;
+				pSlab->m_pNext = pSlabsToFree;
+				pSlabsToFree = pSlab;
+			}
+		}
+	}
+
+	// Don't call into the allocator while holding the lock
+	MessagePool_FreeSlabs( pSlabsToFree );
+}
+
+/// Take up to nMax blocks from the shared pool.  Returns the number fetched
+static int MessagePool_PopShared( int nSizeClass, void **ppBlocks, int nMax )
+{
+	MessagePoolSharedList &shared = s_arMessagePoolShared[ nSizeClass ];
+	std::lock_guard<ShortDurationMutexImpl> lock( shared.m_mutex );
+	int n = 0;
+	while ( n < nMax && shared.m_pFirstSlab )
+	{
+		MessagePoolSlab *pSlab = shared.m_pFirstSlab;
+		do
+		{
+			MessagePoolFreeBlock *p = pSlab->m_pFirstFree;
+			pSlab->m_pFirstFree = p->m_pNext;
+			ppBlocks[n++] = p;
+			--pSlab->m_nFree;
+			--shared.m_nFree;
+		} while ( n < nMax && pSlab->m_nFree > 0 );
+		if ( pSlab->m_nFree == 0 )
+			MessagePool_UnlinkSlab( shared, pSlab );
+	}
+	return n;
+}
+
+/// Allocate a new slab and add its blocks to the shared pool.  Returns false if we're out of memory
+static bool MessagePool_AllocSlab( int nSizeClass )
+{
+	#ifdef _WIN32
+		void *pMem = _aligned_malloc( k_cbMessagePoolSlab, k_cbMessagePoolSlab );
+	#else
+		void *pMem = nullptr;
+		if ( posix_memalign( &pMem, k_cbMessagePoolSlab, k_cbMessagePoolSlab ) != 0 )
+			pMem = nullptr;
+	#endif
+	if ( !pMem )
+		return false;
+
+	MessagePoolSlab *pSlab = static_cast<MessagePoolSlab *>( pMem );
+	int cbBlock = MessagePool_BlockSize( nSizeClass );
+	pSlab->m_nBlocks = ( k_cbMessagePoolSlab - k_cbMessagePoolSlabHeader ) / cbBlock;
+	pSlab->m_nFree = pSlab->m_nBlocks;
+	pSlab->m_pFirstFree = nullptr;
+	char *pFirstBlock = static_cast<char *>( pMem ) + k_cbMessagePoolSlabHeader;
+	for ( int i = pSlab->m_nBlocks-1 ; i >= 0 ; --i )
+	{
+		MessagePoolFreeBlock *p = reinterpret_cast<MessagePoolFreeBlock *>( pFirstBlock + i*cbBlock );
+		p->m_pNext = pSlab->m_pFirstFree;
+		pSlab->m_pFirstFree = p;
+	}
+	s_nMessagePoolSlabs.fetch_add( 1, std::memory_order_relaxed );
+	s_cbMessagePoolSlabs.fetch_add( k_cbMessagePoolSlab, std::memory_order_relaxed );
+
+	MessagePoolSharedList &shared = s_arMessagePoolShared[ nSizeClass ];
+	std::lock_guard<ShortDurationMutexImpl> lock( shared.m_mutex );
+	MessagePool_LinkSlab( shared, pSlab );
+	shared.m_nFree += pSlab->m_nBlocks;
+	return true;
+}
+
+/// Take up to nMax blocks from the shared pool, allocating a slab if it is empty.
+/// Returns the number fetched, which is zero only if we are out of memory
+static int MessagePool_PopSharedOrAllocSlab( int nSizeClass, void **ppBlocks, int nMax )
+{
+	for (;;)
+	{
+		int n = MessagePool_PopShared( nSizeClass, ppBlocks, nMax );
+		if ( n > 0 )
+			return n;
+		if ( !MessagePool_AllocSlab( nSizeClass ) )
+			return 0;
+	}
+}
+
+/// Flush the thread cache when the thread exits
+struct MessagePoolThreadCacheFlusher
+{
+	~MessagePoolThreadCacheFlusher()
+	{
+		MessagePoolThreadCache &cache = tls_messagePoolCache;
+		for ( int nSizeClass = 0 ; nSizeClass < k_nMessagePoolSizeClasses ; ++nSizeClass )
+		{
+			MessagePool_PushShared( nSizeClass, cache.m_arBlocks[ nSizeClass ], cache.m_arCount[ nSizeClass ] );
+			cache.m_arCount[ nSizeClass ] = 0;
+		}
+		MessagePool_PublishCounters( cache );
+		cache.m_bThreadExiting = true;
+	}
+};
+
+static void *MessagePool_AllocSlow( int nSizeClass )
+{
+	MessagePoolThreadCache &cache = tls_messagePoolCache;
+
+	// Thread is going away?  Don't put anything into the cache,
+	// just grab a single block.
+	if ( cache.m_bThreadExiting )
+	{
+		s_nMessagePoolMisses.fetch_add( 1, std::memory_order_relaxed );
+		void *pBlock;
+		if ( MessagePool_PopSharedOrAllocSlab( nSizeClass, &pBlock, 1 ) == 1 )
+			return pBlock;
+		return nullptr;
+	}
+
+	// Make sure we will give our cached blocks back when the thread exits
+	if ( !cache.m_bFlusherRegistered )
+	{
+		static thread_local MessagePoolThreadCacheFlusher tls_flusher;
+		(void)tls_flusher;
+		cache.m_bFlusherRegistered = true;
+	}
+
+	++cache.m_nMisses;
+	MessagePool_PublishCounters( cache );
+
+	void **ppBlocks = cache.m_arBlocks[ nSizeClass ];
+	int n = MessagePool_PopSharedOrAllocSlab( nSizeClass, ppBlocks, k_nMessagePoolBatch );
+	if ( n == 0 )
+		return nullptr;
+	cache.m_arCount[ nSizeClass ] = n-1;
+	return ppBlocks[ n-1 ];
+}
+
+static void MessagePool_FreeSlow( int nSizeClass, void *pBlock )
+{
+	MessagePoolThreadCache &cache = tls_messagePoolCache;
+	if ( cache.m_bThreadExiting )
+	{
+		MessagePool_PushShared( nSizeClass, &pBlock, 1 );
+		return;
+	}
+
+	// Cache is full.  Spill the oldest batch into the shared pool,
+	// keeping the most recently used (and hopefully hot) blocks.
+	void **ppBlocks = cache.m_arBlocks[ nSizeClass ];
+	MessagePool_PushShared( nSizeClass, ppBlocks, k_nMessagePoolBatch );
+	int nKeep = k_nMessagePoolThreadCacheMax - k_nMessagePoolBatch;
+	memmove( ppBlocks, ppBlocks + k_nMessagePoolBatch, nKeep * sizeof(void*) );
+	ppBlocks[ nKeep ] = pBlock;
+	cache.m_arCount[ nSizeClass ] = nKeep+1;
+	MessagePool_PublishCounters( cache );
+}
+
+static inline void *MessagePool_Alloc( int nSizeClass )
+{
+	#ifdef MESSAGE_POOL_PASSTHROUGH
+		return malloc( MessagePool_BlockSize( nSizeClass ) );
+	#else
+		MessagePoolThreadCache &cache = tls_messagePoolCache;
+		int &n = cache.m_arCount[ nSizeClass ];
+		if ( likely( n > 0 ) )
+		{
+			++cache.m_nHits;
+			return cache.m_arBlocks[ nSizeClass ][ --n ];
+		}
+		return MessagePool_AllocSlow( nSizeClass );
+	#endif
+}
+
+static inline void MessagePool_Free( int nSizeClass, void *pBlock )
+{
+	#ifdef MESSAGE_POOL_PASSTHROUGH
+		free( pBlock );
+	#else
+		MessagePoolThreadCache &cache = tls_messagePoolCache;
+		int &n = cache.m_arCount[ nSizeClass ];
+		if ( likely( n < k_nMessagePoolThreadCacheMax ) )
+			cache.m_arBlocks[ nSizeClass ][ n++ ] = pBlock;
+		else
+			MessagePool_FreeSlow( nSizeClass, pBlock );
+	#endif
+}
+
+void MessagePool_GetStats( MessagePoolStats_t &stats )
+{
+	#ifndef MESSAGE_POOL_PASSTHROUGH
+		MessagePool_PublishCounters( tls_messagePoolCache );
+	#endif
+	stats.m_nHits = s_nMessagePoolHits.load( std::memory_order_relaxed );
+	stats.m_nMisses = s_nMessagePoolMisses.load( std::memory_order_relaxed );
+	stats.m_nSlabs = s_nMessagePoolSlabs.load( std::memory_order_relaxed );
+	stats.m_cbSlabs = s_cbMessagePoolSlabs.load( std::memory_order_relaxed );
+	stats.m_nOversizedPayloads = s_nMessagePoolOversizedPayloads.load( std::memory_order_relaxed );
+}
+
+void MessagePool_Trim()
+{
+	#ifndef MESSAGE_POOL_PASSTHROUGH
+		MessagePoolThreadCache &cache = tls_messagePoolCache;
+		for ( int nSizeClass = 0 ; nSizeClass < k_nMessagePoolSizeClasses ; ++nSizeClass )
+		{
+			// Flush our own cache, and free any slab that this leaves empty
+			MessagePool_PushShared( nSizeClass, cache.m_arBlocks[ nSizeClass ], cache.m_arCount[ nSizeClass ], 0 );
+			cache.m_arCount[ nSizeClass ] = 0;
+
+			// Free any other empty slabs
+			MessagePoolSlab *pSlabsToFree = nullptr;
+			MessagePoolSharedList &shared = s_arMessagePoolShared[ nSizeClass ];
+			{
+				std::lock_guard<ShortDurationMutexImpl> lock( shared.m_mutex );
+				MessagePoolSlab *pSlab = shared.m_pFirstSlab;
+				while ( pSlab )
+				{
+					MessagePoolSlab *pNext = pSlab->m_pNext;
+					if ( pSlab->m_nFree == pSlab->m_nBlocks )
+					{
+						MessagePool_UnlinkSlab( shared, pSlab );
+						shared.m_nFree -= pSlab->m_nBlocks;
+						pSlab->m_pNext = pSlabsToFree;
+						pSlabsToFree = pSlab;
+					}
+					pSlab = pNext;
+				}
+			}
+			MessagePool_FreeSlabs( pSlabsToFree );
+		}
+		MessagePool_PublishCounters( cache );
+	#endif
+}
+
 void CGameNetworkingMessage::DefaultFreeData( GameNetworkingMessage_t *pMsg )
 {
 	free( pMsg->m_pData );
 }
 
+void CGameNetworkingMessage::InlineFreeData( GameNetworkingMessage_t *pMsg )
+{
+}
+
+void CGameNetworkingMessage::SharedPayloadFreeData( GameNetworkingMessage_t *pMsg )
+{
+	// We stashed the owner of the payload in the user data field
+	CGameNetworkingMessage *pOwner = reinterpret_cast<CGameNetworkingMessage *>( (intptr_t)pMsg->m_nUserData );
+	Assert( pOwner && pOwner->m_pData == pMsg->m_pData );
+	pOwner->ReleaseSharedPayload();
+}
+
+void CGameNetworkingMessage::ReleaseSharedPayload()
+{
+	int nRefCount = m_nSharedPayloadRefCount.fetch_sub( 1, std::memory_order_acq_rel );
+	Assert( nRefCount > 0 );
+	if ( nRefCount == 1 )
+		Release();
+}
+
+CGameNetworkingMessage *CGameNetworkingMessage::NewSharingPayload( CGameNetworkingMessage *pOwner )
+{
+	Assert( pOwner->m_nSharedPayloadRefCount.load( std::memory_order_relaxed ) > 0 );
+
+	CGameNetworkingMessage *pMsg = New( 0 );
+	if ( !pMsg )
+		return nullptr;
+	pMsg->m_nFlags = pOwner->m_nFlags;
+	pMsg->m_nChannel = pOwner->m_nChannel;
+	pMsg->m_idxLane = pOwner->m_idxLane;
+	pMsg->m_cbSize = pOwner->m_cbSize;
+
+	// An empty payload doesn't have anything to share
+	if ( pOwner->m_pData )
+	{
+		pOwner->m_nSharedPayloadRefCount.fetch_add( 1, std::memory_order_relaxed );
+		pMsg->m_pData = pOwner->m_pData;
+		pMsg->m_pfnFreeData = SharedPayloadFreeData;
+		pMsg->m_nUserData = (int64)reinterpret_cast<intptr_t>( pOwner );
+	}
+	return pMsg;
+}
 
 void CGameNetworkingMessage::ReleaseFunc( GameNetworkingMessage_t *pIMsg )
 {
 	CGameNetworkingMessage *pMsg = static_cast<CGameNetworkingMessage *>( pIMsg );
 
 	// Free up the buffer, if we have one
-	if ( pMsg->m_pData && pMsg->m_pfnFreeData )
+	if ( pMsg->m_pData && pMsg->m_pfnFreeData && pMsg->m_pfnFreeData != InlineFreeData )
 		(*pMsg->m_pfnFreeData)( pMsg );
 	pMsg->m_pData = nullptr; // Just for grins
 
@@ -85,38 +533,63 @@ void CGameNetworkingMessage::ReleaseFunc( GameNetworkingMessage_t *pIMsg )
 	Assert( !pMsg->m_linksSecondaryQueue.m_pPrev );
 	Assert( !pMsg->m_linksSecondaryQueue.m_pNext );
 
-	// Self destruct
-	// FIXME Should avoid this dynamic memory call with some sort of pooling
-	delete pMsg;
+	// Self destruct, returning our block to the pool
+	int nSizeClass = pMsg->m_nPoolSizeClass;
+	Assert( nSizeClass >= 0 && nSizeClass < k_nMessagePoolSizeClasses );
+	pMsg->~CGameNetworkingMessage();
+	MessagePool_Free( nSizeClass, pMsg );
 }
 
 CGameNetworkingMessage *CGameNetworkingMessage::New( uint32 cbSize )
 {
-	// FIXME Should avoid this dynamic memory call with some sort of pooling
-	CGameNetworkingMessage *pMsg = new CGameNetworkingMessage;
+	// Locate the smallest size class that will hold the payload.  If it's
+	// too big for any of them, use a header-only block.
+	int nSizeClass = 0;
+	if ( cbSize <= (uint32)k_arMessagePoolPayloadSize[ k_nMessagePoolSizeClasses-1 ] )
+	{
+		while ( cbSize > (uint32)k_arMessagePoolPayloadSize[ nSizeClass ] )
+			++nSizeClass;
+	}
+
+	void *pBlock = MessagePool_Alloc( nSizeClass );
+	if ( !pBlock )
+	{
+		SpewError( "Failed to allocate %d-byte message block", MessagePool_BlockSize( nSizeClass ) );
+		return nullptr;
+	}
+	CGameNetworkingMessage *pMsg = ::new( pBlock ) CGameNetworkingMessage;
+	pMsg->m_nPoolSizeClass = nSizeClass;
 
 	// NOTE: Intentionally not memsetting the whole thing;
 	// this struct is pretty big.
 
 	// Allocate buffer if requested
-	if ( cbSize )
+	if ( cbSize == 0 )
+	{
+		pMsg->m_cbSize = 0;
+		pMsg->m_pData = nullptr;
+		pMsg->m_pfnFreeData = nullptr;
+	}
+	else if ( nSizeClass > 0 )
+	{
+		pMsg->m_pData = (char *)pBlock + k_cbMessageBlockHeader;
+		pMsg->m_cbSize = cbSize;
+		pMsg->m_pfnFreeData = CGameNetworkingMessage::InlineFreeData;
+	}
+	else
 	{
+		s_nMessagePoolOversizedPayloads.fetch_add( 1, std::memory_order_relaxed );
 		pMsg->m_pData = malloc( cbSize );
 		if ( pMsg->m_pData == nullptr )
 		{
-			delete pMsg;
+			pMsg->~CGameNetworkingMessage();
+			MessagePool_Free( nSizeClass, pBlock );
 			SpewError( "Failed to allocate %d-byte message buffer", cbSize );
 			return nullptr;
 		}
 		pMsg->m_cbSize = cbSize;
 		pMsg->m_pfnFreeData = CGameNetworkingMessage::DefaultFreeData;
 	}
-	else
-	{
-		pMsg->m_cbSize = 0;
-		pMsg->m_pData = nullptr;
-		pMsg->m_pfnFreeData = nullptr;
-	}
 
 	// Clear identity
 	pMsg->m_conn = k_HGameNetConnection_Invalid;
@@ -129,6 +602,8 @@ CGameNetworkingMessage *CGameNetworkingMessage::New( uint32 cbSize )
 	// Clear these fields
 	pMsg->m_nChannel = -1;
 	pMsg->m_nFlags = 0;
+	pMsg->m_idxLane = 0;
+	pMsg->m_nSharedPayloadRefCount.store( 0, std::memory_order_relaxed );
 	pMsg->m_links.Clear();
 	pMsg->m_linksSecondaryQueue.Clear();
 
@@ -327,12 +802,13 @@ int GameNetworkingMessageQueue::RemoveMessages( GameNetworkingMessage_t **ppOutM
 
 CGameNetworkPollGroup::CGameNetworkPollGroup( CGameNetworkingSockets *pInterface )
 : m_pGameNetworkingSocketsInterface( pInterface )
+, m_lockRecvMessages( "pollgroup_recv_msg_queue" )
 , m_hPollGroupSelf( k_HSteamListenSocket_Invalid )
 {
 	// Object creation is rare; to keep things simple we require the global lock
 	GameNetworkingGlobalLock::AssertHeldByCurrentThread();
 
-	m_queueRecvMessages.m_pRequiredLock = &g_lockAllRecvMessageQueues;
+	m_queueRecvMessages.m_pRequiredLock = &m_lockRecvMessages;
 }
 
 CGameNetworkPollGroup::~CGameNetworkPollGroup()
@@ -353,7 +829,8 @@ CGameNetworkPollGroup::~CGameNetworkPollGroup()
 
 	// We should not have any messages now!  but if we do, unlink them
 	{
-		ShortDurationScopeLock lockMessageQueues( g_lockAllRecvMessageQueues );
+		ShortDurationScopeLock lockMessageQueues( m_lockRecvMessages );
+		Assert( m_inboxRecvMessages.empty() ); // Removing the connections should have drained this
 		Assert( m_queueRecvMessages.empty() );
 
 		// But if we do, unlink them but leave them in the main queue.
@@ -398,6 +875,32 @@ CGameNetworkPollGroup::~CGameNetworkPollGroup()
 	m_lock.unlock();
 }
 
+void CGameNetworkPollGroup::DrainRecvInbox()
+{
+	m_lockRecvMessages.AssertHeldByCurrentThread();
+
+	CGameNetworkingMessage *pMsg = m_inboxRecvMessages.PopAll();
+	while ( pMsg )
+	{
+		CGameNetworkingMessage *pNext = pMsg->m_links.m_pNext;
+		GameNetworkingMessageQueue *pConnQueue = pMsg->m_links.m_pQueue;
+		Assert( pConnQueue && pConnQueue->m_pRequiredLock == &m_lockRecvMessages );
+		pMsg->m_links.Clear();
+
+		pMsg->LinkToQueueTail( &CGameNetworkingMessage::m_links, pConnQueue );
+		pMsg->LinkToQueueTail( &CGameNetworkingMessage::m_linksSecondaryQueue, &m_queueRecvMessages );
+
+		pMsg = pNext;
+	}
+}
+
+int CGameNetworkPollGroup::ReceiveMessages( GameNetworkingMessage_t **ppOutMessages, int nMaxMessages )
+{
+	ShortDurationScopeLock lockMessageQueues( m_lockRecvMessages );
+	DrainRecvInbox();
+	return m_queueRecvMessages.RemoveMessages( ppOutMessages, nMaxMessages );
+}
+
 void CGameNetworkPollGroup::AssignHandleAndAddToGlobalTable()
 {
 	// Object creation is rare; to keep things simple we require the global lock
@@ -667,6 +1170,7 @@ CGameNetworkConnectionBase::CGameNetworkConnectionBase( CGameNetworkingSockets *
 	m_hSelfInParentListenSocketMap = -1;
 	m_bCertHasIdentity = false;
 	m_bCryptKeysValid = false;
+	m_bHasPrecomputedPremasterSecret = false;
 	m_eNegotiatedCipher = k_EGameNetworkingSocketsCipher_INVALID;
 	memset( m_szAppName, 0, sizeof( m_szAppName ) );
 	memset( m_szDescription, 0, sizeof( m_szDescription ) );
@@ -697,39 +1201,15 @@ CGameNetworkConnectionBase::~CGameNetworkConnectionBase()
 	// and we cannot take it here without potentially introducing deadlock
 	if ( m_hConnectionSelf != k_HGameNetConnection_Invalid )
 	{
-		int idx = g_mapConnections.Find( uint16( m_hConnectionSelf ) );
-		if ( idx == g_mapConnections.InvalidIndex() || g_mapConnections[ idx ] != this )
-		{
+		if ( !g_mapConnections.Remove( m_hConnectionSelf, this ) )
 			AssertMsg( false, "Connection list bookeeping corruption" );
-			FOR_EACH_HASHMAP( g_mapConnections, i )
-			{
-				if ( g_mapConnections[i] == this )
-					g_mapConnections.RemoveAt( i );
-			}
-		}
-		else
-		{
-			g_mapConnections[ idx ] = nullptr; // Just for grins
-			g_mapConnections.RemoveAt( idx );
-		}
 
 		m_hConnectionSelf = k_HGameNetConnection_Invalid;
 	}
 
-	// Save connection ID so we avoid using the same thing in the very near future.
-	if ( m_unConnectionIDLocal )
-	{
-		// Trim history to max.  If we're really cycling through connections fast, this
-		// history won't be very useful, but that should be an extremely rare edge case,
-		// and the worst thing that happens is that we have a higher chance of reusing
-		// a connection ID that shares the same bottom 16 bits.
-		while ( s_vecRecentLocalConnectionIDs.Count() >= k_nMaxRecentLocalConnectionIDs )
-			s_vecRecentLocalConnectionIDs.Remove( 0 );
-		s_vecRecentLocalConnectionIDs.AddToTail( (uint16)m_unConnectionIDLocal );
-
-		// Clear it, since this function should be idempotent
-		m_unConnectionIDLocal = 0;
-	}
+	// Clear it, since this function should be idempotent.  (The connection
+	// table takes care of not reusing the ID in the near future.)
+	m_unConnectionIDLocal = 0;
 }
 
 static std_vector<CGameNetworkConnectionBase *> s_vecPendingDeleteConnections;
@@ -792,9 +1272,9 @@ void CGameNetworkConnectionBase::FreeResources()
 	SetState( k_EGameNetworkingConnectionState_Dead, GameNetworkingSockets_GetLocalTimestamp() );
 
 	// Discard any messages that weren't retrieved
-	g_lockAllRecvMessageQueues.lock();
+	LockRecvMessageQueue();
 	m_queueRecvMessages.PurgeMessages();
-	g_lockAllRecvMessageQueues.unlock();
+	UnlockRecvMessageQueue();
 
 	// If we are in a poll group, remove us from the group
 	RemoveFromPollGroup();
@@ -827,10 +1307,13 @@ void CGameNetworkConnectionBase::RemoveFromPollGroup()
 		return;
 	PollGroupScopeLock pollGroupLock( m_pPollGroup->m_lock );
 
-	// Scan all of our messages, and make sure they are not in the secondary queue
+	// Scan all of our messages, and make sure they are not in the secondary queue.
+	// First make sure anything still sitting in the poll group's inbox has been
+	// linked into our queue, so we don't leave any stragglers behind.
 	{
-		ShortDurationScopeLock lockMessageQueues( g_lockAllRecvMessageQueues );
-		for ( CGameNetworkingMessage *pMsg = m_queueRecvMessages.m_pFirst ; pMsg ; pMsg = pMsg->m_linksSecondaryQueue.m_pNext )
+		ShortDurationScopeLock lockMessageQueues( m_pPollGroup->m_lockRecvMessages );
+		m_pPollGroup->DrainRecvInbox();
+		for ( CGameNetworkingMessage *pMsg = m_queueRecvMessages.m_pFirst ; pMsg ; pMsg = pMsg->m_links.m_pNext )
 		{
 			Assert( pMsg->m_links.m_pQueue == &m_queueRecvMessages );
 
@@ -840,6 +1323,9 @@ void CGameNetworkConnectionBase::RemoveFromPollGroup()
 			// OK, do the work
 			pMsg->UnlinkFromQueue( &CGameNetworkingMessage::m_linksSecondaryQueue );
 		}
+
+		// Our queue is now protected only by our own lock
+		m_queueRecvMessages.m_pRequiredLock = nullptr;
 	}
 
 	// Remove us from the poll group's list.  DbgVerify because we should be in the list!
@@ -864,12 +1350,13 @@ void CGameNetworkConnectionBase::SetPollGroup( CGameNetworkPollGroup *pPollGroup
 		return;
 	}
 
-	// Grab locks for old and new poll groups.  Remember, we can take multiple locks without
+	// Leave the old poll group, if any.  This unlinks our messages from
+	// its queue, so below we only need to deal with the new group.
+	RemoveFromPollGroup();
+
+	// Grab lock for new poll group.  Remember, we can take multiple locks without
 	// worrying about deadlock because we hold the global lock
 	PollGroupScopeLock pollGroupLockNew( pPollGroup->m_lock );
-	PollGroupScopeLock pollGroupLockOld;
-	if ( m_pPollGroup )
-		pollGroupLockOld.Lock( m_pPollGroup->m_lock );
 
 	// Scan all messages that are already queued for this connection,
 	// and insert them into the poll groups queue in the (approximate)
@@ -880,22 +1367,17 @@ void CGameNetworkConnectionBase::SetPollGroup( CGameNetworkPollGroup *pPollGroup
 	// really anybody who is expecting or relying on such guarantees
 	// is probably doing something wrong.
 	{
-		ShortDurationScopeLock lockMessageQueues( g_lockAllRecvMessageQueues );
+		ShortDurationScopeLock lockMessageQueues( pPollGroup->m_lockRecvMessages );
+
+		// Get the group's queue up to date before we merge into it, so the
+		// ordering by timestamp below is against everything received so far
+		pPollGroup->DrainRecvInbox();
+
 		CGameNetworkingMessage *pInsertBefore = pPollGroup->m_queueRecvMessages.m_pFirst;
 		for ( CGameNetworkingMessage *pMsg = m_queueRecvMessages.m_pFirst ; pMsg ; pMsg = pMsg->m_links.m_pNext )
 		{
 			Assert( pMsg->m_links.m_pQueue == &m_queueRecvMessages );
-
-			// Unlink it from existing poll group queue, if any
-			if ( pMsg->m_linksSecondaryQueue.m_pQueue )
-			{
-				Assert( m_pPollGroup && pMsg->m_linksSecondaryQueue.m_pQueue == &m_pPollGroup->m_queueRecvMessages );
-				pMsg->UnlinkFromQueue( &CGameNetworkingMessage::m_linksSecondaryQueue );
-			}
-			else
-			{
-				Assert( !m_pPollGroup );
-			}
+			Assert( !pMsg->m_linksSecondaryQueue.m_pQueue );
 
 			// Scan forward in the poll group message queue, until we find the insertion point
 			for (;;)
@@ -918,16 +1400,16 @@ void CGameNetworkConnectionBase::SetPollGroup( CGameNetworkPollGroup *pPollGroup
 				pInsertBefore = pInsertBefore->m_linksSecondaryQueue.m_pNext;
 			}
 		}
-	}
 
-	// Tell previous poll group, if any, that we are no longer with them
-	if ( m_pPollGroup )
-	{
-		DbgVerify( m_pPollGroup->m_vecConnections.FindAndFastRemove( this ) );
+		// From now on, our queue is shared with the poll group, and
+		// is protected by its lock
+		m_queueRecvMessages.m_pRequiredLock = &pPollGroup->m_lockRecvMessages;
+
+		// Link to new poll group.  Once this is set, newly received messages
+		// go through the group's inbox
+		m_pPollGroup = pPollGroup;
 	}
 
-	// Link to new poll group
-	m_pPollGroup = pPollGroup;
 	Assert( !m_pPollGroup->m_vecConnections.HasElement( this ) );
 	m_pPollGroup->m_vecConnections.AddToTail( this );
 }
@@ -960,7 +1442,7 @@ bool CGameNetworkConnectionBase::BInitConnection( GameNetworkingMicroseconds use
 	m_szEndDebug[0] = '\0';
 	m_statsEndToEnd.Init( usecNow, true ); // Until we go connected don't try to send acks, etc
 
-	// Select random connection ID, and make sure it passes certain sanity checks
+	// Assign connection ID, and add us to the connection table
 	{
 		Assert( m_unConnectionIDLocal == 0 );
 
@@ -974,42 +1456,15 @@ bool CGameNetworkConnectionBase::BInitConnection( GameNetworkingMicroseconds use
 		//     subsequently try to wait on any locks that we hold.
 		TableScopeLock tableLock( g_tables_lock );
 
-		// We make sure the lower 16 bits are unique.  Make sure we don't have too many connections.
-		// This definitely could be relaxed, but honestly we don't expect this library to be used in situations
-		// where you need that many connections.
-		if ( g_mapConnections.Count() >= 0x1fff )
+		// The table chooses the ID.  It's unpredictable, neither half is
+		// zero, and it won't be reused within a short time interval.
+		m_unConnectionIDLocal = g_mapConnections.Add( this );
+		if ( m_unConnectionIDLocal == 0 )
 		{
 			V_strcpy_safe( errMsg, "Too many connections." );
 			return false;
 		}
 
-		int tries = 0;
-		for (;;) {
-			if ( ++tries > 10000 )
-			{
-				V_strcpy_safe( errMsg, "Unable to find unique connection ID" );
-				return false;
-			}
-			CCrypto::GenerateRandomBlock( &m_unConnectionIDLocal, sizeof(m_unConnectionIDLocal) );
-
-			// Make sure neither half is zero
-			if ( ( m_unConnectionIDLocal & 0xffff ) == 0 )
-				continue;
-			if ( ( m_unConnectionIDLocal & 0xffff0000 ) == 0 )
-				continue;
-
-			// Check recent connections
-			if ( s_vecRecentLocalConnectionIDs.HasElement( (uint16)m_unConnectionIDLocal ) )
-				continue;
-
-			// Check active connections
-			if ( g_mapConnections.HasElement( (uint16)m_unConnectionIDLocal ) )
-				continue;
-
-			// This one's good
-			break;
-		}
-
 		// Let's use the the connection ID as the connection handle.  It's random, not reused
 		// within a short time interval, and we print it in our debugging in places, and you
 		// can see it on the wire for debugging.  In the past we has a "clever" method of
@@ -1017,9 +1472,6 @@ bool CGameNetworkConnectionBase::BInitConnection( GameNetworkingMicroseconds use
 		// guaranteeing handles wouldn't be reused.  But making it be the same as the
 		// ConnectionID is probably just more useful and less confusing.
 		m_hConnectionSelf = m_unConnectionIDLocal;
-
-		// Add it to our table of active sockets.
-		g_mapConnections.Insert( int16( m_hConnectionSelf ), this );
 	} // Release table scope lock
 
 	// Set options, if any
@@ -1110,11 +1562,15 @@ void CGameNetworkConnectionBase::ClearLocalCrypto()
 	AssertLocksHeldByCurrentThread();
 	m_eNegotiatedCipher = k_EGameNetworkingSocketsCipher_INVALID;
 	m_keyExchangePrivateKeyLocal.Wipe();
+	m_bHasPrecomputedPremasterSecret = false;
+	m_precomputedPremasterSecret.Wipe();
 	m_msgCryptLocal.Clear();
 	m_msgSignedCryptLocal.Clear();
 	m_bCryptKeysValid = false;
 	m_cryptContextSend.Wipe();
 	m_cryptContextRecv.Wipe();
+	m_cryptContextSendChaCha20.Wipe();
+	m_cryptContextRecvChaCha20.Wipe();
 	m_cryptIVSend.Wipe();
 	m_cryptIVRecv.Wipe();
 }
@@ -1126,7 +1582,7 @@ void CGameNetworkConnectionBase::RecvNonDataSequencedPacket( int64 nPktNum, Game
 	// Let SNP know when we received it, so we can track loss events and send acks.  We do
 	// not schedule acks to be sent at this time, but when they are sent, we will implicitly
 	// ack this one
-	SNP_RecordReceivedPktNum( nPktNum, usecNow, false );
+	SNP_RecordReceivedPktNum( nPktNum, usecNow, usecNow, false, true );
 
 	// Update general sequence number/stats tracker for the end-to-end flow.
 	m_statsEndToEnd.TrackProcessSequencedPacket( nPktNum, usecNow, 0 );
@@ -1278,6 +1734,22 @@ void CGameNetworkConnectionBase::SetCryptoCipherList()
 	// Also, lock it, we cannot change it any more
 	m_connectionConfig.m_Unencrypted.Lock();
 	int unencrypted = m_connectionConfig.m_Unencrypted.Get();
+
+	// Add the encrypted ciphers.  AES-GCM is faster when the CPU has
+	// hardware support for it, otherwise ChaCha20-Poly1305 is
+	// several times faster.
+	auto AddEncryptedCiphers = [this]() {
+		if ( !CCrypto::BCanUseAESGCM() )
+		{
+			m_msgCryptLocal.add_ciphers( k_EGameNetworkingSocketsCipher_CHACHA20_POLY1305 );
+			return;
+		}
+		const bool bPreferAES = CCrypto::BHasHardwareAES();
+		m_msgCryptLocal.add_ciphers( bPreferAES ? k_EGameNetworkingSocketsCipher_AES_256_GCM : k_EGameNetworkingSocketsCipher_CHACHA20_POLY1305 );
+		if ( !BOfferOnlyPreferredEncryptedCipher() )
+			m_msgCryptLocal.add_ciphers( bPreferAES ? k_EGameNetworkingSocketsCipher_CHACHA20_POLY1305 : k_EGameNetworkingSocketsCipher_AES_256_GCM );
+	};
+
 	switch ( unencrypted )
 	{
 		default:
@@ -1285,19 +1757,19 @@ void CGameNetworkConnectionBase::SetCryptoCipherList()
 			// FALLTHROUGH
 		case 0:
 			// Not allowed
-			m_msgCryptLocal.add_ciphers( k_EGameNetworkingSocketsCipher_AES_256_GCM );
+			AddEncryptedCiphers();
 			break;
 
 		case 1:
 			// Allowed, but prefer encrypted
-			m_msgCryptLocal.add_ciphers( k_EGameNetworkingSocketsCipher_AES_256_GCM );
+			AddEncryptedCiphers();
 			m_msgCryptLocal.add_ciphers( k_EGameNetworkingSocketsCipher_NULL );
 			break;
 
 		case 2:
 			// Allowed, preferred
 			m_msgCryptLocal.add_ciphers( k_EGameNetworkingSocketsCipher_NULL );
-			m_msgCryptLocal.add_ciphers( k_EGameNetworkingSocketsCipher_AES_256_GCM );
+			AddEncryptedCiphers();
 			break;
 
 		case 3:
@@ -1321,9 +1793,12 @@ void CGameNetworkConnectionBase::FinalizeLocalCrypto()
 	// Set protocol version
 	m_msgCryptLocal.set_protocol_version( k_nCurrentProtocolVersion );
 
-	// Generate a keypair for key exchange
+	// Generate a keypair for key exchange, unless that was already done
 	CECKeyExchangePublicKey publicKeyLocal;
-	CCrypto::GenerateKeyExchangeKeyPair( &publicKeyLocal, &m_keyExchangePrivateKeyLocal );
+	if ( m_bHasPrecomputedPremasterSecret )
+		m_keyExchangePrivateKeyLocal.GetPublicKey( &publicKeyLocal );
+	else
+		CCrypto::GenerateKeyExchangeKeyPair( &publicKeyLocal, &m_keyExchangePrivateKeyLocal );
 	m_msgCryptLocal.set_key_type( CMsgSteamDatagramSessionCryptInfo_EKeyType_CURVE25519 );
 	publicKeyLocal.GetRawDataAsStdString( m_msgCryptLocal.mutable_key_data() );
 
@@ -1539,6 +2014,14 @@ bool CGameNetworkConnectionBase::BRecvCryptoHandshake( const CMsgSteamDatagramCe
 	}
 	m_statsEndToEnd.m_nPeerProtocolVersion = m_msgCryptRemote.protocol_version();
 
+	// Did the app set up lanes before we knew who we were talking to?
+	if ( len( m_senderState.m_vecLanes ) > 1 && m_statsEndToEnd.m_nPeerProtocolVersion < k_nMinProtocolVersionLanes )
+	{
+		ConnectionState_ProblemDetectedLocally( k_EGameNetConnectionEnd_Remote_BadProtocolVersion, "Multiple lanes configured, but peer is running V%u, which doesn't support them.  (>=V%u is required)",
+			m_statsEndToEnd.m_nPeerProtocolVersion, k_nMinProtocolVersionLanes );
+		return false;
+	}
+
 	// Starting with protocol 10, the connect request/OK packets always implicitly
 	// have a packet number of 1, and thus the next packet (often the first data packet)
 	// is assigned a sequence number of 2, at a minimum.
@@ -1595,6 +2078,19 @@ bool CGameNetworkConnectionBase::BRecvCryptoHandshake( const CMsgSteamDatagramCe
 	return true;
 }
 
+void CGameNetworkConnectionBase::SetPrecomputedKeyExchange( const PrecomputedKeyExchange_t &keyExchange )
+{
+	AssertLocksHeldByCurrentThread();
+	Assert( m_bConnectionInitiatedRemotely );
+	Assert( !m_msgSignedCryptLocal.has_info() );
+	Assert( keyExchange.m_bValid );
+
+	m_keyExchangePrivateKeyLocal.CopyFrom( keyExchange.m_keyExchangePrivateKeyLocal );
+	V_memcpy( m_precomputedKeyExchangePublicKeyRemote, keyExchange.m_keyExchangePublicKeyRemote, sizeof(m_precomputedKeyExchangePublicKeyRemote) );
+	V_memcpy( m_precomputedPremasterSecret.m_buf, keyExchange.m_premasterSecret.m_buf, sizeof(m_precomputedPremasterSecret.m_buf) );
+	m_bHasPrecomputedPremasterSecret = true;
+}
+
 bool CGameNetworkConnectionBase::BFinishCryptoHandshake( bool bServer )
 {
 	AssertLocksHeldByCurrentThread( "BFinishCryptoHandshake" );
@@ -1619,6 +2115,25 @@ bool CGameNetworkConnectionBase::BFinishCryptoHandshake( bool bServer )
 			break;
 		}
 	}
+
+	// Our preference decides whether we encrypt at all.  But if we are
+	// the server and are going to encrypt, let the client pick which
+	// encrypted cipher.  It knows whether its CPU has hardware AES, and
+	// the client is usually the weaker machine.
+	if ( m_bConnectionInitiatedRemotely && m_eNegotiatedCipher != k_EGameNetworkingSocketsCipher_INVALID && m_eNegotiatedCipher != k_EGameNetworkingSocketsCipher_NULL )
+	{
+		for ( int eCipher : m_msgCryptRemote.ciphers() )
+		{
+			if ( eCipher == k_EGameNetworkingSocketsCipher_NULL )
+				continue;
+			if ( std::find( m_msgCryptLocal.ciphers().begin(), m_msgCryptLocal.ciphers().end(), eCipher ) != m_msgCryptLocal.ciphers().end() )
+			{
+				m_eNegotiatedCipher = EGameNetworkingSocketsCipher(eCipher);
+				break;
+			}
+		}
+	}
+
 	if ( m_eNegotiatedCipher == k_EGameNetworkingSocketsCipher_INVALID )
 	{
 		ConnectionState_ProblemDetectedLocally( k_EGameNetConnectionEnd_Remote_BadCrypt, "Failed to negotiate mutually-agreeable cipher" );
@@ -1654,13 +2169,21 @@ bool CGameNetworkConnectionBase::BFinishCryptoHandshake( bool bServer )
 		return false;
 	}
 
-	// Diffie-Hellman key exchange to get "premaster secret"
+	// Diffie-Hellman key exchange to get "premaster secret".  If this was
+	// already done on a worker thread, with the same key, just use that.
 	AutoWipeFixedSizeBuffer<sizeof(SHA256Digest_t)> premasterSecret;
-	if ( !CCrypto::PerformKeyExchange( m_keyExchangePrivateKeyLocal, keyExchangePublicKeyRemote, &premasterSecret.m_buf ) )
+	if ( m_bHasPrecomputedPremasterSecret && m_msgCryptRemote.key_data().length() == sizeof(m_precomputedKeyExchangePublicKeyRemote)
+		&& V_memcmp( m_msgCryptRemote.key_data().c_str(), m_precomputedKeyExchangePublicKeyRemote, sizeof(m_precomputedKeyExchangePublicKeyRemote) ) == 0 )
+	{
+		V_memcpy( premasterSecret.m_buf, m_precomputedPremasterSecret.m_buf, sizeof(premasterSecret.m_buf) );
+	}
+	else if ( !CCrypto::PerformKeyExchange( m_keyExchangePrivateKeyLocal, keyExchangePublicKeyRemote, &premasterSecret.m_buf ) )
 	{
 		ConnectionState_ProblemDetectedLocally( k_EGameNetConnectionEnd_Remote_BadCrypt, "Key exchange failed" );
 		return false;
 	}
+	m_bHasPrecomputedPremasterSecret = false;
+	m_precomputedPremasterSecret.Wipe();
 	//SpewMsg( "%s premaster: %02x%02x%02x%02x\n", bServer ? "Server" : "Client", premasterSecret.m_buf[0], premasterSecret.m_buf[1], premasterSecret.m_buf[2], premasterSecret.m_buf[3] );
 
 	// We won't need this again, so go ahead and discard it now.
@@ -1741,9 +2264,20 @@ bool CGameNetworkConnectionBase::BFinishCryptoHandshake( bool bServer )
 	}
 
 	// Set encryption keys into the contexts, and set parameters
-	if (
-		!m_cryptContextSend.Init( cryptKeySend.m_buf, cryptKeySend.k_nSize, m_cryptIVSend.k_nSize, k_cbGameNetwokingSocketsEncrytionTagSize )
-		|| !m_cryptContextRecv.Init( cryptKeyRecv.m_buf, cryptKeyRecv.k_nSize, m_cryptIVRecv.k_nSize, k_cbGameNetwokingSocketsEncrytionTagSize ) )
+	bool bCryptInitOK;
+	if ( m_eNegotiatedCipher == k_EGameNetworkingSocketsCipher_CHACHA20_POLY1305 )
+	{
+		bCryptInitOK =
+			m_cryptContextSendChaCha20.Init( cryptKeySend.m_buf, cryptKeySend.k_nSize, m_cryptIVSend.k_nSize, k_cbGameNetwokingSocketsEncrytionTagSize )
+			&& m_cryptContextRecvChaCha20.Init( cryptKeyRecv.m_buf, cryptKeyRecv.k_nSize, m_cryptIVRecv.k_nSize, k_cbGameNetwokingSocketsEncrytionTagSize );
+	}
+	else
+	{
+		bCryptInitOK =
+			m_cryptContextSend.Init( cryptKeySend.m_buf, cryptKeySend.k_nSize, m_cryptIVSend.k_nSize, k_cbGameNetwokingSocketsEncrytionTagSize )
+			&& m_cryptContextRecv.Init( cryptKeyRecv.m_buf, cryptKeyRecv.k_nSize, m_cryptIVRecv.k_nSize, k_cbGameNetwokingSocketsEncrytionTagSize );
+	}
+	if ( !bCryptInitOK )
 	{
 		ConnectionState_ProblemDetectedLocally( k_EGameNetConnectionEnd_Remote_BadCrypt, "Error initializing crypto" );
 		return false;
@@ -1823,13 +2357,13 @@ void CGameNetworkConnectionBase::SetUserData( int64 nUserData )
 	// of the queue yet.  This way we don't expose the client to weird
 	// race conditions where they create a connection, and before they
 	// are able to install their user data, some messages come in
-	g_lockAllRecvMessageQueues.lock();
+	LockRecvMessageQueue();
 	for ( CGameNetworkingMessage *m = m_queueRecvMessages.m_pFirst ; m ; m = m->m_links.m_pNext )
 	{
 		Assert( m->m_conn == m_hConnectionSelf );
 		m->m_nConnUserData = nUserData;
 	}
-	g_lockAllRecvMessageQueues.unlock();
+	UnlockRecvMessageQueue();
 }
 
 void CConnectionTransport::TransportConnectionStateChanged( EGameNetworkingConnectionState eOldState )
@@ -2068,21 +2602,68 @@ EResult CGameNetworkConnectionBase::APIFlushMessageOnConnection()
 	return SNP_FlushMessage( usecNow );
 }
 
+EResult CGameNetworkConnectionBase::APIConfigureConnectionLanes( int nNumLanes, const int *pLanePriorities, const uint16 *pLaneWeights )
+{
+	m_pLock->AssertHeldByCurrentThread();
+
+	// Check connection state
+	switch ( GetState() )
+	{
+	case k_EGameNetworkingConnectionState_None:
+	case k_EGameNetworkingConnectionState_FinWait:
+	case k_EGameNetworkingConnectionState_Linger:
+	case k_EGameNetworkingConnectionState_Dead:
+	default:
+		AssertMsg( false, "Why are making API calls on this connection?" );
+		return k_EResultInvalidState;
+
+	case k_EGameNetworkingConnectionState_Connecting:
+	case k_EGameNetworkingConnectionState_FindingRoute:
+	case k_EGameNetworkingConnectionState_Connected:
+		break;
+
+	case k_EGameNetworkingConnectionState_ClosedByPeer:
+	case k_EGameNetworkingConnectionState_ProblemDetectedLocally:
+		return k_EResultNoConnection;
+	}
+
+	if ( nNumLanes < len( m_senderState.m_vecLanes ) || nNumLanes > k_nMaxLanes )
+		return k_EResultInvalidParam;
+	if ( pLaneWeights )
+	{
+		for ( int i = 0 ; i < nNumLanes ; ++i )
+		{
+			if ( pLaneWeights[i] == 0 )
+				return k_EResultInvalidParam;
+		}
+	}
+
+	// If we already know the peer can't decode lanes, say so now
+	if ( nNumLanes > 1 && m_statsEndToEnd.m_nPeerProtocolVersion != 0 && m_statsEndToEnd.m_nPeerProtocolVersion < k_nMinProtocolVersionLanes )
+		return k_EResultInvalidState;
+
+	m_senderState.ConfigureLanes( nNumLanes, pLanePriorities, pLaneWeights );
+	return k_EResultOK;
+}
+
 int CGameNetworkConnectionBase::APIReceiveMessages( GameNetworkingMessage_t **ppOutMessages, int nMaxMessages )
 {
 	// Connection must be locked, but we don't require the global lock here!
 	m_pLock->AssertHeldByCurrentThread();
 
-	g_lockAllRecvMessageQueues.lock();
+	LockRecvMessageQueue();
 	int result = m_queueRecvMessages.RemoveMessages( ppOutMessages, nMaxMessages );
-	g_lockAllRecvMessageQueues.unlock();
+	UnlockRecvMessageQueue();
 
 	return result;
 }
 
 bool CGameNetworkConnectionBase::DecryptDataChunk( uint16 nWireSeqNum, int cbPacketSize, const void *pChunk, int cbChunk, RecvPacketContext_t &ctx )
 {
-	AssertLocksHeldByCurrentThread();
+	if ( m_bProcessingOnRecvWorker )
+		m_pLock->AssertHeldByCurrentThread();
+	else
+		AssertLocksHeldByCurrentThread();
 
 	if ( !m_bCryptKeysValid || !BStateIsActive() )
 	{
@@ -2123,8 +2704,19 @@ bool CGameNetworkConnectionBase::DecryptDataChunk( uint16 nWireSeqNum, int cbPac
 		break;
 
 		case k_EGameNetworkingSocketsCipher_AES_256_GCM:
+		case k_EGameNetworkingSocketsCipher_CHACHA20_POLY1305:
 		{
 
+			// Already decrypted by a receive worker thread?  Only use it if
+			// it was decrypted for this connection, using the same packet number.
+			const RecvPktPreDecrypted_t *pPreDecrypted = ctx.m_pPreDecrypted;
+			if ( pPreDecrypted && pPreDecrypted->m_unConnectionID == m_unConnectionIDLocal && pPreDecrypted->m_nPktNum == ctx.m_nPktNum )
+			{
+				ctx.m_cbPlainText = pPreDecrypted->m_cbPlainText;
+				ctx.m_pPlainText = pPreDecrypted->m_plainText;
+				break;
+			}
+
 			// Adjust the IV by the packet number
 			*(uint64 *)&m_cryptIVRecv.m_buf += LittleQWord( ctx.m_nPktNum );
 			//SpewMsg( "Recv decrypt IV %llu + %02x%02x%02x%02x  encrypted %d %02x%02x%02x%02x\n",
@@ -2136,12 +2728,25 @@ bool CGameNetworkConnectionBase::DecryptDataChunk( uint16 nWireSeqNum, int cbPac
 
 			// Decrypt the chunk and check the auth tag
 			uint32 cbDecrypted = sizeof(ctx.m_decrypted);
-			bool bDecryptOK = m_cryptContextRecv.Decrypt(
-				pChunk, cbChunk, // encrypted
-				m_cryptIVRecv.m_buf, // IV
-				ctx.m_decrypted, &cbDecrypted, // output
-				nullptr, 0 // no AAD
-			);
+			bool bDecryptOK;
+			if ( m_eNegotiatedCipher == k_EGameNetworkingSocketsCipher_CHACHA20_POLY1305 )
+			{
+				bDecryptOK = m_cryptContextRecvChaCha20.Decrypt(
+					pChunk, cbChunk, // encrypted
+					m_cryptIVRecv.m_buf, // IV
+					ctx.m_decrypted, &cbDecrypted, // output
+					nullptr, 0 // no AAD
+				);
+			}
+			else
+			{
+				bDecryptOK = m_cryptContextRecv.Decrypt(
+					pChunk, cbChunk, // encrypted
+					m_cryptIVRecv.m_buf, // IV
+					ctx.m_decrypted, &cbDecrypted, // output
+					nullptr, 0 // no AAD
+				);
+			}
 
 			// Restore the IV to the base value
 			*(uint64 *)&m_cryptIVRecv.m_buf -= LittleQWord( ctx.m_nPktNum );
@@ -2194,9 +2799,92 @@ bool CGameNetworkConnectionBase::DecryptDataChunk( uint16 nWireSeqNum, int cbPac
 
 	// Decrypted ok.  Track flow, and allow this packet to update the logical state, reply timeouts, etc
 	m_statsEndToEnd.TrackRecvPacket( cbPacketSize, ctx.m_usecNow );
+	if ( ctx.m_usecKernelRecv )
+		m_statsEndToEnd.TrackRecvProcessingLatency( ctx.m_usecNow - ctx.m_usecKernelRecv );
 	return true;
 }
 
+void CGameNetworkConnectionBase::PreDecryptDataChunks( int nChunks, const PreDecryptChunk_t *pChunks )
+{
+	// NOTE: We do NOT hold the global lock!
+	m_pLock->AssertHeldByCurrentThread();
+
+	// Only bother for the ciphers where it's actually worth it
+	if ( !m_bCryptKeysValid || !BStateIsActive() )
+		return;
+	if ( m_eNegotiatedCipher != k_EGameNetworkingSocketsCipher_AES_256_GCM && m_eNegotiatedCipher != k_EGameNetworkingSocketsCipher_CHACHA20_POLY1305 )
+		return;
+
+	Assert( nChunks <= k_nSteamDatagramMaxRecvBatchSize );
+	nChunks = std::min( nChunks, k_nSteamDatagramMaxRecvBatchSize );
+
+	AES_GCM_BatchPacket_t batch[ k_nSteamDatagramMaxRecvBatchSize ];
+	int64 arPktNum[ k_nSteamDatagramMaxRecvBatchSize ];
+	RecvPktPreDecrypted_t *arpOut[ k_nSteamDatagramMaxRecvBatchSize ];
+	uint8 arIV[ k_nSteamDatagramMaxRecvBatchSize ][ sizeof(m_cryptIVRecv.m_buf) ];
+	int nBatch = 0;
+	for ( int i = 0 ; i < nChunks ; ++i )
+	{
+		const PreDecryptChunk_t &chunk = pChunks[i];
+
+		// Guess the full packet number.  This is the same thing that
+		// DecryptDataChunk will do, but we don't check for duplicates or update
+		// any stats.  If other packets are processed before this one and
+		// our guess turns out to be wrong, the service thread will just
+		// decrypt it again.
+		const int64 nPktNum = m_statsEndToEnd.ExpandWirePacketNumber( chunk.m_nWireSeqNum );
+		if ( nPktNum <= 0 )
+			continue;
+
+		// Adjust a copy of the IV by the packet number.  The service thread
+		// modifies the original in place, and we must not touch it.
+		uint8 *iv = arIV[ nBatch ];
+		memcpy( iv, m_cryptIVRecv.m_buf, sizeof(m_cryptIVRecv.m_buf) );
+		*(uint64 *)iv += LittleQWord( nPktNum );
+
+		AES_GCM_BatchPacket_t &pkt = batch[ nBatch ];
+		pkt.m_pIn = chunk.m_pChunk;
+		pkt.m_cbIn = (uint32)chunk.m_cbChunk;
+		pkt.m_pIV = iv;
+		pkt.m_pAAD = nullptr; // no AAD
+		pkt.m_cbAAD = 0;
+		pkt.m_pOut = chunk.m_pOut->m_plainText;
+		pkt.m_cbOut = sizeof(chunk.m_pOut->m_plainText);
+		arPktNum[ nBatch ] = nPktNum;
+		arpOut[ nBatch ] = chunk.m_pOut;
+		++nBatch;
+	}
+	if ( nBatch == 0 )
+		return;
+
+	if ( m_eNegotiatedCipher == k_EGameNetworkingSocketsCipher_CHACHA20_POLY1305 )
+	{
+		// No multi-buffer path for ChaCha20-Poly1305, but it's still
+		// worth getting it off the service thread
+		for ( int i = 0 ; i < nBatch ; ++i )
+		{
+			AES_GCM_BatchPacket_t &pkt = batch[i];
+			pkt.m_bOK = m_cryptContextRecvChaCha20.Decrypt( pkt.m_pIn, pkt.m_cbIn, pkt.m_pIV, pkt.m_pOut, &pkt.m_cbOut, pkt.m_pAAD, pkt.m_cbAAD );
+		}
+	}
+	else
+	{
+		m_cryptContextRecv.DecryptBatch( batch, nBatch );
+	}
+
+	for ( int i = 0 ; i < nBatch ; ++i )
+	{
+		// If it failed, leave it to the service thread to deal with it
+		if ( !batch[i].m_bOK )
+			continue;
+
+		RecvPktPreDecrypted_t &out = *arpOut[i];
+		out.m_unConnectionID = m_unConnectionIDLocal;
+		out.m_nPktNum = arPktNum[i];
+		out.m_cbPlainText = (int)batch[i].m_cbOut;
+	}
+}
+
 EResult CGameNetworkConnectionBase::APIAcceptConnection()
 {
 	AssertLocksHeldByCurrentThread();
@@ -2463,9 +3151,9 @@ void CGameNetworkConnectionBase::SetState( EGameNetworkingConnectionState eNewSt
 	// discard any unread received messages
 	if ( eNewAPIState == k_EGameNetworkingConnectionState_None )
 	{
-		g_lockAllRecvMessageQueues.lock();
+		LockRecvMessageQueue();
 		m_queueRecvMessages.PurgeMessages();
-		g_lockAllRecvMessageQueues.unlock();
+		UnlockRecvMessageQueue();
 	}
 
 	// Slam some stuff when we are in various states
@@ -2537,7 +3225,7 @@ void CGameNetworkConnectionBase::ConnectionStateChanged( EGameNetworkingConnecti
 		m_pTransport->TransportConnectionStateChanged( eOldState );
 }
 
-bool CGameNetworkConnectionBase::ReceivedMessage( const void *pData, int cbData, int64 nMsgNum, int nFlags, GameNetworkingMicroseconds usecNow )
+bool CGameNetworkConnectionBase::ReceivedMessage( const void *pData, int cbData, int64 nMsgNum, int nFlags, int idxLane, GameNetworkingMicroseconds usecNow )
 {
 //	// !TEST! Enable this during connection test to trap bogus messages earlier
 //		struct TestMsg
@@ -2564,6 +3252,7 @@ bool CGameNetworkConnectionBase::ReceivedMessage( const void *pData, int cbData,
 
 	// Copy the data
 	memcpy( pMsg->m_pData, pData, cbData );
+	pMsg->m_idxLane = (uint16)idxLane;
 
 	// Receive it
 	ReceivedMessage( pMsg );
@@ -2580,18 +3269,34 @@ void CGameNetworkConnectionBase::ReceivedMessage( CGameNetworkingMessage *pMsg )
 		(long long)pMsg->m_nMessageNumber,
 		pMsg->m_cbSize );
 
-	// We use the same lock to protect *all* recv queues, for both connections and poll groups,
-	// which keeps this really simple.
-	g_lockAllRecvMessageQueues.lock();
+	// If we are in a poll group, hand the message to the group's lock-free
+	// inbox.  It will be linked into our queue and the group's queue by
+	// whoever next reads from either one.  This way the service thread
+	// never contends with the thread polling for messages.
+	if ( m_pPollGroup )
+	{
+		m_pPollGroup->m_inboxRecvMessages.Push( pMsg, &m_queueRecvMessages );
+		return;
+	}
 
-	// Add to end of my queue.
+	// Otherwise, our queue is only touched while holding our lock, which we already have.
 	pMsg->LinkToQueueTail( &CGameNetworkingMessage::m_links, &m_queueRecvMessages );
+}
 
-	// Add to the poll group, if we are in one
+void CGameNetworkConnectionBase::LockRecvMessageQueue()
+{
+	m_pLock->AssertHeldByCurrentThread();
 	if ( m_pPollGroup )
-		pMsg->LinkToQueueTail( &CGameNetworkingMessage::m_linksSecondaryQueue, &m_pPollGroup->m_queueRecvMessages );
+	{
+		m_pPollGroup->m_lockRecvMessages.lock();
+		m_pPollGroup->DrainRecvInbox();
+	}
+}
 
-	g_lockAllRecvMessageQueues.unlock();
+void CGameNetworkConnectionBase::UnlockRecvMessageQueue()
+{
+	if ( m_pPollGroup )
+		m_pPollGroup->m_lockRecvMessages.unlock();
 }
 
 void CGameNetworkConnectionBase::PostConnectionStateChangedCallback( EGameNetworkingConnectionState eOldAPIState, EGameNetworkingConnectionState eNewAPIState )
@@ -2626,7 +3331,10 @@ void CGameNetworkConnectionBase::PostConnectionStateChangedCallback( EGameNetwor
 
 void CGameNetworkConnectionBase::ConnectionState_ProblemDetectedLocally( EGameNetConnectionEnd eReason, const char *pszFmt, ... )
 {
-	AssertLocksHeldByCurrentThread();
+	if ( m_bProcessingOnRecvWorker )
+		m_pLock->AssertHeldByCurrentThread();
+	else
+		AssertLocksHeldByCurrentThread();
 
 	va_list ap;
 
@@ -2641,6 +3349,16 @@ void CGameNetworkConnectionBase::ConnectionState_ProblemDetectedLocally( EGameNe
 		va_end(ap);
 	}
 
+	// A receive worker thread cannot change our state, that needs the
+	// global lock.  We've recorded the reason, the service thread will
+	// take it from here.
+	if ( m_bProcessingOnRecvWorker )
+	{
+		m_bProblemDetectedOnRecvWorker = true;
+		SetNextThinkTimeASAP();
+		return;
+	}
+
 	// Check our state
 	switch ( GetState() )
 	{
@@ -2676,6 +3394,39 @@ void CGameNetworkConnectionBase::ConnectionState_ProblemDetectedLocally( EGameNe
 	SetNextThinkTimeASAP();
 }
 
+void CGameNetworkConnectionBase::ApplyProblemDetectedOnRecvWorker()
+{
+	AssertLocksHeldByCurrentThread();
+	Assert( !m_bProcessingOnRecvWorker );
+	m_bProblemDetectedOnRecvWorker = false;
+
+	// Make the state change that the worker couldn't
+	switch ( GetState() )
+	{
+		case k_EGameNetworkingConnectionState_Connecting:
+		case k_EGameNetworkingConnectionState_FindingRoute:
+		case k_EGameNetworkingConnectionState_Connected:
+		{
+			// The worker recorded the reason.  (Copy the message, since it
+			// will be used to format itself.)
+			ConnectionEndDebugMsg msg;
+			V_strcpy_safe( msg, m_szEndDebug );
+			ConnectionState_ProblemDetectedLocally( m_eEndReason, "%s", msg );
+			break;
+		}
+
+		case k_EGameNetworkingConnectionState_Linger:
+			// App closed the connection in the meantime.  Don't
+			// bother trying to flush
+			ConnectionState_FinWait();
+			break;
+
+		default:
+			// Already closed
+			break;
+	}
+}
+
 void CGameNetworkConnectionBase::ConnectionState_FinWait()
 {
 	GameNetworkingMicroseconds usecNow = GameNetworkingSockets_GetLocalTimestamp();
@@ -2900,6 +3651,9 @@ void CGameNetworkConnectionBase::CheckConnectionStateAndSetNextThinkTime( GameNe
 {
 	AssertLocksHeldByCurrentThread();
 
+	// Did a receive worker thread leave us something to do?
+	CheckProblemDetectedOnRecvWorker();
+
 	// Assume a default think interval just to make sure we check in periodically
 	GameNetworkingMicroseconds usecMinNextThinkTime = usecNow + k_nMillion;
 
@@ -3029,7 +3783,7 @@ void CGameNetworkConnectionBase::CheckConnectionStateAndSetNextThinkTime( GameNe
 		case k_EGameNetworkingConnectionState_Linger:
 
 			// Have we sent everything we wanted to?
-			if ( m_senderState.m_messagesQueued.empty() && m_senderState.m_unackedReliableMessages.empty() )
+			if ( m_senderState.BAllMessagesDelivered() )
 			{
 				// Close the connection ASAP
 				ConnectionState_FinWait();
@@ -3267,7 +4021,7 @@ void CGameNetworkConnectionBase::UpdateMTUFromConfig()
 		// To keep things simple, the retries are always the original ranges,
 		// we never have our retries chop up the space differently than
 		// the original send
-		if ( !m_senderState.m_listReadyRetryReliableRange.empty() || !m_senderState.m_listInFlightReliableRange.empty() )
+		if ( m_senderState.HasReadyRetryReliableRange() || m_senderState.HasInFlightReliableRange() )
 			return;
 	}
 
@@ -3293,6 +4047,11 @@ CGameNetworkConnectionP2P *CGameNetworkConnectionBase::AsGameNetworkConnectionP2
 	return nullptr;
 }
 
+CGameNetworkConnectionUDP *CGameNetworkConnectionBase::AsGameNetworkConnectionUDP()
+{
+	return nullptr;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 //
 // CGameNetworkConnectionPipe
@@ -3490,6 +4249,15 @@ int64 CGameNetworkConnectionPipe::_APISendMessageToConnection( CGameNetworkingMe
 	Assert( m_pPartner->m_pLock == m_pLock );
 	m_pLock->AssertHeldByCurrentThread();
 
+	// Lanes don't mean anything for pipes, but enforce the same rules
+	// so that apps don't get different behaviour over a real connection
+	if ( pMsg->m_idxLane >= len( m_senderState.m_vecLanes ) )
+	{
+		SpewWarningRateLimited( usecNow, "[%s] Invalid lane %d.  Only %d lanes configured\n", GetDescription(), (int)pMsg->m_idxLane, len( m_senderState.m_vecLanes ) );
+		pMsg->Release();
+		return -k_EResultInvalidParam;
+	}
+
 	// Fake a bunch of stats
 	FakeSendStats( usecNow, pMsg->m_cbSize );
 
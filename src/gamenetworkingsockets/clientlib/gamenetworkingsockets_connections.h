@@ -37,6 +37,7 @@ class CGameNetworkingSockets;
 class CGameNetworkingMessages;
 class CGameNetworkConnectionBase;
 class CGameNetworkConnectionP2P;
+class CGameNetworkConnectionUDP;
 class CSharedSocket;
 class CConnectionTransport;
 struct SNPAckSerializerHelper;
@@ -65,6 +66,16 @@ public:
 	inline ~AutoWipeFixedSizeBuffer() { Wipe(); }
 };
 
+/// Result of a key exchange that was done ahead of time, on a crypto worker
+/// thread, before the connection object existed.  (See k_EGameNetworkingConfig_HandshakeCryptoThreads)
+struct PrecomputedKeyExchange_t
+{
+	bool m_bValid = false;
+	CECKeyExchangePrivateKey m_keyExchangePrivateKeyLocal;
+	uint8 m_keyExchangePublicKeyRemote[32]; // The remote key that the secret was computed with
+	AutoWipeFixedSizeBuffer<sizeof(SHA256Digest_t)> m_premasterSecret;
+};
+
 /// In various places, we need a key in a map of remote connections.
 struct RemoteConnectionKey_t
 {
@@ -93,6 +104,16 @@ struct SendPacketContext_t
 	const char *m_pszReason; // Why are we sending this packet?
 };
 
+/// A data chunk to be decrypted by a receive worker thread.
+/// See CGameNetworkConnectionBase::PreDecryptDataChunks
+struct PreDecryptChunk_t
+{
+	uint16 m_nWireSeqNum;
+	const void *m_pChunk;
+	int m_cbChunk;
+	RecvPktPreDecrypted_t *m_pOut;
+};
+
 /// Context used when receiving a data packet
 struct RecvPacketContext_t
 {
@@ -110,6 +131,20 @@ struct RecvPacketContext_t
 	/// Jitter measurement, if present
 	//int m_usecTimeSinceLast;
 
+	/// Payload already decrypted by a receive worker thread, if any.
+	/// DecryptDataChunk will check that it matches before using it.
+	const RecvPktPreDecrypted_t *m_pPreDecrypted = nullptr;
+
+	/// Time when the packet arrived at the host, according to the kernel,
+	/// or 0 if the transport doesn't know.  m_usecNow - m_usecKernelRecv
+	/// is how long it sat in OS buffers and queues before we processed it.
+	GameNetworkingMicroseconds m_usecKernelRecv = 0;
+
+	/// Best estimate of when the packet arrived.  Use this for timing
+	/// measurements like ping and jitter, so that they measure the network,
+	/// and not how quickly we got around to processing the packet.
+	inline GameNetworkingMicroseconds UsecWhenReceived() const { return m_usecKernelRecv ? m_usecKernelRecv : m_usecNow; }
+
 //
 // Output of DecryptDataChunk
 //
@@ -184,8 +219,9 @@ inline EGameNetworkingConnectionState CollapseConnectionStateToAPIState( EGameNe
 	return eState;
 }
 
-/// We use one global lock to protect all queues of
-/// received messages.  (On connections and poll groups!)
+/// Protects the queues of received messages for IGameNetworkingMessages
+/// sessions and channels.  (Connection and poll group queues have their
+/// own locks.  See CGameNetworkPollGroup::m_lockRecvMessages.)
 extern ShortDurationLock g_lockAllRecvMessageQueues;
 
 /////////////////////////////////////////////////////////////////////////////
@@ -214,6 +250,24 @@ public:
 	/// Linked list of messages received through any connection on this listen socket
 	GameNetworkingMessageQueue m_queueRecvMessages;
 
+	/// Connections in the poll group publish received messages here, without
+	/// taking any lock, so that the service thread never contends with the
+	/// app reading messages.  Whoever reads messages next (from the poll group
+	/// or from one of its connections) links them into the queues.
+	GameNetworkingMessageInbox m_inboxRecvMessages;
+
+	/// Protects m_queueRecvMessages, and the queues of all connections in
+	/// the poll group, and consuming m_inboxRecvMessages
+	ShortDurationLock m_lockRecvMessages;
+
+	/// Link messages waiting in the inbox into the connection and poll group
+	/// queues.  m_lockRecvMessages must be held.
+	void DrainRecvInbox();
+
+	/// Fetch messages received on any connection in the poll group.
+	/// Caller must hold m_lock, or the global lock.
+	int ReceiveMessages( GameNetworkingMessage_t **ppOutMessages, int nMaxMessages );
+
 	/// Index into the global list
 	HGameNetPollGroup m_hPollGroupSelf;
 
@@ -315,6 +369,9 @@ public:
 	/// Flush any messages queued for Nagle
 	EResult APIFlushMessageOnConnection();
 
+	/// Set up lanes
+	EResult APIConfigureConnectionLanes( int nNumLanes, const int *pLanePriorities, const uint16 *pLaneWeights );
+
 	/// Receive the next message(s)
 	int APIReceiveMessages( GameNetworkingMessage_t **ppOutMessages, int nMaxMessages );
 
@@ -450,9 +507,15 @@ public:
 	/// Our handle in our parent's m_listAcceptedConnections (if we were accepted on a listen socket)
 	int m_hSelfInParentListenSocketMap;
 
-	// Linked list of received messages
+	/// Linked list of received messages.  If we are in a poll group, this is
+	/// protected by the poll group's m_lockRecvMessages, and new messages might
+	/// be waiting in its inbox.  Otherwise, our own lock protects it.
 	GameNetworkingMessageQueue m_queueRecvMessages;
 
+	/// Lock m_queueRecvMessages, making sure it is up to date
+	void LockRecvMessageQueue();
+	void UnlockRecvMessageQueue();
+
 	/// The unique 64-bit end-to-end connection ID.  Each side picks 32 bits
 	uint32 m_unConnectionIDLocal;
 	uint32 m_unConnectionIDRemote;
@@ -468,6 +531,15 @@ public:
 	/// Connection configuration
 	ConnectionConfig m_connectionConfig;
 
+	/// Effective values of the config options we read on every packet or
+	/// message.  Resolved lazily, whenever any config value changes anywhere.
+	inline const ConnectionConfigSnapshot &ConfigSnapshot() const
+	{
+		if ( unlikely( m_configSnapshot.m_nVersion != g_nConfigValueVersion.load( std::memory_order_relaxed ) ) )
+			m_configSnapshot.Refresh( m_connectionConfig );
+		return m_configSnapshot;
+	}
+
 	/// The reason code for why the connection was closed.
 	EGameNetConnectionEnd m_eEndReason;
 	ConnectionEndDebugMsg m_szEndDebug;
@@ -495,6 +567,28 @@ public:
 	/// processing the packet
 	bool DecryptDataChunk( uint16 nWireSeqNum, int cbPacketSize, const void *pChunk, int cbChunk, RecvPacketContext_t &ctx );
 
+	/// Called by a receive worker thread, which holds our lock, but NOT the
+	/// global lock.  Guess the full packet numbers and decrypt the chunks ahead
+	/// of time (as one batch), without touching any other state.  (See
+	/// DecryptDataChunk.)
+	void PreDecryptDataChunks( int nChunks, const PreDecryptChunk_t *pChunks );
+
+	/// Set while a receive worker thread is processing a packet for this
+	/// connection, holding only our lock.  Anything that would need the
+	/// global lock must be deferred.  (See ConnectionState_ProblemDetectedLocally)
+	bool m_bProcessingOnRecvWorker = false;
+
+	/// A receive worker thread detected a problem with the connection.
+	/// The reason has been recorded, but the state change needs the global
+	/// lock, so it waits for the service thread.
+	bool m_bProblemDetectedOnRecvWorker = false;
+	inline void CheckProblemDetectedOnRecvWorker()
+	{
+		if ( unlikely( m_bProblemDetectedOnRecvWorker ) )
+			ApplyProblemDetectedOnRecvWorker();
+	}
+	void ApplyProblemDetectedOnRecvWorker();
+
 	/// Decode the plaintext.  Returns false if the packet seems corrupt or bogus, or should abort further
 	/// processing.
 	bool ProcessPlainTextDataChunk( int usecTimeSinceLast, RecvPacketContext_t &ctx );
@@ -513,7 +607,7 @@ public:
 
 	bool SNP_BHasAnyBufferedRecvData() const
 	{
-		return !m_receiverState.m_bufReliableStream.empty();
+		return m_receiverState.BHasAnyBufferedReliableData();
 	}
 	bool SNP_BHasAnyUnackedSentReliableData() const
 	{
@@ -586,6 +680,10 @@ public:
 	bool BRecvCryptoHandshake( const CMsgSteamDatagramCertificateSigned &msgCert, const CMsgSteamDatagramSessionCryptInfoSigned &msgSessionInfo, bool bServer );
 	bool BFinishCryptoHandshake( bool bServer );
 
+	/// Use a key exchange that was done ahead of time, instead of doing it
+	/// when the connection is accepted.  Server only, before we are accepted.
+	void SetPrecomputedKeyExchange( const PrecomputedKeyExchange_t &keyExchange );
+
 	/// Check state of connection.  Check for timeouts, and schedule time when we
 	/// should think next
 	void CheckConnectionStateAndSetNextThinkTime( GameNetworkingMicroseconds usecNow );
@@ -598,6 +696,7 @@ public:
 
 	// Upcasts.  So we don't have to compile with RTTI
 	virtual CGameNetworkConnectionP2P *AsGameNetworkConnectionP2P();
+	virtual CGameNetworkConnectionUDP *AsGameNetworkConnectionUDP();
 
 	/// Check if this connection is an internal connection for the
 	/// ISteamMessages interface.  The messages layer *mostly* works
@@ -655,7 +754,7 @@ protected:
 	virtual void ConnectionGuessTimeoutReason( EGameNetConnectionEnd &nReasonCode, ConnectionEndDebugMsg &msg, GameNetworkingMicroseconds usecNow );
 
 	/// Called when we receive a complete message.  Should allocate a message object and put it into the proper queues
-	bool ReceivedMessage( const void *pData, int cbData, int64 nMsgNum, int nFlags, GameNetworkingMicroseconds usecNow );
+	bool ReceivedMessage( const void *pData, int cbData, int64 nMsgNum, int nFlags, int idxLane, GameNetworkingMicroseconds usecNow );
 	void ReceivedMessage( CGameNetworkingMessage *pMsg );
 
 	/// Timestamp when we last sent an end-to-end connection request packet
@@ -681,16 +780,22 @@ protected:
 	// Local crypto info for this connection
 	CECSigningPrivateKey m_keyPrivate; // Private key corresponding to our cert.  We'll wipe this in FinalizeLocalCrypto, as soon as we've locked in the crypto properties we're going to use
 	CECKeyExchangePrivateKey m_keyExchangePrivateKeyLocal;
+	bool m_bHasPrecomputedPremasterSecret; // If set, m_keyExchangePrivateKeyLocal came from a PrecomputedKeyExchange_t
+	uint8 m_precomputedKeyExchangePublicKeyRemote[32];
+	AutoWipeFixedSizeBuffer<sizeof(SHA256Digest_t)> m_precomputedPremasterSecret;
 	CMsgSteamDatagramSessionCryptInfo m_msgCryptLocal;
 	CMsgSteamDatagramSessionCryptInfoSigned m_msgSignedCryptLocal;
 	CMsgSteamDatagramCertificateSigned m_msgSignedCertLocal;
 	bool m_bCertHasIdentity; // Does the cert contain the identity we will use for this connection?
 	EGameNetworkingSocketsCipher m_eNegotiatedCipher;
 
-	// AES keys used in each direction
+	// Keys used in each direction.  Only the contexts for the negotiated
+	// cipher are initialized.
 	bool m_bCryptKeysValid;
 	AES_GCM_EncryptContext m_cryptContextSend;
 	AES_GCM_DecryptContext m_cryptContextRecv;
+	ChaCha20Poly1305_EncryptContext m_cryptContextSendChaCha20;
+	ChaCha20Poly1305_DecryptContext m_cryptContextRecvChaCha20;
 
 	// Initialization vector for AES-GCM.  These are combined with
 	// the packet number so that the effective IV is unique per
@@ -713,6 +818,10 @@ protected:
 	/// Called to decide if we want to try to proceed without a signed cert for ourselves
 	virtual EUnsignedCert AllowLocalUnsignedCert();
 
+	/// Return true if we should only offer our single most-preferred encrypted
+	/// cipher.  Normally we offer all of them and the server picks one.
+	virtual bool BOfferOnlyPreferredEncryptedCipher() { return false; }
+
 	//
 	// "SNP" - Steam Networking Protocol.  (Sort of audacious to stake out this acronym, don't you think...?)
 	//         The layer that does end-to-end reliability and bandwidth estimation
@@ -724,13 +833,15 @@ protected:
 	GameNetworkingMicroseconds SNP_ThinkSendState( GameNetworkingMicroseconds usecNow );
 	GameNetworkingMicroseconds SNP_GetNextThinkTime( GameNetworkingMicroseconds usecNow );
 	GameNetworkingMicroseconds SNP_TimeWhenWantToSendNextPacket() const;
+	bool SNP_BCongestionWindowFull() const;
 	void SNP_PrepareFeedback( GameNetworkingMicroseconds usecNow );
-	void SNP_ReceiveUnreliableSegment( int64 nMsgNum, int nOffset, const void *pSegmentData, int cbSegmentSize, bool bLastSegmentInMessage, GameNetworkingMicroseconds usecNow );
-	bool SNP_ReceiveReliableSegment( int64 nPktNum, int64 nSegBegin, const uint8 *pSegmentData, int cbSegmentSize, GameNetworkingMicroseconds usecNow );
+	void SNP_ReceiveUnreliableSegment( int64 nMsgNum, int idxLane, int nOffset, const void *pSegmentData, int cbSegmentSize, bool bLastSegmentInMessage, GameNetworkingMicroseconds usecNow );
+	void SNP_ReceiveUnreliableParity( int64 nMsgNum, int idxLane, int cbMsgSize, int cbChunk, int nGroupSize, int nFirstChunk, const void *pParityData, int cbParity, GameNetworkingMicroseconds usecNow );
+	bool SNP_ReceiveReliableSegment( int64 nPktNum, int idxLane, int64 nSegBegin, const uint8 *pSegmentData, int cbSegmentSize, GameNetworkingMicroseconds usecNow );
 	int SNP_ClampSendRate();
 	void SNP_PopulateDetailedStats( SteamDatagramLinkStats &info );
 	void SNP_PopulateQuickStats( GameNetworkingQuickConnectionStatus &info, GameNetworkingMicroseconds usecNow );
-	void SNP_RecordReceivedPktNum( int64 nPktNum, GameNetworkingMicroseconds usecNow, bool bScheduleAck );
+	void SNP_RecordReceivedPktNum( int64 nPktNum, GameNetworkingMicroseconds usecNow, GameNetworkingMicroseconds usecWhenReceived, bool bScheduleAck, bool bMarkReceived );
 	EResult SNP_FlushMessage( GameNetworkingMicroseconds usecNow );
 
 	/// Accumulate "tokens" into our bucket base on the current calculated send rate
@@ -754,6 +865,10 @@ protected:
 
 private:
 
+	void SNP_QueueUnreliableParity( CGameNetworkingMessage *pMsg, SSNPSendLane &lane );
+	SSNPRecvUnreliableSegmentData *SNP_AddUnreliableSegment( int64 nMsgNum, int nOffset, int cbSegmentSize, bool bLastSegmentInMessage, GameNetworkingMicroseconds usecNow );
+	void SNP_RecoverUnreliableSegmentsFEC( int64 nMsgNum );
+	void SNP_CheckUnreliableMessageComplete( int64 nMsgNum, int idxLane, GameNetworkingMicroseconds usecNow );
 	void SNP_GatherAckBlocks( SNPAckSerializerHelper &helper, GameNetworkingMicroseconds usecNow );
 	uint8 *SNP_SerializeAckBlocks( const SNPAckSerializerHelper &helper, uint8 *pOut, const uint8 *pOutEnd, GameNetworkingMicroseconds usecNow );
 	uint8 *SNP_SerializeStopWaitingFrame( uint8 *pOut, const uint8 *pOutEnd, GameNetworkingMicroseconds usecNow );
@@ -761,6 +876,9 @@ private:
 	void SetState( EGameNetworkingConnectionState eNewState, GameNetworkingMicroseconds usecNow );
 	EGameNetworkingConnectionState m_eConnectionState;
 
+	/// Cached effective config values.  Use ConfigSnapshot()
+	mutable ConnectionConfigSnapshot m_configSnapshot;
+
 	/// State of the connection as our peer would observe it.
 	/// (Certain local state transitions are not meaningful.)
 	///
@@ -966,7 +1084,106 @@ inline void SendPacketContext<TStatsMsg>::CalcMaxEncryptedPayloadSize( size_t cb
 //
 /////////////////////////////////////////////////////////////////////////////
 
-extern CUtlHashMap<uint16, CGameNetworkConnectionBase *, std::equal_to<uint16>, Identity<uint16> > g_mapConnections;
+/// Table of all connections, indexed by local connection ID, which is
+/// also the API handle.
+///
+/// Each connection occupies a slot in a flat array.  The connection ID is
+/// the slot index plus a generation number, run through a keyed permutation,
+/// so lookup is always an array index and a compare, no matter how many
+/// connections there are.  The generation is bumped each time a slot is
+/// freed, and freed slots are reused in FIFO order, so a stale handle (or a
+/// packet for an old connection) won't find a new connection that reuses
+/// the slot.  The permutation keeps the IDs that we put on the wire
+/// unpredictable, like when they were chosen purely at random.
+class CConnectionTable
+{
+public:
+
+	/// Number of bits in the unsalted ID that are used for the slot index.
+	/// The rest are the generation.
+	static constexpr int k_nSlotBits = 22;
+	static constexpr uint32 k_nMaxSlots = 1u << k_nSlotBits;
+
+	/// Assign a new connection ID and add the connection to the table.
+	/// Returns 0 if the table is full.
+	uint32 Add( CGameNetworkConnectionBase *pConn );
+
+	/// Remove connection from the table.  Returns false if it wasn't found
+	bool Remove( uint32 nConnectionID, CGameNetworkConnectionBase *pConn );
+
+	/// Locate connection by ID.  Returns null if not found
+	inline CGameNetworkConnectionBase *Find( uint32 nConnectionID ) const
+	{
+		const uint32 idxSlot = UnsaltConnectionID( nConnectionID ) & ( k_nMaxSlots-1 );
+		if ( idxSlot >= m_vecSlots.size() )
+			return nullptr;
+		const Slot &slot = m_vecSlots[ idxSlot ];
+		return slot.m_nConnectionID == nConnectionID ? slot.m_pConn : nullptr;
+	}
+
+	/// Number of connections in the table
+	inline int Count() const { return (int)m_vecConnections.size(); }
+
+	/// All connections in the table, in no particular order.  Don't add
+	/// or remove connections while iterating!
+	inline const std_vector<CGameNetworkConnectionBase *> &IterValues() const { return m_vecConnections; }
+
+private:
+	struct Slot
+	{
+		CGameNetworkConnectionBase *m_pConn;
+		uint32 m_nConnectionID; // Salted ID of current occupant, or 0 if free
+		uint32 m_nGeneration; // Generation that will be used for the next occupant
+		uint32 m_idxDense; // Index into m_vecConnections while occupied
+		uint32 m_idxNextFree; // Next slot in the free list, while free
+	};
+
+	/// Don't reuse a slot until at least this many slots are free.  This
+	/// way there is plenty of time between uses of the same generation of
+	/// the same slot.
+	static constexpr uint32 k_nMinFreeSlotsBeforeReuse = 256;
+
+	std_vector<Slot> m_vecSlots;
+	std_vector<CGameNetworkConnectionBase *> m_vecConnections;
+	uint32 m_idxFreeHead = ~0u;
+	uint32 m_idxFreeTail = ~0u;
+	uint32 m_nFreeSlots = 0;
+	CCrypto::SipHashKey_t m_keySalt = {};
+
+	// A 4-round Feistel network over the two 16-bit halves, with a keyed
+	// PRF (SipHash) as the round function.  That makes it a pseudorandom
+	// permutation: seeing some of the IDs we hand out doesn't help anybody
+	// predict the others.
+	inline uint32 SaltRound( uint32 x, uint32 nRound ) const
+	{
+		const uint32 data = ( nRound << 16 ) | x;
+		return uint32( CCrypto::SipHash( &data, sizeof(data), m_keySalt ) ) & 0xffff;
+	}
+	inline uint32 SaltConnectionID( uint32 n ) const
+	{
+		uint32 l = n >> 16, r = n & 0xffff;
+		for ( uint32 nRound = 0 ; nRound < 4 ; ++nRound )
+		{
+			uint32 t = l ^ SaltRound( r, nRound );
+			l = r;
+			r = t;
+		}
+		return ( l << 16 ) | r;
+	}
+	inline uint32 UnsaltConnectionID( uint32 n ) const
+	{
+		uint32 l = n >> 16, r = n & 0xffff;
+		for ( uint32 nRound = 4 ; nRound-- > 0 ; )
+		{
+			uint32 t = r ^ SaltRound( l, nRound );
+			r = l;
+			l = t;
+		}
+		return ( l << 16 ) | r;
+	}
+};
+
+extern CConnectionTable g_mapConnections;
 extern CUtlHashMap<int, CGameNetworkPollGroup *, std::equal_to<int>, Identity<int> > g_mapPollGroups;
 
 // All of the tables above are projected by the same lock, since we expect to only access it briefly
@@ -981,6 +1198,11 @@ extern CUtlHashMap<int, CGameNetworkListenSocketBase *, std::equal_to<int>, Iden
 
 extern bool BCheckGlobalSpamReplyRateLimit( GameNetworkingMicroseconds usecNow );
 extern CGameNetworkConnectionBase *GetConnectionByHandle( HGameNetConnection sock, ConnectionScopeLock &scopeLock );
+
+/// Locate a connection by local ID and lock it, without waiting on any locks.
+/// Safe to call without the global lock.  Returns null if the connection
+/// doesn't exist, or if we would have to wait.
+extern CGameNetworkConnectionBase *TryLockConnectionByLocalID( uint32 nLocalConnectionID, ConnectionScopeLock &scopeLock, const char *pszLockTag );
 extern CGameNetworkPollGroup *GetPollGroupByHandle( HGameNetPollGroup hPollGroup, PollGroupScopeLock &scopeLock, const char *pszLockTag );
 
 inline CGameNetworkConnectionBase *FindConnectionByLocalID( uint32 nLocalConnectionID, ConnectionScopeLock &scopeLock )
@@ -181,6 +181,18 @@ STEAMNETWORKINGSOCKETS_INTERFACE void SteamAPI_IGameNetworkingSockets_RunCallbac
 {
 	self->RunCallbacks(  );
 }
+STEAMNETWORKINGSOCKETS_INTERFACE void SteamAPI_IGameNetworkingSockets_BroadcastMessage( IGameNetworkingSockets* self, GameNetworkingMessage_t * pMessage, int nConnections, const HGameNetConnection * pConnections, int64 * pOutMessageNumberOrResult )
+{
+	self->BroadcastMessage( pMessage,nConnections,pConnections,pOutMessageNumberOrResult );
+}
+STEAMNETWORKINGSOCKETS_INTERFACE int SteamAPI_IGameNetworkingSockets_BroadcastMessageToPollGroup( IGameNetworkingSockets* self, GameNetworkingMessage_t * pMessage, HGameNetPollGroup hPollGroup )
+{
+	return self->BroadcastMessageToPollGroup( pMessage,hPollGroup );
+}
+STEAMNETWORKINGSOCKETS_INTERFACE EResult SteamAPI_IGameNetworkingSockets_ConfigureConnectionLanes( IGameNetworkingSockets* self, HGameNetConnection hConn, int nNumLanes, const int * pLanePriorities, const uint16 * pLaneWeights )
+{
+	return self->ConfigureConnectionLanes( hConn,nNumLanes,pLanePriorities,pLaneWeights );
+}
 
 //--- IGameNetworkingUtils-------------------------
 
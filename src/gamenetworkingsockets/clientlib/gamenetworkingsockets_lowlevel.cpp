@@ -13,6 +13,9 @@
 
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <deque>
 #include <atomic>
 
 #ifdef POSIX
@@ -48,6 +51,64 @@
 // Time low level send/recv calls and packet processing
 //#define STEAMNETWORKINGSOCKETS_LOWLEVEL_TIME_SOCKET_CALLS
 
+// Use recvmmsg() to pull multiple datagrams off of a socket with one system call,
+// and sendmmsg() to flush datagrams queued during a service thread pass
+#if defined( LINUX ) && !defined( ANDROID )
+	#define STEAMNETWORKINGSOCKETS_LOWLEVEL_RECVMMSG
+	#define STEAMNETWORKINGSOCKETS_LOWLEVEL_SENDMMSG
+
+	// UDP segmentation offload (GSO) on send, and generic receive offload
+	// (GRO) on receive.  Whether we actually use them is controlled by
+	// k_EGameNetworkingConfig_UDP_SegmentationOffload, and what the kernel
+	// supports.  Sent through the sendmmsg queue and received through the
+	// recvmmsg path, so those are required.
+	#define STEAMNETWORKINGSOCKETS_LOWLEVEL_UDP_SEGMENTATION_OFFLOAD
+	#include <netinet/udp.h>
+	#ifndef SOL_UDP
+		#define SOL_UDP 17
+	#endif
+	#ifndef UDP_SEGMENT
+		#define UDP_SEGMENT 103
+	#endif
+	#ifndef UDP_GRO
+		#define UDP_GRO 104
+	#endif
+
+	// Kernel receive timestamps, see k_EGameNetworkingConfig_RecvKernelTimestamps.
+	// They are delivered as ancillary data, so we only get them on the
+	// recvmmsg path.
+	#define STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_TIMESTAMPS
+	#ifndef SO_TIMESTAMPNS
+		#define SO_TIMESTAMPNS 35
+	#endif
+	#ifndef SCM_TIMESTAMPNS
+		#define SCM_TIMESTAMPNS SO_TIMESTAMPNS
+	#endif
+
+	// Receive worker threads, see k_EGameNetworkingConfig_RecvWorkerThreads.
+	// Listen sockets are split into SO_REUSEPORT shards, with a classic BPF
+	// program that steers packets to a shard based on the connection ID.
+	#define STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_WORKERS
+	#include <linux/filter.h>
+	#ifndef SO_ATTACH_REUSEPORT_CBPF
+		#define SO_ATTACH_REUSEPORT_CBPF 51
+	#endif
+
+	// Use ppoll() so the service thread can wake up with microsecond
+	// precision.  See k_EGameNetworkingConfig_SendPacingMaxBurst
+	#define STEAMNETWORKINGSOCKETS_LOWLEVEL_PRECISE_WAIT
+	#include <sys/prctl.h>
+
+	// Read the CPU timestamp counter directly for local timestamps, if the
+	// kernel trusts it enough to use it as its own clocksource.  See
+	// GetRawTimestampUSec
+	#if defined( __x86_64__ )
+		#define STEAMNETWORKINGSOCKETS_LOWLEVEL_TSC_CLOCK
+		#include <x86intrin.h>
+		#include <cpuid.h>
+	#endif
+#endif
+
 #include <tier0/memdbgon.h>
 
 namespace GameNetworkingSocketsLib {
@@ -58,6 +119,8 @@ constexpr GameNetworkingMicroseconds k_usecMaxTimestampDelta = k_msMaxPollWait *
 static void FlushSpew();
 
 int g_nSteamDatagramSocketBufferSize = 256*1024;
+int g_nSteamDatagramRecvBatchSize = k_nSteamDatagramMaxRecvBatchSize;
+int g_nSteamDatagramSendBatchSize = k_nSteamDatagramMaxSendBatchSize;
 
 /// Global lock for all local data structures
 static Lock<RecursiveTimedMutexImpl> s_mutexGlobalLock( "global", 0 );
@@ -641,6 +704,81 @@ bool IsRouteToAddressProbablyLocal( netadr_t addr )
 //
 /////////////////////////////////////////////////////////////////////////////
 
+/// Effective fake network conditions and packet tracing options, resolved
+/// once per config change.  The per-packet send and receive paths test a
+/// single flag and skip the simulation entirely when none of it is enabled,
+/// which is the normal case.  Only touched while holding the global lock.
+struct FakeNetworkConfigSnapshot
+{
+	uint32 m_nVersion = 0;
+	bool m_bSimulateSend = false;
+	bool m_bSimulateRecv = false;
+	int32 m_nPacketTraceMaxBytes = -1;
+	int32 m_nFakeRateLimit_Send_Rate;
+	int32 m_nFakeRateLimit_Recv_Rate;
+	float m_flFakePacketLoss_Send;
+	float m_flFakePacketLoss_Recv;
+	int32 m_nFakePacketLag_Send;
+	int32 m_nFakePacketLag_Recv;
+	float m_flFakePacketReorder_Send;
+	float m_flFakePacketReorder_Recv;
+	int32 m_nFakePacketReorder_Time;
+	float m_flFakePacketDup_Send;
+	float m_flFakePacketDup_Recv;
+	int32 m_nFakePacketDup_TimeMax;
+};
+static FakeNetworkConfigSnapshot s_fakeNetworkConfig;
+
+/// Config version at which we last saw that there is nothing for
+/// ProcessRawUDPPacket to do to an inbound packet before it is handed
+/// to the connection.  (No simulated network conditions or tracing.)
+/// Receive workers only process packets themselves when this is current.
+static std::atomic<uint32> s_nFakeNetworkConfigVersionRecvPassthrough;
+
+static void RefreshFakeNetworkConfig()
+{
+	FakeNetworkConfigSnapshot &c = s_fakeNetworkConfig;
+
+	// Grab the version first, so that if it changes while we are
+	// reading the values, we'll just refresh again next time
+	c.m_nVersion = g_nConfigValueVersion.load( std::memory_order_acquire );
+
+	c.m_nPacketTraceMaxBytes = g_Config_PacketTraceMaxBytes.Get();
+	c.m_nFakeRateLimit_Send_Rate = g_Config_FakeRateLimit_Send_Rate.Get();
+	c.m_nFakeRateLimit_Recv_Rate = g_Config_FakeRateLimit_Recv_Rate.Get();
+	c.m_flFakePacketLoss_Send = g_Config_FakePacketLoss_Send.Get();
+	c.m_flFakePacketLoss_Recv = g_Config_FakePacketLoss_Recv.Get();
+	c.m_nFakePacketLag_Send = g_Config_FakePacketLag_Send.Get();
+	c.m_nFakePacketLag_Recv = g_Config_FakePacketLag_Recv.Get();
+	c.m_flFakePacketReorder_Send = g_Config_FakePacketReorder_Send.Get();
+	c.m_flFakePacketReorder_Recv = g_Config_FakePacketReorder_Recv.Get();
+	c.m_nFakePacketReorder_Time = g_Config_FakePacketReorder_Time.Get();
+	c.m_flFakePacketDup_Send = g_Config_FakePacketDup_Send.Get();
+	c.m_flFakePacketDup_Recv = g_Config_FakePacketDup_Recv.Get();
+	c.m_nFakePacketDup_TimeMax = g_Config_FakePacketDup_TimeMax.Get();
+
+	c.m_bSimulateSend = c.m_nFakeRateLimit_Send_Rate > 0
+		|| c.m_flFakePacketLoss_Send > 0.0f
+		|| c.m_nFakePacketLag_Send > 0
+		|| c.m_flFakePacketReorder_Send > 0.0f
+		|| c.m_flFakePacketDup_Send > 0.0f;
+	c.m_bSimulateRecv = c.m_nFakeRateLimit_Recv_Rate > 0
+		|| c.m_flFakePacketLoss_Recv > 0.0f
+		|| c.m_nFakePacketLag_Recv > 0
+		|| c.m_flFakePacketReorder_Recv > 0.0f
+		|| c.m_flFakePacketDup_Recv > 0.0f;
+
+	const bool bRecvPassthrough = !c.m_bSimulateRecv && c.m_nPacketTraceMaxBytes < 0;
+	s_nFakeNetworkConfigVersionRecvPassthrough.store( bRecvPassthrough ? c.m_nVersion : 0, std::memory_order_release );
+}
+
+static inline const FakeNetworkConfigSnapshot &FakeNetworkConfig()
+{
+	if ( unlikely( s_fakeNetworkConfig.m_nVersion != g_nConfigValueVersion.load( std::memory_order_relaxed ) ) )
+		RefreshFakeNetworkConfig();
+	return s_fakeNetworkConfig;
+}
+
 static double s_flFakeRateLimit_Send_tokens;
 static double s_flFakeRateLimit_Recv_tokens;
 static GameNetworkingMicroseconds s_usecFakeRateLimitBucketUpdateTime;
@@ -678,6 +816,22 @@ static void UpdateFakeRateLimitTokenBuckets( GameNetworkingMicroseconds usecNow
 	}
 }
 
+class CRawUDPSocketImpl;
+
+#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_SENDMMSG
+	/// True while the service thread is in the middle of a pass and
+	/// outbound datagrams should be queued rather than sent immediately
+	static bool s_bQueueRawUDPSends = false;
+	static bool BQueueRawUDPSend( CRawUDPSocketImpl *pSock, const sockaddr_storage &adrTo, socklen_t adrSize, int nChunks, const iovec *pChunks );
+#endif
+static void FlushQueuedRawUDPSends();
+#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_WORKERS
+	static int s_nRecvWorkers = 0;
+	static void AddSocketToRecvWorkers( CRawUDPSocketImpl *pSock );
+	static void RemoveSocketFromRecvWorkers( CRawUDPSocketImpl *pSock );
+	static bool BRecvWorkersDoneWithSocket( CRawUDPSocketImpl *pSock );
+#endif
+
 inline IRawUDPSocket::IRawUDPSocket() {}
 inline IRawUDPSocket::~IRawUDPSocket() {}
 
@@ -689,6 +843,10 @@ public:
 	~CRawUDPSocketImpl()
 	{
 		closesocket( m_socket );
+		#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_WORKERS
+			for ( SOCKET shard: m_vecReusePortShards )
+				closesocket( shard );
+		#endif
 		#ifdef WIN32
 			WSACloseEvent( m_event );
 		#endif
@@ -709,6 +867,34 @@ public:
 		WSAEVENT m_event = INVALID_HANDLE_VALUE;
 	#endif
 
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_UDP_SEGMENTATION_OFFLOAD
+		/// True if the kernel will accept UDP_SEGMENT on this socket.  Cleared
+		/// if a segmented send fails, and we fall back to ordinary sends.
+		bool m_bGSO = false;
+
+		/// True if UDP_GRO is enabled on this socket, meaning that one read
+		/// may return several datagrams coalesced together.
+		bool m_bGRO = false;
+	#endif
+
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_TIMESTAMPS
+		/// True if the kernel timestamps datagrams received on this socket
+		/// (and its shards), using SO_TIMESTAMPNS.
+		bool m_bRecvTimestamps = false;
+	#endif
+
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_WORKERS
+		/// True if this socket is read by the receive worker threads,
+		/// instead of the service thread.
+		bool m_bRecvWorkers = false;
+
+		/// Additional sockets bound to the same address using SO_REUSEPORT.
+		/// The kernel spreads incoming traffic among these and m_socket,
+		/// and each one is read by a different receive worker.  We always
+		/// send using m_socket.
+		std::vector<SOCKET> m_vecReusePortShards;
+	#endif
+
 	// Implements IRawUDPSocket
 	virtual bool BSendRawPacketGather( int nChunks, const iovec *pChunks, const netadr_t &adrTo ) const override;
 	virtual void Close() override;
@@ -744,11 +930,18 @@ public:
 		}
 		#endif
 
-		if ( g_Config_PacketTraceMaxBytes.Get() >= 0 )
+		if ( FakeNetworkConfig().m_nPacketTraceMaxBytes >= 0 )
 		{
 			TracePkt( true, adrTo, nChunks, pChunks );
 		}
 
+		#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_SENDMMSG
+			// Service thread is in the middle of a pass?  Queue it up and
+			// send it along with everything else at the end of the pass.
+			if ( s_bQueueRawUDPSends && BQueueRawUDPSend( const_cast<CRawUDPSocketImpl *>( this ), destAddress, addrSize, nChunks, pChunks ) )
+				return true;
+		#endif
+
 		#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_TIME_SOCKET_CALLS
 			GameNetworkingMicroseconds usecSendStart = GameNetworkingSockets_GetLocalTimestamp();
 		#endif
@@ -817,7 +1010,7 @@ public:
 			ReallySpewTypeFmt( k_EGameNetworkingSocketsDebugOutputType_Msg, "[Trace Recv] %s <- %s | %d bytes\n",
 				GameNetworkingIPAddrRender( m_boundAddr ).c_str(), CUtlNetAdrRender( adrRemote ).String(), cbTotal );
 		}
-		int l = std::min( cbTotal, g_Config_PacketTraceMaxBytes.Get() );
+		int l = std::min( cbTotal, FakeNetworkConfig().m_nPacketTraceMaxBytes );
 		const uint8 *p = (const uint8 *)pChunks->iov_base;
 		int cbChunkLeft = pChunks->iov_len;
 		while ( l > 0 )
@@ -974,7 +1167,7 @@ public:
 					// caller to dangle.
 					char temp[ k_cbGameNetworkingSocketsMaxUDPMsgLen ];
 					memcpy( temp, pkt.m_pkt, pkt.m_cbPkt );
-					pSock->m_callback( RecvPktInfo_t{ temp, pkt.m_cbPkt, pkt.m_adrRemote, pSock } );
+					pSock->m_callback( RecvPktInfo_t{ temp, pkt.m_cbPkt, pkt.m_adrRemote, pSock, nullptr, usecNow, 0 } );
 				}
 			}
 			m_list.RemoveFromHead();
@@ -1034,6 +1227,244 @@ private:
 
 static CPacketLagger s_packetLagQueue;
 
+#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_SENDMMSG
+
+/// A datagram that was sent during a service thread pass, and is waiting
+/// to be flushed.  The address has already been converted, and the packet
+/// has already been traced.
+struct QueuedRawUDPSend
+{
+	CRawUDPSocketImpl *m_pSock;
+	sockaddr_storage m_adrTo;
+	socklen_t m_adrSize;
+	int m_cbPkt;
+	char m_pkt[ k_cbGameNetworkingSocketsMaxUDPMsgLen ];
+};
+static QueuedRawUDPSend s_queuedSends[ k_nSteamDatagramMaxSendBatchSize ];
+static int s_nQueuedSends = 0;
+
+/// Time when the oldest datagram in the queue was queued
+static GameNetworkingMicroseconds s_usecOldestQueuedSend;
+
+#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_UDP_SEGMENTATION_OFFLOAD
+	/// Limits for a single segmented send.  The total must fit in a single
+	/// UDP datagram, and the kernel limits the number of segments.
+	constexpr int k_cbMaxUDPSegmentationOffloadSend = 60*1024;
+	constexpr int k_nMaxUDPSegmentationOffloadSegments = 64;
+	COMPILE_TIME_ASSERT( k_nSteamDatagramMaxSendBatchSize <= k_nMaxUDPSegmentationOffloadSegments );
+#endif
+
+/// Don't hold on to a queued datagram for longer than this, even if the
+/// pass is taking a long time.  (Checked periodically, not on every send.)
+constexpr GameNetworkingMicroseconds k_usecMaxQueuedSendDelay = 1000;
+
+/// Actually send everything in the queue.  Runs of datagrams for the same
+/// socket are sent with a single call to sendmmsg
+static void SendQueuedRawUDPSends()
+{
+	GameNetworkingGlobalLock::AssertHeldByCurrentThread();
+
+	mmsghdr msgs[ k_nSteamDatagramMaxSendBatchSize ];
+	iovec iov[ k_nSteamDatagramMaxSendBatchSize ];
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_UDP_SEGMENTATION_OFFLOAD
+		struct { alignas( cmsghdr ) char m_buf[ CMSG_SPACE( sizeof(uint16) ) ]; } ctrl[ k_nSteamDatagramMaxSendBatchSize ];
+	#endif
+
+	int idx = 0;
+	while ( idx < s_nQueuedSends )
+	{
+		// Locate run of packets on the same socket
+		CRawUDPSocketImpl *pSock = s_queuedSends[ idx ].m_pSock;
+		int n = 0;
+		int nQueued = 0;
+		while ( idx + nQueued < s_nQueuedSends && s_queuedSends[ idx + nQueued ].m_pSock == pSock )
+		{
+			const int iFirst = idx + nQueued;
+			const QueuedRawUDPSend &q = s_queuedSends[ iFirst ];
+			iov[nQueued].iov_base = (void *)q.m_pkt;
+			iov[nQueued].iov_len = q.m_cbPkt;
+			msghdr &hdr = msgs[n].msg_hdr;
+			hdr.msg_name = (void *)&q.m_adrTo;
+			hdr.msg_namelen = q.m_adrSize;
+			hdr.msg_iov = &iov[nQueued];
+			hdr.msg_iovlen = 1;
+			hdr.msg_control = nullptr;
+			hdr.msg_controllen = 0;
+			hdr.msg_flags = 0;
+			msgs[n].msg_len = 0;
+			++nQueued;
+
+			#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_UDP_SEGMENTATION_OFFLOAD
+				// Consecutive datagrams to the same destination can be sent as a
+				// single buffer that the kernel (or NIC) will split up.  All
+				// segments must be the same size, except the last may be shorter.
+				if ( pSock->m_bGSO && g_Config_UDP_SegmentationOffload.Get() )
+				{
+					int cbTotal = q.m_cbPkt;
+					int cbLast = q.m_cbPkt;
+					while ( idx + nQueued < s_nQueuedSends && (int)hdr.msg_iovlen < k_nMaxUDPSegmentationOffloadSegments )
+					{
+						const QueuedRawUDPSend &qNext = s_queuedSends[ idx + nQueued ];
+						if ( qNext.m_pSock != pSock
+							|| cbLast != q.m_cbPkt
+							|| qNext.m_cbPkt > q.m_cbPkt
+							|| cbTotal + qNext.m_cbPkt > k_cbMaxUDPSegmentationOffloadSend
+							|| qNext.m_adrSize != q.m_adrSize
+							|| memcmp( &qNext.m_adrTo, &q.m_adrTo, q.m_adrSize ) != 0 )
+							break;
+						iov[nQueued].iov_base = (void *)qNext.m_pkt;
+						iov[nQueued].iov_len = qNext.m_cbPkt;
+						cbTotal += qNext.m_cbPkt;
+						cbLast = qNext.m_cbPkt;
+						++hdr.msg_iovlen;
+						++nQueued;
+					}
+
+					if ( hdr.msg_iovlen > 1 )
+					{
+						hdr.msg_control = ctrl[n].m_buf;
+						hdr.msg_controllen = sizeof( ctrl[n].m_buf );
+						cmsghdr *cm = CMSG_FIRSTHDR( &hdr );
+						cm->cmsg_level = SOL_UDP;
+						cm->cmsg_type = UDP_SEGMENT;
+						cm->cmsg_len = CMSG_LEN( sizeof(uint16) );
+						*(uint16 *)CMSG_DATA( cm ) = (uint16)q.m_cbPkt;
+					}
+				}
+			#endif
+
+			++n;
+		}
+		Assert( n > 0 );
+
+		#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_TIME_SOCKET_CALLS
+			GameNetworkingMicroseconds usecSendStart = GameNetworkingSockets_GetLocalTimestamp();
+		#endif
+
+		// Send them.  The OS might not take them all at once.  If a
+		// datagram fails to send, skip it, just like we would if we
+		// had sent it immediately.
+		int iSent = 0;
+		while ( iSent < n )
+		{
+			int r = ::sendmmsg( pSock->m_socket, &msgs[ iSent ], n - iSent, 0 );
+			if ( r > 0 )
+			{
+				iSent += r;
+				continue;
+			}
+
+			#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_UDP_SEGMENTATION_OFFLOAD
+				// Segmented send failed?  Some devices can't do the checksum
+				// offload that GSO requires, and we don't find out until we
+				// try.  Stop using it on this socket, and send the segments
+				// one by one.  (Don't bother if the send buffer is just full.)
+				msghdr &hdr = msgs[ iSent ].msg_hdr;
+				int nErr = GetLastSocketError();
+				if ( hdr.msg_iovlen > 1 && nErr != EAGAIN && nErr != EWOULDBLOCK && nErr != ENOBUFS )
+				{
+					SpewWarning( "UDP segmentation offload send failed on %s, error %d.  Falling back to ordinary sends.\n",
+						GameNetworkingIPAddrRender( pSock->m_boundAddr ).c_str(), nErr );
+					pSock->m_bGSO = false;
+
+					msghdr hdrSeg = hdr;
+					hdrSeg.msg_control = nullptr;
+					hdrSeg.msg_controllen = 0;
+					hdrSeg.msg_iovlen = 1;
+					for ( int i = 0 ; i < (int)hdr.msg_iovlen ; ++i )
+					{
+						hdrSeg.msg_iov = &hdr.msg_iov[i];
+						::sendmsg( pSock->m_socket, &hdrSeg, 0 );
+					}
+				}
+			#endif
+
+			++iSent;
+		}
+
+		#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_TIME_SOCKET_CALLS
+			GameNetworkingMicroseconds usecSendElapsed = GameNetworkingSockets_GetLocalTimestamp() - usecSendStart;
+			if ( usecSendElapsed > 1000 )
+			{
+				SpewWarning( "UDP sendmmsg took %.1fms\n", usecSendElapsed*1e-3 );
+				ETW_LongOp( "UDP sendmmsg", usecSendElapsed );
+			}
+		#endif
+
+		idx += nQueued;
+	}
+
+	s_nQueuedSends = 0;
+}
+
+static bool BQueueRawUDPSend( CRawUDPSocketImpl *pSock, const sockaddr_storage &adrTo, socklen_t adrSize, int nChunks, const iovec *pChunks )
+{
+	Assert( s_bQueueRawUDPSends );
+
+	int cbPkt = 0;
+	for ( int i = 0 ; i < nChunks ; ++i )
+		cbPkt += (int)pChunks[i].iov_len;
+
+	// Too big to queue?  Flush whatever we have so that the
+	// datagrams are still sent in order, and let the caller
+	// send this one immediately
+	if ( cbPkt > k_cbGameNetworkingSocketsMaxUDPMsgLen )
+	{
+		SendQueuedRawUDPSends();
+		return false;
+	}
+
+	QueuedRawUDPSend &q = s_queuedSends[ s_nQueuedSends++ ];
+	q.m_pSock = pSock;
+	memcpy( &q.m_adrTo, &adrTo, adrSize );
+	q.m_adrSize = adrSize;
+	q.m_cbPkt = cbPkt;
+	char *d = q.m_pkt;
+	for ( int i = 0 ; i < nChunks ; ++i )
+	{
+		memcpy( d, pChunks[i].iov_base, pChunks[i].iov_len );
+		d += pChunks[i].iov_len;
+	}
+
+	// Check if we need to flush now.  Avoid reading the
+	// clock on every packet
+	if ( s_nQueuedSends == 1 )
+	{
+		s_usecOldestQueuedSend = GameNetworkingSockets_GetLocalTimestamp();
+	}
+	else if ( s_nQueuedSends >= std::min( g_nSteamDatagramSendBatchSize, k_nSteamDatagramMaxSendBatchSize )
+		|| ( ( s_nQueuedSends & 7 ) == 0 && GameNetworkingSockets_GetLocalTimestamp() > s_usecOldestQueuedSend + k_usecMaxQueuedSendDelay ) )
+	{
+		SendQueuedRawUDPSends();
+	}
+
+	return true;
+}
+
+#endif // #ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_SENDMMSG
+
+/// Called by the service thread when it begins a pass.  Datagrams sent
+/// while the pass is in progress will be queued until FlushQueuedRawUDPSends
+static void BeginQueuedRawUDPSends()
+{
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_SENDMMSG
+		Assert( s_nQueuedSends == 0 );
+		s_bQueueRawUDPSends = g_nSteamDatagramSendBatchSize > 1;
+	#endif
+}
+
+/// Send any queued datagrams and stop queueing.  This must be called
+/// before the service thread releases the lock, and before a socket
+/// with datagrams in the queue is destroyed.
+static void FlushQueuedRawUDPSends()
+{
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_SENDMMSG
+		if ( s_nQueuedSends > 0 )
+			SendQueuedRawUDPSends();
+		s_bQueueRawUDPSends = false;
+	#endif
+}
+
 /// Object used to wake our background thread efficiently
 #if defined( _WIN32 )
 	static HANDLE s_hEventWakeThread = INVALID_HANDLE_VALUE;
@@ -1071,9 +1502,14 @@ bool CRawUDPSocketImpl::BSendRawPacketGather( int nChunks, const iovec *pChunks,
 	if ( s_nLowLevelSupportRefCount.load(std::memory_order_acquire) <= 0 )
 		return true;
 
-	// Check simulated global rate limit.  Make sure this is fast
-	// when the limit is not in use
-	if ( unlikely( g_Config_FakeRateLimit_Send_Rate.Get() > 0 ) )
+	// Not simulating any network conditions?  This is the common case,
+	// so make sure it's fast
+	const FakeNetworkConfigSnapshot &fakeNet = FakeNetworkConfig();
+	if ( likely( !fakeNet.m_bSimulateSend ) )
+		return BReallySendRawPacket( nChunks, pChunks, adrTo );
+
+	// Check simulated global rate limit
+	if ( fakeNet.m_nFakeRateLimit_Send_Rate > 0 )
 	{
 
 		// Check if bucket already has tokens in it, which
@@ -1098,22 +1534,22 @@ bool CRawUDPSocketImpl::BSendRawPacketGather( int nChunks, const iovec *pChunks,
 	}
 
 	// Fake loss?
-	if ( RandomBoolWithOdds( g_Config_FakePacketLoss_Send.Get() ) )
+	if ( RandomBoolWithOdds( fakeNet.m_flFakePacketLoss_Send ) )
 		return true;
 
 	// Fake lag?
-	int32 nPacketFakeLagTotal = g_Config_FakePacketLag_Send.Get();
+	int32 nPacketFakeLagTotal = fakeNet.m_nFakePacketLag_Send;
 
 	// Check for simulating random packet reordering
-	if ( RandomBoolWithOdds( g_Config_FakePacketReorder_Send.Get() ) )
+	if ( RandomBoolWithOdds( fakeNet.m_flFakePacketReorder_Send ) )
 	{
-		nPacketFakeLagTotal += g_Config_FakePacketReorder_Time.Get();
+		nPacketFakeLagTotal += fakeNet.m_nFakePacketReorder_Time;
 	}
 
 	// Check for simulating random packet duplication
-	if ( RandomBoolWithOdds( g_Config_FakePacketDup_Send.Get() ) )
+	if ( RandomBoolWithOdds( fakeNet.m_flFakePacketDup_Send ) )
 	{
-		int32 nDupLag = nPacketFakeLagTotal + WeakRandomInt( 0, g_Config_FakePacketDup_TimeMax.Get() );
+		int32 nDupLag = nPacketFakeLagTotal + WeakRandomInt( 0, fakeNet.m_nFakePacketDup_TimeMax );
 		nDupLag = std::max( 1, nDupLag );
 		s_packetLagQueue.LagPacket( true, const_cast<CRawUDPSocketImpl *>( this ), adrTo, nDupLag, nChunks, pChunks );
 	}
@@ -1143,9 +1579,20 @@ void CRawUDPSocketImpl::Close()
 	DbgVerify( !s_vecRawSocketsPendingDeletion.FindAndFastRemove( this ) );
 	s_vecRawSocketsPendingDeletion.AddToTail( this );
 
+	// Make sure receive workers are done with it, and discard
+	// anything they have received that we haven't processed yet
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_WORKERS
+		if ( m_bRecvWorkers )
+			RemoveSocketFromRecvWorkers( this );
+	#endif
+
 	// Clean up lagged packets, if any
 	s_packetLagQueue.AboutToDestroySocket( this );
 
+	// Anything we already sent should go out before the socket is closed.
+	// (This ends queueing for the current pass, if any.)
+	FlushQueuedRawUDPSends();
+
 	// Make sure we don't delay doing this too long
 	if ( s_bManualPollMode || ( s_pThreadSteamDatagram && s_pThreadSteamDatagram->get_id() != std::this_thread::get_id() ) )
 	{
@@ -1159,7 +1606,7 @@ void CRawUDPSocketImpl::Close()
 	}
 }
 
-static SOCKET OpenUDPSocketBoundToSockAddr( const void *sockaddr, size_t len, SteamDatagramErrMsg &errMsg, int *pnIPv6AddressFamilies )
+static SOCKET OpenUDPSocketBoundToSockAddr( const void *sockaddr, size_t len, SteamDatagramErrMsg &errMsg, int *pnIPv6AddressFamilies, bool bReusePort )
 {
 	unsigned int opt;
 
@@ -1245,6 +1692,23 @@ static SOCKET OpenUDPSocketBoundToSockAddr( const void *sockaddr, size_t len, St
 		}
 	}
 
+	// Allow other sockets to bind to the same address?  (Used to split
+	// incoming traffic among receive workers.)
+	#ifdef SO_REUSEPORT
+		if ( bReusePort )
+		{
+			opt = 1;
+			if ( setsockopt( sock, SOL_SOCKET, SO_REUSEPORT, (char *)&opt, sizeof( opt ) ) != 0 )
+			{
+				V_sprintf_safe( errMsg, "Failed to set SO_REUSEPORT.  Error code 0x%08X.", GetLastSocketError() );
+				closesocket( sock );
+				return INVALID_SOCKET;
+			}
+		}
+	#else
+		Assert( !bReusePort );
+	#endif
+
 	// Bind it to specific desired port and/or interfaces
 	if ( bind( sock, (struct sockaddr *)sockaddr, (socklen_t)len ) == -1 )
 	{
@@ -1257,7 +1721,7 @@ static SOCKET OpenUDPSocketBoundToSockAddr( const void *sockaddr, size_t len, St
 	return sock;
 }
 
-static CRawUDPSocketImpl *OpenRawUDPSocketInternal( CRecvPacketCallback callback, SteamDatagramErrMsg &errMsg, const GameNetworkingIPAddr *pAddrLocal, int *pnAddressFamilies )
+static CRawUDPSocketImpl *OpenRawUDPSocketInternal( CRecvPacketCallback callback, SteamDatagramErrMsg &errMsg, const GameNetworkingIPAddr *pAddrLocal, int *pnAddressFamilies, bool bShardAcrossRecvWorkers )
 {
 	// Creating a socket *should* be fast, but sometimes the OS might need to do some work.
 	// We shouldn't do this too often, give it a little extra time.
@@ -1317,6 +1781,12 @@ static CRawUDPSocketImpl *OpenRawUDPSocketInternal( CRecvPacketCallback callback
 		}
 	}
 
+	// Split incoming traffic across multiple sockets, one per receive worker?
+	bool bReusePort = false;
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_WORKERS
+		bReusePort = bShardAcrossRecvWorkers && s_nRecvWorkers > 1;
+	#endif
+
 	// Try IPv6?
 	SOCKET sock = INVALID_SOCKET;
 	if ( nAddressFamilies & k_nAddressFamily_IPv6 )
@@ -1329,7 +1799,7 @@ static CRawUDPSocketImpl *OpenRawUDPSocketInternal( CRecvPacketCallback callback
 
 		// Try to get socket
 		int nIPv6AddressFamilies = nAddressFamilies;
-		sock = OpenUDPSocketBoundToSockAddr( &address6, sizeof(address6), errMsg, &nIPv6AddressFamilies );
+		sock = OpenUDPSocketBoundToSockAddr( &address6, sizeof(address6), errMsg, &nIPv6AddressFamilies, bReusePort );
 
 		if ( sock == INVALID_SOCKET )
 		{
@@ -1357,7 +1827,7 @@ static CRawUDPSocketImpl *OpenRawUDPSocketInternal( CRecvPacketCallback callback
 		address4.sin_port = BigWord( addrLocal.m_port );
 
 		// Try to get socket
-		sock = OpenUDPSocketBoundToSockAddr( &address4, sizeof(address4), errMsg, nullptr );
+		sock = OpenUDPSocketBoundToSockAddr( &address4, sizeof(address4), errMsg, nullptr, bReusePort );
 
 		// If we failed, well, we have no other options left to try.
 		if ( sock == INVALID_SOCKET )
@@ -1401,6 +1871,92 @@ static CRawUDPSocketImpl *OpenRawUDPSocketInternal( CRecvPacketCallback callback
 	pSock->m_callback = callback;
 	pSock->m_nAddressFamilies = nAddressFamilies;
 
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_WORKERS
+		pSock->m_bRecvWorkers = s_nRecvWorkers > 0;
+
+		// Open the rest of the shards, bound to the same address
+		if ( bReusePort )
+		{
+			for ( int i = 1 ; i < s_nRecvWorkers ; ++i )
+			{
+				SteamDatagramErrMsg errMsgShard;
+				int nShardAddressFamilies = nAddressFamilies;
+				SOCKET shard = OpenUDPSocketBoundToSockAddr( &addrBound, cbAddress, errMsgShard, addrBound.ss_family == AF_INET6 ? &nShardAddressFamilies : nullptr, true );
+				if ( shard == INVALID_SOCKET )
+				{
+					SpewWarning( "Failed to open SO_REUSEPORT shard on %s.  %s\n", GameNetworkingIPAddrRender( addrLocal ).c_str(), errMsgShard );
+					break;
+				}
+				pSock->m_vecReusePortShards.push_back( shard );
+			}
+
+			// Steer packets to a shard based on the connection ID (bytes 1-4
+			// of a data packet, see UDPDataMsgHdr), so that all the traffic
+			// for a connection is read by the same worker.  For other packets
+			// it's essentially random.  Packets too short to have a connection
+			// ID go to the first socket.  If this fails, the kernel uses a
+			// hash of the addresses, which is OK too.
+			const uint32 nShards = uint32( pSock->m_vecReusePortShards.size() + 1 );
+			if ( nShards > 1 )
+			{
+				sock_filter code[] =
+				{
+					{ BPF_LD | BPF_W | BPF_ABS, 0, 0, 1 },
+					{ BPF_ALU | BPF_MOD | BPF_K, 0, 0, nShards },
+					{ BPF_RET | BPF_A, 0, 0, 0 },
+				};
+				sock_fprog prog;
+				prog.len = V_ARRAYSIZE( code );
+				prog.filter = code;
+				if ( setsockopt( sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog) ) != 0 )
+					SpewVerbose( "SO_ATTACH_REUSEPORT_CBPF failed on %s.  Error code 0x%08X.\n", GameNetworkingIPAddrRender( addrLocal ).c_str(), GetLastSocketError() );
+			}
+			SpewVerbose( "Listening on %s using %d SO_REUSEPORT shards\n", GameNetworkingIPAddrRender( addrLocal ).c_str(), (int)nShards );
+		}
+	#endif
+
+	// Check if we can use UDP segmentation offload.  If the kernel is too
+	// old, these will fail, and we will just use ordinary sends and receives.
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_UDP_SEGMENTATION_OFFLOAD
+		if ( g_Config_UDP_SegmentationOffload.Get() )
+		{
+			int opt = 0;
+			socklen_t optLen = sizeof(opt);
+			pSock->m_bGSO = getsockopt( sock, SOL_UDP, UDP_SEGMENT, &opt, &optLen ) == 0;
+			bool bTryGRO = true;
+			#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_WORKERS
+				// Receive workers don't handle coalesced datagrams
+				bTryGRO = !pSock->m_bRecvWorkers;
+			#endif
+			if ( bTryGRO )
+			{
+				opt = 1;
+				pSock->m_bGRO = setsockopt( sock, SOL_UDP, UDP_GRO, &opt, sizeof(opt) ) == 0;
+			}
+			if ( !pSock->m_bGSO || ( bTryGRO && !pSock->m_bGRO ) )
+				SpewVerbose( "UDP segmentation offload not fully supported on %s.  GSO=%d GRO=%d\n", GameNetworkingIPAddrRender( addrLocal ).c_str(), (int)pSock->m_bGSO, (int)pSock->m_bGRO );
+		}
+	#endif
+
+	// Ask the kernel to timestamp incoming packets, so that ping and jitter
+	// don't include the time they spent waiting for us to read them.
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_TIMESTAMPS
+		if ( g_Config_RecvKernelTimestamps.Get() )
+		{
+			int opt = 1;
+			pSock->m_bRecvTimestamps = setsockopt( sock, SOL_SOCKET, SO_TIMESTAMPNS, &opt, sizeof(opt) ) == 0;
+			#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_WORKERS
+				for ( SOCKET shard: pSock->m_vecReusePortShards )
+				{
+					if ( pSock->m_bRecvTimestamps && setsockopt( shard, SOL_SOCKET, SO_TIMESTAMPNS, &opt, sizeof(opt) ) != 0 )
+						pSock->m_bRecvTimestamps = false;
+				}
+			#endif
+			if ( !pSock->m_bRecvTimestamps )
+				SpewVerbose( "Kernel receive timestamps not supported on %s.  Error code 0x%08X.\n", GameNetworkingIPAddrRender( addrLocal ).c_str(), GetLastSocketError() );
+		}
+	#endif
+
 	// On windows, create an event used to poll efficiently
 	#ifdef _WIN32
 		pSock->m_event = WSACreateEvent();
@@ -1415,6 +1971,12 @@ static CRawUDPSocketImpl *OpenRawUDPSocketInternal( CRecvPacketCallback callback
 	// Add to master list.  (Hopefully we usually won't have that many.)
 	s_vecRawSockets.AddToTail( pSock );
 
+	// Hand off to the receive workers?
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_WORKERS
+		if ( pSock->m_bRecvWorkers )
+			AddSocketToRecvWorkers( pSock );
+	#endif
+
 	// Wake up background thread so we can start receiving packets on this socket immediately
 	WakeSteamDatagramThread();
 
@@ -1428,7 +1990,7 @@ static CRawUDPSocketImpl *OpenRawUDPSocketInternal( CRecvPacketCallback callback
 
 IRawUDPSocket *OpenRawUDPSocket( CRecvPacketCallback callback, SteamDatagramErrMsg &errMsg, GameNetworkingIPAddr *pAddrLocal, int *pnAddressFamilies )
 {
-	return OpenRawUDPSocketInternal( callback, errMsg, pAddrLocal, pnAddressFamilies );
+	return OpenRawUDPSocketInternal( callback, errMsg, pAddrLocal, pnAddressFamilies, false );
 }
 
 static inline void AssertGlobalLockHeldExactlyOnce()
@@ -1439,115 +2001,1045 @@ static inline void AssertGlobalLockHeldExactlyOnce()
 	#endif
 }
 
-/// Poll all of our sockets, and dispatch the packets received.
-/// This will return true if we own the lock, or false if we detected
-/// a shutdown request and bailed without re-squiring the lock.
-static bool PollRawUDPSockets( int nMaxTimeoutMS, bool bManualPoll )
+/// Dispatch a single datagram that we have pulled off of a socket.  This is
+/// where simulated loss, lag, etc are applied to inbound traffic.
+static void ProcessRawUDPPacket( CRawUDPSocketImpl *pSock, char *pPkt, int cbPkt, const sockaddr_storage &from, const RecvPktPreDecrypted_t *pPreDecrypted, GameNetworkingMicroseconds usecNow, GameNetworkingMicroseconds usecKernelRecv )
 {
-	// This should only ever be called from our one thread proc,
-	// and we assume that it will have locked the lock exactly once.
-	AssertGlobalLockHeldExactlyOnce();
+	Assert( usecKernelRecv <= usecNow );
 
-	const int nSocketsToPoll = s_vecRawSockets.Count();
-
-	#ifdef _WIN32
-		HANDLE *pEvents = (HANDLE*)alloca( sizeof(HANDLE) * (nSocketsToPoll+1) );
-		int nEvents = 0;
-	#else
-		pollfd *pPollFDs = (pollfd*)alloca( sizeof(pollfd) * (nSocketsToPoll+1) ); 
-		int nPollFDs = 0;
-	#endif
+	// Add a tag.  If we end up holding the lock for a long time, this tag
+	// will tell us how many packets were processed
+	GameNetworkingGlobalLock::AssertHeldByCurrentThread( "RecvUDPPacket" );
 
-	CRawUDPSocketImpl **pSocketsToPoll = (CRawUDPSocketImpl **)alloca( sizeof(CRawUDPSocketImpl *) * nSocketsToPoll ); 
+	// Simulating network conditions?  Normally we are not, and all of
+	// this gets skipped with a single test
+	const FakeNetworkConfigSnapshot &fakeNet = FakeNetworkConfig();
+	const bool bSimulateRecv = unlikely( fakeNet.m_bSimulateRecv );
 
-	for ( int i = 0 ; i < nSocketsToPoll ; ++i )
+	// Check simulated global rate limit
+	if ( bSimulateRecv && fakeNet.m_nFakeRateLimit_Recv_Rate > 0 )
 	{
-		CRawUDPSocketImpl *pSock = s_vecRawSockets[ i ];
 
-		// Should be totally valid at this point
-		Assert( pSock->m_callback.m_fnCallback );
-		Assert( pSock->m_socket != INVALID_SOCKET );
+		// Check if bucket already has tokens in it, which
+		// will be common.  If so, we can avoid reading the
+		// timer
+		if ( s_flFakeRateLimit_Recv_tokens <= 0.0f )
+		{
 
-		pSocketsToPoll[ i ] = pSock;
+			// Update bucket with tokens
+			UpdateFakeRateLimitTokenBuckets( usecNow );
 
-		#ifdef _WIN32
-			pEvents[ nEvents++ ] = pSock->m_event;
-		#else
-			pollfd *p = &pPollFDs[ nPollFDs++ ];
-			p->fd = pSock->m_socket;
-			p->events = POLLRDNORM;
-			p->revents = 0;
-		#endif
+			// Still empty?
+			if ( s_flFakeRateLimit_Recv_tokens <= 0.0f )
+				return;
+		}
+
+		// Spend tokens
+		s_flFakeRateLimit_Recv_tokens -= cbPkt;
 	}
 
-	#if defined( _WIN32 )
-		Assert( s_hEventWakeThread != NULL && s_hEventWakeThread != INVALID_HANDLE_VALUE );
-		pEvents[ nEvents++ ] = s_hEventWakeThread;
-	#elif defined( NN_NINTENDO_SDK )
-		Assert( s_hEventWakeThread != INVALID_SOCKET );
-		pollfd *p = &pPollFDs[ nPollFDs++ ];
-		p->fd = s_hEventWakeThread;
-		p->events = POLLRDNORM;
-		p->revents = 0;
-	#else
-		Assert( s_hSockWakeThreadRead != INVALID_SOCKET );
-		pollfd *p = &pPollFDs[ nPollFDs++ ];
-		p->fd = s_hSockWakeThreadRead;
-		p->events = POLLRDNORM;
-		p->revents = 0;
-	#endif
+	// Check for simulating random packet loss
+	if ( bSimulateRecv && RandomBoolWithOdds( fakeNet.m_flFakePacketLoss_Recv ) )
+		return;
 
-	// Release lock while we're asleep
-	GameNetworkingGlobalLock::Unlock();
+	RecvPktInfo_t info;
+	info.m_adrFrom.SetFromSockadr( &from );
 
-	// Shutdown request?
-	if ( s_nLowLevelSupportRefCount.load(std::memory_order_acquire) <= 0 || s_bManualPollMode != bManualPoll )
-		return false; // ABORT THREAD
+	// If we're dual stack, convert mapped IPv4 back to ordinary IPv4
+	if ( pSock->m_nAddressFamilies == k_nAddressFamily_DualStack )
+		info.m_adrFrom.BConvertMappedToIPv4();
 
-	// Wait for data on one of the sockets, or for us to be asked to wake up
-	#if defined( WIN32 )
-		DWORD nWaitResult = WaitForMultipleObjects( nEvents, pEvents, FALSE, nMaxTimeoutMS );
-	#else
-		poll( pPollFDs, nPollFDs, nMaxTimeoutMS );
-	#endif
+	// Check for tracing
+	if ( fakeNet.m_nPacketTraceMaxBytes >= 0 )
+	{
+		iovec tmp;
+		tmp.iov_base = pPkt;
+		tmp.iov_len = cbPkt;
+		pSock->TracePkt( false, info.m_adrFrom, 1, &tmp );
+	}
 
-	GameNetworkingMicroseconds usecStartedLocking = GameNetworkingSockets_GetLocalTimestamp();
-	UpdateFakeRateLimitTokenBuckets( usecStartedLocking );
-	for (;;)
+	if ( bSimulateRecv )
 	{
+		int32 nPacketFakeLagTotal = fakeNet.m_nFakePacketLag_Recv;
 
-		// Shutdown request?  We've potentially been waiting a long time.
-		// Don't attempt to grab the lock again if we know we want to shutdown,
-		// that is just a waste of time.
-		if ( s_nLowLevelSupportRefCount.load(std::memory_order_acquire) <= 0 || s_bManualPollMode != bManualPoll )
-			return false;
+		// Check for simulating random packet reordering
+		if ( RandomBoolWithOdds( fakeNet.m_flFakePacketReorder_Recv ) )
+		{
+			nPacketFakeLagTotal += fakeNet.m_nFakePacketReorder_Time;
+		}
 
-		// Try to acquire the lock.  But don't wait forever, in case the other thread has the lock
-		// and then makes a shutdown request while we're waiting on the lock here.
-		if ( GameNetworkingGlobalLock::TryLock( "ServiceThread", 250 ) )
-			break;
+		// Check for simulating random packet duplication
+		if ( RandomBoolWithOdds( fakeNet.m_flFakePacketDup_Recv ) )
+		{
+			int32 nDupLag = nPacketFakeLagTotal + WeakRandomInt( 0, fakeNet.m_nFakePacketDup_TimeMax );
+			nDupLag = std::max( 1, nDupLag );
+			iovec temp;
+			temp.iov_len = cbPkt;
+			temp.iov_base = pPkt;
+			s_packetLagQueue.LagPacket( false, pSock, info.m_adrFrom, nDupLag, 1, &temp );
+		}
 
-		// The only time this really should happen is a relatively rare race condition
-		// where the main thread is trying to shut us down.  (Or while debugging.)
-		// However, note that try_lock_for is permitted to "fail" spuriously, returning
-		// false even if no other thread holds the lock.  (For performance reasons.)
-		// So we check how long we have actually been waiting.
-		GameNetworkingMicroseconds usecElapsed = GameNetworkingSockets_GetLocalTimestamp() - usecStartedLocking;
-		AssertMsg1( usecElapsed < 50*1000 || s_nLowLevelSupportRefCount.load(std::memory_order_acquire) <= 0 || s_bManualPollMode != bManualPoll || Plat_IsInDebugSession(), "SDR service thread gave up on lock after waiting %dms.  This directly adds to delay of processing of network packets!", int( usecElapsed/1000 ) );
+		// Check for simulating lag
+		if ( nPacketFakeLagTotal > 0 )
+		{
+			iovec temp;
+			temp.iov_len = cbPkt;
+			temp.iov_base = pPkt;
+			s_packetLagQueue.LagPacket( false, pSock, info.m_adrFrom, nPacketFakeLagTotal, 1, &temp );
+			return;
+		}
 	}
 
-	// If we have spewed, flush to disk
-	FlushSpew();
+	ETW_UDPRecvPacket( info.m_adrFrom, cbPkt );
 
-	// Recv socket data from any sockets that might have data, and execute the callbacks.
-	char buf[ k_cbGameNetworkingSocketsMaxUDPMsgLen + 1024 ];
-#ifdef _WIN32
-	// Note that we assume we aren't polling a ton of sockets here.  We do at least skip ahead
-	// to the first socket with data, based on the return value of WaitForMultipleObjects.  But
-	// then we will check all sockets later in the array.
-	//
-	// Note that if we get a wake request, the event has already been reset, because we used an auto-reset event
-	for ( int idx = nWaitResult - WAIT_OBJECT_0 ; (unsigned)idx < (unsigned)nSocketsToPoll ; ++idx )
+	info.m_pPkt = pPkt;
+	info.m_cbPkt = cbPkt;
+	info.m_pSock = pSock;
+	info.m_pPreDecrypted = pPreDecrypted;
+	info.m_usecNow = usecNow;
+	info.m_usecKernelRecv = usecKernelRecv;
+	pSock->m_callback( info );
+}
+
+#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECVMMSG
+
+#if defined( STEAMNETWORKINGSOCKETS_LOWLEVEL_UDP_SEGMENTATION_OFFLOAD ) || defined( STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_TIMESTAMPS )
+	#define STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_CONTROL
+
+	/// Space for the ancillary data we might ask for with each datagram:
+	/// the GRO segment size and the kernel receive timestamp
+	struct RawUDPRecvControl
+	{
+		alignas( cmsghdr ) char m_buf[ CMSG_SPACE( sizeof(int) ) + CMSG_SPACE( sizeof(timespec) ) ];
+	};
+
+	/// Scan the ancillary data for a received datagram.  cbGRO is set to
+	/// the GRO segment size, and tsKernelRecv to the time the kernel
+	/// received the datagram.  Things that aren't present are zeroed.
+	static void ParseRawUDPRecvControl( msghdr &hdr, int &cbGRO, timespec &tsKernelRecv )
+	{
+		cbGRO = 0;
+		tsKernelRecv.tv_sec = 0;
+		tsKernelRecv.tv_nsec = 0;
+		for ( cmsghdr *cm = CMSG_FIRSTHDR( &hdr ) ; cm ; cm = CMSG_NXTHDR( &hdr, cm ) )
+		{
+			#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_UDP_SEGMENTATION_OFFLOAD
+				if ( cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO )
+					memcpy( &cbGRO, CMSG_DATA( cm ), sizeof(cbGRO) );
+			#endif
+			#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_TIMESTAMPS
+				if ( cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPNS )
+					memcpy( &tsKernelRecv, CMSG_DATA( cm ), sizeof(tsKernelRecv) );
+			#endif
+		}
+	}
+#endif
+
+#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_TIMESTAMPS
+
+/// Convert kernel receive timestamps, which are wall clock time, to local
+/// timestamps.  Use one of these per batch, created right after reading the
+/// local clock.  We read the wall clock once, the first time we need it,
+/// and reuse the offset for the rest of the batch.
+class CKernelRecvTimestampConverter
+{
+public:
+	explicit CKernelRecvTimestampConverter( GameNetworkingMicroseconds usecNow ) : m_usecNow( usecNow ) {}
+
+	/// Returns 0 if the timestamp is missing or can't be trusted
+	GameNetworkingMicroseconds Convert( const timespec &tsKernelRecv )
+	{
+		if ( tsKernelRecv.tv_sec == 0 && tsKernelRecv.tv_nsec == 0 )
+			return 0;
+		if ( m_usecWallClockOffset == INT64_MIN )
+		{
+			timespec tsNow;
+			if ( clock_gettime( CLOCK_REALTIME, &tsNow ) != 0 )
+				return 0;
+			m_usecWallClockOffset = TimespecToUSec( tsNow ) - m_usecNow;
+		}
+		GameNetworkingMicroseconds usecKernelRecv = TimespecToUSec( tsKernelRecv ) - m_usecWallClockOffset;
+
+		// The two clocks aren't read at the same instant, so a packet that
+		// just arrived can appear to be very slightly in the future.  Anything
+		// way off probably means somebody stepped the wall clock.
+		if ( usecKernelRecv > m_usecNow )
+			return m_usecNow;
+		if ( usecKernelRecv < m_usecNow - k_usecMaxKernelRecvTimestampAge )
+			return 0;
+		return usecKernelRecv;
+	}
+
+private:
+	static constexpr GameNetworkingMicroseconds k_usecMaxKernelRecvTimestampAge = k_nMillion;
+	static inline int64 TimespecToUSec( const timespec &ts ) { return int64( ts.tv_sec )*k_nMillion + ts.tv_nsec/1000; }
+
+	const GameNetworkingMicroseconds m_usecNow;
+	int64 m_usecWallClockOffset = INT64_MIN;
+};
+
+#endif
+
+/// Buffers used to receive a batch of datagrams with a single call to
+/// recvmmsg.  Only accessed by the thread that is polling the sockets,
+/// while it holds the global lock.
+constexpr int k_cbRawUDPRecvSlot = k_cbGameNetworkingSocketsMaxUDPMsgLen + 1024;
+struct RawUDPRecvBatch
+{
+	mmsghdr m_msgs[ k_nSteamDatagramMaxRecvBatchSize ];
+	iovec m_iov[ k_nSteamDatagramMaxRecvBatchSize ];
+	sockaddr_storage m_from[ k_nSteamDatagramMaxRecvBatchSize ];
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_CONTROL
+		RawUDPRecvControl m_ctrl[ k_nSteamDatagramMaxRecvBatchSize ];
+	#endif
+
+	/// Space for the payloads.  Ordinarily this is divided into one
+	/// slot per datagram.  For sockets with GRO enabled, a single read
+	/// can return up to 64K, so we use fewer, larger slots.
+	char m_buf[ k_nSteamDatagramMaxRecvBatchSize * k_cbRawUDPRecvSlot ];
+};
+static RawUDPRecvBatch s_recvBatch;
+
+#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_UDP_SEGMENTATION_OFFLOAD
+	constexpr int k_cbRawUDPRecvSlotGRO = 0xffff;
+	COMPILE_TIME_ASSERT( sizeof( s_recvBatch.m_buf ) >= k_cbRawUDPRecvSlotGRO );
+#endif
+
+/// Returns true if we need to read ancillary data along with the
+/// datagrams on this socket, which means using recvmmsg.
+static inline bool BRawUDPSocketNeedsRecvControl( const CRawUDPSocketImpl *pSock )
+{
+	bool bResult = false;
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_UDP_SEGMENTATION_OFFLOAD
+		bResult = bResult || pSock->m_bGRO;
+	#endif
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_TIMESTAMPS
+		bResult = bResult || pSock->m_bRecvTimestamps;
+	#endif
+	return bResult;
+}
+
+/// Pull up to nBatchSize datagrams off the socket into s_recvBatch.
+/// nBatchSize may be reduced, if the socket needs larger buffers.
+/// Returns the number of datagrams received, or a value <= 0 if
+/// there is nothing to read (or some other error)
+static int RecvRawUDPBatch( CRawUDPSocketImpl *pSock, int &nBatchSize )
+{
+	int cbSlot = k_cbRawUDPRecvSlot;
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_UDP_SEGMENTATION_OFFLOAD
+		if ( pSock->m_bGRO )
+		{
+			cbSlot = k_cbRawUDPRecvSlotGRO;
+			nBatchSize = std::min( nBatchSize, (int)sizeof( s_recvBatch.m_buf ) / cbSlot );
+		}
+	#endif
+	Assert( nBatchSize > 0 && nBatchSize <= k_nSteamDatagramMaxRecvBatchSize );
+
+	// The kernel overwrites the address lengths, so we need to
+	// reset the headers every time
+	for ( int i = 0 ; i < nBatchSize ; ++i )
+	{
+		s_recvBatch.m_iov[i].iov_base = s_recvBatch.m_buf + i*cbSlot;
+		s_recvBatch.m_iov[i].iov_len = cbSlot;
+
+		msghdr &hdr = s_recvBatch.m_msgs[i].msg_hdr;
+		hdr.msg_name = &s_recvBatch.m_from[i];
+		hdr.msg_namelen = sizeof( s_recvBatch.m_from[i] );
+		hdr.msg_iov = &s_recvBatch.m_iov[i];
+		hdr.msg_iovlen = 1;
+		#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_CONTROL
+			if ( BRawUDPSocketNeedsRecvControl( pSock ) )
+			{
+				hdr.msg_control = s_recvBatch.m_ctrl[i].m_buf;
+				hdr.msg_controllen = sizeof( s_recvBatch.m_ctrl[i].m_buf );
+			}
+			else
+		#endif
+		{
+			hdr.msg_control = nullptr;
+			hdr.msg_controllen = 0;
+		}
+		hdr.msg_flags = 0;
+		s_recvBatch.m_msgs[i].msg_len = 0;
+	}
+
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_TIME_SOCKET_CALLS
+		GameNetworkingMicroseconds usecRecvStart = GameNetworkingSockets_GetLocalTimestamp();
+	#endif
+
+	int nRecv = ::recvmmsg( pSock->m_socket, s_recvBatch.m_msgs, nBatchSize, MSG_DONTWAIT, nullptr );
+
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_TIME_SOCKET_CALLS
+		GameNetworkingMicroseconds usecRecvElapsed = GameNetworkingSockets_GetLocalTimestamp() - usecRecvStart;
+		if ( usecRecvElapsed > 1000 )
+		{
+			SpewWarning( "recvmmsg took %.1fms\n", usecRecvElapsed*1e-3 );
+			ETW_LongOp( "UDP recvmmsg", usecRecvElapsed );
+		}
+	#endif
+
+	return nRecv;
+}
+
+#endif // #ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECVMMSG
+
+#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_WORKERS
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Receive worker threads
+//
+// Each worker polls a subset of the sockets, without holding the global
+// lock.  It pulls datagrams off the socket and decrypts the payload of data
+// packets.  In the common case (an established UDP connection, and nothing
+// unusual about the packet) it then processes the packet completely, holding
+// only the connection lock.  (See ProcessRecvPacketsOnWorkerThread.)  The
+// rest are queued up, and the service thread dispatches them, holding the
+// global lock, exactly as if it had read them itself.  It just doesn't need
+// to touch the sockets, and usually doesn't need to decrypt.
+//
+// When a socket is closed, we don't wait for the workers.  We take it out
+// of their lists, and then it sits on the pending deletion list until no
+// worker is reading from it.  A worker that finishes reading from a socket
+// that was removed wakes the service thread so it can retry the delete.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+/// A batch of datagrams pulled off of one socket by a receive worker
+struct RecvWorkerBatch
+{
+	CRawUDPSocketImpl *m_pSock; // Cleared if the socket is closed before the batch is dispatched
+	int m_nPkts;
+	int m_cbPkt[ k_nSteamDatagramMaxRecvBatchSize ];
+	sockaddr_storage m_from[ k_nSteamDatagramMaxRecvBatchSize ];
+	RecvPktPreDecrypted_t m_preDecrypted[ k_nSteamDatagramMaxRecvBatchSize ];
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_TIMESTAMPS
+		timespec m_tsKernelRecv[ k_nSteamDatagramMaxRecvBatchSize ]; // Wall clock time, converted when dispatched.  Zero if unknown
+	#endif
+	char m_buf[ k_nSteamDatagramMaxRecvBatchSize * k_cbRawUDPRecvSlot ];
+};
+
+/// Batches waiting to be dispatched by the service thread, and batches
+/// that can be reused.
+static ShortDurationLock s_lockRecvWorkerBatches( "recv_worker_batches" );
+static std::vector<RecvWorkerBatch *> s_vecRecvWorkerBatchesReady;
+static std::vector<RecvWorkerBatch *> s_vecRecvWorkerBatchesFree;
+static int s_nRecvWorkerBatchesAllocated;
+
+/// Batches that the service thread is in the middle of dispatching.
+/// Protected by the global lock.
+static std::vector<RecvWorkerBatch *> s_vecRecvWorkerBatchesDispatching;
+
+/// Limit how far the workers can get ahead of the service thread.  If it
+/// can't keep up, we'd rather leave packets in the OS buffer.
+constexpr int k_nMaxRecvWorkerBatches = 32;
+
+struct RecvWorker
+{
+	struct Socket_t
+	{
+		CRawUDPSocketImpl *m_pSock;
+		SOCKET m_socket; // m_pSock->m_socket, or one of its shards
+	};
+
+	std::thread *m_pThread = nullptr;
+	SOCKET m_hSockWakeRead = INVALID_SOCKET;
+	SOCKET m_hSockWakeWrite = INVALID_SOCKET;
+
+	/// Protects the list of sockets.  The generation number is bumped
+	/// every time the list changes
+	ShortDurationLock m_lock { "recv_worker" };
+	std::vector<Socket_t> m_vecSockets;
+	int m_nGeneration = 0;
+
+	/// Socket the worker is currently reading from.  A closed socket is
+	/// not deleted while a worker is still using it.
+	std::atomic<CRawUDPSocketImpl *> m_pActiveSock { nullptr };
+
+	void Wake()
+	{
+		char buf[1] = {0};
+		send( m_hSockWakeWrite, buf, 1, 0 );
+	}
+};
+static RecvWorker s_arRecvWorkers[ k_nSteamDatagramMaxRecvWorkerThreads ];
+static std::atomic<bool> s_bStopRecvWorkers;
+static int s_idxNextRecvWorker;
+
+static RecvWorkerBatch *AllocRecvWorkerBatch()
+{
+	RecvWorkerBatch *pBatch = nullptr;
+	s_lockRecvWorkerBatches.lock();
+	if ( !s_vecRecvWorkerBatchesFree.empty() )
+	{
+		pBatch = s_vecRecvWorkerBatchesFree.back();
+		s_vecRecvWorkerBatchesFree.pop_back();
+	}
+	else if ( s_nRecvWorkerBatchesAllocated < k_nMaxRecvWorkerBatches )
+	{
+		++s_nRecvWorkerBatchesAllocated;
+	}
+	else
+	{
+		s_lockRecvWorkerBatches.unlock();
+		return nullptr;
+	}
+	s_lockRecvWorkerBatches.unlock();
+
+	if ( !pBatch )
+		pBatch = new RecvWorkerBatch;
+	return pBatch;
+}
+
+/// Pull datagrams off the socket until it is drained.  Returns false if
+/// we couldn't get a buffer, because the service thread is behind.
+static bool RecvWorkerDrainSocket( CRawUDPSocketImpl *pSock, SOCKET sock )
+{
+	mmsghdr msgs[ k_nSteamDatagramMaxRecvBatchSize ];
+	iovec iov[ k_nSteamDatagramMaxRecvBatchSize ];
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_TIMESTAMPS
+		RawUDPRecvControl ctrl[ k_nSteamDatagramMaxRecvBatchSize ];
+	#endif
+	const int nBatchSize = Clamp( g_nSteamDatagramRecvBatchSize, 1, k_nSteamDatagramMaxRecvBatchSize );
+	for (;;)
+	{
+		RecvWorkerBatch *pBatch = AllocRecvWorkerBatch();
+		if ( !pBatch )
+			return false;
+
+		for ( int i = 0 ; i < nBatchSize ; ++i )
+		{
+			iov[i].iov_base = pBatch->m_buf + i*k_cbRawUDPRecvSlot;
+			iov[i].iov_len = k_cbRawUDPRecvSlot;
+
+			msghdr &hdr = msgs[i].msg_hdr;
+			hdr.msg_name = &pBatch->m_from[i];
+			hdr.msg_namelen = sizeof( pBatch->m_from[i] );
+			hdr.msg_iov = &iov[i];
+			hdr.msg_iovlen = 1;
+			#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_TIMESTAMPS
+				if ( pSock->m_bRecvTimestamps )
+				{
+					hdr.msg_control = ctrl[i].m_buf;
+					hdr.msg_controllen = sizeof( ctrl[i].m_buf );
+				}
+				else
+			#endif
+			{
+				hdr.msg_control = nullptr;
+				hdr.msg_controllen = 0;
+			}
+			hdr.msg_flags = 0;
+			msgs[i].msg_len = 0;
+		}
+
+		int nRecv = ::recvmmsg( sock, msgs, nBatchSize, MSG_DONTWAIT, nullptr );
+		if ( nRecv <= 0 )
+		{
+			s_lockRecvWorkerBatches.lock();
+			s_vecRecvWorkerBatchesFree.push_back( pBatch );
+			s_lockRecvWorkerBatches.unlock();
+			return true;
+		}
+
+		// One clock read for the whole batch
+		const GameNetworkingMicroseconds usecNow = GameNetworkingSockets_GetLocalTimestamp();
+		#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_TIMESTAMPS
+			CKernelRecvTimestampConverter kernelRecvTimestamps( usecNow );
+		#endif
+
+		const void *arpPkt[ k_nSteamDatagramMaxRecvBatchSize ];
+		netadr_t arAdrFrom[ k_nSteamDatagramMaxRecvBatchSize ];
+		GameNetworkingMicroseconds arUsecKernelRecv[ k_nSteamDatagramMaxRecvBatchSize ];
+		for ( int i = 0 ; i < nRecv ; ++i )
+		{
+			pBatch->m_cbPkt[i] = (int)msgs[i].msg_len;
+			arpPkt[i] = iov[i].iov_base;
+
+			// If we're dual stack, convert mapped IPv4 back to ordinary IPv4
+			arAdrFrom[i].SetFromSockadr( &pBatch->m_from[i] );
+			if ( pSock->m_nAddressFamilies == k_nAddressFamily_DualStack )
+				arAdrFrom[i].BConvertMappedToIPv4();
+
+			arUsecKernelRecv[i] = 0;
+			#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_TIMESTAMPS
+				int cbGRO;
+				ParseRawUDPRecvControl( msgs[i].msg_hdr, cbGRO, pBatch->m_tsKernelRecv[i] );
+				arUsecKernelRecv[i] = kernelRecvTimestamps.Convert( pBatch->m_tsKernelRecv[i] );
+			#endif
+		}
+
+		// Here's the work we are actually trying to get off of the service
+		// thread.  If the service thread would need to do anything to these
+		// packets first (simulate network conditions, trace them), then we
+		// can only decrypt them.
+		const bool bProcess = s_nFakeNetworkConfigVersionRecvPassthrough.load( std::memory_order_acquire ) == g_nConfigValueVersion.load( std::memory_order_relaxed );
+		ProcessRecvPacketsOnWorkerThread( pSock, nRecv, arpPkt, pBatch->m_cbPkt, arAdrFrom, arUsecKernelRecv, usecNow, bProcess, pBatch->m_preDecrypted );
+		pBatch->m_pSock = pSock;
+		pBatch->m_nPkts = nRecv;
+
+		// Queue it.  Only need to wake the service thread if the
+		// queue was empty.  Otherwise, it already has a wake request.
+		s_lockRecvWorkerBatches.lock();
+		const bool bWake = s_vecRecvWorkerBatchesReady.empty();
+		s_vecRecvWorkerBatchesReady.push_back( pBatch );
+		s_lockRecvWorkerBatches.unlock();
+		if ( bWake )
+			WakeSteamDatagramThread();
+
+		if ( nRecv < nBatchSize )
+			return true;
+	}
+}
+
+static void RecvWorkerThreadProc( RecvWorker *pWorker )
+{
+	std::vector<RecvWorker::Socket_t> vecSockets;
+	std::vector<pollfd> vecPollFDs;
+	int nGeneration = -1;
+	while ( !s_bStopRecvWorkers.load( std::memory_order_acquire ) )
+	{
+
+		// Refresh our list of sockets, if it has changed
+		pWorker->m_lock.lock();
+		if ( nGeneration != pWorker->m_nGeneration )
+		{
+			nGeneration = pWorker->m_nGeneration;
+			vecSockets = pWorker->m_vecSockets;
+		}
+		pWorker->m_lock.unlock();
+
+		vecPollFDs.resize( vecSockets.size() + 1 );
+		for ( size_t i = 0 ; i < vecSockets.size() ; ++i )
+		{
+			vecPollFDs[i].fd = vecSockets[i].m_socket;
+			vecPollFDs[i].events = POLLRDNORM;
+			vecPollFDs[i].revents = 0;
+		}
+		pollfd &pollWake = vecPollFDs.back();
+		pollWake.fd = pWorker->m_hSockWakeRead;
+		pollWake.events = POLLRDNORM;
+		pollWake.revents = 0;
+
+		poll( vecPollFDs.data(), (nfds_t)vecPollFDs.size(), k_msMaxPollWait );
+
+		if ( pollWake.revents & POLLRDNORM )
+		{
+			char buf[ 64 ];
+			while ( ::recv( pWorker->m_hSockWakeRead, buf, sizeof(buf), 0 ) > 0 ) {}
+		}
+
+		bool bBehind = false;
+		for ( size_t i = 0 ; i < vecSockets.size() && !bBehind ; ++i )
+		{
+			if ( !( vecPollFDs[i].revents & POLLRDNORM ) )
+				continue;
+
+			// Make sure the list didn't change (and the socket wasn't
+			// closed) while we were asleep.  If so, start over.
+			pWorker->m_lock.lock();
+			const bool bListChanged = nGeneration != pWorker->m_nGeneration;
+			if ( !bListChanged )
+				pWorker->m_pActiveSock.store( vecSockets[i].m_pSock );
+			pWorker->m_lock.unlock();
+			if ( bListChanged )
+				break;
+
+			bBehind = !RecvWorkerDrainSocket( vecSockets[i].m_pSock, vecSockets[i].m_socket );
+
+			// Done with the socket.  If it was closed while we were reading
+			// from it, the service thread is waiting for us to let go of it
+			// before it can delete it
+			pWorker->m_lock.lock();
+			pWorker->m_pActiveSock.store( nullptr );
+			const bool bRemoved = nGeneration != pWorker->m_nGeneration;
+			pWorker->m_lock.unlock();
+			if ( bRemoved )
+			{
+				WakeSteamDatagramThread();
+				break;
+			}
+		}
+
+		// If the service thread can't keep up, give it a moment
+		if ( bBehind )
+			std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+	}
+}
+
+static void AddSocketToRecvWorkers( CRawUDPSocketImpl *pSock )
+{
+	GameNetworkingGlobalLock::AssertHeldByCurrentThread();
+	Assert( s_nRecvWorkers > 0 );
+
+	auto AddToNextWorker = [pSock]( SOCKET sock )
+	{
+		RecvWorker &w = s_arRecvWorkers[ s_idxNextRecvWorker ];
+		s_idxNextRecvWorker = ( s_idxNextRecvWorker + 1 ) % s_nRecvWorkers;
+		w.m_lock.lock();
+		w.m_vecSockets.push_back( RecvWorker::Socket_t{ pSock, sock } );
+		++w.m_nGeneration;
+		w.m_lock.unlock();
+		w.Wake();
+	};
+	AddToNextWorker( pSock->m_socket );
+	for ( SOCKET shard: pSock->m_vecReusePortShards )
+		AddToNextWorker( shard );
+}
+
+static void RemoveSocketFromRecvWorkers( CRawUDPSocketImpl *pSock )
+{
+	GameNetworkingGlobalLock::AssertHeldByCurrentThread();
+
+	for ( int i = 0 ; i < s_nRecvWorkers ; ++i )
+	{
+		RecvWorker &w = s_arRecvWorkers[ i ];
+		w.m_lock.lock();
+		auto itEnd = std::remove_if( w.m_vecSockets.begin(), w.m_vecSockets.end(),
+			[pSock]( const RecvWorker::Socket_t &x ) { return x.m_pSock == pSock; } );
+		const bool bRemoved = itEnd != w.m_vecSockets.end();
+		if ( bRemoved )
+		{
+			w.m_vecSockets.erase( itEnd, w.m_vecSockets.end() );
+			++w.m_nGeneration;
+		}
+		w.m_lock.unlock();
+
+		// Make sure it stops polling the socket.  If it's in the middle
+		// of reading from it, we don't wait for it here.  It won't start
+		// reading from the socket again, and BRecvWorkersDoneWithSocket
+		// keeps us from deleting the socket until it's done.
+		if ( bRemoved )
+			w.Wake();
+	}
+}
+
+/// Called before deleting a closed socket.  Returns false if a worker
+/// is still reading from it, in which case the worker will wake the
+/// service thread when it is done.  Otherwise, makes sure nothing
+/// references the socket and returns true.
+static bool BRecvWorkersDoneWithSocket( CRawUDPSocketImpl *pSock )
+{
+	GameNetworkingGlobalLock::AssertHeldByCurrentThread();
+
+	for ( int i = 0 ; i < s_nRecvWorkers ; ++i )
+	{
+		RecvWorker &w = s_arRecvWorkers[ i ];
+		w.m_lock.lock();
+		const bool bActive = w.m_pActiveSock.load() == pSock;
+		w.m_lock.unlock();
+		if ( bActive )
+			return false;
+	}
+
+	// Discard anything received but not dispatched yet.  The worker
+	// queues its batches before letting go of the socket, so there
+	// won't be any more of these.
+	s_lockRecvWorkerBatches.lock();
+	for ( RecvWorkerBatch *pBatch: s_vecRecvWorkerBatchesReady )
+	{
+		if ( pBatch->m_pSock == pSock )
+			pBatch->m_pSock = nullptr;
+	}
+	s_lockRecvWorkerBatches.unlock();
+	for ( RecvWorkerBatch *pBatch: s_vecRecvWorkerBatchesDispatching )
+	{
+		if ( pBatch->m_pSock == pSock )
+			pBatch->m_pSock = nullptr;
+	}
+	return true;
+}
+
+/// Called by the service thread to dispatch everything the workers have
+/// received.  Returns false if we detected a shutdown request.
+static bool DispatchRecvWorkerBatches()
+{
+	GameNetworkingGlobalLock::AssertHeldByCurrentThread();
+	Assert( s_vecRecvWorkerBatchesDispatching.empty() );
+
+	// Make sure the workers know whether they can process packets
+	// themselves, if the config has changed
+	FakeNetworkConfig();
+
+	s_lockRecvWorkerBatches.lock();
+	s_vecRecvWorkerBatchesDispatching.swap( s_vecRecvWorkerBatchesReady );
+	s_lockRecvWorkerBatches.unlock();
+
+	bool bShutdown = false;
+	for ( RecvWorkerBatch *pBatch: s_vecRecvWorkerBatchesDispatching )
+	{
+		// One clock read for the whole batch
+		const GameNetworkingMicroseconds usecNow = GameNetworkingSockets_GetLocalTimestamp();
+		#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_TIMESTAMPS
+			CKernelRecvTimestampConverter kernelRecvTimestamps( usecNow );
+		#endif
+		for ( int i = 0 ; i < pBatch->m_nPkts && !bShutdown ; ++i )
+		{
+			// Socket closed?  (Possibly by a previous callback.)
+			CRawUDPSocketImpl *pSock = pBatch->m_pSock;
+			if ( !pSock || !pSock->m_callback.m_fnCallback )
+				break;
+			if ( s_nLowLevelSupportRefCount.load(std::memory_order_acquire) <= 0 )
+			{
+				bShutdown = true;
+				break;
+			}
+
+			// Already taken care of by the worker?
+			if ( pBatch->m_preDecrypted[i].m_bProcessed )
+				continue;
+
+			GameNetworkingMicroseconds usecKernelRecv = 0;
+			#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_TIMESTAMPS
+				usecKernelRecv = kernelRecvTimestamps.Convert( pBatch->m_tsKernelRecv[i] );
+			#endif
+			ProcessRawUDPPacket( pSock, pBatch->m_buf + i*k_cbRawUDPRecvSlot, pBatch->m_cbPkt[i], pBatch->m_from[i], &pBatch->m_preDecrypted[i], usecNow, usecKernelRecv );
+		}
+	}
+
+	// Recycle the buffers
+	s_lockRecvWorkerBatches.lock();
+	s_vecRecvWorkerBatchesFree.insert( s_vecRecvWorkerBatchesFree.end(), s_vecRecvWorkerBatchesDispatching.begin(), s_vecRecvWorkerBatchesDispatching.end() );
+	s_lockRecvWorkerBatches.unlock();
+	s_vecRecvWorkerBatchesDispatching.clear();
+
+	return !bShutdown;
+}
+
+static bool StartRecvWorkerThreads( SteamDatagramErrMsg &errMsg )
+{
+	Assert( s_nRecvWorkers == 0 );
+	const int nWorkers = Clamp( g_Config_RecvWorkerThreads.Get(), 0, k_nSteamDatagramMaxRecvWorkerThreads );
+	s_bStopRecvWorkers = false;
+	s_idxNextRecvWorker = 0;
+	for ( int i = 0 ; i < nWorkers ; ++i )
+	{
+		RecvWorker &w = s_arRecvWorkers[ i ];
+		int sock[2];
+		if ( socketpair( AF_LOCAL, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0, sock ) != 0 )
+		{
+			V_sprintf_safe( errMsg, "socketpair() call failed.  Error code 0x%08x.", GetLastSocketError() );
+			return false;
+		}
+		w.m_hSockWakeRead = sock[0];
+		w.m_hSockWakeWrite = sock[1];
+		w.m_nGeneration = 0;
+		w.m_pThread = new std::thread( RecvWorkerThreadProc, &w );
+		s_nRecvWorkers = i+1;
+	}
+	if ( nWorkers > 0 )
+		SpewMsg( "Started %d receive worker threads.\n", nWorkers );
+	return true;
+}
+
+static void StopRecvWorkerThreads()
+{
+	s_bStopRecvWorkers = true;
+	for ( int i = 0 ; i < s_nRecvWorkers ; ++i )
+	{
+		RecvWorker &w = s_arRecvWorkers[ i ];
+		w.Wake();
+		w.m_pThread->join();
+		delete w.m_pThread;
+		w.m_pThread = nullptr;
+		closesocket( w.m_hSockWakeRead );
+		closesocket( w.m_hSockWakeWrite );
+		w.m_hSockWakeRead = w.m_hSockWakeWrite = INVALID_SOCKET;
+		Assert( w.m_vecSockets.empty() );
+		w.m_vecSockets.clear();
+	}
+	s_nRecvWorkers = 0;
+
+	s_lockRecvWorkerBatches.lock();
+	for ( RecvWorkerBatch *pBatch: s_vecRecvWorkerBatchesReady )
+		delete pBatch;
+	s_vecRecvWorkerBatchesReady.clear();
+	for ( RecvWorkerBatch *pBatch: s_vecRecvWorkerBatchesFree )
+		delete pBatch;
+	s_vecRecvWorkerBatchesFree.clear();
+	s_nRecvWorkerBatchesAllocated = 0;
+	s_lockRecvWorkerBatches.unlock();
+}
+
+#endif // #ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_WORKERS
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Crypto worker threads.  See k_EGameNetworkingConfig_HandshakeCryptoThreads
+//
+/////////////////////////////////////////////////////////////////////////////
+
+ICryptoWorkerJob::~ICryptoWorkerJob() {}
+
+static std::vector<std::thread *> s_vecCryptoWorkerThreads;
+
+/// Jobs waiting for a worker, and jobs that are done and waiting
+/// for the service thread.
+static std::mutex s_mutexCryptoWorkerJobs;
+static std::condition_variable s_condCryptoWorkerJobs;
+static std::deque<ICryptoWorkerJob *> s_queueCryptoWorkerJobsPending;
+static std::vector<ICryptoWorkerJob *> s_vecCryptoWorkerJobsDone;
+static bool s_bStopCryptoWorkers;
+
+/// Jobs the service thread is in the middle of finishing, and the total
+/// number of jobs in flight.  Protected by the global lock.
+static std::vector<ICryptoWorkerJob *> s_vecCryptoWorkerJobsFinishing;
+static int s_nCryptoWorkerJobsInFlight;
+
+static void CryptoWorkerThreadProc()
+{
+	std::unique_lock<std::mutex> lock( s_mutexCryptoWorkerJobs );
+	for (;;)
+	{
+		while ( !s_bStopCryptoWorkers && s_queueCryptoWorkerJobsPending.empty() )
+			s_condCryptoWorkerJobs.wait( lock );
+
+		// When stopping, keep going until the queue is drained, so
+		// that every job gets handed back to its owner
+		if ( s_queueCryptoWorkerJobsPending.empty() )
+			break;
+
+		ICryptoWorkerJob *pJob = s_queueCryptoWorkerJobsPending.front();
+		s_queueCryptoWorkerJobsPending.pop_front();
+		lock.unlock();
+
+		pJob->RunInWorkerThread();
+
+		// Hand it back.  Only need to wake the service thread if the
+		// list was empty.  Otherwise, it already has a wake request.
+		lock.lock();
+		const bool bWake = s_vecCryptoWorkerJobsDone.empty();
+		s_vecCryptoWorkerJobsDone.push_back( pJob );
+		if ( bWake )
+		{
+			lock.unlock();
+			WakeSteamDatagramThread();
+			lock.lock();
+		}
+	}
+}
+
+bool CryptoWorkers_BActive()
+{
+	return !s_vecCryptoWorkerThreads.empty();
+}
+
+bool CryptoWorkers_BQueueJob( ICryptoWorkerJob *pJob )
+{
+	GameNetworkingGlobalLock::AssertHeldByCurrentThread();
+	if ( s_vecCryptoWorkerThreads.empty() || s_nCryptoWorkerJobsInFlight >= k_nMaxCryptoWorkerJobs )
+		return false;
+	++s_nCryptoWorkerJobsInFlight;
+
+	s_mutexCryptoWorkerJobs.lock();
+	s_queueCryptoWorkerJobsPending.push_back( pJob );
+	s_mutexCryptoWorkerJobs.unlock();
+	s_condCryptoWorkerJobs.notify_one();
+	return true;
+}
+
+bool CryptoWorkers_BCancelJob( ICryptoWorkerJob *pJob )
+{
+	GameNetworkingGlobalLock::AssertHeldByCurrentThread();
+	std::lock_guard<std::mutex> lock( s_mutexCryptoWorkerJobs );
+	auto it = std::find( s_queueCryptoWorkerJobsPending.begin(), s_queueCryptoWorkerJobsPending.end(), pJob );
+	if ( it == s_queueCryptoWorkerJobsPending.end() )
+		return false;
+	s_queueCryptoWorkerJobsPending.erase( it );
+	Assert( s_nCryptoWorkerJobsInFlight > 0 );
+	--s_nCryptoWorkerJobsInFlight;
+	return true;
+}
+
+/// Called by the service thread to finish jobs that the workers are done with
+static void FinishCryptoWorkerJobs()
+{
+	GameNetworkingGlobalLock::AssertHeldByCurrentThread();
+	if ( s_nCryptoWorkerJobsInFlight == 0 )
+		return;
+	Assert( s_vecCryptoWorkerJobsFinishing.empty() );
+
+	s_mutexCryptoWorkerJobs.lock();
+	s_vecCryptoWorkerJobsFinishing.swap( s_vecCryptoWorkerJobsDone );
+	s_mutexCryptoWorkerJobs.unlock();
+
+	for ( ICryptoWorkerJob *pJob: s_vecCryptoWorkerJobsFinishing )
+	{
+		Assert( s_nCryptoWorkerJobsInFlight > 0 );
+		--s_nCryptoWorkerJobsInFlight;
+		pJob->FinishInServiceThread();
+	}
+	s_vecCryptoWorkerJobsFinishing.clear();
+}
+
+static void StartCryptoWorkerThreads()
+{
+	Assert( s_vecCryptoWorkerThreads.empty() );
+	const int nWorkers = Clamp( g_Config_HandshakeCryptoThreads.Get(), 0, k_nSteamDatagramMaxCryptoWorkerThreads );
+	s_bStopCryptoWorkers = false;
+	s_nCryptoWorkerJobsInFlight = 0;
+	for ( int i = 0 ; i < nWorkers ; ++i )
+		s_vecCryptoWorkerThreads.push_back( new std::thread( CryptoWorkerThreadProc ) );
+	if ( nWorkers > 0 )
+		SpewMsg( "Started %d crypto worker threads.\n", nWorkers );
+}
+
+static void StopCryptoWorkerThreads()
+{
+	s_mutexCryptoWorkerJobs.lock();
+	s_bStopCryptoWorkers = true;
+	s_mutexCryptoWorkerJobs.unlock();
+	s_condCryptoWorkerJobs.notify_all();
+	for ( std::thread *pThread: s_vecCryptoWorkerThreads )
+	{
+		pThread->join();
+		delete pThread;
+	}
+	s_vecCryptoWorkerThreads.clear();
+
+	// The workers drained the queue before exiting.  Hand everything back
+	// to the owners, rather than deleting jobs they might still reference.
+	// (E.g. we're being shut down from atexit with listen sockets still open.)
+	Assert( s_queueCryptoWorkerJobsPending.empty() );
+	FinishCryptoWorkerJobs();
+	Assert( s_vecCryptoWorkerJobsDone.empty() );
+	Assert( s_nCryptoWorkerJobsInFlight == 0 );
+	s_nCryptoWorkerJobsInFlight = 0;
+}
+
+/// Poll all of our sockets, and dispatch the packets received.
+/// This will return true if we own the lock, or false if we detected
+/// a shutdown request and bailed without re-squiring the lock.
+static bool PollRawUDPSockets( GameNetworkingMicroseconds usecMaxWait, bool bManualPoll )
+{
+	// This should only ever be called from our one thread proc,
+	// and we assume that it will have locked the lock exactly once.
+	AssertGlobalLockHeldExactlyOnce();
+
+	const int nRawSockets = s_vecRawSockets.Count();
+
+	#ifdef _WIN32
+		HANDLE *pEvents = (HANDLE*)alloca( sizeof(HANDLE) * (nRawSockets+1) );
+		int nEvents = 0;
+	#else
+		pollfd *pPollFDs = (pollfd*)alloca( sizeof(pollfd) * (nRawSockets+1) ); 
+		int nPollFDs = 0;
+	#endif
+
+	CRawUDPSocketImpl **pSocketsToPoll = (CRawUDPSocketImpl **)alloca( sizeof(CRawUDPSocketImpl *) * nRawSockets ); 
+	int nSocketsToPoll = 0;
+
+	for ( int i = 0 ; i < nRawSockets ; ++i )
+	{
+		CRawUDPSocketImpl *pSock = s_vecRawSockets[ i ];
+
+		// Should be totally valid at this point
+		Assert( pSock->m_callback.m_fnCallback );
+		Assert( pSock->m_socket != INVALID_SOCKET );
+
+		// Receive workers will read from it, we don't need to
+		#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_WORKERS
+			if ( pSock->m_bRecvWorkers )
+				continue;
+		#endif
+
+		pSocketsToPoll[ nSocketsToPoll++ ] = pSock;
+
+		#ifdef _WIN32
+			pEvents[ nEvents++ ] = pSock->m_event;
+		#else
+			pollfd *p = &pPollFDs[ nPollFDs++ ];
+			p->fd = pSock->m_socket;
+			p->events = POLLRDNORM;
+			p->revents = 0;
+		#endif
+	}
+
+	#if defined( _WIN32 )
+		Assert( s_hEventWakeThread != NULL && s_hEventWakeThread != INVALID_HANDLE_VALUE );
+		pEvents[ nEvents++ ] = s_hEventWakeThread;
+	#elif defined( NN_NINTENDO_SDK )
+		Assert( s_hEventWakeThread != INVALID_SOCKET );
+		pollfd *p = &pPollFDs[ nPollFDs++ ];
+		p->fd = s_hEventWakeThread;
+		p->events = POLLRDNORM;
+		p->revents = 0;
+	#else
+		Assert( s_hSockWakeThreadRead != INVALID_SOCKET );
+		pollfd *p = &pPollFDs[ nPollFDs++ ];
+		p->fd = s_hSockWakeThreadRead;
+		p->events = POLLRDNORM;
+		p->revents = 0;
+	#endif
+
+	// Release lock while we're asleep
+	GameNetworkingGlobalLock::Unlock();
+
+	// Shutdown request?
+	if ( s_nLowLevelSupportRefCount.load(std::memory_order_acquire) <= 0 || s_bManualPollMode != bManualPoll )
+		return false; // ABORT THREAD
+
+	// Wait for data on one of the sockets, or for us to be asked to wake up
+	#if defined( WIN32 )
+		DWORD nWaitResult = WaitForMultipleObjects( nEvents, pEvents, FALSE, DWORD( ( usecMaxWait + 999 ) / 1000 ) );
+	#elif defined( STEAMNETWORKINGSOCKETS_LOWLEVEL_PRECISE_WAIT )
+		timespec tsWait;
+		tsWait.tv_sec = time_t( usecMaxWait / k_nMillion );
+		tsWait.tv_nsec = long( usecMaxWait % k_nMillion ) * 1000;
+		ppoll( pPollFDs, nPollFDs, &tsWait, nullptr );
+	#else
+		poll( pPollFDs, nPollFDs, int( ( usecMaxWait + 999 ) / 1000 ) );
+	#endif
+
+	GameNetworkingMicroseconds usecStartedLocking = GameNetworkingSockets_GetLocalTimestamp();
+	UpdateFakeRateLimitTokenBuckets( usecStartedLocking );
+	for (;;)
+	{
+
+		// Shutdown request?  We've potentially been waiting a long time.
+		// Don't attempt to grab the lock again if we know we want to shutdown,
+		// that is just a waste of time.
+		if ( s_nLowLevelSupportRefCount.load(std::memory_order_acquire) <= 0 || s_bManualPollMode != bManualPoll )
+			return false;
+
+		// Try to acquire the lock.  But don't wait forever, in case the other thread has the lock
+		// and then makes a shutdown request while we're waiting on the lock here.
+		if ( GameNetworkingGlobalLock::TryLock( "ServiceThread", 250 ) )
+			break;
+
+		// The only time this really should happen is a relatively rare race condition
+		// where the main thread is trying to shut us down.  (Or while debugging.)
+		// However, note that try_lock_for is permitted to "fail" spuriously, returning
+		// false even if no other thread holds the lock.  (For performance reasons.)
+		// So we check how long we have actually been waiting.
+		GameNetworkingMicroseconds usecElapsed = GameNetworkingSockets_GetLocalTimestamp() - usecStartedLocking;
+		AssertMsg1( usecElapsed < 50*1000 || s_nLowLevelSupportRefCount.load(std::memory_order_acquire) <= 0 || s_bManualPollMode != bManualPoll || Plat_IsInDebugSession(), "SDR service thread gave up on lock after waiting %dms.  This directly adds to delay of processing of network packets!", int( usecElapsed/1000 ) );
+	}
+
+	// If we have spewed, flush to disk
+	FlushSpew();
+
+	// Until we release the lock, coalesce outbound datagrams
+	BeginQueuedRawUDPSends();
+
+	// Dispatch anything that was received by the worker threads
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_WORKERS
+		if ( !DispatchRecvWorkerBatches() )
+			return true; // current thread owns the lock
+	#endif
+
+	// Finish up any work that was done by the crypto workers
+	FinishCryptoWorkerJobs();
+
+	// Recv socket data from any sockets that might have data, and execute the callbacks.
+	char buf[ k_cbGameNetworkingSocketsMaxUDPMsgLen + 1024 ];
+#ifdef _WIN32
+	// Note that we assume we aren't polling a ton of sockets here.  We do at least skip ahead
+	// to the first socket with data, based on the return value of WaitForMultipleObjects.  But
+	// then we will check all sockets later in the array.
+	//
+	// Note that if we get a wake request, the event has already been reset, because we used an auto-reset event
+	for ( int idx = nWaitResult - WAIT_OBJECT_0 ; (unsigned)idx < (unsigned)nSocketsToPoll ; ++idx )
 	{
 
 		CRawUDPSocketImpl *pSock = pSocketsToPoll[ idx ];
@@ -1593,6 +3085,80 @@ static bool PollRawUDPSockets( int nMaxTimeoutMS, bool bManualPoll )
 			if ( s_nLowLevelSupportRefCount.load(std::memory_order_acquire) <= 0 )
 				return true; // current thread owns the lock
 
+			#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECVMMSG
+				// Use the batch path if requested.  Sockets with GRO enabled
+				// must use it, because coalesced reads won't fit in buf.  And
+				// it's the only way to get kernel receive timestamps
+				if ( g_nSteamDatagramRecvBatchSize > 1 || BRawUDPSocketNeedsRecvControl( pSock ) )
+				{
+					int nBatchSize = Clamp( g_nSteamDatagramRecvBatchSize, 1, k_nSteamDatagramMaxRecvBatchSize );
+					int nRecv = RecvRawUDPBatch( pSock, nBatchSize );
+
+					// Nothing more to read?  (See notes below about why we don't
+					// care about the exact error.)
+					if ( nRecv <= 0 )
+						break;
+
+					// One clock read for the whole batch
+					const GameNetworkingMicroseconds usecNow = GameNetworkingSockets_GetLocalTimestamp();
+					#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_TIMESTAMPS
+						CKernelRecvTimestampConverter kernelRecvTimestamps( usecNow );
+					#endif
+
+					for ( int i = 0 ; i < nRecv ; ++i )
+					{
+						// Socket closed or shutdown requested by the previous callback?
+						if ( !pSock->m_callback.m_fnCallback )
+							break;
+						if ( s_nLowLevelSupportRefCount.load(std::memory_order_acquire) <= 0 )
+							return true; // current thread owns the lock
+
+						char *pPkt = (char *)s_recvBatch.m_iov[i].iov_base;
+						const int cbMsg = (int)s_recvBatch.m_msgs[i].msg_len;
+						int cbSegment = cbMsg;
+						GameNetworkingMicroseconds usecKernelRecv = 0;
+
+						#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_CONTROL
+							if ( BRawUDPSocketNeedsRecvControl( pSock ) )
+							{
+								int cbGRO;
+								timespec tsKernelRecv;
+								ParseRawUDPRecvControl( s_recvBatch.m_msgs[i].msg_hdr, cbGRO, tsKernelRecv );
+
+								// Several datagrams coalesced together?  Then the kernel
+								// tells us the size of each one (except the last one,
+								// which may be smaller).  They all share one timestamp.
+								if ( cbGRO > 0 )
+									cbSegment = cbGRO;
+
+								#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_TIMESTAMPS
+									usecKernelRecv = kernelRecvTimestamps.Convert( tsKernelRecv );
+								#endif
+							}
+						#endif
+
+						for ( int ofs = 0 ; ofs < cbMsg ; ofs += cbSegment )
+						{
+							if ( ofs > 0 )
+							{
+								// Check again for socket closed or shutdown requested by a callback
+								if ( !pSock->m_callback.m_fnCallback )
+									break;
+								if ( s_nLowLevelSupportRefCount.load(std::memory_order_acquire) <= 0 )
+									return true; // current thread owns the lock
+							}
+							ProcessRawUDPPacket( pSock, pPkt + ofs, std::min( cbSegment, cbMsg - ofs ), s_recvBatch.m_from[i], nullptr, usecNow, usecKernelRecv );
+						}
+					}
+
+					// If the OS didn't fill up the whole batch, then the socket is
+					// drained.  Don't waste a system call just to find that out.
+					if ( nRecv < nBatchSize )
+						break;
+					continue;
+				}
+			#endif
+
 			#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_TIME_SOCKET_CALLS
 				GameNetworkingMicroseconds usecRecvFromStart = GameNetworkingSockets_GetLocalTimestamp();
 			#endif
@@ -1602,7 +3168,7 @@ static bool PollRawUDPSockets( int nMaxTimeoutMS, bool bManualPoll )
 			int ret = ::recvfrom( pSock->m_socket, buf, sizeof( buf ), 0, (sockaddr *)&from, &fromlen );
 
 			#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_TIME_SOCKET_CALLS
-				GameNetworkingMicroseconds usecRecvFromEnd = GameNetworkingSockets_GetLocalTimestamp(); // FIXME - If we add a timestamp to RecvPktInfo_t this will be free
+				const GameNetworkingMicroseconds usecRecvFromEnd = GameNetworkingSockets_GetLocalTimestamp();
 				if ( usecRecvFromEnd > s_usecIgnoreLongLockWaitTimeUntil )
 				{
 					GameNetworkingMicroseconds usecRecvFromElapsed = usecRecvFromEnd - usecRecvFromStart;
@@ -1630,93 +3196,11 @@ static bool PollRawUDPSockets( int nMaxTimeoutMS, bool bManualPoll )
 			if ( ret < 0 )
 				break;
 
-			// Add a tag.  If we end up holding the lock for a long time, this tag
-			// will tell us how many packets were processed
-			GameNetworkingGlobalLock::AssertHeldByCurrentThread( "RecvUDPPacket" );
-
-			// Check simulated global rate limit.  Make sure this is fast
-			// when the limit is not in use
-			if ( unlikely( g_Config_FakeRateLimit_Recv_Rate.Get() > 0 ) )
-			{
-
-				// Check if bucket already has tokens in it, which
-				// will be common.  If so, we can avoid reading the
-				// timer
-				if ( s_flFakeRateLimit_Recv_tokens <= 0.0f )
-				{
-
-					// Update bucket with tokens
-					// FIXME - We could probably avoid reading the timer here
-					// If we read it in the outer loop.  Which...we probably should do
-					// and add to the context struct, since almost every packet callback
-					// currently does it.
-					UpdateFakeRateLimitTokenBuckets( GameNetworkingSockets_GetLocalTimestamp() );
-
-					// Still empty?
-					if ( s_flFakeRateLimit_Recv_tokens <= 0.0f )
-						continue;
-				}
-
-				// Spend tokens
-				s_flFakeRateLimit_Recv_tokens -= ret;
-			}
-
-			// Check for simulating random packet loss
-			if ( RandomBoolWithOdds( g_Config_FakePacketLoss_Recv.Get() ) )
-				continue;
-
-			RecvPktInfo_t info;
-			info.m_adrFrom.SetFromSockadr( &from );
-
-			// If we're dual stack, convert mapped IPv4 back to ordinary IPv4
-			if ( pSock->m_nAddressFamilies == k_nAddressFamily_DualStack )
-				info.m_adrFrom.BConvertMappedToIPv4();
-
-			// Check for tracing
-			if ( g_Config_PacketTraceMaxBytes.Get() >= 0 )
-			{
-				iovec tmp;
-				tmp.iov_base = buf;
-				tmp.iov_len = ret;
-				pSock->TracePkt( false, info.m_adrFrom, 1, &tmp );
-			}
-
-			int32 nPacketFakeLagTotal = g_Config_FakePacketLag_Recv.Get();
-
-			// Check for simulating random packet reordering
-			if ( RandomBoolWithOdds( g_Config_FakePacketReorder_Recv.Get() ) )
-			{
-				nPacketFakeLagTotal += g_Config_FakePacketReorder_Time.Get();
-			}
-
-			// Check for simulating random packet duplication
-			if ( RandomBoolWithOdds( g_Config_FakePacketDup_Recv.Get() ) )
-			{
-				int32 nDupLag = nPacketFakeLagTotal + WeakRandomInt( 0, g_Config_FakePacketDup_TimeMax.Get() );
-				nDupLag = std::max( 1, nDupLag );
-				iovec temp;
-				temp.iov_len = ret;
-				temp.iov_base = buf;
-				s_packetLagQueue.LagPacket( false, pSock, info.m_adrFrom, nDupLag, 1, &temp );
-			}
-
-			// Check for simulating lag
-			if ( nPacketFakeLagTotal > 0 )
-			{
-				iovec temp;
-				temp.iov_len = ret;
-				temp.iov_base = buf;
-				s_packetLagQueue.LagPacket( false, pSock, info.m_adrFrom, nPacketFakeLagTotal, 1, &temp );
-			}
-			else
-			{
-				ETW_UDPRecvPacket( info.m_adrFrom, ret );
-
-				info.m_pPkt = buf;
-				info.m_cbPkt = ret;
-				info.m_pSock = pSock;
-				pSock->m_callback( info );
-			}
+			#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_TIME_SOCKET_CALLS
+				ProcessRawUDPPacket( pSock, buf, ret, from, nullptr, usecRecvFromEnd, 0 );
+			#else
+				ProcessRawUDPPacket( pSock, buf, ret, from, nullptr, GameNetworkingSockets_GetLocalTimestamp(), 0 );
+			#endif
 
 			#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_TIME_SOCKET_CALLS
 				GameNetworkingMicroseconds usecProcessPacketEnd = GameNetworkingSockets_GetLocalTimestamp();
@@ -1741,13 +3225,21 @@ void ProcessPendingDestroyClosedRawUDPSockets()
 {
 	GameNetworkingGlobalLock::AssertHeldByCurrentThread();
 
-	for ( CRawUDPSocketImpl *pSock: s_vecRawSocketsPendingDeletion )
+	for ( int i = s_vecRawSocketsPendingDeletion.Count()-1 ; i >= 0 ; --i )
 	{
+		CRawUDPSocketImpl *pSock = s_vecRawSocketsPendingDeletion[ i ];
 		Assert( pSock->m_callback.m_fnCallback == nullptr );
+
+		// A receive worker might still be reading from it.  If so,
+		// we'll get woken up when it's done.
+		#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_WORKERS
+			if ( pSock->m_bRecvWorkers && !BRecvWorkersDoneWithSocket( pSock ) )
+				continue;
+		#endif
+
+		s_vecRawSocketsPendingDeletion.FastRemove( i );
 		delete pSock;
 	}
-
-	s_vecRawSocketsPendingDeletion.RemoveAll();
 }
 
 static void ProcessDeferredOperations()
@@ -1783,12 +3275,13 @@ static bool GameNetworkingSockets_InternalPoll( int msWait, bool bManualPoll )
 	AssertGlobalLockHeldExactlyOnce();
 
 	// Figure out how long to sleep
+	GameNetworkingMicroseconds usecWait = msWait * 1000;
 	GameNetworkingMicroseconds usecNextWakeTime = IThinker::Thinker_GetNextScheduledThinkTime();
 	if ( usecNextWakeTime < k_nThinkTime_Never )
 	{
 
 		// Calc wait time to wake up as late as possible,
-		// rounded up to the nearest millisecond.
+		// rounded to the nearest millisecond, unless we can do better.
 		GameNetworkingMicroseconds usecNow = GameNetworkingSockets_GetLocalTimestamp();
 		int64 usecUntilNextThinkTime = usecNextWakeTime - usecNow;
 
@@ -1796,8 +3289,16 @@ static bool GameNetworkingSockets_InternalPoll( int msWait, bool bManualPoll )
 		{
 			// Earliest thinker in the queue is ready to go now.
 			// There is no point in going to sleep
-			msWait = 0;
+			usecWait = 0;
+		}
+		#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_PRECISE_WAIT
+		else if ( g_Config_SendPacingMaxBurst.Get() > 0 )
+		{
+			// We're pacing, and we have a precise timer.  Wake up right
+			// when we need to.
+			usecWait = std::min( usecWait, usecUntilNextThinkTime );
 		}
+		#endif
 		else
 		{
 
@@ -1805,8 +3306,8 @@ static bool GameNetworkingSockets_InternalPoll( int msWait, bool bManualPoll )
 			// only has 1ms precision, so we round to the nearest ms, so that we don't
 			// always wake up exactly 1ms early, go to sleep and wait for 1ms.
 			//
-			// NOTE: On linux, we have a precise timer and we could probably do better
-			// than this.  On windows, we could use an alertable timer, and presumably when
+			// NOTE: On linux, we have a precise timer, and we use it above when
+			// pacing.  On windows, we could use an alertable timer, and presumably when
 			// we set the we could use a high precision relative time, and Windows could do
 			// smart stuff.
 			int msTaskWait = ( usecUntilNextThinkTime + 500 ) / 1000;
@@ -1815,7 +3316,7 @@ static bool GameNetworkingSockets_InternalPoll( int msWait, bool bManualPoll )
 			msTaskWait = std::max( 1, msTaskWait );
 
 			// Limit to what the caller has requested
-			msWait = std::min( msWait, msTaskWait );
+			usecWait = std::min( usecWait, msTaskWait * (GameNetworkingMicroseconds)1000 );
 		}
 	}
 
@@ -1824,10 +3325,10 @@ static bool GameNetworkingSockets_InternalPoll( int msWait, bool bManualPoll )
 	// be explicitly waking the thread for good perf, we will notice
 	// the delay.  But not so long that a bug in some rare 
 	// shutdown race condition (or the like) will be catastrophic
-	msWait = std::min( msWait, k_msMaxPollWait );
+	usecWait = std::min( usecWait, k_msMaxPollWait * (GameNetworkingMicroseconds)1000 );
 
 	// Poll sockets
-	if ( !PollRawUDPSockets( msWait, bManualPoll ) )
+	if ( !PollRawUDPSockets( usecWait, bManualPoll ) )
 	{
 		// Shutdown request, and they did NOT re-acquire the lock
 		return false;
@@ -1838,6 +3339,7 @@ static bool GameNetworkingSockets_InternalPoll( int msWait, bool bManualPoll )
 	// Shutdown request?
 	if ( s_nLowLevelSupportRefCount.load(std::memory_order_acquire) <= 0 || s_bManualPollMode != bManualPoll )
 	{
+		FlushQueuedRawUDPSends();
 		GameNetworkingGlobalLock::Unlock();
 		return false; // Shutdown request, we have released the lock
 	}
@@ -1847,6 +3349,9 @@ static bool GameNetworkingSockets_InternalPoll( int msWait, bool bManualPoll )
 
 	// Check for various deferred operations
 	ProcessDeferredOperations();
+
+	// Send everything that was queued during this pass
+	FlushQueuedRawUDPSends();
 	return true;
 }
 
@@ -1919,6 +3424,12 @@ static void GameNetworkingThreadProc()
 		// totally straightforward the correct way to do this on Linux.
 	#endif
 
+	// The default timer slack (50us) is a big fraction of the time between
+	// packets when we are pacing at a high rate
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_PRECISE_WAIT
+		prctl( PR_SET_TIMERSLACK, 1UL, 0, 0, 0 );
+	#endif
+
 	// In the loop, we will always hold global lock while we're awake.
 	// So go ahead and acquire it now.  But watch out for a race condition
 	// where we want to shut down immediately after starting the thread
@@ -2022,7 +3533,7 @@ IBoundUDPSocket *OpenUDPSocketBoundToHost( const netadr_t &adrRemote, CRecvPacke
 
 	// Create a socket, bind it to the desired local address
 	CDedicatedBoundSocket *pTempContext = nullptr; // don't yet know the context
-	CRawUDPSocketImpl *pRawSock = OpenRawUDPSocketInternal( CRecvPacketCallback( DedicatedBoundSocketCallback, pTempContext ), errMsg, nullptr, &nAddressFamilies );
+	CRawUDPSocketImpl *pRawSock = OpenRawUDPSocketInternal( CRecvPacketCallback( DedicatedBoundSocketCallback, pTempContext ), errMsg, nullptr, &nAddressFamilies, false );
 	if ( !pRawSock )
 		return nullptr;
 
@@ -2045,11 +3556,11 @@ bool CreateBoundSocketPair( CRecvPacketCallback callback1, CRecvPacketCallback c
 	uint32 nLocalIP = 0x7f000001; // 127.0.0.1
 	CDedicatedBoundSocket *pTempContext = nullptr; // don't yet know the context
 	localAddr.SetIPv4( nLocalIP, 0 );
-	pRawSock[0] = OpenRawUDPSocketInternal( CRecvPacketCallback( DedicatedBoundSocketCallback, pTempContext ), errMsg, &localAddr, nullptr );
+	pRawSock[0] = OpenRawUDPSocketInternal( CRecvPacketCallback( DedicatedBoundSocketCallback, pTempContext ), errMsg, &localAddr, nullptr, false );
 	if ( !pRawSock[0] )
 		return false;
 	localAddr.SetIPv4( nLocalIP, 0 );
-	pRawSock[1] = OpenRawUDPSocketInternal( CRecvPacketCallback( DedicatedBoundSocketCallback, pTempContext ), errMsg, &localAddr, nullptr );
+	pRawSock[1] = OpenRawUDPSocketInternal( CRecvPacketCallback( DedicatedBoundSocketCallback, pTempContext ), errMsg, &localAddr, nullptr, false );
 	if ( !pRawSock[1] )
 	{
 		delete pRawSock[0];
@@ -2071,6 +3582,7 @@ bool CreateBoundSocketPair( CRecvPacketCallback callback1, CRecvPacketCallback c
 CSharedSocket::CSharedSocket()
 {
 	m_pRawSock = nullptr;
+	m_fnGetConnectionID = nullptr;
 }
 
 CSharedSocket::~CSharedSocket()
@@ -2080,6 +3592,27 @@ CSharedSocket::~CSharedSocket()
 
 void CSharedSocket::CallbackRecvPacket( const RecvPktInfo_t &info, CSharedSocket *pSock )
 {
+	// Fast path: locate the client by connection ID.  This is the common case
+	// for an established connection.  Make sure it's from who we expect,
+	// though.  If not, maybe their address changed, and we use the slow path.
+	if ( pSock->m_fnGetConnectionID )
+	{
+		uint32 unConnectionID = pSock->m_fnGetConnectionID( info.m_pPkt, info.m_cbPkt );
+		if ( unConnectionID )
+		{
+			int idx = pSock->m_mapRemoteHostsByConnectionID.Find( unConnectionID );
+			if ( idx != pSock->m_mapRemoteHostsByConnectionID.InvalidIndex() )
+			{
+				const RemoteHostByConnectionID_t &remoteHost = pSock->m_mapRemoteHostsByConnectionID[ idx ];
+				if ( remoteHost.m_adr == info.m_adrFrom )
+				{
+					remoteHost.m_callback( info );
+					return;
+				}
+			}
+		}
+	}
+
 	// Locate the client
 	int idx = pSock->m_mapRemoteHosts.Find( info.m_adrFrom );
 
@@ -2090,18 +3623,19 @@ void CSharedSocket::CallbackRecvPacket( const RecvPktInfo_t &info, CSharedSocket
 	callback( info );
 }
 
-bool CSharedSocket::BInit( const GameNetworkingIPAddr &localAddr, CRecvPacketCallback callbackDefault, SteamDatagramErrMsg &errMsg )
+bool CSharedSocket::BInit( const GameNetworkingIPAddr &localAddr, CRecvPacketCallback callbackDefault, SteamDatagramErrMsg &errMsg, FnGetPacketConnectionID fnGetConnectionID )
 {
 	GameNetworkingGlobalLock::AssertHeldByCurrentThread();
 
 	Kill();
 
 	GameNetworkingIPAddr bindAddr = localAddr;
-	m_pRawSock = OpenRawUDPSocket( CRecvPacketCallback( CallbackRecvPacket, this ), errMsg, &bindAddr, nullptr );
+	m_pRawSock = OpenRawUDPSocketInternal( CRecvPacketCallback( CallbackRecvPacket, this ), errMsg, &bindAddr, nullptr, true );
 	if ( m_pRawSock == nullptr )
 		return false;
 
 	m_callbackDefault = callbackDefault;
+	m_fnGetConnectionID = fnGetConnectionID;
 	return true;
 }
 
@@ -2110,6 +3644,7 @@ void CSharedSocket::Kill()
 	GameNetworkingGlobalLock::AssertHeldByCurrentThread();
 
 	m_callbackDefault.m_fnCallback = nullptr;
+	m_fnGetConnectionID = nullptr;
 	if ( m_pRawSock )
 	{
 		m_pRawSock->Close();
@@ -2125,7 +3660,10 @@ void CSharedSocket::CloseRemoteHostByIndex( int idx )
 {
 	GameNetworkingGlobalLock::AssertHeldByCurrentThread();
 
-	delete m_mapRemoteHosts[ idx ];
+	RemoteHost *pRemoteHost = m_mapRemoteHosts[ idx ];
+	if ( pRemoteHost->m_unConnectionID )
+		m_mapRemoteHostsByConnectionID.Remove( pRemoteHost->m_unConnectionID );
+	delete pRemoteHost;
 	m_mapRemoteHosts[idx] = nullptr; // just for grins
 	m_mapRemoteHosts.RemoveAt( idx );
 }
@@ -2147,6 +3685,33 @@ IBoundUDPSocket *CSharedSocket::AddRemoteHost( const netadr_t &adrRemote, CRecvP
 	return pRemoteHost;
 }
 
+void CSharedSocket::SetRemoteHostConnectionID( IBoundUDPSocket *pBoundSock, uint32 unConnectionID )
+{
+	GameNetworkingGlobalLock::AssertHeldByCurrentThread();
+
+	RemoteHost *pRemoteHost = static_cast<RemoteHost *>( pBoundSock );
+	Assert( pRemoteHost->m_pOwner == this );
+	if ( pRemoteHost->m_unConnectionID == unConnectionID )
+		return;
+
+	if ( pRemoteHost->m_unConnectionID )
+	{
+		m_mapRemoteHostsByConnectionID.Remove( pRemoteHost->m_unConnectionID );
+		pRemoteHost->m_unConnectionID = 0;
+	}
+	if ( unConnectionID == 0 )
+		return;
+	if ( m_mapRemoteHostsByConnectionID.HasElement( unConnectionID ) )
+	{
+		AssertMsg1( false, "Connection ID %u already in use on this shared socket!", unConnectionID );
+		return;
+	}
+	pRemoteHost->m_unConnectionID = unConnectionID;
+	RemoteHostByConnectionID_t &remoteHost = m_mapRemoteHostsByConnectionID[ m_mapRemoteHostsByConnectionID.Insert( unConnectionID ) ];
+	remoteHost.m_adr = pRemoteHost->GetRemoteHostAddr();
+	remoteHost.m_callback = pRemoteHost->m_callback;
+}
+
 void CSharedSocket::RemoteHost::Close()
 {
 	GameNetworkingGlobalLock::AssertHeldByCurrentThread();
@@ -2381,6 +3946,20 @@ bool BGameNetworkingSocketsLowLevelAddRef( SteamDatagramErrMsg &errMsg )
 			}
 		#endif
 
+		// Start receive workers, if requested
+		#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_WORKERS
+			if ( !StartRecvWorkerThreads( errMsg ) )
+			{
+				StopRecvWorkerThreads();
+				closesocket( s_hSockWakeThreadRead );
+				closesocket( s_hSockWakeThreadWrite );
+				s_hSockWakeThreadRead = s_hSockWakeThreadWrite = INVALID_SOCKET;
+				return false;
+			}
+		#endif
+
+		StartCryptoWorkerThreads();
+
 		SpewMsg( "Initialized low level socket/threading support.\n" );
 	}
 
@@ -2444,6 +4023,16 @@ void GameNetworkingSocketsLowLevelDecRef()
 	if ( s_pThreadSteamDatagram )
 		StopSteamDatagramThread();
 
+	// Stop receive workers
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_RECV_WORKERS
+		StopRecvWorkerThreads();
+	#endif
+	StopCryptoWorkerThreads();
+
+	// Our threads have returned their cached message blocks, so any
+	// slabs that are entirely free can go back to the system
+	MessagePool_Trim();
+
 	// Destory wake communication objects
 	#if defined( _WIN32 )
 		if ( s_hEventWakeThread != INVALID_HANDLE_VALUE )
@@ -2510,6 +4099,190 @@ void GameNetworkingSockets_SetDebugOutputFunction( EGameNetworkingSocketsDebugOu
 	GameNetworkingSocketsLib::InitSpew();
 }
 
+/////////////////////////////////////////////////////////////////////////////
+//
+// Raw clock
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_TSC_CLOCK
+
+// Mapping from TSC ticks to Plat_USTime() microseconds.  We keep two of
+// these so that we can switch to an updated mapping without a lock while
+// other threads are reading.  (A reader only uses a slot for a few
+// nanoseconds, and we switch about once a second.)
+struct TSCClockMapping
+{
+	uint64 m_nTSCBase;
+	uint64 m_usecBase;
+	double m_flUSecPerTick;
+	uint64 m_nTSCRecalibrate; // Update the mapping once the TSC passes this
+};
+static TSCClockMapping s_arTSCClockMapping[2];
+
+// Index of the current mapping, or one of these
+constexpr int k_nTSCClock_Uninitialized = -1;
+constexpr int k_nTSCClock_Unusable = -2;
+constexpr int k_nTSCClock_Calibrating = -3;
+static std::atomic<int> s_idxTSCClockMapping( k_nTSCClock_Uninitialized );
+
+// Only one thread at a time calibrates
+static std::atomic<bool> s_bTSCClockBusy;
+
+// Where we started measuring the TSC rate.  We always measure over the
+// longest baseline we have.
+static uint64 s_nTSCCalibrationAnchor;
+static uint64 s_usecTSCCalibrationAnchor;
+
+// How long to measure before we start using the TSC at all, and how
+// often we check the mapping against the OS clock after that
+constexpr uint64 k_usecTSCClockInitialCalibration = 100*1000;
+constexpr uint64 k_usecTSCClockRecalibrateInterval = 1000*1000;
+
+inline uint64 ReadTSC()
+{
+	// RDTSCP waits for earlier instructions, so we can't read the
+	// counter before the loads that precede the call
+	unsigned int nAux;
+	return __rdtscp( &nAux );
+}
+
+inline uint64 TSCClockMap( const TSCClockMapping &m, uint64 nTSC )
+{
+	// Another core might be a hair behind the one that set the base
+	int64 nTicks = int64( nTSC - m.m_nTSCBase );
+	if ( nTicks <= 0 )
+		return m.m_usecBase;
+	return m.m_usecBase + uint64( double( nTicks ) * m.m_flUSecPerTick );
+}
+
+static bool BTSCClockUsable()
+{
+	// CPU must have RDTSCP, and an invariant TSC (constant rate,
+	// keeps running in deep sleep states)
+	unsigned int eax, ebx, ecx, edx;
+	if ( !__get_cpuid( 0x80000001, &eax, &ebx, &ecx, &edx ) || !( edx & ( 1u << 27 ) ) )
+		return false;
+	if ( !__get_cpuid( 0x80000007, &eax, &ebx, &ecx, &edx ) || !( edx & ( 1u << 8 ) ) )
+		return false;
+
+	// And the kernel must be using it as its clocksource.  That rules out
+	// machines where the TSCs on different sockets are not in sync, VMs
+	// where the hypervisor doesn't make it stable, etc.
+	FILE *f = fopen( "/sys/devices/system/clocksource/clocksource0/current_clocksource", "rt" );
+	if ( !f )
+		return false;
+	char szClockSource[ 32 ];
+	bool bResult = fgets( szClockSource, sizeof(szClockSource), f ) && V_strcmp( szClockSource, "tsc\n" ) == 0;
+	fclose( f );
+	return bResult;
+}
+
+static uint64 TSCClockSlowPath()
+{
+
+	// Somebody else already working on it?  Just keep using the
+	// current mapping, or the OS clock if we don't have one yet.
+	if ( s_bTSCClockBusy.exchange( true, std::memory_order_acquire ) )
+	{
+		int idx = s_idxTSCClockMapping.load( std::memory_order_acquire );
+		if ( idx >= 0 )
+			return TSCClockMap( s_arTSCClockMapping[ idx ], ReadTSC() );
+		return Plat_USTime();
+	}
+
+	int idx = s_idxTSCClockMapping.load( std::memory_order_acquire );
+	uint64 nTSC = ReadTSC();
+	uint64 usecNow = Plat_USTime();
+	uint64 usecResult = usecNow;
+	if ( idx == k_nTSCClock_Uninitialized )
+	{
+		if ( BTSCClockUsable() )
+		{
+			s_nTSCCalibrationAnchor = nTSC;
+			s_usecTSCCalibrationAnchor = usecNow;
+			s_idxTSCClockMapping.store( k_nTSCClock_Calibrating, std::memory_order_release );
+		}
+		else
+		{
+			s_idxTSCClockMapping.store( k_nTSCClock_Unusable, std::memory_order_release );
+		}
+	}
+	else if ( idx >= 0 || usecNow - s_usecTSCCalibrationAnchor >= k_usecTSCClockInitialCalibration )
+	{
+		TSCClockMapping &m = s_arTSCClockMapping[ idx == 0 ? 1 : 0 ];
+		if ( nTSC <= s_nTSCCalibrationAnchor )
+		{
+			// TSC went backwards?  It's not what we thought it was
+			AssertMsg( false, "TSC went backwards.  Using OS clock" );
+			s_idxTSCClockMapping.store( k_nTSCClock_Unusable, std::memory_order_release );
+			s_bTSCClockBusy.store( false, std::memory_order_release );
+			return usecNow;
+		}
+		double flUSecPerTick = double( usecNow - s_usecTSCCalibrationAnchor ) / double( nTSC - s_nTSCCalibrationAnchor );
+
+		if ( idx < 0 )
+		{
+			// First mapping.  Start exactly on the OS clock, which
+			// is what everybody has been using up until now
+			m.m_nTSCBase = nTSC;
+			m.m_usecBase = usecNow;
+			m.m_flUSecPerTick = flUSecPerTick;
+		}
+		else
+		{
+			// Pick up exactly where the current mapping is right now, so
+			// time never jumps, and slew the rate so that we converge with
+			// the OS clock over the next interval.  Don't slew by more than
+			// a few percent.
+			uint64 usecMapped = TSCClockMap( s_arTSCClockMapping[ idx ], nTSC );
+			int64 usecError = int64( usecNow - usecMapped );
+			if ( usecError > (int64)k_usecTSCClockRecalibrateInterval || usecError < -(int64)k_usecTSCClockRecalibrateInterval )
+			{
+				// Way off.  (Suspend/resume?)  Start measuring the rate over again
+				s_nTSCCalibrationAnchor = nTSC;
+				s_usecTSCCalibrationAnchor = usecNow;
+			}
+			usecError = Clamp( usecError, -(int64)k_usecTSCClockRecalibrateInterval/20, (int64)k_usecTSCClockRecalibrateInterval/20 );
+			m.m_nTSCBase = nTSC;
+			m.m_usecBase = usecMapped;
+			m.m_flUSecPerTick = flUSecPerTick * double( (int64)k_usecTSCClockRecalibrateInterval + usecError ) / double( k_usecTSCClockRecalibrateInterval );
+			usecResult = usecMapped;
+		}
+		m.m_nTSCRecalibrate = nTSC + uint64( k_usecTSCClockRecalibrateInterval / flUSecPerTick );
+		s_idxTSCClockMapping.store( int( &m - s_arTSCClockMapping ), std::memory_order_release );
+	}
+
+	s_bTSCClockBusy.store( false, std::memory_order_release );
+	return usecResult;
+}
+
+#endif // #ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_TSC_CLOCK
+
+/// Read the raw clock, in microseconds.  Same timeline as Plat_USTime(),
+/// but where possible we read the CPU timestamp counter ourselves, without
+/// calling into the OS.
+static inline uint64 GetRawTimestampUSec()
+{
+	#ifdef STEAMNETWORKINGSOCKETS_LOWLEVEL_TSC_CLOCK
+		int idx = s_idxTSCClockMapping.load( std::memory_order_acquire );
+		if ( likely( idx >= 0 ) )
+		{
+			const TSCClockMapping &m = s_arTSCClockMapping[ idx ];
+			uint64 nTSC = ReadTSC();
+			if ( likely( nTSC < m.m_nTSCRecalibrate ) )
+				return TSCClockMap( m, nTSC );
+		}
+		else if ( idx == k_nTSCClock_Unusable )
+		{
+			return Plat_USTime();
+		}
+		return TSCClockSlowPath();
+	#else
+		return Plat_USTime();
+	#endif
+}
+
 GameNetworkingMicroseconds GameNetworkingSockets_GetLocalTimestamp()
 {
 	GameNetworkingMicroseconds usecResult;
@@ -2521,7 +4294,7 @@ GameNetworkingMicroseconds GameNetworkingSockets_GetLocalTimestamp()
 		long long usecOffset = GameNetworkingSocketsLib::s_usecTimeOffset;
 
 		// Read raw timer
-		uint64 usecRaw = Plat_USTime();
+		uint64 usecRaw = GetRawTimestampUSec();
 
 		// Add offset to get value in "GameNetworkingMicroseconds" time
 		usecResult = usecRaw + usecOffset;
@@ -2558,8 +4331,10 @@ GameNetworkingMicroseconds GameNetworkingSockets_GetLocalTimestamp()
 	}
 
 	// Save the last value returned.  Unless another thread snuck in there while we were busy.
-	// If so, that's OK.
-	GameNetworkingSocketsLib::s_usecTimeLastReturned.compare_exchange_strong( usecLastReturned, usecResult );
+	// If so, that's OK.  We only need this to detect big jumps, so don't touch
+	// the shared cache line unless it has moved a bit.
+	if ( usecResult - usecLastReturned >= 1000 )
+		GameNetworkingSocketsLib::s_usecTimeLastReturned.compare_exchange_strong( usecLastReturned, usecResult );
 
 	return usecResult;
 }
@@ -41,6 +41,18 @@ class IRawUDPSocket;
 //
 /////////////////////////////////////////////////////////////////////////////
 
+/// Work done on an incoming data packet by a receive worker thread, before
+/// it was handed to the service thread.  The plaintext is only valid for
+/// the connection and packet number it was decrypted for.
+struct RecvPktPreDecrypted_t
+{
+	bool m_bProcessed; // The worker took care of the whole packet.  The service thread should ignore it
+	uint32 m_unConnectionID; // 0 if we didn't (or couldn't) decrypt it
+	int64 m_nPktNum;
+	int m_cbPlainText;
+	uint8 m_plainText[ k_cbGameNetworkingSocketsMaxPlaintextPayloadRecv ];
+};
+
 /// Info about an incoming packet passed to the CRecvPacketCallback
 struct RecvPktInfo_t
 {
@@ -48,8 +60,22 @@ struct RecvPktInfo_t
 	int m_cbPkt;
 	netadr_t m_adrFrom;
 	IRawUDPSocket *m_pSock;
+	const RecvPktPreDecrypted_t *m_pPreDecrypted; // Work already done by a receive worker thread, if any
+	GameNetworkingMicroseconds m_usecNow; // Local time when the service thread pulled the packet off the socket.  Read once per system call or batch, so callbacks don't each need to read the clock
+	GameNetworkingMicroseconds m_usecKernelRecv; // Local time when the packet arrived at the host, according to the kernel, or 0 if not known.  Always <= m_usecNow
 };
 
+/// Called by receive worker threads for each batch of datagrams, WITHOUT
+/// the global lock.  Does any work that can be done in parallel.  Data
+/// packets are decrypted and, if bProcess is set and nothing about the
+/// packet needs the global lock, processed completely, holding only the
+/// lock of the connection.  Must never block on a lock.
+extern void ProcessRecvPacketsOnWorkerThread( IRawUDPSocket *pSock, int nPkts, const void *const *ppPkt, const int *pcbPkt, const netadr_t *pAdrFrom, const GameNetworkingMicroseconds *pusecKernelRecv, GameNetworkingMicroseconds usecNow, bool bProcess, RecvPktPreDecrypted_t *pOut );
+
+/// Return the recipient's connection ID from the header of a UDP data packet,
+/// or 0 if it isn't a data packet.  (See CSharedSocket::BInit)
+extern uint32 GetUDPDataPacketToConnectionID( const void *pPkt, int cbPkt );
+
 /// Store the callback and its context together
 class CRecvPacketCallback
 {
@@ -206,9 +232,17 @@ public:
 	CSharedSocket();
 	~CSharedSocket();
 
+	/// Returns the connection ID a packet is addressed to, or 0 if it doesn't have one
+	typedef uint32 (*FnGetPacketConnectionID)( const void *pPkt, int cbPkt );
+
 	/// Allocate a raw socket and setup bookkeeping structures so we can add
 	/// clients that will talk using it.
-	bool BInit( const GameNetworkingIPAddr &localAddr, CRecvPacketCallback callbackDefault, SteamDatagramErrMsg &errMsg );
+	///
+	/// If fnGetConnectionID is specified, packets are routed by connection ID
+	/// when possible, rather than by address.  The ID is much cheaper to hash
+	/// than the address.  We still check that the packet came from the
+	/// address we expect, and fall back to the address lookup if it didn't.
+	bool BInit( const GameNetworkingIPAddr &localAddr, CRecvPacketCallback callbackDefault, SteamDatagramErrMsg &errMsg, FnGetPacketConnectionID fnGetConnectionID = nullptr );
 
 	/// Close all sockets and clean up all resources
 	void Kill();
@@ -217,6 +251,11 @@ public:
 	/// are done.
 	IBoundUDPSocket *AddRemoteHost( const netadr_t &adrRemote, CRecvPacketCallback callback );
 
+	/// Set the connection ID that packets for a remote host will be addressed
+	/// to, so they can be routed by connection ID.  (Only useful if we were
+	/// initialized with a fnGetConnectionID.)
+	void SetRemoteHostConnectionID( IBoundUDPSocket *pRemoteHost, uint32 unConnectionID );
+
 	/// Send a packet to a remove host.  It doesn't matter if the remote host
 	/// is in the client table a client already or not.
 	bool BSendRawPacket( const void *pPkt, int cbPkt, const netadr_t &adrTo ) const
@@ -234,11 +273,18 @@ public:
 		return &m_pRawSock->m_boundAddr;
 	}
 
+	/// Invoke the callback for the remote host that sent a packet, or the
+	/// default callback if we don't know them.  This is our raw socket callback.
+	static void CallbackRecvPacket( const RecvPktInfo_t &info, CSharedSocket *pSock );
+
 private:
 
 	/// Call this if we get a packet from somebody we don't recognize
 	CRecvPacketCallback m_callbackDefault;
 
+	/// Get the connection ID from a packet, if we are routing by connection ID
+	FnGetPacketConnectionID m_fnGetConnectionID;
+
 	/// The raw socket that is being shared
 	IRawUDPSocket *m_pRawSock;
 
@@ -252,6 +298,7 @@ private:
 		inline RemoteHost( IRawUDPSocket *pRawSock, const netadr_t &adr ) : IBoundUDPSocket( pRawSock, adr ) {}
 		CRecvPacketCallback m_callback;
 		CSharedSocket *m_pOwner;
+		uint32 m_unConnectionID = 0;
 		virtual void Close() OVERRIDE;
 	};
 	friend class RemoteHost;
@@ -266,9 +313,18 @@ private:
 	/// anyway.
 	CUtlHashMap<netadr_t, RemoteHost *, std::equal_to<netadr_t>, netadr_t::Hash > m_mapRemoteHosts;
 
-	void CloseRemoteHostByIndex( int idx );
+	/// Remote hosts that have a connection ID.  Connection IDs are
+	/// unpredictable, so they are already a good hash.  We keep a copy
+	/// of what we need to route the packet right in the map, so the
+	/// fast path touches as little memory as possible.
+	struct RemoteHostByConnectionID_t
+	{
+		netadr_t m_adr;
+		CRecvPacketCallback m_callback;
+	};
+	CUtlHashMap<uint32, RemoteHostByConnectionID_t, std::equal_to<uint32>, Identity<uint32> > m_mapRemoteHostsByConnectionID;
 
-	static void CallbackRecvPacket( const RecvPktInfo_t &info, CSharedSocket *pSock );
+	void CloseRemoteHostByIndex( int idx );
 };
 
 /////////////////////////////////////////////////////////////////////////////
@@ -281,6 +337,28 @@ private:
 /// This is when: 1.) We own the lock and 2.) we aren't polling in the service thread.
 extern void ProcessPendingDestroyClosedRawUDPSockets();
 
+/// Requested OS send/recv buffer size for the raw sockets we open
+extern int g_nSteamDatagramSocketBufferSize;
+
+/// Max number of datagrams we will pull off of a socket with a single
+/// system call, on platforms that support it (recvmmsg).  Set to 1 to
+/// receive one datagram at a time.
+const int k_nSteamDatagramMaxRecvBatchSize = 32;
+extern int g_nSteamDatagramRecvBatchSize;
+
+/// While the service thread is processing a pass (receiving packets and
+/// running thinkers), outbound datagrams are queued and then flushed with
+/// a single system call (sendmmsg) at the end of the pass, or once this
+/// many are pending.  Set to 1 to send each datagram immediately.
+const int k_nSteamDatagramMaxSendBatchSize = 64;
+extern int g_nSteamDatagramSendBatchSize;
+
+/// Max value for k_EGameNetworkingConfig_RecvWorkerThreads
+const int k_nSteamDatagramMaxRecvWorkerThreads = 16;
+
+/// Max value for k_EGameNetworkingConfig_HandshakeCryptoThreads
+const int k_nSteamDatagramMaxCryptoWorkerThreads = 16;
+
 /// Last time that we spewed something that was subject to rate limit 
 extern GameNetworkingMicroseconds g_usecLastRateLimitSpew;
 extern int g_nRateLimitSpewCount;
@@ -550,6 +628,45 @@ extern void GameNetworkingSocketsLowLevelValidate( CValidator &validator );
 /// but is safe to call from the service thread as well.
 extern void WakeSteamDatagramThread();
 
+/// Expensive work (mostly public key crypto during the handshake) that we
+/// want to do without holding the global lock, so that it doesn't delay
+/// processing of packets for connections that are already established.
+/// See k_EGameNetworkingConfig_HandshakeCryptoThreads
+class ICryptoWorkerJob
+{
+public:
+	virtual ~ICryptoWorkerJob();
+
+	/// Called from a worker thread, with no locks held.  Only touch data
+	/// that is owned by the job!
+	virtual void RunInWorkerThread() = 0;
+
+	/// Called from the service thread, with the global lock held, once the
+	/// work is done.  You are responsible for deleting the job (now or later).
+	/// This is always called, unless the job is cancelled.  When the system is
+	/// shut down, the workers run any jobs still in the queue first.
+	virtual void FinishInServiceThread() = 0;
+};
+
+/// Return true if we have crypto worker threads
+extern bool CryptoWorkers_BActive();
+
+/// Hand off a job to the crypto worker threads.  Returns false if there are
+/// no workers, or if they are too far behind.  In that case, you still own
+/// the job, and should do the work inline or drop it.  The global lock
+/// must be held.
+extern bool CryptoWorkers_BQueueJob( ICryptoWorkerJob *pJob );
+
+/// Remove a job from the queue, if a worker hasn't started it yet.  If this
+/// returns true, you own the job again.  Otherwise, the job is running or
+/// done, and FinishInServiceThread will still be called.  The global lock
+/// must be held.
+extern bool CryptoWorkers_BCancelJob( ICryptoWorkerJob *pJob );
+
+/// Max number of jobs that can be in flight at once (queued, running, or
+/// waiting to be finished.)
+const int k_nMaxCryptoWorkerJobs = 64;
+
 /// Class used to take some action while we have the global thread locked,
 /// perhaps later and in another thread if necessary.  Intended to be used
 /// from callbacks and other contexts where we don't know what thread we are
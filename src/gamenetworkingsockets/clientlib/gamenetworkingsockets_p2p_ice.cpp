@@ -343,7 +343,7 @@ void CConnectionTransportP2PICE::ProcessPacket( const uint8_t *pPkt, int cbPkt,
 	// Data packet is the most common, check for it first.  Also, does stat tracking.
 	if ( *pPkt & 0x80 )
 	{
-		Received_Data( pPkt, cbPkt, usecNow );
+		Received_Data( pPkt, cbPkt, nullptr, usecNow, 0 );
 		return;
 	}
 
@@ -61,19 +61,326 @@ inline GameNetworkingMicroseconds GetUsecPingWithFallback( CGameNetworkConnectio
 }
 
 
-void SSNPSenderState::Shutdown()
+//-----------------------------------------------------------------------------
+void SNPInFlightPacketTable::Insert( int64 nPktNum, SNPInFlightPacket_t &&pkt )
+{
+	Assert( nPktNum >= m_nPktNumEnd );
+	if ( m_nCount == 0 )
+		m_nPktNumBegin = nPktNum;
+
+	// Need to grow?
+	int64 nSlotsNeeded = nPktNum - m_nPktNumBegin + 1;
+	if ( nSlotsNeeded > len( m_vecSlots ) )
+	{
+		int nNewSlots = std::max( 16, len( m_vecSlots ) );
+		while ( nNewSlots < nSlotsNeeded )
+			nNewSlots *= 2;
+
+		std_vector<Slot> vecNewSlots( nNewSlots );
+		int64 nNewMask = nNewSlots-1;
+		for ( int64 n = m_nPktNumBegin ; n < m_nPktNumEnd ; ++n )
+		{
+			Slot &slot = m_vecSlots[ n & m_nMask ];
+			if ( slot.m_nPktNum != n )
+				continue;
+			Slot &newSlot = vecNewSlots[ n & nNewMask ];
+			newSlot.m_nPktNum = n;
+			newSlot.m_pkt = std::move( slot.m_pkt );
+		}
+		m_vecSlots.swap( vecNewSlots );
+		m_nMask = nNewMask;
+	}
+
+	// Any slots we skipped over already hold older packet numbers,
+	// so they are marked as free.
+	Slot &slot = m_vecSlots[ nPktNum & m_nMask ];
+	Assert( slot.m_nPktNum < m_nPktNumBegin );
+	slot.m_nPktNum = nPktNum;
+	slot.m_pkt = std::move( pkt );
+	m_nPktNumEnd = nPktNum+1;
+	++m_nCount;
+}
+
+void SNPInFlightPacketTable::Erase( int64 nPktNum )
+{
+	Slot &slot = m_vecSlots[ nPktNum & m_nMask ];
+	Assert( slot.m_nPktNum == nPktNum );
+	slot.m_nPktNum = -1;
+	slot.m_pkt.m_vecReliableSegments.clear();
+	--m_nCount;
+
+	// If we removed the head, advance it to the next packet
+	// we are still tracking
+	if ( m_nCount == 0 )
+	{
+		m_nPktNumBegin = m_nPktNumEnd;
+	}
+	else if ( nPktNum == m_nPktNumBegin )
+	{
+		do
+		{
+			++m_nPktNumBegin;
+			Assert( m_nPktNumBegin < m_nPktNumEnd );
+		} while ( m_vecSlots[ m_nPktNumBegin & m_nMask ].m_nPktNum != m_nPktNumBegin );
+	}
+}
+
+void SNPInFlightPacketTable::clear()
+{
+	m_vecSlots.clear();
+	m_nMask = -1;
+	m_nPktNumBegin = m_nPktNumEnd;
+	m_nCount = 0;
+}
+
+#if STEAMNETWORKINGSOCKETS_SNP_PARANOIA > 0
+void SNPInFlightPacketTable::DebugCheck() const
+{
+	Assert( m_nPktNumBegin <= m_nPktNumEnd );
+	Assert( m_nPktNumEnd - m_nPktNumBegin <= len( m_vecSlots ) );
+	if ( m_nCount == 0 )
+	{
+		Assert( m_nPktNumBegin == m_nPktNumEnd );
+		return;
+	}
+	Assert( m_vecSlots[ m_nPktNumBegin & m_nMask ].m_nPktNum == m_nPktNumBegin );
+	int nCount = 0;
+	GameNetworkingMicroseconds prevWhenSent = 0;
+	for ( int64 n = m_nPktNumBegin ; n < m_nPktNumEnd ; ++n )
+	{
+		const Slot &slot = m_vecSlots[ n & m_nMask ];
+		if ( slot.m_nPktNum != n )
+		{
+			Assert( slot.m_nPktNum < m_nPktNumBegin );
+			continue;
+		}
+		Assert( prevWhenSent <= slot.m_pkt.m_usecWhenSent );
+		prevWhenSent = slot.m_pkt.m_usecWhenSent;
+		++nCount;
+	}
+	Assert( nCount == m_nCount );
+}
+#endif
+
+//-----------------------------------------------------------------------------
+int SNPReliableRangeList::LowerBound( int64 nBegin ) const
+{
+	int lo = m_idxHead;
+	int hi = len( m_vecEntries );
+
+	// Most common case is appending at the end
+	if ( lo == hi || m_vecEntries[ hi-1 ].m_range.m_nBegin < nBegin )
+		return hi;
+
+	while ( lo < hi )
+	{
+		int mid = ( lo + hi ) >> 1;
+		if ( m_vecEntries[ mid ].m_range.m_nBegin < nBegin )
+			lo = mid+1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+const SNPReliableRangeList::Entry *SNPReliableRangeList::Find( const SNPRange_t &range ) const
+{
+	int idx = LowerBound( range.m_nBegin );
+	if ( idx >= len( m_vecEntries ) || m_vecEntries[ idx ].m_range.m_nBegin != range.m_nBegin )
+		return nullptr;
+	AssertMsg( m_vecEntries[ idx ].m_range.m_nEnd == range.m_nEnd, "Ranges should not overlap in this list!" );
+	return &m_vecEntries[ idx ];
+}
+
+void SNPReliableRangeList::Insert( const SNPRange_t &range, CGameNetworkingMessage *pMsg )
+{
+	Assert( !HasOverlappingRange( range ) );
+	int idx = LowerBound( range.m_nBegin );
+
+	// If we're inserting before the head and have space there,
+	// just back up the head
+	if ( idx == m_idxHead && m_idxHead > 0 )
+	{
+		--m_idxHead;
+		Entry &e = m_vecEntries[ m_idxHead ];
+		e.m_range = range;
+		e.m_pMsg = pMsg;
+		return;
+	}
+
+	Entry e;
+	e.m_range = range;
+	e.m_pMsg = pMsg;
+	m_vecEntries.insert( m_vecEntries.begin() + idx, e );
+}
+
+bool SNPReliableRangeList::Erase( const SNPRange_t &range )
+{
+	int idx = LowerBound( range.m_nBegin );
+	if ( idx >= len( m_vecEntries ) || m_vecEntries[ idx ].m_range.m_nBegin != range.m_nBegin )
+		return false;
+	AssertMsg( m_vecEntries[ idx ].m_range.m_nEnd == range.m_nEnd, "Ranges should not overlap in this list!" );
+	if ( idx == m_idxHead )
+		pop_front();
+	else
+		m_vecEntries.erase( m_vecEntries.begin() + idx );
+	return true;
+}
+
+void SNPReliableRangeList::pop_front()
+{
+	Assert( !empty() );
+	++m_idxHead;
+
+	// Reclaim space at the front once it gets to be a significant
+	// portion of the list
+	if ( m_idxHead == len( m_vecEntries ) )
+	{
+		m_vecEntries.clear();
+		m_idxHead = 0;
+	}
+	else if ( m_idxHead >= 32 && m_idxHead*2 >= len( m_vecEntries ) )
+	{
+		m_vecEntries.erase( m_vecEntries.begin(), m_vecEntries.begin() + m_idxHead );
+		m_idxHead = 0;
+	}
+}
+
+bool SNPReliableRangeList::HasOverlappingRange( const SNPRange_t &range ) const
+{
+	int idx = LowerBound( range.m_nBegin );
+
+	// Next range starts before we end?
+	if ( idx < len( m_vecEntries ) && m_vecEntries[ idx ].m_range.m_nBegin < range.m_nEnd )
+		return true;
+
+	// Previous range ends after we start?
+	if ( idx > m_idxHead && m_vecEntries[ idx-1 ].m_range.m_nEnd > range.m_nBegin )
+		return true;
+
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+void SSNPSendLane::Shutdown()
 {
 	m_unackedReliableMessages.PurgeMessages();
 	m_messagesQueued.PurgeMessages();
-	m_mapInFlightPacketsByPktNum.clear();
 	m_listInFlightReliableRange.clear();
+	m_listReadyRetryReliableRange.clear();
+	m_cbCurrentSendMessageSent = 0;
+}
+
+//-----------------------------------------------------------------------------
+void SSNPSendLane::MoveFrom( SSNPSendLane &x )
+{
+	while ( CGameNetworkingMessage *pMsg = x.m_messagesQueued.pop_front() )
+		m_messagesQueued.push_back( pMsg );
+	while ( CGameNetworkingMessage *pMsg = x.m_unackedReliableMessages.pop_front() )
+		m_unackedReliableMessages.push_back( pMsg );
+	std::swap( m_listInFlightReliableRange, x.m_listInFlightReliableRange );
+	std::swap( m_listReadyRetryReliableRange, x.m_listReadyRetryReliableRange );
+	m_nReliableStreamPos = x.m_nReliableStreamPos;
+	m_nLastSendMsgNumReliable = x.m_nLastSendMsgNumReliable;
+	m_cbCurrentSendMessageSent = x.m_cbCurrentSendMessageSent;
+	m_nPriority = x.m_nPriority;
+	m_nWeight = x.m_nWeight;
+	m_nVirtTime = x.m_nVirtTime;
+}
+
+//-----------------------------------------------------------------------------
+void SSNPSenderState::Shutdown()
+{
+	for ( SSNPSendLane &lane: m_vecLanes )
+		lane.Shutdown();
+	m_inFlightPackets.clear();
 	m_cbPendingUnreliable = 0;
 	m_cbPendingReliable = 0;
 	m_cbSentUnackedReliable = 0;
 }
 
 //-----------------------------------------------------------------------------
-void SSNPSenderState::RemoveAckedReliableMessageFromUnackedList()
+void SSNPSenderState::ConfigureLanes( int nNumLanes, const int *pLanePriorities, const uint16 *pLaneWeights )
+{
+	Assert( nNumLanes >= len( m_vecLanes ) && nNumLanes <= k_nMaxLanes );
+
+	// Adding lanes?  The message lists are intrusive, so we need to move
+	// the contents of the existing lanes into the new array
+	if ( nNumLanes > len( m_vecLanes ) )
+	{
+		std_vector<SSNPSendLane> vecNewLanes( nNumLanes );
+		for ( int idxLane = 0 ; idxLane < len( m_vecLanes ) ; ++idxLane )
+			vecNewLanes[ idxLane ].MoveFrom( m_vecLanes[ idxLane ] );
+		m_vecLanes.swap( vecNewLanes );
+	}
+
+	for ( int idxLane = 0 ; idxLane < nNumLanes ; ++idxLane )
+	{
+		SSNPSendLane &lane = m_vecLanes[ idxLane ];
+		lane.m_nPriority = pLanePriorities ? pLanePriorities[ idxLane ] : 0;
+		lane.m_nWeight = pLaneWeights ? std::max( 1, (int)pLaneWeights[ idxLane ] ) : 1;
+	}
+}
+
+//-----------------------------------------------------------------------------
+GameNetworkingMicroseconds SSNPSenderState::UsecNagleNextMessage() const
+{
+	GameNetworkingMicroseconds usecResult = k_nThinkTime_Never;
+	for ( const SSNPSendLane &lane: m_vecLanes )
+	{
+		if ( !lane.m_messagesQueued.empty() )
+			usecResult = std::min( usecResult, lane.m_messagesQueued.m_pFirst->SNPSend_UsecNagle() );
+	}
+	return usecResult;
+}
+
+//-----------------------------------------------------------------------------
+int SSNPSenderState::PickLaneToRetry() const
+{
+	int idxResult = -1;
+	for ( int idxLane = 0 ; idxLane < len( m_vecLanes ) ; ++idxLane )
+	{
+		const SSNPSendLane &lane = m_vecLanes[ idxLane ];
+		if ( lane.m_listReadyRetryReliableRange.empty() )
+			continue;
+		if ( idxResult < 0 || lane.m_nPriority < m_vecLanes[ idxResult ].m_nPriority )
+			idxResult = idxLane;
+	}
+	return idxResult;
+}
+
+//-----------------------------------------------------------------------------
+int SSNPSenderState::PickLaneToSend()
+{
+	// Fast path for the common case of a single lane
+	if ( m_vecLanes.size() == 1 )
+		return m_vecLanes[0].m_messagesQueued.empty() ? -1 : 0;
+
+	// Strict priority first, then the lane that has had the smallest
+	// share of the bandwidth, relative to its weight
+	int idxResult = -1;
+	for ( int idxLane = 0 ; idxLane < len( m_vecLanes ) ; ++idxLane )
+	{
+		const SSNPSendLane &lane = m_vecLanes[ idxLane ];
+		if ( lane.m_messagesQueued.empty() )
+			continue;
+		if ( idxResult >= 0 )
+		{
+			const SSNPSendLane &best = m_vecLanes[ idxResult ];
+			if ( lane.m_nPriority > best.m_nPriority )
+				continue;
+			if ( lane.m_nPriority == best.m_nPriority && lane.m_nVirtTime >= best.m_nVirtTime )
+				continue;
+		}
+		idxResult = idxLane;
+	}
+	if ( idxResult >= 0 )
+		m_nVirtTimeCurrent = m_vecLanes[ idxResult ].m_nVirtTime;
+	return idxResult;
+}
+
+//-----------------------------------------------------------------------------
+void SSNPSendLane::RemoveAckedReliableMessageFromUnackedList()
 {
 
 	// Trim messages from the head that have been acked.
@@ -91,27 +398,27 @@ void SSNPSenderState::RemoveAckedReliableMessageFromUnackedList()
 		// to resend?)
 		if ( !m_listInFlightReliableRange.empty() )
 		{
-			auto head = m_listInFlightReliableRange.begin();
-			Assert( head->first.m_nBegin >= pMsg->SNPSend_ReliableStreamPos() );
-			if ( head->second == pMsg )
+			const SNPReliableRangeList::Entry &head = m_listInFlightReliableRange.front();
+			Assert( head.m_range.m_nBegin >= pMsg->SNPSend_ReliableStreamPos() );
+			if ( head.m_pMsg == pMsg )
 			{
-				Assert( head->first.m_nBegin < nReliableEnd );
+				Assert( head.m_range.m_nBegin < nReliableEnd );
 				return;
 			}
-			Assert( head->first.m_nBegin >= nReliableEnd );
+			Assert( head.m_range.m_nBegin >= nReliableEnd );
 		}
 
 		// Are we backing the next range that is ready for resend now?
 		if ( !m_listReadyRetryReliableRange.empty() )
 		{
-			auto head = m_listReadyRetryReliableRange.begin();
-			Assert( head->first.m_nBegin >= pMsg->SNPSend_ReliableStreamPos() );
-			if ( head->second == pMsg )
+			const SNPReliableRangeList::Entry &head = m_listReadyRetryReliableRange.front();
+			Assert( head.m_range.m_nBegin >= pMsg->SNPSend_ReliableStreamPos() );
+			if ( head.m_pMsg == pMsg )
 			{
-				Assert( head->first.m_nBegin < nReliableEnd );
+				Assert( head.m_range.m_nBegin < nReliableEnd );
 				return;
 			}
-			Assert( head->first.m_nBegin >= nReliableEnd );
+			Assert( head.m_range.m_nBegin >= nReliableEnd );
 		}
 
 		// We're all done!
@@ -123,42 +430,14 @@ void SSNPSenderState::RemoveAckedReliableMessageFromUnackedList()
 //-----------------------------------------------------------------------------
 SSNPSenderState::SSNPSenderState()
 {
-	// Setup the table of inflight packets with a sentinel.
-	m_mapInFlightPacketsByPktNum.clear();
-	SNPInFlightPacket_t &sentinel = m_mapInFlightPacketsByPktNum[INT64_MIN];
-	sentinel.m_bNack = false;
-	sentinel.m_pTransport = nullptr;
-	sentinel.m_usecWhenSent = 0;
-	m_itNextInFlightPacketToTimeout = m_mapInFlightPacketsByPktNum.end();
+	m_vecLanes.resize( 1 );
 	DebugCheckInFlightPacketMap();
 }
 
 #if STEAMNETWORKINGSOCKETS_SNP_PARANOIA > 0
 void SSNPSenderState::DebugCheckInFlightPacketMap() const
 {
-	Assert( !m_mapInFlightPacketsByPktNum.empty() );
-	bool bFoundNextToTimeout = false;
-	auto it = m_mapInFlightPacketsByPktNum.begin();
-	Assert( it->first == INT64_MIN );
-	Assert( m_itNextInFlightPacketToTimeout != it );
-	int64 prevPktNum = it->first;
-	GameNetworkingMicroseconds prevWhenSent = it->second.m_usecWhenSent;
-	while ( ++it != m_mapInFlightPacketsByPktNum.end() )
-	{
-		Assert( prevPktNum < it->first );
-		Assert( prevWhenSent <= it->second.m_usecWhenSent );
-		if ( it == m_itNextInFlightPacketToTimeout )
-		{
-			Assert( !bFoundNextToTimeout );
-			bFoundNextToTimeout = true;
-		}
-		prevPktNum = it->first;
-		prevWhenSent = it->second.m_usecWhenSent;
-	}
-	if ( !bFoundNextToTimeout )
-	{
-		Assert( m_itNextInFlightPacketToTimeout == m_mapInFlightPacketsByPktNum.end() );
-	}
+	m_inFlightPackets.DebugCheck();
 }
 #endif
 
@@ -166,23 +445,54 @@ void SSNPSenderState::DebugCheckInFlightPacketMap() const
 SSNPReceiverState::SSNPReceiverState()
 {
 	// Init packet gaps with a sentinel
-	SSNPPacketGap &sentinel = m_mapPacketGaps[INT64_MAX];
+	SSNPPacketGap sentinel;
 	sentinel.m_nEnd = INT64_MAX; // Fixed value
+	sentinel.m_usecWhenReceivedPktBefore = 0;
 	sentinel.m_usecWhenOKToNack = INT64_MAX; // Fixed value, for when there is nothing left to nack
 	sentinel.m_usecWhenAckPrior = INT64_MAX; // Time when we need to flush a report on all lower-numbered packets
 
 	// Point at the sentinel
-	m_itPendingAck = m_mapPacketGaps.end();
-	--m_itPendingAck;
+	m_itPendingAck = m_mapPacketGaps.insert( INT64_MAX, sentinel );
 	m_itPendingNack = m_itPendingAck;
+
+	m_vecLanes.resize( 1 );
+}
+
+//-----------------------------------------------------------------------------
+SSNPReceiverState::PacketGapMap::iterator SSNPReceiverState::InsertPacketGap( int64 nBegin, const SSNPPacketGap &gap )
+{
+	PacketGapMap::iterator it = m_mapPacketGaps.insert( nBegin, gap );
+
+	// Entries at or after the insertion point shifted up one slot
+	if ( m_itPendingAck >= it )
+		++m_itPendingAck;
+	if ( m_itPendingNack >= it )
+		++m_itPendingNack;
+	return it;
+}
+
+//-----------------------------------------------------------------------------
+SSNPReceiverState::PacketGapMap::iterator SSNPReceiverState::ErasePacketGap( PacketGapMap::iterator it )
+{
+	it = m_mapPacketGaps.erase( it );
+
+	// Entries after the removed one shifted down one slot
+	if ( m_itPendingAck > it )
+		--m_itPendingAck;
+	if ( m_itPendingNack > it )
+		--m_itPendingNack;
+	return it;
 }
 
 //-----------------------------------------------------------------------------
 void SSNPReceiverState::Shutdown()
 {
 	m_mapUnreliableSegments.clear();
-	m_bufReliableStream.clear();
-	m_mapReliableStreamGaps.clear();
+	for ( SSNPRecvLane &lane: m_vecLanes )
+	{
+		lane.m_bufReliableStream.clear();
+		lane.m_mapReliableStreamGaps.clear();
+	}
 	m_mapPacketGaps.clear();
 }
 
@@ -205,6 +515,7 @@ void CGameNetworkConnectionBase::SNP_InitializeConnection( GameNetworkingMicrose
 	Assert( usecPing > 0 );
 	int64 w_init = Clamp( 4380, 2 * k_cbGameNetworkingSocketsMaxEncryptedPayloadSend, 4 * k_cbGameNetworkingSocketsMaxEncryptedPayloadSend );
 	m_sendRateData.m_nCurrentSendRateEstimate = int( k_nMillion * w_init / usecPing );
+	m_sendRateData.m_bbr.Init( m_sendRateData.m_nCurrentSendRateEstimate, usecNow );
 
 	// Go ahead and clamp it now
 	SNP_ClampSendRate();
@@ -215,6 +526,7 @@ void CGameNetworkConnectionBase::SNP_ShutdownConnection()
 {
 	m_senderState.Shutdown();
 	m_receiverState.Shutdown();
+	m_sendRateData.m_bbr.ResetInFlight();
 }
 
 //-----------------------------------------------------------------------------
@@ -230,13 +542,22 @@ int64 CGameNetworkConnectionBase::SNP_SendMessage( CGameNetworkingMessage *pSend
 		*pbThinkImmediately = false;
 
 	// Check if we're full
-	if ( m_senderState.PendingBytesTotal() + cbData > m_connectionConfig.m_SendBufferSize.Get() )
+	if ( m_senderState.PendingBytesTotal() + cbData > ConfigSnapshot().m_SendBufferSize )
 	{
 		SpewWarningRateLimited( usecNow, "Connection already has %u bytes pending, cannot queue any more messages\n", m_senderState.PendingBytesTotal() );
 		pSendMessage->Release();
 		return -k_EResultLimitExceeded; 
 	}
 
+	// Check that they selected a lane that exists
+	if ( pSendMessage->m_idxLane >= len( m_senderState.m_vecLanes ) )
+	{
+		SpewWarningRateLimited( usecNow, "[%s] Invalid lane %d.  Only %d lanes configured\n", GetDescription(), (int)pSendMessage->m_idxLane, len( m_senderState.m_vecLanes ) );
+		pSendMessage->Release();
+		return -k_EResultInvalidParam;
+	}
+	SSNPSendLane &lane = m_senderState.m_vecLanes[ pSendMessage->m_idxLane ];
+
 	// Check if they try to send a really large message
 	if ( cbData > k_cbMaxUnreliableMsgSizeSend && !( pSendMessage->m_nFlags & k_nGameNetworkingSend_Reliable )  )
 	{
@@ -259,16 +580,21 @@ int64 CGameNetworkConnectionBase::SNP_SendMessage( CGameNetworkingMessage *pSend
 	// Assign a message number
 	pSendMessage->m_nMessageNumber = ++m_senderState.m_nLastSentMsgNum;
 
+	// No FEC, unless we decide otherwise below
+	pSendMessage->m_cbSNPSendFECChunk = 0;
+	pSendMessage->m_nSNPSendFECGroupSize = 0;
+	pSendMessage->m_cbSNPSendFECMsgSize = 0;
+
 	// Reliable, or unreliable?
 	if ( pSendMessage->m_nFlags & k_nGameNetworkingSend_Reliable )
 	{
-		pSendMessage->SNPSend_SetReliableStreamPos( m_senderState.m_nReliableStreamPos );
+		pSendMessage->SNPSend_SetReliableStreamPos( lane.m_nReliableStreamPos );
 
 		// Generate the header
 		byte *hdr = pSendMessage->SNPSend_ReliableHeader();
 		hdr[0] = 0;
 		byte *hdrEnd = hdr+1;
-		int64 nMsgNumGap = pSendMessage->m_nMessageNumber - m_senderState.m_nLastSendMsgNumReliable;
+		int64 nMsgNumGap = pSendMessage->m_nMessageNumber - lane.m_nLastSendMsgNumReliable;
 		Assert( nMsgNumGap >= 1 );
 		if ( nMsgNumGap > 1 )
 		{
@@ -290,7 +616,7 @@ int64 CGameNetworkConnectionBase::SNP_SendMessage( CGameNetworkingMessage *pSend
 		pSendMessage->m_cbSize += pSendMessage->m_cbSNPSendReliableHeader;
 
 		// Advance stream pointer
-		m_senderState.m_nReliableStreamPos += pSendMessage->m_cbSize;
+		lane.m_nReliableStreamPos += pSendMessage->m_cbSize;
 
 		// Update stats
 		++m_senderState.m_nMessagesSentReliable;
@@ -298,7 +624,7 @@ int64 CGameNetworkConnectionBase::SNP_SendMessage( CGameNetworkingMessage *pSend
 
 		// Remember last sent reliable message number, so we can know how to
 		// encode the next one
-		m_senderState.m_nLastSendMsgNumReliable = pSendMessage->m_nMessageNumber;
+		lane.m_nLastSendMsgNumReliable = pSendMessage->m_nMessageNumber;
 
 		Assert( pSendMessage->SNPSend_IsReliable() );
 	}
@@ -313,12 +639,16 @@ int64 CGameNetworkConnectionBase::SNP_SendMessage( CGameNetworkingMessage *pSend
 		Assert( !pSendMessage->SNPSend_IsReliable() );
 	}
 
-	// Add to pending list
-	m_senderState.m_messagesQueued.push_back( pSendMessage );
-	SpewVerboseGroup( m_connectionConfig.m_LogLevel_Message.Get(), "[%s] SendMessage %s: MsgNum=%lld sz=%d\n",
+	// Add to pending list.  If the lane was idle, it doesn't get
+	// credit for the time it wasn't using its share of the bandwidth
+	if ( lane.m_messagesQueued.empty() )
+		lane.m_nVirtTime = std::max( lane.m_nVirtTime, m_senderState.m_nVirtTimeCurrent );
+	lane.m_messagesQueued.push_back( pSendMessage );
+	SpewVerboseGroup( ConfigSnapshot().m_LogLevel_Message, "[%s] SendMessage %s: MsgNum=%lld lane=%d sz=%d\n",
 				 GetDescription(),
 				 pSendMessage->SNPSend_IsReliable() ? "RELIABLE" : "UNRELIABLE",
 				 (long long)pSendMessage->m_nMessageNumber,
+				 (int)pSendMessage->m_idxLane,
 				 pSendMessage->m_cbSize );
 
 	// Use Nagle?
@@ -328,10 +658,14 @@ int64 CGameNetworkConnectionBase::SNP_SendMessage( CGameNetworkingMessage *pSend
 	// FIXME - Don't think this works if the configuration value is changing.  Since changing the
 	// config value could violate the assumption that nagle times are increasing.  Probably not worth
 	// fixing.
-	pSendMessage->SNPSend_SetUsecNagle( usecNow + m_connectionConfig.m_NagleTime.Get() );
+	pSendMessage->SNPSend_SetUsecNagle( usecNow + ConfigSnapshot().m_NagleTime );
 	if ( pSendMessage->m_nFlags & k_nGameNetworkingSend_NoNagle )
 		m_senderState.ClearNagleTimers();
 
+	// Protect large unreliable messages with FEC parity, if requested
+	if ( !pSendMessage->SNPSend_IsReliable() )
+		SNP_QueueUnreliableParity( pSendMessage, lane );
+
 	// Save the message number.  The code below might end up deleting the message we just queued
 	int64 result = pSendMessage->m_nMessageNumber;
 
@@ -352,7 +686,8 @@ int64 CGameNetworkConnectionBase::SNP_SendMessage( CGameNetworkingMessage *pSend
 
 			// Not ready to send yet.  Is it because Nagle, or because we have previous
 			// data queued and are rate limited?
-			if ( usecNextThink > m_senderState.m_messagesQueued.m_pFirst->SNPSend_UsecNagle() )
+			GameNetworkingMicroseconds usecNagle = m_senderState.UsecNagleNextMessage();
+			if ( usecNextThink > usecNagle )
 			{
 				// It's because of the rate limit
 				SpewVerbose( "[%s] Send RATELIM.  QueueTime is %.1fms, SendRate=%.1fk, BytesQueued=%d, ping=%dms\n", 
@@ -368,7 +703,7 @@ int64 CGameNetworkConnectionBase::SNP_SendMessage( CGameNetworkingMessage *pSend
 				// Waiting on nagle
 				SpewVerbose( "[%s] Send Nagle %.1fms.  QueueTime is %.1fms, SendRate=%.1fk, BytesQueued=%d, ping=%dms\n", 
 					GetDescription(),
-					( m_senderState.m_messagesQueued.m_pFirst->SNPSend_UsecNagle() - usecNow ) * 1e-3,
+					( usecNagle - usecNow ) * 1e-3,
 					m_sendRateData.CalcTimeUntilNextSend() * 1e-3,
 					m_sendRateData.m_nCurrentSendRateEstimate * ( 1.0/1024.0),
 					m_senderState.PendingBytesTotal(),
@@ -410,6 +745,76 @@ int64 CGameNetworkConnectionBase::SNP_SendMessage( CGameNetworkingMessage *pSend
 	return result;
 }
 
+// XOR src into dest
+static void FECXorBytes( uint8 *pDest, const uint8 *pSrc, int cb )
+{
+	for ( int i = 0 ; i < cb ; ++i )
+		pDest[i] ^= pSrc[i];
+}
+
+void CGameNetworkConnectionBase::SNP_QueueUnreliableParity( CGameNetworkingMessage *pMsg, SSNPSendLane &lane )
+{
+	int nGroupSize = ConfigSnapshot().m_UnreliableFECGroupSize;
+	if ( nGroupSize <= 0 || m_statsEndToEnd.m_nPeerProtocolVersion < k_nMinProtocolVersionUnreliableFEC )
+		return;
+
+	// Only messages that will need to be fragmented benefit
+	const int cbChunk = m_cbMaxPlaintextPayloadSend - k_cbUnreliableFECChunkReserve;
+	Assert( cbChunk > 0 );
+	const int cbMsg = pMsg->m_cbSize;
+	if ( cbMsg <= cbChunk )
+		return;
+
+	// The receiver needs to be able to buffer all of the chunks and parity
+	// blocks.  Use bigger groups if necessary.  (If the MTU is really small,
+	// we might just not be able to do this.)
+	const int nChunks = ( cbMsg + cbChunk - 1 ) / cbChunk;
+	if ( nChunks >= k_nMaxBufferedUnreliableSegments )
+		return;
+	int nGroups = ( nChunks + nGroupSize - 1 ) / nGroupSize;
+	while ( nChunks + nGroups > k_nMaxBufferedUnreliableSegments )
+	{
+		++nGroupSize;
+		nGroups = ( nChunks + nGroupSize - 1 ) / nGroupSize;
+	}
+
+	// Each parity block is the XOR of the chunks in the group, and is as
+	// long as the longest chunk.  Only the last chunk can be short, so
+	// only the last parity block might be short
+	const int cbLastGroupBegin = (nGroups-1)*nGroupSize*cbChunk;
+	const int cbParityTotal = (nGroups-1)*cbChunk + std::min( cbChunk, cbMsg - cbLastGroupBegin );
+	CGameNetworkingMessage *pParity = CGameNetworkingMessage::New( cbParityTotal );
+	if ( !pParity )
+		return;
+	uint8 *pParityData = (uint8 *)pParity->m_pData;
+	memset( pParityData, 0, cbParityTotal );
+	for ( int idxChunk = 0 ; idxChunk < nChunks ; ++idxChunk )
+	{
+		int nOffset = idxChunk*cbChunk;
+		FECXorBytes( pParityData + ( idxChunk / nGroupSize )*cbChunk, (const uint8 *)pMsg->m_pData + nOffset, std::min( cbChunk, cbMsg - nOffset ) );
+	}
+
+	// Don't let segments of the message span chunk boundaries
+	pMsg->m_cbSNPSendFECChunk = cbChunk;
+
+	// Queue the parity right behind the message it protects.  It has
+	// the same message number, and isn't counted as a message
+	pParity->m_nMessageNumber = pMsg->m_nMessageNumber;
+	pParity->m_nFlags = k_nGameNetworkingSend_Unreliable;
+	pParity->m_idxLane = pMsg->m_idxLane;
+	pParity->SNPSend_SetReliableStreamPos( 0 );
+	pParity->m_cbSNPSendReliableHeader = 0;
+	pParity->m_cbSNPSendFECChunk = cbChunk;
+	pParity->m_nSNPSendFECGroupSize = nGroupSize;
+	pParity->m_cbSNPSendFECMsgSize = cbMsg;
+	pParity->SNPSend_SetUsecNagle( pMsg->SNPSend_UsecNagle() );
+	m_senderState.m_cbPendingUnreliable += cbParityTotal;
+	lane.m_messagesQueued.push_back( pParity );
+
+	SpewVerboseGroup( ConfigSnapshot().m_LogLevel_Message, "[%s] SendMessage FEC: MsgNum=%lld chunk=%d group=%d parity sz=%d\n",
+		GetDescription(), (long long)pMsg->m_nMessageNumber, cbChunk, nGroupSize, cbParityTotal );
+}
+
 EResult CGameNetworkConnectionBase::SNP_FlushMessage( GameNetworkingMicroseconds usecNow )
 {
 	// Connection must be locked, but we don't require the global lock here!
@@ -423,12 +828,18 @@ EResult CGameNetworkConnectionBase::SNP_FlushMessage( GameNetworkingMicroseconds
 		return k_EResultIgnored;
 	}
 
-	if ( m_senderState.m_messagesQueued.empty() )
-		return k_EResultOK;
-
 	// If no Nagle timer was set, then there's nothing to do, we should already
 	// be properly scheduled.  Don't do work to re-discover that fact.
-	if ( m_senderState.m_messagesQueued.m_pLast->SNPSend_UsecNagle() == 0 )
+	bool bAnyNagle = false;
+	for ( const SSNPSendLane &lane: m_senderState.m_vecLanes )
+	{
+		if ( !lane.m_messagesQueued.empty() && lane.m_messagesQueued.m_pLast->SNPSend_UsecNagle() != 0 )
+		{
+			bAnyNagle = true;
+			break;
+		}
+	}
+	if ( !bAnyNagle )
 		return k_EResultOK;
 
 	// Accumulate tokens, and also limit to reasonable burst
@@ -519,7 +930,12 @@ bool CGameNetworkConnectionBase::ProcessPlainTextDataChunk( int usecTimeSinceLas
 	const int64 nPktNum = ctx.m_nPktNum;
 	bool bInhibitMarkReceived = false;
 
-	const int nLogLevelPacketDecode = m_connectionConfig.m_LogLevel_PacketDecode.Get();
+	// Time measurements (ping, jitter, and the ack delay we report to
+	// our peer) use the time the packet actually arrived, if we know it,
+	// so they don't include our own processing latency.
+	const GameNetworkingMicroseconds usecWhenReceived = ctx.UsecWhenReceived();
+
+	const int nLogLevelPacketDecode = ConfigSnapshot().m_LogLevel_PacketDecode;
 	SpewVerboseGroup( nLogLevelPacketDecode, "[%s] decode pkt %lld\n", GetDescription(), (long long)nPktNum );
 
 	// Decode frames until we get to the end of the payload
@@ -527,6 +943,8 @@ bool CGameNetworkConnectionBase::ProcessPlainTextDataChunk( int usecTimeSinceLas
 	const byte *pEnd = pDecode + ctx.m_cbPlainText;
 	int64 nCurMsgNum = 0;
 	int64 nDecodeReliablePos = 0;
+	int idxDecodeLane = 0;
+	bool bReceivedReliable = false;
 	while ( pDecode < pEnd )
 	{
 
@@ -614,7 +1032,7 @@ bool CGameNetworkConnectionBase::ProcessPlainTextDataChunk( int usecTimeSinceLas
 
 				// Receive the segment
 				bool bLastSegmentInMessage = ( nFrameType & 0x20 ) != 0;
-				SNP_ReceiveUnreliableSegment( nCurMsgNum, nOffset, pSegmentData, cbSegmentSize, bLastSegmentInMessage, usecNow );
+				SNP_ReceiveUnreliableSegment( nCurMsgNum, idxDecodeLane, nOffset, pSegmentData, cbSegmentSize, bLastSegmentInMessage, usecNow );
 			}
 		}
 		else if ( ( nFrameType & 0xe0 ) == 0x40 )
@@ -640,7 +1058,8 @@ bool CGameNetworkConnectionBase::ProcessPlainTextDataChunk( int usecTimeSinceLas
 				}
 
 				// What do we expect to receive next?
-				int64 nExpectNextStreamPos = m_receiverState.m_nReliableStreamPos + len( m_receiverState.m_bufReliableStream );
+				const SSNPRecvLane &lane = m_receiverState.m_vecLanes[ idxDecodeLane ];
+				int64 nExpectNextStreamPos = lane.m_nReliableStreamPos + len( lane.m_bufReliableStream );
 
 				// Find the stream offset closest to that
 				nDecodeReliablePos = ( nExpectNextStreamPos & ~nMask ) + nOffset;
@@ -684,9 +1103,10 @@ bool CGameNetworkConnectionBase::ProcessPlainTextDataChunk( int usecTimeSinceLas
 			READ_SEGMENT_DATA_SIZE( reliable )
 
 			// Ingest the segment.
-			if ( !SNP_ReceiveReliableSegment( nPktNum, nDecodeReliablePos, pSegmentData, cbSegmentSize, usecNow ) )
+			bReceivedReliable = true;
+			if ( !SNP_ReceiveReliableSegment( nPktNum, idxDecodeLane, nDecodeReliablePos, pSegmentData, cbSegmentSize, usecNow ) )
 			{
-				if ( !BStateIsActive() )
+				if ( !BStateIsActive() || m_bProblemDetectedOnRecvWorker )
 					return false; // we decided to nuke the connection - abort packet processing
 
 				// We're not able to ingest this reliable segment at the moment,
@@ -703,6 +1123,70 @@ bool CGameNetworkConnectionBase::ProcessPlainTextDataChunk( int usecTimeSinceLas
 			if ( nCurMsgNum > 0 ) 
 				++nCurMsgNum;
 		}
+		else if ( ( nFrameType & 0xf8 ) == 0x88 )
+		{
+
+			//
+			// Select lane
+			//
+
+			uint64 nLane = nFrameType & 7;
+			if ( nLane == 7 )
+				READ_VARINT( nLane, "lane" );
+			if ( nLane >= (uint64)k_nMaxLanes )
+				DECODE_ERROR( "Lane %llu is out of range", (unsigned long long)nLane );
+			idxDecodeLane = (int)nLane;
+			if ( idxDecodeLane >= len( m_receiverState.m_vecLanes ) )
+				m_receiverState.m_vecLanes.resize( idxDecodeLane+1 );
+
+			// Message numbers and reliable stream positions in the rest of
+			// the packet are encoded as if this were the start of the packet
+			nCurMsgNum = 0;
+			nDecodeReliablePos = 0;
+
+			SpewDebugGroup( nLogLevelPacketDecode, "[%s]   decode pkt %lld select lane %d\n",
+				GetDescription(), (long long)nPktNum, idxDecodeLane );
+		}
+		else if ( ( nFrameType & 0xf8 ) == 0xa0 )
+		{
+
+			//
+			// Unreliable FEC parity block
+			//
+
+			// Message number is always absolute, and does not affect the
+			// message number used to decode the segments that follow
+			uint32 nLowerBits;
+			READ_32BITU( nLowerBits, "FEC msgnum" );
+			int64 nParityMsgNum = NearestWithSameLowerBits( (int32)nLowerBits, m_receiverState.m_nHighestSeenMsgNum );
+
+			uint32 cbFECMsgSize, cbFECChunk, nFECFirstChunk;
+			uint8 nFECGroupSize;
+			READ_VARINT( cbFECMsgSize, "FEC msg size" );
+			READ_VARINT( cbFECChunk, "FEC chunk size" );
+			READ_8BITU( nFECGroupSize, "FEC group size" );
+			READ_VARINT( nFECFirstChunk, "FEC first chunk" );
+			READ_SEGMENT_DATA_SIZE( parity )
+
+			// Sanity check everything.  Since this is just an optimization
+			// for unreliable data, we can ignore anything we don't like
+			if (
+				nParityMsgNum <= 0
+				|| cbFECMsgSize > (uint32)k_cbMaxUnreliableMsgSizeRecv
+				|| cbFECChunk == 0 || cbFECChunk > (uint32)k_cbMaxUnreliableSegmentSizeRecv
+				|| nFECGroupSize == 0
+				|| nFECFirstChunk >= (uint32)k_nMaxBufferedUnreliableSegments
+				|| nFECFirstChunk*cbFECChunk >= cbFECMsgSize
+				|| cbSegmentSize != (int)std::min( cbFECChunk, cbFECMsgSize - nFECFirstChunk*cbFECChunk )
+			) {
+				SpewWarningRateLimited( usecNow, "[%s] Ignoring invalid FEC parity block.  msg %lld size %u chunk %u group %d first %u parity size %d\n",
+					GetDescription(), (long long)nParityMsgNum, cbFECMsgSize, cbFECChunk, (int)nFECGroupSize, nFECFirstChunk, cbSegmentSize );
+			}
+			else
+			{
+				SNP_ReceiveUnreliableParity( nParityMsgNum, idxDecodeLane, (int)cbFECMsgSize, (int)cbFECChunk, nFECGroupSize, (int)nFECFirstChunk, pSegmentData, cbSegmentSize, usecNow );
+			}
+		}
 		else if ( ( nFrameType & 0xfc ) == 0x80 )
 		{
 			//
@@ -754,10 +1238,8 @@ bool CGameNetworkConnectionBase::ProcessPlainTextDataChunk( int usecTimeSinceLas
 			{
 				if ( h->second.m_nEnd > m_receiverState.m_nMinPktNumToSendAcks )
 				{
-					// Ug.  You're not supposed to modify the key in a map.
-					// I suppose that's legit, since you could violate the ordering.
-					// but in this case I know that this change is OK.
-					const_cast<int64 &>( h->first ) = m_receiverState.m_nMinPktNumToSendAcks;
+					// Trim the front of the gap.  This doesn't change the ordering
+					h->first = m_receiverState.m_nMinPktNumToSendAcks;
 					break;
 				}
 
@@ -776,7 +1258,7 @@ bool CGameNetworkConnectionBase::ProcessPlainTextDataChunk( int usecTimeSinceLas
 				}
 
 				// Packet loss is in the past.  Forget about it and move on
-				h = m_receiverState.m_mapPacketGaps.erase(h);
+				h = m_receiverState.ErasePacketGap( h );
 			}
 		}
 		else if ( ( nFrameType & 0xf0 ) == 0x90 )
@@ -836,27 +1318,31 @@ bool CGameNetworkConnectionBase::ProcessPlainTextDataChunk( int usecTimeSinceLas
 				}
 			}
 
-			// Locate our bookkeeping for this packet, or the latest one before it
-			// Remember, we have a sentinel with a low, invalid packet number
-			Assert( !m_senderState.m_mapInFlightPacketsByPktNum.empty() );
-			auto inFlightPkt = m_senderState.m_mapInFlightPacketsByPktNum.upper_bound( nLatestRecvSeqNum );
-			--inFlightPkt;
-			Assert( inFlightPkt->first <= nLatestRecvSeqNum );
+			// Locate our bookkeeping for this packet, if we still have it
+			SNPInFlightPacketTable &inFlightPackets = m_senderState.m_inFlightPackets;
+			const SNPInFlightPacket_t *pLatestInFlightPkt = inFlightPackets.Find( nLatestRecvSeqNum );
 
-			SpewDebugGroup( nLogLevelPacketDecode, "[%s]   decode pkt %lld latest recv %lld, inflight=%lld\n",
+			SpewDebugGroup( nLogLevelPacketDecode, "[%s]   decode pkt %lld latest recv %lld, inflight=[%lld,%lld)\n",
 				GetDescription(),
-				(long long)nPktNum, (long long)nLatestRecvSeqNum, (long long)inFlightPkt->first
+				(long long)nPktNum, (long long)nLatestRecvSeqNum, (long long)inFlightPackets.PktNumBegin(), (long long)inFlightPackets.PktNumEnd()
 			);
 
 			// Parse out delay, and process the ping
 			{
 				uint16 nPackedDelay;
 				READ_16BITU( nPackedDelay, "ack delay" );
-				if ( nPackedDelay != 0xffff && inFlightPkt->first == nLatestRecvSeqNum && inFlightPkt->second.m_pTransport == ctx.m_pTransport )
+				if ( nPackedDelay != 0xffff && pLatestInFlightPkt && pLatestInFlightPkt->m_pTransport == ctx.m_pTransport )
 				{
 					GameNetworkingMicroseconds usecDelay = GameNetworkingMicroseconds( nPackedDelay ) << k_nAckDelayPrecisionShift;
-					GameNetworkingMicroseconds usecElapsed = usecNow - inFlightPkt->second.m_usecWhenSent;
-					Assert( usecElapsed >= 0 );
+					GameNetworkingMicroseconds usecElapsed = usecWhenReceived - pLatestInFlightPkt->m_usecWhenSent;
+
+					// A kernel receive timestamp can be off from our clock by
+					// a few microseconds, which matters on a fast local link
+					if ( usecElapsed < 0 )
+					{
+						Assert( ctx.m_usecKernelRecv && usecElapsed > -1000 );
+						usecElapsed = 0;
+					}
 
 					// Account for their reported delay, and calculate ping, in MS
 					int msPing = ( usecElapsed - usecDelay ) / 1000;
@@ -874,7 +1360,7 @@ bool CGameNetworkConnectionBase::ProcessPlainTextDataChunk( int usecTimeSinceLas
 						// Either they are lying or some weird timer stuff is happening.
 						// Either way, discard it.
 
-						SpewMsgGroup( m_connectionConfig.m_LogLevel_AckRTT.Get(), "[%s] decode pkt %lld latest recv %lld delay %lluusec INVALID ping %lldusec\n",
+						SpewMsgGroup( ConfigSnapshot().m_LogLevel_AckRTT, "[%s] decode pkt %lld latest recv %lld delay %lluusec INVALID ping %lldusec\n",
 							GetDescription(),
 							(long long)nPktNum, (long long)nLatestRecvSeqNum,
 							(unsigned long long)usecDelay,
@@ -887,9 +1373,10 @@ bool CGameNetworkConnectionBase::ProcessPlainTextDataChunk( int usecTimeSinceLas
 						if ( msPing < 0 )
 							msPing = 0;
 						ProcessSNPPing( msPing, ctx );
+						m_sendRateData.m_bbr.OnRTTSample( usecElapsed - usecDelay, usecNow );
 
 						// Spew
-						SpewVerboseGroup( m_connectionConfig.m_LogLevel_AckRTT.Get(), "[%s] decode pkt %lld latest recv %lld delay %.1fms elapsed %.1fms ping %dms\n",
+						SpewVerboseGroup( ConfigSnapshot().m_LogLevel_AckRTT, "[%s] decode pkt %lld latest recv %lld delay %.1fms elapsed %.1fms ping %dms\n",
 							GetDescription(),
 							(long long)nPktNum, (long long)nLatestRecvSeqNum,
 							(float)(usecDelay * 1e-3 ),
@@ -924,6 +1411,7 @@ bool CGameNetworkConnectionBase::ProcessPlainTextDataChunk( int usecTimeSinceLas
 			// than the stop_aiting value we sent), because we need to do that to get to the rest
 			// of the packet.
 			bool bAckedReliableRange = false;
+			const bool bCwndWasFull = SNP_BCongestionWindowFull();
 			int64 nPktNumAckEnd = nLatestRecvSeqNum+1;
 			while ( nBlocks >= 0 )
 			{
@@ -985,21 +1473,29 @@ bool CGameNetworkConnectionBase::ProcessPlainTextDataChunk( int usecTimeSinceLas
 					);
 				}
 
-				// Process acks first.
+				// Process acks first.  Only scan the portion of the range that
+				// overlaps the packets we are tracking
 				Assert( nPktNumAckBegin >= 0 );
-				while ( inFlightPkt->first >= nPktNumAckBegin )
-				{
-					Assert( inFlightPkt->first < nPktNumAckEnd );
+				for (
+					int64 nAckPktNum = std::min( nPktNumAckEnd, inFlightPackets.PktNumEnd() ) - 1;
+					nAckPktNum >= std::max( nPktNumAckBegin, inFlightPackets.PktNumBegin() );
+					--nAckPktNum
+				) {
+					SNPInFlightPacket_t *pInFlightPkt = inFlightPackets.Find( nAckPktNum );
+					if ( !pInFlightPkt )
+						continue;
 
 					// Scan reliable segments, and see if any are marked for retry or are in flight
-					for ( const SNPRange_t &relRange: inFlightPkt->second.m_vecReliableSegments )
+					for ( const SNPLaneRange_t &laneRange: pInFlightPkt->m_vecReliableSegments )
 					{
+						const SNPRange_t &relRange = laneRange.m_range;
+						SSNPSendLane &lane = m_senderState.m_vecLanes[ laneRange.m_idxLane ];
 						int l = int( relRange.length() );
 
 						// If range is present, it should be in only one of these two tables.
-						if ( m_senderState.m_listInFlightReliableRange.erase( relRange ) == 0 )
+						if ( !lane.m_listInFlightReliableRange.Erase( relRange ) )
 						{
-							if ( m_senderState.m_listReadyRetryReliableRange.erase( relRange ) > 0 )
+							if ( lane.m_listReadyRetryReliableRange.Erase( relRange ) )
 							{
 
 								// When we put stuff into the reliable retry list, we mark it as pending again.
@@ -1013,7 +1509,7 @@ bool CGameNetworkConnectionBase::ProcessPlainTextDataChunk( int usecTimeSinceLas
 						else
 						{
 							bAckedReliableRange = true;
-							Assert( m_senderState.m_listReadyRetryReliableRange.count( relRange ) == 0 );
+							Assert( !lane.m_listReadyRetryReliableRange.Find( relRange ) );
 
 							// Less data waiting to be acked
 							Assert( m_senderState.m_cbSentUnackedReliable >= l );
@@ -1021,14 +1517,11 @@ bool CGameNetworkConnectionBase::ProcessPlainTextDataChunk( int usecTimeSinceLas
 						}
 					}
 
-					// Check if this was the next packet we were going to timeout, then advance
-					// pointer.  This guy didn't timeout.
-					if ( inFlightPkt == m_senderState.m_itNextInFlightPacketToTimeout )
-						++m_senderState.m_itNextInFlightPacketToTimeout;
+					// Update delivery rate sample
+					m_sendRateData.m_bbr.OnPacketAcked( *pInFlightPkt, usecNow );
 
 					// No need to track this anymore, remove from our table
-					inFlightPkt = m_senderState.m_mapInFlightPacketsByPktNum.erase( inFlightPkt );
-					--inFlightPkt;
+					inFlightPackets.Erase( nAckPktNum );
 					m_senderState.MaybeCheckInFlightPacketMap();
 				}
 
@@ -1037,14 +1530,16 @@ bool CGameNetworkConnectionBase::ProcessPlainTextDataChunk( int usecTimeSinceLas
 					m_statsEndToEnd.InFlightPktAck( usecNow );
 
 				// Process nacks.
+				// We'll keep the records on hand, though, in case an ACK comes in
 				Assert( nPktNumNackBegin >= 0 );
-				while ( inFlightPkt->first >= nPktNumNackBegin )
-				{
-					Assert( inFlightPkt->first < nPktNumAckEnd );
-					SNP_SenderProcessPacketNack( inFlightPkt->first, inFlightPkt->second, "NACK" );
-
-					// We'll keep the record on hand, though, in case an ACK comes in
-					--inFlightPkt;
+				for (
+					int64 nNackPktNum = std::min( nPktNumAckBegin, inFlightPackets.PktNumEnd() ) - 1;
+					nNackPktNum >= std::max( nPktNumNackBegin, inFlightPackets.PktNumBegin() );
+					--nNackPktNum
+				) {
+					SNPInFlightPacket_t *pInFlightPkt = inFlightPackets.Find( nNackPktNum );
+					if ( pInFlightPkt )
+						SNP_SenderProcessPacketNack( nNackPktNum, *pInFlightPkt, "NACK" );
 				}
 
 				// Continue on to the the next older block
@@ -1052,25 +1547,36 @@ bool CGameNetworkConnectionBase::ProcessPlainTextDataChunk( int usecTimeSinceLas
 				--nBlocks;
 			}
 
+			// Update bandwidth model with whatever we just learned.
+			// If we were blocked waiting for acks, we might be able
+			// to send now
+			m_sendRateData.m_bbr.OnAckFrameProcessed( usecNow );
+			if ( bCwndWasFull && !m_sendRateData.m_bbr.BCongestionWindowFull() )
+				SetNextThinkTimeASAP();
+
 			// Should we check for discarding reliable messages we are keeping around in case
 			// of retransmission, since we know now that they were delivered?
 			if ( bAckedReliableRange )
 			{
-				m_senderState.RemoveAckedReliableMessageFromUnackedList();
-
-				// Spew where we think the peer is decoding the reliable stream
-				if ( nLogLevelPacketDecode >= k_EGameNetworkingSocketsDebugOutputType_Debug )
+				for ( int idxLane = 0 ; idxLane < len( m_senderState.m_vecLanes ) ; ++idxLane )
 				{
+					SSNPSendLane &lane = m_senderState.m_vecLanes[ idxLane ];
+					lane.RemoveAckedReliableMessageFromUnackedList();
 
-					int64 nPeerReliablePos = m_senderState.m_nReliableStreamPos;
-					if ( !m_senderState.m_listInFlightReliableRange.empty() )
-						nPeerReliablePos = std::min( nPeerReliablePos, m_senderState.m_listInFlightReliableRange.begin()->first.m_nBegin );
-					if ( !m_senderState.m_listReadyRetryReliableRange.empty() )
-						nPeerReliablePos = std::min( nPeerReliablePos, m_senderState.m_listReadyRetryReliableRange.begin()->first.m_nBegin );
+					// Spew where we think the peer is decoding the reliable stream
+					if ( nLogLevelPacketDecode >= k_EGameNetworkingSocketsDebugOutputType_Debug )
+					{
 
-					SpewDebugGroup( nLogLevelPacketDecode, "[%s]   decode pkt %lld peer reliable pos = %lld\n",
-						GetDescription(),
-						(long long)nPktNum, (long long)nPeerReliablePos );
+						int64 nPeerReliablePos = lane.m_nReliableStreamPos;
+						if ( !lane.m_listInFlightReliableRange.empty() )
+							nPeerReliablePos = std::min( nPeerReliablePos, lane.m_listInFlightReliableRange.front().m_range.m_nBegin );
+						if ( !lane.m_listReadyRetryReliableRange.empty() )
+							nPeerReliablePos = std::min( nPeerReliablePos, lane.m_listReadyRetryReliableRange.front().m_range.m_nBegin );
+
+						SpewDebugGroup( nLogLevelPacketDecode, "[%s]   decode pkt %lld lane %d peer reliable pos = %lld\n",
+							GetDescription(),
+							(long long)nPktNum, idxLane, (long long)nPeerReliablePos );
+					}
 				}
 			}
 
@@ -1099,14 +1605,17 @@ bool CGameNetworkConnectionBase::ProcessPlainTextDataChunk( int usecTimeSinceLas
 		// Act as if the packet was dropped.  This will cause the
 		// peer's sender logic to interpret this as additional packet
 		// loss and back off.  That's a feature, not a bug.
+		//
+		// If this is the newest packet, we still need to record a
+		// gap for it, or we would implicitly ack it.
+		SNP_RecordReceivedPktNum( nPktNum, usecNow, usecWhenReceived, false, false );
 	}
 	else
 	{
 
 		// Update structures needed to populate our ACKs.
 		// If we received reliable data now, then schedule an ack
-		bool bScheduleAck = nDecodeReliablePos > 0;
-		SNP_RecordReceivedPktNum( nPktNum, usecNow, bScheduleAck );
+		SNP_RecordReceivedPktNum( nPktNum, usecNow, usecWhenReceived, bReceivedReliable, true );
 	}
 
 	// Track end-to-end flow.  Even if we decided to tell our peer that
@@ -1116,7 +1625,7 @@ bool CGameNetworkConnectionBase::ProcessPlainTextDataChunk( int usecTimeSinceLas
 	//
 	// Also, note that order of operations is important.  This call must
 	// happen after the SNP_RecordReceivedPktNum call above
-	m_statsEndToEnd.TrackProcessSequencedPacket( nPktNum, usecNow, usecTimeSinceLast );
+	m_statsEndToEnd.TrackProcessSequencedPacket( nPktNum, usecWhenReceived, usecTimeSinceLast );
 
 	// Packet can be processed further
 	return true;
@@ -1142,24 +1651,28 @@ void CGameNetworkConnectionBase::SNP_SenderProcessPacketNack( int64 nPktNum, SNP
 
 	// Mark as dropped
 	pkt.m_bNack = true;
+	m_sendRateData.m_bbr.OnPacketLost( pkt );
 
 	// Is this in-flight stats we were expecting an ack for?
 	if ( m_statsEndToEnd.m_pktNumInFlight == nPktNum )
 		m_statsEndToEnd.InFlightPktTimeout();
 
 	// Scan reliable segments
-	for ( const SNPRange_t &relRange: pkt.m_vecReliableSegments )
+	for ( const SNPLaneRange_t &laneRange: pkt.m_vecReliableSegments )
 	{
+		const SNPRange_t &relRange = laneRange.m_range;
+		SSNPSendLane &lane = m_senderState.m_vecLanes[ laneRange.m_idxLane ];
 
 		// Marked as in-flight?
-		auto inFlightRange = m_senderState.m_listInFlightReliableRange.find( relRange );
-		if ( inFlightRange == m_senderState.m_listInFlightReliableRange.end() )
+		const SNPReliableRangeList::Entry *pInFlightRange = lane.m_listInFlightReliableRange.Find( relRange );
+		if ( !pInFlightRange )
 			continue;
 
-		SpewMsgGroup( m_connectionConfig.m_LogLevel_PacketDecode.Get(), "[%s] pkt %lld %s, queueing retry of reliable range [%lld,%lld)\n", 
+		SpewMsgGroup( ConfigSnapshot().m_LogLevel_PacketDecode, "[%s] pkt %lld %s, queueing retry of lane %d reliable range [%lld,%lld)\n", 
 			GetDescription(),
 			nPktNum,
 			pszDebug,
+			laneRange.m_idxLane,
 			relRange.m_nBegin, relRange.m_nEnd );
 
 		// The ready-to-retry list counts towards the "pending" stat
@@ -1170,9 +1683,9 @@ void CGameNetworkConnectionBase::SNP_SenderProcessPacketNack( int64 nPktNum, SNP
 
 		// Move it to the ready for retry list!
 		// if shouldn't already be there!
-		Assert( m_senderState.m_listReadyRetryReliableRange.count( relRange ) == 0 );
-		m_senderState.m_listReadyRetryReliableRange[ inFlightRange->first ] = inFlightRange->second;
-		m_senderState.m_listInFlightReliableRange.erase( inFlightRange );
+		Assert( !lane.m_listReadyRetryReliableRange.Find( relRange ) );
+		lane.m_listReadyRetryReliableRange.Insert( pInFlightRange->m_range, pInFlightRange->m_pMsg );
+		lane.m_listInFlightReliableRange.Erase( relRange );
 	}
 }
 
@@ -1183,12 +1696,9 @@ GameNetworkingMicroseconds CGameNetworkConnectionBase::SNP_SenderCheckInFlightPa
 
 	// Fast path for nothing in flight.
 	m_senderState.MaybeCheckInFlightPacketMap();
-	if ( m_senderState.m_mapInFlightPacketsByPktNum.size() <= 1 )
-	{
-		Assert( m_senderState.m_itNextInFlightPacketToTimeout == m_senderState.m_mapInFlightPacketsByPktNum.end() );
+	SNPInFlightPacketTable &inFlightPackets = m_senderState.m_inFlightPackets;
+	if ( inFlightPackets.empty() )
 		return k_nThinkTime_Never;
-	}
-	Assert( m_senderState.m_mapInFlightPacketsByPktNum.begin()->first < 0 );
 
 	GameNetworkingMicroseconds usecNextRetry = k_nThinkTime_Never;
 
@@ -1196,16 +1706,18 @@ GameNetworkingMicroseconds CGameNetworkConnectionBase::SNP_SenderCheckInFlightPa
 	// than we do to totally forgot about the packet, in case an ack comes in late,
 	// we can take advantage of it.
 	GameNetworkingMicroseconds usecRTO = m_statsEndToEnd.CalcSenderRetryTimeout();
-	while ( m_senderState.m_itNextInFlightPacketToTimeout != m_senderState.m_mapInFlightPacketsByPktNum.end() )
+	int64 nPktNumTimeout = std::max( m_senderState.m_nNextInFlightPktNumToTimeout, inFlightPackets.PktNumBegin() );
+	while ( nPktNumTimeout < inFlightPackets.PktNumEnd() )
 	{
-		Assert( m_senderState.m_itNextInFlightPacketToTimeout->first > 0 );
+		Assert( nPktNumTimeout > 0 );
 
-		// If already nacked, then no use waiting on it, just skip it
-		if ( !m_senderState.m_itNextInFlightPacketToTimeout->second.m_bNack )
+		// If already acked or nacked, then no use waiting on it, just skip it
+		SNPInFlightPacket_t *pInFlightPkt = inFlightPackets.Find( nPktNumTimeout );
+		if ( pInFlightPkt && !pInFlightPkt->m_bNack )
 		{
 
 			// Not yet time to give up?
-			GameNetworkingMicroseconds usecRetryPkt = m_senderState.m_itNextInFlightPacketToTimeout->second.m_usecWhenSent + usecRTO;
+			GameNetworkingMicroseconds usecRetryPkt = pInFlightPkt->m_usecWhenSent + usecRTO;
 			if ( usecRetryPkt > usecNow )
 			{
 				usecNextRetry = usecRetryPkt;
@@ -1214,17 +1726,13 @@ GameNetworkingMicroseconds CGameNetworkConnectionBase::SNP_SenderCheckInFlightPa
 
 			// Mark as dropped, and move any reliable contents into the
 			// retry list.
-			SNP_SenderProcessPacketNack( m_senderState.m_itNextInFlightPacketToTimeout->first, m_senderState.m_itNextInFlightPacketToTimeout->second, "AckTimeout" );
+			SNP_SenderProcessPacketNack( nPktNumTimeout, *pInFlightPkt, "AckTimeout" );
 		}
 
 		// Advance to next packet waiting to timeout
-		++m_senderState.m_itNextInFlightPacketToTimeout;
+		++nPktNumTimeout;
 	}
-
-	// Skip the sentinel
-	auto inFlightPkt = m_senderState.m_mapInFlightPacketsByPktNum.begin();
-	Assert( inFlightPkt->first < 0 );
-	++inFlightPkt;
+	m_senderState.m_nNextInFlightPktNumToTimeout = nPktNumTimeout;
 
 	// Expire old packets (all of these should have been marked as nacked)
 	// Here we need to be careful when selecting an expiry.  If the actual RTT
@@ -1246,23 +1754,22 @@ GameNetworkingMicroseconds CGameNetworkConnectionBase::SNP_SenderCheckInFlightPa
 			usecExpiry = usecMostRecentPingAge;
 	}
 
+	// The oldest packet is always present in the table
 	GameNetworkingMicroseconds usecWhenExpiry = usecNow - usecExpiry;
-	for (;;)
+	while ( !inFlightPackets.empty() )
 	{
-		if ( inFlightPkt->second.m_usecWhenSent > usecWhenExpiry )
+		int64 nPktNumOldest = inFlightPackets.PktNumBegin();
+		const SNPInFlightPacket_t *pOldest = inFlightPackets.Find( nPktNumOldest );
+		Assert( pOldest );
+		if ( pOldest->m_usecWhenSent > usecWhenExpiry )
 			break;
 
 		// Should have already been timed out by the code above
-		Assert( inFlightPkt->second.m_bNack );
-		Assert( inFlightPkt != m_senderState.m_itNextInFlightPacketToTimeout );
+		Assert( pOldest->m_bNack );
+		Assert( nPktNumOldest < m_senderState.m_nNextInFlightPktNumToTimeout );
 
-		// Expire it, advance to the next one
-		inFlightPkt = m_senderState.m_mapInFlightPacketsByPktNum.erase( inFlightPkt );
-		Assert( !m_senderState.m_mapInFlightPacketsByPktNum.empty() );
-
-		// Bail if we've hit the end of the nacks
-		if ( inFlightPkt == m_senderState.m_mapInFlightPacketsByPktNum.end() )
-			break;
+		// Expire it
+		inFlightPackets.Erase( nPktNumOldest );
 	}
 
 	// Make sure we didn't hose data structures
@@ -1285,6 +1792,23 @@ struct EncodedSegment
 	CGameNetworkingMessage *m_pMsg;
 	int m_cbSegSize;
 	int m_nOffset;
+	int m_idxLane;
+	int m_idxLaneSelect; // If >= 0, we need to emit a select lane frame before this segment
+
+	/// Remember which lane this segment belongs to.  If that's not the lane
+	/// we are currently encoding, then we need to switch lanes first.  Returns
+	/// the size of the select lane frame
+	inline int SetupLane( int idxLane, int idxEncodeLane )
+	{
+		m_idxLane = idxLane;
+		if ( idxLane == idxEncodeLane )
+		{
+			m_idxLaneSelect = -1;
+			return 0;
+		}
+		m_idxLaneSelect = idxLane;
+		return idxLane < 7 ? 1 : 1 + VarIntSerializedSize( (uint32)idxLane );
+	}
 
 	inline void SetupReliable( CGameNetworkingMessage *pMsg, int64 nBegin, int64 nEnd, int64 nLastReliableStreamPosEnd )
 	{
@@ -1399,28 +1923,37 @@ struct EncodedSegment
 		m_nOffset = nOffset;
 	}
 
-};
-
-template <typename T, typename L>
-inline bool HasOverlappingRange( const SNPRange_t &range, const std_map<SNPRange_t,T,L> &map )
-{
-	auto l = map.lower_bound( range );
-	if ( l != map.end() )
+	inline void SetupParity( CGameNetworkingMessage *pMsg, int nOffset )
 	{
-		Assert( l->first.m_nBegin >= range.m_nBegin );
-		if ( l->first.m_nBegin < range.m_nEnd )
-			return true;
-	}
-	auto u = map.upper_bound( range );
-	if ( u != map.end() )
-	{
-		Assert( range.m_nBegin < u->first.m_nBegin );
-		if ( range.m_nEnd > l->first.m_nBegin )
-			return true;
+		Assert( pMsg->SNPSend_IsFECParity() );
+		Assert( nOffset % pMsg->m_cbSNPSendFECChunk == 0 );
+
+		// Top five bits = 10100 identify this as an FEC parity block.
+		// Message number is always absolute, so this frame doesn't
+		// affect how the other segments in the packet are encoded.
+		uint8 *pHdr = m_hdr;
+		*(pHdr++) = 0xa0;
+		*(uint32*)pHdr = LittleDWord( (uint32)pMsg->m_nMessageNumber ); pHdr += 4;
+
+		// How the message was divided up, and which group this is
+		int idxGroup = nOffset / pMsg->m_cbSNPSendFECChunk;
+		pHdr = SerializeVarInt( pHdr, (uint32)pMsg->m_cbSNPSendFECMsgSize, m_hdr+k_cbMaxHdr );
+		Assert( pHdr );
+		pHdr = SerializeVarInt( pHdr, (uint32)pMsg->m_cbSNPSendFECChunk, m_hdr+k_cbMaxHdr );
+		Assert( pHdr );
+		*(pHdr++) = uint8( pMsg->m_nSNPSendFECGroupSize );
+		pHdr = SerializeVarInt( pHdr, (uint32)( idxGroup * pMsg->m_nSNPSendFECGroupSize ), m_hdr+k_cbMaxHdr );
+		Assert( pHdr );
+
+		m_cbHdr = pHdr-m_hdr;
+
+		// Parity blocks are never split
+		m_pMsg = pMsg;
+		m_nOffset = nOffset;
+		m_cbSegSize = std::min( pMsg->m_cbSNPSendFECChunk, (int)pMsg->m_cbSize - nOffset );
 	}
 
-	return false;
-}
+};
 
 bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTransport, SendPacketContext_t &ctx )
 {
@@ -1428,10 +1961,9 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 	AssertLocksHeldByCurrentThread( "SNP_SendPacket" );
 
 	// Check calling conditions, and don't crash
-	if ( !BStateIsActive() || m_senderState.m_mapInFlightPacketsByPktNum.empty() || !pTransport )
+	if ( !BStateIsActive() || !pTransport )
 	{
 		Assert( BStateIsActive() );
-		Assert( !m_senderState.m_mapInFlightPacketsByPktNum.empty() );
 		Assert( pTransport );
 		return false;
 	}
@@ -1448,7 +1980,7 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 	uint8 *pPayloadEnd = payload + cbMaxPlaintextPayload;
 	uint8 *pPayloadPtr = payload;
 
-	int nLogLevelPacketDecode = m_connectionConfig.m_LogLevel_PacketDecode.Get();
+	int nLogLevelPacketDecode = ConfigSnapshot().m_LogLevel_PacketDecode;
 	SpewVerboseGroup( nLogLevelPacketDecode, "[%s] encode pkt %lld",
 		GetDescription(),
 		(long long)m_statsEndToEnd.m_nNextSendSequenceNumber );
@@ -1468,7 +2000,7 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 		pLog->m_usecTime = usecNow;
 		pLog->m_cbPendingReliable = m_senderState.m_cbPendingReliable;
 		pLog->m_cbPendingUnreliable = m_senderState.m_cbPendingUnreliable;
-		pLog->m_nPacketGaps = len( m_receiverState.m_mapPacketGaps )-1;
+		pLog->m_nPacketGaps = m_receiverState.m_mapPacketGaps.size()-1;
 		pLog->m_nAckBlocksNeeded = ackHelper.m_nBlocksNeedToAck;
 		pLog->m_nPktNumNextPendingAck = m_receiverState.m_itPendingAck->first;
 		pLog->m_usecNextPendingAckTime = m_receiverState.m_itPendingAck->second.m_usecWhenAckPrior;
@@ -1528,20 +2060,31 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 		pPayloadEnd = pPayloadPtr;
 	}
 
+	// Encoding state.  Each packet starts out in lane 0.  When we select
+	// a different lane, the message number and reliable stream position
+	// encoding start over, as if it were the start of the packet.
 	int64 nLastReliableStreamPosEnd = 0;
+	int64 nLastMsgNum = 0;
+	int idxEncodeLane = 0;
 	int cbBytesRemainingForSegments = pPayloadEnd - pPayloadPtr - cbReserveForAcks;
 	vstd::small_vector<EncodedSegment,8> vecSegments;
 
 	// If we need to retry any reliable data, then try to put that in first.
+	// Higher priority lanes go first.
 	// Bail if we only have a tiny sliver of data left
-	while ( !m_senderState.m_listReadyRetryReliableRange.empty() && cbBytesRemainingForSegments > 2 )
+	while ( cbBytesRemainingForSegments > 2 )
 	{
-		auto h = m_senderState.m_listReadyRetryReliableRange.begin();
+		int idxLane = m_senderState.PickLaneToRetry();
+		if ( idxLane < 0 )
+			break;
+		SSNPSendLane &lane = m_senderState.m_vecLanes[ idxLane ];
+		const SNPReliableRangeList::Entry &h = lane.m_listReadyRetryReliableRange.front();
 
 		// Start a reliable segment
 		EncodedSegment &seg = *push_back_get_ptr( vecSegments );
-		seg.SetupReliable( h->second, h->first.m_nBegin, h->first.m_nEnd, nLastReliableStreamPosEnd );
-		int cbSegTotalWithoutSizeField = seg.m_cbHdr + seg.m_cbSegSize;
+		int cbSelectLane = seg.SetupLane( idxLane, idxEncodeLane );
+		seg.SetupReliable( h.m_pMsg, h.m_range.m_nBegin, h.m_range.m_nEnd, cbSelectLane > 0 ? 0 : nLastReliableStreamPosEnd );
+		int cbSegTotalWithoutSizeField = cbSelectLane + seg.m_cbHdr + seg.m_cbSegSize;
 		if ( cbSegTotalWithoutSizeField > cbBytesRemainingForSegments )
 		{
 			// This one won't fit.
@@ -1561,7 +2104,7 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 			// opportunity to fill a normal packet and we fail on the first segment,
 			// we will never make progress and we are hosed!
 			AssertMsg2(
-				nLastReliableStreamPosEnd > 0
+				!vecSegments.empty()
 				|| cbMaxPlaintextPayload < m_cbMaxPlaintextPayloadSend
 				|| ( cbReserveForAcks > 15 && ackHelper.m_nBlocksNeedToAck > 8 ),
 				"We cannot fit reliable segment, need %d bytes, only %d remaining", cbSegTotalWithoutSizeField, cbBytesRemainingForSegments
@@ -1576,7 +2119,12 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 
 		// If we only have a sliver left, then don't try to fit any more.
 		cbBytesRemainingForSegments -= cbSegTotalWithoutSizeField;
-		nLastReliableStreamPosEnd = h->first.m_nEnd;
+		if ( cbSelectLane > 0 )
+		{
+			idxEncodeLane = idxLane;
+			nLastMsgNum = 0;
+		}
+		nLastReliableStreamPosEnd = h.m_range.m_nEnd;
 
 		// Assume for now this won't be the last segment, in which case we will also need
 		// the byte for the size field.
@@ -1585,7 +2133,7 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 		cbBytesRemainingForSegments -= 1;
 
 		// Remove from retry list.  (We'll add to the in-flight list later)
-		m_senderState.m_listReadyRetryReliableRange.erase( h );
+		lane.m_listReadyRetryReliableRange.pop_front();
 
 		#ifdef SNP_ENABLE_PACKETSENDLOG
 			++pLog->m_nReliableSegmentsRetry;
@@ -1593,24 +2141,80 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 	}
 
 	// Did we retry everything we needed to?  If not, then don't try to send new stuff,
-	// before we send those retries.
-	if ( m_senderState.m_listReadyRetryReliableRange.empty() )
+	// before we send those retries.  And if the congestion window is full, then
+	// we were only allowed to send the retries.
+	if ( !m_senderState.HasReadyRetryReliableRange() && !SNP_BCongestionWindowFull() )
 	{
 
 		// OK, check the outgoing messages, and send as much stuff as we can cram in there
-		int64 nLastMsgNum = 0;
 		while ( cbBytesRemainingForSegments > 4 )
 		{
-			if ( m_senderState.m_messagesQueued.empty() )
-			{
-				m_senderState.m_cbCurrentSendMessageSent = 0;
+			int idxLane = m_senderState.PickLaneToSend();
+			if ( idxLane < 0 )
 				break;
-			}
-			CGameNetworkingMessage *pSendMsg = m_senderState.m_messagesQueued.m_pFirst;
-			Assert( m_senderState.m_cbCurrentSendMessageSent < pSendMsg->m_cbSize );
+			SSNPSendLane &lane = m_senderState.m_vecLanes[ idxLane ];
+			CGameNetworkingMessage *pSendMsg = lane.m_messagesQueued.m_pFirst;
+			Assert( lane.m_cbCurrentSendMessageSent < pSendMsg->m_cbSize );
 
-			// Start a new segment
+			// Start a new segment.  Switch lanes first, if necessary
 			EncodedSegment &seg = *push_back_get_ptr( vecSegments );
+			int cbSelectLane = seg.SetupLane( idxLane, idxEncodeLane );
+			if ( cbSelectLane > 0 )
+			{
+				idxEncodeLane = idxLane;
+				nLastMsgNum = 0;
+				nLastReliableStreamPosEnd = 0;
+				cbBytesRemainingForSegments -= cbSelectLane;
+			}
+
+			// FEC parity block?
+			if ( pSendMsg->SNPSend_IsFECParity() )
+			{
+				seg.SetupParity( pSendMsg, lane.m_cbCurrentSendMessageSent );
+
+				// Don't put parity in the same packet as any part of the
+				// message it protects, or they would be lost together
+				bool bSamePacketAsMsg = false;
+				for ( int i = 0 ; i < len( vecSegments )-1 ; ++i )
+				{
+					if ( vecSegments[i].m_idxLane == idxLane && vecSegments[i].m_pMsg->m_nMessageNumber == pSendMsg->m_nMessageNumber )
+						bSamePacketAsMsg = true;
+				}
+
+				if ( bSamePacketAsMsg || seg.m_cbHdr + seg.m_cbSegSize > cbBytesRemainingForSegments )
+				{
+					vecSegments.pop_back();
+					cbBytesRemainingForSegments += cbSelectLane;
+					if ( !vecSegments.empty() )
+						break;
+
+					// Parity blocks can't be split.  If we can't fit one into an
+					// otherwise empty packet, something is weird (maybe the MTU
+					// got smaller).  It's just an optimization, so discard the
+					// rest of them rather than get stuck.
+					idxEncodeLane = 0;
+					lane.m_messagesQueued.pop_front();
+					m_senderState.m_cbPendingUnreliable -= pSendMsg->m_cbSize - lane.m_cbCurrentSendMessageSent;
+					Assert( m_senderState.m_cbPendingUnreliable >= 0 );
+					lane.m_cbCurrentSendMessageSent = 0;
+					pSendMsg->Release();
+					continue;
+				}
+
+				cbBytesRemainingForSegments -= seg.m_cbHdr + seg.m_cbSegSize;
+				m_senderState.AdvanceLaneVirtTime( lane, seg.m_cbSegSize );
+				lane.m_cbCurrentSendMessageSent += seg.m_cbSegSize;
+				if ( lane.m_cbCurrentSendMessageSent >= pSendMsg->m_cbSize )
+				{
+					Assert( lane.m_cbCurrentSendMessageSent == pSendMsg->m_cbSize );
+					lane.m_cbCurrentSendMessageSent = 0;
+					lane.m_messagesQueued.pop_front();
+				}
+
+				// Only one parity block per packet, so that losing one
+				// packet costs us at most one of them
+				break;
+			}
 
 			// Reliable?
 			bool bLastSegment = false;
@@ -1619,14 +2223,14 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 
 				// FIXME - Coalesce adjacent reliable messages ranges
 
-				int64 nBegin = pSendMsg->SNPSend_ReliableStreamPos() + m_senderState.m_cbCurrentSendMessageSent;
+				int64 nBegin = pSendMsg->SNPSend_ReliableStreamPos() + lane.m_cbCurrentSendMessageSent;
 
 				// How large would we like this segment to be,
 				// ignoring how much space is left in the packet.
 				// We limit the size of reliable segments, to make
 				// sure that we don't make an excessively large
 				// one and then have a hard time retrying it later.
-				int cbDesiredSegSize = pSendMsg->m_cbSize - m_senderState.m_cbCurrentSendMessageSent;
+				int cbDesiredSegSize = pSendMsg->m_cbSize - lane.m_cbCurrentSendMessageSent;
 				if ( cbDesiredSegSize > m_cbMaxReliableMessageSegment )
 				{
 					cbDesiredSegSize = m_cbMaxReliableMessageSegment;
@@ -1641,7 +2245,21 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 			}
 			else
 			{
-				seg.SetupUnreliable( pSendMsg, m_senderState.m_cbCurrentSendMessageSent, nLastMsgNum );
+				seg.SetupUnreliable( pSendMsg, lane.m_cbCurrentSendMessageSent, nLastMsgNum );
+
+				// If we are sending FEC parity for this message, don't let a
+				// segment span a chunk boundary, and end the packet after each
+				// chunk, so that losing a packet only damages one chunk.
+				const int cbFECChunk = pSendMsg->m_cbSNPSendFECChunk;
+				if ( cbFECChunk > 0 )
+				{
+					int nChunkEnd = ( lane.m_cbCurrentSendMessageSent / cbFECChunk + 1 ) * cbFECChunk;
+					if ( nChunkEnd < (int)pSendMsg->m_cbSize )
+					{
+						seg.m_cbSegSize = nChunkEnd - lane.m_cbCurrentSendMessageSent;
+						bLastSegment = true;
+					}
+				}
 			}
 
 			// Can't fit the whole thing?
@@ -1659,6 +2277,7 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 				{
 					// Don't send this segment now.
 					vecSegments.pop_back();
+					cbBytesRemainingForSegments += cbSelectLane;
 					break;
 				}
 
@@ -1668,23 +2287,25 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 
 				// Truncate, and leave the message in the queue
 				seg.m_cbSegSize = std::min( seg.m_cbSegSize, cbBytesRemainingForSegments - seg.m_cbHdr );
-				m_senderState.m_cbCurrentSendMessageSent += seg.m_cbSegSize;
-				Assert( m_senderState.m_cbCurrentSendMessageSent < pSendMsg->m_cbSize );
+				lane.m_cbCurrentSendMessageSent += seg.m_cbSegSize;
+				Assert( lane.m_cbCurrentSendMessageSent < pSendMsg->m_cbSize );
 				cbBytesRemainingForSegments -= seg.m_cbHdr + seg.m_cbSegSize;
+				m_senderState.AdvanceLaneVirtTime( lane, seg.m_cbSegSize );
 				break;
 			}
 
 			// The whole message fit (perhaps exactly, without the size byte)
 			// Reset send pointer for the next message
-			Assert( m_senderState.m_cbCurrentSendMessageSent + seg.m_cbSegSize == pSendMsg->m_cbSize );
-			m_senderState.m_cbCurrentSendMessageSent = 0;
+			Assert( lane.m_cbCurrentSendMessageSent + seg.m_cbSegSize == pSendMsg->m_cbSize );
+			lane.m_cbCurrentSendMessageSent = 0;
 
 			// Remove message from queue,w e have transfered ownership to the segment and will
 			// dispose of the message when we serialize the segments
-			m_senderState.m_messagesQueued.pop_front();
+			lane.m_messagesQueued.pop_front();
 
 			// Consume payload bytes
 			cbBytesRemainingForSegments -= seg.m_cbHdr + seg.m_cbSegSize;
+			m_senderState.AdvanceLaneVirtTime( lane, seg.m_cbSegSize );
 
 			// Assume for now this won't be the last segment, in which case we will also need the byte for the size field.
 			// NOTE: This might cause cbPayloadBytesRemaining to go negative by one!  I know that seems weird, but it actually
@@ -1700,7 +2321,7 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 					++nLastMsgNum;
 
 				// Go ahead and add us to the end of the list of unacked messages
-				m_senderState.m_unackedReliableMessages.push_back( seg.m_pMsg );
+				lane.m_unackedReliableMessages.push_back( seg.m_pMsg );
 			}
 			else
 			{
@@ -1749,9 +2370,9 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 
 	// We are gonna send a packet.  Start filling out an entry so that when it's acked (or nacked)
 	// we can know what to do.
-	Assert( m_senderState.m_mapInFlightPacketsByPktNum.lower_bound( m_statsEndToEnd.m_nNextSendSequenceNumber ) == m_senderState.m_mapInFlightPacketsByPktNum.end() );
-	std::pair<int64,SNPInFlightPacket_t> pairInsert( m_statsEndToEnd.m_nNextSendSequenceNumber, SNPInFlightPacket_t{ usecNow, false, pTransport, {} } );
-	SNPInFlightPacket_t &inFlightPkt = pairInsert.second;
+	const int64 nPktNum = m_statsEndToEnd.m_nNextSendSequenceNumber;
+	Assert( m_senderState.m_inFlightPackets.PktNumEnd() <= nPktNum );
+	SNPInFlightPacket_t inFlightPkt{ usecNow, false, pTransport, {} };
 
 	// We might have gone over exactly one byte, because we counted the size byte of the last
 	// segment, which doesn't actually need to be sent
@@ -1762,9 +2383,26 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 	for ( int idx = 0 ; idx < nSegments ; ++idx )
 	{
 		EncodedSegment &seg = vecSegments[ idx ];
+		SSNPSendLane &lane = m_senderState.m_vecLanes[ seg.m_idxLane ];
 
 		// Check if this message is still sitting in the queue.  (If so, it has to be the first one!)
-		bool bStillInQueue = ( seg.m_pMsg == m_senderState.m_messagesQueued.m_pFirst );
+		bool bStillInQueue = ( seg.m_pMsg == lane.m_messagesQueued.m_pFirst );
+
+		// Switch lanes?
+		if ( seg.m_idxLaneSelect >= 0 )
+		{
+			if ( seg.m_idxLaneSelect < 7 )
+			{
+				*(pPayloadPtr++) = uint8( 0x88 | seg.m_idxLaneSelect );
+			}
+			else
+			{
+				*(pPayloadPtr++) = 0x8f;
+				pPayloadPtr = SerializeVarInt( pPayloadPtr, (uint32)seg.m_idxLaneSelect );
+			}
+			SpewDebugGroup( nLogLevelPacketDecode, "[%s]   encode pkt %lld select lane %d\n",
+				GetDescription(), (long long)m_statsEndToEnd.m_nNextSendSequenceNumber, seg.m_idxLaneSelect );
+		}
 
 		// Finish the segment size byte
 		if ( idx < nSegments-1 )
@@ -1790,8 +2428,23 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 		memcpy( pPayloadPtr, seg.m_hdr, seg.m_cbHdr ); pPayloadPtr += seg.m_cbHdr;
 		Assert( pPayloadPtr+seg.m_cbSegSize <= pPayloadEnd );
 
-		// Reliable?
-		if ( seg.m_pMsg->SNPSend_IsReliable() )
+		// FEC parity?
+		if ( seg.m_pMsg->SNPSend_IsFECParity() )
+		{
+			memcpy( pPayloadPtr, (char*)seg.m_pMsg->m_pData + seg.m_nOffset, seg.m_cbSegSize );
+			pPayloadPtr += seg.m_cbSegSize;
+
+			SpewDebugGroup( nLogLevelPacketDecode, "[%s]   encode pkt %lld FEC parity msg %lld offset %d+%d=%d\n",
+				GetDescription(), (long long)m_statsEndToEnd.m_nNextSendSequenceNumber, (long long)seg.m_pMsg->m_nMessageNumber,
+				seg.m_nOffset, seg.m_cbSegSize, seg.m_nOffset+seg.m_cbSegSize );
+
+			m_senderState.m_cbPendingUnreliable -= seg.m_cbSegSize;
+			Assert( m_senderState.m_cbPendingUnreliable >= 0 );
+
+			if ( !bStillInQueue )
+				seg.m_pMsg->Release();
+		}
+		else if ( seg.m_pMsg->SNPSend_IsReliable() )
 		{
 			// We should never encode an empty range of the stream, that is worthless.
 			// (Even an empty reliable message requires some framing in the stream.)
@@ -1829,8 +2482,8 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 			// Ranges of the reliable stream that have not been acked should either be
 			// in flight, or queued for retry.  Make sure this range is not already in
 			// either state.
-			Assert( !HasOverlappingRange( range, m_senderState.m_listInFlightReliableRange ) );
-			Assert( !HasOverlappingRange( range, m_senderState.m_listReadyRetryReliableRange ) );
+			Assert( !lane.m_listInFlightReliableRange.HasOverlappingRange( range ) );
+			Assert( !lane.m_listReadyRetryReliableRange.HasOverlappingRange( range ) );
 
 			// Spew
 			SpewDebugGroup( nLogLevelPacketDecode, "[%s]   encode pkt %lld reliable msg %lld offset %d+%d=%d range [%lld,%lld)\n",
@@ -1839,10 +2492,10 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 				(long long)range.m_nBegin, (long long)range.m_nEnd );
 
 			// Add to table of in-flight reliable ranges
-			m_senderState.m_listInFlightReliableRange[ range ] = seg.m_pMsg;
+			lane.m_listInFlightReliableRange.Insert( range, seg.m_pMsg );
 
 			// Remember that this packet contained that range
-			inFlightPkt.m_vecReliableSegments.push_back( range );
+			inFlightPkt.m_vecReliableSegments.push_back( SNPLaneRange_t{ range, seg.m_idxLane } );
 
 			// Less reliable data pending
 			m_senderState.m_cbPendingReliable -= seg.m_cbSegSize;
@@ -1909,6 +2562,7 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 		break;
 
 		case k_EGameNetworkingSocketsCipher_AES_256_GCM:
+		case k_EGameNetworkingSocketsCipher_CHACHA20_POLY1305:
 		{
 
 			Assert( m_bCryptKeysValid );
@@ -1919,12 +2573,24 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 			// Encrypt the chunk
 			uint8 arEncryptedChunk[ k_cbGameNetworkingSocketsMaxEncryptedPayloadSend + 64 ]; // Should not need pad
 			uint32 cbEncrypted = sizeof(arEncryptedChunk);
-			DbgVerify( m_cryptContextSend.Encrypt(
-				payload, cbPlainText, // plaintext
-				m_cryptIVSend.m_buf, // IV
-				arEncryptedChunk, &cbEncrypted, // output
-				nullptr, 0 // no AAD
-			) );
+			if ( m_eNegotiatedCipher == k_EGameNetworkingSocketsCipher_CHACHA20_POLY1305 )
+			{
+				DbgVerify( m_cryptContextSendChaCha20.Encrypt(
+					payload, cbPlainText, // plaintext
+					m_cryptIVSend.m_buf, // IV
+					arEncryptedChunk, &cbEncrypted, // output
+					nullptr, 0 // no AAD
+				) );
+			}
+			else
+			{
+				DbgVerify( m_cryptContextSend.Encrypt(
+					payload, cbPlainText, // plaintext
+					m_cryptIVSend.m_buf, // IV
+					arEncryptedChunk, &cbEncrypted, // output
+					nullptr, 0 // no AAD
+				) );
+			}
 
 			//SpewMsg( "Send encrypt IV %llu + %02x%02x%02x%02x  encrypted %d %02x%02x%02x%02x\n",
 			//	*(uint64 *)&m_cryptIVSend.m_buf,
@@ -1946,10 +2612,6 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 	if ( nBytesSent <= 0 )
 		return false;
 
-	// We sent a packet.  Track it
-	auto pairInsertResult = m_senderState.m_mapInFlightPacketsByPktNum.insert( pairInsert );
-	Assert( pairInsertResult.second ); // We should have inserted a new element, not updated an existing element
-
 	// If we sent any reliable data, we should expect a reply
 	if ( !inFlightPkt.m_vecReliableSegments.empty() )
 	{
@@ -1957,9 +2619,14 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 		// FIXME - should let transport know
 	}
 
-	// If we aren't already tracking anything to timeout, then this is the next one.
-	if ( m_senderState.m_itNextInFlightPacketToTimeout == m_senderState.m_mapInFlightPacketsByPktNum.end() )
-		m_senderState.m_itNextInFlightPacketToTimeout = pairInsertResult.first;
+	// We sent a packet.  Track it
+	m_sendRateData.m_bbr.OnPacketSent( inFlightPkt, nBytesSent, usecNow );
+	m_senderState.m_inFlightPackets.Insert( nPktNum, std::move( inFlightPkt ) );
+
+	// Out of data?  Then rate samples from now on don't reflect
+	// the capacity of the network
+	if ( m_senderState.PendingBytesTotal() == 0 )
+		m_sendRateData.m_bbr.OnAppLimited();
 
 	#ifdef SNP_ENABLE_PACKETSENDLOG
 		pLog->m_cbSent = nBytesSent;
@@ -1972,9 +2639,10 @@ bool CGameNetworkConnectionBase::SNP_SendPacket( CConnectionTransport *pTranspor
 
 void CGameNetworkConnectionBase::SNP_SentNonDataPacket( CConnectionTransport *pTransport, int cbPkt, GameNetworkingMicroseconds usecNow )
 {
-	std::pair<int64,SNPInFlightPacket_t> pairInsert( m_statsEndToEnd.m_nNextSendSequenceNumber-1, SNPInFlightPacket_t{ usecNow, false, pTransport, {} } );
-	auto pairInsertResult = m_senderState.m_mapInFlightPacketsByPktNum.insert( pairInsert );
-	Assert( pairInsertResult.second ); // We should have inserted a new element, not updated an existing element.  Probably an order ofoperations bug with m_nNextSendSequenceNumber
+	// NOTE: If this asserts, it's probably an order of operations bug with m_nNextSendSequenceNumber
+	SNPInFlightPacket_t inFlightPkt{ usecNow, false, pTransport, {} };
+	m_sendRateData.m_bbr.OnPacketSent( inFlightPkt, cbPkt, usecNow );
+	m_senderState.m_inFlightPackets.Insert( m_statsEndToEnd.m_nNextSendSequenceNumber-1, std::move( inFlightPkt ) );
 
 	// Spend tokens from the bucket
 	m_sendRateData.m_flTokenBucket -= (float)cbPkt;
@@ -1986,7 +2654,9 @@ void CGameNetworkConnectionBase::SNP_GatherAckBlocks( SNPAckSerializerHelper &he
 	helper.m_nBlocksNeedToAck = 0;
 
 	// Fast case for no packet loss we need to ack, which will (hopefully!) be a common case
-	int n = len( m_receiverState.m_mapPacketGaps ) - 1;
+	int n = m_receiverState.m_mapPacketGaps.size() - 1;
+	if ( m_receiverState.OpenPacketGap( m_statsEndToEnd.m_nMaxRecvPktNum ) )
+		--n; // We can't report on that one yet
 	if ( n <= 0 )
 		return;
 
@@ -2037,10 +2707,8 @@ void CGameNetworkConnectionBase::SNP_GatherAckBlocks( SNPAckSerializerHelper &he
 
 		int64 nAckEnd;
 		GameNetworkingMicroseconds usecWhenSentLast;
-		if ( n == 0 )
+		if ( itNext->first == INT64_MAX )
 		{
-			// itNext should be the sentinel
-			Assert( itNext->first == INT64_MAX );
 			nAckEnd = m_statsEndToEnd.m_nMaxRecvPktNum+1;
 			usecWhenSentLast = m_statsEndToEnd.m_usecTimeLastRecvSeq;
 		}
@@ -2103,7 +2771,7 @@ uint8 *CGameNetworkConnectionBase::SNP_SerializeAckBlocks( const SNPAckSerialize
 	// 10011000 - ack frame designator, with 16-bit last-received sequence number, and no ack blocks
 	*pAckHeaderByte = 0x98;
 
-	int nLogLevelPacketDecode = m_connectionConfig.m_LogLevel_PacketDecode.Get();
+	int nLogLevelPacketDecode = ConfigSnapshot().m_LogLevel_PacketDecode;
 
 	#ifdef SNP_ENABLE_PACKETSENDLOG
 		PacketSendLog *pLog = &m_vecSendLog[ m_vecSendLog.size()-1 ];
@@ -2120,7 +2788,7 @@ uint8 *CGameNetworkConnectionBase::SNP_SerializeAckBlocks( const SNPAckSerialize
 			GetDescription(),
 			(long long)m_statsEndToEnd.m_nNextSendSequenceNumber, (long long)nLastRecvPktNum
 		);
-		m_receiverState.m_mapPacketGaps.rbegin()->second.m_usecWhenAckPrior = INT64_MAX; // Clear timer, we wrote everything we needed to
+		m_receiverState.m_mapPacketGaps.back().second.m_usecWhenAckPrior = INT64_MAX; // Clear timer, we wrote everything we needed to
 
 		#ifdef SNP_ENABLE_PACKETSENDLOG
 			pLog->m_nAckBlocksSent = 0;
@@ -2143,6 +2811,7 @@ uint8 *CGameNetworkConnectionBase::SNP_SerializeAckBlocks( const SNPAckSerialize
 		if ( nBlocks == 0 )
 		{
 			auto itOldestGap = m_receiverState.m_mapPacketGaps.begin();
+			Assert( itOldestGap->first < INT64_MAX );
 			int64 nLastRecvPktNum = itOldestGap->first-1;
 			*pLatestPktNum = LittleWord( uint16( nLastRecvPktNum ) );
 			*pTimeSinceLatestPktNum = LittleWord( (uint16)SNPAckSerializerHelper::EncodeTimeSince( usecNow, itOldestGap->second.m_usecWhenReceivedPktBefore ) );
@@ -2157,8 +2826,20 @@ uint8 *CGameNetworkConnectionBase::SNP_SerializeAckBlocks( const SNPAckSerialize
 				pLog->m_nAckEnd = nLastRecvPktNum;
 			#endif
 
-			// Acked packets before this gap.  Were we waiting to flush them?
-			if ( itOldestGap == m_receiverState.m_itPendingAck )
+			// Acked packets before this gap.  If it's open, then that's
+			// everything we can report right now.  Otherwise, were we waiting
+			// to flush them?
+			if ( itOldestGap == m_receiverState.OpenPacketGap( m_statsEndToEnd.m_nMaxRecvPktNum ) )
+			{
+				for (;;)
+				{
+					m_receiverState.m_itPendingAck->second.m_usecWhenAckPrior = INT64_MAX;
+					if ( m_receiverState.m_itPendingAck->first == INT64_MAX )
+						break;
+					++m_receiverState.m_itPendingAck;
+				}
+			}
+			else if ( itOldestGap == m_receiverState.m_itPendingAck )
 			{
 				// Mark it as sent
 				m_receiverState.m_itPendingAck->second.m_usecWhenAckPrior = INT64_MAX;
@@ -2212,10 +2893,12 @@ uint8 *CGameNetworkConnectionBase::SNP_SerializeAckBlocks( const SNPAckSerialize
 		(long long)m_statsEndToEnd.m_nNextSendSequenceNumber, (long long)(nAckEnd-1), nBlocks, (long long)m_statsEndToEnd.m_nMaxRecvPktNum
 	);
 
-	// Check for a common case where we report on everything
-	if ( nAckEnd > m_statsEndToEnd.m_nMaxRecvPktNum )
+	// Check for a common case where we report on everything.  (Or
+	// everything we can, if the newest gap is open.)
+	auto itOpenGap = m_receiverState.OpenPacketGap( m_statsEndToEnd.m_nMaxRecvPktNum );
+	if ( nAckEnd > m_statsEndToEnd.m_nMaxRecvPktNum || ( itOpenGap && nAckEnd == itOpenGap->first ) )
 	{
-		Assert( nAckEnd == m_statsEndToEnd.m_nMaxRecvPktNum+1 );
+		Assert( nAckEnd == ( itOpenGap ? itOpenGap->first : m_statsEndToEnd.m_nMaxRecvPktNum+1 ) );
 		for (;;)
 		{
 			m_receiverState.m_itPendingAck->second.m_usecWhenAckPrior = INT64_MAX;
@@ -2223,7 +2906,7 @@ uint8 *CGameNetworkConnectionBase::SNP_SerializeAckBlocks( const SNPAckSerialize
 				break;
 			++m_receiverState.m_itPendingAck;
 		}
-		m_receiverState.m_itPendingNack = m_receiverState.m_itPendingAck;
+		m_receiverState.m_itPendingNack = itOpenGap ? itOpenGap : m_receiverState.m_itPendingAck;
 	}
 	else
 	{
@@ -2327,7 +3010,7 @@ uint8 *CGameNetworkConnectionBase::SNP_SerializeStopWaitingFrame( uint8 *pOut, c
 	// Calculate offset from the current sequence number
 	int64 nOffset = m_statsEndToEnd.m_nNextSendSequenceNumber - m_senderState.m_nMinPktWaitingOnAck;
 	AssertMsg2( nOffset > 0, "Told peer to stop acking up to %lld, but latest packet we have sent is %lld", (long long)m_senderState.m_nMinPktWaitingOnAck, (long long)m_statsEndToEnd.m_nNextSendSequenceNumber );
-	SpewVerboseGroup( m_connectionConfig.m_LogLevel_PacketDecode.Get(), "[%s]   encode pkt %lld stop_waiting offset %lld = %lld",
+	SpewVerboseGroup( ConfigSnapshot().m_LogLevel_PacketDecode, "[%s]   encode pkt %lld stop_waiting offset %lld = %lld",
 		GetDescription(),
 		(long long)m_statsEndToEnd.m_nNextSendSequenceNumber, (long long)nOffset, (long long)m_senderState.m_nMinPktWaitingOnAck );
 
@@ -2379,14 +3062,14 @@ uint8 *CGameNetworkConnectionBase::SNP_SerializeStopWaitingFrame( uint8 *pOut, c
 	return pOut;
 }
 
-void CGameNetworkConnectionBase::SNP_ReceiveUnreliableSegment( int64 nMsgNum, int nOffset, const void *pSegmentData, int cbSegmentSize, bool bLastSegmentInMessage, GameNetworkingMicroseconds usecNow )
+void CGameNetworkConnectionBase::SNP_ReceiveUnreliableSegment( int64 nMsgNum, int idxLane, int nOffset, const void *pSegmentData, int cbSegmentSize, bool bLastSegmentInMessage, GameNetworkingMicroseconds usecNow )
 {
-	SpewDebugGroup( m_connectionConfig.m_LogLevel_PacketDecode.Get(), "[%s] RX msg %lld offset %d+%d=%d %02x ... %02x\n", GetDescription(), nMsgNum, nOffset, cbSegmentSize, nOffset+cbSegmentSize, ((byte*)pSegmentData)[0], ((byte*)pSegmentData)[cbSegmentSize-1] );
+	SpewDebugGroup( ConfigSnapshot().m_LogLevel_PacketDecode, "[%s] RX msg %lld offset %d+%d=%d %02x ... %02x\n", GetDescription(), nMsgNum, nOffset, cbSegmentSize, nOffset+cbSegmentSize, ((byte*)pSegmentData)[0], ((byte*)pSegmentData)[cbSegmentSize-1] );
 
 	// Ignore data segments when we are not going to process them (e.g. linger)
 	if ( GetState() != k_EGameNetworkingConnectionState_Connected )
 	{
-		SpewDebugGroup( m_connectionConfig.m_LogLevel_PacketDecode.Get(), "[%s] discarding msg %lld [%d,%d) as connection is in state %d\n",
+		SpewDebugGroup( ConfigSnapshot().m_LogLevel_PacketDecode, "[%s] discarding msg %lld [%d,%d) as connection is in state %d\n",
 			GetDescription(),
 			nMsgNum,
 			nOffset, nOffset+cbSegmentSize,
@@ -2400,10 +3083,54 @@ void CGameNetworkConnectionBase::SNP_ReceiveUnreliableSegment( int64 nMsgNum, in
 
 		// Deliver it immediately, don't go through the fragmentation assembly process below.
 		// (Although that would work.)
-		ReceivedMessage( pSegmentData, cbSegmentSize, nMsgNum, k_nGameNetworkingSend_Unreliable, usecNow );
+		ReceivedMessage( pSegmentData, cbSegmentSize, nMsgNum, k_nGameNetworkingSend_Unreliable, idxLane, usecNow );
 		return;
 	}
 
+	// Message fragment.  Find/insert the entry in our reassembly queue
+	SSNPRecvUnreliableSegmentData *pData = SNP_AddUnreliableSegment( nMsgNum, nOffset, cbSegmentSize, bLastSegmentInMessage, usecNow );
+	if ( !pData )
+		return;
+	memcpy( pData->m_buf, pSegmentData, cbSegmentSize );
+
+	// Now check if that completed the message
+	SNP_CheckUnreliableMessageComplete( nMsgNum, idxLane, usecNow );
+}
+
+void CGameNetworkConnectionBase::SNP_ReceiveUnreliableParity( int64 nMsgNum, int idxLane, int cbMsgSize, int cbChunk, int nGroupSize, int nFirstChunk, const void *pParityData, int cbParity, GameNetworkingMicroseconds usecNow )
+{
+	SpewDebugGroup( ConfigSnapshot().m_LogLevel_PacketDecode, "[%s] RX FEC parity msg %lld size %d chunk %d group %d first %d\n",
+		GetDescription(), (long long)nMsgNum, cbMsgSize, cbChunk, nGroupSize, nFirstChunk );
+
+	// Ignore data segments when we are not going to process them (e.g. linger)
+	if ( GetState() != k_EGameNetworkingConnectionState_Connected )
+		return;
+
+	// If we don't have any pieces of this message, then either we already
+	// received the whole thing, or we have lost so much of it that parity
+	// can't help.  Either way, don't waste space holding onto this.
+	SSNPRecvUnreliableSegmentKey key;
+	key.m_nMsgNum = nMsgNum;
+	key.m_nOffset = 0;
+	auto it = m_receiverState.m_mapUnreliableSegments.lower_bound( key );
+	if ( it == m_receiverState.m_mapUnreliableSegments.end() || it->first.m_nMsgNum != nMsgNum )
+		return;
+
+	SSNPRecvUnreliableSegmentData *pData = SNP_AddUnreliableSegment( nMsgNum, -1 - nFirstChunk, cbParity, false, usecNow );
+	if ( !pData )
+		return;
+	pData->m_cbFECMsgSize = cbMsgSize;
+	pData->m_cbFECChunk = cbChunk;
+	pData->m_nFECGroupSize = nGroupSize;
+	memcpy( pData->m_buf, pParityData, cbParity );
+
+	// Maybe that lets us rebuild something
+	SNP_CheckUnreliableMessageComplete( nMsgNum, idxLane, usecNow );
+}
+
+SSNPRecvUnreliableSegmentData *CGameNetworkConnectionBase::SNP_AddUnreliableSegment( int64 nMsgNum, int nOffset, int cbSegmentSize, bool bLastSegmentInMessage, GameNetworkingMicroseconds usecNow )
+{
+
 	// Limit number of unreliable segments we store.  We just use a fixed
 	// limit, rather than trying to be smart by expiring based on time or whatever.
 	if ( len( m_receiverState.m_mapUnreliableSegments ) > k_nMaxBufferedUnreliableSegments )
@@ -2428,7 +3155,6 @@ void CGameNetworkConnectionBase::SNP_ReceiveUnreliableSegment( int64 nMsgNum, in
 		}
 	}
 
-	// Message fragment.  Find/insert the entry in our reassembly queue
 	// I really hate this syntax and interface.
 	SSNPRecvUnreliableSegmentKey key;
 	key.m_nMsgNum = nMsgNum;
@@ -2444,23 +3170,132 @@ void CGameNetworkConnectionBase::SNP_ReceiveUnreliableSegment( int64 nMsgNum, in
 
 		// Just drop the segment.  Note that the sender might have sent a longer segment from the previous
 		// one, in which case this segment contains new data, and is not therefore redundant.  That seems
-		// "legal", but very weird, and not worth handling.  If senders do retransmit unreliable segments
-		// (perhaps FEC?) then they need to retransmit the exact same segments.
-		return;
+		// "legal", but very weird, and not worth handling.  (This is also why we rebuild segments
+		// from FEC parity exactly where the holes are.)
+		return nullptr;
 	}
 
-	// Segment in the map either just got inserted, or is a subset of the segment
-	// we just received.  Replace it.
+	// Segment in the map just got inserted.  Caller fills in the data
 	data.m_cbSegSize = cbSegmentSize;
 	Assert( !data.m_bLast );
 	data.m_bLast = bLastSegmentInMessage;
-	memcpy( data.m_buf, pSegmentData, cbSegmentSize );
+	return &data;
+}
 
-	// Now check if that completed the message
+void CGameNetworkConnectionBase::SNP_RecoverUnreliableSegmentsFEC( int64 nMsgNum )
+{
+	auto &mapSegments = m_receiverState.m_mapUnreliableSegments;
+	SSNPRecvUnreliableSegmentKey key;
+	key.m_nMsgNum = nMsgNum;
+	key.m_nOffset = INT_MIN;
+	auto itParity = mapSegments.lower_bound( key );
+	key.m_nOffset = 0;
+	while ( itParity != mapSegments.end() && itParity->first.m_nMsgNum == nMsgNum && itParity->first.m_nOffset < 0 )
+	{
+		const SSNPRecvUnreliableSegmentData &parity = itParity->second;
+		const int cbChunk = parity.m_cbFECChunk;
+		const int nGroupBegin = ( -1 - itParity->first.m_nOffset ) * cbChunk;
+		const int nGroupEnd = std::min( nGroupBegin + parity.m_nFECGroupSize*cbChunk, parity.m_cbFECMsgSize );
+
+		// Locate the holes in this group.  (Segments shouldn't overlap, but
+		// handle it if they do.)  If there are more holes than this, they
+		// can't all be in one chunk, because the sender doesn't fragment
+		// chunks that badly.
+		constexpr int k_nMaxHoles = 8;
+		int arHoleBegin[ k_nMaxHoles ], arHoleEnd[ k_nMaxHoles ];
+		int nHoles = 0;
+		auto AddHole = [&]( int nBegin, int nEnd )
+		{
+			if ( nHoles < k_nMaxHoles )
+			{
+				arHoleBegin[ nHoles ] = nBegin;
+				arHoleEnd[ nHoles ] = nEnd;
+			}
+			++nHoles;
+		};
+		int nCovered = nGroupBegin;
+		for ( auto it = mapSegments.lower_bound( key ) ; it != mapSegments.end() && it->first.m_nMsgNum == nMsgNum ; ++it )
+		{
+			int nSegBegin = it->first.m_nOffset;
+			if ( nSegBegin >= nGroupEnd )
+				break;
+			if ( nSegBegin > nCovered )
+				AddHole( nCovered, nSegBegin );
+			nCovered = std::max( nCovered, nSegBegin + it->second.m_cbSegSize );
+		}
+		if ( nCovered < nGroupEnd )
+			AddHole( nCovered, nGroupEnd );
+
+		// Nothing missing?  Then we don't need the parity anymore
+		if ( nHoles == 0 )
+		{
+			itParity = mapSegments.erase( itParity );
+			continue;
+		}
+
+		// We can only rebuild one chunk per group
+		const int nChunkBegin = arHoleBegin[0] / cbChunk * cbChunk;
+		const int nChunkEnd = std::min( nChunkBegin + cbChunk, nGroupEnd );
+		if ( nHoles > k_nMaxHoles || arHoleEnd[ nHoles-1 ] > nChunkEnd )
+		{
+			++itParity;
+			continue;
+		}
+
+		// The missing chunk is the parity XOR all the other chunks in the group
+		uint8 chunk[ k_cbMaxUnreliableSegmentSizeRecv ];
+		memcpy( chunk, parity.m_buf, parity.m_cbSegSize );
+		nCovered = nGroupBegin;
+		for ( auto it = mapSegments.lower_bound( key ) ; it != mapSegments.end() && it->first.m_nMsgNum == nMsgNum ; ++it )
+		{
+			int nSegBegin = it->first.m_nOffset;
+			int nBegin = std::max( nSegBegin, nCovered );
+			int nEnd = std::min( nSegBegin + it->second.m_cbSegSize, nGroupEnd );
+			while ( nBegin < nEnd )
+			{
+				int nThisChunkBegin = nBegin / cbChunk * cbChunk;
+				int nPieceEnd = std::min( nEnd, nThisChunkBegin + cbChunk );
+				if ( nThisChunkBegin != nChunkBegin )
+					FECXorBytes( chunk + nBegin - nThisChunkBegin, (const uint8 *)it->second.m_buf + nBegin - nSegBegin, nPieceEnd - nBegin );
+				nBegin = nPieceEnd;
+			}
+			nCovered = std::max( nCovered, nEnd );
+		}
+
+		// Fill in exactly the holes
+		for ( int i = 0 ; i < nHoles ; ++i )
+		{
+			SSNPRecvUnreliableSegmentKey keyHole;
+			keyHole.m_nMsgNum = nMsgNum;
+			keyHole.m_nOffset = arHoleBegin[i];
+			SSNPRecvUnreliableSegmentData &data = mapSegments[ keyHole ];
+			Assert( data.m_cbSegSize < 0 );
+			data.m_cbSegSize = arHoleEnd[i] - arHoleBegin[i];
+			data.m_bLast = ( arHoleEnd[i] == parity.m_cbFECMsgSize );
+			memcpy( data.m_buf, chunk + arHoleBegin[i] - nChunkBegin, data.m_cbSegSize );
+		}
+
+		SpewDebugGroup( ConfigSnapshot().m_LogLevel_PacketDecode, "[%s] FEC rebuilt msg %lld [%d,%d) from parity\n",
+			GetDescription(), (long long)nMsgNum, arHoleBegin[0], arHoleEnd[ nHoles-1 ] );
+		++m_receiverState.m_nUnreliableSegmentsRecoveredFEC;
+		itParity = mapSegments.erase( itParity );
+	}
+}
+
+void CGameNetworkConnectionBase::SNP_CheckUnreliableMessageComplete( int64 nMsgNum, int idxLane, GameNetworkingMicroseconds usecNow )
+{
+	auto &mapSegments = m_receiverState.m_mapUnreliableSegments;
+
+	// Use any parity we have to fill holes
+	SNP_RecoverUnreliableSegmentsFEC( nMsgNum );
+
+	SSNPRecvUnreliableSegmentKey key;
+	key.m_nMsgNum = nMsgNum;
 	key.m_nOffset = 0;
-	auto itMsgStart = m_receiverState.m_mapUnreliableSegments.lower_bound( key );
-	auto end = m_receiverState.m_mapUnreliableSegments.end();
-	Assert( itMsgStart != end );
+	auto itMsgStart = mapSegments.lower_bound( key );
+	auto end = mapSegments.end();
+	if ( itMsgStart == end )
+		return;
 	auto itMsgLast = itMsgStart;
 	int cbMessageSize = 0;
 	for (;;)
@@ -2486,43 +3321,44 @@ void CGameNetworkConnectionBase::SNP_ReceiveUnreliableSegment( int64 nMsgNum, in
 	CGameNetworkingMessage *pMsg = CGameNetworkingMessage::New( this, cbMessageSize, nMsgNum, k_nGameNetworkingSend_Unreliable, usecNow );
 	if ( !pMsg )
 		return;
+	pMsg->m_idxLane = (uint16)idxLane;
 
 	// OK, we have the complete message!  Gather the
 	// segments into a contiguous buffer
-	for (;;)
+	for ( auto it = itMsgStart ;; ++it )
 	{
-		Assert( itMsgStart->first.m_nMsgNum == nMsgNum );
-		memcpy( (char *)pMsg->m_pData + itMsgStart->first.m_nOffset, itMsgStart->second.m_buf, itMsgStart->second.m_cbSegSize );
+		Assert( it->first.m_nMsgNum == nMsgNum );
+		memcpy( (char *)pMsg->m_pData + it->first.m_nOffset, it->second.m_buf, it->second.m_cbSegSize );
 
 		// Done?
-		if ( itMsgStart->second.m_bLast )
+		if ( it == itMsgLast )
 			break;
-
-		// Remove entry from list, and move onto the next entry
-		itMsgStart = m_receiverState.m_mapUnreliableSegments.erase( itMsgStart );
 	}
 
-	// Erase the last segment, and anything else we might have hanging around
-	// for this message (???)
+	// Erase everything we have for this message, including any parity
+	// we didn't need and anything past the end (???)
+	key.m_nOffset = INT_MIN;
+	auto itErase = mapSegments.lower_bound( key );
 	do {
-		itMsgStart = m_receiverState.m_mapUnreliableSegments.erase( itMsgStart );
-	} while ( itMsgStart != end && itMsgStart->first.m_nMsgNum == nMsgNum );
+		itErase = mapSegments.erase( itErase );
+	} while ( itErase != end && itErase->first.m_nMsgNum == nMsgNum );
 
 	// Deliver the message.
 	ReceivedMessage( pMsg );
 }
 
-bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int64 nSegBegin, const uint8 *pSegmentData, int cbSegmentSize, GameNetworkingMicroseconds usecNow )
+bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int idxLane, int64 nSegBegin, const uint8 *pSegmentData, int cbSegmentSize, GameNetworkingMicroseconds usecNow )
 {
-	int nLogLevelPacketDecode = m_connectionConfig.m_LogLevel_PacketDecode.Get();
+	int nLogLevelPacketDecode = ConfigSnapshot().m_LogLevel_PacketDecode;
 
 	// Calculate segment end stream position
 	int64 nSegEnd = nSegBegin + cbSegmentSize;
+	SSNPRecvLane &lane = m_receiverState.m_vecLanes[ idxLane ];
 
 	// Spew
-	SpewVerboseGroup( nLogLevelPacketDecode, "[%s]   decode pkt %lld reliable range [%lld,%lld)\n",
+	SpewVerboseGroup( nLogLevelPacketDecode, "[%s]   decode pkt %lld lane %d reliable range [%lld,%lld)\n",
 		GetDescription(),
-		(long long)nPktNum,
+		(long long)nPktNum, idxLane,
 		(long long)nSegBegin, (long long)nSegEnd );
 
 	// No segment data?  Seems fishy, but if it happens, just skip it.
@@ -2561,7 +3397,7 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 
 	// Check if the entire thing is stuff we have already received, then
 	// we can discard it
-	if ( nSegEnd <= m_receiverState.m_nReliableStreamPos )
+	if ( nSegEnd <= lane.m_nReliableStreamPos )
 		return true;
 
 	// !SPEED! Should we have a fast path here for small messages
@@ -2569,13 +3405,13 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 	// stream buffer and decode directly.
 
 	// What do we expect to receive next?
-	const int64 nExpectNextStreamPos = m_receiverState.m_nReliableStreamPos + len( m_receiverState.m_bufReliableStream );
+	const int64 nExpectNextStreamPos = lane.m_nReliableStreamPos + len( lane.m_bufReliableStream );
 
 	// Check if we need to grow the reliable buffer to hold the data
 	if ( nSegEnd > nExpectNextStreamPos )
 	{
-		int64 cbNewSize = nSegEnd - m_receiverState.m_nReliableStreamPos;
-		Assert( cbNewSize > len( m_receiverState.m_bufReliableStream ) );
+		int64 cbNewSize = nSegEnd - lane.m_nReliableStreamPos;
+		Assert( cbNewSize > len( lane.m_bufReliableStream ) );
 
 		// Check if we have too much data buffered, just stop processing
 		// this packet, and forget we ever received it.  We need to protect
@@ -2590,9 +3426,9 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 			SpewWarningRateLimited( usecNow, "[%s] decode pkt %lld abort.  %lld bytes reliable data buffered [%lld-%lld), new size would be %lld to %lld\n",
 				GetDescription(),
 				(long long)nPktNum,
-				(long long)m_receiverState.m_bufReliableStream.size(),
-				(long long)m_receiverState.m_nReliableStreamPos,
-				(long long)( m_receiverState.m_nReliableStreamPos + m_receiverState.m_bufReliableStream.size() ),
+				(long long)lane.m_bufReliableStream.size(),
+				(long long)lane.m_nReliableStreamPos,
+				(long long)( lane.m_nReliableStreamPos + lane.m_bufReliableStream.size() ),
 				(long long)cbNewSize, (long long)nSegEnd
 			);
 			return false;  // DO NOT ACK THIS PACKET
@@ -2601,16 +3437,16 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 		// Check if this is going to make a new gap
 		if ( nSegBegin > nExpectNextStreamPos )
 		{
-			if ( !m_receiverState.m_mapReliableStreamGaps.empty() )
+			if ( !lane.m_mapReliableStreamGaps.empty() )
 			{
 
 				// We should never have a gap at the very end of the buffer.
 				// (Why would we extend the buffer, unless we needed to to
 				// store some data?)
-				Assert( m_receiverState.m_mapReliableStreamGaps.rbegin()->second < nExpectNextStreamPos );
+				Assert( lane.m_mapReliableStreamGaps.back().second < nExpectNextStreamPos );
 
 				// We need to add a new gap.  See if we're already too fragmented.
-				if ( len( m_receiverState.m_mapReliableStreamGaps ) >= k_nMaxReliableStreamGaps_Extend )
+				if ( lane.m_mapReliableStreamGaps.size() >= k_nMaxReliableStreamGaps_Extend )
 				{
 					// Stop processing the packet, and don't ack it
 					// This indicates the connection is in pretty bad shape,
@@ -2618,9 +3454,9 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 					SpewWarningRateLimited( usecNow, "[%s] decode pkt %lld abort.  Reliable stream already has %d fragments, first is [%lld,%lld), last is [%lld,%lld), new segment is [%lld,%lld)\n",
 						GetDescription(),
 						(long long)nPktNum,
-						len( m_receiverState.m_mapReliableStreamGaps ),
-						(long long)m_receiverState.m_mapReliableStreamGaps.begin()->first, (long long)m_receiverState.m_mapReliableStreamGaps.begin()->second,
-						(long long)m_receiverState.m_mapReliableStreamGaps.rbegin()->first, (long long)m_receiverState.m_mapReliableStreamGaps.rbegin()->second,
+						lane.m_mapReliableStreamGaps.size(),
+						(long long)lane.m_mapReliableStreamGaps.front().first, (long long)lane.m_mapReliableStreamGaps.front().second,
+						(long long)lane.m_mapReliableStreamGaps.back().first, (long long)lane.m_mapReliableStreamGaps.back().second,
 						(long long)nSegBegin, (long long)nSegEnd
 					);
 					return false;  // DO NOT ACK THIS PACKET
@@ -2628,9 +3464,9 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 			}
 
 			// Add a gap
-			m_receiverState.m_mapReliableStreamGaps[ nExpectNextStreamPos ] = nSegBegin;
+			lane.m_mapReliableStreamGaps.insert( nExpectNextStreamPos, nSegBegin );
 		}
-		m_receiverState.m_bufReliableStream.resize( size_t( cbNewSize ) );
+		lane.m_bufReliableStream.resize( size_t( cbNewSize ) );
 	}
 
 	// If segment overlapped the existing buffer, we might need to discard the front
@@ -2639,9 +3475,9 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 	{
 
 		// Check if the front bit has already been processed, then skip it
-		if ( nSegBegin < m_receiverState.m_nReliableStreamPos )
+		if ( nSegBegin < lane.m_nReliableStreamPos )
 		{
-			int nSkip = m_receiverState.m_nReliableStreamPos - nSegBegin;
+			int nSkip = lane.m_nReliableStreamPos - nSegBegin;
 			cbSegmentSize -= nSkip;
 			pSegmentData += nSkip;
 			nSegBegin += nSkip;
@@ -2649,10 +3485,10 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 		Assert( nSegBegin < nSegEnd );
 
 		// Check if this filled in one or more gaps (or made a hole in the middle!)
-		if ( !m_receiverState.m_mapReliableStreamGaps.empty() )
+		if ( !lane.m_mapReliableStreamGaps.empty() )
 		{
-			auto gapFilled = m_receiverState.m_mapReliableStreamGaps.upper_bound( nSegBegin );
-			if ( gapFilled != m_receiverState.m_mapReliableStreamGaps.begin() )
+			auto gapFilled = lane.m_mapReliableStreamGaps.upper_bound( nSegBegin );
+			if ( gapFilled != lane.m_mapReliableStreamGaps.begin() )
 			{
 				--gapFilled;
 				Assert( gapFilled->first < gapFilled->second ); // Make sure we don't have degenerate/invalid gaps in our table
@@ -2667,8 +3503,8 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 							if ( nSegEnd < gapFilled->second )
 							{
 								// We filled the first bit of the gap.  Chop off the front bit that we filled.
-								// We cast away const here because we know that we aren't violating the ordering constraints
-								const_cast<int64&>( gapFilled->first ) = nSegEnd;
+								// We know that we aren't violating the ordering constraints
+								gapFilled->first = nSegEnd;
 								break;
 							}
 
@@ -2676,7 +3512,7 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 							// Erase, and move forward in case this also fills more gaps
 							// !SPEED! Since exactly filing the gap should be common, we might
 							// check specifically for that case and early out here.
-							gapFilled = m_receiverState.m_mapReliableStreamGaps.erase( gapFilled );
+							gapFilled = lane.m_mapReliableStreamGaps.erase( gapFilled );
 						}
 						else if ( nSegEnd >= gapFilled->second )
 						{
@@ -2696,15 +3532,15 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 							// Protect against malicious sender.  A good sender will
 							// fill the gaps in stream position order and not fragment
 							// like this
-							if ( len( m_receiverState.m_mapReliableStreamGaps ) >= k_nMaxReliableStreamGaps_Fragment )
+							if ( lane.m_mapReliableStreamGaps.size() >= k_nMaxReliableStreamGaps_Fragment )
 							{
 								// Stop processing the packet, and don't ack it
 								SpewWarningRateLimited( usecNow, "[%s] decode pkt %lld abort.  Reliable stream already has %d fragments, first is [%lld,%lld), last is [%lld,%lld).  We don't want to fragment [%lld,%lld) with new segment [%lld,%lld)\n",
 									GetDescription(),
 									(long long)nPktNum,
-									len( m_receiverState.m_mapReliableStreamGaps ),
-									(long long)m_receiverState.m_mapReliableStreamGaps.begin()->first, (long long)m_receiverState.m_mapReliableStreamGaps.begin()->second,
-									(long long)m_receiverState.m_mapReliableStreamGaps.rbegin()->first, (long long)m_receiverState.m_mapReliableStreamGaps.rbegin()->second,
+									lane.m_mapReliableStreamGaps.size(),
+									(long long)lane.m_mapReliableStreamGaps.front().first, (long long)lane.m_mapReliableStreamGaps.front().second,
+									(long long)lane.m_mapReliableStreamGaps.back().first, (long long)lane.m_mapReliableStreamGaps.back().second,
 									(long long)gapFilled->first, (long long)gapFilled->second,
 									(long long)nSegBegin, (long long)nSegEnd
 								);
@@ -2719,7 +3555,7 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 							gapFilled->second = nSegBegin;
 
 							// Add the right hand gap
-							m_receiverState.m_mapReliableStreamGaps[ nRightHandBegin ] = nRightHandEnd;
+							lane.m_mapReliableStreamGaps.insert( nRightHandBegin, nRightHandEnd );
 
 							// And we know that we cannot possible have covered any more gaps
 							break;
@@ -2727,7 +3563,7 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 
 						// In some rare cases we might fill more than one gap with a single segment.
 						// So keep searching forward.
-					} while ( gapFilled != m_receiverState.m_mapReliableStreamGaps.end() && gapFilled->first < nSegEnd );
+					} while ( gapFilled != lane.m_mapReliableStreamGaps.end() && gapFilled->first < nSegEnd );
 				}
 			}
 		}
@@ -2736,21 +3572,21 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 	// Copy the data into the buffer.
 	// It might be redundant, but if so, we aren't going to take the
 	// time to figure that out.
-	int nBufOffset = nSegBegin - m_receiverState.m_nReliableStreamPos;
+	int nBufOffset = nSegBegin - lane.m_nReliableStreamPos;
 	Assert( nBufOffset >= 0 );
-	Assert( nBufOffset+cbSegmentSize <= len( m_receiverState.m_bufReliableStream ) );
-	memcpy( &m_receiverState.m_bufReliableStream[nBufOffset], pSegmentData, cbSegmentSize );
+	Assert( nBufOffset+cbSegmentSize <= len( lane.m_bufReliableStream ) );
+	memcpy( &lane.m_bufReliableStream[nBufOffset], pSegmentData, cbSegmentSize );
 
 	// Figure out how many valid bytes are at the head of the buffer
 	int nNumReliableBytes;
-	if ( m_receiverState.m_mapReliableStreamGaps.empty() )
+	if ( lane.m_mapReliableStreamGaps.empty() )
 	{
-		nNumReliableBytes = len( m_receiverState.m_bufReliableStream );
+		nNumReliableBytes = len( lane.m_bufReliableStream );
 	}
 	else
 	{
-		auto firstGap = m_receiverState.m_mapReliableStreamGaps.begin();
-		Assert( firstGap->first >= m_receiverState.m_nReliableStreamPos );
+		auto firstGap = lane.m_mapReliableStreamGaps.begin();
+		Assert( firstGap->first >= lane.m_nReliableStreamPos );
 		if ( firstGap->first < nSegBegin )
 		{
 			// There's gap in front of us, and therefore if we didn't have
@@ -2761,9 +3597,9 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 
 		// We do have a gap, but it's somewhere after this segment.
 		Assert( firstGap->first >= nSegEnd );
-		nNumReliableBytes = firstGap->first - m_receiverState.m_nReliableStreamPos;
+		nNumReliableBytes = firstGap->first - lane.m_nReliableStreamPos;
 		Assert( nNumReliableBytes > 0 );
-		Assert( nNumReliableBytes < len( m_receiverState.m_bufReliableStream ) ); // The last byte in the buffer should always be valid!
+		Assert( nNumReliableBytes < len( lane.m_bufReliableStream ) ); // The last byte in the buffer should always be valid!
 	}
 	Assert( nNumReliableBytes > 0 );
 
@@ -2776,7 +3612,7 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 		// each time we get a new packet.  We could cache off the result if we find out
 		// that it's worth while.  It should be pretty fast, though, so let's keep the
 		// code simple until we know that it's worthwhile.
-		uint8 *pReliableStart = &m_receiverState.m_bufReliableStream[0];
+		uint8 *pReliableStart = &lane.m_bufReliableStream[0];
 		uint8 *pReliableDecode = pReliableStart;
 		uint8 *pReliableEnd = pReliableDecode + nNumReliableBytes;
 
@@ -2784,8 +3620,8 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 		SpewDebugGroup( nLogLevelPacketDecode, "[%s]   decode pkt %lld valid reliable bytes = %d [%lld,%lld)\n",
 			GetDescription(),
 			(long long)nPktNum, nNumReliableBytes,
-			(long long)m_receiverState.m_nReliableStreamPos,
-			(long long)( m_receiverState.m_nReliableStreamPos + nNumReliableBytes ) );
+			(long long)lane.m_nReliableStreamPos,
+			(long long)( lane.m_nReliableStreamPos + nNumReliableBytes ) );
 
 		// Sanity check that we have a valid header byte.
 		uint8 nHeaderByte = *(pReliableDecode++);
@@ -2796,7 +3632,7 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 		}
 
 		// Parse the message number
-		int64 nMsgNum = m_receiverState.m_nLastRecvReliableMsgNum;
+		int64 nMsgNum = lane.m_nLastRecvReliableMsgNum;
 		if ( nHeaderByte & 0x40 )
 		{
 			uint64 nOffset;
@@ -2820,7 +3656,7 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 			{
 				ConnectionState_ProblemDetectedLocally( k_EGameNetConnectionEnd_Misc_InternalError,
 					"Reliable message number lurch.  Last reliable %lld, offset %llu, highest seen %lld",
-					(long long)m_receiverState.m_nLastRecvReliableMsgNum, (unsigned long long)nOffset,
+					(long long)lane.m_nLastRecvReliableMsgNum, (unsigned long long)nOffset,
 					(long long)m_receiverState.m_nHighestSeenMsgNum );
 				return false;
 			}
@@ -2877,17 +3713,17 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 		}
 
 		// We have a full message!  Queue it
-		if ( !ReceivedMessage( pReliableDecode, cbMsgSize, nMsgNum, k_nGameNetworkingSend_Reliable, usecNow ) )
+		if ( !ReceivedMessage( pReliableDecode, cbMsgSize, nMsgNum, k_nGameNetworkingSend_Reliable, idxLane, usecNow ) )
 			return false; // Weird failure.  Most graceful response is to not ack this packet, and maybe we will work next on retry.
 		pReliableDecode += cbMsgSize;
 		int cbStreamConsumed = pReliableDecode-pReliableStart;
 
 		// Advance bookkeeping
-		m_receiverState.m_nLastRecvReliableMsgNum = nMsgNum;
-		m_receiverState.m_nReliableStreamPos += cbStreamConsumed;
+		lane.m_nLastRecvReliableMsgNum = nMsgNum;
+		lane.m_nReliableStreamPos += cbStreamConsumed;
 
 		// Remove the data from the from the front of the buffer
-		pop_from_front( m_receiverState.m_bufReliableStream, cbStreamConsumed );
+		pop_from_front( lane.m_bufReliableStream, cbStreamConsumed );
 
 		// We might have more in the stream that is ready to dispatch right now.
 		nNumReliableBytes -= cbStreamConsumed;
@@ -2896,7 +3732,7 @@ bool CGameNetworkConnectionBase::SNP_ReceiveReliableSegment( int64 nPktNum, int6
 	return true; // packet is OK, can be acked, and continue processing it
 }
 
-void CGameNetworkConnectionBase::SNP_RecordReceivedPktNum( int64 nPktNum, GameNetworkingMicroseconds usecNow, bool bScheduleAck )
+void CGameNetworkConnectionBase::SNP_RecordReceivedPktNum( int64 nPktNum, GameNetworkingMicroseconds usecNow, GameNetworkingMicroseconds usecWhenReceived, bool bScheduleAck, bool bMarkReceived )
 {
 
 	// Check if sender has already told us they don't need us to
@@ -2905,7 +3741,7 @@ void CGameNetworkConnectionBase::SNP_RecordReceivedPktNum( int64 nPktNum, GameNe
 		return;
 
 	// Fast path for the (hopefully) most common case of packets arriving in order
-	if ( likely( nPktNum == m_statsEndToEnd.m_nMaxRecvPktNum+1 ) )
+	if ( likely( nPktNum == m_statsEndToEnd.m_nMaxRecvPktNum+1 && bMarkReceived ) )
 	{
 		if ( bScheduleAck ) // fast path for all unreliable data (common when we are just being used for transport)
 		{
@@ -2921,35 +3757,66 @@ void CGameNetworkConnectionBase::SNP_RecordReceivedPktNum( int64 nPktNum, GameNe
 
 	// Latest time that this packet should be acked.
 	// (We might already be scheduled to send and ack that would include this packet.)
-	GameNetworkingMicroseconds usecScheduleAck = bScheduleAck ? usecNow + k_usecMaxDataAckDelay : INT64_MAX;
+	GameNetworkingMicroseconds usecScheduleAck = bScheduleAck && bMarkReceived ? usecNow + k_usecMaxDataAckDelay : INT64_MAX;
 
 	// Check if this introduced a gap since the last sequence packet we have received
 	if ( nPktNum > m_statsEndToEnd.m_nMaxRecvPktNum )
 	{
 
-		// Protect against malicious sender!
-		if ( len( m_receiverState.m_mapPacketGaps ) >= k_nMaxPacketGaps )
-			return; // Nope, we will *not* actually mark the packet as received
+		// If we are acting as if we didn't receive this packet, then it
+		// goes in the gap, too.  The sequence tracker is going to advance past
+		// it, so this is our only record that we need to nack it.  (Until we
+		// receive a packet after it, this gap is "open", and we cannot report
+		// on it.  See SSNPReceiverState::OpenPacketGap.)
+		int64 nBegin = m_statsEndToEnd.m_nMaxRecvPktNum+1;
+		int64 nEnd = bMarkReceived ? nPktNum : nPktNum+1;
+
+		// If the newest gap is open, then it runs right up to here, and we
+		// just extend it.  Also, protect against malicious sender!  If we
+		// can't track any more gaps, extend the newest one.  We'll nack some
+		// packets that we actually received, but never ack one that we didn't.
+		if ( m_receiverState.m_mapPacketGaps.size() > 1 )
+		{
+			auto itNewest = &m_receiverState.m_mapPacketGaps.back() - 1;
+			if ( itNewest->second.m_nEnd == nBegin || m_receiverState.m_mapPacketGaps.full() )
+			{
+				Assert( itNewest->second.m_nEnd <= nBegin );
+				itNewest->second.m_nEnd = nEnd;
+
+				SpewMsgGroup( ConfigSnapshot().m_LogLevel_PacketGaps, "[%s] drop pkts, gap extended to [%lld-%lld)",
+					GetDescription(),
+					(long long)itNewest->first, (long long)nEnd );
+
+				// Make sure we nack the packets we just added
+				if ( m_receiverState.m_itPendingNack->first == INT64_MAX )
+					m_receiverState.m_itPendingNack = itNewest;
+
+				// At this point, ack invariants should be met
+				m_receiverState.DebugCheckPackGapMap();
+
+				QueueFlushAllAcks( usecScheduleAck );
+				return;
+			}
+		}
+		Assert( !m_receiverState.m_mapPacketGaps.full() );
 
 		// Add a gap for the skipped packet(s).
-		int64 nBegin = m_statsEndToEnd.m_nMaxRecvPktNum+1;
-		std::pair<int64,SSNPPacketGap> x;
-		x.first = nBegin;
-		x.second.m_nEnd = nPktNum;
-		x.second.m_usecWhenReceivedPktBefore = m_statsEndToEnd.m_usecTimeLastRecvSeq;
-		x.second.m_usecWhenAckPrior = m_receiverState.m_mapPacketGaps.rbegin()->second.m_usecWhenAckPrior;
+		SSNPPacketGap x;
+		x.m_nEnd = nEnd;
+		x.m_usecWhenReceivedPktBefore = m_statsEndToEnd.m_usecTimeLastRecvSeq;
+		x.m_usecWhenAckPrior = m_receiverState.m_mapPacketGaps.back().second.m_usecWhenAckPrior;
 
 		// When should we nack this?
-		x.second.m_usecWhenOKToNack = usecNow;
+		x.m_usecWhenOKToNack = usecNow;
 		if ( nPktNum < m_statsEndToEnd.m_nMaxRecvPktNum + 3 )
-			x.second.m_usecWhenOKToNack += k_usecNackFlush;
+			x.m_usecWhenOKToNack += k_usecNackFlush;
 
-		auto iter = m_receiverState.m_mapPacketGaps.insert( x ).first;
+		auto iter = m_receiverState.InsertPacketGap( nBegin, x );
 
-		SpewMsgGroup( m_connectionConfig.m_LogLevel_PacketGaps.Get(), "[%s] drop %d pkts [%lld-%lld)",
+		SpewMsgGroup( ConfigSnapshot().m_LogLevel_PacketGaps, "[%s] drop %d pkts [%lld-%lld)",
 			GetDescription(),
-			(int)( nPktNum - nBegin ),
-			(long long)nBegin, (long long)nPktNum );
+			(int)( nEnd - nBegin ),
+			(long long)nBegin, (long long)nEnd );
 
 		// Remember that we need to send a NACK
 		if ( m_receiverState.m_itPendingNack->first == INT64_MAX )
@@ -2977,7 +3844,7 @@ void CGameNetworkConnectionBase::SNP_RecordReceivedPktNum( int64 nPktNum, GameNe
 		// time
 		QueueFlushAllAcks( usecScheduleAck );
 	}
-	else
+	else if ( bMarkReceived )
 	{
 
 		// Check if this filed a gap
@@ -3028,7 +3895,7 @@ void CGameNetworkConnectionBase::SNP_RecordReceivedPktNum( int64 nPktNum, GameNe
 
 				// Gap is totally filled.  Erase, and move to the next one,
 				// if any, so we can schedule ack below
-				itGap = m_receiverState.m_mapPacketGaps.erase( itGap );
+				itGap = m_receiverState.ErasePacketGap( itGap );
 
 				// Were we scheduled to ack the packets before this?  If so, then
 				// we still need to do that, only now when we send that ack, we will
@@ -3051,13 +3918,12 @@ void CGameNetworkConnectionBase::SNP_RecordReceivedPktNum( int64 nPktNum, GameNe
 					// case, the invariant is that m_itPendingAck should point at the sentinel
 					if ( m_receiverState.m_itPendingAck->second.m_usecWhenAckPrior == INT64_MAX )
 					{
-						m_receiverState.m_itPendingAck = m_receiverState.m_mapPacketGaps.end();
-						--m_receiverState.m_itPendingAck;
+						m_receiverState.m_itPendingAck = &m_receiverState.m_mapPacketGaps.back();
 						Assert( m_receiverState.m_itPendingAck->first == INT64_MAX );
 					}
 				}
 
-				SpewVerboseGroup( m_connectionConfig.m_LogLevel_PacketGaps.Get(), "[%s] decode pkt %lld, single pkt gap filled", GetDescription(), (long long)nPktNum );
+				SpewVerboseGroup( ConfigSnapshot().m_LogLevel_PacketGaps, "[%s] decode pkt %lld, single pkt gap filled", GetDescription(), (long long)nPktNum );
 
 				// At this point, ack invariants should be met
 				m_receiverState.DebugCheckPackGapMap();
@@ -3068,7 +3934,7 @@ void CGameNetworkConnectionBase::SNP_RecordReceivedPktNum( int64 nPktNum, GameNe
 				--itGap->second.m_nEnd;
 				Assert( itGap->first < itGap->second.m_nEnd );
 
-				SpewVerboseGroup( m_connectionConfig.m_LogLevel_PacketGaps.Get(), "[%s] decode pkt %lld, last packet in gap, reduced to [%lld,%lld)", GetDescription(),
+				SpewVerboseGroup( ConfigSnapshot().m_LogLevel_PacketGaps, "[%s] decode pkt %lld, last packet in gap, reduced to [%lld,%lld)", GetDescription(),
 					(long long)nPktNum, (long long)itGap->first, (long long)itGap->second.m_nEnd );
 
 				// Move to the next gap so we can schedule ack below
@@ -3081,14 +3947,13 @@ void CGameNetworkConnectionBase::SNP_RecordReceivedPktNum( int64 nPktNum, GameNe
 		else if ( itGap->first == nPktNum )
 		{
 			// First packet in multi-packet gap.
-			// Shrink packet from the front
-			// Cast away const to allow us to modify the key.
+			// Shrink packet from the front.
 			// We know this won't break the map ordering
-			++const_cast<int64&>( itGap->first );
+			++itGap->first;
 			Assert( itGap->first < itGap->second.m_nEnd );
-			itGap->second.m_usecWhenReceivedPktBefore = usecNow;
+			itGap->second.m_usecWhenReceivedPktBefore = usecWhenReceived;
 
-			SpewVerboseGroup( m_connectionConfig.m_LogLevel_PacketGaps.Get(), "[%s] decode pkt %lld, first packet in gap, reduced to [%lld,%lld)", GetDescription(),
+			SpewVerboseGroup( ConfigSnapshot().m_LogLevel_PacketGaps, "[%s] decode pkt %lld, first packet in gap, reduced to [%lld,%lld)", GetDescription(),
 				(long long)nPktNum, (long long)itGap->first, (long long)itGap->second.m_nEnd );
 
 			// At this point, ack invariants should be met
@@ -3098,7 +3963,7 @@ void CGameNetworkConnectionBase::SNP_RecordReceivedPktNum( int64 nPktNum, GameNe
 		{
 			// Packet is in the middle of the gap.  We'll need to fragment this gap
 			// Protect against malicious sender!
-			if ( len( m_receiverState.m_mapPacketGaps ) >= k_nMaxPacketGaps )
+			if ( m_receiverState.m_mapPacketGaps.full() )
 				return; // Nope, we will *not* actually mark the packet as received
 
 			// Locate the next block so we can set the schedule time
@@ -3106,26 +3971,25 @@ void CGameNetworkConnectionBase::SNP_RecordReceivedPktNum( int64 nPktNum, GameNe
 			++itNext;
 
 			// Start making a new gap to account for the upper end
-			std::pair<int64,SSNPPacketGap> upper;
-			upper.first = nPktNum+1;
-			upper.second.m_nEnd = itGap->second.m_nEnd;
-			upper.second.m_usecWhenReceivedPktBefore = usecNow;
+			SSNPPacketGap upper;
+			upper.m_nEnd = itGap->second.m_nEnd;
+			upper.m_usecWhenReceivedPktBefore = usecWhenReceived;
 			if ( itNext == m_receiverState.m_itPendingAck )
-				upper.second.m_usecWhenAckPrior = INT64_MAX;
+				upper.m_usecWhenAckPrior = INT64_MAX;
 			else
-				upper.second.m_usecWhenAckPrior = itNext->second.m_usecWhenAckPrior;
-			upper.second.m_usecWhenOKToNack = itGap->second.m_usecWhenOKToNack;
+				upper.m_usecWhenAckPrior = itNext->second.m_usecWhenAckPrior;
+			upper.m_usecWhenOKToNack = itGap->second.m_usecWhenOKToNack;
 
 			// Truncate the current gap
 			itGap->second.m_nEnd = nPktNum;
 			Assert( itGap->first < itGap->second.m_nEnd );
 
-			SpewVerboseGroup( m_connectionConfig.m_LogLevel_PacketGaps.Get(), "[%s] decode pkt %lld, gap split [%lld,%lld) and [%lld,%lld)", GetDescription(),
-				(long long)nPktNum, (long long)itGap->first, (long long)itGap->second.m_nEnd, upper.first, upper.second.m_nEnd );
+			SpewVerboseGroup( ConfigSnapshot().m_LogLevel_PacketGaps, "[%s] decode pkt %lld, gap split [%lld,%lld) and [%lld,%lld)", GetDescription(),
+				(long long)nPktNum, (long long)itGap->first, (long long)itGap->second.m_nEnd, (long long)( nPktNum+1 ), (long long)upper.m_nEnd );
 
 			// Insert a new gap to account for the upper end, and
 			// advance iterator to it, so that we can schedule ack below
-			itGap = m_receiverState.m_mapPacketGaps.insert( upper ).first;
+			itGap = m_receiverState.InsertPacketGap( nPktNum+1, upper );
 
 			// At this point, ack invariants should be met
 			m_receiverState.DebugCheckPackGapMap();
@@ -3204,12 +4068,303 @@ void CGameNetworkConnectionBase::SNP_RecordReceivedPktNum( int64 nPktNum, GameNe
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Delivery rate based congestion control
+//-----------------------------------------------------------------------------
+
+// Pacing gain cycle used in ProbeBW.  Probe for more bandwidth for one
+// min RTT, then drain any queue that created, then cruise
+static const float s_arBBRPacingGainCycle[ k_nBBRGainCycleLen ] = { 1.25f, 0.75f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+
+void SSNPBBRState::Init( int nInitialBtlBw, GameNetworkingMicroseconds usecNow )
+{
+	// NOTE: We leave the delivery state alone, we only reset the model
+
+	// Seed the max filter with the initial estimate.  It will age
+	// out after k_nBBRBtlBwFilterRounds
+	memset( m_arBtlBwRoundMax, 0, sizeof(m_arBtlBwRoundMax) );
+	m_nBtlBwFilterRound = m_nRoundCount;
+	m_arBtlBwRoundMax[ m_nRoundCount % k_nBBRBtlBwFilterRounds ] = nInitialBtlBw;
+	m_nBtlBw = nInitialBtlBw;
+
+	m_usecMinRTT = 0;
+	m_usecMinRTTStamp = usecNow;
+	m_bMinRTTExpired = false;
+
+	m_bFilledPipe = false;
+	m_nFullBw = 0;
+	m_nFullBwCount = 0;
+	m_nCycleIndex = 0;
+	m_usecCycleStamp = usecNow;
+	m_usecProbeRTTDoneStamp = 0;
+	SetMode( k_EMode_Startup, k_flBBRHighGain, k_flBBRHighGain );
+}
+
+int64 SSNPBBRState::BDP() const
+{
+	if ( m_usecMinRTT <= 0 )
+		return INT64_MAX;
+	return m_nBtlBw * m_usecMinRTT / k_nMillion;
+}
+
+int64 SSNPBBRState::CongestionWindow() const
+{
+	const int64 cbMinCwnd = k_nBBRMinCwndPackets * k_cbGameNetworkingSocketsMaxEncryptedPayloadSend;
+	if ( m_eMode == k_EMode_ProbeRTT )
+		return cbMinCwnd;
+
+	// No RTT measurement yet?  Then we can only go by the pacing rate
+	if ( m_usecMinRTT <= 0 )
+		return INT64_MAX;
+
+	GameNetworkingMicroseconds usecWindow = GameNetworkingMicroseconds( m_usecMinRTT * m_flCwndGain ) + k_usecMaxDataAckDelay;
+	return std::max( m_nBtlBw * usecWindow / k_nMillion, cbMinCwnd );
+}
+
+void SSNPBBRState::OnPacketSent( SNPInFlightPacket_t &pkt, int cbSent, GameNetworkingMicroseconds usecNow )
+{
+	// Starting from idle?  Then the next sample should not include
+	// the time we spent not sending anything
+	if ( m_cbInFlight <= 0 )
+	{
+		m_usecFirstSentTime = usecNow;
+		m_usecDeliveredTime = usecNow;
+	}
+
+	pkt.m_cbSent = cbSent;
+	pkt.m_bAppLimited = ( m_nAppLimitedUntil != 0 );
+	pkt.m_nDeliveredAtSend = m_nDelivered;
+	pkt.m_usecDeliveredTimeAtSend = m_usecDeliveredTime;
+	pkt.m_usecFirstSentTimeAtSend = m_usecFirstSentTime;
+
+	m_cbInFlight += cbSent;
+}
+
+void SSNPBBRState::OnPacketAcked( const SNPInFlightPacket_t &pkt, GameNetworkingMicroseconds usecNow )
+{
+	// If we already declared it lost, it was removed from in flight then
+	if ( !pkt.m_bNack )
+		m_cbInFlight -= pkt.m_cbSent;
+	Assert( m_cbInFlight >= 0 );
+
+	m_nDelivered += pkt.m_cbSent;
+	m_usecDeliveredTime = usecNow;
+	if ( m_nAppLimitedUntil != 0 && m_nDelivered > m_nAppLimitedUntil )
+		m_nAppLimitedUntil = 0;
+
+	// Take the sample from the most recently sent packet.  Acks
+	// are processed newest first, so on a tie keep the first one.
+	if ( pkt.m_nDeliveredAtSend > m_nSamplePriorDelivered )
+	{
+		m_nSamplePriorDelivered = pkt.m_nDeliveredAtSend;
+		m_usecSamplePriorTime = pkt.m_usecDeliveredTimeAtSend;
+		m_usecSampleSendElapsed = pkt.m_usecWhenSent - pkt.m_usecFirstSentTimeAtSend;
+		m_usecSampleAckElapsed = usecNow - pkt.m_usecDeliveredTimeAtSend;
+		m_bSampleAppLimited = pkt.m_bAppLimited;
+		m_usecFirstSentTime = pkt.m_usecWhenSent;
+	}
+}
+
+void SSNPBBRState::OnRTTSample( GameNetworkingMicroseconds usecRTT, GameNetworkingMicroseconds usecNow )
+{
+	usecRTT = std::max( usecRTT, (GameNetworkingMicroseconds)1 );
+	m_bMinRTTExpired = usecNow > m_usecMinRTTStamp + k_usecBBRMinRTTFilterLen;
+	if ( m_usecMinRTT <= 0 || usecRTT <= m_usecMinRTT || m_bMinRTTExpired )
+	{
+		m_usecMinRTT = usecRTT;
+		m_usecMinRTTStamp = usecNow;
+	}
+}
+
+void SSNPBBRState::OnAckFrameProcessed( GameNetworkingMicroseconds usecNow )
+{
+	// Anything acked?
+	if ( m_nSamplePriorDelivered >= 0 )
+	{
+
+		// Round trip counting
+		bool bRoundStart = false;
+		if ( m_nSamplePriorDelivered >= m_nNextRoundDelivered )
+		{
+			m_nNextRoundDelivered = m_nDelivered;
+			++m_nRoundCount;
+			bRoundStart = true;
+		}
+
+		// Delivery rate sample.  Use the longer of the send and ack
+		// intervals, so that ack compression doesn't inflate the rate.
+		// Samples over less than one min RTT are not reliable.
+		GameNetworkingMicroseconds usecInterval = std::max( m_usecSampleSendElapsed, m_usecSampleAckElapsed );
+		if ( usecInterval > 0 && usecInterval >= m_usecMinRTT )
+		{
+			int64 nRate = ( m_nDelivered - m_nSamplePriorDelivered ) * k_nMillion / usecInterval;
+			UpdateBtlBw( (int)std::min( nRate, (int64)INT_MAX ), m_bSampleAppLimited );
+		}
+
+		if ( bRoundStart )
+			CheckFullPipe();
+	}
+
+	// Update state machine
+	switch ( m_eMode )
+	{
+		case k_EMode_Startup:
+			if ( m_bFilledPipe )
+				SetMode( k_EMode_Drain, 1.0f / k_flBBRHighGain, k_flBBRHighGain );
+			break;
+
+		case k_EMode_Drain:
+			// Delayed acks make our in flight count somewhat pessimistic,
+			// so don't wait forever for it to drop
+			if ( m_cbInFlight <= BDP() || m_nRoundCount - m_nModeStartRound > k_nBBRFullBwRounds )
+				EnterProbeBW( usecNow );
+			break;
+
+		case k_EMode_ProbeBW:
+			AdvanceCyclePhase( usecNow );
+			break;
+
+		case k_EMode_ProbeRTT:
+			break;
+	}
+	CheckProbeRTT( usecNow );
+
+	// Reset sample for next ack frame
+	m_nSamplePriorDelivered = -1;
+	m_cbLostThisAck = 0;
+}
+
+void SSNPBBRState::SetMode( EMode eMode, float flPacingGain, float flCwndGain )
+{
+	m_eMode = eMode;
+	m_flPacingGain = flPacingGain;
+	m_flCwndGain = flCwndGain;
+	m_nModeStartRound = m_nRoundCount;
+}
+
+void SSNPBBRState::UpdateBtlBw( int nRate, bool bAppLimited )
+{
+
+	// Advance the window to the current round, forgetting old rounds
+	int nAdvance = m_nRoundCount - m_nBtlBwFilterRound;
+	if ( nAdvance > 0 )
+	{
+		for ( int i = 1 ; i <= std::min( nAdvance, k_nBBRBtlBwFilterRounds ) ; ++i )
+			m_arBtlBwRoundMax[ ( m_nBtlBwFilterRound + i ) % k_nBBRBtlBwFilterRounds ] = 0;
+		m_nBtlBwFilterRound = m_nRoundCount;
+	}
+
+	// App-limited samples only tell us the bandwidth is at least this
+	// much, so only use them if they would raise the estimate
+	int &nRoundMax = m_arBtlBwRoundMax[ m_nRoundCount % k_nBBRBtlBwFilterRounds ];
+	if ( !bAppLimited || nRate >= m_nBtlBw )
+		nRoundMax = std::max( nRoundMax, nRate );
+
+	int nMax = 0;
+	for ( int x: m_arBtlBwRoundMax )
+		nMax = std::max( nMax, x );
+
+	// If all we have had recently are app-limited samples, keep
+	// the old estimate
+	if ( nMax > 0 )
+		m_nBtlBw = nMax;
+}
+
+void SSNPBBRState::CheckFullPipe()
+{
+	if ( m_bFilledPipe || m_bSampleAppLimited )
+		return;
+
+	// Still growing?
+	if ( m_nBtlBw >= m_nFullBw * k_flBBRFullBwThresh )
+	{
+		m_nFullBw = m_nBtlBw;
+		m_nFullBwCount = 0;
+		return;
+	}
+
+	if ( ++m_nFullBwCount >= k_nBBRFullBwRounds )
+		m_bFilledPipe = true;
+}
+
+void SSNPBBRState::EnterProbeBW( GameNetworkingMicroseconds usecNow )
+{
+	// Start at a random phase, other than the drain phase, so that
+	// multiple flows don't probe in lockstep
+	m_nCycleIndex = k_nBBRGainCycleLen - 1 - WeakRandomInt( 0, k_nBBRGainCycleLen-3 );
+	m_usecCycleStamp = usecNow;
+	SetMode( k_EMode_ProbeBW, s_arBBRPacingGainCycle[ m_nCycleIndex ], k_flBBRCwndGain );
+}
+
+void SSNPBBRState::AdvanceCyclePhase( GameNetworkingMicroseconds usecNow )
+{
+	bool bFullLength = usecNow - m_usecCycleStamp > m_usecMinRTT;
+	bool bAdvance;
+	if ( m_flPacingGain > 1.0f )
+	{
+		// Keep probing until we have had a chance to fill the pipe,
+		// unless we are seeing loss
+		bAdvance = bFullLength && ( m_cbLostThisAck > 0 || m_cbInFlight >= BDP() * m_flPacingGain );
+	}
+	else if ( m_flPacingGain < 1.0f )
+	{
+		// Leave as soon as the queue has drained
+		bAdvance = bFullLength || m_cbInFlight <= BDP();
+	}
+	else
+	{
+		bAdvance = bFullLength;
+	}
+	if ( !bAdvance )
+		return;
+
+	m_nCycleIndex = ( m_nCycleIndex + 1 ) % k_nBBRGainCycleLen;
+	m_usecCycleStamp = usecNow;
+	m_flPacingGain = s_arBBRPacingGainCycle[ m_nCycleIndex ];
+}
+
+void SSNPBBRState::CheckProbeRTT( GameNetworkingMicroseconds usecNow )
+{
+	if ( m_eMode != k_EMode_ProbeRTT )
+	{
+		// Haven't seen a new min RTT in a while?  Then cut the
+		// congestion window to drain any queue we might have built,
+		// so we can measure it
+		if ( !m_bMinRTTExpired )
+			return;
+		m_bMinRTTExpired = false;
+		m_usecProbeRTTDoneStamp = 0;
+		SetMode( k_EMode_ProbeRTT, 1.0f, 1.0f );
+		return;
+	}
+
+	// Once we have drained, spend at least one round, and
+	// at least k_usecBBRProbeRTTDuration
+	if ( m_usecProbeRTTDoneStamp == 0 )
+	{
+		if ( m_cbInFlight > CongestionWindow() )
+			return;
+		m_usecProbeRTTDoneStamp = usecNow + k_usecBBRProbeRTTDuration;
+		m_nModeStartRound = m_nRoundCount;
+	}
+	if ( usecNow < m_usecProbeRTTDoneStamp || m_nRoundCount <= m_nModeStartRound )
+		return;
+
+	m_usecMinRTTStamp = usecNow;
+	if ( m_bFilledPipe )
+		EnterProbeBW( usecNow );
+	else
+		SetMode( k_EMode_Startup, k_flBBRHighGain, k_flBBRHighGain );
+}
+
+//-----------------------------------------------------------------------------
 int CGameNetworkConnectionBase::SNP_ClampSendRate()
 {
-	// Get effective clamp limits.  We clamp the limits themselves to be safe
-	// and make sure they are sane
-	int nMin = Clamp( m_connectionConfig.m_SendRateMin.Get(), 1024, 100*1024*1024 );
-	int nMax = Clamp( m_connectionConfig.m_SendRateMax.Get(), nMin, 100*1024*1024 );
+	// Get effective clamp limits.  (The snapshot has already clamped
+	// the limits themselves to make sure they are sane)
+	const ConnectionConfigSnapshot &config = ConfigSnapshot();
+	int nMin = config.m_nSendRateMin;
+	int nMax = config.m_nSendRateMax;
 
 	// Check if application has disabled bandwidth estimation
 	if ( nMin == nMax )
@@ -3232,8 +4387,17 @@ int CGameNetworkConnectionBase::SNP_ClampSendRate()
 			m_sendRateData.m_nCurrentSendRateEstimate = nMin;
 		}
 
-		// FIXME - In the future we might implement BBR probe cycle
-		m_sendRateData.m_flCurrentSendRateUsed = m_sendRateData.m_nCurrentSendRateEstimate;
+		// Use delivery rate model?
+		if ( ConfigSnapshot().m_CongestionControl == k_nGameNetworkingConfig_CongestionControl_BBR )
+		{
+			const SSNPBBRState &bbr = m_sendRateData.m_bbr;
+			m_sendRateData.m_nCurrentSendRateEstimate = Clamp( bbr.BtlBw(), nMin, nMax );
+			m_sendRateData.m_flCurrentSendRateUsed = Clamp( bbr.BtlBw() * bbr.PacingGain(), (float)nMin, (float)nMax );
+		}
+		else
+		{
+			m_sendRateData.m_flCurrentSendRateUsed = m_sendRateData.m_nCurrentSendRateEstimate;
+		}
 	}
 
 	// Return value
@@ -3327,6 +4491,18 @@ void CGameNetworkConnectionBase::SNP_TokenBucket_Accumulate( GameNetworkingMicro
 	{
 		m_sendRateData.m_flTokenBucket = k_flSendRateBurstOverageAllowance;
 	}
+
+	// When pacing, don't let us make up for more than a short amount of
+	// lost time, even if we have data ready, or else we'll send it all in a
+	// burst.  The service thread wakes up on time when we are pacing, so
+	// this shouldn't cost us much throughput.
+	const int usecPacingMaxBurst = g_Config_SendPacingMaxBurst.Get();
+	if ( usecPacingMaxBurst > 0 )
+	{
+		const float flMaxTokens = std::max( k_flSendRateBurstOverageAllowance, m_sendRateData.m_flCurrentSendRateUsed * usecPacingMaxBurst * 1e-6f );
+		if ( m_sendRateData.m_flTokenBucket > flMaxTokens )
+			m_sendRateData.m_flTokenBucket = flMaxTokens;
+	}
 }
 
 void SSNPReceiverState::QueueFlushAllAcks( GameNetworkingMicroseconds usecWhen )
@@ -3336,8 +4512,7 @@ void SSNPReceiverState::QueueFlushAllAcks( GameNetworkingMicroseconds usecWhen )
 	Assert( usecWhen > 0 ); // zero is reserved and should never be used as a requested wake time
 
 	// if we're already scheduled for earlier, then there cannot be any work to do
-	auto it = m_mapPacketGaps.end();
-	--it;
+	auto it = &m_mapPacketGaps.back();
 	if ( it->second.m_usecWhenAckPrior <= usecWhen )
 		return;
 	it->second.m_usecWhenAckPrior = usecWhen;
@@ -3370,7 +4545,7 @@ void SSNPReceiverState::DebugCheckPackGapMap() const
 	int64 nPrevEnd = 0;
 	GameNetworkingMicroseconds usecPrevAck = 0;
 	bool bFoundPendingAck = false;
-	for ( auto it: m_mapPacketGaps )
+	for ( const auto &it: m_mapPacketGaps )
 	{
 		Assert( it.first > nPrevEnd );
 		if ( it.first == m_itPendingAck->first )
@@ -3403,6 +4578,12 @@ void SSNPReceiverState::DebugCheckPackGapMap() const
 }
 #endif
 
+bool CGameNetworkConnectionBase::SNP_BCongestionWindowFull() const
+{
+	// Only BBR uses a congestion window
+	return ConfigSnapshot().m_CongestionControl == k_nGameNetworkingConfig_CongestionControl_BBR && m_sendRateData.m_bbr.BCongestionWindowFull();
+}
+
 GameNetworkingMicroseconds CGameNetworkConnectionBase::SNP_TimeWhenWantToSendNextPacket() const
 {
 	// Connection must be locked, but we don't require the global lock here!
@@ -3415,18 +4596,24 @@ GameNetworkingMicroseconds CGameNetworkConnectionBase::SNP_TimeWhenWantToSendNex
 		return k_nThinkTime_Never;
 	}
 
-	// Reliable triggered?  Then send it right now
-	if ( !m_senderState.m_listReadyRetryReliableRange.empty() )
+	// Reliable triggered?  Then send it right now.  Even if the congestion
+	// window is full, we don't hold back data that we know was lost.  (It
+	// isn't in flight anymore, and the receiver is probably waiting on it.)
+	if ( m_senderState.HasReadyRetryReliableRange() )
 		return 0;
 
+	// Congestion window full?  Then we can't send any new data until
+	// something is acked or declared lost.  We might still need to nack
+	if ( SNP_BCongestionWindowFull() )
+		return m_receiverState.TimeWhenOKToNack( m_statsEndToEnd.m_nMaxRecvPktNum );
+
 	// Anything queued?
-	GameNetworkingMicroseconds usecNextSend;
-	if ( m_senderState.m_messagesQueued.empty() )
+	GameNetworkingMicroseconds usecNextSend = m_senderState.UsecNagleNextMessage();
+	if ( usecNextSend == k_nThinkTime_Never )
 	{
 
 		// Queue is empty, nothing to send except perhaps nacks (below)
 		Assert( m_senderState.PendingBytesTotal() == 0 );
-		usecNextSend = k_nThinkTime_Never;
 	}
 	else
 	{
@@ -3439,12 +4626,11 @@ GameNetworkingMicroseconds CGameNetworkConnectionBase::SNP_TimeWhenWantToSendNex
 			return 0;
 
 		// We have less than a full packet's worth of data.  Wait until
-		// the Nagle time, if we have one
-		usecNextSend = m_senderState.m_messagesQueued.m_pFirst->SNPSend_UsecNagle();
+		// the Nagle time, if we have one.  (We already got that above)
 	}
 
 	// Check if the receiver wants to send a NACK.
-	usecNextSend = std::min( usecNextSend, m_receiverState.m_itPendingNack->second.m_usecWhenOKToNack );
+	usecNextSend = std::min( usecNextSend, m_receiverState.TimeWhenOKToNack( m_statsEndToEnd.m_nMaxRecvPktNum ) );
 
 	// Return the earlier of the two
 	return usecNextSend;
@@ -3514,6 +4700,7 @@ void CGameNetworkConnectionBase::SNP_PopulateDetailedStats( SteamDatagramLinkSta
 	info.m_lifetime.m_nMessagesSentUnreliable  = m_senderState.m_nMessagesSentUnreliable;
 	info.m_lifetime.m_nMessagesRecvReliable    = m_receiverState.m_nMessagesRecvReliable;
 	info.m_lifetime.m_nMessagesRecvUnreliable  = m_receiverState.m_nMessagesRecvUnreliable;
+	info.m_lifetime.m_nUnreliableSegmentsRecoveredFEC = m_receiverState.m_nUnreliableSegmentsRecoveredFEC;
 }
 
 void CGameNetworkConnectionBase::SNP_PopulateQuickStats( GameNetworkingQuickConnectionStatus &info, GameNetworkingMicroseconds usecNow )
@@ -6,6 +6,7 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <atomic>
 
 struct P2PSessionState_t;
 
@@ -43,6 +44,14 @@ constexpr int k_nMaxReliableStreamGaps_Extend = 30; // Discard reliable data pas
 constexpr int k_nMaxReliableStreamGaps_Fragment = 20; // Discard reliable data that is filling in the middle of a hole, if it would cause the number of gaps to exceed this number
 constexpr int k_nMaxPacketGaps = 62; // Don't bother tracking more than N gaps.  Instead, we will end up NACKing some packets that we actually did receive.  This should not break the protocol, but it protects us from malicious sender
 
+// Max number of lanes on a connection.  (See ConfigureConnectionLanes.)
+// The buffering limits above apply to each lane separately.
+constexpr int k_nMaxLanes = 255;
+
+// Lane weights are scaled by this much when advancing a lane's virtual time,
+// so that the weighted fair queueing math can stay in integers.
+constexpr int64 k_nLaneVirtTimeScale = 0x10000;
+
 // Hang on to at most N unreliable segments.  When packets are dropping
 // and unreliable messages being fragmented, we will accumulate old pieces
 // of unreliable messages that we retain in hopes that we will get the
@@ -52,9 +61,16 @@ constexpr int k_nMaxPacketGaps = 62; // Don't bother tracking more than N gaps.
 // idea, since the odds of the message dropping increase exponentially with the
 // number of packets.  With 20 packets, even 1% packet loss becomes ~80% message
 // loss.  (Assuming naive fragmentation and reassembly and no forward
-// error correction.)
+// error correction.  See k_EGameNetworkingConfig_UnreliableFECGroupSize.)
+// FEC parity blocks count against this limit, too.
 constexpr int k_nMaxBufferedUnreliableSegments = 20;
 
+// When sending FEC parity for an unreliable message, the message is divided
+// into chunks this much smaller than the max plaintext payload, to leave room
+// for the segment header, acks, etc, so that each chunk will usually be sent
+// in a single segment.
+constexpr int k_cbUnreliableFECChunkReserve = 64;
+
 // If app tries to send a message larger than N bytes unreliably,
 // complain about it, and automatically convert to reliable.
 // About 15 segments.
@@ -82,6 +98,26 @@ public:
 	static CGameNetworkingMessage *New( uint32 cbSize );
 	static void DefaultFreeData( GameNetworkingMessage_t *pMsg );
 
+	/// Free function used when the payload lives in the same pooled block
+	/// as the message.  (It doesn't do anything; the block is returned to
+	/// the pool when the message is released.)
+	static void InlineFreeData( GameNetworkingMessage_t *pMsg );
+
+	/// Allocate a message that points at pOwner's payload, rather than
+	/// copying it.  pOwner is kept alive until all messages sharing its
+	/// payload have been released.  (Including any that the reliability
+	/// layer is holding onto for retransmission.)  The caller must already
+	/// hold a reference, see InitSharedPayload.
+	static CGameNetworkingMessage *NewSharingPayload( CGameNetworkingMessage *pOwner );
+
+	/// Prepare to share our payload.  We start out with one reference,
+	/// which belongs to the caller.
+	inline void InitSharedPayload() { m_nSharedPayloadRefCount.store( 1, std::memory_order_relaxed ); }
+
+	/// Drop a reference to our payload.  When the last one goes away,
+	/// we are released.
+	void ReleaseSharedPayload();
+
 	/// OK to delay sending this message until this time.  Set to zero to explicitly force
 	/// Nagle timer to expire and send now (but this should behave the same as if the
 	/// timer < usecNow).  If the timer is cleared, then all messages with lower message numbers
@@ -112,6 +148,17 @@ public:
 
 	// Reliable stream header
 	int m_cbSNPSendReliableHeader;
+
+	/// Unreliable forward error correction.  On a message we are protecting
+	/// with parity, this is the chunk size that was used to compute it, and
+	/// we don't let a segment span a chunk boundary.  On a parity message,
+	/// this is also set, and m_nSNPSendFECGroupSize is the number of chunks
+	/// per parity block, and m_cbSNPSendFECMsgSize is the size of the message
+	/// it protects.  All zero for ordinary messages.
+	int m_cbSNPSendFECChunk;
+	int m_nSNPSendFECGroupSize;
+	int m_cbSNPSendFECMsgSize;
+	inline bool SNPSend_IsFECParity() const { return m_nSNPSendFECGroupSize > 0; }
 	byte *SNPSend_ReliableHeader()
 	{
 		// !KLUDGE! Reuse the peer identity to hold the reliable header
@@ -130,7 +177,10 @@ public:
 		inline void Clear() { m_pQueue = nullptr; m_pPrev = nullptr; m_pNext = nullptr; }
 	};
 
-	/// Intrusive links for the "primary" list we are in
+	/// Intrusive links for the "primary" list we are in.  While the message
+	/// is waiting in a GameNetworkingMessageInbox, m_pQueue is the queue it
+	/// is bound for (but it isn't linked there yet), and m_pNext is the
+	/// next message in the inbox.
 	Links m_links;
 
 	/// Intrusive links for any secondary list we may be in.  (Same listen socket or
@@ -146,7 +196,34 @@ private:
 	inline CGameNetworkingMessage() {}
 	inline ~CGameNetworkingMessage() {}
 	static void ReleaseFunc( GameNetworkingMessage_t *pIMsg );
+
+	/// Which message pool size class our block came from
+	int m_nPoolSizeClass;
+
+	/// If other messages are sharing our payload, number of references
+	/// to it.  (The payload is only shared by messages being sent.)
+	std::atomic<int> m_nSharedPayloadRefCount;
+
+	static void SharedPayloadFreeData( GameNetworkingMessage_t *pMsg );
+};
+
+/// Counters for the message pool.  Hits are allocations served by the
+/// thread-local cache; misses had to go to the shared pool (or carve a new
+/// slab).  Hit and miss counts from other threads are published in
+/// batches, so they may lag slightly.
+struct MessagePoolStats_t
+{
+	int64 m_nHits;
+	int64 m_nMisses;
+	int64 m_nSlabs; // Currently allocated
+	int64 m_cbSlabs;
+	int64 m_nOversizedPayloads; // Payload too big for the pool, and was malloc'd separately
 };
+extern void MessagePool_GetStats( MessagePoolStats_t &stats );
+
+/// Return the calling thread's cached blocks, and free all the slabs that
+/// are now empty.  Called at shutdown, after our own threads have exited.
+extern void MessagePool_Trim();
 
 /// A doubly-linked list of CGameNetworkingMessage
 struct GameNetworkingMessageQueue
@@ -176,6 +253,47 @@ struct GameNetworkingMessageQueue
 	void AssertLockHeld() const;
 };
 
+/// Lock-free, multi-producer single-consumer list of received messages
+/// that have not yet been linked into their queues.  Producers push
+/// messages one at a time.  The consumer takes the whole list at once,
+/// so there is no ABA problem.
+struct GameNetworkingMessageInbox
+{
+	inline bool empty() const { return m_pHead.load( std::memory_order_relaxed ) == nullptr; }
+
+	/// Add a message.  pDestQueue is remembered, for the consumer to
+	/// link it into when it is popped.
+	inline void Push( CGameNetworkingMessage *pMsg, GameNetworkingMessageQueue *pDestQueue )
+	{
+		pMsg->m_links.m_pQueue = pDestQueue;
+		pMsg->m_links.m_pPrev = nullptr;
+		CGameNetworkingMessage *pHead = m_pHead.load( std::memory_order_relaxed );
+		do
+		{
+			pMsg->m_links.m_pNext = pHead;
+		} while ( !m_pHead.compare_exchange_weak( pHead, pMsg, std::memory_order_release, std::memory_order_relaxed ) );
+	}
+
+	/// Take all messages, and return them oldest first, chained
+	/// through m_links.m_pNext.  Only one thread may call this at a time.
+	inline CGameNetworkingMessage *PopAll()
+	{
+		CGameNetworkingMessage *pMsg = m_pHead.exchange( nullptr, std::memory_order_acquire );
+		CGameNetworkingMessage *pOldest = nullptr;
+		while ( pMsg )
+		{
+			CGameNetworkingMessage *pNext = pMsg->m_links.m_pNext;
+			pMsg->m_links.m_pNext = pOldest;
+			pOldest = pMsg;
+			pMsg = pNext;
+		}
+		return pOldest;
+	}
+
+private:
+	std::atomic<CGameNetworkingMessage *> m_pHead{ nullptr }; // Newest first
+};
+
 /// Maximum number of packets we will send in one Think() call.
 const int k_nMaxPacketsPerThink = 16;
 
@@ -209,10 +327,17 @@ struct SNPRange_t
 	};
 };
 
+/// A range of the reliable stream of a particular lane
+struct SNPLaneRange_t
+{
+	SNPRange_t m_range;
+	int m_idxLane;
+};
+
 /// A packet that has been sent but we don't yet know if was received
-/// or dropped.  These are kept in an ordered map keyed by packet number.
+/// or dropped.  These are kept in a table indexed by packet number.
 /// (Hence the packet number not being a member)  When we receive an ACK,
-/// we remove packets from this list.
+/// we remove packets from the table.
 struct SNPInFlightPacket_t
 {
 	//
@@ -231,12 +356,130 @@ struct SNPInFlightPacket_t
 	/// Transport used to send
 	CConnectionTransport *m_pTransport;
 
-	/// List of reliable segments.  Ignoring retransmission,
-	/// there really is no reason why we we would need to have
-	/// more than 1 in a packet, even if there are multiple
-	/// reliable messages.  If we need to retry, we might
+	/// List of reliable segments, and the lane each one belongs to.
+	/// Ignoring retransmission, there really is no reason why we
+	/// we would need to have more than 1 in a packet, even if there
+	/// are multiple reliable messages.  If we need to retry, we might
 	/// be fragmented.  But usually it will only be a few.
-	vstd::small_vector<SNPRange_t,1> m_vecReliableSegments;
+	vstd::small_vector<SNPLaneRange_t,1> m_vecReliableSegments;
+
+	//
+	// Delivery rate sampling state, captured when the packet is sent.
+	// See SSNPBBRState.  (These don't have initializers, so that this
+	// struct can still be brace-initialized.)
+	//
+
+	/// Size of the packet on the wire
+	int m_cbSent;
+
+	/// SSNPBBRState::m_bAppLimited when this packet was sent
+	bool m_bAppLimited;
+
+	/// SSNPBBRState::m_nDelivered when this packet was sent
+	int64 m_nDeliveredAtSend;
+
+	/// SSNPBBRState::m_usecDeliveredTime when this packet was sent
+	GameNetworkingMicroseconds m_usecDeliveredTimeAtSend;
+
+	/// SSNPBBRState::m_usecFirstSentTime when this packet was sent
+	GameNetworkingMicroseconds m_usecFirstSentTimeAtSend;
+};
+
+/// Table of packets that are in flight.  Packet numbers are assigned
+/// sequentially, so rather than a tree, this is a ring buffer indexed
+/// by packet number, covering the window [PktNumBegin(),PktNumEnd()).
+/// Packets that were acked before the ones in front of them, or that were
+/// never tracked, leave holes in the window.  The first packet in the window
+/// is always present.
+class SNPInFlightPacketTable
+{
+public:
+	inline bool empty() const { return m_nCount == 0; }
+	inline int size() const { return m_nCount; }
+
+	/// Oldest packet in the table, and one past the newest.
+	/// If the table is empty, these are equal.
+	inline int64 PktNumBegin() const { return m_nPktNumBegin; }
+	inline int64 PktNumEnd() const { return m_nPktNumEnd; }
+
+	/// Locate a packet.  Returns nullptr if it isn't in the table
+	inline SNPInFlightPacket_t *Find( int64 nPktNum )
+	{
+		if ( nPktNum < m_nPktNumBegin || nPktNum >= m_nPktNumEnd )
+			return nullptr;
+		Slot &slot = m_vecSlots[ nPktNum & m_nMask ];
+		return slot.m_nPktNum == nPktNum ? &slot.m_pkt : nullptr;
+	}
+
+	/// Start tracking a packet.  The packet number must be newer than
+	/// any packet we have seen so far.
+	void Insert( int64 nPktNum, SNPInFlightPacket_t &&pkt );
+
+	/// Stop tracking a packet.  (It must be in the table.)
+	void Erase( int64 nPktNum );
+
+	void clear();
+
+	#if STEAMNETWORKINGSOCKETS_SNP_PARANOIA > 0
+		void DebugCheck() const;
+	#endif
+
+private:
+	struct Slot
+	{
+		int64 m_nPktNum = -1; // Packet number we are holding, or -1 if the slot is free
+		SNPInFlightPacket_t m_pkt;
+	};
+	std_vector<Slot> m_vecSlots; // Size is always a power of two
+	int64 m_nMask = -1;
+	int64 m_nPktNumBegin = 0;
+	int64 m_nPktNumEnd = 0;
+	int m_nCount = 0;
+};
+
+/// Sorted list of non-overlapping ranges of the reliable stream, each with
+/// the message that holds the first byte of the range.  We almost always
+/// add ranges to the end and remove them from the front, so this is a flat
+/// array with the head at an offset.  Removing the head is O(1).  Insertions
+/// and removals in the middle (when retrying) shift the elements after it.
+class SNPReliableRangeList
+{
+public:
+	struct Entry
+	{
+		SNPRange_t m_range;
+		CGameNetworkingMessage *m_pMsg;
+	};
+
+	inline bool empty() const { return m_idxHead == (int)m_vecEntries.size(); }
+	inline int size() const { return len( m_vecEntries ) - m_idxHead; }
+	inline const Entry &front() const { Assert( !empty() ); return m_vecEntries[ m_idxHead ]; }
+	inline const Entry *begin() const { return m_vecEntries.data() + m_idxHead; }
+	inline const Entry *end() const { return m_vecEntries.data() + m_vecEntries.size(); }
+
+	/// Locate an entry with exactly the range specified.  Returns nullptr if not found
+	const Entry *Find( const SNPRange_t &range ) const;
+
+	/// Add a range.  It must not overlap any range already in the list.
+	void Insert( const SNPRange_t &range, CGameNetworkingMessage *pMsg );
+
+	/// Remove the entry with exactly the range specified.  Returns false if not found
+	bool Erase( const SNPRange_t &range );
+
+	/// Remove the first entry
+	void pop_front();
+
+	/// Return true if the range overlaps any range in the list
+	bool HasOverlappingRange( const SNPRange_t &range ) const;
+
+	void clear() { m_vecEntries.clear(); m_idxHead = 0; }
+
+private:
+	std_vector<Entry> m_vecEntries;
+	int m_idxHead = 0;
+
+	/// Index of the first entry with m_nBegin >= nBegin
+	int LowerBound( int64 nBegin ) const;
 };
 
 struct SSNPSendMessageList : public GameNetworkingMessageQueue
@@ -294,6 +537,167 @@ struct SSNPSendMessageList : public GameNetworkingMessageQueue
 
 };
 
+constexpr float k_flBBRHighGain = 2.885f; // 2/ln(2), the minimum gain that can double the delivery rate each round
+constexpr float k_flBBRCwndGain = 2.0f; // Congestion window, as a multiple of BDP, once we have filled the pipe
+constexpr int k_nBBRMinCwndPackets = 4;
+constexpr int k_nBBRBtlBwFilterRounds = 10; // Window of the bottleneck bandwidth max filter, in round trips
+constexpr GameNetworkingMicroseconds k_usecBBRMinRTTFilterLen = 10*k_nMillion; // How long a min RTT sample is good for
+constexpr GameNetworkingMicroseconds k_usecBBRProbeRTTDuration = 200*1000; // Min time to spend in ProbeRTT
+constexpr int k_nBBRFullBwRounds = 3; // Rounds without bandwidth growth before we decide the pipe is full
+constexpr float k_flBBRFullBwThresh = 1.25f; // What counts as growth
+constexpr int k_nBBRGainCycleLen = 8;
+
+/// Delivery rate based congestion control model, loosely following BBR
+/// (draft-cardwell-iccrg-bbr-congestion-control).  We measure the rate at
+/// which data is acked to estimate the bottleneck bandwidth, and track the
+/// min RTT.  The mode state machine produces a pacing gain that is applied
+/// to the bandwidth estimate.
+///
+/// The pacing rate is the main control.  The congestion window is only a
+/// backstop, so that we stop sending if acks stop arriving.  It leaves
+/// room for the receiver delaying acks by up to k_usecMaxDataAckDelay.
+///
+/// Delivery state is always tracked, even if this algorithm is not
+/// selected, so that it can be switched on for a live connection.
+struct SSNPBBRState
+{
+	enum EMode
+	{
+		k_EMode_Startup,
+		k_EMode_Drain,
+		k_EMode_ProbeBW,
+		k_EMode_ProbeRTT,
+	};
+
+	void Init( int nInitialBtlBw, GameNetworkingMicroseconds usecNow );
+
+	/// Called before a packet is added to the in-flight table.
+	void OnPacketSent( SNPInFlightPacket_t &pkt, int cbSent, GameNetworkingMicroseconds usecNow );
+
+	/// Called when the application runs out of data to send.  Rate samples
+	/// taken while we are app-limited underestimate the bandwidth, so they
+	/// are only used if they would raise the estimate
+	void OnAppLimited() { m_nAppLimitedUntil = std::max( m_nDelivered + m_cbInFlight, (int64)1 ); }
+
+	/// Called for each packet acked, while processing an ack frame.
+	void OnPacketAcked( const SNPInFlightPacket_t &pkt, GameNetworkingMicroseconds usecNow );
+
+	/// Called the first time a packet is declared lost
+	void OnPacketLost( const SNPInFlightPacket_t &pkt )
+	{
+		m_cbInFlight -= pkt.m_cbSent;
+		m_cbLostThisAck += pkt.m_cbSent;
+	}
+
+	/// Called with a round trip time measurement, already adjusted for
+	/// the peer's reported ack delay
+	void OnRTTSample( GameNetworkingMicroseconds usecRTT, GameNetworkingMicroseconds usecNow );
+
+	/// Called once we have finished processing an ack frame.  Generates
+	/// a rate sample from the packets acked, and updates the model
+	void OnAckFrameProcessed( GameNetworkingMicroseconds usecNow );
+
+	/// Called if all in-flight packets are forgotten
+	void ResetInFlight() { m_cbInFlight = 0; m_nAppLimitedUntil = 0; }
+
+	/// Current bottleneck bandwidth estimate, bytes/sec
+	inline int BtlBw() const { return m_nBtlBw; }
+
+	/// Current pacing gain
+	inline float PacingGain() const { return m_flPacingGain; }
+
+	inline EMode Mode() const { return m_eMode; }
+
+	/// Estimated bandwidth-delay product, in bytes
+	int64 BDP() const;
+
+	/// Max bytes we should have in flight
+	int64 CongestionWindow() const;
+	inline bool BCongestionWindowFull() const { return m_cbInFlight >= CongestionWindow(); }
+
+	//
+	// Delivery rate estimation
+	//
+
+	/// Total bytes delivered (acked)
+	int64 m_nDelivered = 0;
+
+	/// Time when m_nDelivered was last updated
+	GameNetworkingMicroseconds m_usecDeliveredTime = 0;
+
+	/// Send time of the packet most recently delivered
+	GameNetworkingMicroseconds m_usecFirstSentTime = 0;
+
+	/// If nonzero, we are app-limited until this many bytes are delivered
+	int64 m_nAppLimitedUntil = 0;
+
+	/// Bytes sent but not yet acked or declared lost
+	int m_cbInFlight = 0;
+
+	// Rate sample being built while processing an ack frame.  It is
+	// taken from the most recently sent packet that was acked.
+	int64 m_nSamplePriorDelivered = -1;
+	GameNetworkingMicroseconds m_usecSamplePriorTime = 0;
+	GameNetworkingMicroseconds m_usecSampleSendElapsed = 0;
+	GameNetworkingMicroseconds m_usecSampleAckElapsed = 0;
+	bool m_bSampleAppLimited = false;
+	int m_cbLostThisAck = 0;
+
+	//
+	// Round trip counting.  A round ends when a packet sent after the
+	// start of the round is acked.
+	//
+
+	int64 m_nNextRoundDelivered = 0;
+	int m_nRoundCount = 0;
+
+	//
+	// Model
+	//
+
+	/// Windowed max filter over the delivery rate.  Max sample
+	/// in each of the last k_nBBRBtlBwFilterRounds rounds.
+	int m_arBtlBwRoundMax[ k_nBBRBtlBwFilterRounds ] = {};
+	int m_nBtlBwFilterRound = 0;
+	int m_nBtlBw = 0;
+
+	/// Min RTT, and when it was measured.  0 if we don't have a sample yet
+	GameNetworkingMicroseconds m_usecMinRTT = 0;
+	GameNetworkingMicroseconds m_usecMinRTTStamp = 0;
+	bool m_bMinRTTExpired = false;
+
+	//
+	// State machine
+	//
+
+	EMode m_eMode = k_EMode_Startup;
+	float m_flPacingGain = k_flBBRHighGain;
+	float m_flCwndGain = k_flBBRHighGain;
+	int m_nModeStartRound = 0;
+
+	/// Startup: have we filled the pipe?  If not, how many rounds
+	/// since we saw significant growth?
+	bool m_bFilledPipe = false;
+	int m_nFullBw = 0;
+	int m_nFullBwCount = 0;
+
+	/// ProbeBW: current phase in the gain cycle, and when it started
+	int m_nCycleIndex = 0;
+	GameNetworkingMicroseconds m_usecCycleStamp = 0;
+
+	/// ProbeRTT: when we can leave.  0 if we are still waiting
+	/// for in flight data to drain
+	GameNetworkingMicroseconds m_usecProbeRTTDoneStamp = 0;
+
+private:
+	void SetMode( EMode eMode, float flPacingGain, float flCwndGain );
+	void UpdateBtlBw( int nRate, bool bAppLimited );
+	void CheckFullPipe();
+	void EnterProbeBW( GameNetworkingMicroseconds usecNow );
+	void AdvanceCyclePhase( GameNetworkingMicroseconds usecNow );
+	void CheckProbeRTT( GameNetworkingMicroseconds usecNow );
+};
+
 /// Info used by a sender to estimate the available bandwidth
 struct SSendRateData
 {
@@ -323,6 +727,10 @@ struct SSendRateData
 	/// Last time that we added tokens to m_flTokenBucket
 	GameNetworkingMicroseconds m_usecTokenBucketTime = 0;
 
+	/// Delivery rate model.  Used to set the send rate when
+	/// k_EGameNetworkingConfig_CongestionControl selects BBR.
+	SSNPBBRState m_bbr;
+
 	/// Calculate time until we could send our next packet, checking our token
 	/// bucket and the current send rate
 	GameNetworkingMicroseconds CalcTimeUntilNextSend() const
@@ -335,12 +743,11 @@ struct SSendRateData
 	}
 };
 
-struct SSNPSenderState
+/// Outbound state for a single lane.  Each lane is an independent
+/// reliable stream, with its own queue of messages.  Losing a packet
+/// with data from one lane doesn't hold up delivery of the others.
+struct SSNPSendLane
 {
-	SSNPSenderState();
-	~SSNPSenderState() {
-		Shutdown();
-	}
 	void Shutdown();
 
 	/// Nagle timer on all pending messages
@@ -354,9 +761,13 @@ struct SSNPSenderState
 		}
 	}
 
-	// Current message number, we ++ when adding a message
+	/// Take over the queues and bookkeeping of another lane.  The message
+	/// lists are intrusive, so we cannot just copy them.
+	void MoveFrom( SSNPSendLane &x );
+
+	// Next position in this lane's reliable stream.  Note that the first
+	// byte is actually at position 1, not 0
 	int64 m_nReliableStreamPos = 1;
-	int64 m_nLastSentMsgNum = 0; // Will increment to 1 with first message
 	int64 m_nLastSendMsgNumReliable = 0;
 
 	/// List of messages that we have not yet finished putting on the wire the first time.
@@ -375,6 +786,117 @@ struct SSNPSenderState
 	/// as soon as they are no longer needed.)
 	SSNPSendMessageList m_unackedReliableMessages;
 
+	/// Ordered list of reliable ranges that we have recently sent
+	/// in a packet.  These should be non-overlapping, and furthermore
+	/// should not overlap with with any range in m_listReadyReliableRange
+	///
+	/// Each range also remembers the message that has the first bit of
+	/// reliable data we need for this message
+	SNPReliableRangeList m_listInFlightReliableRange;
+
+	/// Ordered list of ranges that have been put on the wire,
+	/// but have been detected as dropped, and now need to be retried.
+	SNPReliableRangeList m_listReadyRetryReliableRange;
+
+	/// Lanes with a lower value are always served first.
+	int m_nPriority = 0;
+
+	/// Lanes with the same priority share the bandwidth in proportion
+	/// to their weights.
+	int m_nWeight = 1;
+
+	/// Weighted fair queueing: total bytes sent on this lane, scaled by
+	/// k_nLaneVirtTimeScale/m_nWeight.  Among lanes of the same priority,
+	/// the one furthest behind goes next.
+	int64 m_nVirtTime = 0;
+
+	// Remove messages from m_unackedReliableMessages that have been fully acked.
+	void RemoveAckedReliableMessageFromUnackedList();
+};
+
+struct SSNPSenderState
+{
+	SSNPSenderState();
+	~SSNPSenderState() {
+		Shutdown();
+	}
+	void Shutdown();
+
+	/// Nagle timer on all pending messages
+	void ClearNagleTimers()
+	{
+		for ( SSNPSendLane &lane: m_vecLanes )
+			lane.ClearNagleTimers();
+	}
+
+	/// Change the number of lanes, and their scheduling parameters.
+	/// The number of lanes cannot be reduced.
+	void ConfigureLanes( int nNumLanes, const int *pLanePriorities, const uint16 *pLaneWeights );
+
+	/// Check if any lane has reliable data waiting to be retried
+	inline bool HasReadyRetryReliableRange() const
+	{
+		for ( const SSNPSendLane &lane: m_vecLanes )
+		{
+			if ( !lane.m_listReadyRetryReliableRange.empty() )
+				return true;
+		}
+		return false;
+	}
+
+	/// Check if any lane has reliable data in flight
+	inline bool HasInFlightReliableRange() const
+	{
+		for ( const SSNPSendLane &lane: m_vecLanes )
+		{
+			if ( !lane.m_listInFlightReliableRange.empty() )
+				return true;
+		}
+		return false;
+	}
+
+	/// Check if everything we have been asked to send has been sent, and
+	/// all of the reliable messages acked
+	inline bool BAllMessagesDelivered() const
+	{
+		for ( const SSNPSendLane &lane: m_vecLanes )
+		{
+			if ( !lane.m_messagesQueued.empty() || !lane.m_unackedReliableMessages.empty() )
+				return false;
+		}
+		return true;
+	}
+
+	/// Earliest Nagle time of the messages at the head of the lanes,
+	/// or k_nThinkTime_Never if nothing is queued.
+	GameNetworkingMicroseconds UsecNagleNextMessage() const;
+
+	/// Select the lane with reliable data that is ready to be retried, in
+	/// priority order.  Returns -1 if nothing needs to be retried
+	int PickLaneToRetry() const;
+
+	/// Select the lane with queued messages that should go on the wire
+	/// next.  Returns -1 if all the queues are empty
+	int PickLaneToSend();
+
+	/// Charge cbSent bytes to a lane for scheduling purposes
+	inline void AdvanceLaneVirtTime( SSNPSendLane &lane, int cbSent )
+	{
+		lane.m_nVirtTime += cbSent * k_nLaneVirtTimeScale / lane.m_nWeight;
+	}
+
+	// Current message number, we ++ when adding a message.
+	// Message numbers are shared by all lanes
+	int64 m_nLastSentMsgNum = 0; // Will increment to 1 with first message
+
+	/// Send lanes.  There is always at least one
+	std_vector<SSNPSendLane> m_vecLanes;
+
+	/// Virtual time of the lane we most recently selected to send.  When a
+	/// lane that was idle gets new data, it starts here, so that it doesn't
+	/// get to make up for the time it was idle
+	int64 m_nVirtTimeCurrent = 0;
+
 	// Buffered data counters.  See GameNetworkingQuickConnectionStatus for more info
 	int m_cbPendingUnreliable = 0;
 	int m_cbPendingReliable = 0;
@@ -386,34 +908,18 @@ struct SSNPSenderState
 	int64 m_nMessagesSentUnreliable = 0;
 
 	/// List of packets that we have sent but don't know whether they were received or not.
-	/// We keep a dummy sentinel at the head of the list, with a negative packet number.
-	/// This vastly simplifies the processing.
-	std_map<int64,SNPInFlightPacket_t> m_mapInFlightPacketsByPktNum;
-
-	/// The next unacked packet that should be timed out and implicitly NACKed,
-	/// if we don't receive an ACK in time.  Will be m_mapInFlightPacketsByPktNum.end()
-	/// if we don't have any in flight packets that we are waiting on.
-	std_map<int64,SNPInFlightPacket_t>::iterator m_itNextInFlightPacketToTimeout;
+	SNPInFlightPacketTable m_inFlightPackets;
 
-	/// Ordered list of reliable ranges that we have recently sent
-	/// in a packet.  These should be non-overlapping, and furthermore
-	/// should not overlap with with any range in m_listReadyReliableRange
-	///
-	/// The "value" portion of the map is the message that has the first bit of
-	/// reliable data we need for this message
-	std_map<SNPRange_t,CGameNetworkingMessage*,SNPRange_t::NonOverlappingLess> m_listInFlightReliableRange;
-
-	/// Ordered list of ranges that have been put on the wire,
-	/// but have been detected as dropped, and now need to be retried.
-	std_map<SNPRange_t,CGameNetworkingMessage*,SNPRange_t::NonOverlappingLess> m_listReadyRetryReliableRange;
+	/// Packets older than this have already been checked for timeout.  (They
+	/// have either been nacked or acked.)  The next packet that should be timed
+	/// out and implicitly NACKed, if we don't receive an ACK in time, is the
+	/// first one in the table at or after this packet number.
+	int64 m_nNextInFlightPktNumToTimeout = 0;
 
 	/// Oldest packet sequence number that we are still asking peer
 	/// to send acks for.
 	int64 m_nMinPktWaitingOnAck = 0;
 
-	// Remove messages from m_unackedReliableMessages that have been fully acked.
-	void RemoveAckedReliableMessageFromUnackedList();
-
 	/// Check invariants in debug.
 	#if STEAMNETWORKINGSOCKETS_SNP_PARANOIA == 0 
 		inline void DebugCheckInFlightPacketMap() const {}
@@ -427,6 +933,9 @@ struct SSNPSenderState
 	#endif
 };
 
+/// Key for a buffered unreliable segment.  FEC parity blocks for the
+/// message are stored with a negative offset: -1 - the index of the first
+/// chunk in the parity group.  So they sort before the data segments.
 struct SSNPRecvUnreliableSegmentKey
 {
 	int64 m_nMsgNum;
@@ -444,9 +953,92 @@ struct SSNPRecvUnreliableSegmentData
 {
 	int m_cbSegSize = -1;
 	bool m_bLast = false;
+
+	// Parity blocks only: how the message was divided into parity groups
+	int m_cbFECMsgSize = 0;
+	int m_cbFECChunk = 0;
+	int m_nFECGroupSize = 0;
+
 	char m_buf[ k_cbMaxUnreliableSegmentSizeRecv ];
 };
 
+/// Small sorted map with int64 keys and a fixed capacity, stored in a flat
+/// array.  We use this for the receiver's gap lists.  Those are capped at a
+/// few dozen entries and are almost always tiny, so a linear layout that
+/// lives inside the connection beats a node-based tree by a mile.
+///
+/// The interface is the subset of std::map that we need.  Unlike std::map,
+/// insert() and erase() invalidate iterators past the point of modification,
+/// and you are allowed to modify the key in place, provided you don't change
+/// the ordering.
+template <typename V, int N>
+class SNPFixedSortedMap
+{
+public:
+	struct value_type
+	{
+		int64 first;
+		V second;
+	};
+	typedef value_type *iterator;
+	typedef const value_type *const_iterator;
+
+	inline int size() const { return m_nSize; }
+	inline bool empty() const { return m_nSize == 0; }
+	inline bool full() const { return m_nSize >= N; }
+	inline iterator begin() { return m_arEntries; }
+	inline iterator end() { return m_arEntries + m_nSize; }
+	inline const_iterator begin() const { return m_arEntries; }
+	inline const_iterator end() const { return m_arEntries + m_nSize; }
+	inline value_type &front() { Assert( !empty() ); return m_arEntries[0]; }
+	inline value_type &back() { Assert( !empty() ); return m_arEntries[ m_nSize-1 ]; }
+	inline void clear() { m_nSize = 0; }
+
+	/// Locate the first entry with key > the specified key
+	inline iterator upper_bound( int64 key )
+	{
+		int lo = 0;
+		int hi = m_nSize;
+		while ( lo < hi )
+		{
+			int mid = ( lo + hi ) >> 1;
+			if ( m_arEntries[ mid ].first <= key )
+				lo = mid+1;
+			else
+				hi = mid;
+		}
+		return m_arEntries + lo;
+	}
+
+	/// Add an entry, returning an iterator to it.  The key must not already
+	/// be present, and the map must not be full.  (Caller is expected to
+	/// enforce the limit, since it has to decide what to do about it.)
+	inline iterator insert( int64 key, const V &value )
+	{
+		Assert( !full() );
+		iterator it = upper_bound( key );
+		Assert( it == begin() || it[-1].first < key );
+		memmove( it+1, it, ( end() - it ) * sizeof(value_type) );
+		++m_nSize;
+		it->first = key;
+		it->second = value;
+		return it;
+	}
+
+	/// Remove the entry, and return an iterator to the following entry
+	inline iterator erase( iterator it )
+	{
+		Assert( begin() <= it && it < end() );
+		--m_nSize;
+		memmove( it, it+1, ( end() - it ) * sizeof(value_type) );
+		return it;
+	}
+
+private:
+	int m_nSize = 0;
+	value_type m_arEntries[N];
+};
+
 struct SSNPPacketGap
 {
 	int64 m_nEnd; // just after the last packet received
@@ -455,6 +1047,25 @@ struct SSNPPacketGap
 	GameNetworkingMicroseconds m_usecWhenOKToNack; // Don't give up on the gap being filed before this time
 };
 
+/// Inbound reliable stream for a single lane
+struct SSNPRecvLane
+{
+	/// Stream position of the first byte in m_bufReliableData.  Remember that the first byte
+	/// in the reliable stream is actually at position 1, not 0
+	int64 m_nReliableStreamPos = 1;
+
+	/// The message number of the most recently received reliable message
+	int64 m_nLastRecvReliableMsgNum = 0;
+
+	/// Reliable data stream that we have received.  This might have gaps in it!
+	std_vector<byte> m_bufReliableStream;
+
+	/// Gaps in the reliable data.  These are created when we receive reliable data that
+	/// is beyond what we expect next.  Since these must never overlap, we store them
+	/// using begin as the key and end as the value.
+	SNPFixedSortedMap<int64,k_nMaxReliableStreamGaps_Extend> m_mapReliableStreamGaps;
+};
+
 struct SSNPReceiverState
 {
 	SSNPReceiverState();
@@ -469,27 +1080,23 @@ struct SSNPReceiverState
 	/// a pretty small list.
 	std_map<SSNPRecvUnreliableSegmentKey,SSNPRecvUnreliableSegmentData> m_mapUnreliableSegments;
 
-	/// Stream position of the first byte in m_bufReliableData.  Remember that the first byte
-	/// in the reliable stream is actually at position 1, not 0
-	int64 m_nReliableStreamPos = 1;
-
-	/// The highest message number we have seen so far.
+	/// The highest message number we have seen so far.  (In any lane.)
 	int64 m_nHighestSeenMsgNum = 0;
 
-	/// The message number of the most recently received reliable message
-	int64 m_nLastRecvReliableMsgNum = 0;
-
-	/// Reliable data stream that we have received.  This might have gaps in it!
-	std_vector<byte> m_bufReliableStream;
+	/// Receive lanes.  There is always at least one.  We add more
+	/// when the sender selects them.
+	std_vector<SSNPRecvLane> m_vecLanes;
 
-	/// Gaps in the reliable data.  These are created when we receive reliable data that
-	/// is beyond what we expect next.  Since these must never overlap, we store them
-	/// using begin as the key and end as the value.
-	///
-	/// !SPEED! We should probably use a small fixed-sized, sorted vector here,
-	/// since in most cases the list will be small, and the cost of dynamic memory
-	/// allocation will be way worse than O(n) insertion/removal.
-	std_map<int64,int64> m_mapReliableStreamGaps;
+	/// Check if any lane has reliable data buffered
+	inline bool BHasAnyBufferedReliableData() const
+	{
+		for ( const SSNPRecvLane &lane: m_vecLanes )
+		{
+			if ( !lane.m_bufReliableStream.empty() )
+				return true;
+		}
+		return false;
+	}
 
 	/// List of gaps in the packet sequence numbers we have received.
 	/// Since these must never overlap, we store them using begin as the
@@ -503,10 +1110,10 @@ struct SSNPReceiverState
 	/// protocol cannot report on packet N without also reporting
 	/// on all packets numbered < N.
 	///
-	/// !SPEED! We should probably use a small fixed-sized, sorted vector here,
-	/// since in most cases the list will be small, and the cost of dynamic memory
-	/// allocation will be way worse than O(n) insertion/removal.
-	std_map<int64,SSNPPacketGap> m_mapPacketGaps;
+	/// Use InsertPacketGap and ErasePacketGap to modify the list,
+	/// they will keep m_itPendingAck and m_itPendingNack valid.
+	typedef SNPFixedSortedMap<SSNPPacketGap,k_nMaxPacketGaps> PacketGapMap;
+	PacketGapMap m_mapPacketGaps;
 
 	/// Oldest packet sequence number we need to ack to our peer
 	int64 m_nMinPktNumToSendAcks = 0;
@@ -535,13 +1142,46 @@ struct SSNPReceiverState
 	/// bookkeeping is to figure out which acks we *need* to send,
 	/// and which acks we cannot send yet, so we can make optimal
 	/// decisions.
-	std_map<int64,SSNPPacketGap>::iterator m_itPendingAck;
+	PacketGapMap::iterator m_itPendingAck;
 
 	/// Iterator into m_mapPacketGaps.  If != the sentinel,
 	/// we will avoid reporting on the dropped packets in this
 	/// gap (and all higher numbered packets), because we are
 	/// waiting in the hopes that they will arrive out of order.
-	std_map<int64,SSNPPacketGap>::iterator m_itPendingNack;
+	PacketGapMap::iterator m_itPendingNack;
+
+	/// Add a gap to m_mapPacketGaps, and return an iterator to it.
+	/// Caller must make sure we don't exceed k_nMaxPacketGaps.
+	PacketGapMap::iterator InsertPacketGap( int64 nBegin, const SSNPPacketGap &gap );
+
+	/// Remove a gap from m_mapPacketGaps, returning an iterator to the next
+	/// gap.  If m_itPendingAck or m_itPendingNack referred to this gap, they
+	/// will also point to the next one, but usually the caller should have
+	/// already advanced them.
+	PacketGapMap::iterator ErasePacketGap( PacketGapMap::iterator it );
+
+	/// If we decided not to mark the newest packet we have received, then the
+	/// newest gap includes it, and there is nothing after the gap for us to
+	/// ack.  Our wire protocol can't report on a gap like that, so until we
+	/// receive a packet after it, we act like it isn't there.  Returns the
+	/// gap, or nullptr if the newest gap (if any) is not open.
+	inline PacketGapMap::iterator OpenPacketGap( int64 nMaxRecvPktNum )
+	{
+		if ( m_mapPacketGaps.size() < 2 )
+			return nullptr;
+		PacketGapMap::iterator it = &m_mapPacketGaps.back() - 1;
+		return it->second.m_nEnd > nMaxRecvPktNum ? it : nullptr;
+	}
+
+	/// Return the time when we want to send the next nack, or INT64_MAX if
+	/// there is nothing we can nack right now
+	inline GameNetworkingMicroseconds TimeWhenOKToNack( int64 nMaxRecvPktNum ) const
+	{
+		// We can't nack an open gap
+		if ( m_itPendingNack->first < INT64_MAX && m_itPendingNack->second.m_nEnd > nMaxRecvPktNum )
+			return INT64_MAX;
+		return m_itPendingNack->second.m_usecWhenOKToNack;
+	}
 
 	/// Queue a flush of ALL acks (and NACKs!) by the given time.
 	/// If anything is scheduled to happen earlier, that schedule
@@ -573,6 +1213,7 @@ struct SSNPReceiverState
 	// Stats.  FIXME - move to LinkStatsEndToEnd and track rate counters
 	int64 m_nMessagesRecvReliable = 0;
 	int64 m_nMessagesRecvUnreliable = 0;
+	int64 m_nUnreliableSegmentsRecoveredFEC = 0;
 };
 
 } // GameNetworkingSocketsLib
@@ -2,6 +2,7 @@
 
 #include "gamenetworkingsockets_udp.h"
 #include "cgamenetworkingsockets.h"
+#include "../gamenetworkingsockets_certstore.h"
 #include "crypto.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
@@ -80,14 +81,97 @@ void ReallyReportBadUDPPacket( const char *pszFrom, const char *pszMsgType, cons
 //
 /////////////////////////////////////////////////////////////////////////////
 
+/// A batch of connect requests, handed off to a crypto worker thread to
+/// check the signatures and do our half of the key exchange
+struct CGameNetworkListenSocketDirectUDP::ConnectRequestCryptoJob final : ICryptoWorkerJob
+{
+	/// Cleared if the listen socket is destroyed while the worker has us
+	CGameNetworkListenSocketDirectUDP *m_pListenSocket = nullptr;
+
+	std::vector<PendingConnectRequest_t> m_vecRequests;
+	CSignatureVerifyBatch m_batch;
+	PrecomputedKeyExchange_t m_arKeyExchange[ k_nMaxPendingConnectRequests ];
+
+	/// Next request to resume, once the work is done
+	int m_idxNextResume = 0;
+
+	virtual void RunInWorkerThread() override
+	{
+		m_batch.Verify();
+
+		// Do the key exchange.  If anything looks wrong, just skip it.  The
+		// request will be rejected when we resume it.
+		CMsgSteamDatagramSessionCryptInfo msgCrypt;
+		CECKeyExchangePublicKey keyExchangePublicKeyLocal, keyExchangePublicKeyRemote;
+		Assert( len( m_vecRequests ) <= k_nMaxPendingConnectRequests );
+		for ( int i = 0 ; i < len( m_vecRequests ) ; ++i )
+		{
+			if ( !msgCrypt.ParseFromString( m_vecRequests[i].m_msg.crypt().info() ) || msgCrypt.key_type() != CMsgSteamDatagramSessionCryptInfo_EKeyType_CURVE25519 )
+				continue;
+			const std::string &sKeyRemote = msgCrypt.key_data();
+			if ( sKeyRemote.length() != sizeof(PrecomputedKeyExchange_t::m_keyExchangePublicKeyRemote)
+				|| !keyExchangePublicKeyRemote.SetRawDataWithoutWipingInput( sKeyRemote.c_str(), sKeyRemote.length() ) )
+				continue;
+
+			PrecomputedKeyExchange_t &keyExchange = m_arKeyExchange[i];
+			CCrypto::GenerateKeyExchangeKeyPair( &keyExchangePublicKeyLocal, &keyExchange.m_keyExchangePrivateKeyLocal );
+			if ( !CCrypto::PerformKeyExchange( keyExchange.m_keyExchangePrivateKeyLocal, keyExchangePublicKeyRemote, &keyExchange.m_premasterSecret.m_buf ) )
+			{
+				keyExchange.m_keyExchangePrivateKeyLocal.Wipe();
+				continue;
+			}
+			V_memcpy( keyExchange.m_keyExchangePublicKeyRemote, sKeyRemote.c_str(), sizeof(keyExchange.m_keyExchangePublicKeyRemote) );
+			keyExchange.m_bValid = true;
+		}
+	}
+
+	virtual void FinishInServiceThread() override
+	{
+		CGameNetworkListenSocketDirectUDP *pSock = m_pListenSocket;
+		if ( !pSock )
+		{
+			delete this;
+			return;
+		}
+
+		// Line up to be resumed
+		std::vector<ConnectRequestCryptoJob *> &vecInFlight = pSock->m_vecConnectRequestCryptoJobsInFlight;
+		auto it = std::find( vecInFlight.begin(), vecInFlight.end(), this );
+		Assert( it != vecInFlight.end() );
+		if ( it != vecInFlight.end() )
+			vecInFlight.erase( it );
+		pSock->m_vecConnectRequestCryptoJobsDone.push_back( this );
+		pSock->m_scheduleResumeConnectRequests.EnsureMinScheduleTime( k_nThinkTime_ASAP );
+	}
+};
+
 CGameNetworkListenSocketDirectUDP::CGameNetworkListenSocketDirectUDP( CGameNetworkingSockets *pGameNetworkingSocketsInterface )
 : CGameNetworkListenSocketBase( pGameNetworkingSocketsInterface )
+, m_scheduleProcessPendingConnectRequests( this, &CGameNetworkListenSocketDirectUDP::ProcessPendingConnectRequests )
+, m_scheduleResumeConnectRequests( this, &CGameNetworkListenSocketDirectUDP::ResumeConnectRequests )
 {
 	m_pSock = nullptr;
+	m_bProcessingPendingConnectRequests = false;
+	m_pResumingKeyExchange = nullptr;
 }
 
 CGameNetworkListenSocketDirectUDP::~CGameNetworkListenSocketDirectUDP()
 {
+	// Cancel any connect requests that are still waiting for a worker.
+	// Jobs already running are detached, and will delete themselves
+	// when they finish.
+	for ( ConnectRequestCryptoJob *pJob: m_vecConnectRequestCryptoJobsInFlight )
+	{
+		if ( CryptoWorkers_BCancelJob( pJob ) )
+			delete pJob;
+		else
+			pJob->m_pListenSocket = nullptr;
+	}
+	m_vecConnectRequestCryptoJobsInFlight.clear();
+	for ( ConnectRequestCryptoJob *pJob: m_vecConnectRequestCryptoJobsDone )
+		delete pJob;
+	m_vecConnectRequestCryptoJobsDone.clear();
+
 	// Clean up socket, if any
 	if ( m_pSock )
 	{
@@ -127,7 +211,7 @@ bool CGameNetworkListenSocketDirectUDP::BInit( const GameNetworkingIPAddr &local
 	}
 
 	m_pSock = new CSharedSocket;
-	if ( !m_pSock->BInit( localAddr, CRecvPacketCallback( ReceivedFromUnknownHost, this ), errMsg ) )
+	if ( !m_pSock->BInit( localAddr, CRecvPacketCallback( ReceivedFromUnknownHost, this ), errMsg, GetUDPDataPacketToConnectionID ) )
 	{
 		delete m_pSock;
 		m_pSock = nullptr;
@@ -166,8 +250,7 @@ void CGameNetworkListenSocketDirectUDP::ReceivedFromUnknownHost( const RecvPktIn
 	const uint8 *pPkt = static_cast<const uint8 *>( info.m_pPkt );
 	int cbPkt = info.m_cbPkt;
 	const netadr_t &adrFrom = info.m_adrFrom;
-
-	GameNetworkingMicroseconds usecNow = GameNetworkingSockets_GetLocalTimestamp();
+	const GameNetworkingMicroseconds usecNow = info.m_usecNow;
 
 	if ( cbPkt < 5 )
 	{
@@ -201,6 +284,8 @@ void CGameNetworkListenSocketDirectUDP::ReceivedFromUnknownHost( const RecvPktIn
 	}
 	else if ( *pPkt == k_EGameNetworkingUDPMsg_ConnectRequest )
 	{
+		if ( !pSock->BPreParseCheckConnectRequest( pPkt, cbPkt, adrFrom, usecNow ) )
+			return;
 		ParseProtobufBody( pPkt+1, cbPkt-1, CMsgSteamSockets_UDP_ConnectRequest, msg )
 		pSock->Received_ConnectRequest( msg, adrFrom, cbPkt, usecNow );
 	}
@@ -252,6 +337,73 @@ inline uint16 GetChallengeTime( GameNetworkingMicroseconds usecNow )
 	return uint16( usecNow >> 20 );
 }
 
+bool CGameNetworkListenSocketDirectUDP::BCheckChallenge( uint64 nChallenge, const netadr_t &adrFrom, GameNetworkingMicroseconds usecNow ) const
+{
+	// Make sure challenge was generated relatively recently
+	uint16 nTimeThen = uint32( nChallenge );
+	uint16 nElapsed = GetChallengeTime( usecNow ) - nTimeThen;
+	if ( nElapsed > GetChallengeTime( 4*k_nMillion ) )
+	{
+		ReportBadPacket( "ConnectRequest", "Challenge too old." );
+		return false;
+	}
+
+	// Assuming we sent them this time value, re-create the challenge we would have sent them.
+	if ( GenerateChallenge( nTimeThen, adrFrom ) != nChallenge )
+	{
+		ReportBadPacket( "ConnectRequest", "Incorrect challenge.  Could be spoofed." );
+		return false;
+	}
+
+	return true;
+}
+
+// The protobuf library always serializes fields in field number order, so a
+// ConnectRequest from any version of our code starts with the client
+// connection ID (field 1, fixed32) and then the challenge (field 2, fixed64),
+// at fixed offsets.  That lets us check the challenge without parsing the
+// message.
+const uint8 k_nConnectRequestTag_ClientConnectionID = (1<<3) | 5; // Field 1, wire type 5 (fixed32)
+const uint8 k_nConnectRequestTag_Challenge = (2<<3) | 1; // Field 2, wire type 1 (fixed64)
+const int k_cbConnectRequestHeader = 1 + 1+4 + 1+8; // Lead byte, connection ID, challenge
+
+bool CGameNetworkListenSocketDirectUDP::BPreParseCheckConnectRequest( const uint8 *pPkt, int cbPkt, const netadr_t &adrFrom, GameNetworkingMicroseconds usecNow )
+{
+	Assert( pPkt[0] == k_EGameNetworkingUDPMsg_ConnectRequest );
+	if ( cbPkt < k_cbConnectRequestHeader || pPkt[1] != k_nConnectRequestTag_ClientConnectionID || pPkt[6] != k_nConnectRequestTag_Challenge )
+	{
+		ReportBadPacket( "ConnectRequest", "Malformed header." );
+		return false;
+	}
+
+	uint64 nChallenge;
+	memcpy( &nChallenge, pPkt+7, sizeof(nChallenge) );
+	if ( !BCheckChallenge( LittleQWord( nChallenge ), adrFrom, usecNow ) )
+		return false;
+
+	// They have proven that they can receive packets at this address.
+	// Now check the rate limit for the network they are on.
+	const int nRateLimit = g_Config_ConnectRequestRateLimit.Get();
+	if ( nRateLimit > 0 )
+	{
+		uint8 prefix[16];
+		adrFrom.GetIPV6( prefix );
+		if ( adrFrom.GetType() == k_EIPTypeV4 || adrFrom.IsMappedIPv4() )
+			prefix[15] = 0; // /24
+		else
+			memset( prefix+6, 0, 10 ); // /48
+		uint64 h = CCrypto::SipHash( prefix, sizeof(prefix), m_argbChallengeSecret );
+		TokenBucketRateLimiter &bucket = m_arConnectRequestRateLimit[ h % k_nConnectRequestRateLimitBuckets ];
+		if ( !bucket.BCheck( usecNow, (float)nRateLimit, 2.0f*nRateLimit ) )
+		{
+			ReportBadPacket( "ConnectRequest", "Rate limit exceeded for this network." );
+			return false;
+		}
+	}
+
+	return true;
+}
+
 void CGameNetworkListenSocketDirectUDP::Received_ChallengeRequest( const CMsgSteamSockets_UDP_ChallengeRequest &msg, const netadr_t &adrFrom, GameNetworkingMicroseconds usecNow )
 {
 	if ( msg.connection_id() == 0 )
@@ -285,21 +437,11 @@ void CGameNetworkListenSocketDirectUDP::Received_ConnectRequest( const CMsgSteam
 {
 	SteamDatagramErrMsg errMsg;
 
-	// Make sure challenge was generated relatively recently
-	uint16 nTimeThen = uint32( msg.challenge() );
-	uint16 nElapsed = GetChallengeTime( usecNow ) - nTimeThen;
-	if ( nElapsed > GetChallengeTime( 4*k_nMillion ) )
-	{
-		ReportBadPacket( "ConnectRequest", "Challenge too old." );
-		return;
-	}
-
-	// Assuming we sent them this time value, re-create the challenge we would have sent them.
-	if ( GenerateChallenge( nTimeThen, adrFrom ) != msg.challenge() )
-	{
-		ReportBadPacket( "ConnectRequest", "Incorrect challenge.  Could be spoofed." );
+	// We checked the challenge in the header before parsing, but check it
+	// again here.  Protobuf uses the last value if a field appears more
+	// than once, so the one in the message might not be the one we checked.
+	if ( !BCheckChallenge( msg.challenge(), adrFrom, usecNow ) )
 		return;
-	}
 
 	uint32 unClientConnectionID = msg.client_connection_id();
 	if ( unClientConnectionID == 0 )
@@ -392,6 +534,15 @@ void CGameNetworkListenSocketDirectUDP::Received_ConnectRequest( const CMsgSteam
 		CGameNetworkConnectionBase *pOldConn = m_mapChildConnections[ h ];
 		Assert( pOldConn->m_identityRemote == identityRemote );
 
+		// If they retried while we were working on their request, we might
+		// have a few copies of it lined up.  We accepted the first one.
+		if ( m_bProcessingPendingConnectRequests )
+		{
+			CConnectionTransportUDP *pOldTransport = assert_cast<CGameNetworkConnectionUDP *>( pOldConn )->Transport();
+			if ( pOldTransport && pOldTransport->m_pSocket && pOldTransport->m_pSocket->GetRemoteHostAddr() == adrFrom )
+				return;
+		}
+
 		// NOTE: We cannot just destroy the object.  The API semantics
 		// are that all connections, once accepted and made visible
 		// to the API, must be closed by the application.
@@ -407,6 +558,15 @@ void CGameNetworkListenSocketDirectUDP::Received_ConnectRequest( const CMsgSteam
 		return;
 	}
 
+	// Checking the signatures is by far the most expensive part of accepting
+	// a connection.  Queue the request, so we can check the signatures for a
+	// bunch of them at once.  We'll come back through here to finish up.
+	if ( !m_bProcessingPendingConnectRequests && g_Config_HandshakeBatchVerify.Get() )
+	{
+		QueueConnectRequest( msg, adrFrom, cbPkt, usecNow );
+		return;
+	}
+
 	ConnectionScopeLock connectionLock;
 	CGameNetworkConnectionUDP *pConn = new CGameNetworkConnectionUDP( m_pGameNetworkingSocketsInterface, connectionLock );
 
@@ -418,6 +578,10 @@ void CGameNetworkListenSocketDirectUDP::Received_ConnectRequest( const CMsgSteam
 		return;
 	}
 
+	// Did a worker thread already do the key exchange?
+	if ( m_pResumingKeyExchange && m_pResumingKeyExchange->m_bValid )
+		pConn->SetPrecomputedKeyExchange( *m_pResumingKeyExchange );
+
 	pConn->m_statsEndToEnd.TrackRecvPacket( cbPkt, usecNow );
 
 	// Did they send us a ping estimate?
@@ -442,6 +606,122 @@ void CGameNetworkListenSocketDirectUDP::Received_ConnectRequest( const CMsgSteam
 	}
 }
 
+void CGameNetworkListenSocketDirectUDP::QueueConnectRequest( const CMsgSteamSockets_UDP_ConnectRequest &msg, const netadr_t &adrFrom, int cbPkt, GameNetworkingMicroseconds usecNow )
+{
+	// Client retried before we got around to it?  Don't accept the
+	// same connection twice, the second attempt would be rejected as
+	// a duplicate, and that would tear down the first one.
+	for ( const PendingConnectRequest_t &p: m_vecPendingConnectRequests )
+	{
+		if ( p.m_adrFrom == adrFrom && p.m_msg.client_connection_id() == msg.client_connection_id() )
+			return;
+	}
+
+	m_vecPendingConnectRequests.emplace_back();
+	PendingConnectRequest_t &p = m_vecPendingConnectRequests.back();
+	p.m_msg = msg;
+	p.m_adrFrom = adrFrom;
+	p.m_cbPkt = cbPkt;
+	p.m_usecRecv = usecNow;
+
+	// Process them at the end of this pass through the service thread,
+	// or right now if we have enough for a full batch
+	if ( (int)m_vecPendingConnectRequests.size() >= k_nMaxPendingConnectRequests )
+		ProcessPendingConnectRequests( usecNow );
+	else
+		m_scheduleProcessPendingConnectRequests.EnsureMinScheduleTime( k_nThinkTime_ASAP );
+}
+
+void CGameNetworkListenSocketDirectUDP::ProcessPendingConnectRequests( GameNetworkingMicroseconds usecNow )
+{
+	GameNetworkingGlobalLock::AssertHeldByCurrentThread( "ProcessPendingConnectRequests" );
+	Assert( !m_bProcessingPendingConnectRequests );
+	m_scheduleProcessPendingConnectRequests.Cancel();
+
+	if ( m_vecPendingConnectRequests.empty() )
+		return;
+	ConnectRequestCryptoJob *pJob = new ConnectRequestCryptoJob;
+	pJob->m_pListenSocket = this;
+	pJob->m_vecRequests.swap( m_vecPendingConnectRequests );
+
+	// Gather up the signatures.  Malformed stuff is just skipped here,
+	// the normal processing below will reject it.
+	CMsgSteamDatagramCertificate msgCert;
+	for ( const PendingConnectRequest_t &p: pJob->m_vecRequests )
+	{
+		const CMsgSteamDatagramCertificateSigned &msgCertSigned = p.m_msg.cert();
+		if ( msgCertSigned.has_ca_signature() )
+			CertStore_AddCASignatureToBatch( msgCertSigned, pJob->m_batch );
+
+		// !SPEED! Yet another time we're parsing the cert
+		if ( msgCert.ParseFromString( msgCertSigned.cert() ) && msgCert.key_type() == CMsgSteamDatagramCertificate_EKeyType_ED25519 )
+		{
+			const std::string &key = msgCert.key_data();
+			pJob->m_batch.AddSignature( key.c_str(), key.length(), p.m_msg.crypt().info(), p.m_msg.crypt().signature() );
+		}
+	}
+
+	// Hand it off to the crypto workers, if we have them.  If they (or
+	// we) are too far behind, drop the requests.  The clients will retry.
+	if ( CryptoWorkers_BActive() )
+	{
+		if ( len( m_vecConnectRequestCryptoJobsDone ) < k_nMaxConnectRequestCryptoJobsDone && CryptoWorkers_BQueueJob( pJob ) )
+		{
+			m_vecConnectRequestCryptoJobsInFlight.push_back( pJob );
+			return;
+		}
+		SpewWarningRateLimited( usecNow, "Dropping %d connect requests, handshake crypto is too far behind\n", len( pJob->m_vecRequests ) );
+		delete pJob;
+		return;
+	}
+
+	// Check the signatures now, and process the requests for real.
+	// The signatures we already checked will not be checked again.
+	pJob->m_batch.Verify();
+	for ( int i = 0 ; i < len( pJob->m_vecRequests ) ; ++i )
+		ResumeConnectRequest( pJob, i );
+	delete pJob;
+}
+
+void CGameNetworkListenSocketDirectUDP::ResumeConnectRequests( GameNetworkingMicroseconds usecNow )
+{
+	GameNetworkingGlobalLock::AssertHeldByCurrentThread( "ResumeConnectRequests" );
+
+	// Only do a few per pass.  Making the connection objects still takes
+	// some time, and we don't want to delay packets for connections we
+	// already have.
+	int nResumed = 0;
+	while ( !m_vecConnectRequestCryptoJobsDone.empty() )
+	{
+		ConnectRequestCryptoJob *pJob = m_vecConnectRequestCryptoJobsDone[0];
+		if ( pJob->m_idxNextResume >= len( pJob->m_vecRequests ) )
+		{
+			m_vecConnectRequestCryptoJobsDone.erase( m_vecConnectRequestCryptoJobsDone.begin() );
+			delete pJob;
+			continue;
+		}
+		if ( nResumed >= k_nMaxConnectRequestsResumedPerPass )
+		{
+			m_scheduleResumeConnectRequests.ScheduleASAP();
+			return;
+		}
+		ResumeConnectRequest( pJob, pJob->m_idxNextResume++ );
+		++nResumed;
+	}
+}
+
+void CGameNetworkListenSocketDirectUDP::ResumeConnectRequest( ConnectRequestCryptoJob *pJob, int idx )
+{
+	const PendingConnectRequest_t &p = pJob->m_vecRequests[ idx ];
+
+	CSignatureVerifyBatch::ActiveScope activeBatch( pJob->m_batch );
+	m_bProcessingPendingConnectRequests = true;
+	m_pResumingKeyExchange = &pJob->m_arKeyExchange[ idx ];
+	Received_ConnectRequest( p.m_msg, p.m_adrFrom, p.m_cbPkt, p.m_usecRecv );
+	m_pResumingKeyExchange = nullptr;
+	m_bProcessingPendingConnectRequests = false;
+}
+
 void CGameNetworkListenSocketDirectUDP::Received_ConnectionClosed( const CMsgSteamSockets_UDP_ConnectionClosed &msg, const netadr_t &adrFrom, GameNetworkingMicroseconds usecNow )
 {
 	// Send an ack.  Note that we require the inbound message to be padded
@@ -645,7 +925,7 @@ void CConnectionTransportUDPBase::TrackSentStats( UDPSendPacketContext_t &ctx )
 	);
 }
 
-void CConnectionTransportUDPBase::Received_Data( const uint8 *pPkt, int cbPkt, GameNetworkingMicroseconds usecNow )
+void CConnectionTransportUDPBase::Received_Data( const uint8 *pPkt, int cbPkt, const RecvPktPreDecrypted_t *pPreDecrypted, GameNetworkingMicroseconds usecNow, GameNetworkingMicroseconds usecKernelRecv )
 {
 
 	if ( cbPkt < sizeof(UDPDataMsgHdr) )
@@ -669,6 +949,9 @@ void CConnectionTransportUDPBase::Received_Data( const uint8 *pPkt, int cbPkt, G
 	}
 	uint16 nWirePktNumber = LittleWord( hdr->m_unSeqNum );
 
+	// A receive worker might have found a problem that it couldn't act on
+	m_connection.CheckProblemDetectedOnRecvWorker();
+
 	// Check state
 	switch ( ConnectionState() )
 	{
@@ -743,6 +1026,8 @@ void CConnectionTransportUDPBase::Received_Data( const uint8 *pPkt, int cbPkt, G
 	ctx.m_usecNow = usecNow;
 	ctx.m_pTransport = this;
 	ctx.m_pStatsIn = pMsgStatsIn;
+	ctx.m_pPreDecrypted = pPreDecrypted;
+	ctx.m_usecKernelRecv = usecKernelRecv;
 	if ( !m_connection.DecryptDataChunk( nWirePktNumber, cbPkt, pChunk, cbChunk, ctx ) )
 		return;
 
@@ -759,6 +1044,141 @@ void CConnectionTransportUDPBase::Received_Data( const uint8 *pPkt, int cbPkt, G
 		RecvStats( *pMsgStatsIn, usecNow );
 }
 
+uint32 GetUDPDataPacketToConnectionID( const void *pPkt, int cbPkt )
+{
+	const UDPDataMsgHdr *hdr = static_cast<const UDPDataMsgHdr *>( pPkt );
+	if ( cbPkt < (int)sizeof(*hdr) || !( hdr->m_unMsgFlags & 0x80 ) )
+		return 0;
+	return LittleDWord( hdr->m_unToConnectionID );
+}
+
+void ProcessRecvPacketsOnWorkerThread( IRawUDPSocket *pSock, int nPkts, const void *const *ppPkt, const int *pcbPkt, const netadr_t *pAdrFrom, const GameNetworkingMicroseconds *pusecKernelRecv, GameNetworkingMicroseconds usecNow, bool bProcess, RecvPktPreDecrypted_t *pOut )
+{
+	// NOTE: We do NOT hold the global lock!  Anything that goes wrong
+	// here, we just leave for the service thread to deal with.
+	Assert( nPkts <= k_nSteamDatagramMaxRecvBatchSize );
+	nPkts = std::min( nPkts, k_nSteamDatagramMaxRecvBatchSize );
+
+	uint32 arConnectionID[ k_nSteamDatagramMaxRecvBatchSize ];
+	PreDecryptChunk_t arChunk[ k_nSteamDatagramMaxRecvBatchSize ];
+	for ( int i = 0 ; i < nPkts ; ++i )
+	{
+		pOut[i].m_bProcessed = false;
+		pOut[i].m_unConnectionID = 0;
+		arConnectionID[i] = 0;
+
+		// Only data packets are worth the trouble
+		const uint8 *pIn = static_cast<const uint8 *>( ppPkt[i] );
+		if ( pcbPkt[i] < (int)sizeof(UDPDataMsgHdr) || !( *pIn & 0x80 ) )
+			continue;
+		const UDPDataMsgHdr *hdr = (const UDPDataMsgHdr *)pIn;
+		const uint8 *pPktEnd = pIn + pcbPkt[i];
+		pIn += sizeof(*hdr);
+
+		// Skip inline stats.  We don't parse them here
+		if ( hdr->m_unMsgFlags & hdr->kFlag_ProtobufBlob )
+		{
+			uint32 cbStatsMsgIn;
+			pIn = DeserializeVarInt( pIn, pPktEnd, cbStatsMsgIn );
+			if ( pIn == nullptr || cbStatsMsgIn > (uint32)( pPktEnd - pIn ) )
+				continue;
+			pIn += cbStatsMsgIn;
+		}
+
+		arConnectionID[i] = LittleDWord( hdr->m_unToConnectionID );
+		PreDecryptChunk_t &chunk = arChunk[i];
+		chunk.m_nWireSeqNum = LittleWord( hdr->m_unSeqNum );
+		chunk.m_pChunk = pIn;
+		chunk.m_cbChunk = int( pPktEnd - pIn );
+		chunk.m_pOut = &pOut[i];
+	}
+
+	// Gather up all of the packets for the same connection, so we
+	// only need to lock it once, and can decrypt them all in one batch
+	PreDecryptChunk_t arConnectionChunk[ k_nSteamDatagramMaxRecvBatchSize ];
+	int arConnectionPktIndex[ k_nSteamDatagramMaxRecvBatchSize ];
+	for ( int i = 0 ; i < nPkts ; ++i )
+	{
+		const uint32 unConnectionID = arConnectionID[i];
+		if ( unConnectionID == 0 )
+			continue;
+		int nChunks = 0;
+		for ( int j = i ; j < nPkts ; ++j )
+		{
+			if ( arConnectionID[j] == unConnectionID )
+			{
+				arConnectionPktIndex[ nChunks ] = j;
+				arConnectionChunk[ nChunks++ ] = arChunk[j];
+				arConnectionID[j] = 0;
+			}
+		}
+
+		ConnectionScopeLock connectionLock;
+		CGameNetworkConnectionBase *pConn = TryLockConnectionByLocalID( unConnectionID, connectionLock, "RecvWorker" );
+		if ( !pConn )
+			continue;
+		pConn->PreDecryptDataChunks( nChunks, arConnectionChunk );
+
+		// Now process them, in order, if we can.  Only ordinary UDP
+		// connections.  Everything else goes to the service thread
+		if ( !bProcess )
+			continue;
+		CGameNetworkConnectionUDP *pConnUDP = pConn->AsGameNetworkConnectionUDP();
+		if ( !pConnUDP || !pConnUDP->m_pTransport )
+			continue;
+		CConnectionTransportUDP *pTransport = pConnUDP->Transport();
+		for ( int k = 0 ; k < nChunks ; ++k )
+		{
+			const int idx = arConnectionPktIndex[k];
+			if ( pTransport->BRecvDataPacketOnWorkerThread( pSock, static_cast<const uint8 *>( ppPkt[idx] ), pcbPkt[idx], pAdrFrom[idx], &pOut[idx], usecNow, pusecKernelRecv[idx] ) )
+				pOut[idx].m_bProcessed = true;
+		}
+	}
+}
+
+bool CConnectionTransportUDP::BRecvDataPacketOnWorkerThread( IRawUDPSocket *pRawSock, const uint8 *pPkt, int cbPkt, const netadr_t &adrFrom, const RecvPktPreDecrypted_t *pPreDecrypted, GameNetworkingMicroseconds usecNow, GameNetworkingMicroseconds usecKernelRecv )
+{
+	// NOTE: We do NOT hold the global lock!
+	m_connection.m_pLock->AssertHeldByCurrentThread();
+	Assert( cbPkt >= (int)sizeof(UDPDataMsgHdr) );
+	const UDPDataMsgHdr *hdr = (const UDPDataMsgHdr *)pPkt;
+	Assert( LittleDWord( hdr->m_unToConnectionID ) == ConnectionIDLocal() );
+
+	// Only the common case: a connected connection, and a packet that we
+	// were able to decrypt.  Anything unusual can wait for the service thread.
+	if ( ConnectionState() != k_EGameNetworkingConnectionState_Connected || m_connection.m_bProblemDetectedOnRecvWorker )
+		return false;
+	if ( pPreDecrypted->m_unConnectionID != ConnectionIDLocal() )
+		return false;
+
+	// Inline stats might need a reply, leave those for the service thread.
+	if ( hdr->m_unMsgFlags & hdr->kFlag_ProtobufBlob )
+		return false;
+
+	// Make sure it's a packet that the service thread would have given to
+	// us.  If it came from somewhere else, maybe the peer's address changed.
+	if ( !m_pSocket || m_pSocket->GetRawSock() != pRawSock || !( m_pSocket->GetRemoteHostAddr() == adrFrom ) )
+		return false;
+
+	// OK, from here on, this is the same as Received_Data.  Anything that
+	// needs the global lock is deferred until the service thread gets to us.
+	UDPRecvPacketContext_t ctx;
+	ctx.m_usecNow = usecNow;
+	ctx.m_pTransport = this;
+	ctx.m_pStatsIn = nullptr;
+	ctx.m_pPreDecrypted = pPreDecrypted;
+	ctx.m_usecKernelRecv = usecKernelRecv;
+	m_connection.m_bProcessingOnRecvWorker = true;
+	if ( m_connection.DecryptDataChunk( LittleWord( hdr->m_unSeqNum ), cbPkt, pPkt + sizeof(*hdr), cbPkt - (int)sizeof(*hdr), ctx ) )
+	{
+		RecvValidUDPDataPacket( ctx );
+		int usecTimeSinceLast = 0;
+		m_connection.ProcessPlainTextDataChunk( usecTimeSinceLast, ctx );
+	}
+	m_connection.m_bProcessingOnRecvWorker = false;
+	return true;
+}
+
 void CConnectionTransportUDPBase::RecvValidUDPDataPacket( UDPRecvPacketContext_t &ctx )
 {
 	// Base class doesn't care
@@ -1227,6 +1647,10 @@ bool CGameNetworkConnectionUDP::BBeginAccept(
 		return false;
 	}
 
+	// Now that we have a connection ID, the shared socket can route
+	// our data packets to us by ID
+	pSharedSock->SetRemoteHostConnectionID( pTransport->m_pSocket, m_unConnectionIDLocal );
+
 	// Process crypto handshake now
 	if ( !BRecvCryptoHandshake( msgCert, msgCryptSessionInfo, true ) )
 	{
@@ -1332,8 +1756,7 @@ void CConnectionTransportUDP::PacketReceived( const RecvPktInfo_t &info, CConnec
 	const uint8 *pPkt = static_cast<const uint8 *>( info.m_pPkt );
 	int cbPkt = info.m_cbPkt;
 	const netadr_t &adrFrom = info.m_adrFrom;
-
-	GameNetworkingMicroseconds usecNow = GameNetworkingSockets_GetLocalTimestamp();
+	const GameNetworkingMicroseconds usecNow = info.m_usecNow;
 
 	if ( cbPkt < 5 )
 	{
@@ -1348,7 +1771,7 @@ void CConnectionTransportUDP::PacketReceived( const RecvPktInfo_t &info, CConnec
 	// Data packet is the most common, check for it first.  Also, does stat tracking.
 	if ( *pPkt & 0x80 )
 	{
-		pSelf->Received_Data( pPkt, cbPkt, usecNow );
+		pSelf->Received_Data( pPkt, cbPkt, info.m_pPreDecrypted, usecNow, info.m_usecKernelRecv );
 		return;
 	}
 
@@ -1764,6 +2187,11 @@ EUnsignedCert CGameNetworkConnectionUDP::AllowLocalUnsignedCert()
 	return AllowRemoteUnsignedCert();
 }
 
+CGameNetworkConnectionUDP *CGameNetworkConnectionUDP::AsGameNetworkConnectionUDP()
+{
+	return this;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 //
 // Loopback connections
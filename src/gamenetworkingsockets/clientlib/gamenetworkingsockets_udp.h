@@ -98,6 +98,21 @@ private:
 	/// Generate a challenge
 	uint64 GenerateChallenge( uint16 nTime, const netadr_t &adr ) const;
 
+	/// Check that a challenge is one we sent to this address recently
+	bool BCheckChallenge( uint64 nChallenge, const netadr_t &adrFrom, GameNetworkingMicroseconds usecNow ) const;
+
+	/// Cheap checks on a connect request, before we parse the protobuf, which is
+	/// relatively expensive.  Checks the challenge, and the rate limit for
+	/// the source address.  Returns false if the packet should be dropped.
+	bool BPreParseCheckConnectRequest( const uint8 *pPkt, int cbPkt, const netadr_t &adrFrom, GameNetworkingMicroseconds usecNow );
+
+	/// Rate limit connect requests by source address prefix.  (See
+	/// k_EGameNetworkingConfig_ConnectRequestRateLimit.)  The prefix is
+	/// hashed using our secret, so an attacker can't pick addresses that
+	/// all land in the same bucket as some other network.
+	static constexpr int k_nConnectRequestRateLimitBuckets = 1024;
+	TokenBucketRateLimiter m_arConnectRequestRateLimit[ k_nConnectRequestRateLimitBuckets ];
+
 	// Callback to handle a packet when it doesn't match
 	// any known address
 	static void ReceivedFromUnknownHost( const RecvPktInfo_t &info, CGameNetworkListenSocketDirectUDP *pSock );
@@ -108,6 +123,51 @@ private:
 	void Received_ConnectionClosed( const CMsgSteamSockets_UDP_ConnectionClosed &msg, const netadr_t &adrFrom, GameNetworkingMicroseconds usecNow );
 	void SendMsg( uint8 nMsgID, const google::protobuf::MessageLite &msg, const netadr_t &adrTo );
 	void SendPaddedMsg( uint8 nMsgID, const google::protobuf::MessageLite &msg, const netadr_t adrTo );
+
+	/// A connect request that passed the cheap checks, and is waiting
+	/// for its signatures to be checked in a batch.  (See k_EGameNetworkingConfig_HandshakeBatchVerify)
+	struct PendingConnectRequest_t
+	{
+		CMsgSteamSockets_UDP_ConnectRequest m_msg;
+		netadr_t m_adrFrom;
+		int m_cbPkt;
+		GameNetworkingMicroseconds m_usecRecv;
+	};
+	std::vector<PendingConnectRequest_t> m_vecPendingConnectRequests;
+	ScheduledMethodThinker<CGameNetworkListenSocketDirectUDP> m_scheduleProcessPendingConnectRequests;
+	bool m_bProcessingPendingConnectRequests;
+
+	/// Each request has at most two signatures: the CA signature on the cert, and the signature on the session info
+	static constexpr int k_nMaxPendingConnectRequests = CSignatureVerifyBatch::k_nMaxSignatures / 2;
+
+	/// A batch of connect requests, and the crypto work for them, which
+	/// is done by a crypto worker thread.  (See k_EGameNetworkingConfig_HandshakeCryptoThreads)
+	struct ConnectRequestCryptoJob;
+	friend struct ConnectRequestCryptoJob;
+
+	/// Jobs that are with the crypto workers.  If we are destroyed, we
+	/// orphan them.
+	std::vector<ConnectRequestCryptoJob *> m_vecConnectRequestCryptoJobsInFlight;
+
+	/// Jobs that the crypto workers are done with.  We resume processing
+	/// these requests a few at a time, so that we don't hog the service
+	/// thread.
+	std::vector<ConnectRequestCryptoJob *> m_vecConnectRequestCryptoJobsDone;
+	ScheduledMethodThinker<CGameNetworkListenSocketDirectUDP> m_scheduleResumeConnectRequests;
+	static constexpr int k_nMaxConnectRequestsResumedPerPass = 4;
+
+	/// If this many jobs are waiting to be resumed, we're too far behind,
+	/// and start dropping new requests.
+	static constexpr int k_nMaxConnectRequestCryptoJobsDone = 8;
+
+	/// Key exchange result for the request we are currently resuming, if
+	/// a worker did it ahead of time.
+	const PrecomputedKeyExchange_t *m_pResumingKeyExchange;
+
+	void QueueConnectRequest( const CMsgSteamSockets_UDP_ConnectRequest &msg, const netadr_t &adrFrom, int cbPkt, GameNetworkingMicroseconds usecNow );
+	void ProcessPendingConnectRequests( GameNetworkingMicroseconds usecNow );
+	void ResumeConnectRequests( GameNetworkingMicroseconds usecNow );
+	void ResumeConnectRequest( ConnectRequestCryptoJob *pJob, int idx );
 };
 
 /////////////////////////////////////////////////////////////////////////////
@@ -131,7 +191,7 @@ public:
 	virtual void SendEndToEndStatsMsg( EStatsReplyRequest eRequest, GameNetworkingMicroseconds usecNow, const char *pszReason ) override;
 
 protected:
-	void Received_Data( const uint8 *pPkt, int cbPkt, GameNetworkingMicroseconds usecNow );
+	void Received_Data( const uint8 *pPkt, int cbPkt, const RecvPktPreDecrypted_t *pPreDecrypted, GameNetworkingMicroseconds usecNow, GameNetworkingMicroseconds usecKernelRecv );
 	void Received_ConnectionClosed( const CMsgSteamSockets_UDP_ConnectionClosed &msg, GameNetworkingMicroseconds usecNow );
 	void Received_NoConnection( const CMsgSteamSockets_UDP_NoConnection &msg, GameNetworkingMicroseconds usecNow );
 
@@ -173,6 +233,12 @@ public:
 
 	void SendConnectOK( GameNetworkingMicroseconds usecNow );
 
+	/// Called by a receive worker thread, which holds the connection lock,
+	/// but NOT the global lock, for a data packet that it has tried to
+	/// decrypt.  If we can finish processing it without the global lock,
+	/// do so and return true.  Otherwise, the service thread will handle it.
+	bool BRecvDataPacketOnWorkerThread( IRawUDPSocket *pRawSock, const uint8 *pPkt, int cbPkt, const netadr_t &adrFrom, const RecvPktPreDecrypted_t *pPreDecrypted, GameNetworkingMicroseconds usecNow, GameNetworkingMicroseconds usecKernelRecv );
+
 	static bool CreateLoopbackPair( CConnectionTransportUDP *pTransport[2] );
 
 protected:
@@ -205,6 +271,7 @@ public:
 	virtual void GetConnectionTypeDescription( ConnectionTypeDescription_t &szDescription ) const override;
 	virtual EUnsignedCert AllowRemoteUnsignedCert() override;
 	virtual EUnsignedCert AllowLocalUnsignedCert() override;
+	virtual CGameNetworkConnectionUDP *AsGameNetworkConnectionUDP() override;
 
 	/// Initiate a connection
 	bool BInitConnect( const GameNetworkingIPAddr &addressRemote, int nOptions, const GameNetworkingConfigValue_t *pOptions, SteamDatagramErrMsg &errMsg );
@@ -236,6 +303,9 @@ public:
 	/// Base class overrides
 	virtual EUnsignedCert AllowRemoteUnsignedCert() override;
 	virtual EUnsignedCert AllowLocalUnsignedCert() override;
+
+	/// Both ends act as the client, so neither one narrows down the cipher list
+	virtual bool BOfferOnlyPreferredEncryptedCipher() override { return true; }
 };
 
 } // namespace GameNetworkingSocketsLib
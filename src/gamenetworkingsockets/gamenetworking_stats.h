@@ -46,6 +46,14 @@ struct SteamDatagramLinkInstantaneousStats
 	/// Peak jitter
 	int m_usecMaxJitter;
 
+	/// Average and peak time between when packets arrived at the host (according
+	/// to the kernel) and when we processed them.  Ping and jitter are measured
+	/// from the kernel receive time, so they reflect the network, and this is the
+	/// local delay on top of that.  -1 if we don't have kernel receive timestamps.
+	/// This is only measured locally; it is not exchanged with the peer.
+	int m_usecAvgRecvProcessingLatency;
+	int m_usecMaxRecvProcessingLatency;
+
 	/// Current sending rate, this can be low at connection start until the slow start
 	/// ramps it up.  It's adjusted as packets are lost and congestion is encountered during
 	/// the connection
@@ -195,6 +203,7 @@ struct SteamDatagramLinkLifetimeStats
 	int64 m_nMessagesSentUnreliable;
 	int64 m_nMessagesRecvReliable;
 	int64 m_nMessagesRecvUnreliable;
+	int64 m_nUnreliableSegmentsRecoveredFEC; // Pieces of unreliable messages we rebuilt from FEC parity.  (Local only, not sent to peer)
 
 	// Ping distribution
 	PingHistogram m_pingHistogram;
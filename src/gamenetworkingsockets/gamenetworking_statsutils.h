@@ -580,6 +580,17 @@ struct LinkStatsTrackerBase
 		m_usecWhenTimeoutStarted = 0;
 	}
 
+	/// Called when we process a packet for which we know when it actually
+	/// arrived at the host.  (See RecvPacketContext_t::m_usecKernelRecv)
+	inline void TrackRecvProcessingLatency( GameNetworkingMicroseconds usecLatency )
+	{
+		Assert( usecLatency >= 0 );
+		int usec = (int)std::min( usecLatency, (GameNetworkingMicroseconds)INT_MAX );
+		m_usecRecvProcessingLatencySum += usec;
+		++m_nRecvProcessingLatencySamples;
+		m_usecMaxRecvProcessingLatency = std::max( m_usecMaxRecvProcessingLatency, usec );
+	}
+
 	//
 	// Quality metrics stats
 	//
@@ -592,6 +603,16 @@ struct LinkStatsTrackerBase
 	float m_flInPacketsWeirdSequencePct;
 	int m_usecMaxJitterPreviousInterval;
 
+	// Receive processing latency, the time between when a packet arrived at the
+	// host and when we processed it.  This is included in the time we measure
+	// if we don't have kernel receive timestamps, so it's tracked separately
+	// from ping.  Current interval, and most recent completed interval.
+	int64 m_usecRecvProcessingLatencySum;
+	int m_nRecvProcessingLatencySamples;
+	int m_usecMaxRecvProcessingLatency;
+	int m_usecAvgRecvProcessingLatencyPreviousInterval;
+	int m_usecMaxRecvProcessingLatencyPreviousInterval;
+
 	// Lifetime counters.  The "accumulator" values do not include the current interval -- use the accessors to get those
 	int64 m_nPktsRecvSequenced;
 	int64 m_nPktsRecvDroppedAccumulator;
@@ -1111,14 +1132,21 @@ struct LinkStatsTracker final : public TLinkStatsTracker
 		return usecNextThink;
 	}
 
+	/// Expand the wire packet number to its full value, based on the
+	/// highest packet number received so far.  No checks, no side effects.
+	inline int64 ExpandWirePacketNumber( uint16 nWireSeqNum ) const
+	{
+		int16 nGap = (int16)( nWireSeqNum - (uint16)TLinkStatsTracker::m_nMaxRecvPktNum );
+		return TLinkStatsTracker::m_nMaxRecvPktNum + nGap;
+	}
+
 	/// Called when we receive a packet with a sequence number.
 	/// This expands the wire packet number to its full value,
 	/// and checks if it is a duplicate or out of range.
 	/// Stats are also updated
 	int64 ExpandWirePacketNumberAndCheck( uint16 nWireSeqNum )
 	{
-		int16 nGap = (int16)( nWireSeqNum - (uint16)TLinkStatsTracker::m_nMaxRecvPktNum );
-		int64 nPktNum = TLinkStatsTracker::m_nMaxRecvPktNum + nGap;
+		int64 nPktNum = ExpandWirePacketNumber( nWireSeqNum );
 
 		// We've received a packet with a sequence number.
 		// Update stats
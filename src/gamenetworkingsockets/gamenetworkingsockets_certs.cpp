@@ -276,6 +276,10 @@ bool BCheckSignature( const std::string &signed_data, CMsgSteamDatagramCertifica
 		return false;
 	}
 
+	// Already checked in a batch?
+	if ( CSignatureVerifyBatch::BActiveBatchHasVerified( public_key.c_str(), public_key.length(), signed_data.c_str(), signed_data.length(), signature.c_str() ) )
+		return true;
+
 	// Put the public key into our object
 	CECSigningPublicKey keyPublic;
 	if ( !keyPublic.SetRawDataWithoutWipingInput( public_key.c_str(), public_key.length() ) )
@@ -295,6 +299,90 @@ bool BCheckSignature( const std::string &signed_data, CMsgSteamDatagramCertifica
 	return true;
 }
 
+const CSignatureVerifyBatch *CSignatureVerifyBatch::s_pActive = nullptr;
+
+bool CSignatureVerifyBatch::AddSignature( const void *pPublicKey, size_t cbPublicKey, const std::string &signed_data, const std::string &signature )
+{
+	Assert( !m_bVerified );
+	if ( BFull() )
+		return false;
+	if ( cbPublicKey != sizeof( Signature_t::m_publicKey ) || signature.length() != sizeof(CryptoSignature_t) )
+		return true;
+
+	Signature_t &s = m_arSignatures[ m_nSignatures++ ];
+	memcpy( s.m_publicKey, pPublicKey, sizeof( s.m_publicKey ) );
+	s.m_pSignedData = (const uint8 *)signed_data.c_str();
+	s.m_cbSignedData = signed_data.length();
+	s.m_pSignature = (const uint8 *)signature.c_str();
+	s.m_bValid = false;
+	return true;
+}
+
+bool CSignatureVerifyBatch::AddSignature( const CECSigningPublicKey &keyPublic, const std::string &signed_data, const std::string &signature )
+{
+	uint8 rawKey[ sizeof( Signature_t::m_publicKey ) ];
+	if ( !keyPublic.IsValid() || keyPublic.GetRawData( rawKey ) != sizeof(rawKey) )
+		return !BFull();
+	return AddSignature( rawKey, sizeof(rawKey), signed_data, signature );
+}
+
+void CSignatureVerifyBatch::Verify()
+{
+	Assert( !m_bVerified );
+	m_bVerified = true;
+	if ( m_nSignatures == 0 )
+		return;
+
+	const uint8 *ppPublicKey[ k_nMaxSignatures ];
+	const void *ppSignedData[ k_nMaxSignatures ];
+	size_t cbSignedData[ k_nMaxSignatures ];
+	const uint8 *ppSignature[ k_nMaxSignatures ];
+	bool bValid[ k_nMaxSignatures ];
+	for ( int i = 0 ; i < m_nSignatures ; ++i )
+	{
+		const Signature_t &s = m_arSignatures[i];
+		ppPublicKey[i] = s.m_publicKey;
+		ppSignedData[i] = s.m_pSignedData;
+		cbSignedData[i] = s.m_cbSignedData;
+		ppSignature[i] = s.m_pSignature;
+	}
+	CCrypto::VerifySignatureBatch( m_nSignatures, ppPublicKey, ppSignedData, cbSignedData, ppSignature, bValid );
+	for ( int i = 0 ; i < m_nSignatures ; ++i )
+		m_arSignatures[i].m_bValid = bValid[i];
+}
+
+bool CSignatureVerifyBatch::BIsVerified( const void *pPublicKey, size_t cbPublicKey, const void *pSignedData, size_t cbSignedData, const void *pSignature ) const
+{
+	if ( cbPublicKey != sizeof( Signature_t::m_publicKey ) )
+		return false;
+
+	// Batches are small, and signatures are effectively random,
+	// so a linear search checking the signature first is fine.
+	for ( int i = 0 ; i < m_nSignatures ; ++i )
+	{
+		const Signature_t &s = m_arSignatures[i];
+		if ( s.m_bValid
+			&& memcmp( s.m_pSignature, pSignature, sizeof(CryptoSignature_t) ) == 0
+			&& memcmp( s.m_publicKey, pPublicKey, sizeof(s.m_publicKey) ) == 0
+			&& s.m_cbSignedData == cbSignedData
+			&& memcmp( s.m_pSignedData, pSignedData, cbSignedData ) == 0 )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool CSignatureVerifyBatch::BActiveBatchHasVerified( const CECSigningPublicKey &keyPublic, const void *pSignedData, size_t cbSignedData, const void *pSignature )
+{
+	if ( !s_pActive )
+		return false;
+	uint8 rawKey[ sizeof( Signature_t::m_publicKey ) ];
+	if ( keyPublic.GetRawData( rawKey ) != sizeof(rawKey) )
+		return false;
+	return s_pActive->BIsVerified( rawKey, sizeof(rawKey), pSignedData, cbSignedData, pSignature );
+}
+
 bool ParseCertFromBase64( const char *pBase64Data, size_t cbBase64Data, CMsgSteamDatagramCertificateSigned &outMsgSignedCert, GameNetworkingErrMsg &errMsg )
 {
 
@@ -14,6 +14,12 @@
 #include "gamenetworkingsockets_certstore.h"
 #include <tier1/utlhashmap.h>
 
+#ifdef IS_STEAMDATAGRAMROUTER
+	#include "router/sdr.h"
+#else
+	#include "clientlib/gamenetworkingsockets_lowlevel.h"
+#endif
+
 #ifdef DBGFLAG_VALIDATE
 	#include <tier0/validator_std.h>
 #endif
@@ -249,9 +255,9 @@ struct PublicKey
 	}
 
 	#ifdef STEAMNETWORKINGSOCKETS_HARDCODED_ROOT_CA_KEY
-		void SlamHardcodedRootCA()
+		void SlamHardcodedRootCA( const char *pszRootCAKey )
 		{
-			bool bOK = m_keyPublic.SetFromOpenSSHAuthorizedKeys( STEAMNETWORKINGSOCKETS_HARDCODED_ROOT_CA_KEY, sizeof(STEAMNETWORKINGSOCKETS_HARDCODED_ROOT_CA_KEY) );
+			bool bOK = m_keyPublic.SetFromOpenSSHAuthorizedKeys( pszRootCAKey, V_strlen( pszRootCAKey )+1 );
 			Assert( bOK );
 			m_eTrust = k_ETrust_Hardcoded;
 			m_effectiveAuthScope.SetAll();
@@ -279,19 +285,25 @@ static PublicKey *FindPublicKey( uint64 nKeyID )
 	return s_mapPublicKeys[ idx ].get();
 }
 
+static void CASignatureCacheFlush();
+
+#ifdef STEAMNETWORKINGSOCKETS_HARDCODED_ROOT_CA_KEY
+static const char *s_pszRootCAKey = STEAMNETWORKINGSOCKETS_HARDCODED_ROOT_CA_KEY;
+#endif
+
 static void CertStore_OneTimeInit()
 {
 	#ifdef STEAMNETWORKINGSOCKETS_HARDCODED_ROOT_CA_KEY
 		if ( s_mapPublicKeys.Count() == 0 )
 		{
 			PublicKey *pKey = new PublicKey;
-			pKey->SlamHardcodedRootCA();
+			pKey->SlamHardcodedRootCA( s_pszRootCAKey );
 			uint64 nKeyID = pKey->CalculateKeyID();
 
 			// Make sure calculated ID matches what we expect!
 			char checkID[64];
 			V_sprintf_safe( checkID, "ID%llu", (unsigned long long)nKeyID );
-			AssertFatal( V_stristr( STEAMNETWORKINGSOCKETS_HARDCODED_ROOT_CA_KEY, checkID ) != NULL );
+			AssertFatal( V_stristr( s_pszRootCAKey, checkID ) != NULL );
 
 			s_mapPublicKeys.Insert( nKeyID, std::unique_ptr<PublicKey>( pKey ) );
 		}
@@ -302,7 +314,16 @@ void CertStore_Reset()
 {
 	s_mapPublicKeys.RemoveAll();
 	s_bTrustValid = false;
+	CASignatureCacheFlush();
+}
+
+#ifdef STEAMNETWORKINGSOCKETS_HARDCODED_ROOT_CA_KEY
+void CertStore_SetRootCAKeyForTests( const char *pszRootCAKey )
+{
+	s_pszRootCAKey = pszRootCAKey;
+	CertStore_Reset();
 }
+#endif
 
 void CertStore_AddKeyRevocation( uint64 key_id )
 {
@@ -562,12 +583,108 @@ static void RecursiveEvaluateKeyTrust( PublicKey *pKey )
 	Assert( !pKey->m_effectiveAuthScope.IsEmpty() );
 }
 
+/////////////////////////////////////////////////////////////////////////////
+//
+// Cache of CA signatures that we have already checked.  Lots of clients
+// present certs signed by the same few CA keys, and the same client presents
+// the same cert every time it reconnects.  An entry is keyed by the CA key ID
+// and a hash of the signed data and the signature, so a hit only means that
+// this exact signature by that key checked out.  It says nothing about
+// whether the key is still trusted or has expired.  We always check that
+// first, using the current state of the key.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+struct CASignatureCacheEntry
+{
+	uint64 m_nCAKeyID; // 0 if the slot is empty
+	SHA256Digest_t m_digest;
+};
+
+/// Direct mapped.  Must be a power of two
+constexpr int k_nCASignatureCacheSize = 4096;
+
+static ShortDurationLock s_lockCASignatureCache( "ca_signature_cache" );
+static std::unique_ptr<CASignatureCacheEntry[]> s_pCASignatureCache;
+static CASignatureCacheStats_t s_CASignatureCacheStats;
+
+static void CalculateCASignatureCacheDigest( const std::string &signed_data, const std::string &signature, SHA256Digest_t &outDigest )
+{
+	Assert( signature.length() == sizeof(CryptoSignature_t) );
+	uint8 buf[ sizeof(SHA256Digest_t) + sizeof(CryptoSignature_t) ];
+	CCrypto::GenerateSHA256Digest( signed_data.c_str(), signed_data.length(), (SHA256Digest_t *)buf );
+	V_memcpy( buf + sizeof(SHA256Digest_t), signature.c_str(), sizeof(CryptoSignature_t) );
+	CCrypto::GenerateSHA256Digest( buf, sizeof(buf), &outDigest );
+}
+
+static inline CASignatureCacheEntry &CASignatureCacheSlot( uint64 nCAKeyID, const SHA256Digest_t &digest )
+{
+	uint32 h;
+	V_memcpy( &h, digest, sizeof(h) );
+	h ^= uint32( nCAKeyID ) ^ uint32( nCAKeyID >> 32 );
+	return s_pCASignatureCache[ h & ( k_nCASignatureCacheSize-1 ) ];
+}
+
+/// Returns true if we have already checked this signature by this key.
+static bool CASignatureCacheFind( uint64 nCAKeyID, const SHA256Digest_t &digest, bool bCountStats )
+{
+	Assert( nCAKeyID != 0 );
+	ShortDurationScopeLock scopeLock( s_lockCASignatureCache );
+	bool bResult = false;
+	if ( s_pCASignatureCache )
+	{
+		const CASignatureCacheEntry &entry = CASignatureCacheSlot( nCAKeyID, digest );
+		bResult = entry.m_nCAKeyID == nCAKeyID && V_memcmp( entry.m_digest, digest, sizeof(SHA256Digest_t) ) == 0;
+	}
+	if ( bCountStats )
+	{
+		if ( bResult )
+			++s_CASignatureCacheStats.m_nHits;
+		else
+			++s_CASignatureCacheStats.m_nMisses;
+	}
+	return bResult;
+}
+
+static void CASignatureCacheAdd( uint64 nCAKeyID, const SHA256Digest_t &digest )
+{
+	Assert( nCAKeyID != 0 );
+	ShortDurationScopeLock scopeLock( s_lockCASignatureCache );
+	if ( !s_pCASignatureCache )
+	{
+		s_pCASignatureCache.reset( new CASignatureCacheEntry[ k_nCASignatureCacheSize ] );
+		for ( int i = 0 ; i < k_nCASignatureCacheSize ; ++i )
+			s_pCASignatureCache[i].m_nCAKeyID = 0;
+	}
+	CASignatureCacheEntry &entry = CASignatureCacheSlot( nCAKeyID, digest );
+	if ( entry.m_nCAKeyID )
+		++s_CASignatureCacheStats.m_nEvictions;
+	entry.m_nCAKeyID = nCAKeyID;
+	V_memcpy( entry.m_digest, digest, sizeof(SHA256Digest_t) );
+}
+
+static void CASignatureCacheFlush()
+{
+	ShortDurationScopeLock scopeLock( s_lockCASignatureCache );
+	s_pCASignatureCache.reset();
+}
+
+void CertStore_GetSignatureCacheStats( CASignatureCacheStats_t &outStats )
+{
+	ShortDurationScopeLock scopeLock( s_lockCASignatureCache );
+	outStats = s_CASignatureCacheStats;
+}
+
 static void CertStore_EnsureTrustValid()
 {
 	CertStore_OneTimeInit();
 	if ( s_bTrustValid )
 		return;
 
+	// Keys might have been replaced or revoked.  We always check the key
+	// before the cache, but there's no reason to keep the old entries.
+	CASignatureCacheFlush();
+
 	// Mark everything not in a "terminal" state as unknown
 	for ( const std::unique_ptr<PublicKey> &pKey: s_mapPublicKeys.IterValues() )
 	{
@@ -609,6 +726,14 @@ const CertAuthScope *CertStore_CheckCASignature( const std::string &signed_data,
 		V_strcpy_safe( errMsg, "Missing CA Key ID" );
 		return nullptr;
 	}
+
+	// We only support one crypto method right now.
+	if ( signature.length() != sizeof(CryptoSignature_t) )
+	{
+		V_strcpy_safe( errMsg, "Signature has invalid length" );
+		return nullptr;
+	}
+
 	PublicKey *pKey = FindPublicKey( nCAKeyID );
 	if ( pKey == nullptr )
 	{
@@ -631,23 +756,49 @@ const CertAuthScope *CertStore_CheckCASignature( const std::string &signed_data,
 		return nullptr;
 	}
 
-	// We only support one crypto method right now.
-	if ( signature.length() != sizeof(CryptoSignature_t) )
-	{
-		V_strcpy_safe( errMsg, "Signature has invalid length" );
-		return nullptr;
-	}
+	// Already checked this exact signature with this key?
+	SHA256Digest_t digest;
+	CalculateCASignatureCacheDigest( signed_data, signature, digest );
+	if ( CASignatureCacheFind( nCAKeyID, digest, true ) )
+		return &pKey->m_effectiveAuthScope;
 
-	// Do the crypto work to check the signature
-	if ( !pKey->m_keyPublic.VerifySignature( signed_data.c_str(), signed_data.length(), *(const CryptoSignature_t *)signature.c_str() ) )
+	// Do the crypto work to check the signature, unless we already did it in a batch
+	if ( !CSignatureVerifyBatch::BActiveBatchHasVerified( pKey->m_keyPublic, signed_data.c_str(), signed_data.length(), signature.c_str() )
+		&& !pKey->m_keyPublic.VerifySignature( signed_data.c_str(), signed_data.length(), *(const CryptoSignature_t *)signature.c_str() ) )
 	{
 		V_strcpy_safe( errMsg, "Signature verification failed" );
 		return nullptr;
 	}
 
+	CASignatureCacheAdd( nCAKeyID, digest );
 	return &pKey->m_effectiveAuthScope;
 }
 
+bool CertStore_AddCASignatureToBatch( const CMsgSteamDatagramCertificateSigned &msgCertSigned, CSignatureVerifyBatch &batch )
+{
+	CertStore_EnsureTrustValid();
+
+	// Only bother if we know the key and it is trusted.  Anything
+	// else will fail before the signature is checked anyway.
+	if ( batch.BFull() )
+		return false;
+	const PublicKey *pKey = FindPublicKey( msgCertSigned.ca_key_id() );
+	if ( pKey == nullptr || !pKey->IsTrusted() )
+		return true;
+
+	// Don't need to verify it if it's in the cache.  This only skips the
+	// crypto.  CertStore_CheckCASignature still checks the trust and expiry
+	// of the key before it consults the cache.
+	if ( msgCertSigned.ca_signature().length() == sizeof(CryptoSignature_t) )
+	{
+		SHA256Digest_t digest;
+		CalculateCASignatureCacheDigest( msgCertSigned.cert(), msgCertSigned.ca_signature(), digest );
+		if ( CASignatureCacheFind( msgCertSigned.ca_key_id(), digest, false ) )
+			return true;
+	}
+	return batch.AddSignature( pKey->m_keyPublic, msgCertSigned.cert(), msgCertSigned.ca_signature() );
+}
+
 const CertAuthScope *CertStore_CheckCert( const CMsgSteamDatagramCertificateSigned &msgCertSigned, CMsgSteamDatagramCertificate &outMsgCert, time_t timeNow, GameNetworkingErrMsg &errMsg )
 {
 	const CertAuthScope *pResult = CertStore_CheckCASignature( msgCertSigned.cert(), msgCertSigned.ca_key_id(), msgCertSigned.ca_signature(), timeNow, errMsg );
@@ -757,6 +908,10 @@ void CertStore_Print( std::ostream &out )
 {
 	CertStore_EnsureTrustValid();
 
+	CASignatureCacheStats_t cacheStats;
+	CertStore_GetSignatureCacheStats( cacheStats );
+	out << "Signature cache: " << (long long)cacheStats.m_nHits << " hits, " << (long long)cacheStats.m_nMisses << " misses, " << (long long)cacheStats.m_nEvictions << " evictions" << std::endl;
+
 	for ( auto item: s_mapPublicKeys.IterItems() )
 	{
 		const std::unique_ptr<PublicKey> &pKey = item.Element();
@@ -107,6 +107,14 @@ struct CertAuthScope
 /// Nuke all certs and start over from scratch
 extern void CertStore_Reset();
 
+#ifdef STEAMNETWORKINGSOCKETS_HARDCODED_ROOT_CA_KEY
+/// For tests only: trust a different root key (in the same format as
+/// STEAMNETWORKINGSOCKETS_HARDCODED_ROOT_CA_KEY) in place of the hardcoded
+/// one, so certs made by a test CA can be checked.  Resets the store.
+/// The string must remain valid as long as the store is in use.
+extern void CertStore_SetRootCAKeyForTests( const char *pszRootCAKey );
+#endif
+
 /// Add a cert to the store from a base-64 blob (the body of the PEM-like blob).  Returns false
 /// only if there was a parse error.  DOES NOT check for expiry or validate any signatures, etc.
 extern bool CertStore_AddCertFromBase64( const char *pszBase64, GameNetworkingErrMsg &errMsg );
@@ -118,11 +126,31 @@ extern void CertStore_AddKeyRevocation( uint64 key_id );
 /// and verify the signature.  Also checks that none of the certs in the chain
 /// have expired at the current time (which you must supply).
 ///
+/// Signatures that have already been checked are remembered, so we don't
+/// need to do the crypto again.  The key's trust and expiry are always
+/// checked.  (See CASignatureCacheStats_t)
+///
 /// If the signed data should be trusted, the scope of the authorization granted
 /// to that public key is returned.  Otherwise, NULL is returned and errMsg is
 /// populated.
 extern const CertAuthScope *CertStore_CheckCASignature( const std::string &signed_data, uint64 nCAKeyID, const std::string &signature, time_t timeNow, GameNetworkingErrMsg &errMsg );
 
+/// Add the CA signature on a cert to a batch of signatures to be checked.
+/// The signature is only added if the CA key is known and trusted.  Returns
+/// false if the batch is full.  See CSignatureVerifyBatch
+extern bool CertStore_AddCASignatureToBatch( const CMsgSteamDatagramCertificateSigned &msgCertSigned, CSignatureVerifyBatch &batch );
+
+/// Counters for the cache of CA signatures that we have already checked.
+/// CertStore_CheckCASignature consults the cache after checking the CA key,
+/// before doing any crypto.
+struct CASignatureCacheStats_t
+{
+	int64 m_nHits = 0;
+	int64 m_nMisses = 0;
+	int64 m_nEvictions = 0; // Entries replaced by a different signature
+};
+extern void CertStore_GetSignatureCacheStats( CASignatureCacheStats_t &outStats );
+
 /// Check a CA signature and chain of trust for a signed cert.
 /// Also deserializes the cert and make sure it is not expired.
 /// DOES NOT CHECK that the appid, pops, etc in the cert
@@ -24,6 +24,7 @@
 #include <tier1/utlbuffer.h>
 #include "keypair.h"
 #include <tier0/memdbgoff.h>
+#include <atomic>
 #include <gamenetworkingsockets_messages_certs.pb.h>
 #include <gns/igamenetworkingutils.h> // for the rendering helpers
 
@@ -270,7 +271,7 @@ constexpr int k_nRouteScoreHuge = INT_MAX/8;
 /// Protocol version of this code.  This is a blunt instrument, which is incremented when we
 /// wish to change the wire protocol in a way that doesn't have some other easy
 /// mechanism for dealing with compatibility (e.g. using protobuf's robust mechanisms).
-const uint32 k_nCurrentProtocolVersion = 10;
+const uint32 k_nCurrentProtocolVersion = 12;
 
 /// Minimum required version we will accept from a peer.  We increment this
 /// when we introduce wire breaking protocol changes and do not wish to be
@@ -279,6 +280,14 @@ const uint32 k_nCurrentProtocolVersion = 10;
 /// do this again, and we'll need to have more sophisticated mechanisms. 
 const uint32 k_nMinRequiredProtocolVersion = 8;
 
+/// Peers older than this cannot decode the select lane frame, and so
+/// we cannot use more than one lane with them.
+const uint32 k_nMinProtocolVersionLanes = 11;
+
+/// Peers older than this cannot decode unreliable FEC parity frames,
+/// so we don't send them.
+const uint32 k_nMinProtocolVersionUnreliableFEC = 12;
+
 /// GameNetworkingMessages is built on top of GameNetworkingSockets.  We use a reserved
 /// virtual port for this interface
 const int k_nVirtualPort_Messages = 0x7fffffff;
@@ -440,6 +449,73 @@ extern uint64 CalculatePublicKeyID( const CECSigningPublicKey &pubKey );
 /// already verified that this public key is from somebody you trust.)
 extern bool BCheckSignature( const std::string &signed_data, CMsgSteamDatagramCertificate_EKeyType eKeyType, const std::string &public_key, const std::string &signature, SteamDatagramErrMsg &errMsg );
 
+/// A set of ed25519 signatures that are checked all at once, which is
+/// much cheaper per signature than checking them one at a time.
+///
+/// The intended use is to gather up the signatures from a bunch of handshake
+/// messages, verify them, and then process the messages as usual with the
+/// batch active.  While it is active, BCheckSignature and the cert store
+/// skip the expensive work for any signature that the batch already verified.
+/// Anything else, including signatures the batch found to be bad, is checked
+/// normally, so all of the error handling stays where it was.
+///
+/// The batch does not copy the signed data or the signatures, they must
+/// remain valid until the batch is cleared.
+class CSignatureVerifyBatch
+{
+public:
+	static constexpr int k_nMaxSignatures = 64;
+
+	CSignatureVerifyBatch() : m_nSignatures( 0 ), m_bVerified( false ) {}
+	~CSignatureVerifyBatch() { Assert( s_pActive != this ); }
+
+	/// Add a signature to the batch.  Malformed keys or signatures are
+	/// silently skipped; they will fail when they are checked normally.
+	/// Returns false if the batch is full.
+	bool AddSignature( const void *pPublicKey, size_t cbPublicKey, const std::string &signed_data, const std::string &signature );
+	bool AddSignature( const CECSigningPublicKey &keyPublic, const std::string &signed_data, const std::string &signature );
+
+	int NumSignatures() const { return m_nSignatures; }
+	bool BFull() const { return m_nSignatures >= k_nMaxSignatures; }
+
+	/// Check all the signatures
+	void Verify();
+
+	/// Return true if the batch has verified this exact signature
+	bool BIsVerified( const void *pPublicKey, size_t cbPublicKey, const void *pSignedData, size_t cbSignedData, const void *pSignature ) const;
+
+	/// Return true if the active batch (if any) has verified the signature
+	static inline bool BActiveBatchHasVerified( const void *pPublicKey, size_t cbPublicKey, const void *pSignedData, size_t cbSignedData, const void *pSignature )
+	{
+		return s_pActive && s_pActive->BIsVerified( pPublicKey, cbPublicKey, pSignedData, cbSignedData, pSignature );
+	}
+	static bool BActiveBatchHasVerified( const CECSigningPublicKey &keyPublic, const void *pSignedData, size_t cbSignedData, const void *pSignature );
+
+	void Clear() { Assert( s_pActive != this ); m_nSignatures = 0; m_bVerified = false; }
+
+	/// Make a batch active for the life of this object.  Protected by the global lock.
+	struct ActiveScope
+	{
+		ActiveScope( const CSignatureVerifyBatch &batch ) { Assert( !s_pActive ); Assert( batch.m_bVerified ); s_pActive = &batch; }
+		~ActiveScope() { s_pActive = nullptr; }
+	};
+
+private:
+	struct Signature_t
+	{
+		uint8 m_publicKey[32];
+		const uint8 *m_pSignedData;
+		size_t m_cbSignedData;
+		const uint8 *m_pSignature;
+		bool m_bValid;
+	};
+	Signature_t m_arSignatures[ k_nMaxSignatures ];
+	int m_nSignatures;
+	bool m_bVerified;
+
+	static const CSignatureVerifyBatch *s_pActive;
+};
+
 /// Parse PEM-like blob to a cert
 extern bool ParseCertFromPEM( const void *pCert, size_t cbCert, CMsgSteamDatagramCertificateSigned &outMsgSignedCert, GameNetworkingErrMsg &errMsg );
 extern bool ParseCertFromBase64( const char *pBase64Data, size_t cbBase64Data, CMsgSteamDatagramCertificateSigned &outMsgSignedCert, GameNetworkingErrMsg &errMsg );
@@ -561,6 +637,13 @@ inline int GameNetworkingIdentityFromCert( GameNetworkingIdentity &result, const
 // NOTE: Does NOT check the cert signature!
 extern int GameNetworkingIdentityFromSignedCert( GameNetworkingIdentity &result, const CMsgSteamDatagramCertificateSigned &msgCertSigned, SteamDatagramErrMsg &errMsg );
 
+/// Bumped whenever any config value changes, at any scope, or the inheritance
+/// chain is rewired.  Cached snapshots of effective values compare against
+/// this to know when they are stale.  Starts at 1, so that a snapshot version
+/// of 0 always means "never resolved".
+extern std::atomic<uint32> g_nConfigValueVersion;
+inline void BumpConfigValueVersion() { g_nConfigValueVersion.fetch_add( 1, std::memory_order_release ); }
+
 struct ConfigValueBase
 {
 
@@ -615,6 +698,7 @@ struct ConfigValue : public ConfigValueBase
 		Assert( !IsLocked() );
 		m_data = value;
 		m_eState = kESet;
+		BumpConfigValueVersion();
 	}
 
 	// Lock in the current value
@@ -717,8 +801,10 @@ struct ConnectionConfig
 	ConfigValue<int32> m_SendBufferSize;
 	ConfigValue<int32> m_SendRateMin;
 	ConfigValue<int32> m_SendRateMax;
+	ConfigValue<int32> m_CongestionControl;
 	ConfigValue<int32> m_MTU_PacketSize;
 	ConfigValue<int32> m_NagleTime;
+	ConfigValue<int32> m_UnreliableFECGroupSize;
 	ConfigValue<int32> m_IP_AllowWithoutAuth;
 	ConfigValue<int32> m_Unencrypted;
 	ConfigValue<int32> m_SymmetricConnect;
@@ -747,6 +833,28 @@ struct ConnectionConfig
 	void Init( ConnectionConfig *pInherit );
 };
 
+/// Effective values of the connection config options that we read per packet
+/// or per message, flattened out of the inheritance chain.  Owners keep one
+/// of these and call Refresh() when m_nVersion no longer matches
+/// g_nConfigValueVersion, so the common case is a single compare.
+struct ConnectionConfigSnapshot
+{
+	uint32 m_nVersion = 0;
+
+	int32 m_SendBufferSize;
+	int32 m_nSendRateMin; // Already clamped to sane limits
+	int32 m_nSendRateMax;
+	int32 m_CongestionControl;
+	int32 m_NagleTime;
+	int32 m_UnreliableFECGroupSize;
+	int32 m_LogLevel_AckRTT;
+	int32 m_LogLevel_PacketDecode;
+	int32 m_LogLevel_Message;
+	int32 m_LogLevel_PacketGaps;
+
+	void Refresh( const ConnectionConfig &config );
+};
+
 template<typename T>
 struct ConnectionConfigDefaultValue : GlobalConfigValueBase<T>
 {
@@ -771,6 +879,13 @@ extern GlobalConfigValue<int32> g_Config_FakeRateLimit_Send_Rate;
 extern GlobalConfigValue<int32> g_Config_FakeRateLimit_Send_Burst;
 extern GlobalConfigValue<int32> g_Config_FakeRateLimit_Recv_Rate;
 extern GlobalConfigValue<int32> g_Config_FakeRateLimit_Recv_Burst;
+extern GlobalConfigValue<int32> g_Config_UDP_SegmentationOffload;
+extern GlobalConfigValue<int32> g_Config_RecvWorkerThreads;
+extern GlobalConfigValue<int32> g_Config_HandshakeBatchVerify;
+extern GlobalConfigValue<int32> g_Config_HandshakeCryptoThreads;
+extern GlobalConfigValue<int32> g_Config_ConnectRequestRateLimit;
+extern GlobalConfigValue<int32> g_Config_SendPacingMaxBurst;
+extern GlobalConfigValue<int32> g_Config_RecvKernelTimestamps;
 
 extern GlobalConfigValue<int32> g_Config_EnumerateDevVars;
 extern GlobalConfigValue<void*> g_Config_Callback_CreateConnectionSignaling;
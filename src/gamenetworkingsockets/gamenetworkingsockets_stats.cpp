@@ -30,6 +30,8 @@ void SteamDatagramLinkInstantaneousStats::Clear()
 	m_flPacketsDroppedPct = -1.0f;
 	m_flPacketsWeirdSequenceNumberPct = -1.0f;
 	m_usecMaxJitter = -1;
+	m_usecAvgRecvProcessingLatency = -1;
+	m_usecMaxRecvProcessingLatency = -1;
 	m_nSendRate = -1;
 	m_nPendingBytes = 0;
 }
@@ -153,6 +155,11 @@ void LinkStatsTrackerBase::InitInternal( GameNetworkingMicroseconds usecNow )
 	m_flInPacketsDroppedPct = -1.0f;
 	m_flInPacketsWeirdSequencePct = -1.0f;
 	m_usecMaxJitterPreviousInterval = -1;
+	m_usecRecvProcessingLatencySum = 0;
+	m_nRecvProcessingLatencySamples = 0;
+	m_usecMaxRecvProcessingLatency = -1;
+	m_usecAvgRecvProcessingLatencyPreviousInterval = -1;
+	m_usecMaxRecvProcessingLatencyPreviousInterval = -1;
 	m_nPktsRecvSequenced = 0;
 	m_nDebugPktsRecvInOrder = 0;
 	m_nPktsRecvDroppedAccumulator = 0;
@@ -201,6 +208,9 @@ void LinkStatsTrackerBase::StartNextInterval( GameNetworkingMicroseconds usecNow
 	m_nPktsRecvDuplicateAccumulator += m_seqPktCounters.m_nDuplicate;
 	m_nPktsRecvLurchAccumulator += m_seqPktCounters.m_nLurch;
 	m_seqPktCounters.Reset();
+	m_usecRecvProcessingLatencySum = 0;
+	m_nRecvProcessingLatencySamples = 0;
+	m_usecMaxRecvProcessingLatency = -1;
 	m_usecIntervalStart = usecNow;
 }
 
@@ -296,6 +306,13 @@ void LinkStatsTrackerBase::UpdateInterval( GameNetworkingMicroseconds usecNow )
 	// Peak jitter value
 	m_usecMaxJitterPreviousInterval = m_seqPktCounters.m_usecMaxJitter;
 
+	// Receive processing latency
+	if ( m_nRecvProcessingLatencySamples > 0 )
+		m_usecAvgRecvProcessingLatencyPreviousInterval = int( m_usecRecvProcessingLatencySum / m_nRecvProcessingLatencySamples );
+	else
+		m_usecAvgRecvProcessingLatencyPreviousInterval = -1;
+	m_usecMaxRecvProcessingLatencyPreviousInterval = m_usecMaxRecvProcessingLatency;
+
 	// Reset for next time
 	StartNextInterval( usecNow );
 }
@@ -541,6 +558,8 @@ void LinkStatsTrackerBase::GetInstantaneousStats( SteamDatagramLinkInstantaneous
 	s.m_flPacketsDroppedPct = m_flInPacketsDroppedPct;
 	s.m_flPacketsWeirdSequenceNumberPct = m_flInPacketsWeirdSequencePct;
 	s.m_usecMaxJitter = m_usecMaxJitterPreviousInterval;
+	s.m_usecAvgRecvProcessingLatency = m_usecAvgRecvProcessingLatencyPreviousInterval;
+	s.m_usecMaxRecvProcessingLatency = m_usecMaxRecvProcessingLatencyPreviousInterval;
 }
 
 void LinkStatsTrackerBase::GetLifetimeStats( SteamDatagramLinkLifetimeStats &s ) const
@@ -806,6 +825,10 @@ void LinkStatsInstantaneousMsgToStruct( const CMsgSteamDatagramLinkInstantaneous
 	else
 		s.m_usecMaxJitter = -1;
 
+	// Only measured locally
+	s.m_usecAvgRecvProcessingLatency = -1;
+	s.m_usecMaxRecvProcessingLatency = -1;
+
 }
 
 void LinkStatsLifetimeStructToMsg( const SteamDatagramLinkLifetimeStats &s, CMsgSteamDatagramLinkLifetimeStats &msg )
@@ -1031,6 +1054,14 @@ void LinkStatsPrintInstantaneousToBuf( const char *pszLeader, const SteamDatagra
 		buf.Printf( "%sPing:%sms    Max latency variance: %sms\n", pszLeader, szPing, szPeakJitter );
 	}
 
+	// If we know when packets actually arrived, then the ping above is
+	// the wire latency, and this is the time we took to get to them
+	if ( stats.m_usecAvgRecvProcessingLatency >= 0 )
+	{
+		buf.Printf( "%sRecv processing latency: %.2fms avg, %.2fms max (not included in ping)\n", pszLeader,
+			stats.m_usecAvgRecvProcessingLatency*1e-3f, stats.m_usecMaxRecvProcessingLatency*1e-3f );
+	}
+
 	if ( stats.m_flPacketsDroppedPct >= 0.0f && stats.m_flPacketsWeirdSequenceNumberPct >= 0.0f )
 	{
 		char szDropped[ 32 ];
@@ -1068,6 +1099,8 @@ void LinkStatsPrintLifetimeToBuf( const char *pszLeader, const SteamDatagramLink
 		buf.Printf( "%s    Duplicate :%11s pkts%7.2f%%\n", pszLeader, NumberPrettyPrinter( stats.m_nPktsRecvDuplicate ).String(), stats.m_nPktsRecvDuplicate * flToPct );
 		buf.Printf( "%s    SeqLurch  :%11s pkts%7.2f%%\n", pszLeader, NumberPrettyPrinter( stats.m_nPktsRecvSequenceNumberLurch ).String(), stats.m_nPktsRecvSequenceNumberLurch * flToPct );
 	}
+	if ( stats.m_nUnreliableSegmentsRecoveredFEC > 0 )
+		buf.Printf( "%s    FEC rebuilt:%10s unreliable segments\n", pszLeader, NumberPrettyPrinter( stats.m_nUnreliableSegmentsRecoveredFEC ).String() );
 
 	// Do we have enough ping samples such that the distribution might be interesting
 	{
@@ -7,7 +7,6 @@
 #endif
 
 #include <tier1/utlpriorityqueue.h>
-
 #include "gamenetworkingsockets_thinker.h"
 
 #ifdef IS_STEAMDATAGRAMROUTER
@@ -27,6 +26,30 @@ namespace GameNetworkingSocketsLib {
 //
 /////////////////////////////////////////////////////////////////////////////
 
+// Thinkers are kept in a hierarchical timing wheel, so that scheduling,
+// rescheduling and cancelling are all O(1).  Connections re-arm their
+// think time constantly (Nagle, ack flush, token bucket wakeups), and with
+// lots of connections the heap fixups we used to do here add up.
+//
+// Level 0 has one slot per microsecond, and each level above that has
+// slots that are 256x wider.  A thinker is linked into the level of the
+// most significant 8-bit group in which its think time differs from the
+// wheel cursor.  So every thinker at level N is due before every thinker at
+// level N+1, and the first occupied slot at the lowest occupied level tells
+// us when we next need to wake up.  As the cursor reaches a slot at a
+// higher level, the thinkers in it are redistributed to the lower levels.
+//
+// Each slot is an unordered list, so that we can link and unlink a thinker
+// by touching only the thinker and the slot, and not its neighbors.
+// Thinkers that are already due are moved to the "ready" queue, which is
+// a heap ordered by think time, so that they are serviced earliest first.
+const int k_nThinkerWheelBitsPerLevel = 8;
+const int k_nThinkerWheelSlotsPerLevel = 1 << k_nThinkerWheelBitsPerLevel;
+const int k_nThinkerWheelLevels = 6; // 2^48 usec, almost 9 years
+const int k_nThinkerWheelSlotReady = k_nThinkerWheelLevels*k_nThinkerWheelSlotsPerLevel;
+const int k_nThinkerWheelSlotOverflow = k_nThinkerWheelSlotReady + 1; // Too far in the future for the wheel.  (Should never happen in practice)
+const int k_nThinkerWheelTotalSlots = k_nThinkerWheelSlotOverflow + 1;
+
 struct ThinkerLess
 {
 	bool operator()( const IThinker *a, const IThinker *b ) const
@@ -37,14 +60,359 @@ struct ThinkerLess
 class ThinkerSetIndex
 {
 public:
-	static void SetIndex( IThinker *p, int idx ) { p->m_queueIndex = idx; }
+	static void SetIndex( IThinker *p, int idx );
 };
 
-static CUtlPriorityQueue<IThinker*,ThinkerLess,ThinkerSetIndex> s_queueThinkers;
+class CThinkerWheel
+{
+public:
+
+	/// Link thinker into the appropriate list, based on its think time
+	void Insert( IThinker *pThinker );
+
+	/// Unlink thinker from whatever list it is in
+	void Remove( IThinker *pThinker );
+
+	/// Move all thinkers that are scheduled before the given time onto
+	/// the ready list
+	void CollectExpired( GameNetworkingMicroseconds usecNow );
+
+	/// Return the earliest thinker from the ready queue, or null
+	inline IThinker *GetFirstReady() const
+	{
+		return m_queueReady.Count() > 0 ? m_queueReady.ElementAtHead() : nullptr;
+	}
+
+	/// Return the time when the earliest thinker wants service.  This
+	/// might be earlier than the real answer if thinkers have been
+	/// removed from a slot, but it is never later.
+	GameNetworkingMicroseconds GetNextThinkTime() const;
+
+	/// Check that every thinker is where it should be.  Returns false
+	/// (after asserting) if anything is wrong.
+	bool CheckInvariants() const;
+
+	#ifdef DBGFLAG_VALIDATE
+		void Validate( CValidator &validator, const char *pchName );
+	#endif
+
+private:
+	struct Slot
+	{
+		std::vector<IThinker*> m_vecThinkers;
+		GameNetworkingMicroseconds m_usecMin = 0; // Lower bound on think time of everything in the list
+	};
+
+	/// All thinkers in the wheel are scheduled no earlier than this, and
+	/// are placed relative to this time.
+	GameNetworkingMicroseconds m_usecCursor = 0;
+
+	/// Bit for each wheel slot that is not empty, and a bit for each
+	/// of those words that is not zero.  Since all of the thinkers at a
+	/// lower level are due before any thinkers at a higher level, the lowest
+	/// bit set tells us the earliest occupied slot.
+	uint64 m_arOccupied[ k_nThinkerWheelSlotReady/64 ] = {};
+	uint32 m_nOccupiedWords = 0;
+	COMPILE_TIME_ASSERT( k_nThinkerWheelSlotReady/64 <= 32 );
+
+	Slot m_arSlots[ k_nThinkerWheelTotalSlots ];
+
+	/// Thinkers that are due.  (The slot at k_nThinkerWheelSlotReady is
+	/// not used, but thinkers in this queue have that as their slot
+	/// index, and their position in the heap as their wheel index.)
+	CUtlPriorityQueue<IThinker*,ThinkerLess,ThinkerSetIndex> m_queueReady;
+
+	/// Scratch list used while redistributing a slot
+	std::vector<IThinker*> m_vecMoveTemp;
+
+	void Link( IThinker *pThinker, int idxSlot );
+	void ClearOccupied( int idxSlot );
+	int FindFirstOccupiedSlot() const;
+	GameNetworkingMicroseconds GetSlotStartTime( int idxSlot ) const;
+	void MoveSlot( int idxSlot, bool bToReady );
+};
+
+void ThinkerSetIndex::SetIndex( IThinker *p, int idx )
+{
+	p->m_nWheelIndex = idx;
+}
+
+void CThinkerWheel::Link( IThinker *pThinker, int idxSlot )
+{
+	if ( idxSlot == k_nThinkerWheelSlotReady )
+	{
+		pThinker->m_nWheelSlot = idxSlot;
+		m_queueReady.Insert( pThinker );
+		return;
+	}
+
+	Slot &slot = m_arSlots[ idxSlot ];
+	pThinker->m_nWheelSlot = idxSlot;
+	pThinker->m_nWheelIndex = (int)slot.m_vecThinkers.size();
+	slot.m_vecThinkers.push_back( pThinker );
+	if ( pThinker->m_nWheelIndex > 0 )
+	{
+		slot.m_usecMin = std::min( slot.m_usecMin, pThinker->m_usecNextThinkTime );
+	}
+	else
+	{
+		slot.m_usecMin = pThinker->m_usecNextThinkTime;
+		if ( idxSlot < k_nThinkerWheelSlotReady )
+		{
+			m_arOccupied[ idxSlot >> 6 ] |= (uint64)1 << ( idxSlot & 63 );
+			m_nOccupiedWords |= 1u << ( idxSlot >> 6 );
+		}
+	}
+}
+
+void CThinkerWheel::ClearOccupied( int idxSlot )
+{
+	Assert( idxSlot < k_nThinkerWheelSlotReady );
+	uint64 &nWord = m_arOccupied[ idxSlot >> 6 ];
+	nWord &= ~( (uint64)1 << ( idxSlot & 63 ) );
+	if ( nWord == 0 )
+		m_nOccupiedWords &= ~( 1u << ( idxSlot >> 6 ) );
+}
+
+void CThinkerWheel::Insert( IThinker *pThinker )
+{
+	const GameNetworkingMicroseconds usecWhen = pThinker->m_usecNextThinkTime;
+	Assert( usecWhen != k_nThinkTime_Never );
+	Assert( pThinker->m_nWheelSlot < 0 );
+
+	// Already due?
+	if ( usecWhen < m_usecCursor )
+	{
+		Link( pThinker, k_nThinkerWheelSlotReady );
+		return;
+	}
+
+	// Level is determined by the highest bit that differs from the cursor
+	const uint64 nDiff = (uint64)usecWhen ^ (uint64)m_usecCursor;
+	const int nLevel = nDiff ? FindMostSignificantBit64( nDiff ) / k_nThinkerWheelBitsPerLevel : 0;
+	if ( unlikely( nLevel >= k_nThinkerWheelLevels ) )
+	{
+		Link( pThinker, k_nThinkerWheelSlotOverflow );
+		return;
+	}
+
+	const int nDigit = (int)( ( (uint64)usecWhen >> ( nLevel*k_nThinkerWheelBitsPerLevel ) ) & ( k_nThinkerWheelSlotsPerLevel-1 ) );
+	Link( pThinker, nLevel*k_nThinkerWheelSlotsPerLevel + nDigit );
+}
+
+void CThinkerWheel::Remove( IThinker *pThinker )
+{
+	const int idxSlot = pThinker->m_nWheelSlot;
+	Assert( idxSlot >= 0 && idxSlot < k_nThinkerWheelTotalSlots );
+	if ( idxSlot == k_nThinkerWheelSlotReady )
+	{
+		Assert( m_queueReady.Element( pThinker->m_nWheelIndex ) == pThinker );
+		m_queueReady.RemoveAt( pThinker->m_nWheelIndex );
+		pThinker->m_nWheelSlot = -1;
+		Assert( pThinker->m_nWheelIndex == -1 );
+		return;
+	}
+	std::vector<IThinker*> &vecThinkers = m_arSlots[ idxSlot ].m_vecThinkers;
+	const int idx = pThinker->m_nWheelIndex;
+	Assert( idx >= 0 && idx < (int)vecThinkers.size() && vecThinkers[ idx ] == pThinker );
+
+	// Move the last one into our place
+	IThinker *pLast = vecThinkers.back();
+	vecThinkers[ idx ] = pLast;
+	pLast->m_nWheelIndex = idx;
+	vecThinkers.pop_back();
+
+	if ( vecThinkers.empty() && idxSlot < k_nThinkerWheelSlotReady )
+		ClearOccupied( idxSlot );
+
+	pThinker->m_nWheelSlot = -1;
+	pThinker->m_nWheelIndex = -1;
+}
+
+int CThinkerWheel::FindFirstOccupiedSlot() const
+{
+	// NOTE: We don't need to start the search at the cursor.  A thinker
+	// is only at a level above 0 if its digit at that level is greater
+	// than the cursor's, so the slots before the cursor are always empty.
+	if ( !m_nOccupiedWords )
+		return -1;
+	const int idxWord = FindLeastSignificantBit( m_nOccupiedWords );
+	return idxWord*64 + FindLeastSignificantBit64( m_arOccupied[ idxWord ] );
+}
+
+GameNetworkingMicroseconds CThinkerWheel::GetSlotStartTime( int idxSlot ) const
+{
+	const int nLevel = idxSlot / k_nThinkerWheelSlotsPerLevel;
+	const int nDigit = idxSlot % k_nThinkerWheelSlotsPerLevel;
+	const int nShift = nLevel*k_nThinkerWheelBitsPerLevel;
+	const uint64 nHighBits = (uint64)m_usecCursor & ( ~(uint64)0 << ( nShift + k_nThinkerWheelBitsPerLevel ) );
+	return (GameNetworkingMicroseconds)( nHighBits | ( (uint64)nDigit << nShift ) );
+}
+
+void CThinkerWheel::MoveSlot( int idxSlot, bool bToReady )
+{
+	// Detach the whole list
+	Assert( m_vecMoveTemp.empty() );
+	m_vecMoveTemp.swap( m_arSlots[ idxSlot ].m_vecThinkers );
+	if ( idxSlot < k_nThinkerWheelSlotReady )
+		ClearOccupied( idxSlot );
+
+	// And re-link each thinker
+	for ( IThinker *pThinker: m_vecMoveTemp )
+	{
+		pThinker->m_nWheelSlot = -1;
+		if ( bToReady )
+			Link( pThinker, k_nThinkerWheelSlotReady );
+		else
+			Insert( pThinker );
+	}
+	m_vecMoveTemp.clear();
+}
+
+void CThinkerWheel::CollectExpired( GameNetworkingMicroseconds usecNow )
+{
+	for (;;)
+	{
+
+		// Locate the earliest occupied slot
+		const int idxSlot = FindFirstOccupiedSlot();
+		if ( idxSlot < 0 )
+		{
+
+			// Wheel is empty.  If anything is in the overflow list, re-check it
+			// against the current time.  Since the cursor is about to catch up
+			// to the current time, all of them will either be due or will go
+			// into slots in the future.
+			if ( unlikely( !m_arSlots[ k_nThinkerWheelSlotOverflow ].m_vecThinkers.empty() ) )
+			{
+				m_usecCursor = std::max( m_usecCursor, usecNow );
+				MoveSlot( k_nThinkerWheelSlotOverflow, false );
+			}
+			break;
+		}
+
+		// Level 0 slots are exactly one microsecond.  Anything
+		// earlier than the current time is due.
+		const GameNetworkingMicroseconds usecSlotStart = GetSlotStartTime( idxSlot );
+		if ( idxSlot < k_nThinkerWheelSlotsPerLevel )
+		{
+			if ( usecSlotStart >= usecNow )
+				break;
+			MoveSlot( idxSlot, true );
+			continue;
+		}
+
+		// Higher level slot.  If we've reached it, then advance the
+		// cursor to the start of the slot, and spread the thinkers out
+		// into the lower levels.
+		if ( usecSlotStart > usecNow )
+			break;
+		m_usecCursor = usecSlotStart;
+		MoveSlot( idxSlot, false );
+	}
+
+	// Nothing else is due.  Advance the cursor, so that thinkers are
+	// placed at the lowest level possible.  Since the earliest occupied
+	// slot is after the current time, the placement of everything in the
+	// wheel is still correct relative to the new cursor.
+	m_usecCursor = std::max( m_usecCursor, usecNow );
+}
+
+GameNetworkingMicroseconds CThinkerWheel::GetNextThinkTime() const
+{
+	// Anybody due now?
+	if ( m_queueReady.Count() > 0 )
+		return m_queueReady.ElementAtHead()->m_usecNextThinkTime;
+
+	const int idxSlot = FindFirstOccupiedSlot();
+	if ( idxSlot >= 0 )
+	{
+		// The min time for the slot can be stale if the earliest thinker
+		// was removed.  Don't ever report a time before the slot begins,
+		// or we'd spin until we get there.
+		return std::max( m_arSlots[ idxSlot ].m_usecMin, GetSlotStartTime( idxSlot ) );
+	}
+
+	if ( !m_arSlots[ k_nThinkerWheelSlotOverflow ].m_vecThinkers.empty() )
+		return m_arSlots[ k_nThinkerWheelSlotOverflow ].m_usecMin;
+	return k_nThinkTime_Never;
+}
+
+bool CThinkerWheel::CheckInvariants() const
+{
+	#define CHECK( x ) if ( !( x ) ) { AssertMsg2( false, "Thinker wheel slot %d: %s", idxSlot, #x ); return false; }
+
+	// Every thinker in a slot should know where it is, and should belong in
+	// that slot, given its think time and the cursor
+	for ( int idxSlot = 0 ; idxSlot < k_nThinkerWheelTotalSlots ; ++idxSlot )
+	{
+		if ( idxSlot == k_nThinkerWheelSlotReady )
+			continue;
+		const Slot &slot = m_arSlots[ idxSlot ];
+		if ( idxSlot < k_nThinkerWheelSlotReady )
+		{
+			const bool bOccupied = ( m_arOccupied[ idxSlot >> 6 ] >> ( idxSlot & 63 ) ) & 1;
+			CHECK( bOccupied == !slot.m_vecThinkers.empty() );
+		}
+		for ( int i = 0 ; i < (int)slot.m_vecThinkers.size() ; ++i )
+		{
+			const IThinker *pThinker = slot.m_vecThinkers[i];
+			CHECK( pThinker->m_nWheelSlot == idxSlot );
+			CHECK( pThinker->m_nWheelIndex == i );
+			CHECK( pThinker->m_usecNextThinkTime != k_nThinkTime_Never );
+			CHECK( pThinker->m_usecNextThinkTime >= slot.m_usecMin );
+			CHECK( pThinker->m_usecNextThinkTime >= m_usecCursor );
+			if ( idxSlot < k_nThinkerWheelSlotReady )
+			{
+				const GameNetworkingMicroseconds usecSlotStart = GetSlotStartTime( idxSlot );
+				const GameNetworkingMicroseconds usecSlotWidth = (GameNetworkingMicroseconds)1 << ( idxSlot / k_nThinkerWheelSlotsPerLevel * k_nThinkerWheelBitsPerLevel );
+				CHECK( pThinker->m_usecNextThinkTime >= usecSlotStart );
+				CHECK( pThinker->m_usecNextThinkTime < usecSlotStart + usecSlotWidth );
+			}
+		}
+	}
+	for ( int idxWord = 0 ; idxWord < k_nThinkerWheelSlotReady/64 ; ++idxWord )
+	{
+		const int idxSlot = idxWord*64;
+		CHECK( ( ( m_nOccupiedWords >> idxWord ) & 1 ) == ( m_arOccupied[ idxWord ] != 0 ) );
+	}
+
+	// Ready queue should be a heap, ordered by think time, and each
+	// thinker should know its position in it
+	{
+		const int idxSlot = k_nThinkerWheelSlotReady;
+		for ( int i = 0 ; i < m_queueReady.Count() ; ++i )
+		{
+			const IThinker *pThinker = m_queueReady.Element( i );
+			CHECK( pThinker->m_nWheelSlot == idxSlot );
+			CHECK( pThinker->m_nWheelIndex == i );
+			CHECK( pThinker->m_usecNextThinkTime != k_nThinkTime_Never );
+			if ( i > 0 )
+				CHECK( m_queueReady.Element( (i-1)/2 )->m_usecNextThinkTime <= pThinker->m_usecNextThinkTime );
+		}
+	}
+
+	#undef CHECK
+	return true;
+}
+
+#ifdef DBGFLAG_VALIDATE
+void CThinkerWheel::Validate( CValidator &validator, const char *pchName )
+{
+	CheckInvariants();
+	for ( Slot &slot: m_arSlots )
+		ValidateRecursive( slot.m_vecThinkers );
+	ValidateObj( m_queueReady );
+	ValidateRecursive( m_vecMoveTemp );
+}
+#endif
+
+static CThinkerWheel s_thinkerWheel;
 
 IThinker::IThinker()
 : m_usecNextThinkTime( k_nThinkTime_Never )
-, m_queueIndex( -1 )
+, m_nWheelSlot( -1 )
+, m_nWheelIndex( -1 )
 {
 }
 
@@ -98,12 +466,8 @@ void IThinker::InternalSetNextThinkTime( GameNetworkingMicroseconds usecTargetTh
 	// Clearing it?
 	if ( usecTargetThinkTime == k_nThinkTime_Never )
 	{
-		if ( m_queueIndex >= 0 )
-		{
-			Assert( s_queueThinkers.Element( m_queueIndex ) == this );
-			s_queueThinkers.RemoveAt( m_queueIndex );
-			Assert( m_queueIndex == -1 );
-		}
+		if ( m_nWheelSlot >= 0 )
+			s_thinkerWheel.Remove( this );
 
 		m_usecNextThinkTime = k_nThinkTime_Never;
 		return;
@@ -111,33 +475,24 @@ void IThinker::InternalSetNextThinkTime( GameNetworkingMicroseconds usecTargetTh
 
 	// Save current time when the next thinker wants service
 	#ifndef IS_STEAMDATAGRAMROUTER
-		GameNetworkingMicroseconds usecNextWake = ( s_queueThinkers.Count() > 0 ) ? s_queueThinkers.ElementAtHead()->GetNextThinkTime() : k_nThinkTime_Never;
+		GameNetworkingMicroseconds usecNextWake = s_thinkerWheel.GetNextThinkTime();
 	#endif
 
-	// Not currently scheduled?
-	if ( m_queueIndex < 0 )
+	// Currently scheduled?  Unlink from our current slot.
+	if ( m_nWheelSlot >= 0 )
 	{
-		Assert( m_usecNextThinkTime == k_nThinkTime_Never );
-		m_usecNextThinkTime = usecTargetThinkTime;
-		s_queueThinkers.Insert( this );
+		Assert( m_usecNextThinkTime != k_nThinkTime_Never );
+		s_thinkerWheel.Remove( this );
 	}
 	else
 	{
-
-		// We're already scheduled.
-		Assert( s_queueThinkers.Element( m_queueIndex ) == this );
-		Assert( m_usecNextThinkTime != k_nThinkTime_Never );
-
-		// Set the new schedule time
-		m_usecNextThinkTime = usecTargetThinkTime;
-
-		// And update our position in the queue
-		s_queueThinkers.RevaluateElement( m_queueIndex );
+		Assert( m_usecNextThinkTime == k_nThinkTime_Never );
 	}
 
-	// Check that we know our place
-	Assert( m_queueIndex >= 0 );
-	Assert( s_queueThinkers.Element( m_queueIndex ) == this );
+	// Set the new schedule time, and link into the appropriate slot
+	m_usecNextThinkTime = usecTargetThinkTime;
+	s_thinkerWheel.Insert( this );
+	Assert( m_nWheelSlot >= 0 );
 
 	#ifndef IS_STEAMDATAGRAMROUTER
 		// Do we need service before we were previously schedule to wake up?
@@ -152,27 +507,22 @@ void IThinker::InternalSetNextThinkTime( GameNetworkingMicroseconds usecTargetTh
 
 GameNetworkingMicroseconds IThinker::Thinker_GetNextScheduledThinkTime()
 {
-	GameNetworkingMicroseconds usecResult = k_nThinkTime_Never;
 	s_mutexThinkerTable.lock();
-	if ( s_queueThinkers.Count() )
-		usecResult = s_queueThinkers.ElementAtHead()->GetNextThinkTime();
+	GameNetworkingMicroseconds usecResult = s_thinkerWheel.GetNextThinkTime();
 	s_mutexThinkerTable.unlock();
 	return usecResult;
 }
 
 void IThinker::Thinker_ProcessThinkers()
 {
-	// We need the lock to access the thinker queue
+	// We need the lock to access the thinker wheel
 	s_mutexThinkerTable.lock();
 
-	// Until the queue is empty
+	// Until nothing else is due
 	int nIterations = 0;
-	while ( s_queueThinkers.Count() > 0 )
+	for (;;)
 	{
 
-		// Grab the head element
-		IThinker *pNextThinker = s_queueThinkers.ElementAtHead();
-
 		// Refetch timestamp each time.  The reason is that certain thinkers
 		// may pass through to other systems (e.g. fake lag) that fetch the time.
 		// If we don't update the time here, that code may have used the newer
@@ -181,11 +531,18 @@ void IThinker::Thinker_ProcessThinkers()
 		// a thinker.
 		GameNetworkingMicroseconds usecNow = GameNetworkingSockets_GetLocalTimestamp();
 
-		// Scheduled too far in the future?
-		if ( pNextThinker->GetNextThinkTime() >= usecNow )
+		// Grab the next thinker that is due.  If the ready list is
+		// empty, check if anybody else has come due since we last looked.
+		IThinker *pNextThinker = s_thinkerWheel.GetFirstReady();
+		if ( !pNextThinker )
 		{
-			// Keep waiting
-			break;
+			s_thinkerWheel.CollectExpired( usecNow );
+			pNextThinker = s_thinkerWheel.GetFirstReady();
+			if ( !pNextThinker )
+			{
+				// Keep waiting
+				break;
+			}
 		}
 
 		++nIterations;
@@ -200,16 +557,8 @@ void IThinker::Thinker_ProcessThinkers()
 		{
 
 			// Go ahead and clear his think time now and remove him
-			// from the heap.  He needs to schedule a new think time
-			// if heeds service again.  For thinkers that need frequent
-			// service, removing them and then re-inserting them when
-			// they reschedule is a bit of extra work that could be
-			// optimized by trying to not remove them now, but adjusting
-			// them once we know when they want to think.  But this
-			// is probably just a bit too complicated for the expected
-			// benefit.  If the number of total Thinkers is relatively
-			// small (which it probably will be), the heap operations
-			// are probably negligible.
+			// from the ready list.  He needs to schedule a new think time
+			// if he needs service again.  Both operations are O(1).
 			pNextThinker->InternalSetNextThinkTime( k_nThinkTime_Never );
 
 			// Release the global thinker table lock, so that other threads
@@ -220,7 +569,7 @@ void IThinker::Thinker_ProcessThinkers()
 
 			// Execute callback.  (Note: this could result
 			// in self-destruction or essentially any change
-			// to the rest of the queue.)
+			// to the rest of the wheel.)
 			pNextThinker->Think( usecNow );
 
 			// Re-acquire table lock for the next check
@@ -241,7 +590,8 @@ void IThinker::Thinker_ProcessThinkers()
 #ifdef DBGFLAG_VALIDATE
 void Thinker_ValidateStatics( CValidator &validator )
 {
-	ValidateObj( s_queueThinkers );
+	ShortDurationScopeLock scopeLock( s_mutexThinkerTable );
+	ValidateObj( s_thinkerWheel );
 }
 #endif
 
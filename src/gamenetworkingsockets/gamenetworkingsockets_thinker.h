@@ -16,7 +16,7 @@ namespace GameNetworkingSocketsLib {
 
 const GameNetworkingMicroseconds k_nThinkTime_Never = INT64_MAX;
 const GameNetworkingMicroseconds k_nThinkTime_ASAP = 1; // by convention, we do not allow setting a think time to 0, since 0 is often an uninitialized variable.
-class ThinkerSetIndex;
+class CThinkerWheel;
 
 class IThinker
 {
@@ -71,7 +71,12 @@ protected:
 
 private:
 	GameNetworkingMicroseconds m_usecNextThinkTime;
-	int m_queueIndex;
+
+	// Location in the timer wheel.  m_nWheelSlot is -1 if we are
+	// not scheduled.
+	int m_nWheelSlot;
+	int m_nWheelIndex;
+	friend class CThinkerWheel;
 	friend class ThinkerSetIndex;
 
 	void InternalSetNextThinkTime( GameNetworkingMicroseconds usecTargetThinkTime );
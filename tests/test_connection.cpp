@@ -8,6 +8,7 @@
 #include <random>
 #include <chrono>
 #include <thread>
+#include <atomic>
 
 #include <gns/gamenetworkingsockets.h>
 #include <gns/igamenetworkingutils.h>
@@ -491,6 +492,304 @@ static void RunSteamDatagramConnectionTest()
 	Test( 1000000, 5, 50, 2, 10 );
 }
 
+// Fetch the current global value of an int32 config option, so a test can
+// put it back when it is done
+static int32 GetGlobalConfigValueInt32( EGameNetworkingConfigValue eValue )
+{
+	int32 nValue = 0;
+	size_t cbValue = sizeof(nValue);
+	EGameNetworkingConfigDataType eDataType;
+	EGameNetworkingGetConfigValueResult eResult = GameNetworkingUtils()->GetConfigValue( eValue, k_EGameNetworkingConfig_Global, 0, &eDataType, &nValue, &cbValue );
+	assert( eResult == k_EGameNetworkingGetConfigValue_OK || eResult == k_EGameNetworkingGetConfigValue_OKInherited );
+	assert( eDataType == k_EGameNetworkingConfig_Int32 );
+	return nValue;
+}
+
+// Check that delivery rate based congestion control finds the capacity
+// of a rate limited link
+static void TestCongestionControlConvergence()
+{
+	IGameNetworkingSockets *pSteamSocketNetworking = GameNetworkingSockets();
+	IGameNetworkingUtils *pUtils = GameNetworkingUtils();
+
+	TEST_Printf( "---------------------------------------------------\n" );
+	TEST_Printf( "CONGESTION CONTROL CONVERGENCE\n" );
+	TEST_Printf( "---------------------------------------------------\n" );
+
+#if defined(SANITIZER) || defined(LIGHT_TESTS)
+	const GameNetworkingMicroseconds usecSettleDuration = 2000000;
+	const GameNetworkingMicroseconds usecMeasureDuration = 1000000;
+#else
+	const GameNetworkingMicroseconds usecSettleDuration = 4000000;
+	const GameNetworkingMicroseconds usecMeasureDuration = 4000000;
+#endif
+
+	// Bandwidth estimation can go well above the link rate, so
+	// that it is the fake rate limit that we are discovering
+	const int32 nSaveSendRateMin = GetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMin );
+	const int32 nSaveSendRateMax = GetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMax );
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_CongestionControl, k_nGameNetworkingConfig_CongestionControl_BBR );
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMin, 16*1024 );
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMax, 8*1024*1024 );
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_FakePacketLag_Send, 10 );
+
+	HGameNetConnection hSend, hRecv;
+	assert( pSteamSocketNetworking->CreateSocketPair( &hSend, &hRecv, true, nullptr, nullptr ) );
+
+	// Start low, then check that we can discover more bandwidth
+	// when it appears, and back off when it goes away
+	for ( int nRate: { 128*1024, 512*1024, 256*1024 } )
+	{
+		pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_FakeRateLimit_Send_Rate, nRate );
+
+		GameNetworkingMicroseconds usecStart = pUtils->GetLocalTimestamp();
+		GameNetworkingMicroseconds usecMeasureStart = usecStart + usecSettleDuration;
+		GameNetworkingMicroseconds usecEnd = usecMeasureStart + usecMeasureDuration;
+		int64 cbRecvMeasured = 0;
+		double flEstimateSum = 0.0;
+		int nEstimateSamples = 0;
+		char msg[ 1000 ] = {};
+		while ( true )
+		{
+			GameNetworkingMicroseconds usecNow = pUtils->GetLocalTimestamp();
+			if ( usecNow >= usecEnd )
+				break;
+
+			// Keep the send buffer full, so we are never app-limited
+			GameNetworkingQuickConnectionStatus info;
+			assert( pSteamSocketNetworking->GetQuickConnectionStatus( hSend, &info ) );
+			assert( info.m_eState == k_EGameNetworkingConnectionState_Connected );
+			for ( int cbPending = info.m_cbPendingReliable ; cbPending < 128*1024 ; cbPending += sizeof(msg) )
+				assert( pSteamSocketNetworking->SendMessageToConnection( hSend, msg, sizeof(msg), k_nGameNetworkingSend_Reliable, nullptr ) == k_EResultOK );
+
+			IGameNetworkingMessage *pMsgs[ 64 ];
+			int nMsgs = pSteamSocketNetworking->ReceiveMessagesOnConnection( hRecv, pMsgs, 64 );
+			for ( int i = 0 ; i < nMsgs ; ++i )
+			{
+				if ( usecNow >= usecMeasureStart )
+					cbRecvMeasured += pMsgs[i]->GetSize();
+				pMsgs[i]->Release();
+			}
+
+			if ( usecNow >= usecMeasureStart )
+			{
+				flEstimateSum += info.m_nSendRateBytesPerSecond;
+				++nEstimateSamples;
+			}
+
+			TEST_PumpCallbacks();
+			std::this_thread::sleep_for( std::chrono::milliseconds( 2 ) );
+		}
+
+		float flEstimate = float( flEstimateSum / std::max( nEstimateSamples, 1 ) );
+		float flGoodput = float( cbRecvMeasured * 1e6 / usecMeasureDuration );
+		TEST_Printf( "Rate limit %6.1fK  estimate %6.1fK  goodput %6.1fK\n", nRate/1024.0f, flEstimate/1024.0f, flGoodput/1024.0f );
+
+		// The estimate should track the link rate.  Goodput will be a
+		// bit lower, because of probing and packet overhead.
+		assert( flEstimate > nRate*.7f && flEstimate < nRate*1.4f );
+		assert( flGoodput > nRate*.6f );
+	}
+
+	pSteamSocketNetworking->CloseConnection( hSend, 0, nullptr, false );
+	pSteamSocketNetworking->CloseConnection( hRecv, 0, nullptr, false );
+
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMin, nSaveSendRateMin );
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMax, nSaveSendRateMax );
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_FakeRateLimit_Send_Rate, 0 );
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_FakePacketLag_Send, 0 );
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_CongestionControl, k_nGameNetworkingConfig_CongestionControl_Fixed );
+}
+
+static std::atomic<int> s_nBroadcastPayloadsFreed;
+static void FreeBroadcastPayload( GameNetworkingMessage_t *pMsg )
+{
+	++s_nBroadcastPayloadsFreed;
+	free( pMsg->m_pData );
+}
+
+static void TestBroadcastMessage()
+{
+	IGameNetworkingSockets *pSteamSocketNetworking = GameNetworkingSockets();
+	IGameNetworkingUtils *pUtils = GameNetworkingUtils();
+
+	TEST_Printf( "---------------------------------------------------\n" );
+	TEST_Printf( "BROADCAST MESSAGE\n" );
+	TEST_Printf( "---------------------------------------------------\n" );
+
+	const int k_nPairs = 8;
+	const int k_nMessages = 200;
+	const int k_cbMsg = 1000;
+
+	// Use some loss, so that the shared payload has to stay alive
+	// for retransmission
+	const int32 nSaveSendRateMin = GetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMin );
+	const int32 nSaveSendRateMax = GetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMax );
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMin, 1024*1024 );
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMax, 1024*1024 );
+	pUtils->SetGlobalConfigValueFloat( k_EGameNetworkingConfig_FakePacketLoss_Send, 10.0f );
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_FakePacketLag_Send, 10 );
+
+	HGameNetConnection arSend[ k_nPairs ], arRecv[ k_nPairs ];
+	HGameNetPollGroup hPollGroup = pSteamSocketNetworking->CreatePollGroup();
+	for ( int i = 0 ; i < k_nPairs ; ++i )
+	{
+		assert( pSteamSocketNetworking->CreateSocketPair( &arSend[i], &arRecv[i], true, nullptr, nullptr ) );
+		assert( pSteamSocketNetworking->SetConnectionPollGroup( arSend[i], hPollGroup ) );
+	}
+
+	// Send half to the list of connections, and half to the poll group.
+	// Each message points at a buffer that we allocated ourselves.
+	s_nBroadcastPayloadsFreed = 0;
+	for ( int nMsg = 0 ; nMsg < k_nMessages ; ++nMsg )
+	{
+		GameNetworkingMessage_t *pMsg = pUtils->AllocateMessage( 0 );
+		pMsg->m_pData = malloc( k_cbMsg );
+		pMsg->m_cbSize = k_cbMsg;
+		pMsg->m_pfnFreeData = FreeBroadcastPayload;
+		pMsg->m_nFlags = k_nGameNetworkingSend_Reliable;
+		memset( pMsg->m_pData, nMsg & 0xff, k_cbMsg );
+		if ( nMsg & 1 )
+		{
+			assert( pSteamSocketNetworking->BroadcastMessageToPollGroup( pMsg, hPollGroup ) == k_nPairs );
+		}
+		else
+		{
+			int64 arResult[ k_nPairs ];
+			pSteamSocketNetworking->BroadcastMessage( pMsg, k_nPairs, arSend, arResult );
+			for ( int64 r: arResult )
+				assert( r > 0 );
+		}
+	}
+
+	// Everybody should get every message, in order
+	int arNextMsg[ k_nPairs ] = {};
+	GameNetworkingMicroseconds usecTimeout = pUtils->GetLocalTimestamp() + 10*1000*1000;
+	for (;;)
+	{
+		bool bDone = true;
+		for ( int i = 0 ; i < k_nPairs ; ++i )
+		{
+			IGameNetworkingMessage *pMsgs[ 64 ];
+			int nMsgs = pSteamSocketNetworking->ReceiveMessagesOnConnection( arRecv[i], pMsgs, 64 );
+			for ( int j = 0 ; j < nMsgs ; ++j )
+			{
+				assert( pMsgs[j]->GetSize() == k_cbMsg );
+				const uint8 *pData = (const uint8 *)pMsgs[j]->GetData();
+				assert( pData[0] == ( arNextMsg[i] & 0xff ) && pData[k_cbMsg-1] == ( arNextMsg[i] & 0xff ) );
+				++arNextMsg[i];
+				pMsgs[j]->Release();
+			}
+			if ( arNextMsg[i] < k_nMessages )
+				bDone = false;
+		}
+		if ( bDone )
+			break;
+		assert( pUtils->GetLocalTimestamp() < usecTimeout );
+		TEST_PumpCallbacks();
+		std::this_thread::sleep_for( std::chrono::milliseconds( 2 ) );
+	}
+
+	// Once everything has been acked, each payload should be freed, exactly once
+	while ( s_nBroadcastPayloadsFreed < k_nMessages )
+	{
+		assert( pUtils->GetLocalTimestamp() < usecTimeout );
+		TEST_PumpCallbacks();
+		std::this_thread::sleep_for( std::chrono::milliseconds( 2 ) );
+	}
+	TEST_Printf( "%d messages to %d connections, %d payloads freed\n", k_nMessages, k_nPairs, s_nBroadcastPayloadsFreed.load() );
+
+	for ( int i = 0 ; i < k_nPairs ; ++i )
+	{
+		pSteamSocketNetworking->CloseConnection( arSend[i], 0, nullptr, false );
+		pSteamSocketNetworking->CloseConnection( arRecv[i], 0, nullptr, false );
+	}
+	pSteamSocketNetworking->DestroyPollGroup( hPollGroup );
+	assert( s_nBroadcastPayloadsFreed == k_nMessages );
+
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMin, nSaveSendRateMin );
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMax, nSaveSendRateMax );
+	pUtils->SetGlobalConfigValueFloat( k_EGameNetworkingConfig_FakePacketLoss_Send, 0.0f );
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_FakePacketLag_Send, 0 );
+}
+
+// Stream reliable data as fast as we can through heavy loss.  The receiver
+// runs out of room to track all the gaps, and has to act as if it didn't
+// receive some packets.  It must never ack a packet it didn't process, or
+// the stream will stall.
+static void TestReliableStreamLoss()
+{
+	IGameNetworkingSockets *pSteamSocketNetworking = GameNetworkingSockets();
+	IGameNetworkingUtils *pUtils = GameNetworkingUtils();
+
+	TEST_Printf( "---------------------------------------------------\n" );
+	TEST_Printf( "RELIABLE STREAM LOSS\n" );
+	TEST_Printf( "---------------------------------------------------\n" );
+
+#if defined(SANITIZER) || defined(LIGHT_TESTS)
+	const int k_nMessages = 5000;
+#else
+	const int k_nMessages = 10000;
+#endif
+	const int k_cbMsg = 1000;
+
+	const int32 nSaveSendRateMin = GetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMin );
+	const int32 nSaveSendRateMax = GetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMax );
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMin, 64*1024*1024 );
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMax, 64*1024*1024 );
+	pUtils->SetGlobalConfigValueFloat( k_EGameNetworkingConfig_FakePacketLoss_Send, 20.0f );
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_FakePacketLag_Send, 5 );
+
+	HGameNetConnection hSend, hRecv;
+	assert( pSteamSocketNetworking->CreateSocketPair( &hSend, &hRecv, true, nullptr, nullptr ) );
+
+	// Every message is tagged with its sequence number, so we can check
+	// that they all arrive, in order
+	char msg[ k_cbMsg ] = {};
+	int nSent = 0, nReceived = 0;
+	GameNetworkingMicroseconds usecTimeout = pUtils->GetLocalTimestamp() + 60*1000*1000;
+	while ( nReceived < k_nMessages )
+	{
+		while ( nSent < k_nMessages )
+		{
+			memcpy( msg, &nSent, sizeof(nSent) );
+			if ( pSteamSocketNetworking->SendMessageToConnection( hSend, msg, k_cbMsg, k_nGameNetworkingSend_ReliableNoNagle, nullptr ) != k_EResultOK )
+				break;
+			++nSent;
+		}
+
+		IGameNetworkingMessage *pMsgs[ 64 ];
+		int nMsgs = pSteamSocketNetworking->ReceiveMessagesOnConnection( hRecv, pMsgs, 64 );
+		for ( int i = 0 ; i < nMsgs ; ++i )
+		{
+			int nMsgSeq;
+			assert( pMsgs[i]->GetSize() == k_cbMsg );
+			memcpy( &nMsgSeq, pMsgs[i]->GetData(), sizeof(nMsgSeq) );
+			assert( nMsgSeq == nReceived );
+			++nReceived;
+			pMsgs[i]->Release();
+		}
+
+		GameNetworkingQuickConnectionStatus info;
+		assert( pSteamSocketNetworking->GetQuickConnectionStatus( hRecv, &info ) );
+		assert( info.m_eState == k_EGameNetworkingConnectionState_Connected );
+		assert( pUtils->GetLocalTimestamp() < usecTimeout );
+
+		TEST_PumpCallbacks();
+		if ( nMsgs == 0 )
+			std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+	}
+	TEST_Printf( "%d messages received in order\n", nReceived );
+
+	pSteamSocketNetworking->CloseConnection( hSend, 0, nullptr, false );
+	pSteamSocketNetworking->CloseConnection( hRecv, 0, nullptr, false );
+
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMin, nSaveSendRateMin );
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMax, nSaveSendRateMax );
+	pUtils->SetGlobalConfigValueFloat( k_EGameNetworkingConfig_FakePacketLoss_Send, 0.0f );
+	pUtils->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_FakePacketLag_Send, 0 );
+}
+
 // Some tests for identity string handling.  Doesn't really have anything to do with
 // connectivity, this is just a conveinent place for this to live
 void TestGameNetworkingIdentity()
@@ -528,22 +827,50 @@ void TestGameNetworkingIdentity()
 
 }
 
-int main(  )
+// With no arguments, run everything.  Otherwise, only run the tests named
+// on the command line: identity, convergence, broadcast, connection
+static bool BShouldRunTest( int argc, const char **argv, const char *pszName )
+{
+	if ( argc <= 1 )
+		return true;
+	for ( int i = 1 ; i < argc ; ++i )
+	{
+		if ( strcmp( argv[i], pszName ) == 0 )
+			return true;
+	}
+	return false;
+}
+
+int main( int argc, const char **argv )
 {
 	// Test some identity printing/parsing stuff
-	TestGameNetworkingIdentity();
+	if ( BShouldRunTest( argc, argv, "identity" ) )
+		TestGameNetworkingIdentity();
 
 	// Create client and server sockets
 	TEST_Init( nullptr );
 	GameNetworkingUtils()->SetGlobalCallback_GameNetConnectionStatusChanged( OnGameNetConnectionStatusChanged );
 
+	// Make sure bandwidth estimation works
+	if ( BShouldRunTest( argc, argv, "convergence" ) )
+		TestCongestionControlConvergence();
+
+	// Send one payload to many connections
+	if ( BShouldRunTest( argc, argv, "broadcast" ) )
+		TestBroadcastMessage();
+
+	// Reliable stream through heavy loss
+	if ( BShouldRunTest( argc, argv, "reliableloss" ) )
+		TestReliableStreamLoss();
+
 	// Run the test
-	RunSteamDatagramConnectionTest();
+	if ( BShouldRunTest( argc, argv, "connection" ) )
+		RunSteamDatagramConnectionTest();
 
 	TEST_Kill();	
 	return 0;
 }
 
 #ifdef NN_NINTENDO_SDK
-extern "C" void nnMain() { main(); }
+extern "C" void nnMain() { main( 0, nullptr ); }
 #endif
@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <string>
+#include <vector>
 
 #include <tier1/utlbuffer.h>
 #include <crypto.h>
@@ -270,6 +271,21 @@ void TestSymmetricAuthCrypto_EncryptTestVectorFile( const char *pszFilename )
 		CHECK( memcmp( ct.c_str(), encrypted, ct.length() ) == 0 );
 		CHECK( memcmp( tag.c_str(), encrypted+ct.length(), tag.length() ) == 0 );
 
+		// Same thing, through the batch interface
+		uint8 encryptedBatch[ 2048 ];
+		AES_GCM_BatchPacket_t pkt;
+		pkt.m_pIn = pt.c_str();
+		pkt.m_cbIn = (uint32)pt.length();
+		pkt.m_pIV = iv.c_str();
+		pkt.m_pAAD = aad.c_str();
+		pkt.m_cbAAD = (uint32)aad.length();
+		pkt.m_pOut = encryptedBatch;
+		pkt.m_cbOut = sizeof(encryptedBatch);
+		CHECK( ctxEnc.EncryptBatch( &pkt, 1 ) == 1 );
+		CHECK( pkt.m_bOK );
+		CHECK( pkt.m_cbOut == cbEncrypted );
+		CHECK( memcmp( encrypted, encryptedBatch, cbEncrypted ) == 0 );
+
 		// Make sure we can decrypt it successfully
 		uint8 decrypted[ 2048 ];
 		uint32 cbDecrypted = sizeof(decrypted);
@@ -310,6 +326,182 @@ void TestSymmetricAuthCryptoVectors()
 	TestSymmetricAuthCrypto_EncryptTestVectorFile( TEST_VECTOR_DIR "gcmEncryptExtIV256.rsp" );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Test batch AES-GCM against the one-packet-at-a-time interface
+//-----------------------------------------------------------------------------
+void TestSymmetricAuthCryptoBatch()
+{
+	// Mostly small packets, but a few that are big enough that
+	// they can't be done in the same pass as the others.
+	const int k_nPackets = 50;
+	const int k_cbMaxPacket = 5000;
+
+	uint8 rgubKey[k_nSymmetricKeyLen];
+	CCrypto::GenerateRandomBlock( rgubKey, V_ARRAYSIZE( rgubKey ) );
+
+	AES_GCM_EncryptContext ctxEnc;
+	AES_GCM_DecryptContext ctxDec;
+	CHECK( ctxEnc.Init( rgubKey, k_nSymmetricKeyLen, k_nSymmetricIVSize, k_nSymmetricGCMTagSize ) );
+	CHECK( ctxDec.Init( rgubKey, k_nSymmetricKeyLen, k_nSymmetricIVSize, k_nSymmetricGCMTagSize ) );
+
+	const int k_cbSlot = k_cbMaxPacket + k_nSymmetricGCMTagSize;
+	std::vector<uint8> vecPlaintext( k_nPackets*k_cbSlot );
+	std::vector<uint8> vecEncrypted( k_nPackets*k_cbSlot );
+	std::vector<uint8> vecDecrypted( k_nPackets*k_cbSlot );
+	std::vector<uint8> vecIV( k_nPackets*k_nSymmetricIVSize );
+	uint8 rgubAAD[ 100 ];
+	CCrypto::GenerateRandomBlock( vecPlaintext.data(), (int)vecPlaintext.size() );
+	CCrypto::GenerateRandomBlock( vecIV.data(), (int)vecIV.size() );
+	CCrypto::GenerateRandomBlock( rgubAAD, sizeof(rgubAAD) );
+
+	AES_GCM_BatchPacket_t pkts[ k_nPackets ];
+	for ( int i = 0 ; i < k_nPackets ; ++i )
+	{
+		AES_GCM_BatchPacket_t &pkt = pkts[i];
+		pkt.m_pIn = &vecPlaintext[ i*k_cbSlot ];
+		pkt.m_cbIn = ( i % 17 == 16 ) ? k_cbMaxPacket - i : ( i*37 ) % 300;
+		pkt.m_pIV = &vecIV[ i*k_nSymmetricIVSize ];
+		pkt.m_pAAD = ( i % 3 == 0 ) ? rgubAAD : nullptr;
+		pkt.m_cbAAD = ( i % 3 == 0 ) ? i % sizeof(rgubAAD) : 0;
+		pkt.m_pOut = &vecEncrypted[ i*k_cbSlot ];
+		pkt.m_cbOut = k_cbSlot;
+	}
+	CHECK( ctxEnc.EncryptBatch( pkts, k_nPackets ) == k_nPackets );
+
+	// Must match what we get one at a time, and must decrypt one at a time
+	for ( int i = 0 ; i < k_nPackets ; ++i )
+	{
+		const AES_GCM_BatchPacket_t &pkt = pkts[i];
+		CHECK( pkt.m_bOK );
+		uint8 encrypted[ k_cbSlot ];
+		uint32 cbEncrypted = sizeof(encrypted);
+		CHECK( ctxEnc.Encrypt( pkt.m_pIn, pkt.m_cbIn, pkt.m_pIV, encrypted, &cbEncrypted, pkt.m_pAAD, pkt.m_cbAAD ) );
+		CHECK( cbEncrypted == pkt.m_cbOut );
+		CHECK( memcmp( encrypted, pkt.m_pOut, cbEncrypted ) == 0 );
+
+		uint8 decrypted[ k_cbSlot ];
+		uint32 cbDecrypted = sizeof(decrypted);
+		CHECK( ctxDec.Decrypt( pkt.m_pOut, pkt.m_cbOut, pkt.m_pIV, decrypted, &cbDecrypted, pkt.m_pAAD, pkt.m_cbAAD ) );
+		CHECK( cbDecrypted == pkt.m_cbIn );
+		CHECK( memcmp( decrypted, pkt.m_pIn, cbDecrypted ) == 0 );
+	}
+
+	// Now decrypt in a batch, with a few packets damaged.  Only
+	// the damaged ones should fail.
+	uint32 arcbEncrypted[ k_nPackets ];
+	for ( int i = 0 ; i < k_nPackets ; ++i )
+		arcbEncrypted[i] = pkts[i].m_cbOut;
+	vecEncrypted[ 3*k_cbSlot ] ^= 0x01; // Ciphertext
+	vecEncrypted[ 16*k_cbSlot + arcbEncrypted[16] - 1 ] ^= 0x80; // Tag, in a big packet
+	vecEncrypted[ 0*k_cbSlot + arcbEncrypted[0] - k_nSymmetricGCMTagSize ] ^= 0x10; // Tag, zero length packet
+	for ( int i = 0 ; i < k_nPackets ; ++i )
+	{
+		AES_GCM_BatchPacket_t &pkt = pkts[i];
+		pkt.m_pIn = &vecEncrypted[ i*k_cbSlot ];
+		pkt.m_cbIn = arcbEncrypted[i];
+		pkt.m_pOut = &vecDecrypted[ i*k_cbSlot ];
+		pkt.m_cbOut = k_cbSlot;
+	}
+	CHECK( ctxDec.DecryptBatch( pkts, k_nPackets ) == k_nPackets-3 );
+	for ( int i = 0 ; i < k_nPackets ; ++i )
+	{
+		const AES_GCM_BatchPacket_t &pkt = pkts[i];
+		const uint8 *pPlaintext = &vecPlaintext[ i*k_cbSlot ];
+		if ( i == 0 || i == 3 || i == 16 )
+		{
+			CHECK( !pkt.m_bOK );
+			CHECK( pkt.m_cbOut == 0 );
+		}
+		else
+		{
+			CHECK( pkt.m_bOK );
+			CHECK( pkt.m_cbOut == arcbEncrypted[i] - k_nSymmetricGCMTagSize );
+			CHECK( memcmp( pkt.m_pOut, pPlaintext, pkt.m_cbOut ) == 0 );
+		}
+	}
+
+	// Decrypting in place works, too
+	for ( int i = 0 ; i < k_nPackets ; ++i )
+	{
+		AES_GCM_BatchPacket_t &pkt = pkts[i];
+		pkt.m_pOut = &vecEncrypted[ i*k_cbSlot ];
+		pkt.m_cbOut = k_cbSlot;
+	}
+	CHECK( ctxDec.DecryptBatch( pkts, k_nPackets ) == k_nPackets-3 );
+	CHECK( memcmp( &vecEncrypted[ 7*k_cbSlot ], &vecPlaintext[ 7*k_cbSlot ], pkts[7].m_cbOut ) == 0 );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Test ChaCha20-Poly1305 against the RFC 8439 test vector, and
+//          round trip a few different sizes
+//-----------------------------------------------------------------------------
+void TestChaCha20Poly1305()
+{
+	// RFC 8439, section 2.8.2
+	uint8 rgubKey[32];
+	for ( int i = 0 ; i < 32 ; ++i )
+		rgubKey[i] = uint8( 0x80 + i );
+	uint8 rgubIV[12], rgubAAD[12], rgubExpected[ 114 + 16 ];
+	V_hextobinary( "070000004041424344454647", 24, rgubIV, sizeof(rgubIV) );
+	V_hextobinary( "50515253c0c1c2c3c4c5c6c7", 24, rgubAAD, sizeof(rgubAAD) );
+	V_hextobinary(
+		"d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d6"
+		"3dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b36"
+		"92ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc"
+		"3ff4def08e4b7a9de576d26586cec64b6116"
+		"1ae10b594f09e26a7e902ecbd0600691",
+		2*sizeof(rgubExpected), rgubExpected, sizeof(rgubExpected) );
+	const char szPlaintext[] = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.";
+	const uint32 cbPlaintext = sizeof(szPlaintext) - 1;
+	CHECK( cbPlaintext == 114 );
+
+	ChaCha20Poly1305_EncryptContext ctxEnc;
+	ChaCha20Poly1305_DecryptContext ctxDec;
+	CHECK( ctxEnc.Init( rgubKey, sizeof(rgubKey), sizeof(rgubIV), 16 ) );
+	CHECK( ctxDec.Init( rgubKey, sizeof(rgubKey), sizeof(rgubIV), 16 ) );
+
+	uint8 rgubEncrypted[ 2000 ];
+	uint32 cbEncrypted = sizeof(rgubEncrypted);
+	CHECK( ctxEnc.Encrypt( szPlaintext, cbPlaintext, rgubIV, rgubEncrypted, &cbEncrypted, rgubAAD, sizeof(rgubAAD) ) );
+	CHECK( cbEncrypted == sizeof(rgubExpected) );
+	CHECK( memcmp( rgubEncrypted, rgubExpected, sizeof(rgubExpected) ) == 0 );
+
+	uint8 rgubDecrypted[ 2000 ];
+	uint32 cbDecrypted = sizeof(rgubDecrypted);
+	CHECK( ctxDec.Decrypt( rgubExpected, sizeof(rgubExpected), rgubIV, rgubDecrypted, &cbDecrypted, rgubAAD, sizeof(rgubAAD) ) );
+	CHECK( cbDecrypted == cbPlaintext );
+	CHECK( memcmp( rgubDecrypted, szPlaintext, cbPlaintext ) == 0 );
+
+	// Wrong AAD must fail
+	cbDecrypted = sizeof(rgubDecrypted);
+	CHECK( !ctxDec.Decrypt( rgubExpected, sizeof(rgubExpected), rgubIV, rgubDecrypted, &cbDecrypted, rgubAAD, sizeof(rgubAAD)-1 ) );
+
+	// Random data, various sizes, crossing the ChaCha20 block
+	// and Poly1305 block boundaries.  Flip a bit anywhere and it must fail.
+	uint8 rgubData[ 1500 ];
+	CCrypto::GenerateRandomBlock( rgubKey, sizeof(rgubKey) );
+	CCrypto::GenerateRandomBlock( rgubData, sizeof(rgubData) );
+	CHECK( ctxEnc.Init( rgubKey, sizeof(rgubKey), sizeof(rgubIV), 16 ) );
+	CHECK( ctxDec.Init( rgubKey, sizeof(rgubKey), sizeof(rgubIV), 16 ) );
+	for ( uint32 cbData : { 0, 1, 15, 16, 17, 63, 64, 65, 100, 129, 1200, 1500 } )
+	{
+		CCrypto::GenerateRandomBlock( rgubIV, sizeof(rgubIV) );
+		cbEncrypted = sizeof(rgubEncrypted);
+		CHECK( ctxEnc.Encrypt( rgubData, cbData, rgubIV, rgubEncrypted, &cbEncrypted, nullptr, 0 ) );
+		CHECK( cbEncrypted == cbData + 16 );
+
+		cbDecrypted = sizeof(rgubDecrypted);
+		CHECK( ctxDec.Decrypt( rgubEncrypted, cbEncrypted, rgubIV, rgubDecrypted, &cbDecrypted, nullptr, 0 ) );
+		CHECK( cbDecrypted == cbData );
+		CHECK( memcmp( rgubDecrypted, rgubData, cbData ) == 0 );
+
+		const uint32 iFlip = ( cbData * 7 + 3 ) % cbEncrypted;
+		rgubEncrypted[ iFlip ] ^= 0x04;
+		cbDecrypted = sizeof(rgubDecrypted);
+		CHECK( !ctxDec.Decrypt( rgubEncrypted, cbEncrypted, rgubIV, rgubDecrypted, &cbDecrypted, nullptr, 0 ) );
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Test elliptic-curve primitives (ed25519 signing, curve25519 key exchange)
 //-----------------------------------------------------------------------------
@@ -501,6 +693,57 @@ AAAECpUfg4C0BkgsCO+GlFAbcTQZUeFFQcamXzDA1tx7aNWre903qWUTRvLh3toW6vScFd
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Tests batch ed25519 signature verification
+//-----------------------------------------------------------------------------
+void TestEd25519BatchVerify()
+{
+	// Use a count that isn't a multiple of the internal batch size,
+	// so the leftovers are checked one at a time
+	const int k_nSignatures = 100;
+	const int k_cbData = 200;
+
+	std::vector<uint8> vecPublicKeys( k_nSignatures*32 );
+	std::vector<uint8> vecData( k_nSignatures*k_cbData );
+	std::vector<CryptoSignature_t> vecSignatures( k_nSignatures );
+	CCrypto::GenerateRandomBlock( vecData.data(), (int)vecData.size() );
+
+	const uint8 *ppPublicKey[ k_nSignatures ];
+	const void *ppData[ k_nSignatures ];
+	size_t cbData[ k_nSignatures ];
+	const uint8 *ppSignature[ k_nSignatures ];
+	bool bValid[ k_nSignatures ];
+	for ( int i = 0 ; i < k_nSignatures ; ++i )
+	{
+		CECSigningPublicKey pubKey;
+		CECSigningPrivateKey privKey;
+		CCrypto::GenerateSigningKeyPair( &pubKey, &privKey );
+		CHECK( pubKey.GetRawData( &vecPublicKeys[i*32] ) == 32 );
+
+		// Vary the message sizes a bit
+		ppData[i] = &vecData[i*k_cbData];
+		cbData[i] = k_cbData - ( i % 7 );
+		privKey.GenerateSignature( ppData[i], cbData[i], &vecSignatures[i] );
+
+		ppPublicKey[i] = &vecPublicKeys[i*32];
+		ppSignature[i] = vecSignatures[i];
+	}
+
+	// All good
+	CHECK( CCrypto::VerifySignatureBatch( k_nSignatures, ppPublicKey, ppData, cbData, ppSignature, bValid ) );
+	for ( int i = 0 ; i < k_nSignatures ; ++i )
+		CHECK( bValid[i] );
+
+	// Corrupt a signature, some data, and use the wrong key for one.  Make sure
+	// we find exactly the bad ones, both inside a full batch and in the leftovers
+	vecSignatures[5][10] ^= 1;
+	vecData[70*k_cbData] ^= 1;
+	ppPublicKey[98] = ppPublicKey[97];
+	CHECK( !CCrypto::VerifySignatureBatch( k_nSignatures, ppPublicKey, ppData, cbData, ppSignature, bValid ) );
+	for ( int i = 0 ; i < k_nSignatures ; ++i )
+		CHECK( bValid[i] == ( i != 5 && i != 70 && i != 98 ) );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Tests elliptic crypto perf
 //-----------------------------------------------------------------------------
@@ -580,11 +823,36 @@ void TestEllipticPerf()
 	double dMicrosecPerSignCheckBig = elapsed / k_cIterationsSignBig;
 	double dRateLargeMBPerSecCheck = double( k_cubPktBig ) * k_cIterationsSignBig / elapsed;
 
+	// small data verify, in batches
+	const int k_nBatch = 64;
+	const uint8 *ppPublicKey[ k_nBatch ];
+	const void *ppData[ k_nBatch ];
+	size_t cbData[ k_nBatch ];
+	const uint8 *ppSignature[ k_nBatch ];
+	bool bValid[ k_nBatch ];
+	uint8 rawSignPub[ 32 ];
+	CHECK( signPub.GetRawData( rawSignPub ) == 32 );
+	CCrypto::GenerateSignature( (uint8*)bufData.Base(), k_cubPktSmall, signPriv, &signature );
+	for ( int i = 0; i < k_nBatch; ++i )
+	{
+		ppPublicKey[i] = rawSignPub;
+		ppData[i] = bufData.Base();
+		cbData[i] = k_cubPktSmall;
+		ppSignature[i] = signature;
+	}
+	usecStart = Plat_USTime();
+	for ( int i = 0; i < k_cIterationsSignSmall; i += k_nBatch )
+	{
+		CHECK( CCrypto::VerifySignatureBatch( k_nBatch, ppPublicKey, ppData, cbData, ppSignature, bValid ) );
+	}
+	double dMicrosecPerSignCheckSmallBatch = double( Plat_USTime() - usecStart ) / ( ( k_cIterationsSignSmall + k_nBatch - 1 ) / k_nBatch * k_nBatch );
+
 	printf( "\tEphemeral curve25519 key exchange:\t\t\t%f microseconds each (%d iterations)\n", dMicrosecPerECDH, k_cIterationsSignSmall );
 	printf( "\tCalculate ed25519 signature (small):\t\t\t%f microseconds each (%d iterations)\n", dMicrosecPerSignSmall, k_cIterationsSignSmall );
 	printf( "\tCalculate ed25519 signature (big):\t\t\t%f microseconds each (%d iterations)\n", dMicrosecPerSignBig, k_cIterationsSignBig );
 	printf( "\tCalculate ed25519 signature (big):\t\t\t%f MB/sec (%d iterations)\n", dRateLargeMBPerSec, k_cIterationsSignBig );
 	printf( "\tVerify ed25519 signature (small):\t\t\t%f microseconds each (%d iterations)\n", dMicrosecPerSignCheckSmall, k_cIterationsSignSmall );
+	printf( "\tVerify ed25519 signature (small, batch of %d):\t%f microseconds each (%d iterations)\n", k_nBatch, dMicrosecPerSignCheckSmallBatch, k_cIterationsSignSmall );
 	printf( "\tVerify ed25519 signature (big):\t\t\t%f microseconds each (%d iterations)\n", dMicrosecPerSignCheckBig, k_cIterationsSignBig );
 	printf( "\tVerify ed25519 signature (big):\t\t\t%f MB/sec (%d iterations)\n", dRateLargeMBPerSecCheck, k_cIterationsSignBig );
 }
@@ -592,7 +860,8 @@ void TestEllipticPerf()
 //-----------------------------------------------------------------------------
 // Purpose: Performs specified # of symmetric encryptions
 //-----------------------------------------------------------------------------
-void SymmetricAuthEncryptRepeatedly( int cIterations, AES_GCM_EncryptContext &ctxEnc, uint8 *pubData, int cubToEncrypt, uint8 *pubIV )
+template <typename TEncryptContext>
+void SymmetricAuthEncryptRepeatedly( int cIterations, TEncryptContext &ctxEnc, uint8 *pubData, int cubToEncrypt, uint8 *pubIV )
 {
 	int nBufSize = cubToEncrypt + 32;				// 16 = AES block size.. worst case for padded data
 	uint8 *pEncrypted = new uint8[ nBufSize ];
@@ -615,7 +884,8 @@ void SymmetricAuthEncryptRepeatedly( int cIterations, AES_GCM_EncryptContext &ct
 //-----------------------------------------------------------------------------
 // Purpose: Performs specified # of symmetric descryptions
 //-----------------------------------------------------------------------------
-void SymmetricAuthDecryptRepeatedly( int cIterations, AES_GCM_DecryptContext &ctxDec, uint8 *pubEncrypted, int cubEncrypted, uint8 *pubIV )
+template <typename TDecryptContext>
+void SymmetricAuthDecryptRepeatedly( int cIterations, TDecryptContext &ctxDec, uint8 *pubEncrypted, int cubEncrypted, uint8 *pubIV )
 {
 	int nBufSize = cubEncrypted + 32;				// 16 = AES block size.. worst case for padded data
 	uint8 *pDecrypted = new uint8[ nBufSize ];
@@ -714,12 +984,89 @@ void TestSymmetricAuthCryptoPerf()
 	int cMicroSecPerDecryptBig = Plat_USTime() - usecStart;
 	double dRateLargeDecrypt = double( k_cubPktBig ) * k_cIterations / cMicroSecPerDecryptBig;
 
+	// Small packets, in batches, each with its own IV, the way
+	// they come off of the wire.
+	const int k_nBatchSize = 32;
+	uint8 rgubBatchIV[ k_nBatchSize ][ k_nSymmetricIVSize ];
+	uint8 rgubBatchEncrypted[ k_nBatchSize ][ k_cubPktSmall + k_nSymmetricGCMTagSize ];
+	uint8 rgubBatchDecrypted[ k_nBatchSize ][ k_cubPktSmall ];
+	CCrypto::GenerateRandomBlock( rgubBatchIV, sizeof( rgubBatchIV ) );
+	AES_GCM_BatchPacket_t batch[ k_nBatchSize ];
+	usecStart = Plat_USTime();
+	for ( int iIteration = 0; iIteration < k_cIterations; iIteration += k_nBatchSize )
+	{
+		for ( int i = 0 ; i < k_nBatchSize ; ++i )
+		{
+			batch[i].m_pIn = rgubData + i;
+			batch[i].m_cbIn = k_cubPktSmall;
+			batch[i].m_pIV = rgubBatchIV[i];
+			batch[i].m_pAAD = nullptr;
+			batch[i].m_cbAAD = 0;
+			batch[i].m_pOut = rgubBatchEncrypted[i];
+			batch[i].m_cbOut = sizeof( rgubBatchEncrypted[i] );
+		}
+		CHECK( ctxEnc.EncryptBatch( batch, k_nBatchSize ) == k_nBatchSize );
+	}
+	int cMicroSecPerEncryptSmallBatch = Plat_USTime() - usecStart;
+
+	usecStart = Plat_USTime();
+	for ( int iIteration = 0; iIteration < k_cIterations; iIteration += k_nBatchSize )
+	{
+		for ( int i = 0 ; i < k_nBatchSize ; ++i )
+		{
+			batch[i].m_pIn = rgubBatchEncrypted[i];
+			batch[i].m_cbIn = sizeof( rgubBatchEncrypted[i] );
+			batch[i].m_pOut = rgubBatchDecrypted[i];
+			batch[i].m_cbOut = sizeof( rgubBatchDecrypted[i] );
+		}
+		CHECK( ctxDec.DecryptBatch( batch, k_nBatchSize ) == k_nBatchSize );
+	}
+	int cMicroSecPerDecryptSmallBatch = Plat_USTime() - usecStart;
+
+	// Number of packets we actually did in batches
+	const int cPktsBatch = ( k_cIterations + k_nBatchSize - 1 ) / k_nBatchSize * k_nBatchSize;
+
+	// Same thing with ChaCha20-Poly1305
+	ChaCha20Poly1305_EncryptContext ctxEncChaCha;
+	ChaCha20Poly1305_DecryptContext ctxDecChaCha;
+	CHECK( ctxEncChaCha.Init( rgubKey, k_nSymmetricKeyLen, V_ARRAYSIZE(rgubIV), k_nSymmetricGCMTagSize ) );
+	CHECK( ctxDecChaCha.Init( rgubKey, k_nSymmetricKeyLen, V_ARRAYSIZE(rgubIV), k_nSymmetricGCMTagSize ) );
+
+	usecStart = Plat_USTime();
+	SymmetricAuthEncryptRepeatedly( k_cIterations, ctxEncChaCha, rgubData, k_cubPktSmall, rgubIV );
+	int cMicroSecPerEncryptSmallChaCha = Plat_USTime() - usecStart;
+
+	usecStart = Plat_USTime();
+	SymmetricAuthEncryptRepeatedly( k_cIterations, ctxEncChaCha, rgubData, k_cubPktBig, rgubIV );
+	int cMicroSecPerEncryptBigChaCha = Plat_USTime() - usecStart;
+
+	cubEncrypted = V_ARRAYSIZE( rgubEncrypted );
+	CHECK( ctxEncChaCha.Encrypt( rgubData, k_cubPktSmall, rgubIV, rgubEncrypted, &cubEncrypted, nullptr, 0 ) );
+	usecStart = Plat_USTime();
+	SymmetricAuthDecryptRepeatedly( k_cIterations, ctxDecChaCha, rgubEncrypted, cubEncrypted, rgubIV );
+	int cMicroSecPerDecryptSmallChaCha = Plat_USTime() - usecStart;
+
+	cubEncrypted = V_ARRAYSIZE( rgubEncrypted );
+	CHECK( ctxEncChaCha.Encrypt( rgubData, k_cubPktBig, rgubIV, rgubEncrypted, &cubEncrypted, nullptr, 0 ) );
+	usecStart = Plat_USTime();
+	SymmetricAuthDecryptRepeatedly( k_cIterations, ctxDecChaCha, rgubEncrypted, cubEncrypted, rgubIV );
+	int cMicroSecPerDecryptBigChaCha = Plat_USTime() - usecStart;
+
+	printf( "\tHardware AES:\t\t\t\t%s\n", CCrypto::BHasHardwareAES() ? "yes" : "no" );
 	printf( "\tSymmetric GCM encrypt (small):\t\t%d microsec (%d iterations)\n", cMicroSecPerEncryptSmall, k_cIterations );
+	printf( "\tSymmetric GCM encrypt (small):\t\t%.0f pkts/sec\n", k_cIterations * 1e6 / cMicroSecPerEncryptSmall );
+	printf( "\tSymmetric GCM encrypt (small, batch):\t%.0f pkts/sec (batches of %d)\n", cPktsBatch * 1e6 / cMicroSecPerEncryptSmallBatch, k_nBatchSize );
 	printf( "\tSymmetric GCM encrypt (big):\t\t%d microsec (%d iterations)\n", cMicroSecPerEncryptBig, k_cIterations );
 	printf( "\tSymmetric GCM encrypt (big):\t\t%f MB/sec (%d iterations)\n", dRateLargeEncrypt, k_cIterations );
 	printf( "\tSymmetric GCM decrypt (small):\t\t%d microsec (%d iterations)\n", cMicroSecPerDecryptSmall, k_cIterations );
+	printf( "\tSymmetric GCM decrypt (small):\t\t%.0f pkts/sec\n", k_cIterations * 1e6 / cMicroSecPerDecryptSmall );
+	printf( "\tSymmetric GCM decrypt (small, batch):\t%.0f pkts/sec (batches of %d)\n", cPktsBatch * 1e6 / cMicroSecPerDecryptSmallBatch, k_nBatchSize );
 	printf( "\tSymmetric GCM decrypt (big):\t\t%d microsec (%d iterations)\n", cMicroSecPerDecryptBig, k_cIterations );
 	printf( "\tSymmetric GCM decrypt (big):\t\t%f MB/sec (%d iterations)\n", dRateLargeDecrypt, k_cIterations );
+	printf( "\tChaCha20-Poly1305 encrypt (small):\t%.0f pkts/sec\n", k_cIterations * 1e6 / cMicroSecPerEncryptSmallChaCha );
+	printf( "\tChaCha20-Poly1305 encrypt (big):\t%f MB/sec\n", double( k_cubPktBig ) * k_cIterations / cMicroSecPerEncryptBigChaCha );
+	printf( "\tChaCha20-Poly1305 decrypt (small):\t%.0f pkts/sec\n", k_cIterations * 1e6 / cMicroSecPerDecryptSmallChaCha );
+	printf( "\tChaCha20-Poly1305 decrypt (big):\t%f MB/sec\n", double( k_cubPktBig ) * k_cIterations / cMicroSecPerDecryptBigChaCha );
 }
 
 bool chdir_to_bindir()
@@ -751,8 +1098,11 @@ int main()
 
 	TestCryptoEncoding();
 	TestSymmetricAuthCryptoVectors();
+	TestSymmetricAuthCryptoBatch();
+	TestChaCha20Poly1305();
 	TestEllipticCrypto();
 	TestOpenSSHEd25519();
+	TestEd25519BatchVerify();
 	TestEllipticPerf();
 	TestSymmetricAuthCryptoPerf();
 
@@ -0,0 +1,2551 @@
+// Microbenchmarks for low level pieces of the library.  These poke directly
+// at internal interfaces, so this test links against the static library.
+//
+// Usage: test_perf [benchmark ...]
+// With no arguments, all benchmarks are run.
+
+// The internal headers must come before test_common.h, which forces _DEBUG.
+// They key things such as STEAMNETWORKINGSOCKETS_SNP_PARANOIA off of that, and
+// if we don't see the same class layouts as the library, we will scribble on it.
+#include <gns/gamenetworkingsockets.h>
+#include <gns/igamenetworkingutils.h>
+#include "../src/gamenetworkingsockets/clientlib/gamenetworkingsockets_lowlevel.h"
+#include "../src/gamenetworkingsockets/clientlib/gamenetworkingsockets_connections.h"
+#include "../src/gamenetworkingsockets/gamenetworkingsockets_platform.h"
+#include "../src/gamenetworkingsockets/gamenetworkingsockets_thinker.h"
+#include <gamenetworkingsockets_messages_udp.pb.h>
+
+#include "test_common.h"
+
+using namespace GameNetworkingSocketsLib;
+
+extern "C" void GameNetworkingSockets_SetManualPollMode( bool bFlag );
+extern "C" void GameNetworkingSockets_Poll( int msMaxWaitTime );
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Raw UDP receive
+//
+/////////////////////////////////////////////////////////////////////////////
+
+static int s_nRawPacketsReceived;
+
+static void RawRecvCallback( const RecvPktInfo_t &info, void *pContext )
+{
+	++s_nRawPacketsReceived;
+}
+
+static void BenchmarkRawUDPRecvPath( const char *pszName, int nBatchSize, IRawUDPSocket *pRawSock, SOCKET sockSend )
+{
+	const int k_nBursts = 2000;
+	const int k_nPacketsPerBurst = 128; // Keep this under what fits in the OS recv buffer
+	const int k_cbPkt = 100;
+
+	g_nSteamDatagramRecvBatchSize = nBatchSize;
+
+	sockaddr_in adrTo;
+	memset( &adrTo, 0, sizeof(adrTo) );
+	adrTo.sin_family = AF_INET;
+	adrTo.sin_addr.s_addr = htonl( 0x7f000001 );
+	adrTo.sin_port = htons( pRawSock->m_boundAddr.m_port );
+
+	char pkt[ k_cbPkt ];
+	memset( pkt, 0x5a, sizeof(pkt) );
+
+	s_nRawPacketsReceived = 0;
+	int nPacketsSent = 0;
+	GameNetworkingMicroseconds usecInPoll = 0;
+	for ( int iBurst = 0 ; iBurst < k_nBursts ; ++iBurst )
+	{
+		for ( int i = 0 ; i < k_nPacketsPerBurst ; ++i )
+		{
+			if ( sendto( sockSend, pkt, sizeof(pkt), 0, (const sockaddr *)&adrTo, sizeof(adrTo) ) == sizeof(pkt) )
+				++nPacketsSent;
+		}
+
+		// Only time the receive side
+		GameNetworkingMicroseconds usecStart = GameNetworkingSockets_GetLocalTimestamp();
+		GameNetworkingSockets_Poll( 0 );
+		usecInPoll += GameNetworkingSockets_GetLocalTimestamp() - usecStart;
+	}
+
+	TEST_Printf( "\t%-20s %8d sent %8d recv %10.0f pkts/sec\n",
+		pszName, nPacketsSent, s_nRawPacketsReceived,
+		s_nRawPacketsReceived * 1e6 / std::max( usecInPoll, (GameNetworkingMicroseconds)1 ) );
+}
+
+static void BenchmarkRawUDPRecv()
+{
+	TEST_Printf( "Raw UDP receive, loopback:\n" );
+
+	GameNetworkingSockets_SetManualPollMode( true );
+
+	SteamDatagramErrMsg errMsg;
+	IRawUDPSocket *pRawSock = nullptr;
+	{
+		GameNetworkingGlobalLock lock( "BenchmarkRawUDPRecv" );
+		if ( !BGameNetworkingSocketsLowLevelAddRef( errMsg ) )
+			TEST_Fatal( "BGameNetworkingSocketsLowLevelAddRef failed.  %s", errMsg );
+
+		g_nSteamDatagramSocketBufferSize = 4*1024*1024;
+		GameNetworkingIPAddr addrLocal;
+		addrLocal.SetIPv4( 0x7f000001, 0 );
+		pRawSock = OpenRawUDPSocket( CRecvPacketCallback( RawRecvCallback, (void *)nullptr ), errMsg, &addrLocal, nullptr );
+		if ( !pRawSock )
+			TEST_Fatal( "OpenRawUDPSocket failed.  %s", errMsg );
+	}
+
+	SOCKET sockSend = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+	if ( sockSend == INVALID_SOCKET )
+		TEST_Fatal( "socket() failed" );
+
+	BenchmarkRawUDPRecvPath( "recvfrom", 1, pRawSock, sockSend );
+	BenchmarkRawUDPRecvPath( "recvmmsg x8", 8, pRawSock, sockSend );
+	BenchmarkRawUDPRecvPath( "recvmmsg x32", k_nSteamDatagramMaxRecvBatchSize, pRawSock, sockSend );
+
+	closesocket( sockSend );
+	{
+		GameNetworkingGlobalLock lock( "BenchmarkRawUDPRecv" );
+		pRawSock->Close();
+		GameNetworkingSocketsLowLevelDecRef();
+	}
+	g_nSteamDatagramRecvBatchSize = k_nSteamDatagramMaxRecvBatchSize;
+	GameNetworkingSockets_SetManualPollMode( false );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Raw UDP send
+//
+/////////////////////////////////////////////////////////////////////////////
+
+/// Simulates a bunch of connections that each want to send a few
+/// packets every time the service thread runs
+class CRawUDPSendThinker : public IThinker
+{
+public:
+	IRawUDPSocket *m_pRawSock = nullptr;
+	netadr_t m_adrTo;
+	int m_nPacketsPerThink = 0;
+	int m_cbPkt = 200;
+	int m_nPacketsSent = 0;
+
+	virtual void Think( GameNetworkingMicroseconds usecNow ) override
+	{
+		char pkt[ k_cbGameNetworkingSocketsMaxUDPMsgLen ];
+		memset( pkt, 0x5a, m_cbPkt );
+		for ( int i = 0 ; i < m_nPacketsPerThink ; ++i )
+		{
+			if ( m_pRawSock->BSendRawPacket( pkt, m_cbPkt, m_adrTo ) )
+				++m_nPacketsSent;
+		}
+	}
+};
+
+static void BenchmarkRawUDPSendPath( const char *pszName, int nBatchSize, IRawUDPSocket *pRawSock, const netadr_t &adrTo, int cbPkt = 200 )
+{
+	const int k_nPasses = 2000;
+	const int k_nThinkers = 50;
+	const int k_nPacketsPerThink = 4;
+
+	g_nSteamDatagramSendBatchSize = nBatchSize;
+
+	CRawUDPSendThinker arThinkers[ k_nThinkers ];
+	for ( CRawUDPSendThinker &t: arThinkers )
+	{
+		t.m_pRawSock = pRawSock;
+		t.m_adrTo = adrTo;
+		t.m_nPacketsPerThink = k_nPacketsPerThink;
+		t.m_cbPkt = cbPkt;
+	}
+
+	int nPacketsSent = 0;
+	GameNetworkingMicroseconds usecInPoll = 0;
+	for ( int iPass = 0 ; iPass < k_nPasses ; ++iPass )
+	{
+		{
+			GameNetworkingGlobalLock lock( "BenchmarkRawUDPSend" );
+			for ( CRawUDPSendThinker &t: arThinkers )
+				t.SetNextThinkTimeASAP();
+		}
+
+		GameNetworkingMicroseconds usecStart = GameNetworkingSockets_GetLocalTimestamp();
+		GameNetworkingSockets_Poll( 0 );
+		usecInPoll += GameNetworkingSockets_GetLocalTimestamp() - usecStart;
+	}
+
+	{
+		GameNetworkingGlobalLock lock( "BenchmarkRawUDPSend" );
+		for ( CRawUDPSendThinker &t: arThinkers )
+		{
+			nPacketsSent += t.m_nPacketsSent;
+			t.ClearNextThinkTime();
+		}
+	}
+
+	TEST_Printf( "\t%-20s %8d sent %10.0f pkts/sec\n",
+		pszName, nPacketsSent,
+		nPacketsSent * 1e6 / std::max( usecInPoll, (GameNetworkingMicroseconds)1 ) );
+}
+
+static void BenchmarkRawUDPSend()
+{
+	TEST_Printf( "Raw UDP send, loopback:\n" );
+
+	GameNetworkingSockets_SetManualPollMode( true );
+
+	SteamDatagramErrMsg errMsg;
+	IRawUDPSocket *pRawSock = nullptr;
+	{
+		GameNetworkingGlobalLock lock( "BenchmarkRawUDPSend" );
+		if ( !BGameNetworkingSocketsLowLevelAddRef( errMsg ) )
+			TEST_Fatal( "BGameNetworkingSocketsLowLevelAddRef failed.  %s", errMsg );
+
+		GameNetworkingIPAddr addrLocal;
+		addrLocal.SetIPv4( 0x7f000001, 0 );
+		pRawSock = OpenRawUDPSocket( CRecvPacketCallback( RawRecvCallback, (void *)nullptr ), errMsg, &addrLocal, nullptr );
+		if ( !pRawSock )
+			TEST_Fatal( "OpenRawUDPSocket failed.  %s", errMsg );
+	}
+
+	// Send to a socket that we never read from.  Once its buffer
+	// fills up, the OS will just discard the datagrams.
+	SOCKET sockSink = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+	sockaddr_in adrSink;
+	memset( &adrSink, 0, sizeof(adrSink) );
+	adrSink.sin_family = AF_INET;
+	adrSink.sin_addr.s_addr = htonl( 0x7f000001 );
+	socklen_t cbAdrSink = sizeof(adrSink);
+	if ( sockSink == INVALID_SOCKET
+		|| bind( sockSink, (const sockaddr *)&adrSink, sizeof(adrSink) ) != 0
+		|| getsockname( sockSink, (sockaddr *)&adrSink, &cbAdrSink ) != 0 )
+		TEST_Fatal( "Failed to create sink socket" );
+	netadr_t adrTo( 0x7f000001, ntohs( adrSink.sin_port ) );
+
+	BenchmarkRawUDPSendPath( "sendmsg", 1, pRawSock, adrTo );
+	BenchmarkRawUDPSendPath( "sendmmsg", k_nSteamDatagramMaxSendBatchSize, pRawSock, adrTo );
+
+	closesocket( sockSink );
+	{
+		GameNetworkingGlobalLock lock( "BenchmarkRawUDPSend" );
+		pRawSock->Close();
+		GameNetworkingSocketsLowLevelDecRef();
+	}
+	g_nSteamDatagramSendBatchSize = k_nSteamDatagramMaxSendBatchSize;
+	GameNetworkingSockets_SetManualPollMode( false );
+}
+
+static int s_cbExpectedRawPacket;
+static int s_nRawPacketsWrongSize;
+
+static void RawRecvCheckSizeCallback( const RecvPktInfo_t &info, void *pContext )
+{
+	++s_nRawPacketsReceived;
+	if ( info.m_cbPkt != s_cbExpectedRawPacket )
+		++s_nRawPacketsWrongSize;
+}
+
+static void BenchmarkRawUDPSegmentationOffloadPath( const char *pszName, int bEnable )
+{
+	const int k_cbPkt = 1200;
+
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_UDP_SegmentationOffload, bEnable );
+
+	// Open sockets after setting the config, since GRO is enabled at open time
+	SteamDatagramErrMsg errMsg;
+	IRawUDPSocket *pSockSend = nullptr;
+	IRawUDPSocket *pSockRecv = nullptr;
+	{
+		GameNetworkingGlobalLock lock( "BenchmarkRawUDPSegmentationOffload" );
+		GameNetworkingIPAddr addrLocal;
+		addrLocal.SetIPv4( 0x7f000001, 0 );
+		pSockSend = OpenRawUDPSocket( CRecvPacketCallback( RawRecvCallback, (void *)nullptr ), errMsg, &addrLocal, nullptr );
+		pSockRecv = OpenRawUDPSocket( CRecvPacketCallback( RawRecvCheckSizeCallback, (void *)nullptr ), errMsg, &addrLocal, nullptr );
+		if ( !pSockSend || !pSockRecv )
+			TEST_Fatal( "OpenRawUDPSocket failed.  %s", errMsg );
+	}
+
+	s_cbExpectedRawPacket = k_cbPkt;
+	s_nRawPacketsWrongSize = 0;
+	s_nRawPacketsReceived = 0;
+	BenchmarkRawUDPSendPath( pszName, k_nSteamDatagramMaxSendBatchSize, pSockSend, netadr_t( 0x7f000001, pSockRecv->m_boundAddr.m_port ), k_cbPkt );
+
+	// Drain anything still in flight
+	for ( int i = 0 ; i < 10 ; ++i )
+		GameNetworkingSockets_Poll( 1 );
+	TEST_Printf( "\t%-20s %8d recv\n", "", s_nRawPacketsReceived );
+	if ( s_nRawPacketsWrongSize )
+		TEST_Fatal( "%d packets received with the wrong size", s_nRawPacketsWrongSize );
+
+	{
+		GameNetworkingGlobalLock lock( "BenchmarkRawUDPSegmentationOffload" );
+		pSockSend->Close();
+		pSockRecv->Close();
+	}
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_UDP_SegmentationOffload, 0 );
+}
+
+static void BenchmarkRawUDPSegmentationOffload()
+{
+	TEST_Printf( "Raw UDP segmentation offload, loopback, %d byte packets:\n", 1200 );
+
+	GameNetworkingSockets_SetManualPollMode( true );
+	SteamDatagramErrMsg errMsg;
+	{
+		GameNetworkingGlobalLock lock( "BenchmarkRawUDPSegmentationOffload" );
+		if ( !BGameNetworkingSocketsLowLevelAddRef( errMsg ) )
+			TEST_Fatal( "BGameNetworkingSocketsLowLevelAddRef failed.  %s", errMsg );
+	}
+
+	BenchmarkRawUDPSegmentationOffloadPath( "sendmmsg", 0 );
+	BenchmarkRawUDPSegmentationOffloadPath( "sendmmsg+GSO/GRO", 1 );
+
+	{
+		GameNetworkingGlobalLock lock( "BenchmarkRawUDPSegmentationOffload" );
+		GameNetworkingSocketsLowLevelDecRef();
+	}
+	GameNetworkingSockets_SetManualPollMode( false );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Receive worker threads
+//
+// The senders run in a child process, so that they don't compete with the
+// receiving side for the global lock.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifdef POSIX
+#include <sys/wait.h>
+
+static const int k_nRecvWorkersConnections = 8;
+static const int k_cbRecvWorkersMsg = 1000;
+static const GameNetworkingMicroseconds k_usecRecvWorkersSendTime = 3*1000*1000;
+
+static HSteamListenSocket s_hRecvWorkersListenSocket;
+static HGameNetPollGroup s_hRecvWorkersPollGroup;
+static int s_nRecvWorkersConnected;
+
+static void RecvWorkersConnectionStatusChanged( GameNetConnectionStatusChangedCallback_t *pInfo )
+{
+	switch ( pInfo->m_info.m_eState )
+	{
+		case k_EGameNetworkingConnectionState_Connecting:
+			if ( pInfo->m_info.m_hListenSocket == s_hRecvWorkersListenSocket )
+			{
+				GameNetworkingSockets()->AcceptConnection( pInfo->m_hConn );
+				GameNetworkingSockets()->SetConnectionPollGroup( pInfo->m_hConn, s_hRecvWorkersPollGroup );
+			}
+			break;
+
+		case k_EGameNetworkingConnectionState_Connected:
+			++s_nRecvWorkersConnected;
+			break;
+
+		case k_EGameNetworkingConnectionState_ClosedByPeer:
+		case k_EGameNetworkingConnectionState_ProblemDetectedLocally:
+			GameNetworkingSockets()->CloseConnection( pInfo->m_hConn, 0, nullptr, false );
+			break;
+
+		default:
+			break;
+	}
+}
+
+static void RecvWorkersInit()
+{
+	GameNetworkingErrMsg errMsg;
+	if ( !GameNetworkingSockets_Init( nullptr, errMsg ) )
+		TEST_Fatal( "GameNetworkingSockets_Init failed.  %s", errMsg );
+}
+
+/// Child process.  Connect to the server and blast away with unreliable
+/// messages, as fast as we can.
+static void RecvWorkersSenderProcess( uint16 nPort )
+{
+	s_hRecvWorkersListenSocket = k_HSteamListenSocket_Invalid;
+	s_nRecvWorkersConnected = 0;
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_RecvWorkerThreads, 0 );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMin, 64*1024*1024 );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMax, 64*1024*1024 );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendBufferSize, 4*1024*1024 );
+	GameNetworkingUtils()->SetGlobalCallback_GameNetConnectionStatusChanged( RecvWorkersConnectionStatusChanged );
+	RecvWorkersInit();
+
+	GameNetworkingIPAddr addrServer;
+	addrServer.SetIPv4( 0x7f000001, nPort );
+	HGameNetConnection arConn[ k_nRecvWorkersConnections ];
+	for ( HGameNetConnection &hConn: arConn )
+		hConn = GameNetworkingSockets()->ConnectByIPAddress( addrServer, 0, nullptr );
+	while ( s_nRecvWorkersConnected < k_nRecvWorkersConnections )
+		TEST_PumpCallbacks();
+
+	char msg[ k_cbRecvWorkersMsg ];
+	memset( msg, 0x5a, sizeof(msg) );
+	GameNetworkingMicroseconds usecEnd = GameNetworkingSockets_GetLocalTimestamp() + k_usecRecvWorkersSendTime;
+	while ( GameNetworkingSockets_GetLocalTimestamp() < usecEnd )
+	{
+		bool bFull = false;
+		for ( HGameNetConnection hConn: arConn )
+		{
+			if ( GameNetworkingSockets()->SendMessageToConnection( hConn, msg, sizeof(msg), k_nGameNetworkingSend_UnreliableNoNagle, nullptr ) != k_EResultOK )
+				bFull = true;
+		}
+		if ( bFull )
+			std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+	}
+
+	for ( HGameNetConnection hConn: arConn )
+		GameNetworkingSockets()->CloseConnection( hConn, 0, nullptr, true );
+	GameNetworkingSockets_Kill();
+}
+
+static void BenchmarkRecvWorkersPass( int nWorkers )
+{
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_RecvWorkerThreads, nWorkers );
+
+	// Fork the sender before we initialize anything
+	int fdPipe[2];
+	if ( pipe( fdPipe ) != 0 )
+		TEST_Fatal( "pipe() failed" );
+	pid_t pid = fork();
+	if ( pid < 0 )
+		TEST_Fatal( "fork() failed" );
+	if ( pid == 0 )
+	{
+		close( fdPipe[1] );
+		uint16 nPort = 0;
+		if ( read( fdPipe[0], &nPort, sizeof(nPort) ) != sizeof(nPort) )
+			_exit( 1 );
+		RecvWorkersSenderProcess( nPort );
+		_exit( 0 );
+	}
+	close( fdPipe[0] );
+
+	s_nRecvWorkersConnected = 0;
+	GameNetworkingUtils()->SetGlobalCallback_GameNetConnectionStatusChanged( RecvWorkersConnectionStatusChanged );
+	RecvWorkersInit();
+
+	GameNetworkingIPAddr addrLocal;
+	addrLocal.SetIPv4( 0x7f000001, uint16( 27300 + nWorkers ) );
+	s_hRecvWorkersPollGroup = GameNetworkingSockets()->CreatePollGroup();
+	s_hRecvWorkersListenSocket = GameNetworkingSockets()->CreateListenSocketIP( addrLocal, 0, nullptr );
+	if ( !GameNetworkingSockets()->GetListenSocketAddress( s_hRecvWorkersListenSocket, &addrLocal ) )
+		TEST_Fatal( "GetListenSocketAddress failed" );
+	if ( write( fdPipe[1], &addrLocal.m_port, sizeof(addrLocal.m_port) ) != sizeof(addrLocal.m_port) )
+		TEST_Fatal( "write() failed" );
+	close( fdPipe[1] );
+
+	// Receive until the sender exits.  Only count the time after
+	// the first message arrives.
+	int64 nMsgs = 0;
+	GameNetworkingMicroseconds usecFirst = 0, usecLast = 0;
+	for (;;)
+	{
+		GameNetworkingSockets()->RunCallbacks();
+
+		GameNetworkingMessage_t *arMsgs[ 256 ];
+		int n = GameNetworkingSockets()->ReceiveMessagesOnPollGroup( s_hRecvWorkersPollGroup, arMsgs, V_ARRAYSIZE( arMsgs ) );
+		if ( n > 0 )
+		{
+			usecLast = GameNetworkingSockets_GetLocalTimestamp();
+			if ( nMsgs == 0 )
+				usecFirst = usecLast;
+			nMsgs += n;
+			for ( int i = 0 ; i < n ; ++i )
+				arMsgs[i]->Release();
+			continue;
+		}
+
+		int status;
+		if ( waitpid( pid, &status, WNOHANG ) == pid )
+		{
+			if ( !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 )
+				TEST_Fatal( "Sender process failed" );
+			break;
+		}
+		std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+	}
+
+	GameNetworkingSockets()->CloseListenSocket( s_hRecvWorkersListenSocket );
+	GameNetworkingSockets()->DestroyPollGroup( s_hRecvWorkersPollGroup );
+	GameNetworkingSockets_Kill();
+
+	char szName[ 32 ];
+	V_sprintf_safe( szName, "%d workers", nWorkers );
+	TEST_Printf( "\t%-20s %8lld recv %10.0f msgs/sec\n",
+		szName, (long long)nMsgs, nMsgs * 1e6 / std::max( usecLast - usecFirst, (GameNetworkingMicroseconds)1 ) );
+}
+
+static void BenchmarkRecvWorkers()
+{
+	TEST_Printf( "Receive worker threads, loopback, %d connections, %d byte unreliable messages:\n", k_nRecvWorkersConnections, k_cbRecvWorkersMsg );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_IP_AllowWithoutAuth, 2 );
+	for ( int nWorkers: { 0, 1, 2, 4, 8 } )
+		BenchmarkRecvWorkersPass( nWorkers );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_RecvWorkerThreads, 0 );
+	GameNetworkingUtils()->SetGlobalCallback_GameNetConnectionStatusChanged( nullptr );
+}
+#else
+static void BenchmarkRecvWorkers()
+{
+	TEST_Printf( "Receive worker threads not supported on this platform\n" );
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Connect storm.  Lots of clients (in a child process) all try to connect
+// at once, like after a server restart.  Measures how fast the server gets
+// through the handshakes, with and without batched signature verification.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifdef POSIX
+
+static const int k_nConnectStormClients = 1000;
+
+static HSteamListenSocket s_hConnectStormListenSocket;
+static int s_nConnectStormAccepted;
+static int s_nConnectStormConnected;
+static int s_nConnectStormFailed;
+static bool s_bConnectStormCloseWhenConnected;
+static GameNetworkingMicroseconds s_usecConnectStormFirstAccept;
+static GameNetworkingMicroseconds s_usecConnectStormLastAccept;
+
+static double GetProcessCPUSeconds()
+{
+	timespec ts;
+	clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &ts );
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void ConnectStormConnectionStatusChanged( GameNetConnectionStatusChangedCallback_t *pInfo )
+{
+	switch ( pInfo->m_info.m_eState )
+	{
+		case k_EGameNetworkingConnectionState_Connecting:
+			if ( pInfo->m_info.m_hListenSocket == s_hConnectStormListenSocket )
+			{
+				if ( GameNetworkingSockets()->AcceptConnection( pInfo->m_hConn ) != k_EResultOK )
+					break;
+				s_usecConnectStormLastAccept = GameNetworkingSockets_GetLocalTimestamp();
+				if ( s_nConnectStormAccepted++ == 0 )
+					s_usecConnectStormFirstAccept = s_usecConnectStormLastAccept;
+			}
+			break;
+
+		case k_EGameNetworkingConnectionState_Connected:
+			if ( pInfo->m_info.m_hListenSocket == k_HSteamListenSocket_Invalid )
+			{
+				++s_nConnectStormConnected;
+				if ( s_bConnectStormCloseWhenConnected )
+					GameNetworkingSockets()->CloseConnection( pInfo->m_hConn, 0, nullptr, false );
+			}
+			break;
+
+		case k_EGameNetworkingConnectionState_ClosedByPeer:
+		case k_EGameNetworkingConnectionState_ProblemDetectedLocally:
+			if ( pInfo->m_info.m_hListenSocket == k_HSteamListenSocket_Invalid )
+				++s_nConnectStormFailed;
+			GameNetworkingSockets()->CloseConnection( pInfo->m_hConn, 0, nullptr, false );
+			break;
+
+		default:
+			break;
+	}
+}
+
+/// Child process.  Start all the connections at once, and wait for them to complete.
+static void ConnectStormClientProcess( uint16 nPort )
+{
+	s_hConnectStormListenSocket = k_HSteamListenSocket_Invalid;
+	s_nConnectStormConnected = 0;
+	RecvWorkersInit();
+
+	GameNetworkingIPAddr addrServer;
+	addrServer.SetIPv4( 0x7f000001, nPort );
+	std::vector<HGameNetConnection> vecConn;
+	for ( int i = 0 ; i < k_nConnectStormClients ; ++i )
+		vecConn.push_back( GameNetworkingSockets()->ConnectByIPAddress( addrServer, 0, nullptr ) );
+	GameNetworkingMicroseconds usecTimeout = GameNetworkingSockets_GetLocalTimestamp() + 30*1000*1000;
+	while ( s_nConnectStormConnected < k_nConnectStormClients && GameNetworkingSockets_GetLocalTimestamp() < usecTimeout )
+		TEST_PumpCallbacks();
+	if ( s_nConnectStormConnected < k_nConnectStormClients )
+		_exit( 2 );
+
+	for ( HGameNetConnection hConn: vecConn )
+		GameNetworkingSockets()->CloseConnection( hConn, 0, nullptr, false );
+	GameNetworkingSockets_Kill();
+}
+
+static void BenchmarkConnectStormPass( bool bBatchVerify )
+{
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_HandshakeBatchVerify, bBatchVerify ? 1 : 0 );
+
+	int fdPipe[2];
+	if ( pipe( fdPipe ) != 0 )
+		TEST_Fatal( "pipe() failed" );
+	pid_t pid = fork();
+	if ( pid < 0 )
+		TEST_Fatal( "fork() failed" );
+	if ( pid == 0 )
+	{
+		close( fdPipe[1] );
+		uint16 nPort = 0;
+		if ( read( fdPipe[0], &nPort, sizeof(nPort) ) != sizeof(nPort) )
+			_exit( 1 );
+		ConnectStormClientProcess( nPort );
+		_exit( 0 );
+	}
+	close( fdPipe[0] );
+
+	s_nConnectStormAccepted = 0;
+	RecvWorkersInit();
+
+	GameNetworkingIPAddr addrLocal;
+	addrLocal.SetIPv4( 0x7f000001, uint16( 27400 + bBatchVerify ) );
+	s_hConnectStormListenSocket = GameNetworkingSockets()->CreateListenSocketIP( addrLocal, 0, nullptr );
+	if ( !GameNetworkingSockets()->GetListenSocketAddress( s_hConnectStormListenSocket, &addrLocal ) )
+		TEST_Fatal( "GetListenSocketAddress failed" );
+	double flCPUStart = GetProcessCPUSeconds();
+	if ( write( fdPipe[1], &addrLocal.m_port, sizeof(addrLocal.m_port) ) != sizeof(addrLocal.m_port) )
+		TEST_Fatal( "write() failed" );
+	close( fdPipe[1] );
+
+	// Accept until all the clients have connected
+	double flCPUEnd = 0.0;
+	for (;;)
+	{
+		GameNetworkingSockets()->RunCallbacks();
+		if ( s_nConnectStormAccepted == k_nConnectStormClients && flCPUEnd == 0.0 )
+			flCPUEnd = GetProcessCPUSeconds();
+
+		int status;
+		if ( waitpid( pid, &status, WNOHANG ) == pid )
+		{
+			if ( !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 )
+				TEST_Fatal( "Client process failed" );
+			break;
+		}
+
+		// In a real storm, requests arrive faster than the server can
+		// handle them.  Here the clients share the CPU with us and can't
+		// keep up, so stall the service thread now and then to let the
+		// requests pile up, like they would on a saturated server.
+		{
+			GameNetworkingGlobalLock lock( "ConnectStorm" );
+			std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+		}
+		std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+	}
+
+	GameNetworkingSockets()->CloseListenSocket( s_hConnectStormListenSocket );
+	s_hConnectStormListenSocket = k_HSteamListenSocket_Invalid;
+	GameNetworkingSockets_Kill();
+
+	GameNetworkingMicroseconds usecElapsed = std::max( s_usecConnectStormLastAccept - s_usecConnectStormFirstAccept, (GameNetworkingMicroseconds)1 );
+	double flCPUPerHandshake = ( flCPUEnd - flCPUStart ) / k_nConnectStormClients;
+	TEST_Printf( "\t%-20s %6d accepted %8.0f handshakes/sec %8.0f handshakes/sec of server CPU (%.1f usec each)\n",
+		bBatchVerify ? "batch verify" : "one at a time", s_nConnectStormAccepted,
+		s_nConnectStormAccepted * 1e6 / usecElapsed,
+		1.0 / flCPUPerHandshake, flCPUPerHandshake * 1e6 );
+}
+
+static void BenchmarkConnectStorm()
+{
+	TEST_Printf( "Connect storm, loopback, %d clients connecting at once (unsigned certs):\n", k_nConnectStormClients );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_IP_AllowWithoutAuth, 2 );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_ConnectRequestRateLimit, 0 ); // All the clients are on the same address
+	GameNetworkingUtils()->SetGlobalCallback_GameNetConnectionStatusChanged( ConnectStormConnectionStatusChanged );
+	for ( bool bBatchVerify: { false, true } )
+		BenchmarkConnectStormPass( bBatchVerify );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_HandshakeBatchVerify, 1 );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_ConnectRequestRateLimit, 32 );
+	GameNetworkingUtils()->SetGlobalCallback_GameNetConnectionStatusChanged( nullptr );
+}
+#else
+static void BenchmarkConnectStorm()
+{
+	TEST_Printf( "Connect storm benchmark not supported on this platform\n" );
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Handshake flood.  Measures how much messages on an established connection
+// are delayed while lots of other clients are connecting, with the handshake
+// crypto done by the service thread, and by crypto worker threads.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifdef POSIX
+
+static const int k_nHandshakeFloodClients = 5000;
+static const int k_nHandshakeFloodInProgress = 500; // Max connection attempts by the clients at any one time
+
+/// Child process.  Keep starting connections until we've done enough of them.
+/// As soon as each one connects, close it.
+static void HandshakeFloodClientProcess( uint16 nPort )
+{
+	s_hConnectStormListenSocket = k_HSteamListenSocket_Invalid;
+	s_nConnectStormConnected = 0;
+	s_nConnectStormFailed = 0;
+	s_bConnectStormCloseWhenConnected = true;
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_HandshakeCryptoThreads, 0 );
+	RecvWorkersInit();
+
+	GameNetworkingIPAddr addrServer;
+	addrServer.SetIPv4( 0x7f000001, nPort );
+	int nStarted = 0;
+	GameNetworkingMicroseconds usecTimeout = GameNetworkingSockets_GetLocalTimestamp() + 120*1000*1000;
+	while ( s_nConnectStormConnected + s_nConnectStormFailed < k_nHandshakeFloodClients && GameNetworkingSockets_GetLocalTimestamp() < usecTimeout )
+	{
+		while ( nStarted < k_nHandshakeFloodClients && nStarted - ( s_nConnectStormConnected + s_nConnectStormFailed ) < k_nHandshakeFloodInProgress )
+		{
+			GameNetworkingSockets()->ConnectByIPAddress( addrServer, 0, nullptr );
+			++nStarted;
+		}
+		TEST_PumpCallbacks();
+	}
+	if ( s_nConnectStormConnected + s_nConnectStormFailed < k_nHandshakeFloodClients )
+		_exit( 2 );
+
+	GameNetworkingSockets_Kill();
+}
+
+static void BenchmarkHandshakeFloodPass( int nCryptoThreads )
+{
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_HandshakeCryptoThreads, nCryptoThreads );
+
+	int fdPipe[2];
+	if ( pipe( fdPipe ) != 0 )
+		TEST_Fatal( "pipe() failed" );
+	pid_t pid = fork();
+	if ( pid < 0 )
+		TEST_Fatal( "fork() failed" );
+	if ( pid == 0 )
+	{
+		close( fdPipe[1] );
+		uint16 nPort = 0;
+		if ( read( fdPipe[0], &nPort, sizeof(nPort) ) != sizeof(nPort) )
+			_exit( 1 );
+		HandshakeFloodClientProcess( nPort );
+		_exit( 0 );
+	}
+	close( fdPipe[0] );
+
+	s_nConnectStormAccepted = 0;
+	s_bConnectStormCloseWhenConnected = false;
+	RecvWorkersInit();
+
+	GameNetworkingIPAddr addrLocal;
+	addrLocal.SetIPv4( 0x7f000001, uint16( 27410 + nCryptoThreads ) );
+	s_hConnectStormListenSocket = GameNetworkingSockets()->CreateListenSocketIP( addrLocal, 0, nullptr );
+	if ( !GameNetworkingSockets()->GetListenSocketAddress( s_hConnectStormListenSocket, &addrLocal ) )
+		TEST_Fatal( "GetListenSocketAddress failed" );
+
+	// The established connection.  Use real sockets, so the packets go
+	// through the service thread, just like everybody else's.
+	HGameNetConnection hSend, hRecv;
+	if ( !GameNetworkingSockets()->CreateSocketPair( &hSend, &hRecv, true, nullptr, nullptr ) )
+		TEST_Fatal( "CreateSocketPair failed" );
+
+	if ( write( fdPipe[1], &addrLocal.m_port, sizeof(addrLocal.m_port) ) != sizeof(addrLocal.m_port) )
+		TEST_Fatal( "write() failed" );
+	close( fdPipe[1] );
+
+	// Send a timestamped message every millisecond, until the clients are done
+	std::vector<GameNetworkingMicroseconds> vecDelay;
+	GameNetworkingMicroseconds usecNextSend = 0;
+	for (;;)
+	{
+		GameNetworkingSockets()->RunCallbacks();
+
+		GameNetworkingMicroseconds usecNow = GameNetworkingSockets_GetLocalTimestamp();
+		if ( usecNow >= usecNextSend )
+		{
+			GameNetworkingSockets()->SendMessageToConnection( hSend, &usecNow, sizeof(usecNow), k_nGameNetworkingSend_ReliableNoNagle, nullptr );
+			usecNextSend = usecNow + 1000;
+		}
+
+		GameNetworkingMessage_t *pMsg[ 16 ];
+		int nMsgs = GameNetworkingSockets()->ReceiveMessagesOnConnection( hRecv, pMsg, 16 );
+		usecNow = GameNetworkingSockets_GetLocalTimestamp();
+		for ( int i = 0 ; i < nMsgs ; ++i )
+		{
+			GameNetworkingMicroseconds usecSent;
+			memcpy( &usecSent, pMsg[i]->m_pData, sizeof(usecSent) );
+			vecDelay.push_back( usecNow - usecSent );
+			pMsg[i]->Release();
+		}
+
+		int status;
+		if ( waitpid( pid, &status, WNOHANG ) == pid )
+		{
+			if ( !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 )
+				TEST_Fatal( "Client process failed" );
+			break;
+		}
+		std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+	}
+
+	GameNetworkingSockets()->CloseConnection( hSend, 0, nullptr, false );
+	GameNetworkingSockets()->CloseConnection( hRecv, 0, nullptr, false );
+	GameNetworkingSockets()->CloseListenSocket( s_hConnectStormListenSocket );
+	s_hConnectStormListenSocket = k_HSteamListenSocket_Invalid;
+	GameNetworkingSockets_Kill();
+
+	if ( vecDelay.empty() )
+		TEST_Fatal( "No messages received" );
+	std::sort( vecDelay.begin(), vecDelay.end() );
+	auto Percentile = [&vecDelay]( int nPct ) { return (long long)vecDelay[ ( vecDelay.size() - 1 ) * nPct / 100 ]; };
+	TEST_Printf( "\t%2d crypto threads %6d accepted %6d msgs  delay p50 %6lldus p99 %6lldus max %6lldus\n",
+		nCryptoThreads, s_nConnectStormAccepted, (int)vecDelay.size(),
+		Percentile( 50 ), Percentile( 99 ), (long long)vecDelay.back() );
+}
+
+static void BenchmarkHandshakeFlood()
+{
+	TEST_Printf( "Message delay on an established connection, while %d clients connect (unsigned certs):\n", k_nHandshakeFloodClients );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_IP_AllowWithoutAuth, 2 );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_ConnectRequestRateLimit, 0 ); // All the clients are on the same address
+	GameNetworkingUtils()->SetGlobalCallback_GameNetConnectionStatusChanged( ConnectStormConnectionStatusChanged );
+	for ( int nCryptoThreads: { 0, 1, 2 } )
+		BenchmarkHandshakeFloodPass( nCryptoThreads );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_HandshakeCryptoThreads, 0 );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_ConnectRequestRateLimit, 32 );
+	GameNetworkingUtils()->SetGlobalCallback_GameNetConnectionStatusChanged( nullptr );
+}
+#else
+static void BenchmarkHandshakeFlood()
+{
+	TEST_Printf( "Handshake flood benchmark not supported on this platform\n" );
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Connect request flood.  How fast a listen socket can throw away connect
+// requests that will never succeed, such as from a flood with spoofed
+// source addresses.  All of the work happens in the service thread,
+// so we time that.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifdef POSIX
+
+/// Make a connect request that looks like a real one, with a cert and
+/// crypt info of about the usual size.  Nothing in it is valid, except
+/// maybe the challenge.
+static int BuildConnectFloodRequest( uint8 *pkt, int cbMax, uint64 nChallenge )
+{
+	CMsgSteamSockets_UDP_ConnectRequest msg;
+	msg.set_client_connection_id( 0x12345678 );
+	msg.set_challenge( nChallenge );
+	msg.set_my_timestamp( 1234 );
+	msg.set_ping_est_ms( 50 );
+	msg.mutable_cert()->set_cert( std::string( 150, '\x5a' ) );
+	msg.mutable_cert()->set_ca_key_id( 1234 );
+	msg.mutable_cert()->set_ca_signature( std::string( 64, '\x5a' ) );
+	msg.mutable_crypt()->set_info( std::string( 60, '\x5a' ) );
+	msg.mutable_crypt()->set_signature( std::string( 64, '\x5a' ) );
+	msg.set_identity_string( "str:connectflood" );
+	pkt[0] = k_EGameNetworkingUDPMsg_ConnectRequest;
+	if ( !msg.SerializeToArray( pkt+1, cbMax-1 ) )
+		TEST_Fatal( "SerializeToArray failed" );
+	return 1 + (int)msg.ByteSizeLong();
+}
+
+/// Ask the listen socket for a challenge, the same way a client would
+static uint64 GetConnectFloodChallenge( SOCKET sock, const sockaddr_in &adrTo )
+{
+	CMsgSteamSockets_UDP_ChallengeRequest msg;
+	msg.set_connection_id( 0x12345678 );
+	msg.set_my_timestamp( 1 );
+	msg.set_protocol_version( k_nCurrentProtocolVersion );
+	// Padded message: msg ID, 16-bit little endian length, body, then zeros
+	const int k_cbPaddedPkt = 512;
+	uint8 pkt[ k_cbGameNetworkingSocketsMaxUDPMsgLen ];
+	memset( pkt, 0, k_cbPaddedPkt );
+	pkt[0] = k_EGameNetworkingUDPMsg_ChallengeRequest;
+	*(uint16 *)( pkt+1 ) = LittleWord( uint16( msg.ByteSizeLong() ) );
+	msg.SerializeToArray( pkt+3, k_cbPaddedPkt-3 );
+	if ( sendto( sock, (const char *)pkt, k_cbPaddedPkt, 0, (const sockaddr *)&adrTo, sizeof(adrTo) ) != k_cbPaddedPkt )
+		TEST_Fatal( "sendto failed" );
+
+	GameNetworkingMicroseconds usecTimeout = GameNetworkingSockets_GetLocalTimestamp() + 1000*1000;
+	while ( GameNetworkingSockets_GetLocalTimestamp() < usecTimeout )
+	{
+		GameNetworkingSockets_Poll( 1 );
+		int cbPkt = recv( sock, (char *)pkt, sizeof(pkt), MSG_DONTWAIT );
+		if ( cbPkt <= 1 || pkt[0] != k_EGameNetworkingUDPMsg_ChallengeReply )
+			continue;
+		CMsgSteamSockets_UDP_ChallengeReply msgReply;
+		if ( msgReply.ParseFromArray( pkt+1, cbPkt-1 ) )
+			return msgReply.challenge();
+	}
+	TEST_Fatal( "No challenge reply" );
+	return 0;
+}
+
+static void BenchmarkConnectFloodPass( const char *pszName, SOCKET sock, const sockaddr_in &adrTo, const uint8 *pkt, int cbPkt )
+{
+	const int k_nBursts = 500; // Short enough that the challenge doesn't expire
+	const int k_nPacketsPerBurst = 128; // Keep this under what fits in the OS recv buffer
+
+	int nPacketsSent = 0;
+	GameNetworkingMicroseconds usecInPoll = 0;
+	for ( int iBurst = 0 ; iBurst < k_nBursts ; ++iBurst )
+	{
+		for ( int i = 0 ; i < k_nPacketsPerBurst ; ++i )
+		{
+			if ( sendto( sock, (const char *)pkt, cbPkt, 0, (const sockaddr *)&adrTo, sizeof(adrTo) ) == cbPkt )
+				++nPacketsSent;
+		}
+
+		// Only time the receive side
+		GameNetworkingMicroseconds usecStart = GameNetworkingSockets_GetLocalTimestamp();
+		GameNetworkingSockets_Poll( 0 );
+		usecInPoll += GameNetworkingSockets_GetLocalTimestamp() - usecStart;
+	}
+
+	TEST_Printf( "\t%-32s %4d bytes %8d sent %10.0f pkts/sec per core\n",
+		pszName, cbPkt, nPacketsSent,
+		nPacketsSent * 1e6 / std::max( usecInPoll, (GameNetworkingMicroseconds)1 ) );
+}
+
+static void BenchmarkConnectFlood()
+{
+	TEST_Printf( "Connect request flood, loopback.  Rate at which junk requests are dropped:\n" );
+
+	GameNetworkingSockets_SetManualPollMode( true );
+	GameNetworkingErrMsg errMsg;
+	if ( !GameNetworkingSockets_Init( nullptr, errMsg ) )
+		TEST_Fatal( "GameNetworkingSockets_Init failed.  %s", errMsg );
+
+	GameNetworkingIPAddr addrLocal;
+	addrLocal.SetIPv4( 0x7f000001, 27410 );
+	HSteamListenSocket hListenSocket = GameNetworkingSockets()->CreateListenSocketIP( addrLocal, 0, nullptr );
+	if ( hListenSocket == k_HSteamListenSocket_Invalid || !GameNetworkingSockets()->GetListenSocketAddress( hListenSocket, &addrLocal ) )
+		TEST_Fatal( "CreateListenSocketIP failed" );
+
+	sockaddr_in adrTo;
+	memset( &adrTo, 0, sizeof(adrTo) );
+	adrTo.sin_family = AF_INET;
+	adrTo.sin_addr.s_addr = htonl( 0x7f000001 );
+	adrTo.sin_port = htons( addrLocal.m_port );
+
+	SOCKET sock = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+	if ( sock == INVALID_SOCKET )
+		TEST_Fatal( "socket() failed" );
+
+	uint8 pkt[ k_cbGameNetworkingSocketsMaxUDPMsgLen ];
+	int cbPkt;
+
+	// Spoofed.  Looks like a real request, but the challenge is wrong
+	cbPkt = BuildConnectFloodRequest( pkt, sizeof(pkt), 0x0123456789abcdefull );
+	BenchmarkConnectFloodPass( "bad challenge", sock, adrTo, pkt, cbPkt );
+
+	// Random junk
+	CCrypto::GenerateRandomBlock( pkt+1, cbPkt-1 );
+	BenchmarkConnectFloodPass( "garbage", sock, adrTo, pkt, cbPkt );
+
+	// A host that can receive our challenges (so it is not spoofing), but
+	// is sending us bogus requests as fast as it can.  Most of them will
+	// be over the rate limit
+	for ( int nRateLimit: { 0, 32 } )
+	{
+		GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_ConnectRequestRateLimit, nRateLimit );
+		cbPkt = BuildConnectFloodRequest( pkt, sizeof(pkt), GetConnectFloodChallenge( sock, adrTo ) );
+		BenchmarkConnectFloodPass( nRateLimit ? "valid challenge, rate limited" : "valid challenge, no rate limit", sock, adrTo, pkt, cbPkt );
+	}
+
+	closesocket( sock );
+	GameNetworkingSockets()->CloseListenSocket( hListenSocket );
+	GameNetworkingSockets_Kill();
+	GameNetworkingSockets_SetManualPollMode( false );
+}
+#else
+static void BenchmarkConnectFlood()
+{
+	TEST_Printf( "Connect flood benchmark not supported on this platform\n" );
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Shared socket demux.  Cost to route a packet received on a listen
+// socket to the connection it belongs to, when there are lots of
+// remote hosts sharing the socket.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+static int s_nDemuxPacketsRouted;
+static int s_nDemuxPacketsUnknown;
+
+static void DemuxRecvCallback( const RecvPktInfo_t &info, void *pContext )
+{
+	// A real connection is going to look at the header, so the cost of
+	// bringing the packet into cache belongs to every method
+	if ( *static_cast<const uint8 *>( info.m_pPkt ) == 0x80 )
+		++s_nDemuxPacketsRouted;
+}
+
+static void DemuxUnknownHostCallback( const RecvPktInfo_t &info, void *pContext )
+{
+	++s_nDemuxPacketsUnknown;
+}
+
+static void BenchmarkSharedSocketDemuxPath( const char *pszName, CSharedSocket::FnGetPacketConnectionID fnGetConnectionID )
+{
+	const int k_nRemoteHosts = 10000;
+	const int k_nPasses = 200;
+	const int k_cbPkt = 100;
+
+	GameNetworkingGlobalLock lock( "BenchmarkSharedSocketDemux" );
+
+	SteamDatagramErrMsg errMsg;
+	GameNetworkingIPAddr addrLocal;
+	addrLocal.SetIPv4( 0x7f000001, 0 );
+	CSharedSocket *pSharedSock = new CSharedSocket;
+	if ( !pSharedSock->BInit( addrLocal, CRecvPacketCallback( DemuxUnknownHostCallback, (void *)nullptr ), errMsg, fnGetConnectionID ) )
+		TEST_Fatal( "CSharedSocket::BInit failed.  %s", errMsg );
+
+	// Give everybody a data packet.  Addresses and connection IDs are
+	// scattered, like they would be in real life.  Listen sockets are
+	// usually dual stack, so IPv4 hosts show up as IPv4-mapped IPv6
+	std::vector<netadr_t> vecAdr( k_nRemoteHosts );
+	std::vector<uint8> vecPkt( k_nRemoteHosts * k_cbPkt, 0x5a );
+	for ( int i = 0 ; i < k_nRemoteHosts ; ++i )
+	{
+		uint8 ipv6[16] = { 0,0,0,0, 0,0,0,0, 0,0,0xff,0xff, 10 };
+		uint32 nHostBits = i * 2654435761u;
+		ipv6[13] = uint8( nHostBits >> 16 );
+		ipv6[14] = uint8( nHostBits >> 8 );
+		ipv6[15] = uint8( nHostBits );
+		vecAdr[i].SetIPV6( ipv6 );
+		vecAdr[i].SetPort( uint16( 1024 + i ) );
+		IBoundUDPSocket *pRemoteHost = pSharedSock->AddRemoteHost( vecAdr[i], CRecvPacketCallback( DemuxRecvCallback, (void *)nullptr ) );
+		if ( !pRemoteHost )
+			TEST_Fatal( "AddRemoteHost failed" );
+
+		uint32 unConnectionID = uint32( i+1 ) * 2654435761u;
+		pSharedSock->SetRemoteHostConnectionID( pRemoteHost, unConnectionID );
+
+		uint8 *pPkt = &vecPkt[ i*k_cbPkt ];
+		pPkt[0] = 0x80;
+		unConnectionID = LittleDWord( unConnectionID );
+		memcpy( pPkt+1, &unConnectionID, sizeof(unConnectionID) );
+	}
+
+	RecvPktInfo_t info;
+	info.m_cbPkt = k_cbPkt;
+	info.m_pSock = nullptr;
+	info.m_pPreDecrypted = nullptr;
+	info.m_usecNow = GameNetworkingSockets_GetLocalTimestamp();
+	info.m_usecKernelRecv = 0;
+	s_nDemuxPacketsRouted = 0;
+	s_nDemuxPacketsUnknown = 0;
+	GameNetworkingMicroseconds usecStart = GameNetworkingSockets_GetLocalTimestamp();
+	for ( int iPass = 0 ; iPass < k_nPasses ; ++iPass )
+	{
+		// Visit hosts in a scattered order.  (7919 is prime, so we hit everybody)
+		for ( int i = 0 ; i < k_nRemoteHosts ; ++i )
+		{
+			int idx = ( i * 7919 ) % k_nRemoteHosts;
+			info.m_pPkt = &vecPkt[ idx*k_cbPkt ];
+			info.m_adrFrom = vecAdr[ idx ];
+			CSharedSocket::CallbackRecvPacket( info, pSharedSock );
+		}
+	}
+	GameNetworkingMicroseconds usecElapsed = GameNetworkingSockets_GetLocalTimestamp() - usecStart;
+	if ( s_nDemuxPacketsUnknown != 0 || s_nDemuxPacketsRouted != k_nRemoteHosts*k_nPasses )
+		TEST_Fatal( "Packets routed to the wrong place!" );
+
+	TEST_Printf( "\t%-20s %6d hosts %8.1f ns/pkt\n",
+		pszName, k_nRemoteHosts, usecElapsed * 1000.0 / ( k_nRemoteHosts * k_nPasses ) );
+
+	pSharedSock->Kill();
+	delete pSharedSock;
+}
+
+static void BenchmarkSharedSocketDemux()
+{
+	TEST_Printf( "Shared socket demux:\n" );
+
+	GameNetworkingSockets_SetManualPollMode( true );
+	{
+		GameNetworkingGlobalLock lock( "BenchmarkSharedSocketDemux" );
+		SteamDatagramErrMsg errMsg;
+		if ( !BGameNetworkingSocketsLowLevelAddRef( errMsg ) )
+			TEST_Fatal( "BGameNetworkingSocketsLowLevelAddRef failed.  %s", errMsg );
+	}
+
+	BenchmarkSharedSocketDemuxPath( "by address", nullptr );
+	BenchmarkSharedSocketDemuxPath( "by connection ID", GetUDPDataPacketToConnectionID );
+
+	{
+		GameNetworkingGlobalLock lock( "BenchmarkSharedSocketDemux" );
+		GameNetworkingSocketsLowLevelDecRef();
+	}
+	GameNetworkingSockets_SetManualPollMode( false );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Thinker scheduling
+//
+// Compares the timer wheel that IThinker uses against the binary heap
+// that it replaced, which is reproduced here.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#include <tier1/utlpriorityqueue.h>
+
+class CHeapThinker;
+struct HeapThinkerLess
+{
+	bool operator()( const CHeapThinker *a, const CHeapThinker *b ) const;
+};
+struct HeapThinkerSetIndex
+{
+	static void SetIndex( CHeapThinker *p, int idx );
+};
+
+static CUtlPriorityQueue<CHeapThinker*,HeapThinkerLess,HeapThinkerSetIndex> s_queueHeapThinkers;
+static ShortDurationLock s_lockHeapThinkers( "heapthinker" );
+
+class CHeapThinker
+{
+public:
+	GameNetworkingMicroseconds m_usecNextThinkTime = k_nThinkTime_Never;
+	int m_queueIndex = -1;
+	GameNetworkingMicroseconds m_usecInterval = 0;
+	int m_nThinks = 0;
+
+	GameNetworkingMicroseconds GetNextThinkTime() const { return m_usecNextThinkTime; }
+
+	void SetNextThinkTime( GameNetworkingMicroseconds usecTargetThinkTime )
+	{
+		s_lockHeapThinkers.lock();
+		InternalSetNextThinkTime( usecTargetThinkTime );
+		s_lockHeapThinkers.unlock();
+	}
+
+	void InternalSetNextThinkTime( GameNetworkingMicroseconds usecTargetThinkTime )
+	{
+		if ( usecTargetThinkTime == k_nThinkTime_Never )
+		{
+			if ( m_queueIndex >= 0 )
+				s_queueHeapThinkers.RemoveAt( m_queueIndex );
+			m_usecNextThinkTime = k_nThinkTime_Never;
+			return;
+		}
+
+		// Same bookkeeping the old code did to decide whether to wake the service thread
+		volatile GameNetworkingMicroseconds usecNextWake = ( s_queueHeapThinkers.Count() > 0 ) ? s_queueHeapThinkers.ElementAtHead()->m_usecNextThinkTime : k_nThinkTime_Never;
+		(void)usecNextWake;
+
+		m_usecNextThinkTime = usecTargetThinkTime;
+		if ( m_queueIndex < 0 )
+			s_queueHeapThinkers.Insert( this );
+		else
+			s_queueHeapThinkers.RevaluateElement( m_queueIndex );
+	}
+
+	void Think( GameNetworkingMicroseconds usecNow )
+	{
+		++m_nThinks;
+		SetNextThinkTime( usecNow + m_usecInterval );
+	}
+
+	static void ProcessThinkers()
+	{
+		s_lockHeapThinkers.lock();
+		while ( s_queueHeapThinkers.Count() > 0 )
+		{
+			CHeapThinker *pNextThinker = s_queueHeapThinkers.ElementAtHead();
+			GameNetworkingMicroseconds usecNow = GameNetworkingSockets_GetLocalTimestamp();
+			if ( pNextThinker->m_usecNextThinkTime >= usecNow )
+				break;
+			pNextThinker->InternalSetNextThinkTime( k_nThinkTime_Never );
+			s_lockHeapThinkers.unlock();
+			pNextThinker->Think( usecNow );
+			s_lockHeapThinkers.lock();
+		}
+		s_lockHeapThinkers.unlock();
+	}
+};
+
+bool HeapThinkerLess::operator()( const CHeapThinker *a, const CHeapThinker *b ) const
+{
+	return a->m_usecNextThinkTime > b->m_usecNextThinkTime;
+}
+void HeapThinkerSetIndex::SetIndex( CHeapThinker *p, int idx ) { p->m_queueIndex = idx; }
+
+class CWheelThinker : public IThinker
+{
+public:
+	GameNetworkingMicroseconds m_usecInterval = 0;
+	int m_nThinks = 0;
+
+	using IThinker::SetNextThinkTime;
+	virtual void Think( GameNetworkingMicroseconds usecNow ) override
+	{
+		++m_nThinks;
+		SetNextThinkTime( usecNow + m_usecInterval );
+	}
+	static void ProcessThinkers() { IThinker::Thinker_ProcessThinkers(); }
+};
+
+// Cheap deterministic PRNG, so that both implementations see the same
+// schedule and random number generation doesn't dominate the timing.
+static inline uint32 ThinkerBenchmarkRand( uint32 &nState )
+{
+	nState ^= nState << 13;
+	nState ^= nState >> 17;
+	nState ^= nState << 5;
+	return nState;
+}
+
+template <typename TThinker>
+static void BenchmarkThinkersPath( const char *pszName, int nThinkers )
+{
+	const int k_nReschedules = 2000000;
+	const GameNetworkingMicroseconds k_usecServiceTime = 1000000;
+
+	// Make sure anything left over from earlier is out of the way, and
+	// the wheel cursor has caught up to the current time.
+	TThinker::ProcessThinkers();
+
+	std::vector<TThinker> vecThinkers( nThinkers );
+	uint32 nRand = 12345;
+
+	// Schedule everybody for a "keepalive" 100ms-1s from now.  Then
+	// pick connections at random, and toggle them between a near term
+	// wakeup (Nagle, ack flush, etc) and the keepalive.  This is what
+	// connections are doing all the time.
+	GameNetworkingMicroseconds usecBase = GameNetworkingSockets_GetLocalTimestamp();
+	for ( TThinker &t: vecThinkers )
+		t.SetNextThinkTime( usecBase + 100000 + ThinkerBenchmarkRand( nRand ) % 900000 );
+	GameNetworkingMicroseconds usecStart = GameNetworkingSockets_GetLocalTimestamp();
+	for ( int i = 0 ; i < k_nReschedules ; ++i )
+	{
+		TThinker &t = vecThinkers[ ThinkerBenchmarkRand( nRand ) % nThinkers ];
+		if ( t.GetNextThinkTime() < usecBase + 100000 )
+			t.SetNextThinkTime( usecBase + 100000 + ThinkerBenchmarkRand( nRand ) % 900000 );
+		else
+			t.SetNextThinkTime( usecBase + 1000 + ThinkerBenchmarkRand( nRand ) % 10000 );
+	}
+	GameNetworkingMicroseconds usecReschedule = GameNetworkingSockets_GetLocalTimestamp() - usecStart;
+
+	// Now let them run, each wanting service every 100-500ms.  Poll
+	// about once a ms, like the service thread does.
+	usecBase = GameNetworkingSockets_GetLocalTimestamp();
+	for ( TThinker &t: vecThinkers )
+	{
+		t.m_usecInterval = 100000 + ThinkerBenchmarkRand( nRand ) % 400000;
+		t.SetNextThinkTime( usecBase + ThinkerBenchmarkRand( nRand ) % t.m_usecInterval + 1 );
+	}
+	GameNetworkingMicroseconds usecInProcess = 0;
+	for (;;)
+	{
+		usecStart = GameNetworkingSockets_GetLocalTimestamp();
+		if ( usecStart >= usecBase + k_usecServiceTime )
+			break;
+		TThinker::ProcessThinkers();
+		usecInProcess += GameNetworkingSockets_GetLocalTimestamp() - usecStart;
+		std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+	}
+	int nThinks = 0;
+	for ( TThinker &t: vecThinkers )
+	{
+		nThinks += t.m_nThinks;
+		t.SetNextThinkTime( k_nThinkTime_Never );
+	}
+
+	TEST_Printf( "\t%-6s %7d thinkers %8.1f ns/reschedule %8d thinks %8.1f ns/think\n",
+		pszName, nThinkers,
+		usecReschedule * 1e3 / k_nReschedules,
+		nThinks, usecInProcess * 1e3 / std::max( nThinks, 1 ) );
+}
+
+static void BenchmarkThinkers()
+{
+	TEST_Printf( "Thinker scheduling:\n" );
+	for ( int nThinkers: { 10000, 30000, 100000 } )
+	{
+		BenchmarkThinkersPath<CHeapThinker>( "heap", nThinkers );
+		BenchmarkThinkersPath<CWheelThinker>( "wheel", nThinkers );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Connection table
+//
+/////////////////////////////////////////////////////////////////////////////
+
+static size_t GetProcessResidentBytes()
+{
+	#ifdef __linux__
+		FILE *f = fopen( "/proc/self/statm", "r" );
+		if ( !f )
+			return 0;
+		unsigned long nPagesTotal = 0, nPagesResident = 0;
+		int n = fscanf( f, "%lu %lu", &nPagesTotal, &nPagesResident );
+		fclose( f );
+		if ( n != 2 )
+			return 0;
+		return (size_t)nPagesResident * (size_t)sysconf( _SC_PAGESIZE );
+	#else
+		return 0;
+	#endif
+}
+
+static void BenchmarkConnectionTable()
+{
+	const int k_nConnections = 200000;
+	const int k_nLookups = 10000000;
+	const int k_nAPICalls = 2000000;
+
+	TEST_Printf( "Connection table, %d pipe connections:\n", k_nConnections );
+
+	GameNetworkingErrMsg errMsg;
+	if ( !GameNetworkingSockets_Init( nullptr, errMsg ) )
+		TEST_Fatal( "GameNetworkingSockets_Init failed.  %s", errMsg );
+
+	// Create a whole bunch of connections
+	std::vector<HGameNetConnection> vecConn( k_nConnections );
+	size_t cbBefore = GetProcessResidentBytes();
+	GameNetworkingMicroseconds usecStart = GameNetworkingSockets_GetLocalTimestamp();
+	for ( int i = 0 ; i < k_nConnections ; i += 2 )
+	{
+		if ( !GameNetworkingSockets()->CreateSocketPair( &vecConn[i], &vecConn[i+1], false, nullptr, nullptr ) )
+			TEST_Fatal( "CreateSocketPair failed after %d connections", i );
+	}
+	GameNetworkingMicroseconds usecCreate = GameNetworkingSockets_GetLocalTimestamp() - usecStart;
+	size_t cbAfter = GetProcessResidentBytes();
+	TEST_Printf( "\t%-24s %8.1f usec/connection\n", "create", usecCreate / (double)k_nConnections );
+	if ( cbAfter > cbBefore )
+		TEST_Printf( "\t%-24s %8.0f bytes/connection\n", "resident memory", ( cbAfter - cbBefore ) / (double)k_nConnections );
+
+	// Raw table lookups, hits and misses
+	uint32 nRand = 12345;
+	{
+		TableScopeLock tableLock( g_tables_lock );
+		int nFound = 0;
+		usecStart = GameNetworkingSockets_GetLocalTimestamp();
+		for ( int i = 0 ; i < k_nLookups ; ++i )
+		{
+			if ( g_mapConnections.Find( vecConn[ ThinkerBenchmarkRand( nRand ) % k_nConnections ] ) )
+				++nFound;
+		}
+		GameNetworkingMicroseconds usecHit = GameNetworkingSockets_GetLocalTimestamp() - usecStart;
+		if ( nFound != k_nLookups )
+			TEST_Fatal( "Only found %d / %d connections", nFound, k_nLookups );
+
+		usecStart = GameNetworkingSockets_GetLocalTimestamp();
+		for ( int i = 0 ; i < k_nLookups ; ++i )
+		{
+			if ( g_mapConnections.Find( ThinkerBenchmarkRand( nRand ) ) )
+				++nFound;
+		}
+		GameNetworkingMicroseconds usecMiss = GameNetworkingSockets_GetLocalTimestamp() - usecStart;
+
+		TEST_Printf( "\t%-24s %8.1f ns/lookup\n", "table lookup (hit)", usecHit * 1e3 / k_nLookups );
+		TEST_Printf( "\t%-24s %8.1f ns/lookup\n", "table lookup (miss)", usecMiss * 1e3 / k_nLookups );
+	}
+
+	// Lookup through the API, which also takes the global and connection locks
+	usecStart = GameNetworkingSockets_GetLocalTimestamp();
+	for ( int i = 0 ; i < k_nAPICalls ; ++i )
+		GameNetworkingSockets()->GetConnectionUserData( vecConn[ ThinkerBenchmarkRand( nRand ) % k_nConnections ] );
+	GameNetworkingMicroseconds usecAPI = GameNetworkingSockets_GetLocalTimestamp() - usecStart;
+	TEST_Printf( "\t%-24s %8.1f ns/call\n", "GetConnectionUserData", usecAPI * 1e3 / k_nAPICalls );
+
+	for ( HGameNetConnection hConn: vecConn )
+		GameNetworkingSockets()->CloseConnection( hConn, 0, nullptr, false );
+	GameNetworkingSockets_Kill();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Message pool
+//
+/////////////////////////////////////////////////////////////////////////////
+
+static void BenchmarkMessagePoolSendRecv( int cbMsg, HGameNetConnection hSend, HGameNetConnection hRecv )
+{
+	const int k_nMessages = 2000000;
+	const int k_nBatch = 64;
+
+	std::vector<char> vecPayload( cbMsg, 'x' );
+	GameNetworkingMessage_t *arMsg[ k_nBatch ];
+
+	MessagePoolStats_t statsBefore, statsAfter;
+	MessagePool_GetStats( statsBefore );
+
+	GameNetworkingMicroseconds usecStart = GameNetworkingSockets_GetLocalTimestamp();
+	for ( int i = 0 ; i < k_nMessages ; i += k_nBatch )
+	{
+		for ( int j = 0 ; j < k_nBatch ; ++j )
+		{
+			if ( GameNetworkingSockets()->SendMessageToConnection( hSend, vecPayload.data(), cbMsg, k_nGameNetworkingSend_UnreliableNoNagle, nullptr ) != k_EResultOK )
+				TEST_Fatal( "SendMessageToConnection failed" );
+		}
+		int nReceived = 0;
+		while ( nReceived < k_nBatch )
+		{
+			int n = GameNetworkingSockets()->ReceiveMessagesOnConnection( hRecv, arMsg, k_nBatch );
+			if ( n <= 0 )
+				TEST_Fatal( "Expected %d messages, only received %d", k_nBatch, nReceived );
+			for ( int j = 0 ; j < n ; ++j )
+				arMsg[j]->Release();
+			nReceived += n;
+		}
+	}
+	GameNetworkingMicroseconds usecElapsed = GameNetworkingSockets_GetLocalTimestamp() - usecStart;
+
+	MessagePool_GetStats( statsAfter );
+	int64 nHits = statsAfter.m_nHits - statsBefore.m_nHits;
+	int64 nMisses = statsAfter.m_nMisses - statsBefore.m_nMisses;
+	char szName[ 64 ];
+	V_sprintf_safe( szName, "send+recv+release %d", cbMsg );
+	TEST_Printf( "\t%-28s %8.1f ns/msg   pool hit rate %.2f%%, %lld slabs\n", szName,
+		usecElapsed * 1e3 / k_nMessages,
+		nHits * 100.0 / std::max( nHits + nMisses, (int64)1 ), (long long)statsAfter.m_nSlabs );
+}
+
+static void BenchmarkMessagePoolAllocFree( int cbMsg )
+{
+	const int k_nIterations = 5000000;
+	const int k_nOutstanding = 64;
+	void *arData[ k_nOutstanding ];
+	char szName[ 64 ];
+
+	// Baseline: what we used to do, one allocation for the message, another for the payload
+	GameNetworkingMicroseconds usecStart = GameNetworkingSockets_GetLocalTimestamp();
+	for ( int i = 0 ; i < k_nIterations ; i += k_nOutstanding )
+	{
+		for ( int j = 0 ; j < k_nOutstanding ; ++j )
+		{
+			arData[j] = malloc( sizeof(CGameNetworkingMessage) );
+			*(void **)arData[j] = malloc( cbMsg );
+		}
+		for ( int j = 0 ; j < k_nOutstanding ; ++j )
+		{
+			free( *(void **)arData[j] );
+			free( arData[j] );
+		}
+	}
+	GameNetworkingMicroseconds usecMalloc = GameNetworkingSockets_GetLocalTimestamp() - usecStart;
+
+	GameNetworkingMessage_t *arMsg[ k_nOutstanding ];
+	usecStart = GameNetworkingSockets_GetLocalTimestamp();
+	for ( int i = 0 ; i < k_nIterations ; i += k_nOutstanding )
+	{
+		for ( int j = 0 ; j < k_nOutstanding ; ++j )
+			arMsg[j] = GameNetworkingUtils()->AllocateMessage( cbMsg );
+		for ( int j = 0 ; j < k_nOutstanding ; ++j )
+			arMsg[j]->Release();
+	}
+	GameNetworkingMicroseconds usecPool = GameNetworkingSockets_GetLocalTimestamp() - usecStart;
+
+	V_sprintf_safe( szName, "malloc+free %d", cbMsg );
+	TEST_Printf( "\t%-28s %8.1f ns/msg\n", szName, usecMalloc * 1e3 / k_nIterations );
+	V_sprintf_safe( szName, "AllocateMessage+Release %d", cbMsg );
+	TEST_Printf( "\t%-28s %8.1f ns/msg\n", szName, usecPool * 1e3 / k_nIterations );
+}
+
+// Allocate a lot of messages at once, then free them all, and make sure
+// the pool gives most of the memory back
+static void BenchmarkMessagePoolBurst( int cbMsg )
+{
+	const int k_nMessages = 100000;
+	std::vector<GameNetworkingMessage_t *> vecMsg( k_nMessages );
+
+	MessagePoolStats_t statsBefore, statsPeak, statsAfter;
+	MessagePool_GetStats( statsBefore );
+	for ( GameNetworkingMessage_t *&pMsg: vecMsg )
+		pMsg = GameNetworkingUtils()->AllocateMessage( cbMsg );
+	MessagePool_GetStats( statsPeak );
+	for ( GameNetworkingMessage_t *pMsg: vecMsg )
+		pMsg->Release();
+	MessagePool_GetStats( statsAfter );
+
+	char szName[ 64 ];
+	V_sprintf_safe( szName, "burst of %d x %d", k_nMessages, cbMsg );
+	TEST_Printf( "	%-28s slab bytes %lld -> %lld -> %lld\n", szName,
+		(long long)statsBefore.m_cbSlabs, (long long)statsPeak.m_cbSlabs, (long long)statsAfter.m_cbSlabs );
+}
+
+static void BenchmarkMessagePool()
+{
+	TEST_Printf( "Message pool:\n" );
+
+	GameNetworkingErrMsg errMsg;
+	if ( !GameNetworkingSockets_Init( nullptr, errMsg ) )
+		TEST_Fatal( "GameNetworkingSockets_Init failed.  %s", errMsg );
+
+	for ( int cbMsg: { 32, 200, 1000, 4000 } )
+		BenchmarkMessagePoolAllocFree( cbMsg );
+
+	HGameNetConnection hConn1, hConn2;
+	if ( !GameNetworkingSockets()->CreateSocketPair( &hConn1, &hConn2, false, nullptr, nullptr ) )
+		TEST_Fatal( "CreateSocketPair failed" );
+	for ( int cbMsg: { 32, 200, 1000, 4000 } )
+		BenchmarkMessagePoolSendRecv( cbMsg, hConn1, hConn2 );
+	BenchmarkMessagePoolBurst( 200 );
+
+	MessagePoolStats_t stats;
+	MessagePool_GetStats( stats );
+	TEST_Printf( "\t%lld hits, %lld misses, %lld slabs (%lld bytes), %lld oversized payloads\n",
+		(long long)stats.m_nHits, (long long)stats.m_nMisses, (long long)stats.m_nSlabs,
+		(long long)stats.m_cbSlabs, (long long)stats.m_nOversizedPayloads );
+
+	GameNetworkingSockets()->CloseConnection( hConn1, 0, nullptr, false );
+	GameNetworkingSockets()->CloseConnection( hConn2, 0, nullptr, false );
+	GameNetworkingSockets_Kill();
+
+	// Empty slabs are freed at shutdown
+	MessagePool_GetStats( stats );
+	TEST_Printf( "\t%lld slabs (%lld bytes) after shutdown\n", (long long)stats.m_nSlabs, (long long)stats.m_cbSlabs );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// SNP under simulated loss
+//
+/////////////////////////////////////////////////////////////////////////////
+
+// Send a bunch of reliable messages over a loopback connection, using
+// whatever fake loss/lag settings are currently active, and report the
+// CPU cost.
+static void BenchmarkSNPReliableStreamPass( const char *pszDesc )
+{
+	const int k_nMessages = 10000;
+	const int k_cbMsg = 1000;
+
+	// Use a loopback pair, not a pipe, so we actually go through SNP
+	HGameNetConnection hSend, hRecv;
+	if ( !GameNetworkingSockets()->CreateSocketPair( &hSend, &hRecv, true, nullptr, nullptr ) )
+		TEST_Fatal( "CreateSocketPair failed" );
+
+	char msg[ k_cbMsg ];
+	memset( msg, 0x5a, sizeof(msg) );
+	GameNetworkingMessage_t *arMsg[ 64 ];
+	int nSent = 0, nReceived = 0;
+	GameNetworkingMicroseconds usecStart = GameNetworkingSockets_GetLocalTimestamp();
+	std::clock_t cpuStart = std::clock();
+	while ( nReceived < k_nMessages )
+	{
+		while ( nSent < k_nMessages && GameNetworkingSockets()->SendMessageToConnection( hSend, msg, k_cbMsg, k_nGameNetworkingSend_ReliableNoNagle, nullptr ) == k_EResultOK )
+			++nSent;
+
+		GameNetworkingSockets_Poll( 1 );
+
+		for (;;)
+		{
+			int n = GameNetworkingSockets()->ReceiveMessagesOnConnection( hRecv, arMsg, V_ARRAYSIZE( arMsg ) );
+			if ( n <= 0 )
+				break;
+			for ( int i = 0 ; i < n ; ++i )
+				arMsg[i]->Release();
+			nReceived += n;
+		}
+
+	}
+	GameNetworkingMicroseconds usecElapsed = GameNetworkingSockets_GetLocalTimestamp() - usecStart;
+	double usecCPU = double( std::clock() - cpuStart ) * 1e6 / CLOCKS_PER_SEC;
+
+	// Wall clock time is mostly determined by the send rate and the
+	// retransmit timeouts.  CPU time is what we're really interested in.
+	TEST_Printf( "\t%s   %7.2f cpu usec/msg  %6.2f MB/sec\n",
+		pszDesc, usecCPU / k_nMessages,
+		(double)k_nMessages * k_cbMsg / usecElapsed );
+
+	GameNetworkingSockets()->CloseConnection( hSend, 0, nullptr, false );
+	GameNetworkingSockets()->CloseConnection( hRecv, 0, nullptr, false );
+}
+
+static void BenchmarkSNPReliableStreamInit()
+{
+	GameNetworkingSockets_SetManualPollMode( true );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMin, 64*1024*1024 );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMax, 64*1024*1024 );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendBufferSize, 256*1024 );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_FakePacketLag_Send, 5 );
+
+	GameNetworkingErrMsg errMsg;
+	if ( !GameNetworkingSockets_Init( nullptr, errMsg ) )
+		TEST_Fatal( "GameNetworkingSockets_Init failed.  %s", errMsg );
+}
+
+static void BenchmarkSNPReliableStreamKill()
+{
+	GameNetworkingSockets_Kill();
+	GameNetworkingSockets_SetManualPollMode( false );
+}
+
+static void BenchmarkSNPLoss()
+{
+	TEST_Printf( "SNP reliable stream, loopback with simulated loss:\n" );
+	BenchmarkSNPReliableStreamInit();
+
+	for ( float flLossPct: { 0.0f, 1.0f, 2.0f, 5.0f, 10.0f, 20.0f } )
+	{
+		GameNetworkingUtils()->SetGlobalConfigValueFloat( k_EGameNetworkingConfig_FakePacketLoss_Send, flLossPct );
+
+		char szDesc[ 64 ];
+		V_sprintf_safe( szDesc, "loss %4.1f%%", flLossPct );
+		BenchmarkSNPReliableStreamPass( szDesc );
+	}
+
+	GameNetworkingUtils()->SetGlobalConfigValueFloat( k_EGameNetworkingConfig_FakePacketLoss_Send, 0.0f );
+	BenchmarkSNPReliableStreamKill();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Send pacing.  Stream data at a fixed rate over a loopback connection,
+// using the service thread, and look at the packet trace to see how
+// evenly the packets went out.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+static std::mutex s_lockPacingSendTimes;
+static std::vector<GameNetworkingMicroseconds> s_vecPacingSendTimes;
+
+static void PacingDebugOutput( EGameNetworkingSocketsDebugOutputType eType, const char *pszMsg )
+{
+	// Only count full data packets, not the acks going the other way
+	const char *pszBytes = strstr( pszMsg, "[Trace Send]" ) ? strchr( pszMsg, '|' ) : nullptr;
+	if ( pszBytes && atoi( pszBytes+1 ) >= 1000 )
+	{
+		std::lock_guard<std::mutex> lock( s_lockPacingSendTimes );
+		s_vecPacingSendTimes.push_back( GameNetworkingSockets_GetLocalTimestamp() );
+	}
+}
+
+static void BenchmarkPacingPass( int usecPacingMaxBurst )
+{
+	const int k_nSendRate = 8*1024*1024;
+	const int k_cbMsg = 1100;
+	const GameNetworkingMicroseconds k_usecSendTime = 2*1000*1000;
+
+	// Packets closer together than this were sent back to back.  At our
+	// send rate, full packets should be about 140usec apart.
+	const GameNetworkingMicroseconds k_usecBackToBack = 30;
+
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendPacingMaxBurst, usecPacingMaxBurst );
+
+	HGameNetConnection hSend, hRecv;
+	if ( !GameNetworkingSockets()->CreateSocketPair( &hSend, &hRecv, true, nullptr, nullptr ) )
+		TEST_Fatal( "CreateSocketPair failed" );
+
+	s_vecPacingSendTimes.clear();
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_PacketTraceMaxBytes, 0 );
+
+	char msg[ k_cbMsg ];
+	memset( msg, 0x5a, sizeof(msg) );
+	GameNetworkingMessage_t *arMsg[ 64 ];
+	int64 cbReceived = 0;
+	GameNetworkingMicroseconds usecStart = GameNetworkingSockets_GetLocalTimestamp();
+	while ( GameNetworkingSockets_GetLocalTimestamp() < usecStart + k_usecSendTime )
+	{
+		// Keep the send buffer full, so we're always rate limited
+		while ( GameNetworkingSockets()->SendMessageToConnection( hSend, msg, k_cbMsg, k_nGameNetworkingSend_ReliableNoNagle, nullptr ) == k_EResultOK )
+			;
+
+		for (;;)
+		{
+			int n = GameNetworkingSockets()->ReceiveMessagesOnConnection( hRecv, arMsg, V_ARRAYSIZE( arMsg ) );
+			if ( n <= 0 )
+				break;
+			for ( int i = 0 ; i < n ; ++i )
+			{
+				cbReceived += arMsg[i]->m_cbSize;
+				arMsg[i]->Release();
+			}
+		}
+
+		std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+	}
+
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_PacketTraceMaxBytes, -1 );
+	GameNetworkingSockets()->CloseConnection( hSend, 0, nullptr, false );
+	GameNetworkingSockets()->CloseConnection( hRecv, 0, nullptr, false );
+
+	// Split the trace into bursts of packets sent back to back
+	std::vector<int> vecBurstSizes;
+	{
+		std::lock_guard<std::mutex> lock( s_lockPacingSendTimes );
+		for ( size_t i = 0 ; i < s_vecPacingSendTimes.size() ; ++i )
+		{
+			if ( i == 0 || s_vecPacingSendTimes[i] - s_vecPacingSendTimes[i-1] >= k_usecBackToBack )
+				vecBurstSizes.push_back( 1 );
+			else
+				++vecBurstSizes.back();
+		}
+	}
+	if ( vecBurstSizes.empty() )
+		TEST_Fatal( "No packets in trace" );
+
+	// What fraction of packets were sent in bursts of each size?
+	const int k_arBucketMax[] = { 1, 2, 4, 8, 16, INT_MAX };
+	int arPacketsInBucket[ V_ARRAYSIZE( k_arBucketMax ) ] = {};
+	int nPackets = 0, nMaxBurst = 0;
+	for ( int nBurst: vecBurstSizes )
+	{
+		int idx = 0;
+		while ( nBurst > k_arBucketMax[idx] )
+			++idx;
+		arPacketsInBucket[idx] += nBurst;
+		nPackets += nBurst;
+		nMaxBurst = std::max( nMaxBurst, nBurst );
+	}
+
+	TEST_Printf( "\tmax burst %5dus  %6.2f MB/sec  %6d pkts  avg burst %5.2f  max %3d  | %5.1f%% %5.1f%% %5.1f%% %5.1f%% %5.1f%% %5.1f%%\n",
+		usecPacingMaxBurst, (double)cbReceived / k_usecSendTime, nPackets,
+		(double)nPackets / vecBurstSizes.size(), nMaxBurst,
+		arPacketsInBucket[0]*100.0/nPackets, arPacketsInBucket[1]*100.0/nPackets,
+		arPacketsInBucket[2]*100.0/nPackets, arPacketsInBucket[3]*100.0/nPackets,
+		arPacketsInBucket[4]*100.0/nPackets, arPacketsInBucket[5]*100.0/nPackets );
+}
+
+static void BenchmarkPacing()
+{
+	TEST_Printf( "Send pacing, loopback at 8MB/sec.  Percent of packets sent in bursts of:\n" );
+	TEST_Printf( "\t%74s %5s  %5s  %5s  %5s  %5s  %5s\n", "", "1", "2", "3-4", "5-8", "9-16", "17+" );
+
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMin, 8*1024*1024 );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMax, 8*1024*1024 );
+
+	GameNetworkingErrMsg errMsg;
+	if ( !GameNetworkingSockets_Init( nullptr, errMsg ) )
+		TEST_Fatal( "GameNetworkingSockets_Init failed.  %s", errMsg );
+	GameNetworkingUtils()->SetDebugOutputFunction( k_EGameNetworkingSocketsDebugOutputType_Msg, PacingDebugOutput );
+
+	for ( int usecPacingMaxBurst: { 0, 1000, 250 } )
+		BenchmarkPacingPass( usecPacingMaxBurst );
+
+	GameNetworkingSockets_Kill();
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMin, 0 );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMax, 0 );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendPacingMaxBurst, 250 );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// SNP receive path: packet and reliable stream gap tracking
+//
+/////////////////////////////////////////////////////////////////////////////
+
+static void BenchmarkSNPRecvGaps()
+{
+	TEST_Printf( "SNP receive path, loopback with simulated loss and reordering on receive:\n" );
+	BenchmarkSNPReliableStreamInit();
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_FakePacketReorder_Time, 2 );
+
+	// Each pattern creates gaps in a different way.  Loss creates gaps
+	// that are filled by retransmission (in a different packet), while
+	// reordering creates gaps that are filled by the original packet
+	// arriving late.
+	struct RecvPattern_t
+	{
+		float m_flLossPct;
+		float m_flReorderPct;
+	};
+	static const RecvPattern_t k_arPatterns[] =
+	{
+		{ 0.0f, 0.0f },
+		{ 2.0f, 0.0f },
+		{ 0.0f, 2.0f },
+		{ 0.0f, 10.0f },
+		{ 2.0f, 10.0f },
+	};
+	for ( const RecvPattern_t &p: k_arPatterns )
+	{
+		GameNetworkingUtils()->SetGlobalConfigValueFloat( k_EGameNetworkingConfig_FakePacketLoss_Recv, p.m_flLossPct );
+		GameNetworkingUtils()->SetGlobalConfigValueFloat( k_EGameNetworkingConfig_FakePacketReorder_Recv, p.m_flReorderPct );
+
+		char szDesc[ 64 ];
+		V_sprintf_safe( szDesc, "loss %4.1f%%  reorder %4.1f%%", p.m_flLossPct, p.m_flReorderPct );
+		BenchmarkSNPReliableStreamPass( szDesc );
+	}
+
+	GameNetworkingUtils()->SetGlobalConfigValueFloat( k_EGameNetworkingConfig_FakePacketLoss_Recv, 0.0f );
+	GameNetworkingUtils()->SetGlobalConfigValueFloat( k_EGameNetworkingConfig_FakePacketReorder_Recv, 0.0f );
+	BenchmarkSNPReliableStreamKill();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Lanes.  A bulk reliable transfer shares a connection with small,
+// latency sensitive reliable messages.  Measure how long the small
+// messages take to arrive, with everything in one lane, and with the
+// small messages in their own high priority lane.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+static void BenchmarkLanesPass( const char *pszDesc, bool bLanes )
+{
+	const int k_cbBulkMsg = 1000;
+	const int k_cbBulkQueued = 128*1024;
+	const GameNetworkingMicroseconds k_usecSmallMsgInterval = 5000;
+	const GameNetworkingMicroseconds k_usecRunTime = 3*1000*1000;
+
+	HGameNetConnection hSend, hRecv;
+	if ( !GameNetworkingSockets()->CreateSocketPair( &hSend, &hRecv, true, nullptr, nullptr ) )
+		TEST_Fatal( "CreateSocketPair failed" );
+
+	int idxBulkLane = 0;
+	if ( bLanes )
+	{
+		const int arPriorities[] = { 0, 1 };
+		if ( GameNetworkingSockets()->ConfigureConnectionLanes( hSend, 2, arPriorities, nullptr ) != k_EResultOK )
+			TEST_Fatal( "ConfigureConnectionLanes failed" );
+		idxBulkLane = 1;
+	}
+
+	auto SendOnLane = [hSend]( const void *pData, int cbData, int idxLane ) -> bool
+	{
+		GameNetworkingMessage_t *pMsg = GameNetworkingUtils()->AllocateMessage( cbData );
+		memcpy( pMsg->m_pData, pData, cbData );
+		pMsg->m_conn = hSend;
+		pMsg->m_nFlags = k_nGameNetworkingSend_ReliableNoNagle;
+		pMsg->m_idxLane = (uint16)idxLane;
+		int64 nResult;
+		GameNetworkingSockets()->SendMessages( 1, &pMsg, &nResult );
+		return nResult > 0;
+	};
+
+	char bulk[ k_cbBulkMsg ];
+	memset( bulk, 0x5a, sizeof(bulk) );
+	GameNetworkingMessage_t *arMsg[ 64 ];
+	std::vector<GameNetworkingMicroseconds> vecLatency;
+	int64 cbBulkReceived = 0;
+	GameNetworkingMicroseconds usecStart = GameNetworkingSockets_GetLocalTimestamp();
+	GameNetworkingMicroseconds usecNextSmallMsg = usecStart;
+	for (;;)
+	{
+		GameNetworkingMicroseconds usecNow = GameNetworkingSockets_GetLocalTimestamp();
+		if ( usecNow >= usecStart + k_usecRunTime )
+			break;
+
+		// Keep plenty of bulk data queued, but leave room in the send
+		// buffer for the small messages
+		GameNetworkingQuickConnectionStatus status;
+		GameNetworkingSockets()->GetQuickConnectionStatus( hSend, &status );
+		for ( int cbQueued = status.m_cbPendingReliable ; cbQueued < k_cbBulkQueued ; cbQueued += k_cbBulkMsg )
+		{
+			if ( !SendOnLane( bulk, k_cbBulkMsg, idxBulkLane ) )
+				TEST_Fatal( "Bulk send failed" );
+		}
+
+		// Small message carries its send time
+		if ( usecNow >= usecNextSmallMsg )
+		{
+			if ( !SendOnLane( &usecNow, sizeof(usecNow), 0 ) )
+				TEST_Fatal( "Small message send failed" );
+			usecNextSmallMsg += k_usecSmallMsgInterval;
+		}
+
+		GameNetworkingSockets_Poll( 1 );
+
+		for (;;)
+		{
+			int n = GameNetworkingSockets()->ReceiveMessagesOnConnection( hRecv, arMsg, V_ARRAYSIZE( arMsg ) );
+			if ( n <= 0 )
+				break;
+			usecNow = GameNetworkingSockets_GetLocalTimestamp();
+			for ( int i = 0 ; i < n ; ++i )
+			{
+				if ( arMsg[i]->m_cbSize == sizeof(GameNetworkingMicroseconds) )
+				{
+					GameNetworkingMicroseconds usecSent;
+					memcpy( &usecSent, arMsg[i]->m_pData, sizeof(usecSent) );
+					vecLatency.push_back( usecNow - usecSent );
+				}
+				else
+				{
+					cbBulkReceived += arMsg[i]->m_cbSize;
+				}
+				arMsg[i]->Release();
+			}
+		}
+	}
+
+	GameNetworkingSockets()->CloseConnection( hSend, 0, nullptr, false );
+	GameNetworkingSockets()->CloseConnection( hRecv, 0, nullptr, false );
+
+	if ( vecLatency.empty() )
+		TEST_Fatal( "No small messages received" );
+	std::sort( vecLatency.begin(), vecLatency.end() );
+	auto Pct = [&vecLatency]( double f ) { return vecLatency[ std::min( vecLatency.size()-1, size_t( f * vecLatency.size() ) ) ] / 1000.0; };
+	TEST_Printf( "\t%-16s small msg latency ms: median %7.2f  p99 %7.2f  max %7.2f   bulk %6.2f MB/sec\n",
+		pszDesc, Pct( 0.50 ), Pct( 0.99 ), vecLatency.back() / 1000.0,
+		(double)cbBulkReceived / k_usecRunTime );
+}
+
+static void BenchmarkLanes()
+{
+	TEST_Printf( "Lanes, loopback with 5ms lag, bulk reliable transfer plus small reliable messages:\n" );
+	BenchmarkSNPReliableStreamInit();
+
+	for ( float flLossPct: { 0.0f, 2.0f } )
+	{
+		GameNetworkingUtils()->SetGlobalConfigValueFloat( k_EGameNetworkingConfig_FakePacketLoss_Send, flLossPct );
+
+		char szDesc[ 64 ];
+		V_sprintf_safe( szDesc, "loss %3.1f%%  1 lane ", flLossPct );
+		BenchmarkLanesPass( szDesc, false );
+		V_sprintf_safe( szDesc, "loss %3.1f%%  2 lanes", flLossPct );
+		BenchmarkLanesPass( szDesc, true );
+	}
+
+	GameNetworkingUtils()->SetGlobalConfigValueFloat( k_EGameNetworkingConfig_FakePacketLoss_Send, 0.0f );
+	BenchmarkSNPReliableStreamKill();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Unreliable FEC.  Send large unreliable messages (several packets each)
+// over a lossy loopback connection, and compare how many get through,
+// and what it costs in bandwidth, with different parity group sizes.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+static int64 GetConnectionBytesSent( HGameNetConnection hConn )
+{
+	ConnectionScopeLock connectionLock;
+	CGameNetworkConnectionBase *pConn = GetConnectionByHandle( hConn, connectionLock );
+	if ( !pConn )
+		TEST_Fatal( "Connection went away" );
+	return pConn->m_statsEndToEnd.m_sent.m_bytes.Total();
+}
+
+static void BenchmarkUnreliableFECPass( float flLossPct, int nGroupSize )
+{
+	const int k_nMessages = 300;
+	const int k_cbMsg = 8000;
+	const GameNetworkingMicroseconds k_usecMsgInterval = 3000;
+
+	HGameNetConnection hSend, hRecv;
+	if ( !GameNetworkingSockets()->CreateSocketPair( &hSend, &hRecv, true, nullptr, nullptr ) )
+		TEST_Fatal( "CreateSocketPair failed" );
+	GameNetworkingUtils()->SetConnectionConfigValueInt32( hSend, k_EGameNetworkingConfig_UnreliableFECGroupSize, nGroupSize );
+
+	char msg[ k_cbMsg ];
+	for ( int i = 0 ; i < k_cbMsg ; ++i )
+		msg[i] = (char)( i*7 );
+	GameNetworkingMessage_t *arMsg[ 64 ];
+	int nSent = 0, nReceived = 0, nCorrupt = 0;
+	int64 cbSentBefore = GetConnectionBytesSent( hSend );
+	GameNetworkingMicroseconds usecNextSend = GameNetworkingSockets_GetLocalTimestamp();
+	GameNetworkingMicroseconds usecDone = INT64_MAX;
+	for (;;)
+	{
+		GameNetworkingMicroseconds usecNow = GameNetworkingSockets_GetLocalTimestamp();
+		if ( nSent < k_nMessages && usecNow >= usecNextSend )
+		{
+			if ( GameNetworkingSockets()->SendMessageToConnection( hSend, msg, k_cbMsg, k_nGameNetworkingSend_UnreliableNoNagle, nullptr ) != k_EResultOK )
+				TEST_Fatal( "Send failed" );
+			++nSent;
+			usecNextSend += k_usecMsgInterval;
+			if ( nSent == k_nMessages )
+				usecDone = usecNow + 200*1000;
+		}
+		if ( usecNow >= usecDone )
+			break;
+
+		GameNetworkingSockets_Poll( 1 );
+
+		for (;;)
+		{
+			int n = GameNetworkingSockets()->ReceiveMessagesOnConnection( hRecv, arMsg, V_ARRAYSIZE( arMsg ) );
+			if ( n <= 0 )
+				break;
+			for ( int i = 0 ; i < n ; ++i )
+			{
+				if ( arMsg[i]->m_cbSize != k_cbMsg || memcmp( arMsg[i]->m_pData, msg, k_cbMsg ) != 0 )
+					++nCorrupt;
+				arMsg[i]->Release();
+			}
+			nReceived += n;
+		}
+	}
+	int64 cbSent = GetConnectionBytesSent( hSend ) - cbSentBefore;
+
+	GameNetworkingSockets()->CloseConnection( hSend, 0, nullptr, false );
+	GameNetworkingSockets()->CloseConnection( hRecv, 0, nullptr, false );
+
+	if ( nCorrupt > 0 )
+		TEST_Fatal( "%d messages were corrupt", nCorrupt );
+
+	char szFEC[ 32 ];
+	if ( nGroupSize > 0 )
+		V_sprintf_safe( szFEC, "group %2d", nGroupSize );
+	else
+		V_strcpy_safe( szFEC, "FEC off " );
+	TEST_Printf( "\tloss %4.1f%%  %s   delivered %6.2f%%   wire bytes per payload byte %5.3f\n",
+		flLossPct, szFEC, nReceived * 100.0 / k_nMessages, (double)cbSent / ( (double)k_nMessages * k_cbMsg ) );
+}
+
+static void BenchmarkUnreliableFEC()
+{
+	TEST_Printf( "Unreliable FEC, loopback with simulated loss, 8000-byte unreliable messages:\n" );
+	BenchmarkSNPReliableStreamInit();
+
+	for ( float flLossPct: { 0.0f, 1.0f, 2.0f, 5.0f, 10.0f } )
+	{
+		GameNetworkingUtils()->SetGlobalConfigValueFloat( k_EGameNetworkingConfig_FakePacketLoss_Send, flLossPct );
+		for ( int nGroupSize: { 0, 8, 4, 2 } )
+			BenchmarkUnreliableFECPass( flLossPct, nGroupSize );
+	}
+
+	GameNetworkingUtils()->SetGlobalConfigValueFloat( k_EGameNetworkingConfig_FakePacketLoss_Send, 0.0f );
+	BenchmarkSNPReliableStreamKill();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Config snapshot.  Compare resolving the per-packet config values through
+// the inheritance chain against reading them out of the cached snapshot.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+static void BenchmarkConfigSnapshot()
+{
+	const int k_nReads = 10*1000*1000;
+
+	TEST_Printf( "Per-packet config reads on a loopback connection:\n" );
+	BenchmarkSNPReliableStreamInit();
+
+	HGameNetConnection hSend, hRecv;
+	if ( !GameNetworkingSockets()->CreateSocketPair( &hSend, &hRecv, true, nullptr, nullptr ) )
+		TEST_Fatal( "CreateSocketPair failed" );
+
+	{
+		ConnectionScopeLock connectionLock;
+		CGameNetworkConnectionBase *pConn = GetConnectionByHandle( hSend, connectionLock );
+		if ( !pConn )
+			TEST_Fatal( "Connection went away" );
+
+		// Same handful of values SNP reads on every packet
+		int64 nSum = 0;
+		std::clock_t cpuStart = std::clock();
+		for ( int i = 0 ; i < k_nReads ; ++i )
+		{
+			const ConnectionConfig &config = pConn->m_connectionConfig;
+			nSum += config.m_LogLevel_PacketDecode.Get();
+			nSum += config.m_SendRateMin.Get();
+			nSum += config.m_SendRateMax.Get();
+			nSum += config.m_CongestionControl.Get();
+		}
+		double nsecChain = double( std::clock() - cpuStart ) * 1e9 / CLOCKS_PER_SEC / k_nReads;
+
+		cpuStart = std::clock();
+		for ( int i = 0 ; i < k_nReads ; ++i )
+		{
+			const ConnectionConfigSnapshot &config = pConn->ConfigSnapshot();
+			nSum += config.m_LogLevel_PacketDecode;
+			nSum += config.m_nSendRateMin;
+			nSum += config.m_nSendRateMax;
+			nSum += config.m_CongestionControl;
+		}
+		double nsecSnapshot = double( std::clock() - cpuStart ) * 1e9 / CLOCKS_PER_SEC / k_nReads;
+
+		TEST_Printf( "\tinherit chain   %6.2f nsec/packet\n", nsecChain );
+		TEST_Printf( "\tsnapshot        %6.2f nsec/packet   (checksum %lld)\n", nsecSnapshot, (long long)nSum );
+	}
+
+	// Make sure a change at any scope is picked up
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_LogLevel_PacketDecode, k_EGameNetworkingSocketsDebugOutputType_Verbose );
+	GameNetworkingUtils()->SetConnectionConfigValueInt32( hSend, k_EGameNetworkingConfig_SendRateMin, 2*1024*1024 );
+	{
+		ConnectionScopeLock connectionLock;
+		CGameNetworkConnectionBase *pConn = GetConnectionByHandle( hSend, connectionLock );
+		if ( !pConn )
+			TEST_Fatal( "Connection went away" );
+		const ConnectionConfigSnapshot &config = pConn->ConfigSnapshot();
+		if ( config.m_LogLevel_PacketDecode != k_EGameNetworkingSocketsDebugOutputType_Verbose || config.m_nSendRateMin != 2*1024*1024 )
+			TEST_Fatal( "Config snapshot is stale" );
+	}
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_LogLevel_PacketDecode, k_EGameNetworkingSocketsDebugOutputType_Warning );
+
+	GameNetworkingSockets()->CloseConnection( hSend, 0, nullptr, false );
+	GameNetworkingSockets()->CloseConnection( hRecv, 0, nullptr, false );
+	BenchmarkSNPReliableStreamKill();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Timestamps.  What it costs to read the clock, and what reading it for
+// every received packet (instead of once per batch) does to throughput.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+static GameNetworkingMicroseconds s_usecTimestampSink;
+
+static void TimestampPerPacketRecvCallback( const RecvPktInfo_t &info, void *pContext )
+{
+	++s_nRawPacketsReceived;
+	s_usecTimestampSink += GameNetworkingSockets_GetLocalTimestamp();
+}
+
+static void TimestampOSClockRecvCallback( const RecvPktInfo_t &info, void *pContext )
+{
+	++s_nRawPacketsReceived;
+	s_usecTimestampSink += Plat_USTime();
+}
+
+static void TimestampFromInfoRecvCallback( const RecvPktInfo_t &info, void *pContext )
+{
+	++s_nRawPacketsReceived;
+	s_usecTimestampSink += info.m_usecNow;
+}
+
+template <typename F>
+static void BenchmarkTimestampCost( const char *pszName, F fnRead )
+{
+	const int k_nReads = 10*1000*1000;
+	double flStart = Plat_FloatTime();
+	for ( int i = 0 ; i < k_nReads ; ++i )
+		s_usecTimestampSink += fnRead();
+	double flElapsed = Plat_FloatTime() - flStart;
+	TEST_Printf( "\t%-32s %6.2f nsec/read\n", pszName, flElapsed * 1e9 / k_nReads );
+}
+
+static void BenchmarkTimestamp()
+{
+	TEST_Printf( "Clock read cost:\n" );
+
+	// Give the TSC clock time to calibrate, and make sure it never
+	// goes backwards while we're at it
+	GameNetworkingMicroseconds usecPrev = GameNetworkingSockets_GetLocalTimestamp();
+	double flCalibrateUntil = Plat_FloatTime() + .25;
+	while ( Plat_FloatTime() < flCalibrateUntil )
+	{
+		GameNetworkingMicroseconds usecNow = GameNetworkingSockets_GetLocalTimestamp();
+		if ( usecNow < usecPrev )
+			TEST_Fatal( "Local timestamp went backwards by %lldusec", (long long)( usecPrev - usecNow ) );
+		usecPrev = usecNow;
+	}
+
+	BenchmarkTimestampCost( "Plat_USTime (OS clock)", []() { return (GameNetworkingMicroseconds)Plat_USTime(); } );
+	#ifdef __linux__
+		BenchmarkTimestampCost( "CLOCK_MONOTONIC_COARSE", []() {
+			timespec ts;
+			clock_gettime( CLOCK_MONOTONIC_COARSE, &ts );
+			return (GameNetworkingMicroseconds)ts.tv_sec * k_nMillion + ts.tv_nsec / 1000;
+		} );
+	#endif
+	BenchmarkTimestampCost( "GetLocalTimestamp", []() { return GameNetworkingSockets_GetLocalTimestamp(); } );
+
+	// Check that the local clock tracks the OS clock
+	{
+		GameNetworkingMicroseconds usecLocalStart = GameNetworkingSockets_GetLocalTimestamp();
+		uint64 usecOSStart = Plat_USTime();
+		std::this_thread::sleep_for( std::chrono::milliseconds( 500 ) );
+		GameNetworkingMicroseconds usecLocalElapsed = GameNetworkingSockets_GetLocalTimestamp() - usecLocalStart;
+		int64 usecOSElapsed = int64( Plat_USTime() - usecOSStart );
+		TEST_Printf( "\tdrift vs OS clock over %lldms: %lldusec\n", (long long)( usecOSElapsed / 1000 ), (long long)( usecLocalElapsed - usecOSElapsed ) );
+	}
+
+	TEST_Printf( "Raw UDP receive, loopback, clock read in packet callback:\n" );
+	GameNetworkingSockets_SetManualPollMode( true );
+
+	SteamDatagramErrMsg errMsg;
+	IRawUDPSocket *pRawSock[3] = {};
+	{
+		GameNetworkingGlobalLock lock( "BenchmarkTimestamp" );
+		if ( !BGameNetworkingSocketsLowLevelAddRef( errMsg ) )
+			TEST_Fatal( "BGameNetworkingSocketsLowLevelAddRef failed.  %s", errMsg );
+
+		g_nSteamDatagramSocketBufferSize = 4*1024*1024;
+		CRecvPacketCallback::FCallbackRecvPacket arCallbacks[3] = { TimestampOSClockRecvCallback, TimestampPerPacketRecvCallback, TimestampFromInfoRecvCallback };
+		for ( int i = 0 ; i < 3 ; ++i )
+		{
+			GameNetworkingIPAddr addrLocal;
+			addrLocal.SetIPv4( 0x7f000001, 0 );
+			pRawSock[i] = OpenRawUDPSocket( CRecvPacketCallback( arCallbacks[i], (void *)nullptr ), errMsg, &addrLocal, nullptr );
+			if ( !pRawSock[i] )
+				TEST_Fatal( "OpenRawUDPSocket failed.  %s", errMsg );
+		}
+	}
+
+	SOCKET sockSend = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+	if ( sockSend == INVALID_SOCKET )
+		TEST_Fatal( "socket() failed" );
+
+	BenchmarkRawUDPRecvPath( "OS clock per pkt", k_nSteamDatagramMaxRecvBatchSize, pRawSock[0], sockSend );
+	BenchmarkRawUDPRecvPath( "local clock per pkt", k_nSteamDatagramMaxRecvBatchSize, pRawSock[1], sockSend );
+	BenchmarkRawUDPRecvPath( "once per batch", k_nSteamDatagramMaxRecvBatchSize, pRawSock[2], sockSend );
+
+	closesocket( sockSend );
+	{
+		GameNetworkingGlobalLock lock( "BenchmarkTimestamp" );
+		for ( IRawUDPSocket *p: pRawSock )
+			p->Close();
+		GameNetworkingSocketsLowLevelDecRef();
+	}
+	GameNetworkingSockets_SetManualPollMode( false );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Kernel receive timestamps.  A loopback pair, where the service thread
+// is slow to get around to reading the sockets.  Without timestamps, that
+// delay shows up as ping and jitter.  With them, it's reported separately.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+static void BenchmarkRecvTimestampsPass( bool bKernelTimestamps )
+{
+	const int k_msServiceDelay = 5;
+	const int k_msRunTime = 2000;
+
+	// Only applies to sockets opened after it is set
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_RecvKernelTimestamps, bKernelTimestamps ? 1 : 0 );
+
+	HGameNetConnection hSend, hRecv;
+	if ( !GameNetworkingSockets()->CreateSocketPair( &hSend, &hRecv, true, nullptr, nullptr ) )
+		TEST_Fatal( "CreateSocketPair failed" );
+
+	// The peer keeps sending (and so acking) from another thread, so its
+	// packets land in our socket buffer while the service thread is asleep
+	std::atomic<bool> bStop( false );
+	std::thread threadPeer( [&]()
+	{
+		char msg[ 64 ] = {};
+		while ( !bStop.load() )
+		{
+			GameNetworkingSockets()->SendMessageToConnection( hRecv, msg, sizeof(msg), k_nGameNetworkingSend_UnreliableNoNagle, nullptr );
+			std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+		}
+	} );
+
+	char msg[ 64 ] = {};
+	GameNetworkingMessage_t *arMsg[ 64 ];
+	double flStopTime = Plat_FloatTime() + k_msRunTime*1e-3;
+	while ( Plat_FloatTime() < flStopTime )
+	{
+		GameNetworkingSockets()->SendMessageToConnection( hSend, msg, sizeof(msg), k_nGameNetworkingSend_UnreliableNoNagle, nullptr );
+		GameNetworkingSockets_Poll( 0 );
+		for ( HGameNetConnection hConn: { hSend, hRecv } )
+		{
+			int n;
+			while ( ( n = GameNetworkingSockets()->ReceiveMessagesOnConnection( hConn, arMsg, V_ARRAYSIZE( arMsg ) ) ) > 0 )
+			{
+				for ( int i = 0 ; i < n ; ++i )
+					arMsg[i]->Release();
+			}
+		}
+		std::this_thread::sleep_for( std::chrono::milliseconds( k_msServiceDelay ) );
+	}
+	bStop = true;
+	threadPeer.join();
+
+	{
+		ConnectionScopeLock connectionLock;
+		CGameNetworkConnectionBase *pConn = GetConnectionByHandle( hSend, connectionLock );
+		if ( !pConn )
+			TEST_Fatal( "Connection went away" );
+		const LinkStatsTrackerEndToEnd &stats = pConn->m_statsEndToEnd;
+		char szProcessing[ 64 ] = "n/a";
+		if ( stats.m_nRecvProcessingLatencySamples > 0 )
+		{
+			V_sprintf_safe( szProcessing, "%5.2fms avg %5.2fms max",
+				double( stats.m_usecRecvProcessingLatencySum ) / stats.m_nRecvProcessingLatencySamples * 1e-3,
+				stats.m_usecMaxRecvProcessingLatency * 1e-3 );
+		}
+		TEST_Printf( "\t%-18s ping %2dms   recv processing %s\n",
+			bKernelTimestamps ? "kernel timestamps" : "service thread",
+			stats.m_ping.m_nSmoothedPing, szProcessing );
+	}
+
+	GameNetworkingSockets()->CloseConnection( hSend, 0, nullptr, false );
+	GameNetworkingSockets()->CloseConnection( hRecv, 0, nullptr, false );
+}
+
+static void BenchmarkRecvTimestamps()
+{
+	TEST_Printf( "Loopback latency measurement, service thread reads sockets every 5ms:\n" );
+	BenchmarkSNPReliableStreamInit();
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_FakePacketLag_Send, 0 );
+	BenchmarkRecvTimestampsPass( false );
+	BenchmarkRecvTimestampsPass( true );
+	BenchmarkSNPReliableStreamKill();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Poll group receive
+//
+// Many loopback connections in one poll group.  A sender thread blasts
+// unreliable messages round-robin, so the service thread is busy
+// delivering into the poll group while the main thread drains it.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+static double GetThreadCPUSeconds()
+{
+	#ifdef __linux__
+		timespec ts;
+		clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts );
+		return ts.tv_sec + ts.tv_nsec * 1e-9;
+	#else
+		return std::clock() / (double)CLOCKS_PER_SEC;
+	#endif
+}
+
+static void BenchmarkPollGroupRecv()
+{
+	const int k_nConnections = 2000;
+	const int k_cbMsg = 100;
+	const GameNetworkingMicroseconds k_usecSendTime = 3*1000*1000;
+
+	TEST_Printf( "Poll group receive, %d loopback connections, %d byte unreliable messages:\n", k_nConnections, k_cbMsg );
+
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMin, 1024*1024 );
+	GameNetworkingUtils()->SetGlobalConfigValueInt32( k_EGameNetworkingConfig_SendRateMax, 1024*1024 );
+
+	GameNetworkingErrMsg errMsg;
+	if ( !GameNetworkingSockets_Init( nullptr, errMsg ) )
+		TEST_Fatal( "GameNetworkingSockets_Init failed.  %s", errMsg );
+
+	HGameNetPollGroup hPollGroup = GameNetworkingSockets()->CreatePollGroup();
+	std::vector<HGameNetConnection> vecSend( k_nConnections ), vecRecv( k_nConnections );
+	for ( int i = 0 ; i < k_nConnections ; ++i )
+	{
+		if ( !GameNetworkingSockets()->CreateSocketPair( &vecSend[i], &vecRecv[i], true, nullptr, nullptr ) )
+			TEST_Fatal( "CreateSocketPair failed after %d connections", i );
+		if ( !GameNetworkingSockets()->SetConnectionPollGroup( vecRecv[i], hPollGroup ) )
+			TEST_Fatal( "SetConnectionPollGroup failed" );
+	}
+
+	std::atomic<bool> bSending( true );
+	std::atomic<int64> nSent( 0 );
+	std::thread threadSend( [&]()
+	{
+		char msg[ k_cbMsg ];
+		memset( msg, 0x5a, sizeof(msg) );
+		int64 n = 0;
+		GameNetworkingMicroseconds usecEnd = GameNetworkingSockets_GetLocalTimestamp() + k_usecSendTime;
+		while ( GameNetworkingSockets_GetLocalTimestamp() < usecEnd )
+		{
+			for ( HGameNetConnection hConn: vecSend )
+			{
+				if ( GameNetworkingSockets()->SendMessageToConnection( hConn, msg, sizeof(msg), k_nGameNetworkingSend_UnreliableNoNagle, nullptr ) == k_EResultOK )
+					++n;
+			}
+		}
+		nSent = n;
+		bSending = false;
+	} );
+
+	// Drain until the sender is done and nothing more shows up
+	int64 nMsgs = 0, nCalls = 0;
+	GameNetworkingMicroseconds usecStart = GameNetworkingSockets_GetLocalTimestamp();
+	GameNetworkingMicroseconds usecLast = usecStart;
+	double flCPUStart = GetThreadCPUSeconds();
+	GameNetworkingMessage_t *arMsgs[ 256 ];
+	for (;;)
+	{
+		int n = GameNetworkingSockets()->ReceiveMessagesOnPollGroup( hPollGroup, arMsgs, V_ARRAYSIZE( arMsgs ) );
+		++nCalls;
+		if ( n > 0 )
+		{
+			usecLast = GameNetworkingSockets_GetLocalTimestamp();
+			nMsgs += n;
+			for ( int i = 0 ; i < n ; ++i )
+				arMsgs[i]->Release();
+			continue;
+		}
+		if ( !bSending && GameNetworkingSockets_GetLocalTimestamp() > usecLast + 200*1000 )
+			break;
+		std::this_thread::yield();
+	}
+	double flCPU = GetThreadCPUSeconds() - flCPUStart;
+	threadSend.join();
+
+	TEST_Printf( "	%10lld sent %10lld recv %10.0f msgs/sec\n",
+		(long long)nSent, (long long)nMsgs, nMsgs * 1e6 / std::max( usecLast - usecStart, (GameNetworkingMicroseconds)1 ) );
+	TEST_Printf( "	%10.1f ns drain cpu/msg %8.0f ns/call (%lld calls)\n",
+		flCPU * 1e9 / std::max( nMsgs, (int64)1 ), flCPU * 1e9 / std::max( nCalls, (int64)1 ), (long long)nCalls );
+
+	for ( int i = 0 ; i < k_nConnections ; ++i )
+	{
+		GameNetworkingSockets()->CloseConnection( vecSend[i], 0, nullptr, false );
+		GameNetworkingSockets()->CloseConnection( vecRecv[i], 0, nullptr, false );
+	}
+	GameNetworkingSockets()->DestroyPollGroup( hPollGroup );
+	GameNetworkingSockets_Kill();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Broadcast
+//
+// Send the same payload to many connections, either by allocating a copy
+// for each connection and using SendMessages, or with BroadcastMessage.
+// Uses pipe connections, so we are mostly measuring the cost of the
+// send path, not the wire.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+static void BenchmarkBroadcastPass( const char *pszName, bool bBroadcast, int cbMsg, const std::vector<HGameNetConnection> &vecSend, HGameNetPollGroup hRecvPollGroup )
+{
+	const int k_nBroadcasts = 2000;
+	const int nConnections = (int)vecSend.size();
+
+	std::vector<char> vecPayload( cbMsg, 'x' );
+	std::vector<GameNetworkingMessage_t *> vecMsgs( nConnections );
+	GameNetworkingMessage_t *arRecv[ 256 ];
+
+	MessagePoolStats_t statsBefore, statsAfter;
+	MessagePool_GetStats( statsBefore );
+
+	int64 nReceived = 0;
+	GameNetworkingMicroseconds usecSend = 0;
+	GameNetworkingMicroseconds usecStart = GameNetworkingSockets_GetLocalTimestamp();
+	for ( int i = 0 ; i < k_nBroadcasts ; ++i )
+	{
+		GameNetworkingMicroseconds usecSendStart = GameNetworkingSockets_GetLocalTimestamp();
+		if ( bBroadcast )
+		{
+			GameNetworkingMessage_t *pMsg = GameNetworkingUtils()->AllocateMessage( cbMsg );
+			memcpy( pMsg->m_pData, vecPayload.data(), cbMsg );
+			pMsg->m_nFlags = k_nGameNetworkingSend_Unreliable;
+			GameNetworkingSockets()->BroadcastMessage( pMsg, nConnections, vecSend.data(), nullptr );
+		}
+		else
+		{
+			for ( int j = 0 ; j < nConnections ; ++j )
+			{
+				GameNetworkingMessage_t *pMsg = GameNetworkingUtils()->AllocateMessage( cbMsg );
+				memcpy( pMsg->m_pData, vecPayload.data(), cbMsg );
+				pMsg->m_conn = vecSend[j];
+				pMsg->m_nFlags = k_nGameNetworkingSend_Unreliable;
+				vecMsgs[j] = pMsg;
+			}
+			GameNetworkingSockets()->SendMessages( nConnections, vecMsgs.data(), nullptr );
+		}
+		usecSend += GameNetworkingSockets_GetLocalTimestamp() - usecSendStart;
+
+		for (;;)
+		{
+			int n = GameNetworkingSockets()->ReceiveMessagesOnPollGroup( hRecvPollGroup, arRecv, V_ARRAYSIZE( arRecv ) );
+			if ( n <= 0 )
+				break;
+			for ( int j = 0 ; j < n ; ++j )
+				arRecv[j]->Release();
+			nReceived += n;
+		}
+	}
+	GameNetworkingMicroseconds usecElapsed = GameNetworkingSockets_GetLocalTimestamp() - usecStart;
+	if ( nReceived != (int64)k_nBroadcasts * nConnections )
+		TEST_Fatal( "Expected %d messages, received %lld", k_nBroadcasts * nConnections, (long long)nReceived );
+
+	MessagePool_GetStats( statsAfter );
+	TEST_Printf( "\t%-20s %5d bytes %8.1f usec/send %8.1f usec/total %6lld slabs\n",
+		pszName, cbMsg, usecSend / (double)k_nBroadcasts, usecElapsed / (double)k_nBroadcasts,
+		(long long)( statsAfter.m_nSlabs - statsBefore.m_nSlabs ) );
+}
+
+static void BenchmarkBroadcast()
+{
+	const int k_nConnections = 500;
+
+	TEST_Printf( "Broadcast to %d pipe connections:\n", k_nConnections );
+
+	GameNetworkingErrMsg errMsg;
+	if ( !GameNetworkingSockets_Init( nullptr, errMsg ) )
+		TEST_Fatal( "GameNetworkingSockets_Init failed.  %s", errMsg );
+
+	HGameNetPollGroup hRecvPollGroup = GameNetworkingSockets()->CreatePollGroup();
+	std::vector<HGameNetConnection> vecSend( k_nConnections ), vecRecv( k_nConnections );
+	for ( int i = 0 ; i < k_nConnections ; ++i )
+	{
+		if ( !GameNetworkingSockets()->CreateSocketPair( &vecSend[i], &vecRecv[i], false, nullptr, nullptr ) )
+			TEST_Fatal( "CreateSocketPair failed after %d connections", i );
+		GameNetworkingSockets()->SetConnectionPollGroup( vecRecv[i], hRecvPollGroup );
+	}
+
+	for ( int cbMsg: { 200, 1200, 4000 } )
+	{
+		BenchmarkBroadcastPass( "SendMessages", false, cbMsg, vecSend, hRecvPollGroup );
+		BenchmarkBroadcastPass( "BroadcastMessage", true, cbMsg, vecSend, hRecvPollGroup );
+	}
+
+	for ( int i = 0 ; i < k_nConnections ; ++i )
+	{
+		GameNetworkingSockets()->CloseConnection( vecSend[i], 0, nullptr, false );
+		GameNetworkingSockets()->CloseConnection( vecRecv[i], 0, nullptr, false );
+	}
+	GameNetworkingSockets()->DestroyPollGroup( hRecvPollGroup );
+	GameNetworkingSockets_Kill();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// Driver
+//
+/////////////////////////////////////////////////////////////////////////////
+
+struct Benchmark_t
+{
+	const char *m_pszName;
+	void (*m_pfn)();
+};
+
+static const Benchmark_t s_arBenchmarks[] =
+{
+	{ "rawudprecv", BenchmarkRawUDPRecv },
+	{ "rawudpsend", BenchmarkRawUDPSend },
+	{ "rawudpgso", BenchmarkRawUDPSegmentationOffload },
+	{ "recvworkers", BenchmarkRecvWorkers },
+	{ "connectstorm", BenchmarkConnectStorm },
+	{ "handshakeflood", BenchmarkHandshakeFlood },
+	{ "connectflood", BenchmarkConnectFlood },
+	{ "shareddemux", BenchmarkSharedSocketDemux },
+	{ "thinkers", BenchmarkThinkers },
+	{ "conntable", BenchmarkConnectionTable },
+	{ "messagepool", BenchmarkMessagePool },
+	{ "snploss", BenchmarkSNPLoss },
+	{ "snprecvgaps", BenchmarkSNPRecvGaps },
+	{ "pacing", BenchmarkPacing },
+	{ "lanes", BenchmarkLanes },
+	{ "unreliablefec", BenchmarkUnreliableFEC },
+	{ "configsnapshot", BenchmarkConfigSnapshot },
+	{ "timestamp", BenchmarkTimestamp },
+	{ "recvtimestamps", BenchmarkRecvTimestamps },
+	{ "pollgroup", BenchmarkPollGroupRecv },
+	{ "broadcast", BenchmarkBroadcast },
+};
+
+int main( int argc, const char **argv )
+{
+	bool bFound = argc <= 1;
+	for ( const Benchmark_t &b: s_arBenchmarks )
+	{
+		bool bRun = argc <= 1;
+		for ( int i = 1 ; i < argc ; ++i )
+		{
+			if ( strcmp( argv[i], b.m_pszName ) == 0 )
+				bRun = true;
+		}
+		if ( bRun )
+		{
+			bFound = true;
+			b.m_pfn();
+		}
+	}
+	if ( !bFound )
+		TEST_Fatal( "No matching benchmark" );
+	return 0;
+}
@@ -6,6 +6,7 @@
 #include <google/protobuf/text_format.h>
 #include <common/crypto.h>
 #include <common/crypto_25519.h>
+#include <gns/igamenetworkingutils.h>
 
 using namespace GameNetworkingSocketsLib;
 
@@ -39,10 +40,23 @@ void GenerateCert( CMsgSteamDatagramCertificateSigned &msgOut, const char *certD
 	msgOut.set_ca_signature( &sig, sizeof(sig) );
 }
 
+// Failed Asserts are reported here.  They don't stop the test, but
+// the test is set to fail if any are printed.
+static void DebugOutput( EGameNetworkingSocketsDebugOutputType eType, const char *pszMsg )
+{
+	fprintf( stderr, "%s\n", pszMsg );
+}
+
 int main()
 {
 	GameNetworkingErrMsg errMsg;
 
+	GameNetworkingUtils()->SetDebugOutputFunction( k_EGameNetworkingSocketsDebugOutputType_Warning, DebugOutput );
+
+	// The "hardcoded" certs below chain up to the test root key from
+	// make_test_certs.py, not the real one
+	CertStore_SetRootCAKeyForTests( "ssh-ed25519 AAAAC3NzaC1lZDI1NTE5AAAAIOMPsJA3FUaQSsHkyYhWvcYt9v3XbwRBcWuVuayWGdK1 ID9417917822780561193" );
+
 	//
 	// Populate our cert store with some certs.
 	// See make_test_certs.py
@@ -120,6 +134,32 @@ int main()
 	// Shouldn't work for wrong app
 	DbgVerify( !CheckCertAppID( msgCert, pCertScope, 570, errMsg ) );
 
+	// Checking the same cert again should hit the signature cache
+	{
+		CASignatureCacheStats_t statsBefore, statsAfter;
+		CertStore_GetSignatureCacheStats( statsBefore );
+		const CertAuthScope *pCertScopeAgain = CertStore_CheckCert( msgCertSigned, msgCert, k_timeTestNow, errMsg );
+		Assert( pCertScopeAgain == pCertScope );
+		CertStore_GetSignatureCacheStats( statsAfter );
+		Assert( statsAfter.m_nHits == statsBefore.m_nHits + 1 );
+
+		// A cached signature must not let us skip the expiry check
+		const time_t k_timeAfterCAExpiry = k_timeTestNow + 100*365*24*3600ll;
+		Assert( !CertStore_CheckCert( msgCertSigned, msgCert, k_timeAfterCAExpiry, errMsg ) );
+		Assert( V_stristr( errMsg, "expired" ) != nullptr );
+		CertStore_GetSignatureCacheStats( statsAfter );
+		Assert( statsAfter.m_nHits == statsBefore.m_nHits + 1 );
+
+		// But a tampered signature must not
+		CMsgSteamDatagramCertificateSigned msgCertTampered = msgCertSigned;
+		std::string sig = msgCertTampered.ca_signature();
+		sig[0] ^= 1;
+		msgCertTampered.set_ca_signature( sig );
+		Assert( !CertStore_CheckCert( msgCertTampered, msgCert, k_timeTestNow, errMsg ) );
+		CertStore_GetSignatureCacheStats( statsAfter );
+		Assert( statsAfter.m_nHits == statsBefore.m_nHits + 1 );
+	}
+
 	// Should work for any POPID
 	DbgVerify( CheckCertPOPID( msgCert, pCertScope, iad, errMsg ) );
 	DbgVerify( CheckCertPOPID( msgCert, pCertScope, sto, errMsg ) );